@@ -17,6 +17,7 @@
 #define CONFIG_MANAGER_H
 
 #include <cerrno>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -111,6 +112,8 @@ public:
     bool getUseExternalMemory() const { return mUseExternalMemory; }
     void setExternalMemoryFormat(android_pixel_format_t format) { mExternalMemoryFormat = format; }
     android_pixel_format_t getExternalMemoryFormat() const { return mExternalMemoryFormat; }
+    void setStreamFormat(android_pixel_format_t format) { mStreamFormat = format; }
+    std::optional<android_pixel_format_t> getStreamFormat() const { return mStreamFormat; }
     void setMockGearSignal(int32_t signal) { mMockGearSignal = signal; }
     int32_t getMockGearSignal() const { return mMockGearSignal; }
 
@@ -128,6 +131,9 @@ private:
     // Format of external memory
     android_pixel_format_t mExternalMemoryFormat;
 
+    // Format the GL renderers ask the cameras for, unless they pick it from the camera metadata
+    std::optional<android_pixel_format_t> mStreamFormat;
+
     // Gear signal to simulate in test mode
     int32_t mMockGearSignal;
 
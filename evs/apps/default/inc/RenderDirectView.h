@@ -24,6 +24,7 @@
 #include <aidl/android/hardware/automotive/evs/BufferDesc.h>
 #include <aidl/android/hardware/automotive/evs/CameraDesc.h>
 #include <aidl/android/hardware/automotive/evs/IEvsEnumerator.h>
+#include <aidl/android/hardware/automotive/evs/Stream.h>
 #include <math/mat2.h>
 
 /*
@@ -42,14 +43,22 @@ public:
     virtual bool drawFrame(const aidl::android::hardware::automotive::evs::BufferDesc& tgtBuffer);
 
 protected:
+    // Opens the camera in the configured format, or in RGBA if rgbaOnly
+    bool openTexture(bool rgbaOnly);
+
+    // Builds the shader program for the sampling of the current texture
+    bool prepareShader();
+
     std::shared_ptr<aidl::android::hardware::automotive::evs::IEvsEnumerator> mEnumerator;
     ConfigManager::CameraInfo mCameraInfo;
     aidl::android::hardware::automotive::evs::CameraDesc mCameraDesc;
     const ConfigManager& mConfig;
 
+    aidl::android::hardware::automotive::evs::Stream mStreamConfig;
     std::unique_ptr<VideoTex> mTexture;
 
     GLuint mShaderProgram = 0;
+    VideoSampling mShaderSampling = VideoSampling::kRgba;
 
     android::mat2 mRotationMat;
 };
@@ -19,6 +19,7 @@
 
 #include "ConfigManager.h"
 #include "RenderBase.h"
+#include "TopViewMesh.h"
 #include "VideoTex.h"
 
 #include <aidl/android/hardware/automotive/evs/BufferDesc.h>
@@ -44,12 +45,28 @@ protected:
         const ConfigManager::CameraInfo& info;
         std::unique_ptr<VideoTex> tex;
 
+        // The part of the ground this camera sees, from the TopViewMesh
+        GLuint vertexBuffer = 0;
+        GLuint indexBuffer = 0;
+        GLsizei indexCount = 0;
+
         ActiveCamera(const ConfigManager::CameraInfo& c) : info(c){};
     };
 
+    // Opens the camera streaming in the given format
+    VideoTex* openTexture(const ConfigManager::CameraInfo& info, android_pixel_format_t format);
+
+    // Returns the program drawing textures of the given sampling onto the ground, building it
+    // the first time
+    GLuint getRemapProgram(VideoSampling sampling);
+
     void renderCarTopView();
     void renderCameraOntoGroundPlane(const ActiveCamera& cam);
 
+    // Rebuilds the ground meshes of all cameras when the visible part of the ground changes
+    void updateGroundMeshes(const TopViewMesh::Extents& extents);
+    void releaseGroundMeshes();
+
     std::shared_ptr<aidl::android::hardware::automotive::evs::IEvsEnumerator> mEnumerator;
     const ConfigManager& mConfig;
     std::vector<ActiveCamera> mActiveCameras;
@@ -61,9 +78,15 @@ protected:
 
     struct {
         GLuint simpleTexture;
-        GLuint projectedTexture;
+        GLuint remapTexture;
+        GLuint remapTextureExternal = 0;
+        GLuint remapTextureYuv = 0;
     } mPgmAssets;
 
+    // The ground extents the current meshes were built for, if any
+    bool mGroundMeshesValid = false;
+    TopViewMesh::Extents mGroundExtents = {};
+
     android::mat4 orthoMatrix;
 };
 
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAR_EVS_APP_TOPVIEWMESH_H
+#define CAR_EVS_APP_TOPVIEWMESH_H
+
+#include "ConfigManager.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Precomputed remap from the ground plane to the camera images for the top down view.
+ *
+ * The visible ground is split into a regular grid, whose cells are cut along the edges of every
+ * camera image crossing them.  Each piece of a cell then lies either inside or outside of each
+ * image.  Each camera gets the triangles of the pieces it sees, where every vertex carries the
+ * projective texture coordinates of its ground position in that camera's image and in the images
+ * of the other cameras seeing the same piece.  With these, the shader computes the share of the
+ * camera for every pixel: shares fade out towards the edges of each image and add up to one, so
+ * drawing every camera mesh with additive blending stitches the views together.  Nothing here
+ * touches GL, so the remap can be checked on the host.
+ */
+class TopViewMesh final {
+public:
+    // Cameras besides its own that a vertex carries the image positions of; a piece of the
+    // ground seen by more cameras is blended from those seeing it furthest from their edges
+    static constexpr unsigned kMaxOverlaps = 3;
+
+    struct Vertex {
+        float x, y;     // Ground position in car space
+        float s, t, q;  // Texture coordinates in the camera image are (s / q, t / q)
+
+        // The same for the other cameras seeing this piece of the ground, as (s, t, q), in the
+        // order of the cameras.  Unused ones have q == 0.
+        float overlaps[kMaxOverlaps][3];
+    };
+
+    struct CameraMesh {
+        std::vector<Vertex> vertices;
+        std::vector<uint16_t> indices;  // Triangle list
+    };
+
+    // The part of the ground plane covered by the display, in car space
+    struct Extents {
+        float top;
+        float bottom;
+        float left;
+        float right;
+
+        bool operator==(const Extents& other) const {
+            return top == other.top && bottom == other.bottom && left == other.left &&
+                    right == other.right;
+        }
+        bool operator!=(const Extents& other) const { return !(*this == other); }
+    };
+
+    // Grid cells along the longer side of the display; keeps the vertex count within 16 bits
+    static constexpr unsigned kDefaultCells = 64;
+
+    // How far into each image, in texture coordinates, the share of a camera fades in; the
+    // "feather" uniform of the remap shaders
+    static constexpr float kDefaultFeather = 0.08f;
+
+    // Returns one mesh per camera, in the given order.  A camera which sees none of the ground
+    // gets an empty mesh.
+    static std::vector<CameraMesh> build(const std::vector<ConfigManager::CameraInfo>& cameras,
+                                         const Extents& extents, unsigned cells = kDefaultCells);
+};
+
+#endif  // CAR_EVS_APP_TOPVIEWMESH_H
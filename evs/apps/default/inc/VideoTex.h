@@ -31,6 +31,22 @@
 #include <aidl/android/hardware/automotive/evs/Stream.h>
 
 #include <system/graphics-base.h>
+#include <ui/GraphicBuffer.h>
+
+#include <sys/types.h>
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// How the shaders read a video texture.  RGBA frames are plain 2D textures.  YUV frames are
+// imported as external images; the shader converts their samples to RGB itself when the driver
+// exposes them raw through GL_EXT_YUV_target, and the external sampler converts them otherwise.
+enum class VideoSampling {
+    kRgba,
+    kExternal,
+    kYuv,
+};
 
 class VideoTex final : public TexWrapper {
     friend VideoTex* createVideoTexture(
@@ -45,22 +61,59 @@ public:
 
     bool refresh();  // returns true if the texture contents were updated
 
+    VideoSampling sampling() const { return mSampling; }
+    GLenum glTarget() const {
+        return mSampling == VideoSampling::kRgba ? GL_TEXTURE_2D : GL_TEXTURE_EXTERNAL_OES;
+    }
+
+    // True once a YUV frame could not be imported into GL; the owner should stream RGBA instead
+    bool importFailed() const { return mImportFailed; }
+
 private:
     VideoTex(std::shared_ptr<aidl::android::hardware::automotive::evs::IEvsEnumerator> pEnum,
              std::shared_ptr<aidl::android::hardware::automotive::evs::IEvsCamera> pCamera,
-             std::shared_ptr<StreamHandler> pStreamHandler, EGLDisplay glDisplay);
+             std::shared_ptr<StreamHandler> pStreamHandler, EGLDisplay glDisplay,
+             android_pixel_format_t format);
 
     std::shared_ptr<aidl::android::hardware::automotive::evs::IEvsEnumerator> mEnumerator;
     std::shared_ptr<aidl::android::hardware::automotive::evs::IEvsCamera> mCamera;
     std::shared_ptr<StreamHandler> mStreamHandler;
     aidl::android::hardware::automotive::evs::BufferDesc mImageBuffer;
 
+    // Camera buffers imported into GL, by buffer id.  The camera cycles through a few buffers, so
+    // each one is imported once instead of every frame.  The whole cache is dropped when a
+    // buffer id comes back with other memory, as the camera has replaced its buffers then.
+    struct CachedImage {
+        dev_t device;  // Identity of the memory behind the buffer
+        ino_t inode;
+        android::sp<android::GraphicBuffer> buffer;
+        EGLImageKHR image;
+        GLuint texture;
+        uint64_t lastUsed;
+    };
+    static constexpr size_t kMaxCachedImages = 8;
+
+    const CachedImage* importImage(native_handle_t* nativeHandle);
+    void releaseImageCache();
+
     EGLDisplay mDisplay;
-    EGLImageKHR mKHRimage = EGL_NO_IMAGE_KHR;
+    VideoSampling mSampling;
+    bool mImportFailed = false;
+    bool mUseImageCache;
+    std::unordered_map<int32_t, CachedImage> mImageCache;
+    uint64_t mImageCacheClock = 0;
+    GLuint mOwnTexture;  // Allocated by TexWrapper; shown until the first frame arrives
+
+    // CPU time spent in refresh(), reported every kStatsInterval frames
+    static constexpr uint64_t kStatsInterval = 900;
+    uint64_t mStatsFrames = 0;
+    uint64_t mStatsImports = 0;
+    int64_t mStatsCpuTimeNs = 0;
 };
 
 // Creates a video texture to draw the camera preview.  format is effective only
-// when useExternalMemory is true.
+// when useExternalMemory is true.  A camera which can't stream in a YUV format is opened again
+// in RGBA.
 VideoTex* createVideoTexture(
         const std::shared_ptr<aidl::android::hardware::automotive::evs::IEvsEnumerator>& pEnum,
         const char* deviceName,
@@ -68,4 +121,14 @@ VideoTex* createVideoTexture(
         EGLDisplay glDisplay, bool useExternalMemory = false,
         android_pixel_format_t format = HAL_PIXEL_FORMAT_RGBA_8888);
 
+// Returns format if the current GL context can sample camera frames of that format, or RGBA,
+// which the camera converts on the CPU, if it can't.
+android_pixel_format_t selectVideoFormat(android_pixel_format_t format);
+
+// Returns the format to stream from a camera: the given format, or without one, a YUV format of
+// an output stream in the camera metadata, or RGBA if there is none.  As with selectVideoFormat,
+// RGBA replaces a YUV format GL can't sample.
+android_pixel_format_t selectStreamFormat(const std::vector<uint8_t>& metadata,
+                                          std::optional<android_pixel_format_t> format);
+
 #endif  // VIDEOTEX_H
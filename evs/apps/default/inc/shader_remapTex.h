@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHADER_REMAP_TEX_H
+#define SHADER_REMAP_TEX_H
+
+// This shader draws a sensor's image over its footprint on the ground using the precomputed
+// texture coordinates of a TopViewMesh.  Meshes are meant to be drawn with additive blending, so
+// the weighted colors of overlapping sensors add up.
+
+const char vtxShader_remapTexture[] = ""
+                                      "#version 300 es                        \n"
+                                      "layout(location = 0) in vec4 pos;      \n"
+                                      "layout(location = 1) in vec3 tex;      \n"
+                                      "layout(location = 2) in vec3 overlap0; \n"
+                                      "layout(location = 3) in vec3 overlap1; \n"
+                                      "layout(location = 4) in vec3 overlap2; \n"
+                                      "uniform mat4 cameraMat;                \n"
+                                      "out vec3 projectedUv;                  \n"
+                                      "out vec3 overlapUv0;                   \n"
+                                      "out vec3 overlapUv1;                   \n"
+                                      "out vec3 overlapUv2;                   \n"
+                                      "void main()                            \n"
+                                      "{                                      \n"
+                                      "   gl_Position = cameraMat * pos;      \n"
+                                      "   projectedUv = tex;                  \n"
+                                      "   overlapUv0 = overlap0;              \n"
+                                      "   overlapUv1 = overlap1;              \n"
+                                      "   overlapUv2 = overlap2;              \n"
+                                      "}                                      \n";
+
+// The share of the sensor in the color of the pixel, among the sensors seeing the same piece of
+// the ground.  Each share fades in over the feather width from the edges of its image, smoothly
+// so that no crease shows where it starts to change, and the shares add up to one.  The meshes
+// end at the edges of the images, where a share is a rounding error away from zero.
+#define REMAP_TEXTURE_SHARE                                                    \
+    "uniform float feather;                                                \n" \
+    "in vec3 projectedUv;                                                  \n" \
+    "in vec3 overlapUv0;                                                   \n" \
+    "in vec3 overlapUv1;                                                   \n" \
+    "in vec3 overlapUv2;                                                   \n" \
+    "float getWeight(vec3 stq)                                             \n" \
+    "{                                                                     \n" \
+    "    if (stq.z <= 0.0f) {                                              \n" \
+    "        return 0.0f;                                                  \n" \
+    "    }                                                                 \n" \
+    "    vec2 uv = stq.xy / stq.z;                                         \n" \
+    "    float distance = min(min(uv.x, 1.0f - uv.x),                      \n" \
+    "                         min(uv.y, 1.0f - uv.y));                     \n" \
+    "    float weight = feather > 0.0f ?                                   \n" \
+    "            smoothstep(0.0f, feather, distance) : 1.0f;               \n" \
+    "    return max(weight, 1e-4f);                                        \n" \
+    "}                                                                     \n" \
+    "float getShare()                                                      \n" \
+    "{                                                                     \n" \
+    "    float own = getWeight(projectedUv);                               \n" \
+    "    float total = own + getWeight(overlapUv0) +                       \n" \
+    "            getWeight(overlapUv1) + getWeight(overlapUv2);            \n" \
+    "    return own / total;                                               \n" \
+    "}                                                                     \n"
+
+const char pixShader_remapTexture[] =
+        "#version 300 es                                        \n"
+        "precision mediump float;                               \n"
+        "uniform sampler2D tex;                                 \n"
+        REMAP_TEXTURE_SHARE
+        "out vec4 color;                                        \n"
+        "void main()                                            \n"
+        "{                                                      \n"
+        "    // Compute perspective correct texture coordinates \n"
+        "    // in the sensor map                               \n"
+        "    vec2 uv = projectedUv.xy / projectedUv.z;          \n"
+        "    float share = getShare();                          \n"
+        "    color = vec4(texture(tex, uv).rgb * share, share); \n"
+        "}                                                      \n";
+
+// Variants of pixShader_remapTexture for camera frames in YUV formats, like those of
+// pixShader_simpleTexture
+const char pixShader_remapTextureExternal[] =
+        "#version 300 es                                        \n"
+        "#extension GL_OES_EGL_image_external_essl3 : require   \n"
+        "precision mediump float;                               \n"
+        "uniform samplerExternalOES tex;                        \n"
+        REMAP_TEXTURE_SHARE
+        "out vec4 color;                                        \n"
+        "void main()                                            \n"
+        "{                                                      \n"
+        "    vec2 uv = projectedUv.xy / projectedUv.z;          \n"
+        "    float share = getShare();                          \n"
+        "    color = vec4(texture(tex, uv).rgb * share, share); \n"
+        "}                                                      \n";
+
+const char pixShader_remapTextureYuv[] =
+        "#version 300 es                                        \n"
+        "#extension GL_EXT_YUV_target : require                 \n"
+        "precision mediump float;                               \n"
+        "uniform __samplerExternal2DY2YEXT tex;                 \n"
+        REMAP_TEXTURE_SHARE
+        "out vec4 color;                                        \n"
+        "void main()                                            \n"
+        "{                                                      \n"
+        "    vec2 uv = projectedUv.xy / projectedUv.z;          \n"
+        "    float share = getShare();                          \n"
+        "    vec3 yuv = texture(tex, uv).xyz;                   \n"
+        "    vec3 rgb = yuv_2_rgb(yuv, itu_601_full_range);     \n"
+        "    color = vec4(rgb * share, share);                  \n"
+        "}                                                      \n";
+
+#undef REMAP_TEXTURE_SHARE
+
+#endif  // SHADER_REMAP_TEX_H
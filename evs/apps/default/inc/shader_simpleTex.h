@@ -40,4 +40,33 @@ const char pixShader_simpleTexture[] = "#version 300 es
                                        "    color = texel;                         \n"
                                        "}                                          \n";
 
+// Variants of pixShader_simpleTexture for camera frames in YUV formats.  The external sampler
+// returns RGB converted by the driver; the YUV sampler returns the raw samples, which are
+// converted here as full range BT.601, the encoding of UVC cameras.
+const char pixShader_simpleTextureExternal[] =
+        "#version 300 es                                       \n"
+        "#extension GL_OES_EGL_image_external_essl3 : require  \n"
+        "precision mediump float;                              \n"
+        "uniform samplerExternalOES tex;                       \n"
+        "in vec2 uv;                                           \n"
+        "out vec4 color;                                       \n"
+        "void main()                                           \n"
+        "{                                                     \n"
+        "    color = texture(tex, uv);                         \n"
+        "}                                                     \n";
+
+const char pixShader_simpleTextureYuv[] =
+        "#version 300 es                                       \n"
+        "#extension GL_EXT_YUV_target : require                \n"
+        "precision mediump float;                              \n"
+        "uniform __samplerExternal2DY2YEXT tex;                \n"
+        "in vec2 uv;                                           \n"
+        "out vec4 color;                                       \n"
+        "void main()                                           \n"
+        "{                                                     \n"
+        "    vec3 yuv = texture(tex, uv).xyz;                  \n"
+        "    vec3 rgb = yuv_2_rgb(yuv, itu_601_full_range);    \n"
+        "    color = vec4(rgb, 1.0);                           \n"
+        "}                                                     \n";
+
 #endif  // SHADER_SIMPLE_TEX_H
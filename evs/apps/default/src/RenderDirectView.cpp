@@ -35,6 +35,7 @@ using aidl::android::hardware::automotive::evs::BufferDesc;
 using aidl::android::hardware::automotive::evs::CameraDesc;
 using aidl::android::hardware::automotive::evs::IEvsEnumerator;
 using aidl::android::hardware::automotive::evs::Stream;
+using aidl::android::hardware::graphics::common::PixelFormat;
 
 typedef struct {
     int32_t id;
@@ -47,6 +48,17 @@ typedef struct {
 
 const size_t kStreamCfgSz = sizeof(RawStreamConfig) / sizeof(int32_t);
 
+const char* getPixelShader(VideoSampling sampling) {
+    switch (sampling) {
+        case VideoSampling::kExternal:
+            return pixShader_simpleTextureExternal;
+        case VideoSampling::kYuv:
+            return pixShader_simpleTextureYuv;
+        default:
+            return pixShader_simpleTexture;
+    }
+}
+
 }  // namespace
 
 RenderDirectView::RenderDirectView(std::shared_ptr<IEvsEnumerator> enumerator,
@@ -76,16 +88,6 @@ bool RenderDirectView::activate() {
         return false;
     }
 
-    // Load our shader program if we don't have it already
-    if (!mShaderProgram) {
-        mShaderProgram = buildShaderProgram(vtxShader_simpleTexture, pixShader_simpleTexture,
-                                            "simpleTexture");
-        if (!mShaderProgram) {
-            LOG(ERROR) << "Error building shader program";
-            return false;
-        }
-    }
-
     bool foundCfg = false;
     std::unique_ptr<Stream> targetCfg(new Stream());
 
@@ -121,17 +123,29 @@ bool RenderDirectView::activate() {
                          << "default parameters will be used.";
         }
     }
-    // This client always wants below input data format
-    targetCfg->format = aidl::android::hardware::graphics::common::PixelFormat::RGBA_8888;
-    foundCfg = true;
-
     targetCfg->width = 1920;
     targetCfg->height = 1080;
-    // Construct our video texture
-    mTexture.reset(createVideoTexture(mEnumerator, mCameraDesc.id.c_str(),
-                                      foundCfg ? std::move(targetCfg) : nullptr, sDisplay,
-                                      mConfig.getUseExternalMemory(),
-                                      mConfig.getExternalMemoryFormat()));
+    mStreamConfig = *targetCfg;
+
+    // Construct our video texture, and the shader which samples it
+    return openTexture(/* rgbaOnly= */ false) && prepareShader();
+}
+
+bool RenderDirectView::openTexture(bool rgbaOnly) {
+    // Frames in YUV formats are converted by the shader, so RGBA is only the fallback
+    std::unique_ptr<Stream> targetCfg(new Stream(mStreamConfig));
+    const android_pixel_format_t format =
+            rgbaOnly ? HAL_PIXEL_FORMAT_RGBA_8888
+                     : selectStreamFormat(mCameraDesc.metadata, mConfig.getStreamFormat());
+    const android_pixel_format_t memoryFormat = rgbaOnly
+            ? HAL_PIXEL_FORMAT_RGBA_8888
+            : selectVideoFormat(mConfig.getExternalMemoryFormat());
+    targetCfg->format = static_cast<PixelFormat>(format);
+
+    // The camera of a previous texture is closed first
+    mTexture = nullptr;
+    mTexture.reset(createVideoTexture(mEnumerator, mCameraDesc.id.c_str(), std::move(targetCfg),
+                                      sDisplay, mConfig.getUseExternalMemory(), memoryFormat));
     if (!mTexture) {
         LOG(ERROR) << "Failed to set up video texture for " << mCameraDesc.id;
         return false;
@@ -140,6 +154,26 @@ bool RenderDirectView::activate() {
     return true;
 }
 
+bool RenderDirectView::prepareShader() {
+    const VideoSampling sampling = mTexture->sampling();
+    if (mShaderProgram && mShaderSampling == sampling) {
+        return true;
+    }
+
+    if (mShaderProgram) {
+        glDeleteProgram(mShaderProgram);
+    }
+    mShaderProgram =
+            buildShaderProgram(vtxShader_simpleTexture, getPixelShader(sampling), "simpleTexture");
+    if (!mShaderProgram) {
+        LOG(ERROR) << "Error building shader program";
+        return false;
+    }
+
+    mShaderSampling = sampling;
+    return true;
+}
+
 void RenderDirectView::deactivate() {
     // Release our video texture
     // We can't hold onto it because some other Render object might need the same camera
@@ -153,6 +187,15 @@ bool RenderDirectView::drawFrame(const BufferDesc& tgtBuffer) {
         return false;
     }
 
+    // Get the latest frame; if the GPU can't sample its format, have the camera convert it
+    mTexture->refresh();
+    if (mTexture->importFailed()) {
+        if (!openTexture(/* rgbaOnly= */ true) || !prepareShader()) {
+            return false;
+        }
+        mTexture->refresh();
+    }
+
     // Select our screen space simple texture shader
     glUseProgram(mShaderProgram);
 
@@ -177,9 +220,8 @@ bool RenderDirectView::drawFrame(const BufferDesc& tgtBuffer) {
     }
 
     // Bind the texture and assign it to the shader's sampler
-    mTexture->refresh();
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, mTexture->glId());
+    glBindTexture(mTexture->glTarget(), mTexture->glId());
 
     GLint sampler = glGetUniformLocation(mShaderProgram, "tex");
     if (sampler < 0) {
@@ -19,77 +19,28 @@
 #include "VideoTex.h"
 #include "glError.h"
 #include "shader.h"
-#include "shader_projectedTex.h"
+#include "shader_remapTex.h"
 #include "shader_simpleTex.h"
+#include <aidl/android/hardware/automotive/evs/CameraDesc.h>
 #include <aidl/android/hardware/automotive/evs/Stream.h>
+#include <aidl/android/hardware/graphics/common/PixelFormat.h>
 
 #include <android-base/logging.h>
 #include <math/mat4.h>
-#include <math/vec3.h>
+
+#include <algorithm>
+#include <cstddef>
 
 namespace {
 
 using aidl::android::hardware::automotive::evs::BufferDesc;
+using aidl::android::hardware::automotive::evs::CameraDesc;
 using aidl::android::hardware::automotive::evs::IEvsEnumerator;
 using aidl::android::hardware::automotive::evs::Stream;
+using aidl::android::hardware::graphics::common::PixelFormat;
 
-// Simple aliases to make geometric math using vectors more readable
-const unsigned X = 0;
-const unsigned Y = 1;
-const unsigned Z = 2;
-
-// Since we assume no roll in these views, we can simplify the required math
-android::vec3 unitVectorFromPitchAndYaw(float pitch, float yaw) {
-    float sinPitch, cosPitch;
-    sincosf(pitch, &sinPitch, &cosPitch);
-    float sinYaw, cosYaw;
-    sincosf(yaw, &sinYaw, &cosYaw);
-    return android::vec3(cosPitch * -sinYaw, cosPitch * cosYaw, sinPitch);
-}
-
-// Helper function to set up a perspective matrix with independent horizontal and vertical
-// angles of view.
-android::mat4 perspective(float hfov, float vfov, float near, float far) {
-    const float tanHalfFovX = tanf(hfov * 0.5f);
-    const float tanHalfFovY = tanf(vfov * 0.5f);
-
-    android::mat4 p(0.0f);
-    p[0][0] = 1.0f / tanHalfFovX;
-    p[1][1] = 1.0f / tanHalfFovY;
-    p[2][2] = -(far + near) / (far - near);
-    p[2][3] = -1.0f;
-    p[3][2] = -(2.0f * far * near) / (far - near);
-    return p;
-}
-
-// Helper function to set up a view matrix for a camera given it's yaw & pitch & location
-// Yes, with a bit of work, we could use lookAt, but it does a lot of extra work
-// internally that we can short cut.
-android::mat4 cameraLookMatrix(const ConfigManager::CameraInfo& cam) {
-    float sinYaw, cosYaw;
-    sincosf(cam.yaw, &sinYaw, &cosYaw);
-
-    // Construct principal unit vectors
-    android::vec3 vAt = unitVectorFromPitchAndYaw(cam.pitch, cam.yaw);
-    android::vec3 vRt = android::vec3(cosYaw, sinYaw, 0.0f);
-    android::vec3 vUp = -cross(vAt, vRt);
-    android::vec3 eye = android::vec3(cam.position[X], cam.position[Y], cam.position[Z]);
-
-    android::mat4 Result(1.0f);
-    Result[0][0] = vRt.x;
-    Result[1][0] = vRt.y;
-    Result[2][0] = vRt.z;
-    Result[0][1] = vUp.x;
-    Result[1][1] = vUp.y;
-    Result[2][1] = vUp.z;
-    Result[0][2] = -vAt.x;
-    Result[1][2] = -vAt.y;
-    Result[2][2] = -vAt.z;
-    Result[3][0] = -dot(vRt, eye);
-    Result[3][1] = -dot(vUp, eye);
-    Result[3][2] = dot(vAt, eye);
-    return Result;
-}
+// Bytes between the vertex attributes of a TopViewMesh
+const GLsizei kVertexStride = sizeof(TopViewMesh::Vertex);
 
 }  // namespace
 
@@ -119,10 +70,9 @@ bool RenderTopView::activate() {
         LOG(ERROR) << "Failed to build shader program";
         return false;
     }
-    mPgmAssets.projectedTexture =
-            buildShaderProgram(vtxShader_projectedTexture, pixShader_projectedTexture,
-                               "projectedTexture");
-    if (!mPgmAssets.projectedTexture) {
+    mPgmAssets.remapTexture =
+            buildShaderProgram(vtxShader_remapTexture, pixShader_remapTexture, "remapTexture");
+    if (!mPgmAssets.remapTexture) {
         LOG(ERROR) << "Failed to build shader program";
         return false;
     }
@@ -142,30 +92,74 @@ bool RenderTopView::activate() {
         return false;
     }
 
+    // The camera metadata tells which cameras stream in a YUV format unless one is configured
+    std::vector<CameraDesc> cameraList;
+    if (auto status = mEnumerator->getCameraList(&cameraList); !status.isOk()) {
+        LOG(WARNING) << "Failed to get the camera list; cameras stream in RGBA unless configured";
+    }
+
     // Set up streaming video textures for our associated cameras
+    const std::vector<uint8_t> noMetadata;
     for (auto&& cam : mActiveCameras) {
-    std::unique_ptr<Stream> targetCfg(new Stream());
-    targetCfg->format = aidl::android::hardware::graphics::common::PixelFormat::RGBA_8888;
-    targetCfg->width = cam.info.width;
-    targetCfg->height = cam.info.height;
-        cam.tex.reset(
-                createVideoTexture(mEnumerator, cam.info.cameraId.c_str(), std::move(targetCfg), sDisplay));
+        const auto desc = std::find_if(cameraList.begin(), cameraList.end(),
+                                       [&cam](const CameraDesc& d) {
+                                           return d.id == cam.info.cameraId;
+                                       });
+        const android_pixel_format_t format =
+                selectStreamFormat(desc != cameraList.end() ? desc->metadata : noMetadata,
+                                   mConfig.getStreamFormat());
+        cam.tex.reset(openTexture(cam.info, format));
         if (!cam.tex) {
             LOG(ERROR) << "Failed to set up video texture for " << cam.info.cameraId << " ("
                        << cam.info.function << ")";
             return false;
         }
+        if (!getRemapProgram(cam.tex->sampling())) {
+            return false;
+        }
     }
 
     return true;
 }
 
+VideoTex* RenderTopView::openTexture(const ConfigManager::CameraInfo& info,
+                                     android_pixel_format_t format) {
+    // Frames in YUV formats are converted by the shader, so RGBA is only the fallback
+    std::unique_ptr<Stream> targetCfg(new Stream());
+    targetCfg->format = static_cast<PixelFormat>(format);
+    targetCfg->width = info.width;
+    targetCfg->height = info.height;
+    return createVideoTexture(mEnumerator, info.cameraId.c_str(), std::move(targetCfg), sDisplay);
+}
+
+GLuint RenderTopView::getRemapProgram(VideoSampling sampling) {
+    GLuint* program = &mPgmAssets.remapTexture;
+    const char* pixShader = pixShader_remapTexture;
+    if (sampling == VideoSampling::kExternal) {
+        program = &mPgmAssets.remapTextureExternal;
+        pixShader = pixShader_remapTextureExternal;
+    } else if (sampling == VideoSampling::kYuv) {
+        program = &mPgmAssets.remapTextureYuv;
+        pixShader = pixShader_remapTextureYuv;
+    }
+
+    if (!*program) {
+        *program = buildShaderProgram(vtxShader_remapTexture, pixShader, "remapTexture");
+        if (!*program) {
+            LOG(ERROR) << "Failed to build shader program";
+        }
+    }
+    return *program;
+}
+
 void RenderTopView::deactivate() {
     // Release our video textures
     // We can't hold onto it because some other Render object might need the same camera
     for (auto&& cam : mActiveCameras) {
         cam.tex = nullptr;
     }
+
+    releaseGroundMeshes();
 }
 
 bool RenderTopView::drawFrame(const BufferDesc& tgtBuffer) {
@@ -189,18 +183,39 @@ bool RenderTopView::drawFrame(const BufferDesc& tgtBuffer) {
     // naturally aligned in the top down view.
     orthoMatrix = android::mat4::ortho(left, right, top, bottom, near, far);
 
+    // The meshes depend on the car configuration and the display only, so this rarely does work
+    updateGroundMeshes({top, bottom, left, right});
+
     // Refresh our video texture contents.  We do it all at once in hopes of getting
     // better coherence among images.  This does not guarantee synchronization, of course...
     for (auto&& cam : mActiveCameras) {
-        if (cam.tex) {
-            cam.tex->refresh();
+        if (!cam.tex) {
+            continue;
+        }
+
+        // If the GPU can't sample the format of a camera, have the camera convert its frames
+        cam.tex->refresh();
+        if (cam.tex->importFailed()) {
+            cam.tex = nullptr;
+            cam.tex.reset(openTexture(cam.info, HAL_PIXEL_FORMAT_RGBA_8888));
+            if (cam.tex) {
+                cam.tex->refresh();
+            }
         }
     }
 
-    // Iterate over all the cameras and project their images onto the ground plane
+    // Ground no camera sees stays black
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // Iterate over all the cameras and draw their images over their parts of the ground plane.
+    // The weighted colors add up where cameras overlap; the destination alpha stays opaque.
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE);
     for (auto&& cam : mActiveCameras) {
         renderCameraOntoGroundPlane(cam);
     }
+    glDisable(GL_BLEND);
 
     // Draw the car image
     renderCarTopView();
@@ -269,62 +284,105 @@ void RenderTopView::renderCarTopView() {
     glDisableVertexAttribArray(1);
 }
 
-// NOTE:  Might be worth reviewing the ideas at
-// http://math.stackexchange.com/questions/1691895/inverse-of-perspective-matrix
-// to see if that simplifies the math, although we'll still want to compute the actual ground
-// interception points taking into account the pitchLimit as below.
-void RenderTopView::renderCameraOntoGroundPlane(const ActiveCamera& cam) {
-    // How far is the farthest any camera should even consider projecting it's image?
-    const float visibleSizeV = mConfig.getDisplayTopLocation() - mConfig.getDisplayBottomLocation();
-    const float visibleSizeH = visibleSizeV * sAspectRatio;
-    const float maxRange = (visibleSizeH > visibleSizeV) ? visibleSizeH : visibleSizeV;
-
-    // Construct the projection matrix (View + Projection) associated with this sensor
-    const android::mat4 V = cameraLookMatrix(cam.info);
-    const android::mat4 P =
-            perspective(cam.info.hfov, cam.info.vfov, cam.info.position[Z], maxRange);
-    const android::mat4 projectionMatix = P * V;
-
-    // Just draw the whole darn ground plane for now -- we're wasting fill rate, but so what?
-    // A 2x optimization would be to draw only the 1/2 space of the window in the direction
-    // the sensor is facing.  A more complex solution would be to construct the intersection
-    // of the sensor volume with the ground plane and render only that geometry.
-    const float top = mConfig.getDisplayTopLocation();
-    const float bottom = mConfig.getDisplayBottomLocation();
-    const float wsHeight = top - bottom;
-    const float wsWidth = wsHeight * sAspectRatio;
-    const float right = wsWidth * 0.5f;
-    const float left = -right;
-
-    const android::vec3 topLeft(left, top, 0.0f);
-    const android::vec3 topRight(right, top, 0.0f);
-    const android::vec3 botLeft(left, bottom, 0.0f);
-    const android::vec3 botRight(right, bottom, 0.0f);
-
-    GLfloat vertsPos[] = {
-            topLeft[X], topLeft[Y], topLeft[Z], topRight[X], topRight[Y], topRight[Z],
-            botLeft[X], botLeft[Y], botLeft[Z], botRight[X], botRight[Y], botRight[Z],
-    };
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, vertsPos);
-    glEnableVertexAttribArray(0);
+void RenderTopView::updateGroundMeshes(const TopViewMesh::Extents& extents) {
+    if (mGroundMeshesValid && mGroundExtents == extents) {
+        return;
+    }
 
-    glDisable(GL_BLEND);
+    releaseGroundMeshes();
 
-    glUseProgram(mPgmAssets.projectedTexture);
-    GLint locCam = glGetUniformLocation(mPgmAssets.projectedTexture, "cameraMat");
-    glUniformMatrix4fv(locCam, 1, false, orthoMatrix.asArray());
-    GLint locProj = glGetUniformLocation(mPgmAssets.projectedTexture, "projectionMat");
-    glUniformMatrix4fv(locProj, 1, false, projectionMatix.asArray());
+    std::vector<ConfigManager::CameraInfo> cameras;
+    cameras.reserve(mActiveCameras.size());
+    for (auto&& cam : mActiveCameras) {
+        cameras.emplace_back(cam.info);
+    }
+    const auto meshes = TopViewMesh::build(cameras, extents);
+
+    // Each mesh is uploaded once and drawn as is until the extents change again
+    for (size_t i = 0; i < mActiveCameras.size(); i++) {
+        auto& cam = mActiveCameras[i];
+        const auto& mesh = meshes[i];
+        if (mesh.indices.empty()) {
+            LOG(WARNING) << cam.info.cameraId << " sees nothing of the top view";
+            continue;
+        }
 
-    GLuint texId;
+        glGenBuffers(1, &cam.vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, cam.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(TopViewMesh::Vertex),
+                     mesh.vertices.data(), GL_STATIC_DRAW);
+        glGenBuffers(1, &cam.indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cam.indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint16_t),
+                     mesh.indices.data(), GL_STATIC_DRAW);
+        cam.indexCount = mesh.indices.size();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    mGroundExtents = extents;
+    mGroundMeshesValid = true;
+}
+
+void RenderTopView::releaseGroundMeshes() {
+    for (auto&& cam : mActiveCameras) {
+        if (cam.vertexBuffer) {
+            glDeleteBuffers(1, &cam.vertexBuffer);
+            cam.vertexBuffer = 0;
+        }
+        if (cam.indexBuffer) {
+            glDeleteBuffers(1, &cam.indexBuffer);
+            cam.indexBuffer = 0;
+        }
+        cam.indexCount = 0;
+    }
+
+    mGroundMeshesValid = false;
+}
+
+// Draws the precomputed mesh of the camera, which covers only the ground the camera sees, so no
+// fragment is spent outside of its footprint.
+void RenderTopView::renderCameraOntoGroundPlane(const ActiveCamera& cam) {
+    if (cam.indexCount == 0) {
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, cam.vertexBuffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, kVertexStride,
+                          reinterpret_cast<const void*>(offsetof(TopViewMesh::Vertex, x)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, kVertexStride,
+                          reinterpret_cast<const void*>(offsetof(TopViewMesh::Vertex, s)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    for (unsigned k = 0; k < TopViewMesh::kMaxOverlaps; k++) {
+        const size_t offset = offsetof(TopViewMesh::Vertex, overlaps) + k * 3 * sizeof(float);
+        glVertexAttribPointer(2 + k, 3, GL_FLOAT, GL_FALSE, kVertexStride,
+                              reinterpret_cast<const void*>(offset));
+        glEnableVertexAttribArray(2 + k);
+    }
+
+    // Cameras lost since activation show the checkerboard
+    GLuint program = mPgmAssets.remapTexture;
+    GLenum target = GL_TEXTURE_2D;
+    GLuint texId = mTexAssets.checkerBoard->glId();
     if (cam.tex) {
+        program = getRemapProgram(cam.tex->sampling());
+        target = cam.tex->glTarget();
         texId = cam.tex->glId();
-    } else {
-        texId = mTexAssets.checkerBoard->glId();
     }
-    glBindTexture(GL_TEXTURE_2D, texId);
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glUseProgram(program);
+    GLint locCam = glGetUniformLocation(program, "cameraMat");
+    glUniformMatrix4fv(locCam, 1, false, orthoMatrix.asArray());
+    glUniform1f(glGetUniformLocation(program, "feather"), TopViewMesh::kDefaultFeather);
+    glBindTexture(target, texId);
 
-    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cam.indexBuffer);
+    glDrawElements(GL_TRIANGLES, cam.indexCount, GL_UNSIGNED_SHORT, nullptr);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (unsigned k = 0; k < 2 + TopViewMesh::kMaxOverlaps; k++) {
+        glDisableVertexAttribArray(k);
+    }
 }
@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TopViewMesh.h"
+
+#include <android-base/logging.h>
+#include <math/mat4.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <tuple>
+
+namespace {
+
+// Simple aliases to make geometric math using vectors more readable
+const unsigned X = 0;
+const unsigned Y = 1;
+const unsigned Z = 2;
+
+// Since we assume no roll in these views, we can simplify the required math
+android::vec3 unitVectorFromPitchAndYaw(float pitch, float yaw) {
+    float sinPitch, cosPitch;
+    sincosf(pitch, &sinPitch, &cosPitch);
+    float sinYaw, cosYaw;
+    sincosf(yaw, &sinYaw, &cosYaw);
+    return android::vec3(cosPitch * -sinYaw, cosPitch * cosYaw, sinPitch);
+}
+
+// Helper function to set up a perspective matrix with independent horizontal and vertical
+// angles of view.
+android::mat4 perspective(float hfov, float vfov, float near, float far) {
+    const float tanHalfFovX = tanf(hfov * 0.5f);
+    const float tanHalfFovY = tanf(vfov * 0.5f);
+
+    android::mat4 p(0.0f);
+    p[0][0] = 1.0f / tanHalfFovX;
+    p[1][1] = 1.0f / tanHalfFovY;
+    p[2][2] = -(far + near) / (far - near);
+    p[2][3] = -1.0f;
+    p[3][2] = -(2.0f * far * near) / (far - near);
+    return p;
+}
+
+// Helper function to set up a view matrix for a camera given it's yaw & pitch & location
+// Yes, with a bit of work, we could use lookAt, but it does a lot of extra work
+// internally that we can short cut.
+android::mat4 cameraLookMatrix(const ConfigManager::CameraInfo& cam) {
+    float sinYaw, cosYaw;
+    sincosf(cam.yaw, &sinYaw, &cosYaw);
+
+    // Construct principal unit vectors
+    android::vec3 vAt = unitVectorFromPitchAndYaw(cam.pitch, cam.yaw);
+    android::vec3 vRt = android::vec3(cosYaw, sinYaw, 0.0f);
+    android::vec3 vUp = -cross(vAt, vRt);
+    android::vec3 eye = android::vec3(cam.position[X], cam.position[Y], cam.position[Z]);
+
+    android::mat4 Result(1.0f);
+    Result[0][0] = vRt.x;
+    Result[1][0] = vRt.y;
+    Result[2][0] = vRt.z;
+    Result[0][1] = vUp.x;
+    Result[1][1] = vUp.y;
+    Result[2][1] = vUp.z;
+    Result[0][2] = -vAt.x;
+    Result[1][2] = -vAt.y;
+    Result[2][2] = -vAt.z;
+    Result[3][0] = -dot(vRt, eye);
+    Result[3][1] = -dot(vUp, eye);
+    Result[3][2] = dot(vAt, eye);
+    return Result;
+}
+
+// A position on the ground, in car space
+struct Point {
+    float x, y;
+};
+
+// Projective texture coordinates of a ground position in the image of a camera
+struct ImagePosition {
+    float s, t, q;
+
+    // The camera sees the position where 0 <= s <= q and 0 <= t <= q.  These are affine in the
+    // ground position, so each edge of an image is a straight line on the ground.
+    bool isInImage() const { return q > 0.0f && s >= 0.0f && s <= q && t >= 0.0f && t <= q; }
+
+    // Distance to the nearest edge of the image in texture coordinates, negative outside
+    float getDistanceToEdge() const {
+        if (q <= 0.0f) {
+            return -std::numeric_limits<float>::max();
+        }
+        const float u = s / q;
+        const float v = t / q;
+        return std::min(std::min(u, 1.0f - u), std::min(v, 1.0f - v));
+    }
+};
+
+// Clip space to texture space, flipped vertically, without the perspective divide so that the
+// GPU interpolates the coordinates correctly
+ImagePosition project(const android::mat4& projection, const Point& p) {
+    const android::vec4 clip = projection * android::vec4(p.x, p.y, 0.0f, 1.0f);
+    return {(clip.x + clip.w) * 0.5f, (clip.w - clip.y) * 0.5f, clip.w};
+}
+
+// A convex piece of a grid cell, by its corners
+using Polygon = std::vector<Point>;
+
+// Cuts the polygon along the line where the affine function of the ground position is zero, into
+// the piece where it's positive and the one where it's negative.  Either may end up empty.
+template <typename Function>
+void splitPolygon(const Polygon& polygon, const Function& function, Polygon* positive,
+                  Polygon* negative) {
+    positive->clear();
+    negative->clear();
+    for (size_t i = 0; i < polygon.size(); ++i) {
+        const Point& a = polygon[i];
+        const Point& b = polygon[(i + 1) % polygon.size()];
+        const float fa = function(a);
+        const float fb = function(b);
+        if (fa >= 0.0f) {
+            positive->push_back(a);
+        }
+        if (fa <= 0.0f) {
+            negative->push_back(a);
+        }
+        if ((fa > 0.0f && fb < 0.0f) || (fa < 0.0f && fb > 0.0f)) {
+            const float k = fa / (fa - fb);
+            const Point cut = {a.x + (b.x - a.x) * k, a.y + (b.y - a.y) * k};
+            positive->push_back(cut);
+            negative->push_back(cut);
+        }
+    }
+    if (positive->size() < 3) {
+        positive->clear();
+    }
+    if (negative->size() < 3) {
+        negative->clear();
+    }
+}
+
+// Cuts the polygon along the edges of the image which cross it, adding the pieces to the list
+void cutAlongImageEdges(const android::mat4& projection, const Polygon& polygon,
+                        std::vector<Polygon>* pieces) {
+    Polygon inside = polygon;
+    Polygon positive, negative;
+    for (int edge = 0; edge < 4; ++edge) {
+        // s, q - s, t and q - t, which are zero along the left, right, top and bottom edges of the
+        // image and positive on the side of the image
+        const auto function = [&projection, edge](const Point& p) {
+            const ImagePosition pos = project(projection, p);
+            const float st = edge < 2 ? pos.s : pos.t;
+            return edge % 2 == 0 ? st : pos.q - st;
+        };
+        splitPolygon(inside, function, &positive, &negative);
+        if (!negative.empty()) {
+            pieces->push_back(negative);
+        }
+        if (positive.empty()) {
+            return;
+        }
+        inside.swap(positive);
+    }
+    pieces->push_back(inside);
+}
+
+}  // namespace
+
+std::vector<TopViewMesh::CameraMesh> TopViewMesh::build(
+        const std::vector<ConfigManager::CameraInfo>& cameras, const Extents& extents,
+        unsigned cells) {
+    std::vector<CameraMesh> meshes(cameras.size());
+    const float width = extents.right - extents.left;
+    const float height = extents.top - extents.bottom;
+    if (cameras.empty() || cells == 0 || width <= 0.0f || height <= 0.0f) {
+        return meshes;
+    }
+
+    // Square cells, as many as asked along the longer side
+    const float cellSize = std::max(width, height) / cells;
+    const unsigned columns = std::max(1u, static_cast<unsigned>(std::ceil(width / cellSize)));
+    const unsigned rows = std::max(1u, static_cast<unsigned>(std::ceil(height / cellSize)));
+    const unsigned stride = columns + 1;
+    const size_t numGridVertices = static_cast<size_t>(stride) * (rows + 1);
+    if (numGridVertices > UINT16_MAX) {
+        LOG(ERROR) << "Too many cells for a top view mesh: " << columns << "x" << rows;
+        return meshes;
+    }
+
+    // Cameras are meant to see this far at most, as in the projection of the old renderer
+    const float maxRange = std::max(width, height);
+    std::vector<android::mat4> projections;
+    projections.reserve(cameras.size());
+    for (const auto& cam : cameras) {
+        projections.push_back(perspective(cam.hfov, cam.vfov, cam.position[Z], maxRange) *
+                              cameraLookMatrix(cam));
+    }
+
+    // Every cell is cut along the edges of the images that cross it, so that every piece lies
+    // either inside or outside of the image of each camera.  The cameras blending a piece then see
+    // all of it, and no camera's image has to end inside a triangle.
+    std::vector<Polygon> pieces;
+    std::vector<Polygon> cut;
+    const auto cutPieces = [&](const Polygon& triangle) {
+        pieces.assign(1, triangle);
+        for (const auto& projection : projections) {
+            cut.clear();
+            for (const auto& piece : pieces) {
+                cutAlongImageEdges(projection, piece, &cut);
+            }
+            pieces.swap(cut);
+        }
+    };
+
+    // The cameras seeing a piece, by how far the middle of the piece is from the edges of their
+    // images, and then by their order
+    std::vector<std::pair<float, size_t>> seeing;
+    seeing.reserve(cameras.size());
+    const auto findCamerasSeeing = [&](const Polygon& piece) {
+        Point middle = {0.0f, 0.0f};
+        for (const auto& p : piece) {
+            middle.x += p.x / piece.size();
+            middle.y += p.y / piece.size();
+        }
+        seeing.clear();
+        for (size_t i = 0; i < cameras.size(); ++i) {
+            const ImagePosition pos = project(projections[i], middle);
+            if (pos.isInImage()) {
+                seeing.emplace_back(-pos.getDistanceToEdge(), i);
+            }
+        }
+        if (seeing.size() > kMaxOverlaps + 1) {
+            std::partial_sort(seeing.begin(), seeing.begin() + kMaxOverlaps + 1, seeing.end());
+            seeing.resize(kMaxOverlaps + 1);
+        }
+        std::sort(seeing.begin(), seeing.end(),
+                  [](const auto& a, const auto& b) { return a.second < b.second; });
+    };
+
+    // Vertices are shared between the triangles of a camera that overlap the same cameras
+    using VertexKey = std::tuple<float, float, std::array<size_t, kMaxOverlaps>>;
+    std::vector<std::map<VertexKey, uint16_t>> indices(cameras.size());
+    std::vector<bool> overflowed(cameras.size(), false);
+    std::vector<uint16_t> fan;
+    const auto addPiece = [&](const Polygon& piece) {
+        findCamerasSeeing(piece);
+        for (const auto& [unused, i] : seeing) {
+            auto& mesh = meshes[i];
+            fan.clear();
+            for (const auto& p : piece) {
+                Vertex vtx = {};
+                vtx.x = p.x;
+                vtx.y = p.y;
+                const ImagePosition pos = project(projections[i], p);
+                vtx.s = pos.s;
+                vtx.t = pos.t;
+                vtx.q = pos.q;
+
+                VertexKey key = {p.x, p.y, {}};
+                auto& others = std::get<2>(key);
+                others.fill(SIZE_MAX);
+                unsigned numOthers = 0;
+                for (const auto& [unused, other] : seeing) {
+                    if (other == i) {
+                        continue;
+                    }
+                    const ImagePosition otherPos = project(projections[other], p);
+                    vtx.overlaps[numOthers][0] = otherPos.s;
+                    vtx.overlaps[numOthers][1] = otherPos.t;
+                    vtx.overlaps[numOthers][2] = otherPos.q;
+                    others[numOthers++] = other;
+                }
+
+                const auto [it, added] = indices[i].try_emplace(key, mesh.vertices.size());
+                if (added) {
+                    overflowed[i] = overflowed[i] || mesh.vertices.size() > UINT16_MAX;
+                    mesh.vertices.push_back(vtx);
+                }
+                fan.push_back(it->second);
+            }
+
+            // Pieces are convex, so a fan of triangles covers each
+            for (size_t k = 1; k + 1 < fan.size(); ++k) {
+                mesh.indices.insert(mesh.indices.end(), {fan[0], fan[k], fan[k + 1]});
+            }
+        }
+    };
+
+    const auto getGridPoint = [&](unsigned row, unsigned col) {
+        return Point{std::min(extents.left + col * cellSize, extents.right),
+                     std::min(extents.bottom + row * cellSize, extents.top)};
+    };
+    for (unsigned row = 0; row < rows; ++row) {
+        for (unsigned col = 0; col < columns; ++col) {
+            const Point bottomLeft = getGridPoint(row, col);
+            const Point bottomRight = getGridPoint(row, col + 1);
+            const Point topLeft = getGridPoint(row + 1, col);
+            const Point topRight = getGridPoint(row + 1, col + 1);
+            for (const auto& triangle : {Polygon{bottomLeft, bottomRight, topLeft},
+                                         Polygon{topLeft, bottomRight, topRight}}) {
+                cutPieces(triangle);
+                for (const auto& piece : pieces) {
+                    addPiece(piece);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        if (overflowed[i]) {
+            LOG(ERROR) << cameras[i].cameraId << " needs too many vertices for a top view mesh";
+            meshes[i] = {};
+            continue;
+        }
+        LOG(DEBUG) << cameras[i].cameraId << " covers " << meshes[i].indices.size() / 3
+                   << " triangles of the ground";
+    }
+
+    return meshes;
+}
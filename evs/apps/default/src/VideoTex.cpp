@@ -20,9 +20,12 @@
 
 #include <aidl/android/hardware/automotive/evs/IEvsCamera.h>
 #include <aidl/android/hardware/automotive/evs/IEvsEnumerator.h>
+#include <aidl/android/hardware/graphics/common/PixelFormat.h>
 #include <aidlcommonsupport/NativeHandle.h>
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <android-base/scopeguard.h>
+#include <system/camera_metadata.h>
 #include <ui/GraphicBuffer.h>
 
 #include <alloca.h>
@@ -31,25 +34,69 @@
 #include <png.h>
 #include <stdio.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace {
 
 using aidl::android::hardware::automotive::evs::BufferDesc;
 using aidl::android::hardware::automotive::evs::IEvsCamera;
 using aidl::android::hardware::automotive::evs::IEvsEnumerator;
 using aidl::android::hardware::automotive::evs::Stream;
+using aidl::android::hardware::graphics::common::PixelFormat;
 using android::GraphicBuffer;
 
+// Set to false to import every frame into GL again, e.g. to measure what the cache saves
+constexpr char kPropImageCache[] = "debug.evs.app.image_cache";
+
+bool isYuvFormat(uint32_t format) {
+    return format == HAL_PIXEL_FORMAT_YCRCB_420_SP || format == HAL_PIXEL_FORMAT_YV12 ||
+            format == HAL_PIXEL_FORMAT_YCBCR_422_I;
+}
+
+bool hasGlExtension(const char* name) {
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if (extensions == nullptr) {
+        return false;
+    }
+
+    // Names are separated by spaces, and some are prefixes of others
+    const size_t length = strlen(name);
+    for (const char* found = strstr(extensions, name); found != nullptr;
+         found = strstr(found + length, name)) {
+        if ((found == extensions || found[-1] == ' ') &&
+            (found[length] == ' ' || found[length] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int64_t getThreadCpuTimeNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
 }  // namespace
 
 VideoTex::VideoTex(std::shared_ptr<IEvsEnumerator> pEnum, std::shared_ptr<IEvsCamera> pCamera,
-                   std::shared_ptr<StreamHandler> pStreamHandler, EGLDisplay glDisplay) :
+                   std::shared_ptr<StreamHandler> pStreamHandler, EGLDisplay glDisplay,
+                   android_pixel_format_t format) :
       TexWrapper(),
       mEnumerator(pEnum),
       mCamera(pCamera),
       mStreamHandler(pStreamHandler),
-      mDisplay(glDisplay) {
+      mDisplay(glDisplay),
+      mSampling(!isYuvFormat(format)                       ? VideoSampling::kRgba
+                        : hasGlExtension("GL_EXT_YUV_target") ? VideoSampling::kYuv
+                                                              : VideoSampling::kExternal),
+      mUseImageCache(android::base::GetBoolProperty(kPropImageCache, true)),
+      mOwnTexture(id) {
     // Nothing but initialization here...
 }
 
@@ -60,11 +107,8 @@ VideoTex::~VideoTex() {
     // Close the camera
     mEnumerator->closeCamera(mCamera);
 
-    // Drop our device texture image
-    if (mKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(mDisplay, mKHRimage);
-        mKHRimage = EGL_NO_IMAGE_KHR;
-    }
+    // Drop our device texture images; TexWrapper deletes its own texture
+    releaseImageCache();
 }
 
 // Return true if the texture contents are changed
@@ -74,12 +118,13 @@ bool VideoTex::refresh() {
         return false;
     }
 
+    const int64_t startTimeNs = getThreadCpuTimeNs();
+
     // If we already have an image backing us, then it's time to return it
     if (getNativeHandle(mImageBuffer) != nullptr) {
-        // Drop our device texture image
-        if (mKHRimage != EGL_NO_IMAGE_KHR) {
-            eglDestroyImageKHR(mDisplay, mKHRimage);
-            mKHRimage = EGL_NO_IMAGE_KHR;
+        // Without the cache, drop our device texture image
+        if (!mUseImageCache) {
+            releaseImageCache();
         }
 
         // Return it since we're done with it
@@ -89,7 +134,6 @@ bool VideoTex::refresh() {
     // Get the new image we want to use as our contents
     mImageBuffer = dupBufferDesc(mStreamHandler->getNewFrame());
 
-    // create a GraphicBuffer from the existing handle
     native_handle_t* nativeHandle = getNativeHandle(mImageBuffer);
     const auto handleGuard =
             android::base::make_scope_guard([nativeHandle] { free(nativeHandle); });
@@ -98,51 +142,147 @@ bool VideoTex::refresh() {
         return false;
     }
 
+    // Point our texture at the buffer, importing it if it's new to us
+    const CachedImage* cached = importImage(nativeHandle);
+    if (cached != nullptr) {
+        id = cached->texture;
+    } else if (mSampling != VideoSampling::kRgba && !mImportFailed) {
+        LOG(WARNING) << "Failed to import a YUV frame; falling back to RGBA frames";
+        mImportFailed = true;
+    }
+
+    // Report how much each frame costs us
+    mStatsCpuTimeNs += getThreadCpuTimeNs() - startTimeNs;
+    if (++mStatsFrames >= kStatsInterval) {
+        LOG(INFO) << "Camera texture refresh: " << mStatsCpuTimeNs / 1000 / mStatsFrames
+                  << " us of CPU time per frame, " << mStatsImports << " of " << mStatsFrames
+                  << " frames imported, image cache " << (mUseImageCache ? "on" : "off");
+        mStatsFrames = 0;
+        mStatsImports = 0;
+        mStatsCpuTimeNs = 0;
+    }
+
+    // Returning "true" even if the import failed because we already released the
+    // previous image (if any) and so the texture may change in unpredictable ways now!
+    return true;
+}
+
+const VideoTex::CachedImage* VideoTex::importImage(native_handle_t* nativeHandle) {
+    // The file descriptors are duplicated for every frame, but they refer to the same memory
+    struct stat info = {};
+    if (nativeHandle->numFds > 0 && fstat(nativeHandle->data[0], &info) != 0) {
+        PLOG(WARNING) << "Failed to identify buffer " << mImageBuffer.bufferId;
+    }
+
+    auto it = mImageCache.find(mImageBuffer.bufferId);
+    if (it != mImageCache.end()) {
+        if (it->second.device == info.st_dev && it->second.inode == info.st_ino) {
+            it->second.lastUsed = ++mImageCacheClock;
+            return &it->second;
+        }
+
+        // Known id with other memory; the camera has new buffers
+        LOG(DEBUG) << "Buffer " << mImageBuffer.bufferId << " has changed; dropping "
+                   << mImageCache.size() << " cached images";
+        releaseImageCache();
+    }
+
+    // create a GraphicBuffer from the existing handle
     const AHardwareBuffer_Desc* pDesc =
             reinterpret_cast<const AHardwareBuffer_Desc*>(&mImageBuffer.buffer.description);
+    if (isYuvFormat(pDesc->format) != (mSampling != VideoSampling::kRgba)) {
+        LOG(ERROR) << "Buffer format 0x" << std::hex << pDesc->format
+                   << " doesn't match the format of the stream";
+        return nullptr;
+    }
     android::sp<GraphicBuffer> pGfxBuffer =  // AHardwareBuffer_to_GraphicBuffer?
             new GraphicBuffer(nativeHandle, GraphicBuffer::CLONE_HANDLE, pDesc->width,
                               pDesc->height, pDesc->format, pDesc->layers, pDesc->usage,
                               pDesc->stride);
     if (!pGfxBuffer) {
         LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap image handle";
-        // Returning "true" in this error condition because we already released the
-        // previous image (if any) and so the texture may change in unpredictable ways now!
-        return true;
+        return nullptr;
     }
 
     if (auto status = pGfxBuffer->initCheck(); status != android::OK) {
         LOG(ERROR) << "Failed to initialize the graphic buffer, error = "
                    << android::statusToString(status);
-        // Same here.
-        return true;
+        return nullptr;
     }
 
     // Get a GL compatible reference to the graphics buffer we've been given
     EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
     EGLClientBuffer clientBuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
-    mKHRimage = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID, clientBuf,
-                                  eglImageAttributes);
-    if (mKHRimage == EGL_NO_IMAGE_KHR) {
+    EGLImageKHR image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID,
+                                          clientBuf, eglImageAttributes);
+    if (image == EGL_NO_IMAGE_KHR) {
         const char* msg = getEGLError();
         LOG(ERROR) << "Error creating EGLImage: " << msg;
-    } else {
-        // Update the texture handle we already created to refer to this gralloc buffer
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, glId());
-        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(mKHRimage));
-
-        // Initialize the sampling properties (it seems the sample may not work if this isn't done)
-        // The user of this texture may very well want to set their own filtering, but we're going
-        // to pay the (minor) price of setting this up for them to avoid the dreaded "black image"
-        // if they forget.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return nullptr;
     }
 
-    return true;
+    // Every buffer gets its own texture, so switching buffers does not respecify a texture
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    if (texture <= 0) {
+        LOG(ERROR) << "Didn't get a texture handle allocated: " << getEGLError();
+        eglDestroyImageKHR(mDisplay, image);
+        return nullptr;
+    }
+
+    // Update the texture handle we created to refer to this gralloc buffer.  YUV buffers can
+    // only be external textures, which the GPU samples without a copy in RGB.
+    const GLenum target = glTarget();
+    while (glGetError() != GL_NO_ERROR) {
+        // Drop errors left by earlier calls so the check below only sees ours
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(target, texture);
+    glEGLImageTargetTexture2DOES(target, static_cast<GLeglImageOES>(image));
+    if (const GLenum error = glGetError(); error != GL_NO_ERROR) {
+        LOG(ERROR) << "Failed to bind the image of a buffer in format 0x" << std::hex
+                   << pDesc->format << " to a texture, GL error 0x" << error;
+        glDeleteTextures(1, &texture);
+        eglDestroyImageKHR(mDisplay, image);
+        return nullptr;
+    }
+
+    // Initialize the sampling properties (it seems the sample may not work if this isn't done)
+    // The user of this texture may very well want to set their own filtering, but we're going
+    // to pay the (minor) price of setting this up for them to avoid the dreaded "black image"
+    // if they forget.
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Make room by dropping the buffer used the longest time ago
+    if (mImageCache.size() >= kMaxCachedImages) {
+        auto oldest = std::min_element(mImageCache.begin(), mImageCache.end(),
+                                       [](const auto& a, const auto& b) {
+                                           return a.second.lastUsed < b.second.lastUsed;
+                                       });
+        if (id == oldest->second.texture) {
+            id = mOwnTexture;
+        }
+        glDeleteTextures(1, &oldest->second.texture);
+        eglDestroyImageKHR(mDisplay, oldest->second.image);
+        mImageCache.erase(oldest);
+    }
+
+    ++mStatsImports;
+    auto& cached = mImageCache[mImageBuffer.bufferId];
+    cached = {info.st_dev, info.st_ino, pGfxBuffer, image, texture, ++mImageCacheClock};
+    return &cached;
+}
+
+void VideoTex::releaseImageCache() {
+    for (auto& [bufferId, cached] : mImageCache) {
+        glDeleteTextures(1, &cached.texture);
+        eglDestroyImageKHR(mDisplay, cached.image);
+    }
+    mImageCache.clear();
+    id = mOwnTexture;
 }
 
 VideoTex* createVideoTexture(const std::shared_ptr<IEvsEnumerator>& pEnum, const char* evsCameraId,
@@ -156,9 +296,24 @@ VideoTex* createVideoTexture(const std::shared_ptr<IEvsEnumerator>& pEnum, const
         return nullptr;
     }
 
+    // The format of the buffers the texture will see
+    const android_pixel_format_t frameFormat =
+            useExternalMemory ? format : static_cast<android_pixel_format_t>(streamCfg->format);
+    const auto fallBackToRgba = [&]() -> VideoTex* {
+        if (!isYuvFormat(frameFormat)) {
+            return nullptr;
+        }
+
+        LOG(WARNING) << "Streaming " << evsCameraId << " in RGBA instead of format 0x" << std::hex
+                     << frameFormat;
+        streamCfg->format = PixelFormat::RGBA_8888;
+        return createVideoTexture(pEnum, evsCameraId, std::move(streamCfg), glDisplay,
+                                  useExternalMemory, HAL_PIXEL_FORMAT_RGBA_8888);
+    };
+
     if (auto status = pEnum->openCamera(evsCameraId, *streamCfg, &pCamera); !status.isOk()) {
         LOG(ERROR) << "Failed to open a camera " << evsCameraId;
-        return nullptr;
+        return fallBackToRgba();
     }
 
     // Initialize the stream that will help us update this texture's contents
@@ -167,6 +322,7 @@ VideoTex* createVideoTexture(const std::shared_ptr<IEvsEnumerator>& pEnum, const
                                                     format, streamCfg->width, streamCfg->height);
     if (!pStreamHandler) {
         LOG(ERROR) << "Failed to allocate FrameHandler";
+        pEnum->closeCamera(pCamera);
         return nullptr;
     }
 
@@ -174,8 +330,48 @@ VideoTex* createVideoTexture(const std::shared_ptr<IEvsEnumerator>& pEnum, const
     if (!pStreamHandler->startStream()) {
         printf("Couldn't start the camera stream (%s)\n", evsCameraId);
         LOG(ERROR) << "Start stream failed for " << evsCameraId;
-        return nullptr;
+        pEnum->closeCamera(pCamera);
+        return fallBackToRgba();
     }
 
-    return new VideoTex(pEnum, pCamera, pStreamHandler, glDisplay);
+    return new VideoTex(pEnum, pCamera, pStreamHandler, glDisplay, frameFormat);
+}
+
+android_pixel_format_t selectVideoFormat(android_pixel_format_t format) {
+    if (!isYuvFormat(format)) {
+        return format;
+    }
+
+    if (!hasGlExtension("GL_OES_EGL_image_external_essl3")) {
+        LOG(WARNING) << "GL can't sample YUV camera frames; they will be converted to RGBA";
+        return HAL_PIXEL_FORMAT_RGBA_8888;
+    }
+    return format;
+}
+
+android_pixel_format_t selectStreamFormat(const std::vector<uint8_t>& metadata,
+                                          std::optional<android_pixel_format_t> format) {
+    if (format) {
+        return selectVideoFormat(*format);
+    }
+
+    // Cameras configured with RGBA streams only convert their frames on the CPU anyway
+    camera_metadata_ro_entry_t streamCfgs;
+    if (metadata.empty() ||
+        find_camera_metadata_ro_entry(reinterpret_cast<const camera_metadata_t*>(metadata.data()),
+                                      ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS,
+                                      &streamCfgs) != 0) {
+        return HAL_PIXEL_FORMAT_RGBA_8888;
+    }
+
+    // Entries are id, width, height, format, direction and frame rate
+    constexpr size_t kStreamCfgSz = 6;
+    for (size_t idx = 0; idx + kStreamCfgSz <= streamCfgs.count; idx += kStreamCfgSz) {
+        const int32_t* cfg = streamCfgs.data.i32 + idx;
+        if (cfg[4] == ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT &&
+            isYuvFormat(cfg[3])) {
+            return selectVideoFormat(static_cast<android_pixel_format_t>(cfg[3]));
+        }
+    }
+    return HAL_PIXEL_FORMAT_RGBA_8888;
 }
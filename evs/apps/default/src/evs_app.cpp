@@ -105,6 +105,7 @@ int main(int argc, char** argv) {
     int displayId = -1;
     bool useExternalMemory = false;
     android_pixel_format_t extMemoryFormat = HAL_PIXEL_FORMAT_RGBA_8888;
+    std::optional<android_pixel_format_t> streamFormat;
     int32_t mockGearSignal = static_cast<int32_t>(VehicleGear::GEAR_REVERSE);
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--test") == 0) {
@@ -132,6 +133,15 @@ int main(int argc, char** argv) {
                     ++i;
                 }
             }
+        } else if (strcmp(argv[i], "--format") == 0) {
+            android_pixel_format_t format;
+            if (i + 1 >= argc || !convertStringToFormat(argv[i + 1], &format)) {
+                LOG(WARNING) << "Stream format is not set or not supported.  "
+                             << "The format will be chosen from the camera metadata.";
+            } else {
+                streamFormat = format;
+                ++i;
+            }
         } else if (strcmp(argv[i], "--gear") == 0) {
             // Gear signal to simulate
             if (i + 1 >= argc) {
@@ -172,6 +182,10 @@ int main(int argc, char** argv) {
                "followed by a single chrome plane with weaved V and U values.\n");
         printf("\t\tYUYV: Packed format with a half horizontal chrome resolution.  "
                "Known as YUV4:2:2.\n");
+        printf("  --format  <format>\n\t"
+               "Format of the camera frames drawn with GL, from the list above.  YUV frames "
+               "are converted to RGB by the GPU.  By default, a YUV format is used if the "
+               "camera metadata advertises one, and RGBA8888 otherwise.\n");
 
         return EXIT_FAILURE;
     }
@@ -231,6 +245,9 @@ int main(int argc, char** argv) {
 
     config.useExternalMemory(useExternalMemory);
     config.setExternalMemoryFormat(extMemoryFormat);
+    if (streamFormat) {
+        config.setStreamFormat(*streamFormat);
+    }
 
     // Set a mock gear signal for the test mode
     config.setMockGearSignal(mockGearSignal);
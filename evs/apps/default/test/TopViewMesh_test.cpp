@@ -0,0 +1,531 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TopViewMesh.h"
+#include "shader_remapTex.h"
+
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+#include <gtest/gtest.h>
+#include <math/mat4.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr float kDegrees = M_PI / 180.0f;
+
+ConfigManager::CameraInfo makeCamera(const char* id, float x, float y, float z, float yaw,
+                                     float pitch, float hfov, float vfov) {
+    ConfigManager::CameraInfo cam;
+    cam.cameraId = id;
+    cam.position[0] = x;
+    cam.position[1] = y;
+    cam.position[2] = z;
+    cam.yaw = yaw * kDegrees;
+    cam.pitch = pitch * kDegrees;
+    cam.hfov = hfov * kDegrees;
+    cam.vfov = vfov * kDegrees;
+    return cam;
+}
+
+// The cameras of res/config.json
+std::vector<ConfigManager::CameraInfo> getShippedCameras() {
+    return {
+            makeCamera("/dev/virtvideo0", 0.0f, 20.0f, 48.0f, 180.0f, -10.0f, 115.0f, 80.0f),
+            makeCamera("/dev/virtvideo1", 0.0f, 100.0f, 48.0f, 0.0f, -10.0f, 115.0f, 80.0f),
+            makeCamera("/dev/virtvideo2", -25.0f, 60.0f, 88.0f, -90.0f, -10.0f, 60.0f, 62.0f),
+            makeCamera("/dev/virtvideo3", 20.0f, 60.0f, 88.0f, 90.0f, -10.0f, 60.0f, 62.0f),
+    };
+}
+
+// The ground the first display of res/config.json shows at the given aspect ratio, as
+// RenderTopView computes it
+TopViewMesh::Extents getShippedExtents(float aspectRatio) {
+    const float top = 117.9f + 44.7f + 100.0f;
+    const float bottom = -40.0f - 100.0f;
+    const float right = (top - bottom) * 0.5f * aspectRatio;
+    return {top, bottom, -right, right};
+}
+
+// Side cameras with wider lenses than those of res/config.json, whose images overlap those of
+// the front and rear cameras
+std::vector<ConfigManager::CameraInfo> getOverlappingCameras() {
+    auto cameras = getShippedCameras();
+    for (auto& cam : {&cameras[2], &cameras[3]}) {
+        cam->hfov = 140.0f * kDegrees;
+        cam->vfov = 100.0f * kDegrees;
+    }
+    return cameras;
+}
+
+// Where the camera sees a ground position, in texture coordinates, in double precision and
+// without any matrix; false if the position is behind the camera
+bool project(const ConfigManager::CameraInfo& cam, double x, double y, double* u, double* v) {
+    const double sinPitch = sin(cam.pitch), cosPitch = cos(cam.pitch);
+    const double sinYaw = sin(cam.yaw), cosYaw = cos(cam.yaw);
+    const double at[] = {cosPitch * -sinYaw, cosPitch * cosYaw, sinPitch};
+    const double right[] = {cosYaw, sinYaw, 0.0};
+    const double up[] = {-(at[1] * right[2] - at[2] * right[1]),
+                         -(at[2] * right[0] - at[0] * right[2]),
+                         -(at[0] * right[1] - at[1] * right[0])};
+    const double d[] = {x - cam.position[0], y - cam.position[1], -cam.position[2]};
+
+    const double depth = d[0] * at[0] + d[1] * at[1] + d[2] * at[2];
+    if (depth <= 0.0) {
+        return false;
+    }
+    const double px = (d[0] * right[0] + d[1] * right[1] + d[2] * right[2]) /
+            tan(cam.hfov * 0.5) / depth;
+    const double py = (d[0] * up[0] + d[1] * up[1] + d[2] * up[2]) / tan(cam.vfov * 0.5) / depth;
+    *u = (px + 1.0) * 0.5;
+    *v = (1.0 - py) * 0.5;
+    return true;
+}
+
+// Share of a camera before normalization, as the remap shader computes it
+double getEdgeWeight(double u, double v, double feather) {
+    const double distance = std::min(std::min(u, 1.0 - u), std::min(v, 1.0 - v));
+    if (distance <= 0.0) {
+        return 0.0;
+    }
+    const double x = std::min(distance / feather, 1.0);
+    return x * x * (3.0 - 2.0 * x);
+}
+
+bool isInTriangle(float x, float y, const TopViewMesh::Vertex& a, const TopViewMesh::Vertex& b,
+                  const TopViewMesh::Vertex& c) {
+    const auto side = [x, y](const TopViewMesh::Vertex& p, const TopViewMesh::Vertex& q) {
+        return (q.x - p.x) * (y - p.y) - (q.y - p.y) * (x - p.x);
+    };
+    const float ab = side(a, b), bc = side(b, c), ca = side(c, a);
+    return (ab >= 0 && bc >= 0 && ca >= 0) || (ab <= 0 && bc <= 0 && ca <= 0);
+}
+
+bool isCovered(const TopViewMesh::CameraMesh& mesh, float x, float y) {
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        if (isInTriangle(x, y, mesh.vertices[mesh.indices[i]], mesh.vertices[mesh.indices[i + 1]],
+                         mesh.vertices[mesh.indices[i + 2]])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST(TopViewMeshTest, VerticesHoldTheProjectionOfTheirGroundPosition) {
+    const auto cameras = getShippedCameras();
+    const auto meshes = TopViewMesh::build(cameras, getShippedExtents(16.0f / 9.0f));
+    ASSERT_EQ(meshes.size(), cameras.size());
+
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        ASSERT_FALSE(meshes[i].indices.empty()) << cameras[i].cameraId;
+        for (const auto& vertex : meshes[i].vertices) {
+            double u = 0, v = 0;
+            ASSERT_TRUE(project(cameras[i], vertex.x, vertex.y, &u, &v));
+            ASSERT_GT(vertex.q, 0.0f);
+            EXPECT_NEAR(vertex.s / vertex.q, u, 1e-3) << cameras[i].cameraId;
+            EXPECT_NEAR(vertex.t / vertex.q, v, 1e-3) << cameras[i].cameraId;
+        }
+    }
+}
+
+// The cameras whose image positions the vertex carries, found by the positions themselves
+std::vector<size_t> getOverlaps(const std::vector<ConfigManager::CameraInfo>& cameras,
+                                const TopViewMesh::Vertex& vertex) {
+    std::vector<size_t> overlaps;
+    for (const auto& overlap : vertex.overlaps) {
+        if (overlap[2] == 0.0f) {
+            continue;
+        }
+        for (size_t j = 0; j < cameras.size(); ++j) {
+            double u = 0, v = 0;
+            if (project(cameras[j], vertex.x, vertex.y, &u, &v) &&
+                std::abs(overlap[0] / overlap[2] - u) < 1e-3 &&
+                std::abs(overlap[1] / overlap[2] - v) < 1e-3) {
+                overlaps.push_back(j);
+                break;
+            }
+        }
+    }
+    return overlaps;
+}
+
+TEST(TopViewMeshTest, TrianglesCarryEveryOtherCameraSeeingThem) {
+    const auto cameras = getOverlappingCameras();
+    const auto meshes = TopViewMesh::build(cameras, getShippedExtents(16.0f / 9.0f));
+
+    // Meshes are cut at the edges of the images, so the cameras which see the middle of a
+    // triangle see all of it, and the shader shares its color among them
+    size_t numBlended = 0;
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        const auto& mesh = meshes[i];
+        for (size_t k = 0; k + 2 < mesh.indices.size(); k += 3) {
+            const TopViewMesh::Vertex* corners[] = {&mesh.vertices[mesh.indices[k]],
+                                                    &mesh.vertices[mesh.indices[k + 1]],
+                                                    &mesh.vertices[mesh.indices[k + 2]]};
+            double x = 0, y = 0;
+            for (const auto* corner : corners) {
+                x += corner->x / 3.0;
+                y += corner->y / 3.0;
+            }
+
+            std::vector<size_t> expected;
+            for (size_t j = 0; j < cameras.size(); ++j) {
+                double u = 0, v = 0;
+                const bool sees = project(cameras[j], x, y, &u, &v) &&
+                        getEdgeWeight(u, v, TopViewMesh::kDefaultFeather) > 0.0;
+                if (j == i) {
+                    EXPECT_TRUE(sees) << cameras[i].cameraId << " at " << x << ", " << y;
+                } else if (sees) {
+                    expected.push_back(j);
+                }
+            }
+            for (const auto* corner : corners) {
+                EXPECT_EQ(getOverlaps(cameras, *corner), expected)
+                        << cameras[i].cameraId << " at " << x << ", " << y;
+            }
+            numBlended += !expected.empty();
+        }
+    }
+    EXPECT_GT(numBlended, 0u);
+}
+
+TEST(TopViewMeshTest, EveryCameraCoversItsFootprint) {
+    const auto cameras = getShippedCameras();
+    const auto extents = getShippedExtents(16.0f / 9.0f);
+    const auto meshes = TopViewMesh::build(cameras, extents);
+
+    // Ground positions well inside the image of a camera lie on its mesh
+    constexpr int kSamples = 97;
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        for (int row = 0; row < kSamples; ++row) {
+            for (int col = 0; col < kSamples; ++col) {
+                const float x =
+                        extents.left + (extents.right - extents.left) * col / (kSamples - 1);
+                const float y =
+                        extents.bottom + (extents.top - extents.bottom) * row / (kSamples - 1);
+                double u = 0, v = 0;
+                if (!project(cameras[i], x, y, &u, &v) || u < 0.01 || u > 0.99 || v < 0.01 ||
+                    v > 0.99) {
+                    continue;
+                }
+                EXPECT_TRUE(isCovered(meshes[i], x, y))
+                        << cameras[i].cameraId << " at " << x << ", " << y;
+            }
+        }
+    }
+}
+
+TEST(TopViewMeshTest, CameraSeeingNoGroundGetsNoMesh) {
+    auto cameras = getShippedCameras();
+    cameras.push_back(makeCamera("sky", 0.0f, 60.0f, 88.0f, 0.0f, 45.0f, 60.0f, 40.0f));
+    const auto meshes = TopViewMesh::build(cameras, getShippedExtents(16.0f / 9.0f));
+    ASSERT_EQ(meshes.size(), cameras.size());
+    EXPECT_TRUE(meshes.back().vertices.empty());
+    EXPECT_TRUE(meshes.back().indices.empty());
+}
+
+// An offscreen GLES 3 context, as a software implementation provides one on any host
+class OffscreenContext {
+public:
+    OffscreenContext(int width, int height) {
+        mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, nullptr, nullptr)) {
+            mDisplay = EGL_NO_DISPLAY;
+            return;
+        }
+
+        const EGLint configAttribs[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+                EGL_RED_SIZE,     8,               EGL_GREEN_SIZE,      8,
+                EGL_BLUE_SIZE,    8,               EGL_ALPHA_SIZE,      8,
+                EGL_NONE,
+        };
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(mDisplay, configAttribs, &config, 1, &numConfigs) ||
+            numConfigs == 0) {
+            return;
+        }
+
+        const EGLint surfaceAttribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+        mSurface = eglCreatePbufferSurface(mDisplay, config, surfaceAttribs);
+        const EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+        eglBindAPI(EGL_OPENGL_ES_API);
+        mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+        mReady = mSurface != EGL_NO_SURFACE && mContext != EGL_NO_CONTEXT &&
+                eglMakeCurrent(mDisplay, mSurface, mSurface, mContext);
+    }
+
+    ~OffscreenContext() {
+        if (mDisplay == EGL_NO_DISPLAY) {
+            return;
+        }
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (mContext != EGL_NO_CONTEXT) {
+            eglDestroyContext(mDisplay, mContext);
+        }
+        if (mSurface != EGL_NO_SURFACE) {
+            eglDestroySurface(mDisplay, mSurface);
+        }
+        eglTerminate(mDisplay);
+    }
+
+    bool isReady() const { return mReady; }
+
+private:
+    EGLDisplay mDisplay = EGL_NO_DISPLAY;
+    EGLSurface mSurface = EGL_NO_SURFACE;
+    EGLContext mContext = EGL_NO_CONTEXT;
+    bool mReady = false;
+};
+
+GLuint buildProgram(const char* vtxSource, const char* pixSource) {
+    GLuint program = glCreateProgram();
+    for (const auto& [type, source] : {std::make_pair(GL_VERTEX_SHADER, vtxSource),
+                                       std::make_pair(GL_FRAGMENT_SHADER, pixSource)}) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        glDeleteShader(shader);
+    }
+    glLinkProgram(program);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// The camera images are smooth ramps, so that a texel is known anywhere: red and green hold
+// the texture coordinates and blue tells the cameras apart
+constexpr int kTextureSize = 256;
+
+void getTexel(size_t camera, double u, double v, double rgb[3]) {
+    rgb[0] = u;
+    rgb[1] = v;
+    rgb[2] = 0.25 * camera + 0.125;
+}
+
+// Errors in 8-bit levels of the pixels one or several cameras see.  Pixels within a fraction of
+// a texel of the edge of an image are left out, as the GPU and the CPU may disagree on which
+// side of the edge they are.
+struct ImageErrors {
+    std::vector<double> single;
+    std::vector<double> blended;
+    size_t numBlack = 0;  // Pixels no camera sees which are black
+
+    static double mean(const std::vector<double>& errors) {
+        double sum = 0;
+        for (const double error : errors) {
+            sum += error;
+        }
+        return sum / errors.size();
+    }
+
+    static double percentile(std::vector<double> errors, double p) {
+        const size_t index = std::min(errors.size() - 1, static_cast<size_t>(errors.size() * p));
+        std::nth_element(errors.begin(), errors.begin() + index, errors.end());
+        return errors[index];
+    }
+};
+
+constexpr int kWidth = 640;
+constexpr int kHeight = 360;
+constexpr double kEdgeMargin = 0.5 / kTextureSize;
+
+// Renders the meshes with the remap shader the way RenderTopView does, and compares the image
+// with the projection and blending computed for every pixel on the CPU
+bool renderAndCompare(const std::vector<ConfigManager::CameraInfo>& cameras, ImageErrors* errors) {
+    const auto extents = getShippedExtents(static_cast<float>(kWidth) / kHeight);
+    const auto meshes = TopViewMesh::build(cameras, extents);
+
+    const GLuint program = buildProgram(vtxShader_remapTexture, pixShader_remapTexture);
+    if (program == 0) {
+        return false;
+    }
+
+    std::vector<GLuint> textures(cameras.size());
+    glGenTextures(textures.size(), textures.data());
+    std::vector<uint8_t> pixels(kTextureSize * kTextureSize * 4);
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        for (int y = 0; y < kTextureSize; ++y) {
+            for (int x = 0; x < kTextureSize; ++x) {
+                double rgb[3];
+                getTexel(i, (x + 0.5) / kTextureSize, (y + 0.5) / kTextureSize, rgb);
+                uint8_t* texel = &pixels[(y * kTextureSize + x) * 4];
+                for (int c = 0; c < 3; ++c) {
+                    texel[c] = lround(rgb[c] * 255.0);
+                }
+                texel[3] = 255;
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kTextureSize, kTextureSize, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, pixels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    glViewport(0, 0, kWidth, kHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE);
+
+    const android::mat4 orthoMatrix = android::mat4::ortho(extents.left, extents.right,
+                                                           extents.top, extents.bottom, 10.0f,
+                                                           0.0f);
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "cameraMat"), 1, false,
+                       orthoMatrix.asArray());
+    glUniform1f(glGetUniformLocation(program, "feather"), TopViewMesh::kDefaultFeather);
+
+    const GLsizei stride = sizeof(TopViewMesh::Vertex);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        const auto& mesh = meshes[i];
+        GLuint buffers[2];
+        glGenBuffers(2, buffers);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * stride, mesh.vertices.data(),
+                     GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint16_t),
+                     mesh.indices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride,
+                              reinterpret_cast<const void*>(offsetof(TopViewMesh::Vertex, x)));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride,
+                              reinterpret_cast<const void*>(offsetof(TopViewMesh::Vertex, s)));
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        for (unsigned k = 0; k < TopViewMesh::kMaxOverlaps; ++k) {
+            const size_t offset =
+                    offsetof(TopViewMesh::Vertex, overlaps) + k * 3 * sizeof(float);
+            glVertexAttribPointer(2 + k, 3, GL_FLOAT, GL_FALSE, stride,
+                                  reinterpret_cast<const void*>(offset));
+            glEnableVertexAttribArray(2 + k);
+        }
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glDrawElements(GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_SHORT, nullptr);
+        glDeleteBuffers(2, buffers);
+    }
+
+    std::vector<uint8_t> image(kWidth * kHeight * 4);
+    glReadPixels(0, 0, kWidth, kHeight, GL_RGBA, GL_UNSIGNED_BYTE, image.data());
+    glDeleteTextures(textures.size(), textures.data());
+    glDeleteProgram(program);
+    if (glGetError() != GL_NO_ERROR) {
+        return false;
+    }
+
+    for (int row = 0; row < kHeight; ++row) {
+        for (int col = 0; col < kWidth; ++col) {
+            // The orthographic projection puts the top of the ground at the first row read back
+            const double x = extents.left + (col + 0.5) / kWidth * (extents.right - extents.left);
+            const double y = extents.top - (row + 0.5) / kHeight * (extents.top - extents.bottom);
+
+            std::vector<double> weights(cameras.size());
+            std::vector<std::pair<double, double>> uv(cameras.size());
+            double total = 0;
+            size_t numSeeing = 0;
+            bool nearEdge = false;
+            for (size_t i = 0; i < cameras.size(); ++i) {
+                auto& [u, v] = uv[i];
+                if (!project(cameras[i], x, y, &u, &v)) {
+                    continue;
+                }
+                const double distance = std::min(std::min(u, 1.0 - u), std::min(v, 1.0 - v));
+                nearEdge |= std::abs(distance) < kEdgeMargin;
+                weights[i] = getEdgeWeight(u, v, TopViewMesh::kDefaultFeather);
+                total += weights[i];
+                numSeeing += weights[i] > 0.0;
+            }
+            if (nearEdge) {
+                continue;
+            }
+
+            const uint8_t* pixel = &image[(row * kWidth + col) * 4];
+            if (numSeeing == 0) {
+                errors->numBlack += pixel[0] == 0 && pixel[1] == 0 && pixel[2] == 0;
+                continue;
+            }
+
+            double expected[3] = {};
+            for (size_t i = 0; i < cameras.size(); ++i) {
+                if (weights[i] > 0.0) {
+                    double rgb[3];
+                    getTexel(i, uv[i].first, uv[i].second, rgb);
+                    for (int c = 0; c < 3; ++c) {
+                        expected[c] += rgb[c] * weights[i] / total;
+                    }
+                }
+            }
+
+            double error = 0;
+            for (int c = 0; c < 3; ++c) {
+                error = std::max(error, std::abs(pixel[c] - expected[c] * 255.0));
+            }
+            (numSeeing == 1 ? errors->single : errors->blended).push_back(error);
+        }
+    }
+
+    return true;
+}
+
+TEST(TopViewMeshTest, RendersTheGoldenImage) {
+    OffscreenContext context(kWidth, kHeight);
+    if (!context.isReady()) {
+        GTEST_SKIP() << "No GLES 3 context is available";
+    }
+
+    ImageErrors errors;
+    ASSERT_TRUE(renderAndCompare(getShippedCameras(), &errors));
+    ASSERT_FALSE(errors.single.empty());
+    EXPECT_GT(errors.numBlack, 0u);
+    EXPECT_LT(ImageErrors::mean(errors.single), 1.0);
+    EXPECT_LT(ImageErrors::percentile(errors.single, 0.995), 2.0);
+}
+
+TEST(TopViewMeshTest, RendersTheGoldenImageOfOverlappingCameras) {
+    OffscreenContext context(kWidth, kHeight);
+    if (!context.isReady()) {
+        GTEST_SKIP() << "No GLES 3 context is available";
+    }
+
+    // The shares are computed for every pixel, so the pixels the cameras blend are as close to
+    // the reference as those a single camera sees
+    ImageErrors errors;
+    ASSERT_TRUE(renderAndCompare(getOverlappingCameras(), &errors));
+    ASSERT_FALSE(errors.single.empty());
+    ASSERT_FALSE(errors.blended.empty());
+    EXPECT_LT(ImageErrors::mean(errors.single), 1.5);
+    EXPECT_LT(ImageErrors::percentile(errors.single, 0.95), 2.0);
+    EXPECT_LT(ImageErrors::mean(errors.blended), 1.5);
+    EXPECT_LT(ImageErrors::percentile(errors.blended, 0.95), 2.0);
+}
+
+}  // namespace
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// CPU time and latency of drawing a frame of four 1280x720 YUYV cameras, with the GPU sampling
+// the camera buffers as the views do, against converting each frame to RGBA on the CPU first
+// with copyYUYVtoRGB32, as before and when GL can't sample YUV.  Every iteration draws one
+// frame of each camera into its quarter of an offscreen target and waits for the GPU, so the
+// time of an iteration is the latency of a frame and its CPU time the cost to the app.
+
+#include "FormatConvert.h"
+#include "shader.h"
+#include "shader_simpleTex.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2ext.h>
+#include <GLES3/gl3.h>
+#include <benchmark/benchmark.h>
+#include <hardware/gralloc.h>
+#include <system/graphics-base.h>
+#include <ui/GraphicBuffer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+using ::android::GraphicBuffer;
+using ::android::sp;
+
+constexpr uint32_t kWidth = 1280;
+constexpr uint32_t kHeight = 720;
+constexpr int kNumCameras = 4;
+
+// An offscreen GLES 3 context as big as the frame of one camera
+class OffscreenContext {
+public:
+    OffscreenContext() {
+        mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, nullptr, nullptr)) {
+            mDisplay = EGL_NO_DISPLAY;
+            return;
+        }
+
+        const EGLint configAttribs[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+                EGL_RED_SIZE,     8,               EGL_GREEN_SIZE,      8,
+                EGL_BLUE_SIZE,    8,               EGL_ALPHA_SIZE,      8,
+                EGL_NONE,
+        };
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(mDisplay, configAttribs, &config, 1, &numConfigs) ||
+            numConfigs == 0) {
+            return;
+        }
+
+        const EGLint surfaceAttribs[] = {EGL_WIDTH, kWidth, EGL_HEIGHT, kHeight, EGL_NONE};
+        mSurface = eglCreatePbufferSurface(mDisplay, config, surfaceAttribs);
+        const EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+        eglBindAPI(EGL_OPENGL_ES_API);
+        mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+        mReady = mSurface != EGL_NO_SURFACE && mContext != EGL_NO_CONTEXT &&
+                eglMakeCurrent(mDisplay, mSurface, mSurface, mContext);
+    }
+
+    ~OffscreenContext() {
+        if (mDisplay == EGL_NO_DISPLAY) {
+            return;
+        }
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (mContext != EGL_NO_CONTEXT) {
+            eglDestroyContext(mDisplay, mContext);
+        }
+        if (mSurface != EGL_NO_SURFACE) {
+            eglDestroySurface(mDisplay, mSurface);
+        }
+        eglTerminate(mDisplay);
+    }
+
+    bool isReady() const { return mReady; }
+    EGLDisplay display() const { return mDisplay; }
+
+private:
+    EGLDisplay mDisplay = EGL_NO_DISPLAY;
+    EGLSurface mSurface = EGL_NO_SURFACE;
+    EGLContext mContext = EGL_NO_CONTEXT;
+    bool mReady = false;
+};
+
+// No extension name is a prefix of the ones looked for here
+bool hasGlExtension(const char* name) {
+    const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    return extensions != nullptr && strstr(extensions, name) != nullptr;
+}
+
+// A gralloc buffer bound to a texture the way VideoTex imports camera frames
+class TextureBuffer {
+public:
+    TextureBuffer(EGLDisplay display, uint32_t format, GLenum target) :
+          mDisplay(display), mTarget(target) {
+        mBuffer = new GraphicBuffer(kWidth, kHeight, format, 1,
+                                    GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_READ_OFTEN |
+                                            GRALLOC_USAGE_SW_WRITE_OFTEN,
+                                    "EvsAppBenchmark");
+        if (mBuffer->initCheck() != ::android::OK) {
+            return;
+        }
+
+        EGLint imageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+        mImage = eglCreateImageKHR(display, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID,
+                                   static_cast<EGLClientBuffer>(mBuffer->getNativeBuffer()),
+                                   imageAttributes);
+        if (mImage == EGL_NO_IMAGE_KHR) {
+            return;
+        }
+
+        glGenTextures(1, &mTexture);
+        glBindTexture(target, mTexture);
+        glEGLImageTargetTexture2DOES(target, static_cast<GLeglImageOES>(mImage));
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        mReady = glGetError() == GL_NO_ERROR;
+    }
+
+    ~TextureBuffer() {
+        if (mTexture != 0) {
+            glDeleteTextures(1, &mTexture);
+        }
+        if (mImage != EGL_NO_IMAGE_KHR) {
+            eglDestroyImageKHR(mDisplay, mImage);
+        }
+    }
+
+    bool isReady() const { return mReady; }
+    const sp<GraphicBuffer>& buffer() const { return mBuffer; }
+
+    void bind() const {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(mTarget, mTexture);
+    }
+
+private:
+    EGLDisplay mDisplay;
+    GLenum mTarget;
+    sp<GraphicBuffer> mBuffer;
+    EGLImageKHR mImage = EGL_NO_IMAGE_KHR;
+    GLuint mTexture = 0;
+    bool mReady = false;
+};
+
+// The frames of a camera: what it captured, and the RGBA copy the CPU fallback draws
+struct Camera {
+    Camera(EGLDisplay display) :
+          yuyv(display, HAL_PIXEL_FORMAT_YCBCR_422_I, GL_TEXTURE_EXTERNAL_OES),
+          rgba(display, HAL_PIXEL_FORMAT_RGBA_8888, GL_TEXTURE_2D) {}
+
+    TextureBuffer yuyv;
+    TextureBuffer rgba;
+};
+
+bool fillPattern(const sp<GraphicBuffer>& buffer, uint8_t seed) {
+    uint8_t* pixels = nullptr;
+    if (buffer->lock(GRALLOC_USAGE_SW_WRITE_OFTEN, reinterpret_cast<void**>(&pixels)) !=
+        ::android::OK) {
+        return false;
+    }
+    for (uint32_t row = 0; row < kHeight; row++) {
+        uint8_t* line = pixels + row * buffer->getStride() * 2;
+        for (uint32_t i = 0; i < kWidth * 2; i++) {
+            line[i] = static_cast<uint8_t>(seed + row + i * 3);
+        }
+    }
+    buffer->unlock();
+    return true;
+}
+
+bool convertOnCpu(const Camera& camera) {
+    const sp<GraphicBuffer>& src = camera.yuyv.buffer();
+    const sp<GraphicBuffer>& dst = camera.rgba.buffer();
+    uint8_t* srcPixels = nullptr;
+    uint32_t* dstPixels = nullptr;
+    if (src->lock(GRALLOC_USAGE_SW_READ_OFTEN, reinterpret_cast<void**>(&srcPixels)) !=
+        ::android::OK) {
+        return false;
+    }
+    if (dst->lock(GRALLOC_USAGE_SW_WRITE_OFTEN, reinterpret_cast<void**>(&dstPixels)) !=
+        ::android::OK) {
+        src->unlock();
+        return false;
+    }
+    copyYUYVtoRGB32(kWidth, kHeight, srcPixels, src->getStride(), dstPixels, dst->getStride());
+    dst->unlock();
+    src->unlock();
+    return true;
+}
+
+// range(0): whether the GPU samples the YUYV buffers, rather than the CPU converting them
+void BM_DrawFourCameras(benchmark::State& state) {
+    const bool sampleYuv = state.range(0) != 0;
+    OffscreenContext context;
+    if (!context.isReady()) {
+        state.SkipWithError("failed to create a GLES 3 context");
+        return;
+    }
+    if (sampleYuv && !hasGlExtension("GL_OES_EGL_image_external_essl3")) {
+        state.SkipWithError("GL can't sample YUV buffers");
+        return;
+    }
+
+    // The shaders of RenderDirectView, picked the same way
+    const char* pixShader = pixShader_simpleTexture;
+    if (sampleYuv) {
+        pixShader = hasGlExtension("GL_EXT_YUV_target") ? pixShader_simpleTextureYuv
+                                                        : pixShader_simpleTextureExternal;
+    }
+    GLuint program = buildShaderProgram(vtxShader_simpleTexture, pixShader, "simpleTexture");
+    if (!program) {
+        state.SkipWithError("failed to build the shader program");
+        return;
+    }
+
+    {
+        std::vector<std::unique_ptr<Camera>> cameras;
+        for (int i = 0; i < kNumCameras; i++) {
+            cameras.emplace_back(new Camera(context.display()));
+            if (!cameras.back()->yuyv.isReady() || !cameras.back()->rgba.isReady() ||
+                !fillPattern(cameras.back()->yuyv.buffer(), i * 64)) {
+                state.SkipWithError("failed to set up the camera buffers");
+                break;
+            }
+        }
+
+        const GLfloat identity[] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+        const GLfloat uvs[] = {0, 0, 1, 0, 0, 1, 1, 1};
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "cameraMat"), 1, false, identity);
+        glUniform1i(glGetUniformLocation(program, "tex"), 0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, uvs);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+
+        double maxLatencyMs = 0;
+        for (auto _ : state) {
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < kNumCameras; i++) {
+                const Camera& camera = *cameras[i];
+                if (!sampleYuv && !convertOnCpu(camera)) {
+                    state.SkipWithError("failed to convert a frame");
+                    break;
+                }
+                (sampleYuv ? camera.yuyv : camera.rgba).bind();
+
+                // Each camera has a quarter of the target
+                const GLfloat left = (i % 2) - 1.0f;
+                const GLfloat top = 1.0f - (i / 2);
+                const GLfloat positions[] = {left, top,        0, left + 1, top,        0,
+                                             left, top - 1.0f, 0, left + 1, top - 1.0f, 0};
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, positions);
+                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            }
+            glFinish();
+
+            const std::chrono::duration<double, std::milli> latency =
+                    std::chrono::steady_clock::now() - start;
+            maxLatencyMs = std::max(maxLatencyMs, latency.count());
+        }
+
+        glDisableVertexAttribArray(0);
+        glDisableVertexAttribArray(1);
+        state.counters["max_ms"] = maxLatencyMs;
+    }
+    glDeleteProgram(program);
+
+    state.SetItemsProcessed(state.iterations() * kNumCameras);
+}
+
+BENCHMARK(BM_DrawFourCameras)->ArgName("sample_yuv")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
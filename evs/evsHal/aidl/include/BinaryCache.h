@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_BINARYCACHE_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_BINARYCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// 64-bit FNV-1a
+constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ull;
+uint64_t hashBytes(uint64_t hash, std::string_view bytes);
+
+// Starts every file the caches of the HAL store, in the byte order of the device, followed by
+// the header of the cache.  Every record is 8-byte aligned, so fixed-width records can be read
+// straight from a mapped file.  A cache bumps its version whenever its layout changes.
+struct BinaryCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t payloadHash;  // Everything after this field
+    uint64_t fileSize;
+};
+static_assert(sizeof(BinaryCacheHeader) == 24);
+
+constexpr size_t alignUp(size_t value) {
+    return (value + 7) & ~static_cast<size_t>(7);
+}
+
+// Builds a cache in memory, starting with its header, and stores it
+class BinaryWriter final {
+public:
+    const uint8_t* data() const { return mBuffer.data(); }
+    size_t size() const { return mBuffer.size(); }
+
+    // Returns the offset of the appended bytes
+    size_t appendBytes(const void* data, size_t size);
+
+    template <typename T>
+    size_t append(const T& value) {
+        return appendBytes(&value, sizeof(T));
+    }
+
+    void appendString(std::string_view value);
+
+    template <typename T>
+    void update(size_t offset, const T& value) {
+        memcpy(mBuffer.data() + offset, &value, sizeof(T));
+    }
+
+    // Fills in the size and hash of the BinaryCacheHeader the cache starts with, and writes a
+    // new file renamed over path, so a reader never sees a partial one
+    bool store(const std::string& path);
+
+private:
+    std::vector<uint8_t> mBuffer;
+};
+
+// Bounds-checked cursor over a cache; once it fails, every take fails
+class BinaryReader final {
+public:
+    enum class Status { OK, UNKNOWN_FORMAT, CORRUPTED };
+
+    BinaryReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    // Checks the data starts with the BinaryCacheHeader of a cache of magic and version, and
+    // has the size and the hash it was stored with.  The cache takes its own header afterwards.
+    Status checkHeader(uint32_t magic, uint32_t version);
+
+    bool isValid() const { return mValid; }
+    void invalidate() { mValid = false; }
+    size_t offset() const { return mOffset; }
+
+    const uint8_t* takeBytes(size_t size);
+
+    // Points into the data, which holds count values of T unless this returns nullptr
+    template <typename T>
+    const T* take(size_t count = 1) {
+        if (count > mSize / sizeof(T)) {
+            mValid = false;
+            return nullptr;
+        }
+        return reinterpret_cast<const T*>(takeBytes(sizeof(T) * count));
+    }
+
+    std::string_view takeString();
+
+private:
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mOffset = 0;
+    bool mValid = true;
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_BINARYCACHE_H
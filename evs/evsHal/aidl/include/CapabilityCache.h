@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_CAPABILITYCACHE_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_CAPABILITYCACHE_H
+
+#include <linux/videodev2.h>
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// What a V4L2 capture device reports about its formats, frame sizes, frame intervals and
+// controls, kept per kind of device so opening a camera again does not walk the enumeration
+// ioctls, which are slow on UVC cameras.  Devices are told apart by their bus, driver, card and
+// driver version.  The cache is stored in vendor.evs.caps.cache, so it survives restarts of the
+// service; devices showing up or going away while it runs are enumerated again.
+class CapabilityCache final {
+public:
+    struct FrameSize {
+        v4l2_frmsizeenum size;
+        std::vector<v4l2_frmivalenum> intervals;  // Only for discrete sizes
+    };
+
+    struct Format {
+        v4l2_fmtdesc desc;
+        std::vector<FrameSize> sizes;
+    };
+
+    struct Capabilities {
+        uint32_t bufferType;  // V4L2_BUF_TYPE_VIDEO_CAPTURE or its multi-planar variant
+        std::vector<Format> formats;
+        std::vector<v4l2_queryctrl> controls;  // Enabled controls with their ranges
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t invalidations = 0;
+        size_t entries = 0;
+        size_t loadedEntries = 0;  // Read from the stored cache at start
+        double enumerationMs = 0;  // Spent in the enumeration ioctls of the misses
+    };
+
+    static CapabilityCache& getInstance();
+
+    // Returns the capabilities of the device deviceName opened as fd, which reported caps to
+    // VIDIOC_QUERYCAP.  The device is enumerated on a miss, or if it was plugged in since.
+    std::shared_ptr<const Capabilities> get(const std::string& deviceName, int fd,
+                                            const v4l2_capability& caps);
+
+    // The hotplug monitor saw deviceName show up or go away
+    void invalidate(const std::string& deviceName);
+
+    Stats getStats();
+
+private:
+    CapabilityCache();
+
+    struct Key {
+        std::string busInfo;
+        std::string driver;
+        std::string card;
+        uint32_t version;
+        uint32_t capabilities;  // The buffer type depends on these
+
+        bool operator<(const Key& other) const {
+            return std::tie(busInfo, driver, card, version, capabilities) <
+                    std::tie(other.busInfo, other.driver, other.card, other.version,
+                             other.capabilities);
+        }
+    };
+
+    static Key makeKey(const v4l2_capability& caps);
+    static std::shared_ptr<Capabilities> enumerate(int fd, const v4l2_capability& caps);
+
+    bool load();
+    void store();
+
+    std::string mFilePath;
+
+    std::mutex mLock;
+    std::map<Key, std::shared_ptr<const Capabilities>> mEntries;
+    std::unordered_map<std::string, Key> mDevices;  // The kind of each device path seen
+    std::unordered_set<std::string> mPlugged;       // Paths to enumerate again on next use
+    Stats mStats;
+
+    std::mutex mStoreLock;  // Writers of the file, which is written without mLock
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_CAPABILITYCACHE_H
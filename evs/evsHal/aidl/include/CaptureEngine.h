@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_CAPTUREENGINE_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_CAPTUREENGINE_H
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class VideoCapture;
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// A single thread which waits for the frames of all streaming devices in one epoll set and runs
+// their frame callbacks.  Frames of devices in the same sync group are held back until every
+// member has captured one within the group's skew window, and are then dispatched together.
+class CaptureEngine {
+public:
+    // Runs after the frame callbacks of all members of a synchronized set have returned
+    using FrameSetCallback = std::function<void()>;
+
+    struct SyncGroupStats {
+        uint64_t frameSets = 0;
+        uint64_t droppedFrames = 0;  // Frames which had no partner within the skew window
+        int64_t lastSkewNs = 0;
+        int64_t maxSkewNs = 0;
+    };
+
+    static CaptureEngine& getInstance();
+
+    ~CaptureEngine();
+
+    // Starts waiting for the frames of a device whose stream is on
+    bool addDevice(VideoCapture* video);
+
+    // Returns once the engine no longer touches the device.  May be called from a frame callback.
+    void removeDevice(VideoCapture* video);
+
+    // Frames of the devices whose sync group is name are delivered in sets of frames with
+    // timestamps at most skewNs apart.  Groups which are not configured use
+    // vendor.evs.sync.skew_us, 10 ms by default.
+    void configureSyncGroup(const std::string& name, int64_t skewNs, FrameSetCallback onFrameSet);
+    void removeSyncGroup(const std::string& name);
+    SyncGroupStats getSyncGroupStats(const std::string& name);
+
+    // The skew window of groups without a configuration of their own
+    static int64_t getDefaultSkewNs();
+
+private:
+    CaptureEngine();
+
+    struct Device {
+        VideoCapture* video;
+        std::string syncGroup;
+        int pendingIndex = -1;  // Frame held back until the other members catch up
+        int64_t pendingTimestampNs = 0;
+    };
+
+    struct SyncGroup {
+        int64_t skewNs;
+        FrameSetCallback onFrameSet;
+        SyncGroupStats stats;
+    };
+
+    // A frame ready to be handed to the callback of its device.  The device may be removed
+    // before the frame is dispatched; removeDevice() waits for the dispatch, so video stays
+    // valid and the frame goes back to its driver instead.
+    struct Dispatch {
+        uint64_t serial;
+        VideoCapture* video;
+        int index;
+    };
+
+    void startThread();
+    void eventLoop();
+    void wakeUp();
+    void handleReadable(uint64_t serial);
+    void dispatchReadyGroups();
+    void dispatch(const std::vector<Dispatch>& frames, const std::string& syncGroup);
+
+    // These are expected to be called while mLock is held
+    SyncGroup& getSyncGroup_Locked(const std::string& name);
+    bool collectFrameSet_Locked(const std::string& name, std::vector<Dispatch>* frames);
+
+    int mEpollFd = -1;
+    int mEventFd = -1;  // Wakes the loop up to stop, or to re-evaluate the sync groups
+
+    std::once_flag mStartOnce;
+    std::thread mThread;
+
+    std::mutex mLock;
+    std::condition_variable mDispatchDone;
+    bool mStopping = false;
+    uint64_t mNextSerial = 1;
+    std::unordered_map<uint64_t, Device> mDevices;
+    std::unordered_map<std::string, SyncGroup> mSyncGroups;
+    std::set<uint64_t> mDispatching;  // Devices whose callbacks are running
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_CAPTUREENGINE_H
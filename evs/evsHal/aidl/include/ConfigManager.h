@@ -212,8 +212,11 @@ public:
     bool isReady() const { return mIsReady; }
 
 private:
+    /* Loads and stores the configuration of given files in tests */
+    friend class ConfigManagerTest;
+
     /* Constructors */
-    ConfigManager() : mBinaryFilePath("") {}
+    ConfigManager() {}
 
     static std::string_view sConfigDefaultPath;
     static std::string_view sConfigOverridePath;
@@ -246,7 +249,10 @@ private:
     std::condition_variable mConfigCond;
 
     /* A path to a binary configuration file */
-    const char* mBinaryFilePath;
+    std::string mBinaryFilePath;
+
+    /* Hash of the sources of the configuration, which a binary file must match */
+    uint64_t mSourceHash = 0;
 
     /* Configuration data readiness */
     bool mIsReady = false;
@@ -358,6 +364,10 @@ private:
     /*
      * Read configuration data from the binary file
      *
+     * The file is mapped and its records are copied into the configuration
+     * maps.  It is rejected unless it has the current format version and was
+     * written from the same sources.
+     *
      * @return bool
      *         True if it succeeds to read configuration data from a binary
      *         file.
@@ -368,10 +378,20 @@ private:
      * Store configuration data to the file
      *
      * @return bool
-     *         True if it succeeds to serialize mCameraInfo to the file.
+     *         True if it succeeds to serialize the configuration data to the
+     *         file.
      */
     bool writeConfigDataToBinary();
 
+    /*
+     * Hash the configuration files and the build fingerprint
+     *
+     * @return uint64_t
+     *         A hash which changes whenever the binary file needs to be
+     *         written again.
+     */
+    static uint64_t hashConfigSources();
+
     /*
      * debugging method to print out all XML elements and their attributes in
      * logcat message.
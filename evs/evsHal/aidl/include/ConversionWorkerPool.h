@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_CONVERSIONWORKERPOOL_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_CONVERSIONWORKERPOOL_H
+
+#include <sched.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// CPUs the helper threads are pinned to while they convert the frames of one camera
+struct ConversionAffinity {
+    bool pinned = false;
+    cpu_set_t cpus;
+
+    // Reads a CPU list such as "2-3,6" from vendor.evs.convert.cpus.<device node name>, e.g.
+    // vendor.evs.convert.cpus.video0 for /dev/video0.  Helpers are not pinned without it.
+    static ConversionAffinity fromProperties(const std::string& deviceName);
+};
+
+// Helper threads shared by all open cameras, which convert a frame in bands of rows
+// concurrently with the capture thread that forwards it.  The number of helpers is capped by
+// vendor.evs.convert.threads, 0 disables them.  Frames smaller than vendor.evs.convert.min_kb
+// are converted inline because the hand-off would cost more than it saves.
+class ConversionWorkerPool {
+public:
+    // Converts the rows [rowBegin, rowEnd) of a frame
+    using RowConverter = std::function<void(unsigned rowBegin, unsigned rowEnd)>;
+
+    static ConversionWorkerPool& getInstance();
+
+    ~ConversionWorkerPool();
+
+    // Converts rows [0, rows) in bands starting at multiples of rowAlignment and returns once
+    // all of them are done.  Returns false if the frame was converted inline.
+    bool run(const ConversionAffinity& affinity, unsigned rows, unsigned rowAlignment,
+             size_t frameBytes, const RowConverter& convert);
+
+private:
+    ConversionWorkerPool();
+
+    struct Job {
+        const RowConverter* convert;
+        const ConversionAffinity* affinity;
+        unsigned pending;
+        std::mutex lock;
+        std::condition_variable done;
+    };
+
+    struct Band {
+        Job* job;
+        unsigned begin;
+        unsigned end;
+    };
+
+    void startHelpers();
+    void helperLoop();
+    void finishBand(const Band& band);
+
+    // Takes back a band of job no helper has picked up yet
+    bool reclaimBand(const Job* job, Band* band);
+
+    unsigned mMaxHelpers;
+    size_t mMinParallelBytes;
+    cpu_set_t mDefaultCpus;
+
+    std::once_flag mStartOnce;
+    std::vector<std::thread> mHelpers;
+
+    std::mutex mLock;
+    std::condition_variable mSignal;
+    std::deque<Band> mBands;
+    bool mStopping = false;
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_CONVERSIONWORKERPOOL_H
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_DISPLAYPACER_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_DISPLAYPACER_H
+
+#include "LatencyHistogram.h"
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Tells the display when to present
+class VsyncSource {
+public:
+    virtual ~VsyncSource() = default;
+
+    // Blocks until the next vsync and returns its time on CLOCK_MONOTONIC, or -1 once stopped
+    virtual int64_t waitForNextVsync() = 0;
+    virtual int64_t getPeriodNs() const = 0;
+
+    // Releases the waiters; later waits return -1
+    virtual void stop() {}
+};
+
+// Vsyncs at a fixed rate, like Choreographer without the display behind it.
+// vendor.evs.display.refresh_rate sets the rate in Hz, 60 by default.
+class TimerVsyncSource final : public VsyncSource {
+public:
+    TimerVsyncSource();
+    explicit TimerVsyncSource(int64_t periodNs);
+
+    int64_t waitForNextVsync() override;
+    int64_t getPeriodNs() const override { return mPeriodNs; }
+
+private:
+    const int64_t mPeriodNs;
+    const int64_t mPhaseNs;  // Time of a vsync; the others follow every period
+};
+
+// Vsyncs when told to, so the pacing can be driven step by step without a display
+class SimulatedVsyncSource final : public VsyncSource {
+public:
+    explicit SimulatedVsyncSource(int64_t periodNs) : mPeriodNs(periodNs) {}
+
+    // Signals a vsync at timestampNs to the threads waiting for one
+    void tick(int64_t timestampNs);
+
+    int64_t waitForNextVsync() override;
+    int64_t getPeriodNs() const override { return mPeriodNs; }
+    void stop() override;
+
+private:
+    const int64_t mPeriodNs;
+
+    std::mutex mLock;
+    std::condition_variable mTicked;
+    uint64_t mTicks = 0;
+    int64_t mLastVsyncNs = 0;
+    bool mStopped = false;
+};
+
+// Paces the target buffers of a display.  The client renders into any free buffer while another
+// waits for the next vsync and a third is on the screen, where it stays until the next present
+// replaces it.  A buffer returned while an older one still waits replaces it, so the display
+// always shows the latest frame and a burst of frames does not build up a queue.
+class DisplayPacer final {
+public:
+    struct Stats {
+        uint64_t queued = 0;        // Frames the client returned for display
+        uint64_t presented = 0;
+        uint64_t dropped = 0;       // Replaced by a newer frame before their vsync
+        uint64_t missedVsyncs = 0;  // Vsyncs passed between the target one and the present
+        int64_t vsyncPeriodNs = 0;
+        LatencyHistogram::Summary presentLatency;  // Returned by the client to presented
+    };
+
+    DisplayPacer(size_t numBuffers, std::unique_ptr<VsyncSource> vsyncSource);
+
+    // Hands a free buffer to the client, waiting up to timeout for one.  Returns -1 if none
+    // became free or the pacer stopped.
+    int acquireBuffer(std::chrono::milliseconds timeout);
+
+    // The client is done with a buffer it acquired; queued buffers are presented, cancelled ones
+    // are free again.  Both return false if the client did not hold the buffer.
+    bool queueBuffer(int index);
+    bool cancelBuffer(int index);
+
+    // Waits for a queued frame and then for the next vsync, and returns the latest frame queued
+    // by then with the time of that vsync.  Returns -1 once the pacer stops.
+    int waitForPresent(int64_t* vsyncNs);
+
+    // The frame waitForPresent() returned is on the screen, and the buffer of the frame it
+    // replaced is free
+    void donePresenting(int index);
+
+    // The frame waitForPresent() returned could not be shown; its buffer is free and the screen
+    // keeps the frame it had
+    void cancelPresent(int index);
+
+    // Releases all waiters; the client gets no more buffers
+    void stop();
+
+    Stats getStats();
+
+private:
+    enum class BufferState { FREE, CLIENT, QUEUED, PRESENTING, ON_SCREEN };
+
+    struct Buffer {
+        BufferState state = BufferState::FREE;
+        int64_t queuedNs = 0;
+        int64_t vsyncNs = 0;
+    };
+
+    std::unique_ptr<VsyncSource> mVsyncSource;
+
+    std::mutex mLock;
+    std::condition_variable mBufferFree;   // The client can take a buffer, or the pacer stops
+    std::condition_variable mFrameQueued;  // A frame waits for presentation, or the pacer stops
+    std::vector<Buffer> mBuffers;
+    int mLatest = -1;    // The queued buffer, if any
+    int mOnScreen = -1;  // The buffer shown since the last present, if any
+    bool mStopping = false;
+
+    Stats mStats;
+    LatencyHistogram mPresentLatency;
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_DISPLAYPACER_H
@@ -20,6 +20,7 @@
 #include "ConfigManager.h"
 #include "EvsGlDisplay.h"
 #include "EvsV4lCamera.h"
+#include "EvsV4lLogicalCamera.h"
 #include "MediaControl.h"
 
 #include <aidl/android/frameworks/automotive/display/ICarDisplayProxy.h>
@@ -88,6 +89,7 @@ private:
     struct CameraRecord {
         aidlevs::CameraDesc desc;
         std::weak_ptr<EvsV4lCamera> activeInstance;
+        std::weak_ptr<EvsV4lLogicalCamera> activeGroupInstance;  // Camera groups only
 
         CameraRecord(const char* cameraId) : desc() { desc.id = cameraId; }
     };
@@ -117,6 +119,10 @@ private:
     bool checkPermission();
     void closeCamera_impl(const std::shared_ptr<aidlevs::IEvsCamera>& pCamera,
                           const std::string& cameraId);
+    ::ndk::ScopedAStatus openLogicalCamera_impl(const std::string& groupId,
+                                                const aidlevs::Stream& streamConfig,
+                                                CameraRecord* pRecord,
+                                                std::shared_ptr<aidlevs::IEvsCamera>* obj);
     ::ndk::ScopedAStatus getDisplayStateImpl(std::optional<int32_t> displayId,
                                              aidlevs::DisplayState* state);
 
@@ -151,6 +157,9 @@ private:
     // Dumpsys commands
     binder_status_t parseCommand(int fd, const std::vector<std::string>& options);
     binder_status_t cmdDump(int fd, const std::vector<std::string>& options);
+    binder_status_t cmdConversion(int fd, const std::vector<std::string>& options);
+    binder_status_t cmdSync(int fd, const std::vector<std::string>& options);
+    binder_status_t cmdRecord(int fd, const std::vector<std::string>& options);
     void cmdHelp(int fd);
 };
 
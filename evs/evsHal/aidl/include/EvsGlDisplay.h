@@ -17,6 +17,7 @@
 #ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_EVSGLDISPLAY_H
 #define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_EVSGLDISPLAY_H
 
+#include "DisplayPacer.h"
 #include "GlWrapper.h"
 
 #include <aidl/android/frameworks/automotive/display/ICarDisplayProxy.h>
@@ -26,7 +27,9 @@
 #include <aidl/android/hardware/automotive/evs/DisplayState.h>
 
 #include <condition_variable>
+#include <memory>
 #include <thread>
+#include <vector>
 
 namespace aidl::android::hardware::automotive::evs::implementation {
 
@@ -45,19 +48,27 @@ public:
     // Implementation details
     EvsGlDisplay(const std::shared_ptr<automotivedisplay::ICarDisplayProxy>& service,
                  uint64_t displayId);
+    // Renders off screen, paced by the given vsyncs, without the display proxy
+    EvsGlDisplay(unsigned width, unsigned height, std::unique_ptr<VsyncSource> vsyncSource);
     virtual ~EvsGlDisplay() override;
 
     // This gets called if another caller "steals" ownership of the display
     void forceShutdown();
 
+    DisplayPacer::Stats getPresentStats() { return mPacer.getStats(); }
+
 private:
-    // A graphics buffer into which we'll store images.  This member variable
-    // will be protected by semaphores.
+    // Three buffers, so the client renders into one while another waits for the vsync and the
+    // third is on the screen
+    static constexpr size_t kNumTargetBuffers = 3;
+
+    // A graphics buffer into which we'll store images.  DisplayPacer tells who owns which one.
     struct BufferRecord {
         ::aidl::android::hardware::graphics::common::HardwareBufferDescription description;
-        buffer_handle_t handle;
-        int fingerprint;
-    } mBuffer;
+        buffer_handle_t handle = nullptr;
+        int fingerprint = 0;
+    };
+    std::vector<BufferRecord> mBuffers;
 
     // State of a rendering thread
     enum RenderThreadStates {
@@ -71,23 +82,25 @@ private:
     aidlevs::DisplayState mRequestedState GUARDED_BY(mLock) = aidlevs::DisplayState::NOT_VISIBLE;
     std::shared_ptr<automotivedisplay::ICarDisplayProxy> mDisplayProxy;
 
+    // Size of the off screen surface; zero when rendering on the display
+    unsigned mHeadlessWidth = 0;
+    unsigned mHeadlessHeight = 0;
+
     GlWrapper mGlWrapper;
     mutable std::mutex mLock;
 
-    // This tells us whether or not our buffer is in use.  Protected by
-    // semaphores.
-    bool mBufferBusy = false;
+    // Hands the buffers to the client and to the rendering thread, and presents on vsyncs
+    DisplayPacer mPacer;
 
     // Variables to synchronize a rendering thread w/ main and binder threads
     std::thread mRenderThread;
     RenderThreadStates mState GUARDED_BY(mLock) = STOPPED;
-    bool mBufferReady = false;
+    bool mBuffersReady GUARDED_BY(mLock) = false;
     void renderFrames();
     bool initializeGlContextLocked() REQUIRES(mLock);
+    void releaseBuffers() REQUIRES(mLock);
 
-    std::condition_variable mBufferReadyToUse;
-    std::condition_variable mBufferReadyToRender;
-    std::condition_variable mBufferDone;
+    std::condition_variable mBuffersReadyToUse;
 };
 
 }  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -18,6 +18,12 @@
 #define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_EVSV4LCAMERA_H
 
 #include "ConfigManager.h"
+#include "ConversionWorkerPool.h"
+#include "FrameDumper.h"
+#include "FrameRateLimiter.h"
+#include "FrameSlotRing.h"
+#include "LatencyHistogram.h"
+#include "MjpegDecoder.h"
 #include "VideoCapture.h"
 
 #include <aidl/android/hardware/automotive/evs/BnEvsCamera.h>
@@ -33,7 +39,10 @@
 #include <android/hardware_buffer.h>
 #include <ui/GraphicBuffer.h>
 
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <string>
 #include <thread>
 
 namespace aidl::android::hardware::automotive::evs::implementation {
@@ -75,6 +84,10 @@ public:
     static std::shared_ptr<EvsV4lCamera> Create(const char* deviceName,
                                                 std::unique_ptr<ConfigManager::CameraInfo>& camInfo,
                                                 const aidlevs::Stream* streamCfg = nullptr);
+    // Has the pool allocate the graphics buffers of each output stream configuration of a camera
+    // in the background, count of each
+    static void prewarmBuffers(const ConfigManager::CameraInfo& camInfo, unsigned count);
+
     EvsV4lCamera(const EvsV4lCamera&) = delete;
     EvsV4lCamera& operator=(const EvsV4lCamera&) = delete;
 
@@ -83,10 +96,74 @@ public:
 
     const aidlevs::CameraDesc& getDesc() { return mDescription; }
 
-    // Dump captured frames to the filesystem
-    ::android::base::Result<void> startDumpFrames(const std::string& path);
+    // setExtendedInfo() with this identifier and a native int32_t sets the target frame rate
+    static constexpr int32_t kExtInfoTargetFrameRate = 0x45565301;
+
+    // Delivers frames at no more than fps, skipping the others before they are converted; 0
+    // delivers every frame the sensor captures.  Takes effect with the next frame.
+    void setTargetFrameRate(unsigned fps) { mFrameRateLimiter.setTargetRate(fps); }
+    unsigned getTargetFrameRate() const { return mFrameRateLimiter.getTargetRate(); }
+
+    // The size of the frames delivered; frames captured at another size are scaled to it
+    uint32_t getOutputWidth() const { return mOutputWidth; }
+    uint32_t getOutputHeight() const { return mOutputHeight; }
+
+    // Streams started afterwards deliver their frames in sync with the other cameras of the
+    // group, see CaptureEngine
+    void setSyncGroup(const std::string& name) { mVideo.setSyncGroup(name); }
+
+    // Dump every interval-th captured frame to the filesystem, LZ4 compressed if compress
+    ::android::base::Result<void> startDumpFrames(const std::string& path, unsigned interval = 1,
+                                                  bool compress = false);
     ::android::base::Result<void> stopDumpFrames();
 
+    // Counters of the current or last frame dump
+    ::android::base::Result<FrameDumper::Stats> getDumpStats();
+
+    // When the output format equals the capture format, frames are delivered in the buffers
+    // the driver captured them into.  These are either gralloc buffers whose dmabufs the driver
+    // imports, or driver buffers exported as dmabufs and imported into gralloc.
+    enum class ZeroCopyMode {
+        NONE,
+        DMABUF_IMPORT,
+        DMABUF_EXPORT,
+    };
+    ZeroCopyMode getZeroCopyMode() const { return mZeroCopyMode; }
+
+    // How the next stream shares buffers with the driver, in place of the property
+    // vendor.evs.v4l2.memory: "auto", "dmabuf", "expbuf" or "mmap", which always copies
+    void setMemoryMode(const std::string& mode) {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        mMemoryMode = mode;
+    }
+
+    // Record captured frames into a file ReplaySysCall can play back
+    ::android::base::Result<void> startRecording(const std::string& path);
+    void stopRecording() { mVideo.stopRecording(); }
+
+    // Time spent converting the captured frames into the output buffers
+    struct ConversionStats {
+        uint64_t frames = 0;
+        uint64_t parallelFrames = 0;  // Frames split across the conversion helpers
+        uint64_t scaledFrames = 0;    // MJPEG frames decoded at a reduced scale
+        uint64_t failedFrames = 0;    // MJPEG frames which could not be decoded
+        uint64_t skippedFrames = 0;   // Frames above the target frame rate, never converted
+        int64_t lastUs = 0;
+        int64_t totalUs = 0;
+        int64_t maxUs = 0;
+    };
+    ConversionStats getConversionStats();
+
+    // Per-frame latency of each stage between the driver and the client
+    struct FrameLatency {
+        LatencyHistogram::Summary capture;     // Driver timestamp to VIDIOC_DQBUF
+        LatencyHistogram::Summary conversion;  // VIDIOC_DQBUF to the frame being ready to send
+        LatencyHistogram::Summary delivery;    // Frame ready to deliverFrame() returning
+        LatencyHistogram::Summary clientHold;  // deliverFrame() to doneWithFrame()
+    };
+    FrameLatency getFrameLatency();
+    void resetFrameLatency();
+
     // Constructors
     EvsV4lCamera(const char* deviceName, std::unique_ptr<ConfigManager::CameraInfo>& camInfo);
 
@@ -96,7 +173,44 @@ private:
     unsigned increaseAvailableFrames_Locked(unsigned numToAdd);
     unsigned decreaseAvailableFrames_Locked(unsigned numToRemove);
 
+    // Stores a new buffer in an empty slot and queues it as free
+    bool addBuffer_Locked(buffer_handle_t handle);
+
+    // Takes back a slot the capture thread handed out, or releases its buffer if the client
+    // shrank the queue while the frame was in flight
+    void returnSlot(uint32_t id);
+
     void forwardFrame(imageBuffer* tgt, void* data);
+    bool forwardZeroCopyFrame(imageBuffer* tgt);
+
+    // Decodes an MJPEG frame into the buffer of a slot and delivers it, on a decoder thread or,
+    // for a member of a sync group, on the capture thread
+    void decodeFrame(uint32_t idx, int64_t dequeueNs, MjpegDecoder& decoder, const uint8_t* data,
+                     size_t size);
+
+    aidlevs::BufferDesc makeBufferDesc(uint32_t idx);
+    void deliverFrame(aidlevs::BufferDesc&& bufferDesc, uint32_t idx, int64_t readyNs);
+    void dumpFrame(imageBuffer* tgt, void* data);
+
+    // Try to stream straight into buffers shared with the driver.  Returns false if no stream
+    // was started; a started stream may still copy frames if the buffers could not be shared.
+    // The export path releases lock while it starts the stream and imports the buffers.
+    bool startZeroCopyStream_Locked(
+            const std::function<void(VideoCapture*, imageBuffer*, void*)>& callback,
+            std::unique_lock<std::mutex>& lock);
+    bool startDmabufImportStream_Locked(
+            const std::function<void(VideoCapture*, imageBuffer*, void*)>& callback);
+    bool startDmabufExportStream_Locked(
+            const std::function<void(VideoCapture*, imageBuffer*, void*)>& callback,
+            std::unique_lock<std::mutex>& lock);
+    void releaseZeroCopyBuffers_Locked();
+
+    // Whether the driver can capture into a gralloc buffer of the given stride as is
+    bool matchesCaptureLayout(buffer_handle_t handle, uint32_t pixelsPerLine);
+
+    // Give the copy buffers back to the pool while frames are shared, and acquire them again
+    void parkCopyBuffers_Locked();
+    void unparkCopyBuffers_Locked();
     inline bool convertToV4l2CID(aidlevs::CameraParam id, uint32_t& v4l2cid);
 
     // The callback used to deliver each frame
@@ -112,25 +226,81 @@ private:
     uint32_t mUsage = 0;   // Values from from Gralloc.h
     uint32_t mStride = 0;  // Pixels per row (may be greater than image width)
 
+    // The size of the output buffers, which the stream configuration picks.  It differs from
+    // the size mVideo captures when no capture size matches; the conversion then scales.
+    uint32_t mOutputWidth = 0;
+    uint32_t mOutputHeight = 0;
+    bool isScaled() {
+        return mOutputWidth != mVideo.getWidth() || mOutputHeight != mVideo.getHeight();
+    }
+
     struct BufferRecord {
         buffer_handle_t handle;
         bool inUse;
+        int64_t deliveredNs = 0;  // CLOCK_MONOTONIC
 
         explicit BufferRecord(buffer_handle_t h) : handle(h), inUse(false){};
     };
 
-    // Graphics buffers to transfer images
-    std::vector<BufferRecord> mBuffers;
+    // A slot holds a graphics buffer while it is queued in mFreeSlots or in flight.  Only the
+    // thread which popped a slot, or set inUse back to false, may touch it until it is queued
+    // again; handles of empty slots are changed with mAccessLock held.
+    struct BufferSlot {
+        buffer_handle_t handle = nullptr;
+        std::atomic<bool> inUse = false;
+        std::atomic<int64_t> deliveredNs = 0;  // CLOCK_MONOTONIC
+    };
+
+    // Graphics buffers to transfer images, kMaxBuffersInFlight slots which never move
+    std::unique_ptr<BufferSlot[]> mBuffers;
+    // Indices of the slots ready to be filled by the capture thread
+    FrameSlotRing mFreeSlots;
     // How many buffers are we currently using
     unsigned mFramesAllowed;
+    // Buffers to release as soon as the client returns them, changed with mAccessLock held
+    std::atomic<unsigned> mSlotsToRelease = 0;
     // How many buffers are currently outstanding
-    unsigned mFramesInUse;
+    std::atomic<unsigned> mFramesInUse;
 
     std::set<uint32_t> mCameraControls;  // Available camera controls
 
+    std::atomic<ZeroCopyMode> mZeroCopyMode = ZeroCopyMode::NONE;
+    std::string mMemoryMode;  // Overrides vendor.evs.v4l2.memory unless empty
+    // Set while frames are shared with the driver and the free copy buffers are back in the pool
+    bool mCopyBuffersParked = false;
+
+    // Indexed like the V4L2 buffers while mZeroCopyMode is not NONE
+    std::vector<BufferRecord> mZeroCopyBuffers;
+    uint32_t mZeroCopyStride = 0;  // Pixels per row of mZeroCopyBuffers
+    // Set while the exported buffers are imported without mAccessLock; frames are dropped
+    bool mZeroCopyPending = false;
+    // Changes whenever the zero copy buffers are released, so an import finishing after the
+    // stream was stopped throws its buffers away
+    uint64_t mZeroCopyGeneration = 0;
+
     // Which format specific function we need to use to move camera imagery into our output buffers
-    void (*mFillBufferFromVideo)(const aidlevs::BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
-                                 unsigned imgStride);
+    std::function<void(const aidlevs::BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                       unsigned imgStride, unsigned rowBegin, unsigned rowEnd)>
+            mFillBufferFromVideo;
+
+    // MJPEG frames are decoded by MjpegDecoderPool instead of mFillBufferFromVideo, or by
+    // mSyncDecoder on the capture thread while the camera is a member of a sync group
+    bool mDecodeMjpeg = false;
+    std::unique_ptr<MjpegDecoder> mSyncDecoder;
+
+    // Decides which captured frames are delivered
+    FrameRateLimiter mFrameRateLimiter;
+
+    // CPUs the shared conversion helpers use for this camera
+    ConversionAffinity mConversionAffinity;
+
+    ConversionStats mConversionStats;
+    std::mutex mConversionStatsLock;
+
+    // The capture stage is measured by mVideo
+    LatencyHistogram mConversionLatency;
+    LatencyHistogram mDeliveryLatency;
+    LatencyHistogram mClientHoldLatency;
 
     aidlevs::EvsResult doneWithFrame_impl(const aidlevs::BufferDesc& bufferDesc);
     aidlevs::EvsResult doneWithFrame_impl(uint32_t id, buffer_handle_t handle);
@@ -148,8 +318,9 @@ private:
     // Dump captured frames
     std::atomic<bool> mDumpFrame = false;
 
-    // Path to store captured frames
-    std::string mDumpPath;
+    // Writes the dumped frames; kept after the dump stops for its counters
+    std::shared_ptr<FrameDumper> mFrameDumper;
+    std::mutex mDumpLock;
 
     // Frame counter
     uint64_t mFrameCounter = 0;
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_EVSV4LLOGICALCAMERA_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_EVSV4LLOGICALCAMERA_H
+
+#include "CaptureEngine.h"
+#include "ConfigManager.h"
+#include "EvsV4lCamera.h"
+
+#include <aidl/android/hardware/automotive/evs/BnEvsCamera.h>
+#include <aidl/android/hardware/automotive/evs/BnEvsCameraStream.h>
+#include <aidl/android/hardware/automotive/evs/BufferDesc.h>
+#include <aidl/android/hardware/automotive/evs/CameraDesc.h>
+#include <aidl/android/hardware/automotive/evs/EvsEventDesc.h>
+#include <aidl/android/hardware/automotive/evs/IEvsCameraStream.h>
+
+#include <mutex>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// A camera group of the configuration, e.g. the cameras of a surround view.  The frames of the
+// member cameras are captured in sync by the CaptureEngine and delivered to the client in one
+// deliverFrame() call per set, one buffer per member identified by its deviceId.
+class EvsV4lLogicalCamera : public ::aidl::android::hardware::automotive::evs::BnEvsCamera {
+public:
+    // Methods from ::android::hardware::automotive::aidlevs::IEvsCamera follow.
+    ::ndk::ScopedAStatus doneWithFrame(const std::vector<aidlevs::BufferDesc>& buffers) override;
+    ::ndk::ScopedAStatus forcePrimaryClient(
+            const std::shared_ptr<aidlevs::IEvsDisplay>& display) override;
+    ::ndk::ScopedAStatus getCameraInfo(aidlevs::CameraDesc* _aidl_return) override;
+    ::ndk::ScopedAStatus getExtendedInfo(int32_t opaqueIdentifier,
+                                         std::vector<uint8_t>* value) override;
+    ::ndk::ScopedAStatus getIntParameter(aidlevs::CameraParam id,
+                                         std::vector<int32_t>* value) override;
+    ::ndk::ScopedAStatus getIntParameterRange(aidlevs::CameraParam id,
+                                              aidlevs::ParameterRange* _aidl_return) override;
+    ::ndk::ScopedAStatus getParameterList(std::vector<aidlevs::CameraParam>* _aidl_return) override;
+    ::ndk::ScopedAStatus getPhysicalCameraInfo(const std::string& deviceId,
+                                               aidlevs::CameraDesc* _aidl_return) override;
+    ::ndk::ScopedAStatus importExternalBuffers(const std::vector<aidlevs::BufferDesc>& buffers,
+                                               int32_t* _aidl_return) override;
+    ::ndk::ScopedAStatus pauseVideoStream() override;
+    ::ndk::ScopedAStatus resumeVideoStream() override;
+    ::ndk::ScopedAStatus setExtendedInfo(int32_t opaqueIdentifier,
+                                         const std::vector<uint8_t>& opaqueValue) override;
+    ::ndk::ScopedAStatus setIntParameter(aidlevs::CameraParam id, int32_t value,
+                                         std::vector<int32_t>* effectiveValue) override;
+    ::ndk::ScopedAStatus setPrimaryClient() override;
+    ::ndk::ScopedAStatus setMaxFramesInFlight(int32_t bufferCount) override;
+    ::ndk::ScopedAStatus startVideoStream(
+            const std::shared_ptr<aidlevs::IEvsCameraStream>& receiver) override;
+    ::ndk::ScopedAStatus stopVideoStream() override;
+    ::ndk::ScopedAStatus unsetPrimaryClient() override;
+
+    // The member cameras must have been opened already
+    static std::shared_ptr<EvsV4lLogicalCamera> Create(
+            const char* groupId, std::unique_ptr<ConfigManager::CameraGroupInfo>& groupInfo,
+            std::vector<std::shared_ptr<EvsV4lCamera>> members);
+    EvsV4lLogicalCamera(const EvsV4lLogicalCamera&) = delete;
+    EvsV4lLogicalCamera& operator=(const EvsV4lLogicalCamera&) = delete;
+
+    virtual ~EvsV4lLogicalCamera() override;
+    void shutdown();
+
+    const aidlevs::CameraDesc& getDesc() { return mDescription; }
+    CaptureEngine::SyncGroupStats getSyncStats();
+
+    // Constructors
+    EvsV4lLogicalCamera(const char* groupId, std::vector<std::shared_ptr<EvsV4lCamera>> members);
+
+private:
+    // Receives the frames and events of one member camera
+    class MemberStream : public ::aidl::android::hardware::automotive::evs::BnEvsCameraStream {
+    public:
+        explicit MemberStream(EvsV4lLogicalCamera* parent) : mParent(parent) {}
+
+        ::ndk::ScopedAStatus deliverFrame(
+                const std::vector<aidlevs::BufferDesc>& buffers) override;
+        ::ndk::ScopedAStatus notify(const aidlevs::EvsEventDesc& event) override;
+
+    private:
+        // Members are stopped before their logical camera goes away
+        EvsV4lLogicalCamera* mParent;
+    };
+
+    void collectFrames(const std::vector<aidlevs::BufferDesc>& buffers);
+    void forwardFrameSet();
+    void forwardEvent(const aidlevs::EvsEventDesc& event);
+    void returnFrames(const std::vector<aidlevs::BufferDesc>& buffers);
+    std::shared_ptr<EvsV4lCamera> findMember(const std::string& deviceId);
+
+    aidlevs::CameraDesc mDescription = {};
+    std::vector<std::shared_ptr<EvsV4lCamera>> mMembers;
+    std::shared_ptr<MemberStream> mMemberStream;
+
+    // The client and the set being collected from the members on the capture engine thread
+    std::mutex mAccessLock;
+    std::shared_ptr<aidlevs::IEvsCameraStream> mStream;
+    std::vector<aidlevs::BufferDesc> mPendingSet;
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_EVSV4LLOGICALCAMERA_H
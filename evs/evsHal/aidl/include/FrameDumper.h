@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_FRAMEDUMPER_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_FRAMEDUMPER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Writes the frames of a camera into files from a background thread, so dumping does not hold up
+// the capture thread.  The capture thread only copies a frame into one of a few slots allocated
+// up front for the frame size of the stream; when all of them wait for the disk, the oldest
+// waiting frame is dropped for the new one.
+// vendor.evs.dump.slots sets the number of slots, four by default.
+class FrameDumper final {
+public:
+    struct Options {
+        std::string directory;
+        std::string prefix;     // Files are named <prefix>_<frame number>.bin
+        unsigned interval = 1;  // Keeps every interval-th frame; at least 1
+        bool compress = false;  // Writes LZ4 frames into .bin.lz4 files instead
+        size_t frameSize = 0;   // Bytes of each frame, which the buffers are allocated for
+    };
+
+    // Written ahead of the pixels of each frame
+    struct Header {
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        uint32_t format;
+    };
+
+    struct Stats {
+        uint64_t frames = 0;     // Offered by the capture thread
+        uint64_t sampled = 0;    // Copied into a slot
+        uint64_t written = 0;
+        uint64_t dropped = 0;    // Overwritten by newer frames before they were written
+        uint64_t failed = 0;     // Could not be written
+        uint64_t bytes = 0;      // Of the frames written, before compression
+        uint64_t fileBytes = 0;  // Of the files written
+        double writeMs = 0;      // Spent compressing and writing
+        size_t slots = 0;
+        size_t maxQueued = 0;
+    };
+
+    explicit FrameDumper(const Options& options);
+    ~FrameDumper();
+    FrameDumper(const FrameDumper&) = delete;
+    FrameDumper& operator=(const FrameDumper&) = delete;
+
+    // Called by the capture thread for each frame
+    void submit(uint64_t frameNumber, const Header& header, const void* data, size_t length);
+
+    // Writes the frames still waiting and stops the writer thread; later frames are ignored
+    void stop();
+
+    Stats getStats();
+
+private:
+    enum class SlotState { FREE, FILLING, QUEUED, WRITING };
+
+    struct Slot {
+        SlotState state = SlotState::FREE;
+        uint64_t frameNumber = 0;
+        size_t size = 0;              // Bytes of the header and the frame
+        std::vector<uint8_t> buffer;  // Grows only if a frame larger than frameSize comes
+    };
+
+    void writerLoop();
+
+    // Returns the size of the file written, or 0 if it could not be written
+    size_t writeSlot(const Slot& slot);
+
+    const Options mOptions;
+    std::vector<uint8_t> mCompressed;  // Owned by the writer thread; as large as the LZ4 bound
+
+    std::mutex mLock;
+    std::condition_variable mSignal;  // A slot was queued, or the writer stops
+    std::vector<Slot> mSlots;
+    std::deque<size_t> mQueue;  // Indices of the queued slots, oldest first
+    bool mStopping = false;
+    Stats mStats;
+
+    std::mutex mStopLock;  // Callers of stop()
+    std::thread mWriter;
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_FRAMEDUMPER_H
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_FRAMERATELIMITER_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_FRAMERATELIMITER_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Decimates a stream of frames to a target rate by their capture timestamps.  A frame is kept
+// when it is due, and the next one becomes due a period later, so the frames kept average no
+// more than the target rate and a sensor rate which is a multiple of it keeps every n-th frame
+// despite jitter.
+class FrameRateLimiter final {
+public:
+    // Any thread may change the rate; 0 keeps every frame
+    void setTargetRate(unsigned fps) { mTargetFps = fps; }
+    unsigned getTargetRate() const { return mTargetFps; }
+
+    // Starts over with the next frame, as after a restart of the stream
+    void reset();
+
+    // Called by the capture thread for each frame; returns false for the frames to skip
+    bool accept(int64_t timestampNs);
+
+private:
+    std::atomic<unsigned> mTargetFps = 0;
+
+    // Owned by the capture thread
+    unsigned mAppliedFps = 0;
+    int64_t mNextDueNs = 0;
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_FRAMERATELIMITER_H
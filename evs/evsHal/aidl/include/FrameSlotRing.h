@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_FRAMESLOTRING_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_FRAMESLOTRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Bounded queue of buffer slot indices, which hands free slots to the capture thread without a
+// lock.  Any thread may push or pop; the capture thread pops while binder threads push the slots
+// their clients return.  A push or pop only fails when the queue is full or empty, or while
+// another thread is half way through taking or filling the cell it needs next.
+class FrameSlotRing {
+public:
+    // Holds up to capacity indices, rounded up to a power of two
+    explicit FrameSlotRing(size_t capacity);
+
+    FrameSlotRing(const FrameSlotRing&) = delete;
+    FrameSlotRing& operator=(const FrameSlotRing&) = delete;
+
+    bool push(uint32_t slot);
+    bool pop(uint32_t* slot);
+
+    // Number of queued indices, which may be stale by the time it returns
+    size_t size() const;
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        uint32_t slot;
+    };
+
+    const size_t mMask;
+    std::unique_ptr<Cell[]> mCells;
+
+    // Producers and consumers update separate cache lines
+    alignas(64) std::atomic<size_t> mEnqueuePos;
+    alignas(64) std::atomic<size_t> mDequeuePos;
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_FRAMESLOTRING_H
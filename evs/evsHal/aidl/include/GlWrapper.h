@@ -29,6 +29,8 @@
 #include <android-base/thread_annotations.h>
 #include <cutils/native_handle.h>
 
+#include <unordered_map>
+
 namespace aidl::android::hardware::automotive::evs::implementation {
 
 namespace automotivedisplay = ::aidl::android::frameworks::automotive::display;
@@ -38,14 +40,23 @@ public:
     GlWrapper() = default;
     bool initialize(const std::shared_ptr<automotivedisplay::ICarDisplayProxy>& svc,
                     uint64_t displayId);
+    // Renders into a pbuffer instead of a window of the display, so the display runs without
+    // the display proxy
+    bool initializeHeadless(unsigned width, unsigned height);
     void shutdown();
 
+    // Selects the buffer to draw.  A buffer is imported into EGL the first time it is seen, and
+    // its texture is reused afterwards for as long as its id stays in the cache.
     bool updateImageTexture(
-            buffer_handle_t handle,
+            uint64_t bufferId, buffer_handle_t handle,
             const ::aidl::android::hardware::graphics::common::HardwareBufferDescription&
                     description);
     void renderImageToScreen();
 
+    // Forgets every imported buffer; must be called before a cached buffer is freed, as its id
+    // may be given to a new one
+    void releaseImageCache();
+
     void showWindow(const std::shared_ptr<automotivedisplay::ICarDisplayProxy>& svc,
                     uint64_t displayId);
     void hideWindow(const std::shared_ptr<automotivedisplay::ICarDisplayProxy>& svc,
@@ -55,6 +66,9 @@ public:
     unsigned getHeight() { return mHeight; };
 
 private:
+    // Sets up EGL and the shader for the window or the pbuffer
+    bool initializeContext();
+
     EGLDisplay mDisplay;
     EGLSurface mSurface;
     EGLContext mContext;
@@ -62,14 +76,23 @@ private:
     unsigned mWidth = 0;
     unsigned mHeight = 0;
 
-    EGLImageKHR mKHRimage = EGL_NO_IMAGE_KHR;
+    // Imported buffers, by buffer id.  A few are enough as we draw from a small set of buffers.
+    struct CachedImage {
+        EGLImageKHR image;
+        GLuint texture;
+        uint64_t lastUsed;
+    };
+    static constexpr size_t kMaxCachedImages = 8;
+    std::unordered_map<uint64_t, CachedImage> mImageCache;
+    uint64_t mImageCacheClock = 0;
+    GLuint mTextureMap = 0;  // Texture of the buffer to draw
 
-    GLuint mTextureMap = 0;
     GLuint mShaderProgram = 0;
 
     // Opaque handle for a native hardware buffer defined in
     // frameworks/native/opengl/include/EGL/eglplatform.h
-    ANativeWindow* mWindow;
+    ANativeWindow* mWindow = nullptr;
+    bool mHeadless = false;
 
     bool mFirstFrameIsDisplayed = false;
 };
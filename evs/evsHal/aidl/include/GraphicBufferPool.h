@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_GRAPHICBUFFERPOOL_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_GRAPHICBUFFERPOOL_H
+
+#include <cutils/native_handle.h>
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Graphics buffers shared by all cameras of the process.  Buffers given back are kept for the
+// next camera or session asking for the same kind of buffer instead of being freed, as long as
+// the kept buffers stay below a high watermark, vendor.evs.pool.watermark_mb (64 MB by default).
+// Buffers can be allocated ahead of time in the background, so opening a camera does not wait
+// for the allocator.
+class GraphicBufferPool final {
+public:
+    struct Key {
+        uint32_t width;
+        uint32_t height;
+        int32_t format;  // android_pixel_format_t
+        uint64_t usage;  // GRALLOC_USAGE_*
+
+        bool operator<(const Key& other) const {
+            return std::tie(width, height, format, usage) <
+                    std::tie(other.width, other.height, other.format, other.usage);
+        }
+    };
+
+    struct Stats {
+        uint64_t allocations = 0;
+        uint64_t reuses = 0;     // Buffers handed out again instead of being allocated
+        uint64_t prewarmed = 0;  // Buffers allocated ahead of time
+        uint64_t frees = 0;
+        size_t liveBuffers = 0;  // Handed out and not given back yet
+        size_t liveBytes = 0;
+        size_t idleBuffers = 0;  // Kept for reuse
+        size_t idleBytes = 0;
+        size_t peakBytes = 0;
+        size_t highWatermarkBytes = 0;
+    };
+
+    static GraphicBufferPool& getInstance();
+
+    ~GraphicBufferPool();
+
+    // Returns a buffer of the given kind and its stride in pixels, or nullptr if none can be
+    // allocated
+    buffer_handle_t acquire(const Key& key, uint32_t* stride);
+
+    // Gives back a buffer from acquire(), which is kept for reuse if it fits below the high
+    // watermark.  Buffers the pool does not know are freed.
+    void release(buffer_handle_t handle);
+
+    // Allocates buffers in the background until count of the kind are kept, unless this would
+    // cross the high watermark
+    void prewarm(const Key& key, unsigned count);
+
+    // Frees every buffer kept for reuse
+    void trim();
+
+    Stats getStats();
+
+private:
+    GraphicBufferPool();
+
+    struct Buffer {
+        buffer_handle_t handle;
+        uint32_t stride;
+    };
+
+    struct LiveBuffer {
+        Key key;
+        uint32_t stride;
+        size_t bytes;
+    };
+
+    static size_t getBufferSize(const Key& key, uint32_t stride);
+    static buffer_handle_t allocate(const Key& key, uint32_t* stride);
+    static void free(buffer_handle_t handle);
+
+    // Frees the oldest kept buffers until they fit below the high watermark
+    void shrink_Locked(std::vector<buffer_handle_t>* toFree);
+    void runPrewarm();
+
+    std::mutex mLock;
+    std::condition_variable mPrewarmSignal;
+
+    // Kept buffers in the order they were given back, oldest first
+    struct IdleBuffer {
+        Key key;
+        Buffer buffer;
+        size_t bytes;
+    };
+    std::deque<IdleBuffer> mIdleBuffers;
+    std::unordered_map<buffer_handle_t, LiveBuffer> mLiveBuffers;
+
+    std::deque<std::pair<Key, unsigned>> mPrewarmQueue;
+    std::thread mPrewarmThread;
+    bool mStopping = false;
+
+    Stats mStats;
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_GRAPHICBUFFERPOOL_H
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_LATENCYHISTOGRAM_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_LATENCYHISTOGRAM_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Counts latencies in microseconds into log-linear buckets, as HdrHistogram does: values below
+// 64 us are exact and larger ones are kept within 1/32 of their value, up to about 134 s.
+// Recording and reading never block, so this is cheap enough to run on every frame.
+class LatencyHistogram {
+public:
+    struct Summary {
+        uint64_t count = 0;
+        int64_t minUs = 0;
+        int64_t meanUs = 0;
+        int64_t p50Us = 0;
+        int64_t p90Us = 0;
+        int64_t p99Us = 0;
+        int64_t p999Us = 0;
+        int64_t maxUs = 0;
+    };
+
+    LatencyHistogram() { reset(); }
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(int64_t valueUs);
+
+    // Samples recorded while this runs may be counted in part
+    void reset();
+
+    Summary getSummary() const;
+
+private:
+    static constexpr unsigned kSubBucketBits = 5;
+    static constexpr unsigned kSubBuckets = 1u << kSubBucketBits;
+    static constexpr unsigned kMaxValueBits = 27;
+    static constexpr unsigned kNumBuckets = (kMaxValueBits - kSubBucketBits + 1) * kSubBuckets;
+
+    static unsigned getBucketIndex(uint64_t valueUs);
+    static int64_t getBucketHighestValue(unsigned index);
+
+    std::atomic<uint64_t> mBuckets[kNumBuckets];
+    std::atomic<uint64_t> mTotalUs;
+    std::atomic<int64_t> mMinUs;
+    std::atomic<int64_t> mMaxUs;
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_LATENCYHISTOGRAM_H
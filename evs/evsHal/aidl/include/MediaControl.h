@@ -180,7 +180,12 @@ class MediaControl {
     static void releaseInstance();
 
     /**
-     * \brief Enum entities and link, and reset all links
+     * \brief Enum entities and links, unless the graph enumerated before is
+     * still current
+     *
+     * The graph is kept until MEDIA_IOC_G_TOPOLOGY reports another topology
+     * version; the link flags are refreshed from the same ioctl, since links
+     * may be switched by others without changing the version.
      *
      * \return 0 if succeed, other value indicates failed
      */
@@ -204,7 +209,21 @@ class MediaControl {
     // VIRTUAL_CHANNEL_E
     int createLink();
 
+    /**
+     * \brief Enable the links of a route with as few link changes as possible
+     *
+     * Only the links of the route which are disabled are enabled.  Enabled
+     * links which feed a sink pad of the route from elsewhere are disabled
+     * first; all other links, which may carry other streams, stay as they are.
+     *
+     * \return 0 if succeed, other value indicates failed
+     */
+    int setupRoute(const std::vector<McLink>& links);
+
  private:
+    // Drives a media device simulated through SysCall in tests
+    friend class MediaControlTest;
+
     MediaControl& operator=(const MediaControl&);
     MediaControl(const char* devName);
     ~MediaControl();
@@ -216,8 +235,15 @@ class MediaControl {
     int SetRouting(int fd, v4l2_subdev_route* routes, uint32_t numRoutes);
     int GetRouting(int fd, v4l2_subdev_route* routes, uint32_t* numRoutes);
 
+    struct LinkChange {
+        MediaLink* link;
+        bool enable;
+    };
+
     // enum MediaControl info.
     int enumInfo();
+    int queryTopologyVersion(int fd);
+    int refreshTopology(int fd);
     int enumLinks(int fd);
     int enumEntities(int fd);
 
@@ -229,6 +255,10 @@ class MediaControl {
     // set up entity link.
 
     MediaLink* entityAddLink(MediaEntity* entity);
+    MediaLink* findLink(uint32_t srcEntity, uint32_t srcPad, uint32_t sinkEntity,
+                        uint32_t sinkPad);
+    int planRoute(const std::vector<McLink>& links, std::vector<LinkChange>* changes);
+    int setupLink(int fd, MediaLink* link, uint32_t flags);
     int setupLink(uint32_t srcEntity, uint32_t srcPad, uint32_t sinkEntity, uint32_t sinkPad,
                   bool enable);
     int setupLink(MediaPad* source, MediaPad* sink, uint32_t flags);
@@ -239,6 +269,13 @@ class MediaControl {
     std::string mDevName;
     std::vector<MediaEntity> mEntities;
 
+    // The topology the entities were enumerated from
+    uint32_t mMediaVersion;
+    bool mHasTopology;
+    uint64_t mTopologyVersion;
+    uint32_t mTopologyPads;
+    uint32_t mTopologyLinks;
+
     static MediaControl* sInstance;
     static std::mutex sLock;
 };
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_MJPEGDECODER_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_MJPEGDECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Decodes the JPEG images of MJPEG streams with libjpeg-turbo, straight into the rows of a
+// graphics buffer.  Images larger than the target are decoded at 1/2, 1/4 or 1/8 scale in the
+// IDCT when that still covers the target, which skips most of the work, and whatever size is
+// left over is made up by taking the nearest pixels of the rows decoded.
+class MjpegDecoder final {
+public:
+    struct Target {
+        uint8_t* pixels;
+        uint32_t format;  // android_pixel_format_t: RGBA_8888, YCBCR_422_I or YCRCB_420_SP
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;  // Pixels per row; YCRCB_420_SP chroma follows stride * height bytes
+    };
+
+    MjpegDecoder();
+    ~MjpegDecoder();
+    MjpegDecoder(const MjpegDecoder&) = delete;
+    MjpegDecoder& operator=(const MjpegDecoder&) = delete;
+
+    // Returns false if the image is corrupt or the target format is not supported.  Rows of
+    // a corrupt image may be partly written.
+    bool decode(const uint8_t* data, size_t size, const Target& target);
+
+    // The scale of the last image decoded, e.g. 2 for 1/2
+    unsigned getLastScale() const { return mLastScale; }
+
+private:
+    struct Context;
+
+    // Errors of libjpeg jump back into decode(), so this keeps no object with a destructor
+    bool decodeImage(const uint8_t* data, size_t size, const Target& target);
+
+    std::unique_ptr<Context> mContext;
+    unsigned mLastScale = 1;
+};
+
+// A few threads shared by all cameras which decode MJPEG frames, so the capture thread only
+// copies the compressed frame and moves on.  Frames of one stream are decoded one after the
+// other in the order they were submitted; at most one more waits while one is being decoded.
+// vendor.evs.mjpeg.threads sets the number of threads, two by default.
+class MjpegDecoderPool final {
+public:
+    // Runs on a decoder thread with the copy of the frame
+    using Job = std::function<void(MjpegDecoder& decoder, const std::vector<uint8_t>& frame)>;
+
+    static MjpegDecoderPool& getInstance();
+
+    ~MjpegDecoderPool();
+
+    // Copies a frame of stream and queues job for it.  Returns false, and does nothing, if a
+    // frame of stream is already waiting; the caller drops the new one.
+    bool submit(const void* stream, const void* data, size_t size, Job job);
+
+    // Returns once no frame of stream is waiting or being decoded.  New frames must not be
+    // submitted meanwhile.
+    void drain(const void* stream);
+
+private:
+    MjpegDecoderPool();
+
+    struct Task {
+        const void* stream;
+        std::vector<uint8_t> frame;
+        Job job;
+    };
+
+    struct StreamState {
+        bool waiting = false;
+        bool decoding = false;
+    };
+
+    void startThreads();
+    void decoderLoop();
+
+    unsigned mNumThreads;
+
+    std::once_flag mStartOnce;
+    std::vector<std::thread> mThreads;
+
+    std::mutex mLock;
+    std::condition_variable mSignal;  // A task can run, or the pool stops
+    std::condition_variable mIdle;    // A stream has no task left
+    std::deque<Task> mTasks;
+    std::unordered_map<const void*, StreamState> mStreams;
+    std::vector<std::vector<uint8_t>> mSpareFrames;  // Copies recycled for the next frames
+    bool mStopping = false;
+};
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_MJPEGDECODER_H
@@ -45,10 +45,13 @@ class SysCall {
     virtual int ioctl(int fd, int request, struct media_links_enum* arg);
     virtual int ioctl(int fd, int request, struct media_links_desc* arg);
     virtual int ioctl(int fd, int request, struct media_entity_desc* arg);
+    virtual int ioctl(int fd, int request, struct media_v2_topology* arg);
     virtual int ioctl(int fd, int request, struct v4l2_capability* arg);
     virtual int ioctl(int fd, int request, v4l2_fmtdesc* arg);
     virtual int ioctl(int fd, int request, enum v4l2_buf_type* arg);
     virtual int ioctl(int fd, int request, struct v4l2_format* arg);
+    virtual int ioctl(int fd, int request, struct v4l2_frmsizeenum* arg);
+    virtual int ioctl(int fd, int request, struct v4l2_frmivalenum* arg);
     virtual int ioctl(int fd, int request, struct v4l2_requestbuffers* arg);
     virtual int ioctl(int fd, int request, struct v4l2_buffers* arg);
     virtual int ioctl(int fd, int request, struct v4l2_buffer* arg);
@@ -70,9 +73,10 @@ class SysCall {
     static SysCall* getInstance();
     static void updateInstance(SysCall* newSysCall);
 
- private:
+ protected:
     int ioctl(int fd, int request, void* arg);
 
+ private:
     SysCall& operator=(const SysCall&);  // Don't call me
 
     static bool sIsInitialized;
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_V4L2REPLAY_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_V4L2REPLAY_H
+
+#include "SysCall.h"
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A recording starts with this header, followed by the frames, each one a ReplayFrameHeader and
+// its pixels padded to 8 bytes.  Integers are stored in the byte order of the device.
+struct ReplayFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pixelFormat;  // V4L2_PIX_FMT_*
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerLine;
+    uint32_t reserved[2];
+};
+
+struct ReplayFrameHeader {
+    int64_t timestampNs;  // Driver timestamp, relative to the first frame
+    uint32_t size;
+    uint32_t reserved;
+};
+
+// Writes the frames of a live device into a recording ReplaySysCall can play back.  The capture
+// thread only copies a frame into one of a few slots; a thread of the recorder writes them, so a
+// slow disk costs the recording frames rather than holding up the capture thread.  When every
+// slot waits for the disk, the new frame is dropped and the recording has a gap.
+class ReplayRecorder final {
+public:
+    static std::unique_ptr<ReplayRecorder> Create(const std::string& path, uint32_t pixelFormat,
+                                                  uint32_t width, uint32_t height,
+                                                  uint32_t bytesPerLine);
+    ~ReplayRecorder();
+    ReplayRecorder(const ReplayRecorder&) = delete;
+    ReplayRecorder& operator=(const ReplayRecorder&) = delete;
+
+    // Called by the capture thread for each frame; returns false once a frame could not be
+    // written, and the recording should be stopped
+    bool record(int64_t timestampNs, const void* data, uint32_t size);
+
+    // Writes the frames still waiting and stops the writer thread; later frames are ignored
+    void finish();
+
+    uint64_t getNumFrames();   // Written into the file
+    uint64_t getNumDropped();  // Found every slot busy
+
+private:
+    enum class SlotState { FREE, FILLING, QUEUED, WRITING };
+
+    struct Slot {
+        SlotState state = SlotState::FREE;
+        int64_t timestampNs = 0;      // Relative to the first frame
+        uint32_t size = 0;
+        std::vector<uint8_t> buffer;  // Grows only if a larger frame comes
+    };
+
+    explicit ReplayRecorder(int fd);
+
+    void writerLoop();
+    bool writeSlot(const Slot& slot);
+
+    const int mFd;
+
+    // Owned by the capture thread
+    bool mHasFirstFrame = false;
+    int64_t mFirstTimestampNs = 0;
+
+    std::mutex mLock;
+    std::condition_variable mSignal;  // A slot was queued, or the writer stops
+    std::vector<Slot> mSlots;
+    std::deque<size_t> mQueue;  // Indices of the queued slots, oldest first
+    bool mStopping = false;
+    bool mFailed = false;
+    uint64_t mNumFrames = 0;
+    uint64_t mNumDropped = 0;
+
+    std::mutex mFinishLock;  // Callers of finish()
+    std::thread mWriter;
+};
+
+/*
+ * Serves virtual V4L2 capture devices in place of the kernel, so the capture path can run and be
+ * measured without cameras.  Every device plays a recording, which may be MJPEG, or synthetic
+ * color bars in YUYV, UYVY or NV21, with its own frame timing, jitter and dropped frames.  Random
+ * choices come from a seeded generator, so a session replays the same way every time.  File
+ * descriptors of other devices go to the real system calls.
+ *
+ * The devices are listed in the file vendor.evs.replay points to, one per line:
+ *   <device> <source> [fps=<n>] [jitter_us=<n>] [drop_percent=<n>] [drop_every=<n>] [seed=<n>]
+ *                     [max_buffers=<n>] [padding=<bytes>]
+ * where the source is either the path of a recording or synthetic:<FOURCC>:<W>x<H>[:<W>x<H>...].
+ * max_buffers caps the buffers VIDIOC_REQBUFS grants, and padding is added to every row of
+ * synthetic frames, as drivers which align their rows do.
+ *
+ * Buffers are either allocated by the device, and may be exported with VIDIOC_EXPBUF, or
+ * imported from the dmabufs the client queues (V4L2_MEMORY_DMABUF).
+ */
+class ReplaySysCall final : public SysCall {
+public:
+    // Replaces the system calls with a ReplaySysCall if any replay device is configured, and
+    // returns the names of the devices.  Only the first call has any effect.
+    static const std::vector<std::string>& install();
+
+    // As install(), with the devices listed in a given file rather than the one of
+    // vendor.evs.replay; for tests and benchmarks
+    static const std::vector<std::string>& install(const std::string& configPath);
+
+    // Adds the devices listed in a file to the installed ReplaySysCall, replacing any of the same
+    // name, so tests can play back recordings made since install().  Returns false if none was
+    // installed or the file lists no valid device.
+    static bool addDevices(const std::string& configPath);
+
+    // Whether a device reporting caps to VIDIOC_QUERYCAP is a replay device
+    static bool isReplayDevice(const v4l2_capability& caps);
+
+    int open(const char* pathname, int flags) override;
+    int close(int fd) override;
+    void* mmap(void* addr, size_t len, int prot, int flag, int filedes, off_t off) override;
+
+    using SysCall::ioctl;
+    int ioctl(int fd, int request, struct v4l2_capability* arg) override;
+    int ioctl(int fd, int request, v4l2_fmtdesc* arg) override;
+    int ioctl(int fd, int request, enum v4l2_buf_type* arg) override;
+    int ioctl(int fd, int request, struct v4l2_format* arg) override;
+    int ioctl(int fd, int request, struct v4l2_frmsizeenum* arg) override;
+    int ioctl(int fd, int request, struct v4l2_frmivalenum* arg) override;
+    int ioctl(int fd, int request, struct v4l2_requestbuffers* arg) override;
+    int ioctl(int fd, int request, struct v4l2_buffer* arg) override;
+    int ioctl(int fd, int request, struct v4l2_control* arg) override;
+    int ioctl(int fd, int request, struct v4l2_queryctrl* arg) override;
+    int ioctl(int fd, int request, struct v4l2_exportbuffer* arg) override;
+
+private:
+    struct Device;
+
+    ReplaySysCall() = default;
+    ~ReplaySysCall() override = default;
+
+    bool loadDevices(const std::string& configPath);
+    std::shared_ptr<Device> getDevice(int fd);
+
+    // Stops the stream and drops the buffers of a device; expects its lock to be held
+    static void stopStream_Locked(Device& device, std::unique_lock<std::mutex>& lock);
+    static void releaseBuffers_Locked(Device& device);
+    // Maps the dmabuf a client queues into a buffer, unless it is mapped already
+    static bool importBuffer_Locked(Device& device, const v4l2_buffer& arg);
+    static void runProducer(Device* device);
+
+    static inline ReplaySysCall* sInstalled = nullptr;  // Set once by install()
+
+    std::mutex mLock;
+    std::map<std::string, std::shared_ptr<Device>> mDevices;  // By device name
+    std::map<int, std::shared_ptr<Device>> mHandles;         // By open file descriptor
+};
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_V4L2REPLAY_H
@@ -16,12 +16,19 @@
 #ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_VIDEOCAPTURE_H
 #define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_VIDEOCAPTURE_H
 
+#include "CapabilityCache.h"
+#include "LatencyHistogram.h"
+#include "V4l2Replay.h"
+
 #include <linux/videodev2.h>
 
 #include <atomic>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <set>
-#include <thread>
+#include <string>
+#include <vector>
 
 typedef v4l2_buffer imageBuffer;
 
@@ -30,22 +37,67 @@ typedef v4l2_buffer imageBuffer;
 #define WIDTH 1920
 #define HEIGHT 1080
 
+namespace aidl::android::hardware::automotive::evs::implementation {
+class CaptureEngine;
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+// A dmabuf the driver captures into directly, see VideoCapture::startStream()
+struct ImportedBuffer {
+    int fd;
+    uint32_t length;
+};
+
 class VideoCapture final {
 public:
     bool open(const char* deviceName, const int32_t width = 0, const int32_t height = 0);
     void close();
 
-    bool startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback = nullptr);
+    // Without importedBuffers, frames are captured into buffers allocated by the driver
+    // (V4L2_MEMORY_MMAP).  Otherwise the driver captures into these dmabufs
+    // (V4L2_MEMORY_DMABUF), and the index of the buffer handed to the callback is the index
+    // into importedBuffers.  Fails if the driver cannot import dmabufs.
+    bool startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback = nullptr,
+                     const std::vector<ImportedBuffer>& importedBuffers = {});
     void stopStream();
 
-    // Valid only after open()
+    // Stops delivering frames while keeping every buffer.  The device keeps capturing and its
+    // frames are dropped right away, unless streamOff asks to stop the device as well, which
+    // saves power and bandwidth but takes a little longer to resume.
+    bool pauseStream(bool streamOff);
+    bool resumeStream();
+    bool isPaused() const { return mPauseMode != PauseMode::NONE; }
+
+    // Frames of streams in the same sync group are delivered in sets captured at about the same
+    // time, see CaptureEngine.  Takes effect when the next stream starts.
+    void setSyncGroup(const std::string& name) { mSyncGroup = name; }
+    const std::string& getSyncGroup() const { return mSyncGroup; }
+
+    // Writes every frame delivered from now on into a recording ReplaySysCall can play back,
+    // until stopRecording() or the stream stops.  Valid only while a stream is running.
+    bool startRecording(const std::string& path);
+    void stopRecording();
+
+    // Exports a driver allocated buffer of a running stream as a dmabuf with VIDIOC_EXPBUF.
+    // The caller owns the returned file descriptor; -1 on failure.
+    int exportBuffer(int index);
+
+    // Valid only while a stream is running
+    int getNumBuffers() { return mNumBuffers; };
+
+    // Valid only after open().  The size is the one of the delivered images, which is smaller
+    // than the captured one if MJPEG frames are decoded at a reduced scale.
     __u32 getWidth() { return mWidth; };
     __u32 getHeight() { return mHeight; };
     __u32 getStride() { return mStride; };
     __u32 getV4LFormat() { return mFormat; };
+    __u32 getColorspace() { return mColorspace; };
+    __u32 getYcbcrEncoding() { return mYcbcrEncoding; };
+    __u32 getQuantization() { return mQuantization; };
+    __u32 getImageSize() { return mImageSize; };
 
     // NULL until stream is started
     void* getLatestData() {
+        std::lock_guard<std::mutex> lock(mFramesLock);
         if (mFrames.empty()) {
             // No frame is available
             return nullptr;
@@ -56,40 +108,90 @@ public:
         return mPixelBuffers[latestBufferId];
     }
 
-    bool isFrameReady() { return !mFrames.empty(); }
+    bool isFrameReady() {
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        return !mFrames.empty();
+    }
     void markFrameConsumed(int id) { returnFrame(id); }
 
     bool isOpen() { return mDeviceFd >= 0; }
 
+    // CLOCK_MONOTONIC time at which a frame was dequeued; valid in the frame callback
+    int64_t getDequeueTimeNs(int id) { return mDequeueTimesNs[id]; }
+
+    // From the driver's timestamp of a frame until it was dequeued
+    ::aidl::android::hardware::automotive::evs::implementation::LatencyHistogram&
+    getCaptureLatency() {
+        return mCaptureLatency;
+    }
+
     int setParameter(struct v4l2_control& control);
     int getParameter(struct v4l2_control& control);
     std::set<uint32_t> enumerateCameraControls();
 
 private:
-    void collectFrames();
+    // Frames are received and dispatched on the thread of the capture engine
+    friend class ::aidl::android::hardware::automotive::evs::implementation::CaptureEngine;
+
+    // Dequeues a captured frame, or sets index to -1 if none is ready yet.  Returns false if
+    // the stream can't deliver any more frames.
+    bool dequeueFrame(int* index, int64_t* timestampNs);
+    void dispatchFrame(int index);
+
     bool returnFrame(int id);
+    bool setUpBuffers(const std::vector<ImportedBuffer>& importedBuffers);
+    void releaseBuffers();
 
     int mDeviceFd = -1;
     uint32_t mBufferType = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    uint32_t mMemoryType = V4L2_MEMORY_MMAP;
 
     int mNumBuffers = 0;
-    uint32_t mBufferSize;
 
     static int mNumCamerasStreaming;
 
     std::unique_ptr<v4l2_buffer[]> mBufferInfos = nullptr;
+    std::unique_ptr<v4l2_plane[]> mPlanes = nullptr;  // VIDEO_PLANES per multi-planar buffer
     std::unique_ptr<void*[]> mPixelBuffers = nullptr;
+    std::unique_ptr<size_t[]> mMappedSizes = nullptr;
+    std::unique_ptr<int64_t[]> mDequeueTimesNs = nullptr;
+
+    ::aidl::android::hardware::automotive::evs::implementation::LatencyHistogram mCaptureLatency;
 
     __u32 mFormat = 0;
     __u32 mWidth = 0;
     __u32 mHeight = 0;
+    __u32 mCaptureWidth = 0;
+    __u32 mCaptureHeight = 0;
     __u32 mStride = 0;
+    __u32 mColorspace = V4L2_COLORSPACE_DEFAULT;
+    __u32 mYcbcrEncoding = V4L2_YCBCR_ENC_DEFAULT;
+    __u32 mQuantization = V4L2_QUANTIZATION_DEFAULT;
+    __u32 mImageSize = 0;
+
+    // Formats, frame sizes and controls of the device, shared by the devices of its kind
+    std::shared_ptr<
+            const ::aidl::android::hardware::automotive::evs::implementation::CapabilityCache::
+                    Capabilities>
+            mCapabilities;
 
     std::function<void(VideoCapture*, imageBuffer*, void*)> mCallback;
 
-    std::thread mCaptureThread;  // The thread we'll use to dispatch frames
-    std::atomic<int> mRunMode;   // Used to signal the frame loop (see RunModes below)
-    std::set<int> mFrames;       // Set of available frame buffers
+    std::string mSyncGroup;
+    bool mFPSDebugEnabled = false;
+
+    std::mutex mRecorderLock;
+    std::unique_ptr<ReplayRecorder> mRecorder;
+
+    enum class PauseMode {
+        NONE,
+        DISCARD,     // Frames are queued again as soon as they are dequeued
+        STREAM_OFF,  // The device is stopped and its buffers are queued for the next STREAMON
+    };
+    std::atomic<PauseMode> mPauseMode = PauseMode::NONE;
+    std::atomic<int> mRunMode;  // Used to signal the frame loop (see RunModes below)
+    std::set<int> mFrames;      // Set of available frame buffers
+    std::mutex mFramesLock;     // Frames are returned from other threads
 
     // Careful changing these -- we're using bit-wise ops to manipulate these
     enum RunModes {
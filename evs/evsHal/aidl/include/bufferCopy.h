@@ -20,25 +20,77 @@
 #include <aidl/android/hardware/automotive/evs/BufferDesc.h>
 #include <android/hardware_buffer.h>
 
+#include "bufferCopyKernels.h"
+
 namespace aidl::android::hardware::automotive::evs::implementation {
 
+// Picks the YCbCr to RGB conversion from the colorspace, ycbcr_enc and quantization fields of
+// the negotiated v4l2_pix_format, resolving their defaults like the V4L2 drivers do.
+YuvColorSpace selectYuvColorSpace(uint32_t colorspace, uint32_t ycbcrEnc, uint32_t quantization);
+
+// The fill functions convert the rows [rowBegin, rowEnd) of the target image, so a frame can be
+// split into bands which are converted concurrently.  Bands of NV21 targets must start and end
+// at even rows.
+
 void fillNV21FromNV21(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
-                      uint8_t* tgt, void* imgData, unsigned imgStride);
+                      uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd);
 
 void fillNV21FromYUYV(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
-                      uint8_t* tgt, void* imgData, unsigned imgStride);
+                      uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd);
 
 void fillRGBAFromYUYV(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
-                      uint8_t* tgt, void* imgData, unsigned imgStride);
+                      uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd, YuvColorSpace colorSpace);
 
-void fillRGBAFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+void fillRGBAFromUYVY(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
+                      uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd, YuvColorSpace colorSpace);
 
 void fillYUYVFromYUYV(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
-                      uint8_t* tgt, void* imgData, unsigned imgStride);
+                      uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd);
 
 void fillYUYVFromUYVY(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
-                      uint8_t* tgt, void* imgData, unsigned imgStride);
+                      uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd);
+
+// The scaled fill functions convert a source image of srcWidth x srcHeight into a target of
+// another size, each target pixel taking the nearest source pixel.  The source rows a target
+// row needs are resampled into a scratch row which the row kernels convert, so only the sampled
+// source pixels are read and the scaling adds no pass over the frame.  Target sizes must be
+// even.
+
+void fillNV21FromNV21Scaled(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
+                            uint8_t* tgt, void* imgData, unsigned imgStride,
+                            unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight);
+
+void fillNV21FromYUYVScaled(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
+                            uint8_t* tgt, void* imgData, unsigned imgStride,
+                            unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight);
+
+void fillRGBAFromYUYVScaled(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
+                            uint8_t* tgt, void* imgData, unsigned imgStride,
+                            unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight, YuvColorSpace colorSpace);
+
+void fillRGBAFromUYVYScaled(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
+                            uint8_t* tgt, void* imgData, unsigned imgStride,
+                            unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight, YuvColorSpace colorSpace);
+
+void fillYUYVFromYUYVScaled(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
+                            uint8_t* tgt, void* imgData, unsigned imgStride,
+                            unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight);
+
+void fillYUYVFromUYVYScaled(const ::aidl::android::hardware::automotive::evs::BufferDesc& tgtBuff,
+                            uint8_t* tgt, void* imgData, unsigned imgStride,
+                            unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight);
 
 }  // namespace aidl::android::hardware::automotive::evs::implementation
 
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_BUFFERCOPYKERNELS_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_BUFFERCOPYKERNELS_H
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Matrix coefficients and range of the YCbCr source of an RGBA conversion
+enum class YuvColorSpace {
+    BT601_LIMITED,
+    BT601_FULL,
+    BT709_LIMITED,
+    BT709_FULL,
+};
+
+// 6 bit fixed point YCbCr to RGB coefficients, e.g. R = (yScale * (Y - yOffset) +
+// crR * (V - 128) + 32) >> 6.  The products and sums fit into int16 lanes, only sums which
+// saturate to a value clamped to 255 anyway may overflow.
+struct YuvToRgbCoefficients {
+    int16_t yOffset;
+    int16_t yScale;
+    int16_t crR;
+    int16_t cbG;
+    int16_t crG;
+    int16_t cbB;
+};
+
+const YuvToRgbCoefficients& getYuvToRgbCoefficients(YuvColorSpace colorSpace);
+
+// Row kernels behind the fill functions in bufferCopy.h.  Every implementation must produce
+// exactly the same bytes as the scalar one, which is kept as the reference.
+struct ConversionKernels {
+    const char* name;
+
+    // Converts two YUYV source rows into two NV21 luma rows and one interleaved chroma row,
+    // averaging the chroma of both rows.  Only width / 2 macro pixels are consumed.
+    void (*yuyvToNV21Rows)(const uint8_t* srcTop, const uint8_t* srcBot, uint8_t* yTop,
+                           uint8_t* yBot, uint8_t* uv, unsigned width);
+
+    // Swaps the bytes of every 16 bit word, which converts YUYV into UYVY and vice versa.
+    void (*swapYUYVRow)(const uint8_t* src, uint8_t* dst, unsigned width);
+
+    // Converts one YUYV row, or UYVY row if uyvy is set, into RGBA byte order in a single pass.
+    // An odd last pixel uses the chroma of its incomplete macro pixel.
+    void (*yuyvToRGBARow)(const uint8_t* src, uint8_t* dst, unsigned width,
+                          const YuvToRgbCoefficients& coefficients, bool uyvy);
+};
+
+const ConversionKernels& getScalarConversionKernels();
+
+// Every implementation the running CPU supports, the scalar one first; for the golden test and
+// the benchmark.
+std::vector<const ConversionKernels*> getSupportedConversionKernels();
+
+// The fastest kernels supported by the running CPU, selected once.
+const ConversionKernels& getConversionKernels();
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_INCLUDE_BUFFERCOPYKERNELS_H
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BinaryCache.h"
+
+#include <android-base/logging.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fstream>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+uint64_t hashPayload(const uint8_t* data, size_t size) {
+    constexpr size_t kOffset = offsetof(BinaryCacheHeader, payloadHash) + sizeof(uint64_t);
+    return hashBytes(kFnvOffsetBasis,
+                     std::string_view(reinterpret_cast<const char*>(data) + kOffset,
+                                      size - kOffset));
+}
+
+}  // namespace
+
+uint64_t hashBytes(uint64_t hash, std::string_view bytes) {
+    for (const char c : bytes) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+size_t BinaryWriter::appendBytes(const void* data, size_t size) {
+    const size_t offset = mBuffer.size();
+    mBuffer.resize(alignUp(offset + size), 0);
+    if (size > 0) {
+        // Empty arrays have no data to copy
+        memcpy(mBuffer.data() + offset, data, size);
+    }
+    return offset;
+}
+
+void BinaryWriter::appendString(std::string_view value) {
+    const uint32_t length = value.size();
+    const size_t offset = mBuffer.size();
+    mBuffer.resize(alignUp(offset + sizeof(length) + length + 1), 0);
+    memcpy(mBuffer.data() + offset, &length, sizeof(length));
+    memcpy(mBuffer.data() + offset + sizeof(length), value.data(), length);
+}
+
+bool BinaryWriter::store(const std::string& path) {
+    BinaryCacheHeader header;
+    if (mBuffer.size() < sizeof(header)) {
+        LOG(ERROR) << "Cache " << path << " has no header";
+        return false;
+    }
+
+    // The hash covers the size as well
+    memcpy(&header, mBuffer.data(), sizeof(header));
+    header.fileSize = mBuffer.size();
+    update(0, header);
+    header.payloadHash = hashPayload(mBuffer.data(), mBuffer.size());
+    update(0, header);
+
+    const std::string tmpPath = path + ".tmp";
+    std::ofstream outFile(tmpPath, std::ofstream::out | std::ofstream::binary |
+                                           std::ofstream::trunc);
+    if (!outFile) {
+        LOG(WARNING) << "Failed to open " << tmpPath;
+        return false;
+    }
+
+    outFile.write(reinterpret_cast<const char*>(mBuffer.data()), mBuffer.size());
+    outFile.close();
+    if (!outFile || rename(tmpPath.data(), path.data()) != 0) {
+        PLOG(WARNING) << "Failed to store the cache " << path;
+        unlink(tmpPath.data());
+        return false;
+    }
+    return true;
+}
+
+BinaryReader::Status BinaryReader::checkHeader(uint32_t magic, uint32_t version) {
+    BinaryCacheHeader header;
+    if (mSize < sizeof(header)) {
+        mValid = false;
+        return Status::UNKNOWN_FORMAT;
+    }
+    memcpy(&header, mData, sizeof(header));
+    if (header.magic != magic || header.version != version || header.fileSize != mSize) {
+        mValid = false;
+        return Status::UNKNOWN_FORMAT;
+    }
+    if (header.payloadHash != hashPayload(mData, mSize)) {
+        mValid = false;
+        return Status::CORRUPTED;
+    }
+    return Status::OK;
+}
+
+const uint8_t* BinaryReader::takeBytes(size_t size) {
+    if (!mValid || size > mSize - mOffset || alignUp(mOffset + size) > mSize) {
+        mValid = false;
+        return nullptr;
+    }
+
+    const uint8_t* p = mData + mOffset;
+    mOffset = alignUp(mOffset + size);
+    return p;
+}
+
+std::string_view BinaryReader::takeString() {
+    const uint8_t* p = takeBytes(0);
+    uint32_t length = 0;
+    if (p == nullptr || mSize - mOffset < sizeof(length)) {
+        mValid = false;
+        return {};
+    }
+
+    memcpy(&length, p, sizeof(length));
+    if (takeBytes(sizeof(length) + static_cast<size_t>(length) + 1) == nullptr) {
+        return {};
+    }
+    return std::string_view(reinterpret_cast<const char*>(p) + sizeof(length), length);
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CapabilityCache.h"
+
+#include "BinaryCache.h"
+#include "SysCall.h"
+#include "V4l2Replay.h"
+
+#include <android-base/logging.h>
+#include <cutils/properties.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+using ::aidl::android::hardware::automotive::evs::implementation::BinaryCacheHeader;
+using ::aidl::android::hardware::automotive::evs::implementation::BinaryReader;
+using ::aidl::android::hardware::automotive::evs::implementation::BinaryWriter;
+
+constexpr char kPropCapabilityCachePath[] = "vendor.evs.caps.cache";
+constexpr char kDefaultCapabilityCachePath[] = "/data/vendor/evs/evs_capabilities.bin";
+
+/*
+ * Layout of the stored cache, with the V4L2 structures of the device, every record 8-byte
+ * aligned.  Bump kFileVersion whenever this layout changes.
+ *
+ *   FileHeader, starting with the BinaryCacheHeader
+ *   FileEntry x numEntries, each followed by
+ *       FileFormat x numFormats, each followed by
+ *           FileSize x numSizes, each followed by v4l2_frmivalenum x numIntervals
+ *       v4l2_queryctrl x numControls
+ */
+constexpr uint32_t kFileMagic = 0x43535645;  // "EVSC"
+constexpr uint32_t kFileVersion = 2;
+
+struct FileHeader {
+    BinaryCacheHeader common;
+    uint32_t numEntries;
+    uint32_t reserved;
+};
+static_assert(sizeof(FileHeader) == 32);
+
+struct FileEntry {
+    uint8_t busInfo[32];
+    uint8_t driver[16];
+    uint8_t card[32];
+    uint32_t version;
+    uint32_t capabilities;
+    uint32_t bufferType;
+    uint32_t numFormats;
+    uint32_t numControls;
+    uint32_t reserved;
+};
+static_assert(sizeof(FileEntry) == 104);
+
+struct FileFormat {
+    v4l2_fmtdesc desc;
+    uint32_t numSizes;
+    uint32_t reserved;
+};
+
+struct FileSize {
+    v4l2_frmsizeenum size;
+    uint32_t numIntervals;
+    uint32_t reserved;
+};
+
+template <size_t N>
+std::string toString(const uint8_t (&field)[N]) {
+    const char* chars = reinterpret_cast<const char*>(field);
+    return std::string(chars, strnlen(chars, N));
+}
+
+template <size_t N>
+void fromString(const std::string& value, uint8_t (&field)[N]) {
+    memset(field, 0, N);
+    memcpy(field, value.data(), std::min(value.size(), N - 1));
+}
+
+}  // namespace
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+CapabilityCache& CapabilityCache::getInstance() {
+    static CapabilityCache sInstance;
+    return sInstance;
+}
+
+CapabilityCache::CapabilityCache() {
+    char path[PROPERTY_VALUE_MAX] = "\0";
+    property_get(kPropCapabilityCachePath, path, kDefaultCapabilityCachePath);
+    mFilePath = path;
+
+    load();
+    mStats.entries = mStats.loadedEntries = mEntries.size();
+}
+
+CapabilityCache::Key CapabilityCache::makeKey(const v4l2_capability& caps) {
+    return {
+            .busInfo = toString(caps.bus_info),
+            .driver = toString(caps.driver),
+            .card = toString(caps.card),
+            .version = caps.version,
+            .capabilities = caps.capabilities,
+    };
+}
+
+std::shared_ptr<CapabilityCache::Capabilities> CapabilityCache::enumerate(
+        int fd, const v4l2_capability& caps) {
+    SysCall* sysCall = SysCall::getInstance();
+    auto capabilities = std::make_shared<Capabilities>();
+    capabilities->bufferType = (caps.capabilities & V4L2_CAP_VIDEO_CAPTURE)
+            ? V4L2_BUF_TYPE_VIDEO_CAPTURE
+            : V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+
+    for (uint32_t i = 0; true; ++i) {
+        Format format = {};
+        format.desc.type = capabilities->bufferType;
+        format.desc.index = i;
+        if (sysCall->ioctl(fd, VIDIOC_ENUM_FMT, &format.desc) != 0) {
+            // No more formats available
+            break;
+        }
+
+        for (uint32_t j = 0; true; ++j) {
+            FrameSize size = {};
+            size.size.pixel_format = format.desc.pixelformat;
+            size.size.index = j;
+            if (sysCall->ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size.size) < 0) {
+                break;
+            }
+
+            for (uint32_t k = 0; size.size.type == V4L2_FRMSIZE_TYPE_DISCRETE; ++k) {
+                v4l2_frmivalenum interval = {};
+                interval.index = k;
+                interval.pixel_format = format.desc.pixelformat;
+                interval.width = size.size.discrete.width;
+                interval.height = size.size.discrete.height;
+                if (sysCall->ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &interval) != 0) {
+                    break;
+                }
+                size.intervals.push_back(interval);
+            }
+            format.sizes.push_back(std::move(size));
+        }
+        capabilities->formats.push_back(std::move(format));
+    }
+
+    v4l2_queryctrl ctrl = {.id = V4L2_CTRL_FLAG_NEXT_CTRL};
+    while (sysCall->ioctl(fd, VIDIOC_QUERYCTRL, &ctrl) == 0) {
+        if (!(ctrl.flags & V4L2_CTRL_FLAG_DISABLED)) {
+            capabilities->controls.push_back(ctrl);
+        }
+        ctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+    }
+    if (errno != EINVAL) {
+        PLOG(WARNING) << "Failed to run VIDIOC_QUERYCTRL";
+    }
+
+    return capabilities;
+}
+
+std::shared_ptr<const CapabilityCache::Capabilities> CapabilityCache::get(
+        const std::string& deviceName, int fd, const v4l2_capability& caps) {
+    // Replay devices answer from memory, and a recording may change under the same name
+    if (ReplaySysCall::isReplayDevice(caps)) {
+        return enumerate(fd, caps);
+    }
+
+    const Key key = makeKey(caps);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mDevices.insert_or_assign(deviceName, key);
+        if (mPlugged.erase(deviceName) == 0) {
+            auto it = mEntries.find(key);
+            if (it != mEntries.end()) {
+                ++mStats.hits;
+                return it->second;
+            }
+        }
+    }
+
+    const auto enumerationStart = std::chrono::steady_clock::now();
+    std::shared_ptr<const Capabilities> capabilities = enumerate(fd, caps);
+    const std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - enumerationStart;
+
+    // A device which reports no format is likely going away, so it is not remembered
+    if (capabilities->formats.empty()) {
+        return capabilities;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEntries.insert_or_assign(key, capabilities);
+        ++mStats.misses;
+        mStats.enumerationMs += elapsed.count();
+        mStats.entries = mEntries.size();
+    }
+
+    LOG(DEBUG) << "Enumerated " << deviceName << " in " << elapsed.count() << " ms";
+    store();
+    return capabilities;
+}
+
+void CapabilityCache::invalidate(const std::string& deviceName) {
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mPlugged.insert(deviceName);
+
+        auto it = mDevices.find(deviceName);
+        if (it != mDevices.end()) {
+            changed = mEntries.erase(it->second) > 0;
+            mDevices.erase(it);
+        }
+        if (changed) {
+            ++mStats.invalidations;
+            mStats.entries = mEntries.size();
+        }
+    }
+
+    if (changed) {
+        store();
+    }
+}
+
+CapabilityCache::Stats CapabilityCache::getStats() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStats;
+}
+
+bool CapabilityCache::load() {
+    std::ifstream file(mFilePath, std::ifstream::in | std::ifstream::binary);
+    if (!file) {
+        LOG(INFO) << "No device capability cache at " << mFilePath;
+        return false;
+    }
+    // Allocated, so aligned for the records the reader points at
+    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                    std::istreambuf_iterator<char>());
+
+    BinaryReader reader(data.data(), data.size());
+    switch (reader.checkHeader(kFileMagic, kFileVersion)) {
+        case BinaryReader::Status::OK:
+            break;
+        case BinaryReader::Status::UNKNOWN_FORMAT:
+            LOG(INFO) << "Device capability cache " << mFilePath << " has an unknown format";
+            return false;
+        case BinaryReader::Status::CORRUPTED:
+            LOG(WARNING) << "Device capability cache " << mFilePath << " is corrupted";
+            return false;
+    }
+    const FileHeader* header = reader.take<FileHeader>();
+
+    // Built aside and kept only if the whole file is valid
+    std::map<Key, std::shared_ptr<const Capabilities>> entries;
+    for (uint32_t e = 0; header != nullptr && e < header->numEntries && reader.isValid(); ++e) {
+        const FileEntry* entry = reader.take<FileEntry>();
+        if (entry == nullptr) {
+            break;
+        }
+
+        auto capabilities = std::make_shared<Capabilities>();
+        capabilities->bufferType = entry->bufferType;
+        for (uint32_t f = 0; f < entry->numFormats && reader.isValid(); ++f) {
+            const FileFormat* fileFormat = reader.take<FileFormat>();
+            if (fileFormat == nullptr) {
+                break;
+            }
+
+            Format& format = capabilities->formats.emplace_back();
+            format.desc = fileFormat->desc;
+            for (uint32_t s = 0; s < fileFormat->numSizes && reader.isValid(); ++s) {
+                const FileSize* fileSize = reader.take<FileSize>();
+                if (fileSize == nullptr) {
+                    break;
+                }
+                const auto* intervals = reader.take<v4l2_frmivalenum>(fileSize->numIntervals);
+                if (intervals == nullptr) {
+                    break;
+                }
+
+                FrameSize& size = format.sizes.emplace_back();
+                size.size = fileSize->size;
+                size.intervals.assign(intervals, intervals + fileSize->numIntervals);
+            }
+        }
+
+        const v4l2_queryctrl* controls = reader.take<v4l2_queryctrl>(entry->numControls);
+        if (controls == nullptr) {
+            break;
+        }
+        capabilities->controls.assign(controls, controls + entry->numControls);
+
+        Key key = {
+                .busInfo = toString(entry->busInfo),
+                .driver = toString(entry->driver),
+                .card = toString(entry->card),
+                .version = entry->version,
+                .capabilities = entry->capabilities,
+        };
+        entries.insert_or_assign(std::move(key), std::move(capabilities));
+    }
+
+    if (!reader.isValid()) {
+        LOG(WARNING) << "Device capability cache " << mFilePath << " is truncated";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mEntries = std::move(entries);
+    LOG(INFO) << "Capabilities of " << mEntries.size() << " devices are loaded from "
+              << mFilePath;
+    return true;
+}
+
+void CapabilityCache::store() {
+    // Serializes writers so the file ends up with the latest entries
+    std::lock_guard<std::mutex> storeLock(mStoreLock);
+
+    BinaryWriter writer;
+    FileHeader header = {
+            .common = {.magic = kFileMagic, .version = kFileVersion},
+            .numEntries = 0,
+            .reserved = 0,
+    };
+    const size_t headerOffset = writer.append(header);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        header.numEntries = mEntries.size();
+        for (auto&& [key, capabilities] : mEntries) {
+            FileEntry entry = {
+                    .version = key.version,
+                    .capabilities = key.capabilities,
+                    .bufferType = capabilities->bufferType,
+                    .numFormats = static_cast<uint32_t>(capabilities->formats.size()),
+                    .numControls = static_cast<uint32_t>(capabilities->controls.size()),
+                    .reserved = 0,
+            };
+            fromString(key.busInfo, entry.busInfo);
+            fromString(key.driver, entry.driver);
+            fromString(key.card, entry.card);
+            writer.append(entry);
+
+            for (auto&& format : capabilities->formats) {
+                writer.append(FileFormat{
+                        .desc = format.desc,
+                        .numSizes = static_cast<uint32_t>(format.sizes.size()),
+                        .reserved = 0,
+                });
+                for (auto&& size : format.sizes) {
+                    writer.append(FileSize{
+                            .size = size.size,
+                            .numIntervals = static_cast<uint32_t>(size.intervals.size()),
+                            .reserved = 0,
+                    });
+                    // Intervals, like controls, are stored as one array
+                    writer.appendBytes(size.intervals.data(),
+                                       size.intervals.size() * sizeof(v4l2_frmivalenum));
+                }
+            }
+
+            writer.appendBytes(capabilities->controls.data(),
+                               capabilities->controls.size() * sizeof(v4l2_queryctrl));
+        }
+    }
+    writer.update(headerOffset, header);
+
+    if (!writer.store(mFilePath)) {
+        LOG(WARNING) << "Failed to store the device capability cache " << mFilePath;
+    }
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
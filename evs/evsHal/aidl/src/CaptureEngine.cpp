@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CaptureEngine.h"
+
+#include "VideoCapture.h"
+
+#include <android-base/logging.h>
+#include <cutils/properties.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+constexpr char kPropSyncSkewUs[] = "vendor.evs.sync.skew_us";
+
+// A third of a frame interval at 30 fps
+constexpr int64_t kDefaultSkewUs = 10000;
+
+// Never a device serial, which start at 1
+constexpr uint64_t kEventFdId = 0;
+
+constexpr int kMaxEvents = 16;
+
+}  // namespace
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+CaptureEngine& CaptureEngine::getInstance() {
+    static CaptureEngine sInstance;
+    return sInstance;
+}
+
+CaptureEngine::CaptureEngine() {
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0) {
+        PLOG(ERROR) << "Failed to create an epoll instance";
+        return;
+    }
+
+    mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (mEventFd < 0) {
+        PLOG(ERROR) << "Failed to create an eventfd";
+        return;
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = kEventFdId;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mEventFd, &event) < 0) {
+        PLOG(ERROR) << "Failed to watch the eventfd";
+        ::close(mEventFd);
+        mEventFd = -1;
+    }
+}
+
+CaptureEngine::~CaptureEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    wakeUp();
+
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+
+    if (mEventFd >= 0) {
+        ::close(mEventFd);
+    }
+    if (mEpollFd >= 0) {
+        ::close(mEpollFd);
+    }
+}
+
+int64_t CaptureEngine::getDefaultSkewNs() {
+    char value[PROPERTY_VALUE_MAX] = "\0";
+    int64_t skewUs = kDefaultSkewUs;
+    if (property_get(kPropSyncSkewUs, value, nullptr) > 0) {
+        skewUs = std::max(atoll(value), 0ll);
+    }
+    return skewUs * 1000;
+}
+
+bool CaptureEngine::addDevice(VideoCapture* video) {
+    if (mEpollFd < 0 || mEventFd < 0) {
+        LOG(ERROR) << "Capture engine is not available";
+        return false;
+    }
+
+    std::call_once(mStartOnce, [this] { startThread(); });
+
+    std::lock_guard<std::mutex> lock(mLock);
+    const uint64_t serial = mNextSerial++;
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = serial;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, video->mDeviceFd, &event) < 0) {
+        PLOG(ERROR) << "Failed to watch a video device";
+        return false;
+    }
+
+    mDevices.emplace(serial, Device{video, video->getSyncGroup()});
+    return true;
+}
+
+void CaptureEngine::removeDevice(VideoCapture* video) {
+    std::unique_lock<std::mutex> lock(mLock);
+    auto it = std::find_if(mDevices.begin(), mDevices.end(),
+                           [video](const auto& entry) { return entry.second.video == video; });
+    if (it == mDevices.end()) {
+        return;
+    }
+
+    const uint64_t serial = it->first;
+    const std::string syncGroup = it->second.syncGroup;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_DEL, video->mDeviceFd, nullptr) < 0) {
+        PLOG(WARNING) << "Failed to stop watching a video device";
+    }
+    if (it->second.pendingIndex >= 0) {
+        // Give back the frame held for a set, as the stream may go on after a pause
+        video->markFrameConsumed(it->second.pendingIndex);
+    }
+    mDevices.erase(it);
+
+    // A callback of this device may still be running, unless it is the one calling us
+    if (std::this_thread::get_id() != mThread.get_id()) {
+        mDispatchDone.wait(lock, [this, serial] { return mDispatching.count(serial) == 0; });
+    }
+    lock.unlock();
+
+    if (!syncGroup.empty()) {
+        // The frames the other members hold back may form a set without this one
+        wakeUp();
+    }
+}
+
+void CaptureEngine::configureSyncGroup(const std::string& name, int64_t skewNs,
+                                       FrameSetCallback onFrameSet) {
+    std::lock_guard<std::mutex> lock(mLock);
+    SyncGroup& group = getSyncGroup_Locked(name);
+    group.skewNs = skewNs;
+    group.onFrameSet = std::move(onFrameSet);
+    group.stats = {};
+}
+
+void CaptureEngine::removeSyncGroup(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mSyncGroups.erase(name);
+}
+
+CaptureEngine::SyncGroupStats CaptureEngine::getSyncGroupStats(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mSyncGroups.find(name);
+    return it == mSyncGroups.end() ? SyncGroupStats{} : it->second.stats;
+}
+
+void CaptureEngine::startThread() {
+    // The engine thread lives as long as the service once a stream has been started
+    mThread = std::thread([this] { eventLoop(); });
+}
+
+void CaptureEngine::wakeUp() {
+    if (mEventFd < 0) {
+        return;
+    }
+
+    const uint64_t value = 1;
+    if (write(mEventFd, &value, sizeof(value)) != sizeof(value)) {
+        PLOG(WARNING) << "Failed to wake up the capture engine";
+    }
+}
+
+void CaptureEngine::eventLoop() {
+    epoll_event events[kMaxEvents];
+    for (;;) {
+        const int count = epoll_wait(mEpollFd, events, kMaxEvents, /* timeout= */ -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PLOG(ERROR) << "epoll_wait failed; no more frames are delivered";
+            break;
+        }
+
+        bool woken = false;
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.u64 == kEventFdId) {
+                uint64_t value;
+                (void)read(mEventFd, &value, sizeof(value));
+                woken = true;
+            } else {
+                handleReadable(events[i].data.u64);
+            }
+        }
+
+        if (woken) {
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                if (mStopping) {
+                    break;
+                }
+            }
+            dispatchReadyGroups();
+        }
+    }
+
+    LOG(DEBUG) << "Capture engine thread ending";
+}
+
+void CaptureEngine::handleReadable(uint64_t serial) {
+    VideoCapture* video = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mDevices.find(serial);
+        if (it == mDevices.end()) {
+            // Removed after epoll_wait() reported it
+            return;
+        }
+
+        // The frame is dequeued without the lock, so that a slow driver or a recording stalls
+        // neither the binder threads adding and removing devices nor the other devices.
+        // removeDevice() waits for it as it waits for a dispatch.
+        video = it->second.video;
+        mDispatching.insert(serial);
+    }
+
+    int index = -1;
+    int64_t timestampNs = 0;
+    const bool streaming = video->dequeueFrame(&index, &timestampNs);
+
+    std::vector<Dispatch> frames;
+    std::string syncGroup;
+    bool removed = false;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mDevices.find(serial);
+        if (it == mDevices.end()) {
+            removed = true;
+        } else if (!streaming) {
+            // Nothing more will be captured; the owner finds the stream stopped
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, video->mDeviceFd, nullptr);
+            video->mRunMode = VideoCapture::STOPPED;
+            mDevices.erase(it);
+        } else if (index >= 0) {
+            Device& device = it->second;
+            if (device.syncGroup.empty()) {
+                frames.push_back({serial, video, index});
+            } else {
+                if (device.pendingIndex >= 0) {
+                    // The other members did not catch up with the previous frame
+                    video->markFrameConsumed(device.pendingIndex);
+                    ++getSyncGroup_Locked(device.syncGroup).stats.droppedFrames;
+                }
+                device.pendingIndex = index;
+                device.pendingTimestampNs = timestampNs;
+
+                syncGroup = device.syncGroup;
+                collectFrameSet_Locked(syncGroup, &frames);
+            }
+        }
+
+        for (const Dispatch& frame : frames) {
+            mDispatching.insert(frame.serial);
+        }
+    }
+
+    if (frames.empty()) {
+        if (removed && streaming && index >= 0) {
+            // Give the buffer back, as the stream may go on after a pause
+            video->markFrameConsumed(index);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mDispatching.erase(serial);
+        }
+        mDispatchDone.notify_all();
+        return;
+    }
+
+    dispatch(frames, syncGroup);
+}
+
+void CaptureEngine::dispatchReadyGroups() {
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (const auto& [name, unused] : mSyncGroups) {
+            names.push_back(name);
+        }
+    }
+
+    for (const auto& name : names) {
+        std::vector<Dispatch> frames;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (!collectFrameSet_Locked(name, &frames)) {
+                continue;
+            }
+            for (const Dispatch& frame : frames) {
+                mDispatching.insert(frame.serial);
+            }
+        }
+        dispatch(frames, name);
+    }
+}
+
+void CaptureEngine::dispatch(const std::vector<Dispatch>& frames, const std::string& syncGroup) {
+    for (const Dispatch& frame : frames) {
+        bool removed = false;
+        {
+            // A callback may have stopped another member of the set meanwhile
+            std::lock_guard<std::mutex> lock(mLock);
+            removed = mDevices.find(frame.serial) == mDevices.end();
+        }
+        if (removed) {
+            // Give the buffer back, as the stream may go on after a pause
+            frame.video->markFrameConsumed(frame.index);
+        } else {
+            frame.video->dispatchFrame(frame.index);
+        }
+    }
+
+    FrameSetCallback onFrameSet;
+    if (!syncGroup.empty()) {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mSyncGroups.find(syncGroup);
+        if (it != mSyncGroups.end()) {
+            onFrameSet = it->second.onFrameSet;
+        }
+    }
+    if (onFrameSet) {
+        onFrameSet();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (const Dispatch& frame : frames) {
+            mDispatching.erase(frame.serial);
+        }
+    }
+    mDispatchDone.notify_all();
+}
+
+CaptureEngine::SyncGroup& CaptureEngine::getSyncGroup_Locked(const std::string& name) {
+    auto it = mSyncGroups.find(name);
+    if (it == mSyncGroups.end()) {
+        it = mSyncGroups.emplace(name, SyncGroup{getDefaultSkewNs(), nullptr, {}}).first;
+    }
+    return it->second;
+}
+
+bool CaptureEngine::collectFrameSet_Locked(const std::string& name,
+                                           std::vector<Dispatch>* frames) {
+    int64_t oldest = std::numeric_limits<int64_t>::max();
+    int64_t newest = std::numeric_limits<int64_t>::min();
+    unsigned members = 0;
+    for (const auto& [serial, device] : mDevices) {
+        if (device.syncGroup != name) {
+            continue;
+        }
+        if (device.pendingIndex < 0) {
+            // Wait for this member
+            return false;
+        }
+        oldest = std::min(oldest, device.pendingTimestampNs);
+        newest = std::max(newest, device.pendingTimestampNs);
+        ++members;
+    }
+    if (members == 0) {
+        return false;
+    }
+
+    SyncGroup& group = getSyncGroup_Locked(name);
+    if (newest - oldest > group.skewNs) {
+        // Frames too old to match the newest one are dropped; their devices capture new ones
+        for (auto& [serial, device] : mDevices) {
+            if (device.syncGroup == name && device.pendingTimestampNs < newest - group.skewNs) {
+                device.video->markFrameConsumed(device.pendingIndex);
+                device.pendingIndex = -1;
+                ++group.stats.droppedFrames;
+            }
+        }
+        return false;
+    }
+
+    for (auto& [serial, device] : mDevices) {
+        if (device.syncGroup == name) {
+            frames->push_back({serial, device.video, device.pendingIndex});
+            device.pendingIndex = -1;
+        }
+    }
+
+    ++group.stats.frameSets;
+    group.stats.lastSkewNs = newest - oldest;
+    group.stats.maxSkewNs = std::max(group.stats.maxSkewNs, group.stats.lastSkewNs);
+    return true;
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -16,10 +16,21 @@
 
 #include "ConfigManager.h"
 
+#include "BinaryCache.h"
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <cutils/properties.h>
 #include <hardware/gralloc.h>
 #include <utils/SystemClock.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <fstream>
+#include <functional>
 #include <sstream>
 #include <string_view>
 #include <thread>
@@ -27,11 +38,150 @@
 namespace {
 
 using ::aidl::android::hardware::automotive::evs::CameraParam;
+using ::aidl::android::hardware::automotive::evs::implementation::BinaryCacheHeader;
+using ::aidl::android::hardware::automotive::evs::implementation::BinaryReader;
+using ::aidl::android::hardware::automotive::evs::implementation::BinaryWriter;
+using ::aidl::android::hardware::automotive::evs::implementation::hashBytes;
+using ::aidl::android::hardware::automotive::evs::implementation::kFnvOffsetBasis;
 using ::aidl::android::hardware::graphics::common::PixelFormat;
 using ::tinyxml2::XMLAttribute;
 using ::tinyxml2::XMLDocument;
 using ::tinyxml2::XMLElement;
 
+constexpr char kPropConfigCachePath[] = "vendor.evs.config.cache";
+constexpr char kDefaultConfigCachePath[] = "/data/vendor/evs/evs_configuration.bin";
+
+/*
+ * Layout of the configuration cache.  Every section starts 8-byte aligned so
+ * the fixed-width records can be read straight from the mapped file; the
+ * loader still copies them into the configuration maps, but no text is
+ * parsed.  Bump kBinaryVersion whenever this layout changes.
+ *
+ *   BinaryHeader, starting with the BinaryCacheHeader
+ *   BinaryRecord x numRecords, each followed by
+ *       id and position strings (uint32_t length, characters, null, padding)
+ *       member id strings of a camera group x numMembers
+ *       BinaryControl x numControls
+ *       BinaryStream x numStreams
+ *       BinaryMetadata and its data x numMetadata
+ *       camera_metadata_t blob of characteristicsSize bytes
+ */
+constexpr uint32_t kBinaryMagic = 0x42535645;  // "EVSB"
+constexpr uint32_t kBinaryVersion = 2;
+
+constexpr uint32_t kRecordCamera = 1;
+constexpr uint32_t kRecordCameraGroup = 2;
+constexpr uint32_t kRecordDisplay = 3;
+
+struct BinaryHeader {
+    BinaryCacheHeader common;
+    uint64_t sourceHash;  // Configuration files and the build this cache was made from
+    int32_t numCameras;
+    uint32_t numRecords;
+};
+static_assert(sizeof(BinaryHeader) == 40);
+
+struct BinaryRecord {
+    uint32_t type;
+    uint32_t size;  // Including this header
+    uint32_t numControls;
+    uint32_t numStreams;
+    uint32_t numMetadata;
+    uint32_t numMembers;
+    int32_t synchronized;
+    uint32_t reserved;
+    uint64_t characteristicsSize;
+};
+static_assert(sizeof(BinaryRecord) == 40);
+
+struct BinaryControl {
+    int32_t id;
+    int32_t min;
+    int32_t max;
+    int32_t step;
+};
+static_assert(sizeof(BinaryControl) == 16);
+
+struct BinaryStream {
+    int32_t id;
+    int32_t width;
+    int32_t height;
+    int32_t format;
+    int32_t type;
+    int32_t framerate;
+};
+static_assert(sizeof(BinaryStream) == 24);
+
+struct BinaryMetadata {
+    uint32_t tag;
+    uint32_t count;
+    uint64_t size;  // Of the data following this, without padding
+};
+static_assert(sizeof(BinaryMetadata) == 16);
+
+StreamConfiguration toStreamConfiguration(const BinaryStream& stream) {
+    return {
+            .id = stream.id,
+            .width = stream.width,
+            .height = stream.height,
+            .format = static_cast<PixelFormat>(stream.format),
+            .type = stream.type,
+            .framerate = stream.framerate,
+    };
+}
+
+BinaryStream toBinaryStream(const StreamConfiguration& cfg) {
+    return {
+            .id = cfg.id,
+            .width = cfg.width,
+            .height = cfg.height,
+            .format = static_cast<int32_t>(cfg.format),
+            .type = cfg.type,
+            .framerate = cfg.framerate,
+    };
+}
+
+/* Size of the data ConfigManager keeps for a metadata entry; 0 if it keeps none */
+size_t getMetadataDataSize(camera_metadata_tag_t tag, size_t count) {
+    switch (tag) {
+        case ANDROID_LENS_DISTORTION:
+        case ANDROID_LENS_POSE_ROTATION:
+        case ANDROID_LENS_POSE_TRANSLATION:
+        case ANDROID_LENS_INTRINSIC_CALIBRATION:
+            return count * sizeof(float);
+        case ANDROID_REQUEST_AVAILABLE_CAPABILITIES:
+            return count * sizeof(camera_metadata_enum_android_request_available_capabilities_t);
+        case ANDROID_LOGICAL_MULTI_CAMERA_PHYSICAL_IDS:
+            return count * sizeof(char);
+        default:
+            return 0;
+    }
+}
+
+/* Allocates a copy the way the XML reader does, so ~CameraInfo() releases either */
+void* copyMetadataData(camera_metadata_tag_t tag, const void* data, size_t count) {
+    void* copy = nullptr;
+    switch (tag) {
+        case ANDROID_LENS_DISTORTION:
+        case ANDROID_LENS_POSE_ROTATION:
+        case ANDROID_LENS_POSE_TRANSLATION:
+        case ANDROID_LENS_INTRINSIC_CALIBRATION:
+            copy = new float[count];
+            break;
+        case ANDROID_REQUEST_AVAILABLE_CAPABILITIES:
+            copy = new camera_metadata_enum_android_request_available_capabilities_t[count];
+            break;
+        case ANDROID_LOGICAL_MULTI_CAMERA_PHYSICAL_IDS:
+            copy = new char[count];
+            break;
+        default:
+            return nullptr;
+    }
+
+    memcpy(copy, data, getMetadataDataSize(tag, count));
+    return copy;
+}
+
 }  // namespace
 
 std::string_view ConfigManager::sConfigDefaultPath =
@@ -39,6 +189,30 @@ std::string_view ConfigManager::sConfigDefaultPath =
 std::string_view ConfigManager::sConfigOverridePath =
         "/vendor/etc/automotive/evs/evs_configuration_override.xml";
 
+uint64_t ConfigManager::hashConfigSources() {
+    /*
+     * The enum values stored in the cache may change with the build, so its
+     * fingerprint counts as a source as well.
+     */
+    char fingerprint[PROPERTY_VALUE_MAX] = "\0";
+    property_get("ro.vendor.build.fingerprint", fingerprint, "");
+
+    uint64_t hash = hashBytes(kFnvOffsetBasis, fingerprint);
+    for (const std::string_view path : {sConfigOverridePath, sConfigDefaultPath}) {
+        std::string contents;
+        if (!android::base::ReadFileToString(std::string(path), &contents)) {
+            contents.clear();
+        }
+
+        /* the length keeps a missing file apart from an empty one */
+        hash = hashBytes(hash, path);
+        hash = hashBytes(hash, std::to_string(contents.size()));
+        hash = hashBytes(hash, contents);
+    }
+
+    return hash;
+}
+
 void ConfigManager::printElementNames(const XMLElement* rootElem, std::string prefix) const {
     const XMLElement* curElem = rootElem;
 
@@ -76,6 +250,7 @@ void ConfigManager::readCameraInfo(const XMLElement* const aCameraElem) {
             if (!readCameraDeviceInfo(aCamera, curElem)) {
                 LOG(WARNING) << "Failed to read a camera information of " << id;
                 delete aCamera;
+                curElem = curElem->NextSiblingElement();
                 continue;
             }
 
@@ -105,6 +280,7 @@ void ConfigManager::readCameraInfo(const XMLElement* const aCameraElem) {
             if (!readCameraDeviceInfo(aCamera, curElem)) {
                 LOG(WARNING) << "Failed to read a camera information of " << id;
                 delete aCamera;
+                curElem = curElem->NextSiblingElement();
                 continue;
             }
 
@@ -280,6 +456,7 @@ size_t ConfigManager::readCameraMetadata(const XMLElement* const aParamElem, Cam
                     size_t len = strlen(curElem->FindAttribute("value")->Value());
                     char* data = new char[len + 1];
                     memcpy(data, curElem->FindAttribute("value")->Value(), len * sizeof(char));
+                    data[len] = '\0';
 
                     /* replace commas with null char */
                     char* p = data;
@@ -493,237 +670,176 @@ bool ConfigManager::readConfigDataFromXML() noexcept {
 }
 
 bool ConfigManager::readConfigDataFromBinary() {
-    /* Temporary buffer to hold configuration data read from a binary file */
-    char mBuffer[1024];
-
-    std::fstream srcFile;
     const int64_t readStart = android::elapsedRealtimeNano();
 
-    srcFile.open(mBinaryFilePath, std::fstream::in | std::fstream::binary);
-    if (!srcFile) {
-        LOG(ERROR) << "Failed to open a source binary file, " << mBinaryFilePath;
+    android::base::unique_fd fd(open(mBinaryFilePath.data(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        LOG(INFO) << "No configuration cache at " << mBinaryFilePath;
         return false;
     }
 
-    std::unique_lock<std::mutex> lock(mConfigLock);
-    mIsReady = false;
-
-    /* read configuration data into the internal buffer */
-    srcFile.read(mBuffer, sizeof(mBuffer));
-    LOG(VERBOSE) << __FUNCTION__ << ": " << srcFile.gcount() << " bytes are read.";
-    char* p = mBuffer;
-    size_t sz = 0;
-
-    /* read number of camera group information entries */
-    const size_t ngrps = *(reinterpret_cast<size_t*>(p));
-    p += sizeof(size_t);
-
-    /* read each camera information entry */
-    for (size_t cidx = 0; cidx < ngrps; ++cidx) {
-        /* read camera identifier */
-        std::string cameraId = *(reinterpret_cast<std::string*>(p));
-        p += sizeof(std::string);
-
-        /* size of camera_metadata_t */
-        const size_t num_entry = *(reinterpret_cast<size_t*>(p));
-        p += sizeof(size_t);
-        const size_t num_data = *(reinterpret_cast<size_t*>(p));
-        p += sizeof(size_t);
-
-        /* create CameraInfo and add it to hash map */
-        std::unique_ptr<ConfigManager::CameraGroupInfo> aCamera;
-        if (aCamera == nullptr || !aCamera->allocate(num_entry, num_data)) {
-            LOG(ERROR) << "Failed to create new CameraInfo object";
-            mCameraInfo.clear();
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(BinaryHeader))) {
+        LOG(WARNING) << "Configuration cache " << mBinaryFilePath << " is truncated";
+        return false;
+    }
+
+    const size_t fileSize = st.st_size;
+    void* addr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        PLOG(WARNING) << "Failed to map " << mBinaryFilePath;
+        return false;
+    }
+    std::unique_ptr<void, std::function<void(void*)>> mapping(addr, [fileSize](void* p) {
+        munmap(p, fileSize);
+    });
+
+    BinaryReader reader(static_cast<const uint8_t*>(addr), fileSize);
+    switch (reader.checkHeader(kBinaryMagic, kBinaryVersion)) {
+        case BinaryReader::Status::OK:
+            break;
+        case BinaryReader::Status::UNKNOWN_FORMAT:
+            LOG(INFO) << "Configuration cache " << mBinaryFilePath << " has an unknown format";
+            return false;
+        case BinaryReader::Status::CORRUPTED:
+            LOG(WARNING) << "Configuration cache " << mBinaryFilePath << " is corrupted";
             return false;
+    }
+
+    const BinaryHeader* header = reader.take<BinaryHeader>();
+    if (header == nullptr) {
+        LOG(WARNING) << "Configuration cache " << mBinaryFilePath << " is truncated";
+        return false;
+    }
+    if (header->sourceHash != mSourceHash) {
+        LOG(INFO) << "Configuration cache " << mBinaryFilePath << " is stale";
+        return false;
+    }
+
+    /* build the configuration aside and publish it only if the whole file is valid */
+    SystemInfo systemInfo;
+    systemInfo.numCameras = header->numCameras;
+    std::unordered_map<std::string, std::unique_ptr<CameraInfo>> cameraInfo;
+    std::unordered_map<std::string, std::unique_ptr<DisplayInfo>> displayInfo;
+    std::unordered_map<std::string, std::unique_ptr<CameraGroupInfo>> cameraGroups;
+    std::unordered_map<std::string, std::unordered_set<std::string>> cameraPosition;
+
+    for (uint32_t ridx = 0; ridx < header->numRecords && reader.isValid(); ++ridx) {
+        const size_t recordStart = reader.offset();
+        const BinaryRecord* record = reader.take<BinaryRecord>();
+        const std::string_view id = reader.takeString();
+        const std::string_view position = reader.takeString();
+        if (!reader.isValid()) {
+            break;
         }
 
-        /* controls */
-        typedef struct {
-            CameraParam cid;
-            int32_t min;
-            int32_t max;
-            int32_t step;
-        } CameraCtrl;
-        sz = *(reinterpret_cast<size_t*>(p));
-        p += sizeof(size_t);
-        CameraCtrl* ptr = reinterpret_cast<CameraCtrl*>(p);
-        for (size_t idx = 0; idx < sz; ++idx) {
-            CameraCtrl temp = *ptr++;
-            aCamera->controls.insert_or_assign(temp.cid,
-                                               std::move(std::make_tuple(temp.min, temp.max,
-                                                                         temp.step)));
-        }
-        p = reinterpret_cast<char*>(ptr);
-
-        /* stream configurations */
-        sz = *(reinterpret_cast<size_t*>(p));
-        p += sizeof(size_t);
-        int32_t* i32_ptr = reinterpret_cast<int32_t*>(p);
-        for (size_t idx = 0; idx < sz; ++idx) {
-            const int32_t id = *i32_ptr++;
-
-            StreamConfiguration temp;
-            memcpy(&temp, i32_ptr, sizeof(StreamConfiguration));
-            i32_ptr += sizeof(StreamConfiguration);
-            aCamera->streamConfigurations.insert_or_assign(id, temp);
-        }
-        p = reinterpret_cast<char*>(i32_ptr);
-
-        /* synchronization */
-        aCamera->synchronized = *(reinterpret_cast<int32_t*>(p));
-        p += sizeof(int32_t);
-
-        for (size_t idx = 0; idx < num_entry; ++idx) {
-            /* Read camera metadata entries */
-            camera_metadata_tag_t tag = *reinterpret_cast<camera_metadata_tag_t*>(p);
-            p += sizeof(camera_metadata_tag_t);
-            const size_t count = *reinterpret_cast<size_t*>(p);
-            p += sizeof(size_t);
-
-            const int32_t type = get_camera_metadata_tag_type(tag);
-            switch (type) {
-                case TYPE_BYTE: {
-                    add_camera_metadata_entry(aCamera->characteristics, tag, p, count);
-                    p += count * sizeof(uint8_t);
-                    break;
-                }
-                case TYPE_INT32: {
-                    add_camera_metadata_entry(aCamera->characteristics, tag, p, count);
-                    p += count * sizeof(int32_t);
-                    break;
-                }
-                case TYPE_FLOAT: {
-                    add_camera_metadata_entry(aCamera->characteristics, tag, p, count);
-                    p += count * sizeof(float);
-                    break;
-                }
-                case TYPE_INT64: {
-                    add_camera_metadata_entry(aCamera->characteristics, tag, p, count);
-                    p += count * sizeof(int64_t);
-                    break;
-                }
-                case TYPE_DOUBLE: {
-                    add_camera_metadata_entry(aCamera->characteristics, tag, p, count);
-                    p += count * sizeof(double);
-                    break;
-                }
-                case TYPE_RATIONAL:
-                    p += count * sizeof(camera_metadata_rational_t);
-                    break;
-                default:
-                    LOG(WARNING) << "Type " << type << " is unknown; "
-                                 << "data may be corrupted.";
-                    break;
+        if (record->type == kRecordDisplay) {
+            std::unique_ptr<DisplayInfo> dpy(new DisplayInfo());
+            const BinaryStream* streams = reader.take<BinaryStream>(record->numStreams);
+            for (uint32_t idx = 0; reader.isValid() && idx < record->numStreams; ++idx) {
+                dpy->streamConfigurations.insert_or_assign(streams[idx].id,
+                                                           toStreamConfiguration(streams[idx]));
+            }
+            if (reader.offset() - recordStart != record->size) {
+                reader.invalidate();
+                break;
             }
+            displayInfo.insert_or_assign(std::string(id), std::move(dpy));
+            continue;
         }
 
-        mCameraInfo.insert_or_assign(cameraId, std::move(aCamera));
-    }
+        std::unique_ptr<CameraInfo> aCamera;
+        CameraGroupInfo* aGroup = nullptr;
+        if (record->type == kRecordCameraGroup) {
+            aGroup = new CameraGroupInfo();
+            aGroup->synchronized = record->synchronized;
+            aCamera.reset(aGroup);
+        } else if (record->type == kRecordCamera) {
+            aCamera.reset(new CameraInfo());
+        } else {
+            LOG(WARNING) << "Configuration cache has an unknown record type " << record->type;
+            reader.invalidate();
+            break;
+        }
 
-    /* read number of camera information entries */
-    const size_t ncams = *(reinterpret_cast<size_t*>(p));
-    p += sizeof(size_t);
+        for (uint32_t idx = 0; reader.isValid() && idx < record->numMembers; ++idx) {
+            const std::string_view member = reader.takeString();
+            if (aGroup != nullptr && reader.isValid()) {
+                aGroup->devices.emplace(member);
+            }
+        }
 
-    /* read each camera information entry */
-    for (size_t cidx = 0; cidx < ncams; ++cidx) {
-        /* read camera identifier */
-        std::string cameraId = *(reinterpret_cast<std::string*>(p));
-        p += sizeof(std::string);
+        const BinaryControl* controls = reader.take<BinaryControl>(record->numControls);
+        for (uint32_t idx = 0; reader.isValid() && idx < record->numControls; ++idx) {
+            aCamera->controls.insert_or_assign(static_cast<CameraParam>(controls[idx].id),
+                                               std::make_tuple(controls[idx].min,
+                                                               controls[idx].max,
+                                                               controls[idx].step));
+        }
 
-        /* size of camera_metadata_t */
-        const size_t num_entry = *(reinterpret_cast<size_t*>(p));
-        p += sizeof(size_t);
-        const size_t num_data = *(reinterpret_cast<size_t*>(p));
-        p += sizeof(size_t);
+        const BinaryStream* streams = reader.take<BinaryStream>(record->numStreams);
+        for (uint32_t idx = 0; reader.isValid() && idx < record->numStreams; ++idx) {
+            aCamera->streamConfigurations.insert_or_assign(streams[idx].id,
+                                                           toStreamConfiguration(streams[idx]));
+        }
 
-        /* create CameraInfo and add it to hash map */
-        std::unique_ptr<ConfigManager::CameraInfo> aCamera;
-        if (aCamera == nullptr || !aCamera->allocate(num_entry, num_data)) {
-            LOG(ERROR) << "Failed to create new CameraInfo object";
-            mCameraInfo.clear();
-            return false;
+        for (uint32_t idx = 0; reader.isValid() && idx < record->numMetadata; ++idx) {
+            const BinaryMetadata* entry = reader.take<BinaryMetadata>();
+            if (entry == nullptr) {
+                break;
+            }
+            const uint8_t* data = reader.take<uint8_t>(entry->size);
+            const auto tag = static_cast<camera_metadata_tag_t>(entry->tag);
+            if (!reader.isValid() || getMetadataDataSize(tag, entry->count) != entry->size) {
+                reader.invalidate();
+                break;
+            }
+            aCamera->cameraMetadata.insert_or_assign(tag,
+                                                     std::make_pair(copyMetadataData(tag, data,
+                                                                                     entry->count),
+                                                                    entry->count));
         }
 
-        /* controls */
-        typedef struct {
-            CameraParam cid;
-            int32_t min;
-            int32_t max;
-            int32_t step;
-        } CameraCtrl;
-        sz = *(reinterpret_cast<size_t*>(p));
-        p += sizeof(size_t);
-        CameraCtrl* ptr = reinterpret_cast<CameraCtrl*>(p);
-        for (size_t idx = 0; idx < sz; ++idx) {
-            CameraCtrl temp = *ptr++;
-            aCamera->controls.insert_or_assign(temp.cid,
-                                               std::move(std::make_tuple(temp.min, temp.max,
-                                                                         temp.step)));
-        }
-        p = reinterpret_cast<char*>(ptr);
-
-        /* stream configurations */
-        sz = *(reinterpret_cast<size_t*>(p));
-        p += sizeof(size_t);
-        int32_t* i32_ptr = reinterpret_cast<int32_t*>(p);
-        for (size_t idx = 0; idx < sz; ++idx) {
-            const int32_t id = *i32_ptr++;
-
-            StreamConfiguration temp;
-            memcpy(&temp, i32_ptr, sizeof(StreamConfiguration));
-            i32_ptr += sizeof(StreamConfiguration);
-            aCamera->streamConfigurations.insert_or_assign(id, temp);
-        }
-        p = reinterpret_cast<char*>(i32_ptr);
-
-        for (size_t idx = 0; idx < num_entry; ++idx) {
-            /* Read camera metadata entries */
-            camera_metadata_tag_t tag = *reinterpret_cast<camera_metadata_tag_t*>(p);
-            p += sizeof(camera_metadata_tag_t);
-            const size_t count = *reinterpret_cast<size_t*>(p);
-            p += sizeof(size_t);
-
-            const int32_t type = get_camera_metadata_tag_type(tag);
-            switch (type) {
-                case TYPE_BYTE: {
-                    add_camera_metadata_entry(aCamera->characteristics, tag, p, count);
-                    p += count * sizeof(uint8_t);
-                    break;
-                }
-                case TYPE_INT32: {
-                    add_camera_metadata_entry(aCamera->characteristics, tag, p, count);
-                    p += count * sizeof(int32_t);
-                    break;
-                }
-                case TYPE_FLOAT: {
-                    add_camera_metadata_entry(aCamera->characteristics, tag, p, count);
-                    p += count * sizeof(float);
-                    break;
-                }
-                case TYPE_INT64: {
-                    add_camera_metadata_entry(aCamera->characteristics, tag, p, count);
-                    p += count * sizeof(int64_t);
-                    break;
-                }
-                case TYPE_DOUBLE: {
-                    add_camera_metadata_entry(aCamera->characteristics, tag, p, count);
-                    p += count * sizeof(double);
-                    break;
-                }
-                case TYPE_RATIONAL:
-                    p += count * sizeof(camera_metadata_rational_t);
-                    break;
-                default:
-                    LOG(WARNING) << "Type " << type << " is unknown; "
-                                 << "data may be corrupted.";
-                    break;
+        if (record->characteristicsSize > 0) {
+            const uint8_t* blob = reader.take<uint8_t>(record->characteristicsSize);
+            if (reader.isValid()) {
+                /* this also validates the structure of the blob */
+                aCamera->characteristics = allocate_copy_camera_metadata_checked(
+                        reinterpret_cast<const camera_metadata_t*>(blob),
+                        record->characteristicsSize);
+            }
+            if (aCamera->characteristics == nullptr) {
+                reader.invalidate();
+                break;
             }
         }
 
-        mCameraInfo.insert_or_assign(cameraId, std::move(aCamera));
+        if (!reader.isValid() || reader.offset() - recordStart != record->size) {
+            reader.invalidate();
+            break;
+        }
+
+        if (aGroup != nullptr) {
+            aCamera.release();
+            cameraGroups.insert_or_assign(std::string(id),
+                                          std::unique_ptr<CameraGroupInfo>(aGroup));
+        } else {
+            cameraInfo.insert_or_assign(std::string(id), std::move(aCamera));
+            cameraPosition[std::string(position)].emplace(id);
+        }
+    }
+
+    if (!reader.isValid()) {
+        LOG(WARNING) << "Configuration cache " << mBinaryFilePath << " is corrupted";
+        return false;
     }
 
+    std::unique_lock<std::mutex> lock(mConfigLock);
+    mSystemInfo = systemInfo;
+    mCameraInfo = std::move(cameraInfo);
+    mDisplayInfo = std::move(displayInfo);
+    mCameraGroups = std::move(cameraGroups);
+    mCameraPosition = std::move(cameraPosition);
     mIsReady = true;
 
     /* notify that configuration data is ready */
@@ -738,187 +854,142 @@ bool ConfigManager::readConfigDataFromBinary() {
 }
 
 bool ConfigManager::writeConfigDataToBinary() {
-    std::fstream outFile;
-
     const int64_t writeStart = android::elapsedRealtimeNano();
 
-    outFile.open(mBinaryFilePath, std::fstream::out | std::fstream::binary);
-    if (!outFile) {
-        LOG(ERROR) << "Failed to open a destination binary file, " << mBinaryFilePath;
-        return false;
-    }
+    BinaryWriter writer;
+    BinaryHeader header = {
+            .common = {.magic = kBinaryMagic, .version = kBinaryVersion},
+            .sourceHash = mSourceHash,
+            .numCameras = 0,
+            .numRecords = 0,
+    };
+    const size_t headerOffset = writer.append(header);
 
-    /* lock a configuration data while it's being written to the filesystem */
-    std::lock_guard<std::mutex> lock(mConfigLock);
+    /* lock a configuration data while it's being serialized */
+    std::unique_lock<std::mutex> lock(mConfigLock);
+    header.numCameras = mSystemInfo.numCameras;
+
+    auto writeCamera = [&](uint32_t type, const std::string& id, const std::string& position,
+                           const CameraInfo& camInfo, const CameraGroupInfo* groupInfo) {
+        BinaryRecord record = {
+                .type = type,
+                .size = 0,
+                .numControls = static_cast<uint32_t>(camInfo.controls.size()),
+                .numStreams = static_cast<uint32_t>(camInfo.streamConfigurations.size()),
+                .numMetadata = 0,
+                .numMembers = groupInfo != nullptr
+                        ? static_cast<uint32_t>(groupInfo->devices.size())
+                        : 0,
+                .synchronized = groupInfo != nullptr ? groupInfo->synchronized : 0,
+                .reserved = 0,
+                .characteristicsSize = camInfo.characteristics != nullptr
+                        ? get_camera_metadata_size(camInfo.characteristics)
+                        : 0,
+        };
+        const size_t recordOffset = writer.append(record);
+        writer.appendString(id);
+        writer.appendString(position);
+
+        if (groupInfo != nullptr) {
+            for (auto&& member : groupInfo->devices) {
+                writer.appendString(member);
+            }
+        }
 
-    /* write camera group information */
-    size_t sz = mCameraGroups.size();
-    outFile.write(reinterpret_cast<const char*>(&sz), sizeof(size_t));
-    for (auto&& [camId, camInfo] : mCameraGroups) {
-        LOG(INFO) << "Storing camera group " << camId;
-
-        /* write a camera identifier string */
-        outFile.write(reinterpret_cast<const char*>(&camId), sizeof(std::string));
-
-        /* controls */
-        sz = camInfo->controls.size();
-        outFile.write(reinterpret_cast<const char*>(&sz), sizeof(size_t));
-        for (auto&& [ctrl, range] : camInfo->controls) {
-            outFile.write(reinterpret_cast<const char*>(&ctrl), sizeof(CameraParam));
-            outFile.write(reinterpret_cast<const char*>(&std::get<0>(range)), sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char*>(&std::get<1>(range)), sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char*>(&std::get<2>(range)), sizeof(int32_t));
-        }
-
-        /* stream configurations */
-        sz = camInfo->streamConfigurations.size();
-        outFile.write(reinterpret_cast<const char*>(&sz), sizeof(size_t));
-        for (auto&& [sid, cfg] : camInfo->streamConfigurations) {
-            outFile.write(reinterpret_cast<const char*>(sid), sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char*>(&cfg), sizeof(cfg));
-        }
-
-        /* synchronization */
-        outFile.write(reinterpret_cast<const char*>(&camInfo->synchronized), sizeof(int32_t));
-
-        /* size of camera_metadata_t */
-        size_t num_entry = 0;
-        size_t num_data = 0;
-        if (camInfo->characteristics != nullptr) {
-            num_entry = get_camera_metadata_entry_count(camInfo->characteristics);
-            num_data = get_camera_metadata_data_count(camInfo->characteristics);
-        }
-        outFile.write(reinterpret_cast<const char*>(&num_entry), sizeof(size_t));
-        outFile.write(reinterpret_cast<const char*>(&num_data), sizeof(size_t));
-
-        /* write each camera metadata entry */
-        if (num_entry > 0) {
-            camera_metadata_entry_t entry;
-            for (size_t idx = 0; idx < num_entry; ++idx) {
-                if (get_camera_metadata_entry(camInfo->characteristics, idx, &entry)) {
-                    LOG(ERROR) << "Failed to retrieve camera metadata entry " << idx;
-                    outFile.close();
-                    return false;
-                }
+        for (auto&& [ctrl, range] : camInfo.controls) {
+            writer.append(BinaryControl{
+                    .id = static_cast<int32_t>(ctrl),
+                    .min = std::get<0>(range),
+                    .max = std::get<1>(range),
+                    .step = std::get<2>(range),
+            });
+        }
 
-                outFile.write(reinterpret_cast<const char*>(&entry.tag), sizeof(entry.tag));
-                outFile.write(reinterpret_cast<const char*>(&entry.count), sizeof(entry.count));
-
-                int32_t type = get_camera_metadata_tag_type(entry.tag);
-                switch (type) {
-                    case TYPE_BYTE:
-                        outFile.write(reinterpret_cast<const char*>(entry.data.u8),
-                                      sizeof(uint8_t) * entry.count);
-                        break;
-                    case TYPE_INT32:
-                        outFile.write(reinterpret_cast<const char*>(entry.data.i32),
-                                      sizeof(int32_t) * entry.count);
-                        break;
-                    case TYPE_FLOAT:
-                        outFile.write(reinterpret_cast<const char*>(entry.data.f),
-                                      sizeof(float) * entry.count);
-                        break;
-                    case TYPE_INT64:
-                        outFile.write(reinterpret_cast<const char*>(entry.data.i64),
-                                      sizeof(int64_t) * entry.count);
-                        break;
-                    case TYPE_DOUBLE:
-                        outFile.write(reinterpret_cast<const char*>(entry.data.d),
-                                      sizeof(double) * entry.count);
-                        break;
-                    case TYPE_RATIONAL:
-                        [[fallthrough]];
-                    default:
-                        LOG(WARNING) << "Type " << type << " is not supported.";
-                        break;
-                }
+        for (auto&& [sid, cfg] : camInfo.streamConfigurations) {
+            writer.append(toBinaryStream(cfg));
+        }
+
+        for (auto&& [tag, entry] : camInfo.cameraMetadata) {
+            const size_t size = getMetadataDataSize(tag, entry.second);
+            if (size == 0) {
+                LOG(WARNING) << "Tag " << std::hex << tag << " is not stored in the cache";
+                continue;
             }
+
+            writer.append(BinaryMetadata{
+                    .tag = static_cast<uint32_t>(tag),
+                    .count = static_cast<uint32_t>(entry.second),
+                    .size = size,
+            });
+            writer.appendBytes(entry.first, size);
+            ++record.numMetadata;
+        }
+
+        if (record.characteristicsSize > 0) {
+            writer.appendBytes(camInfo.characteristics, record.characteristicsSize);
+        }
+
+        record.size = static_cast<uint32_t>(writer.size() - recordOffset);
+        writer.update(recordOffset, record);
+        ++header.numRecords;
+    };
+
+    for (auto&& [camId, camInfo] : mCameraGroups) {
+        if (camInfo != nullptr) {
+            writeCamera(kRecordCameraGroup, camId, "", *camInfo, camInfo.get());
         }
     }
 
-    /* write camera device information */
-    sz = mCameraInfo.size();
-    outFile.write(reinterpret_cast<const char*>(&sz), sizeof(size_t));
     for (auto&& [camId, camInfo] : mCameraInfo) {
-        LOG(INFO) << "Storing camera " << camId;
-
-        /* write a camera identifier string */
-        outFile.write(reinterpret_cast<const char*>(&camId), sizeof(std::string));
-
-        /* controls */
-        sz = camInfo->controls.size();
-        outFile.write(reinterpret_cast<const char*>(&sz), sizeof(size_t));
-        for (auto& [ctrl, range] : camInfo->controls) {
-            outFile.write(reinterpret_cast<const char*>(&ctrl), sizeof(CameraParam));
-            outFile.write(reinterpret_cast<const char*>(&std::get<0>(range)), sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char*>(&std::get<1>(range)), sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char*>(&std::get<2>(range)), sizeof(int32_t));
-        }
-
-        /* stream configurations */
-        sz = camInfo->streamConfigurations.size();
-        outFile.write(reinterpret_cast<const char*>(&sz), sizeof(size_t));
-        for (auto&& [sid, cfg] : camInfo->streamConfigurations) {
-            outFile.write(reinterpret_cast<const char*>(sid), sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char*>(&cfg), sizeof(cfg));
-        }
-
-        /* size of camera_metadata_t */
-        size_t num_entry = 0;
-        size_t num_data = 0;
-        if (camInfo->characteristics != nullptr) {
-            num_entry = get_camera_metadata_entry_count(camInfo->characteristics);
-            num_data = get_camera_metadata_data_count(camInfo->characteristics);
-        }
-        outFile.write(reinterpret_cast<const char*>(&num_entry), sizeof(size_t));
-        outFile.write(reinterpret_cast<const char*>(&num_data), sizeof(size_t));
-
-        /* write each camera metadata entry */
-        if (num_entry > 0) {
-            camera_metadata_entry_t entry;
-            for (size_t idx = 0; idx < num_entry; ++idx) {
-                if (get_camera_metadata_entry(camInfo->characteristics, idx, &entry)) {
-                    LOG(ERROR) << "Failed to retrieve camera metadata entry " << idx;
-                    outFile.close();
-                    return false;
-                }
+        if (camInfo == nullptr) {
+            continue;
+        }
 
-                outFile.write(reinterpret_cast<const char*>(&entry.tag), sizeof(entry.tag));
-                outFile.write(reinterpret_cast<const char*>(&entry.count), sizeof(entry.count));
-
-                int32_t type = get_camera_metadata_tag_type(entry.tag);
-                switch (type) {
-                    case TYPE_BYTE:
-                        outFile.write(reinterpret_cast<const char*>(entry.data.u8),
-                                      sizeof(uint8_t) * entry.count);
-                        break;
-                    case TYPE_INT32:
-                        outFile.write(reinterpret_cast<const char*>(entry.data.i32),
-                                      sizeof(int32_t) * entry.count);
-                        break;
-                    case TYPE_FLOAT:
-                        outFile.write(reinterpret_cast<const char*>(entry.data.f),
-                                      sizeof(float) * entry.count);
-                        break;
-                    case TYPE_INT64:
-                        outFile.write(reinterpret_cast<const char*>(entry.data.i64),
-                                      sizeof(int64_t) * entry.count);
-                        break;
-                    case TYPE_DOUBLE:
-                        outFile.write(reinterpret_cast<const char*>(entry.data.d),
-                                      sizeof(double) * entry.count);
-                        break;
-                    case TYPE_RATIONAL:
-                        [[fallthrough]];
-                    default:
-                        LOG(WARNING) << "Type " << type << " is not supported.";
-                        break;
-                }
+        std::string position;
+        for (auto&& [pos, ids] : mCameraPosition) {
+            if (ids.find(camId) != ids.end()) {
+                position = pos;
+                break;
             }
         }
+        writeCamera(kRecordCamera, camId, position, *camInfo, nullptr);
+    }
+
+    for (auto&& [dpyId, dpyInfo] : mDisplayInfo) {
+        if (dpyInfo == nullptr) {
+            continue;
+        }
+
+        BinaryRecord record = {
+                .type = kRecordDisplay,
+                .size = 0,
+                .numControls = 0,
+                .numStreams = static_cast<uint32_t>(dpyInfo->streamConfigurations.size()),
+                .numMetadata = 0,
+                .numMembers = 0,
+                .synchronized = 0,
+                .reserved = 0,
+                .characteristicsSize = 0,
+        };
+        const size_t recordOffset = writer.append(record);
+        writer.appendString(dpyId);
+        writer.appendString("");
+        for (auto&& [sid, cfg] : dpyInfo->streamConfigurations) {
+            writer.append(toBinaryStream(cfg));
+        }
+
+        record.size = static_cast<uint32_t>(writer.size() - recordOffset);
+        writer.update(recordOffset, record);
+        ++header.numRecords;
+    }
+    lock.unlock();
+
+    writer.update(headerOffset, header);
+    if (!writer.store(mBinaryFilePath)) {
+        LOG(WARNING) << "Failed to store the configuration cache " << mBinaryFilePath;
+        return false;
     }
 
-    outFile.close();
     int64_t writeEnd = android::elapsedRealtimeNano();
     LOG(INFO) << __FUNCTION__ << " takes " << std::scientific
               << (double)(writeEnd - writeStart) / 1000000.0 << " ms.";
@@ -929,19 +1000,29 @@ bool ConfigManager::writeConfigDataToBinary() {
 std::unique_ptr<ConfigManager> ConfigManager::Create() {
     std::unique_ptr<ConfigManager> cfgMgr(new ConfigManager());
 
+    char path[PROPERTY_VALUE_MAX] = "\0";
+    property_get(kPropConfigCachePath, path, kDefaultConfigCachePath);
+    cfgMgr->mBinaryFilePath = path;
+    cfgMgr->mSourceHash = hashConfigSources();
+
     /*
-     * Read a configuration from XML file
-     *
-     * If this is too slow, ConfigManager::readConfigDataFromBinary() and
-     * ConfigManager::writeConfigDataToBinary()can serialize CameraInfo object
-     * to the filesystem and construct CameraInfo instead; this was
-     * evaluated as 10x faster.
+     * Map the configuration cached by a previous start; parse XML and refresh
+     * the cache when there is none or the configuration files have changed
+     * since.
      */
+    if (!cfgMgr->mBinaryFilePath.empty() && cfgMgr->readConfigDataFromBinary()) {
+        return cfgMgr;
+    }
+
     if (!cfgMgr->readConfigDataFromXML()) {
         return nullptr;
-    } else {
-        return cfgMgr;
     }
+
+    if (!cfgMgr->mBinaryFilePath.empty()) {
+        cfgMgr->writeConfigDataToBinary();
+    }
+
+    return cfgMgr;
 }
 
 ConfigManager::CameraInfo::~CameraInfo() {
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConversionWorkerPool.h"
+
+#include <android-base/logging.h>
+#include <cutils/properties.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+namespace {
+
+constexpr char kPropConvertThreads[] = "vendor.evs.convert.threads";
+constexpr char kPropConvertMinKb[] = "vendor.evs.convert.min_kb";
+constexpr char kPropConvertCpusPrefix[] = "vendor.evs.convert.cpus.";
+
+// Upper bound of the default number of helpers; more rarely pay off for a memory bound copy
+constexpr unsigned kDefaultMaxHelpers = 3;
+
+// A VGA RGBA frame is about 1.2 MB and is converted faster than the helpers are woken up
+constexpr int kDefaultMinParallelKb = 2048;
+
+int readIntProperty(const char* name, int defaultValue) {
+    char value[PROPERTY_VALUE_MAX] = "\0";
+    if (property_get(name, value, nullptr) > 0) {
+        return atoi(value);
+    }
+    return defaultValue;
+}
+
+// Parses a CPU list such as "0,2-3" as found in /sys/devices/system/cpu/online
+bool parseCpuList(const char* list, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    const char* p = list;
+    while (*p != '\0') {
+        char* end = nullptr;
+        const long first = strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            return false;
+        }
+
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) {
+                return false;
+            }
+            p = end;
+        }
+
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, cpus);
+        }
+
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return false;
+        }
+    }
+
+    return CPU_COUNT(cpus) > 0;
+}
+
+}  // namespace
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+ConversionAffinity ConversionAffinity::fromProperties(const std::string& deviceName) {
+    ConversionAffinity affinity;
+    CPU_ZERO(&affinity.cpus);
+
+    const std::string node = deviceName.substr(deviceName.find_last_of('/') + 1);
+    const std::string prop = kPropConvertCpusPrefix + node;
+    char value[PROPERTY_VALUE_MAX] = "\0";
+    if (property_get(prop.data(), value, nullptr) > 0) {
+        if (parseCpuList(value, &affinity.cpus)) {
+            affinity.pinned = true;
+            LOG(INFO) << "Conversion helpers of " << deviceName << " run on CPUs " << value;
+        } else {
+            LOG(WARNING) << "Ignoring invalid CPU list " << value << " in " << prop;
+        }
+    }
+
+    return affinity;
+}
+
+ConversionWorkerPool& ConversionWorkerPool::getInstance() {
+    static ConversionWorkerPool sInstance;
+    return sInstance;
+}
+
+ConversionWorkerPool::ConversionWorkerPool() {
+    const unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    const int maxHelpers =
+            readIntProperty(kPropConvertThreads, std::min(cores - 1, kDefaultMaxHelpers));
+    mMaxHelpers = static_cast<unsigned>(std::max(maxHelpers, 0));
+    mMinParallelBytes =
+            static_cast<size_t>(std::max(readIntProperty(kPropConvertMinKb, kDefaultMinParallelKb),
+                                         0)) *
+            1024;
+
+    if (sched_getaffinity(0, sizeof(mDefaultCpus), &mDefaultCpus) != 0) {
+        PLOG(WARNING) << "Failed to read the CPU affinity of the service";
+        CPU_ZERO(&mDefaultCpus);
+    }
+
+    LOG(INFO) << "Frame conversion uses up to " << mMaxHelpers << " helper threads for frames of "
+              << mMinParallelBytes / 1024 << " KB or larger";
+}
+
+ConversionWorkerPool::~ConversionWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mSignal.notify_all();
+
+    for (auto& helper : mHelpers) {
+        helper.join();
+    }
+}
+
+void ConversionWorkerPool::startHelpers() {
+    // Helpers are created with the first frame which is large enough to need them
+    for (unsigned i = 0; i < mMaxHelpers; i++) {
+        mHelpers.emplace_back([this] { helperLoop(); });
+    }
+}
+
+bool ConversionWorkerPool::run(const ConversionAffinity& affinity, unsigned rows,
+                               unsigned rowAlignment, size_t frameBytes,
+                               const RowConverter& convert) {
+    const unsigned units = (rows + rowAlignment - 1) / rowAlignment;
+    const unsigned numBands = std::min(mMaxHelpers + 1, units);
+    if (numBands < 2 || frameBytes < mMinParallelBytes) {
+        convert(0, rows);
+        return false;
+    }
+
+    std::call_once(mStartOnce, [this] { startHelpers(); });
+
+    Job job;
+    job.convert = &convert;
+    job.affinity = &affinity;
+    job.pending = numBands - 1;
+
+    // The first band is left to the calling thread, which is already running
+    auto bandRow = [&](unsigned band) {
+        return std::min(units * band / numBands * rowAlignment, rows);
+    };
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (unsigned band = 1; band < numBands; band++) {
+            mBands.push_back({&job, bandRow(band), bandRow(band + 1)});
+        }
+    }
+    mSignal.notify_all();
+
+    convert(0, bandRow(1));
+
+    // All helpers may be busy with the frames of other cameras
+    Band band;
+    while (reclaimBand(&job, &band)) {
+        convert(band.begin, band.end);
+        finishBand(band);
+    }
+
+    std::unique_lock<std::mutex> lock(job.lock);
+    job.done.wait(lock, [&job] { return job.pending == 0; });
+    return true;
+}
+
+bool ConversionWorkerPool::reclaimBand(const Job* job, Band* band) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = std::find_if(mBands.begin(), mBands.end(),
+                           [job](const Band& b) { return b.job == job; });
+    if (it == mBands.end()) {
+        return false;
+    }
+
+    *band = *it;
+    mBands.erase(it);
+    return true;
+}
+
+void ConversionWorkerPool::finishBand(const Band& band) {
+    // The job lives on the stack of run(), which returns as soon as it sees the last band done
+    std::lock_guard<std::mutex> lock(band.job->lock);
+    if (--band.job->pending == 0) {
+        band.job->done.notify_one();
+    }
+}
+
+void ConversionWorkerPool::helperLoop() {
+    cpu_set_t current = mDefaultCpus;
+
+    while (true) {
+        Band band;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mSignal.wait(lock, [this] { return mStopping || !mBands.empty(); });
+            if (mStopping) {
+                return;
+            }
+
+            band = mBands.front();
+            mBands.pop_front();
+        }
+
+        // Only switch when the band belongs to a camera with different settings
+        const cpu_set_t& wanted =
+                band.job->affinity->pinned ? band.job->affinity->cpus : mDefaultCpus;
+        if (CPU_COUNT(&wanted) > 0 && !CPU_EQUAL(&wanted, &current)) {
+            if (sched_setaffinity(0, sizeof(wanted), &wanted) == 0) {
+                current = wanted;
+            } else {
+                PLOG(WARNING) << "Failed to set the CPU affinity of a conversion helper";
+            }
+        }
+
+        (*band.job->convert)(band.begin, band.end);
+        finishBand(band);
+    }
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DisplayPacer.h"
+
+#include <android-base/logging.h>
+#include <cutils/properties.h>
+#include <utils/Timers.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+namespace {
+
+constexpr char kPropRefreshRate[] = "vendor.evs.display.refresh_rate";
+constexpr int kDefaultRefreshRate = 60;
+
+int64_t readVsyncPeriodNs() {
+    int refreshRate = kDefaultRefreshRate;
+    char value[PROPERTY_VALUE_MAX] = "\0";
+    if (property_get(kPropRefreshRate, value, nullptr) > 0) {
+        refreshRate = atoi(value);
+        if (refreshRate <= 0) {
+            LOG(WARNING) << "Ignoring a refresh rate of " << value << " Hz";
+            refreshRate = kDefaultRefreshRate;
+        }
+    }
+    return 1000000000LL / refreshRate;
+}
+
+}  // namespace
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+TimerVsyncSource::TimerVsyncSource() : TimerVsyncSource(readVsyncPeriodNs()) {}
+
+TimerVsyncSource::TimerVsyncSource(int64_t periodNs) :
+      mPeriodNs(periodNs), mPhaseNs(systemTime(SYSTEM_TIME_MONOTONIC)) {}
+
+int64_t TimerVsyncSource::waitForNextVsync() {
+    // Sleeps to an absolute time, so the vsyncs do not drift by the time the callers take
+    const int64_t nowNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    const int64_t vsyncNs = mPhaseNs + ((nowNs - mPhaseNs) / mPeriodNs + 1) * mPeriodNs;
+
+    struct timespec wakeup = {
+            .tv_sec = static_cast<time_t>(vsyncNs / 1000000000LL),
+            .tv_nsec = static_cast<long>(vsyncNs % 1000000000LL),
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, nullptr) == EINTR) {
+    }
+
+    return vsyncNs;
+}
+
+void SimulatedVsyncSource::tick(int64_t timestampNs) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        ++mTicks;
+        mLastVsyncNs = timestampNs;
+    }
+    mTicked.notify_all();
+}
+
+int64_t SimulatedVsyncSource::waitForNextVsync() {
+    std::unique_lock<std::mutex> lock(mLock);
+    const uint64_t ticks = mTicks;
+    mTicked.wait(lock, [this, ticks] { return mStopped || mTicks != ticks; });
+    return mStopped ? -1 : mLastVsyncNs;
+}
+
+void SimulatedVsyncSource::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopped = true;
+    }
+    mTicked.notify_all();
+}
+
+DisplayPacer::DisplayPacer(size_t numBuffers, std::unique_ptr<VsyncSource> vsyncSource) :
+      mVsyncSource(std::move(vsyncSource)), mBuffers(numBuffers) {
+    mStats.vsyncPeriodNs = mVsyncSource->getPeriodNs();
+}
+
+int DisplayPacer::acquireBuffer(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mLock);
+    int idx = -1;
+    mBufferFree.wait_for(lock, timeout, [this, &idx] {
+        if (mStopping) {
+            return true;
+        }
+        for (size_t i = 0; i < mBuffers.size(); ++i) {
+            if (mBuffers[i].state == BufferState::FREE) {
+                idx = i;
+                return true;
+            }
+        }
+        return false;
+    });
+
+    if (mStopping || idx < 0) {
+        return -1;
+    }
+
+    mBuffers[idx].state = BufferState::CLIENT;
+    return idx;
+}
+
+bool DisplayPacer::queueBuffer(int index) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (index < 0 || index >= static_cast<int>(mBuffers.size()) ||
+            mBuffers[index].state != BufferState::CLIENT) {
+            return false;
+        }
+
+        if (mLatest >= 0) {
+            // The frame waiting for the vsync is already stale; the newer one takes its place
+            mBuffers[mLatest].state = BufferState::FREE;
+            ++mStats.dropped;
+            mBufferFree.notify_one();
+        }
+
+        mBuffers[index].state = BufferState::QUEUED;
+        mBuffers[index].queuedNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        mLatest = index;
+        ++mStats.queued;
+    }
+    mFrameQueued.notify_one();
+    return true;
+}
+
+bool DisplayPacer::cancelBuffer(int index) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (index < 0 || index >= static_cast<int>(mBuffers.size()) ||
+            mBuffers[index].state != BufferState::CLIENT) {
+            return false;
+        }
+        mBuffers[index].state = BufferState::FREE;
+    }
+    mBufferFree.notify_one();
+    return true;
+}
+
+int DisplayPacer::waitForPresent(int64_t* vsyncNs) {
+    {
+        // Sleeps while nothing comes to present, instead of waking up for every vsync
+        std::unique_lock<std::mutex> lock(mLock);
+        mFrameQueued.wait(lock, [this] { return mStopping || mLatest >= 0; });
+        if (mStopping) {
+            return -1;
+        }
+    }
+
+    // Frames returned until then replace the one which woke us up
+    const int64_t vsync = mVsyncSource->waitForNextVsync();
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mStopping || vsync < 0 || mLatest < 0) {
+        return -1;
+    }
+
+    const int idx = mLatest;
+    mLatest = -1;
+    mBuffers[idx].state = BufferState::PRESENTING;
+    mBuffers[idx].vsyncNs = vsync;
+    *vsyncNs = vsync;
+    return idx;
+}
+
+void DisplayPacer::donePresenting(int index) {
+    const int64_t presentedNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (index < 0 || index >= static_cast<int>(mBuffers.size()) ||
+            mBuffers[index].state != BufferState::PRESENTING) {
+            return;
+        }
+
+        // The GPU may still read the frame which was on the screen until this present
+        if (mOnScreen >= 0) {
+            mBuffers[mOnScreen].state = BufferState::FREE;
+        }
+        mOnScreen = index;
+
+        Buffer& buffer = mBuffers[index];
+        buffer.state = BufferState::ON_SCREEN;
+        ++mStats.presented;
+        mPresentLatency.record((presentedNs - buffer.queuedNs) / 1000);
+
+        // A present which spills over the next vsync, whether the wakeup or the swap ran late,
+        // shows the previous frame for one more period
+        const int64_t lateNs = presentedNs - buffer.vsyncNs;
+        if (lateNs > mStats.vsyncPeriodNs) {
+            mStats.missedVsyncs += lateNs / mStats.vsyncPeriodNs;
+        }
+    }
+    mBufferFree.notify_one();
+}
+
+void DisplayPacer::cancelPresent(int index) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (index < 0 || index >= static_cast<int>(mBuffers.size()) ||
+            mBuffers[index].state != BufferState::PRESENTING) {
+            return;
+        }
+        mBuffers[index].state = BufferState::FREE;
+    }
+    mBufferFree.notify_one();
+}
+
+void DisplayPacer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mVsyncSource->stop();
+    mBufferFree.notify_all();
+    mFrameQueued.notify_all();
+}
+
+DisplayPacer::Stats DisplayPacer::getStats() {
+    std::lock_guard<std::mutex> lock(mLock);
+    Stats stats = mStats;
+    stats.presentLatency = mPresentLatency.getSummary();
+    return stats;
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
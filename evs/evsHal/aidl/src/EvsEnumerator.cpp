@@ -16,9 +16,12 @@
 
 #include "EvsEnumerator.h"
 
+#include "CapabilityCache.h"
 #include "ConfigManager.h"
 #include "EvsGlDisplay.h"
 #include "EvsV4lCamera.h"
+#include "GraphicBufferPool.h"
+#include "V4l2Replay.h"
 
 #include <aidl/android/hardware/automotive/evs/DeviceStatusType.h>
 #include <aidl/android/hardware/automotive/evs/EvsResult.h>
@@ -26,12 +29,14 @@
 #include <aidl/android/hardware/graphics/common/BufferUsage.h>
 #include <aidl/android/hardware/graphics/common/PixelFormat.h>
 #include <android-base/file.h>
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <cutils/android_filesystem_config.h>
 #include <cutils/properties.h>
 
 #include <dirent.h>
+#include <inttypes.h>
 #include <sys/inotify.h>
 
 #include <string_view>
@@ -44,6 +49,7 @@ using ::aidl::android::hardware::automotive::evs::EvsResult;
 using ::aidl::android::hardware::automotive::evs::Rotation;
 using ::aidl::android::hardware::graphics::common::BufferUsage;
 using ::android::base::EqualsIgnoreCase;
+using ::android::base::ParseUint;
 using ::android::base::StringPrintf;
 using ::android::base::WriteStringToFd;
 using ::ndk::ScopedAStatus;
@@ -57,8 +63,36 @@ constexpr std::string_view kVideoPrefix = "video";
 constexpr std::string_view kUVCPrefix = "uvcvideo";
 constexpr size_t kEventBufferSize = 512;
 constexpr uint64_t kInvalidDisplayId = std::numeric_limits<uint64_t>::max();
+
+// Buffers allocated ahead of time for each configured output stream
+constexpr char kPropPoolPrewarm[] = "vendor.evs.pool.prewarm";
+constexpr int kDefaultPoolPrewarm = 2;
 const std::set<uid_t> kAllowedUids = {AID_AUTOMOTIVE_EVS, AID_SYSTEM, AID_ROOT};
 
+// Reads the null separated member ids of a camera group from its characteristics
+std::vector<std::string> getPhysicalCameraIds(const camera_metadata_t* characteristics) {
+    std::vector<std::string> ids;
+    camera_metadata_ro_entry entry;
+    if (characteristics == nullptr ||
+        find_camera_metadata_ro_entry(characteristics, ANDROID_LOGICAL_MULTI_CAMERA_PHYSICAL_IDS,
+                                      &entry) != 0) {
+        return ids;
+    }
+
+    const char* data = reinterpret_cast<const char*>(entry.data.u8);
+    size_t start = 0;
+    for (size_t i = 0; i <= entry.count; ++i) {
+        if (i == entry.count || data[i] == '\0') {
+            if (i > start) {
+                ids.emplace_back(data + start, i - start);
+            }
+            start = i + 1;
+        }
+    }
+
+    return ids;
+}
+
 }  // namespace
 
 namespace aidl::android::hardware::automotive::evs::implementation {
@@ -120,6 +154,9 @@ void EvsEnumerator::EvsHotplugThread(std::shared_ptr<EvsEnumerator> service,
             }
 
             std::string deviceName = std::string(kDevicePath) + std::string(event->name);
+
+            // A device plugged in at this path may not be the one seen before
+            CapabilityCache::getInstance().invalidate(deviceName);
             if (event->mask & IN_CREATE) {
                 if (addCaptureDevice(deviceName)) {
                     service->notifyDeviceStatusChange(deviceName,
@@ -160,14 +197,22 @@ EvsEnumerator::EvsEnumerator(const std::shared_ptr<ICarDisplayProxy>& proxyServi
     // Enumerate existing devices
     enumerateCameras();
     mInternalDisplayId = enumerateDisplays();
+
+    // Have the buffers of the configured streams ready before the first camera opens
+    const int prewarm = property_get_int32(kPropPoolPrewarm, kDefaultPoolPrewarm);
+    if (sConfigManager && prewarm > 0) {
+        for (auto&& id : sConfigManager->getCameraIdList()) {
+            const auto& camInfo = sConfigManager->getCameraInfo(id);
+            if (camInfo) {
+                EvsV4lCamera::prewarmBuffers(*camInfo, prewarm);
+            }
+        }
+    }
 }
 
 EvsEnumerator::~EvsEnumerator() {
-    MediaControl* mc = MediaControl::getInstance();
-    if (mc) {
-        mc->clearEntities();
-        MediaControl::releaseInstance();
-    }
+    // The media graph stays with MediaControl, so the next enumerator only checks whether the
+    // topology changed and switches the links which differ
 }
 
 bool EvsEnumerator::checkPermission() {
@@ -250,6 +295,16 @@ void EvsEnumerator::enumerateCameras() {
         }
     }
 
+    closedir(dir);
+
+    // Virtual devices replaying recorded or synthetic frames, see ReplaySysCall
+    for (const auto& deviceName : ReplaySysCall::install()) {
+        ++videoCount;
+        if (addCaptureDevice(deviceName)) {
+            ++captureCount;
+        }
+    }
+
     LOG(INFO) << "Found " << captureCount << " qualified video capture devices "
               << "of " << videoCount << " checked.";
 }
@@ -395,6 +450,19 @@ ScopedAStatus EvsEnumerator::openCamera(const std::string& id, const Stream& cfg
         LOG(WARNING) << "Killing previous camera because of new caller";
         closeCamera(pActiveCamera);
     }
+    std::shared_ptr<EvsV4lLogicalCamera> pActiveGroup = pRecord->activeGroupInstance.lock();
+    if (pActiveGroup) {
+        LOG(WARNING) << "Killing previous camera because of new caller";
+        closeCamera(pActiveGroup);
+    }
+
+    // Camera groups capture from all of their member cameras in sync
+    if (sConfigManager) {
+        const auto groups = sConfigManager->getCameraGroupIdList();
+        if (std::find(groups.begin(), groups.end(), id) != groups.end()) {
+            return openLogicalCamera_impl(id, cfg, pRecord, obj);
+        }
+    }
 
     // Construct a camera instance for the caller
     if (!sConfigManager) {
@@ -414,6 +482,59 @@ ScopedAStatus EvsEnumerator::openCamera(const std::string& id, const Stream& cfg
     return ScopedAStatus::ok();
 }
 
+ScopedAStatus EvsEnumerator::openLogicalCamera_impl(const std::string& groupId, const Stream& cfg,
+                                                    CameraRecord* pRecord,
+                                                    std::shared_ptr<IEvsCamera>* obj) {
+    std::unique_ptr<ConfigManager::CameraGroupInfo>& groupInfo =
+            sConfigManager->getCameraGroupInfo(groupId);
+    const auto memberIds =
+            getPhysicalCameraIds(groupInfo ? groupInfo->characteristics : nullptr);
+    if (memberIds.empty()) {
+        LOG(ERROR) << groupId << " has no physical cameras";
+        return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::INVALID_ARG));
+    }
+
+    // The members are opened like any other camera, so opening one of them on its own takes it
+    // away from the group
+    std::vector<std::shared_ptr<EvsV4lCamera>> members;
+    for (const auto& memberId : memberIds) {
+        CameraRecord* pMemberRecord = findCameraById(memberId);
+        if (!pMemberRecord) {
+            LOG(ERROR) << memberId << " of " << groupId << " does not exist!";
+            return ScopedAStatus::fromServiceSpecificError(
+                    static_cast<int>(EvsResult::INVALID_ARG));
+        }
+
+        std::shared_ptr<EvsV4lCamera> pMember = pMemberRecord->activeInstance.lock();
+        if (pMember) {
+            LOG(WARNING) << "Killing previous camera because of new caller";
+            closeCamera(pMember);
+        }
+
+        pMember = EvsV4lCamera::Create(memberId.data(), sConfigManager->getCameraInfo(memberId),
+                                       &cfg);
+        pMemberRecord->activeInstance = pMember;
+        if (!pMember) {
+            LOG(ERROR) << "Failed to create new EvsV4lCamera object for " << memberId;
+            return ScopedAStatus::fromServiceSpecificError(
+                    static_cast<int>(EvsResult::UNDERLYING_SERVICE_ERROR));
+        }
+        members.push_back(std::move(pMember));
+    }
+
+    std::shared_ptr<EvsV4lLogicalCamera> pGroup =
+            EvsV4lLogicalCamera::Create(groupId.data(), groupInfo, std::move(members));
+    pRecord->activeGroupInstance = pGroup;
+    if (!pGroup) {
+        LOG(ERROR) << "Failed to create new EvsV4lLogicalCamera object for " << groupId;
+        return ScopedAStatus::fromServiceSpecificError(
+                static_cast<int>(EvsResult::UNDERLYING_SERVICE_ERROR));
+    }
+
+    *obj = pGroup;
+    return ScopedAStatus::ok();
+}
+
 ScopedAStatus EvsEnumerator::closeCamera(const std::shared_ptr<IEvsCamera>& cameraObj) {
     LOG(DEBUG) << __FUNCTION__;
 
@@ -591,6 +712,11 @@ void EvsEnumerator::closeCamera_impl(const std::shared_ptr<IEvsCamera>& pCamera,
     // Is the display being destroyed actually the one we think is active?
     if (!pRecord) {
         LOG(ERROR) << "Asked to close a camera whose name isn't recognized";
+    } else if (std::shared_ptr<EvsV4lLogicalCamera> pActiveGroup =
+                       pRecord->activeGroupInstance.lock();
+               pActiveGroup && pActiveGroup == pCamera) {
+        // Shutdown the camera group and its members
+        pActiveGroup->shutdown();
     } else {
         std::shared_ptr<EvsV4lCamera> pActiveCamera = pRecord->activeInstance.lock();
         if (!pActiveCamera) {
@@ -615,7 +741,7 @@ bool EvsEnumerator::qualifyCaptureDevice(const char* deviceName) {
     public:
         FileHandleWrapper(int fd) { mFd = fd; }
         ~FileHandleWrapper() {
-            if (mFd > 0) close(mFd);
+            if (mFd > 0) SysCall::getInstance()->close(mFd);
         }
         operator int() const { return mFd; }
 
@@ -623,13 +749,15 @@ bool EvsEnumerator::qualifyCaptureDevice(const char* deviceName) {
         int mFd = -1;
     };
 
-    FileHandleWrapper fd = open(deviceName, O_RDWR, 0);
+    // Replay devices are served by the system call layer, so they qualify the same way
+    SysCall* sysCall = SysCall::getInstance();
+    FileHandleWrapper fd = sysCall->open(deviceName, O_RDWR);
     if (fd < 0) {
         return false;
     }
 
     v4l2_capability caps;
-    int result = ioctl(fd, VIDIOC_QUERYCAP, &caps);
+    int result = sysCall->ioctl(fd, VIDIOC_QUERYCAP, &caps);
     if (result < 0) {
         return false;
     }
@@ -638,50 +766,49 @@ bool EvsEnumerator::qualifyCaptureDevice(const char* deviceName) {
         return false;
     }
 
-    // Enumerate the available capture formats (if any)
-    v4l2_fmtdesc formatDescription;
-    formatDescription.type = (caps.capabilities & V4L2_CAP_VIDEO_CAPTURE) ? V4L2_BUF_TYPE_VIDEO_CAPTURE : V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    // Enumerate the available capture formats (if any); the formats are kept for opening the
+    // camera afterwards
+    auto capabilities = CapabilityCache::getInstance().get(deviceName, fd, caps);
 
     bool found = false;
-    for (int i = 0; !found; ++i) {
-        formatDescription.index = i;
-        if (ioctl(fd, VIDIOC_ENUM_FMT, &formatDescription) == 0) {
-            LOG(DEBUG) << "Format: 0x" << std::hex << formatDescription.pixelformat << " Type: 0x"
-                       << std::hex << formatDescription.type
-                       << " Desc: " << formatDescription.description << " Flags: 0x" << std::hex
-                       << formatDescription.flags;
-            switch (formatDescription.pixelformat) {
-                case V4L2_PIX_FMT_YUYV:
-                case V4L2_PIX_FMT_UYVY:
-                    found = true;
-                    break;
-                case V4L2_PIX_FMT_NV21:
-                    found = true;
-                    break;
-                case V4L2_PIX_FMT_NV16:
-                    found = true;
-                    break;
-                case V4L2_PIX_FMT_YVU420:
-                    found = true;
-                    break;
-                case V4L2_PIX_FMT_RGB32:
-                    found = true;
-                    break;
+    for (auto it = capabilities->formats.begin(); !found && it != capabilities->formats.end();
+         ++it) {
+        const v4l2_fmtdesc& formatDescription = it->desc;
+        LOG(DEBUG) << "Format: 0x" << std::hex << formatDescription.pixelformat << " Type: 0x"
+                   << std::hex << formatDescription.type
+                   << " Desc: " << formatDescription.description << " Flags: 0x" << std::hex
+                   << formatDescription.flags;
+        switch (formatDescription.pixelformat) {
+            case V4L2_PIX_FMT_YUYV:
+            case V4L2_PIX_FMT_UYVY:
+                found = true;
+                break;
+            case V4L2_PIX_FMT_NV21:
+                found = true;
+                break;
+            case V4L2_PIX_FMT_NV16:
+                found = true;
+                break;
+            case V4L2_PIX_FMT_YVU420:
+                found = true;
+                break;
+            case V4L2_PIX_FMT_MJPEG:
+                found = true;
+                break;
+            case V4L2_PIX_FMT_RGB32:
+                found = true;
+                break;
 #ifdef V4L2_PIX_FMT_ARGB32  // introduced with kernel v3.17
-                case V4L2_PIX_FMT_ARGB32:
-                    found = true;
-                    break;
-                case V4L2_PIX_FMT_XRGB32:
-                    found = true;
-                    break;
+            case V4L2_PIX_FMT_ARGB32:
+                found = true;
+                break;
+            case V4L2_PIX_FMT_XRGB32:
+                found = true;
+                break;
 #endif  // V4L2_PIX_FMT_ARGB32
-                default:
-                    LOG(WARNING) << "Unsupported, " << std::hex << formatDescription.pixelformat;
-                    break;
-            }
-        } else {
-            // No more formats available.
-            break;
+            default:
+                LOG(WARNING) << "Unsupported, " << std::hex << formatDescription.pixelformat;
+                break;
         }
     }
 
@@ -800,6 +927,12 @@ binder_status_t EvsEnumerator::parseCommand(int fd, const std::vector<std::strin
         return STATUS_OK;
     } else if (EqualsIgnoreCase(command, "--dump")) {
         return cmdDump(fd, options);
+    } else if (EqualsIgnoreCase(command, "--conversion")) {
+        return cmdConversion(fd, options);
+    } else if (EqualsIgnoreCase(command, "--sync")) {
+        return cmdSync(fd, options);
+    } else if (EqualsIgnoreCase(command, "--record")) {
+        return cmdRecord(fd, options);
     } else {
         WriteStringToFd(StringPrintf("Invalid option: %s\n", command.data()), fd);
         return STATUS_INVALID_OPERATION;
@@ -808,12 +941,89 @@ binder_status_t EvsEnumerator::parseCommand(int fd, const std::vector<std::strin
 
 void EvsEnumerator::cmdHelp(int fd) {
     WriteStringToFd("--help: shows this help.\n"
-                    "--dump [id] [start|stop] [directory]\n"
-                    "\tDump camera frames to a target directory\n",
+                    "--dump [id] start [directory] [interval] [lz4]\n"
+                    "\tDump every interval-th camera frame, LZ4 compressed if asked, to a target "
+                    "directory\n"
+                    "--dump [id] stop\n"
+                    "\tStop dumping camera frames once the pending ones are written\n"
+                    "--dump [id] stats\n"
+                    "\tShow the counters of the current or last frame dump of a camera\n"
+                    "--dump [id] latency [reset]\n"
+                    "\tShow or reset per-frame latency histograms of a camera\n"
+                    "--dump pool\n"
+                    "\tShow the graphics buffers the cameras share\n"
+                    "--dump caps\n"
+                    "\tShow the cache of the capabilities of the capture devices\n"
+                    "--dump display\n"
+                    "\tShow how the frames of the open displays are paced to the vsync\n"
+                    "--conversion [id]\n"
+                    "\tShow the frame conversion latency of a camera\n"
+                    "--conversion [id] fps <rate>\n"
+                    "\tDeliver the frames of a camera at no more than rate, 0 for every frame\n"
+                    "--sync [group id]\n"
+                    "\tShow how well the frames of a camera group are synchronized\n"
+                    "--record [id] start <file>|stop\n"
+                    "\tRecord camera frames into a file a replay device can play back\n",
                     fd);
 }
 
 binder_status_t EvsEnumerator::cmdDump(int fd, const std::vector<std::string>& options) {
+    if (options.size() == 2 && EqualsIgnoreCase(options[1], "pool")) {
+        // --dump pool
+        const auto stats = GraphicBufferPool::getInstance().getStats();
+        WriteStringToFd(StringPrintf("Graphics buffer pool:\n"
+                                     "\tin use: %zu buffers, %zu KB\n"
+                                     "\tkept for reuse: %zu buffers, %zu KB\n"
+                                     "\tpeak: %zu KB, high watermark: %zu KB\n"
+                                     "\tallocated %" PRIu64 " (%" PRIu64
+                                     " ahead of time), reused %" PRIu64 ", freed %" PRIu64 "\n",
+                                     stats.liveBuffers, stats.liveBytes / 1024, stats.idleBuffers,
+                                     stats.idleBytes / 1024, stats.peakBytes / 1024,
+                                     stats.highWatermarkBytes / 1024, stats.allocations,
+                                     stats.prewarmed, stats.reuses, stats.frees),
+                        fd);
+        return STATUS_OK;
+    }
+
+    if (options.size() == 2 && EqualsIgnoreCase(options[1], "caps")) {
+        // --dump caps
+        const auto stats = CapabilityCache::getInstance().getStats();
+        WriteStringToFd(StringPrintf("Device capability cache:\n"
+                                     "\t%zu kinds of devices, %zu loaded at start\n"
+                                     "\thits %" PRIu64 ", misses %" PRIu64
+                                     " (%.1f ms enumerating), invalidations %" PRIu64 "\n",
+                                     stats.entries, stats.loadedEntries, stats.hits, stats.misses,
+                                     stats.enumerationMs, stats.invalidations),
+                        fd);
+        return STATUS_OK;
+    }
+
+    if (options.size() == 2 && EqualsIgnoreCase(options[1], "display")) {
+        // --dump display
+        std::string output;
+        for (const auto& [id, info] : mutableActiveDisplays().getAllDisplays()) {
+            auto display = info.displayWeak.lock();
+            if (!display) {
+                continue;
+            }
+
+            const auto stats = display->getPresentStats();
+            const auto& latency = stats.presentLatency;
+            output += StringPrintf("Display %d: vsync every %.2f ms\n"
+                                   "\tqueued %" PRIu64 ", presented %" PRIu64 ", dropped %" PRIu64
+                                   ", missed vsyncs %" PRIu64 "\n"
+                                   "\tpresent latency in us: min %" PRId64 " mean %" PRId64
+                                   " p50 %" PRId64 " p90 %" PRId64 " p99 %" PRId64
+                                   " max %" PRId64 "\n",
+                                   id, stats.vsyncPeriodNs / 1000000.0, stats.queued,
+                                   stats.presented, stats.dropped, stats.missedVsyncs,
+                                   latency.minUs, latency.meanUs, latency.p50Us, latency.p90Us,
+                                   latency.p99Us, latency.maxUs);
+        }
+        WriteStringToFd(output.empty() ? "No display is open\n" : output, fd);
+        return STATUS_OK;
+    }
+
     if (options.size() < 3) {
         WriteStringToFd("Necessary argument is missing\n", fd);
         cmdHelp(fd);
@@ -842,7 +1052,19 @@ binder_status_t EvsEnumerator::cmdDump(int fd, const std::vector<std::string>& o
         }
 
         const std::string path = options[3];
-        auto ret = device->startDumpFrames(path);
+        unsigned interval = 1;
+        bool compress = false;
+        for (size_t i = 4; i < options.size(); ++i) {
+            if (EqualsIgnoreCase(options[i], "lz4")) {
+                compress = true;
+            } else if (!ParseUint(options[i], &interval) || interval < 1) {
+                WriteStringToFd(StringPrintf("Invalid argument: %s\n", options[i].data()), fd);
+                cmdHelp(fd);
+                return STATUS_BAD_VALUE;
+            }
+        }
+
+        auto ret = device->startDumpFrames(path, interval, compress);
         if (!ret.ok()) {
             WriteStringToFd(StringPrintf("Failed to start storing frames: %s\n",
                                          ret.error().message().data()),
@@ -858,6 +1080,189 @@ binder_status_t EvsEnumerator::cmdDump(int fd, const std::vector<std::string>& o
                             fd);
             return STATUS_FAILED_TRANSACTION;
         }
+    } else if (EqualsIgnoreCase(command, "stats")) {
+        // --dump [device id] stats
+        auto ret = device->getDumpStats();
+        if (!ret.ok()) {
+            WriteStringToFd(StringPrintf("%s\n", ret.error().message().data()), fd);
+            return STATUS_INVALID_OPERATION;
+        }
+
+        const auto& stats = *ret;
+        WriteStringToFd(StringPrintf("%s: frame dump\n"
+                                     "\tframes %" PRIu64 ", sampled %" PRIu64 ", written %" PRIu64
+                                     ", dropped %" PRIu64 ", failed %" PRIu64 "\n"
+                                     "\t%" PRIu64 " KB written into %" PRIu64
+                                     " KB of files in %.1f ms\n"
+                                     "\t%zu slots, at most %zu waiting\n",
+                                     options[1].data(), stats.frames, stats.sampled,
+                                     stats.written, stats.dropped, stats.failed,
+                                     stats.bytes / 1024, stats.fileBytes / 1024, stats.writeMs,
+                                     stats.slots, stats.maxQueued),
+                        fd);
+    } else if (EqualsIgnoreCase(command, "latency")) {
+        if (options.size() > 3 && EqualsIgnoreCase(options[3], "reset")) {
+            // --dump [device id] latency reset
+            device->resetFrameLatency();
+            return STATUS_OK;
+        }
+
+        // --dump [device id] latency
+        const auto latency = device->getFrameLatency();
+        const std::pair<const char*, const LatencyHistogram::Summary&> stages[] = {
+                {"driver to DQBUF", latency.capture},
+                {"DQBUF to converted", latency.conversion},
+                {"converted to delivered", latency.delivery},
+                {"held by client", latency.clientHold},
+        };
+        std::string output = StringPrintf("%s: latency in us\n", options[1].data());
+        for (const auto& [name, summary] : stages) {
+            output += StringPrintf("\t%-24s count %8" PRIu64 " min %6" PRId64 " mean %6" PRId64
+                                   " p50 %6" PRId64 " p90 %6" PRId64 " p99 %6" PRId64
+                                   " p99.9 %6" PRId64 " max %6" PRId64 "\n",
+                                   name, summary.count, summary.minUs, summary.meanUs,
+                                   summary.p50Us, summary.p90Us, summary.p99Us, summary.p999Us,
+                                   summary.maxUs);
+        }
+        WriteStringToFd(output, fd);
+    } else {
+        WriteStringToFd(StringPrintf("Unknown command: %s", command.data()), fd);
+        cmdHelp(fd);
+    }
+
+    return STATUS_OK;
+}
+
+binder_status_t EvsEnumerator::cmdConversion(int fd, const std::vector<std::string>& options) {
+    if (options.size() < 2) {
+        WriteStringToFd("Necessary argument is missing\n", fd);
+        cmdHelp(fd);
+        return STATUS_BAD_VALUE;
+    }
+
+    EvsEnumerator::CameraRecord* pRecord = findCameraById(options[1]);
+    if (pRecord == nullptr) {
+        WriteStringToFd(StringPrintf("%s is not active\n", options[1].data()), fd);
+        return STATUS_BAD_VALUE;
+    }
+
+    auto device = pRecord->activeInstance.lock();
+    if (device == nullptr) {
+        WriteStringToFd(StringPrintf("%s seems dead\n", options[1].data()), fd);
+        return STATUS_DEAD_OBJECT;
+    }
+
+    if (options.size() > 2) {
+        // --conversion [device id] fps [rate]
+        unsigned fps = 0;
+        if (options.size() != 4 || !EqualsIgnoreCase(options[2], "fps") ||
+            !ParseUint(options[3], &fps)) {
+            WriteStringToFd("Invalid arguments\n", fd);
+            cmdHelp(fd);
+            return STATUS_BAD_VALUE;
+        }
+
+        device->setTargetFrameRate(fps);
+        return STATUS_OK;
+    }
+
+    // --conversion [device id]
+    const auto stats = device->getConversionStats();
+    const int64_t averageUs = stats.frames > 0 ? stats.totalUs / static_cast<int64_t>(stats.frames)
+                                               : 0;
+    WriteStringToFd(StringPrintf("%s: %" PRIu64 " frames converted, %" PRIu64
+                                 " split across helper threads\n"
+                                 "\tlatency last %" PRId64 " us, average %" PRId64
+                                 " us, max %" PRId64 " us\n",
+                                 options[1].data(), stats.frames, stats.parallelFrames,
+                                 stats.lastUs, averageUs, stats.maxUs),
+                    fd);
+    const unsigned fps = device->getTargetFrameRate();
+    WriteStringToFd(StringPrintf("\toutput %ux%u, %s, %" PRIu64 " frames skipped\n",
+                                 device->getOutputWidth(), device->getOutputHeight(),
+                                 fps > 0 ? StringPrintf("at most %u fps", fps).data()
+                                         : "every frame",
+                                 stats.skippedFrames),
+                    fd);
+    if (stats.scaledFrames > 0 || stats.failedFrames > 0) {
+        WriteStringToFd(StringPrintf("\tMJPEG: %" PRIu64 " frames decoded at a reduced scale, "
+                                     "%" PRIu64 " corrupt\n",
+                                     stats.scaledFrames, stats.failedFrames),
+                        fd);
+    }
+
+    return STATUS_OK;
+}
+
+binder_status_t EvsEnumerator::cmdSync(int fd, const std::vector<std::string>& options) {
+    if (options.size() < 2) {
+        WriteStringToFd("Necessary argument is missing\n", fd);
+        cmdHelp(fd);
+        return STATUS_BAD_VALUE;
+    }
+
+    EvsEnumerator::CameraRecord* pRecord = findCameraById(options[1]);
+    if (pRecord == nullptr) {
+        WriteStringToFd(StringPrintf("%s is not active\n", options[1].data()), fd);
+        return STATUS_BAD_VALUE;
+    }
+
+    auto device = pRecord->activeGroupInstance.lock();
+    if (device == nullptr) {
+        WriteStringToFd(StringPrintf("%s is not an open camera group\n", options[1].data()), fd);
+        return STATUS_DEAD_OBJECT;
+    }
+
+    // --sync [group id]
+    const auto stats = device->getSyncStats();
+    WriteStringToFd(StringPrintf("%s: %" PRIu64 " frame sets, %" PRIu64
+                                 " frames dropped without a partner\n"
+                                 "\tskew last %" PRId64 " us, max %" PRId64 " us\n",
+                                 options[1].data(), stats.frameSets, stats.droppedFrames,
+                                 stats.lastSkewNs / 1000, stats.maxSkewNs / 1000),
+                    fd);
+
+    return STATUS_OK;
+}
+
+binder_status_t EvsEnumerator::cmdRecord(int fd, const std::vector<std::string>& options) {
+    if (options.size() < 3) {
+        WriteStringToFd("Necessary argument is missing\n", fd);
+        cmdHelp(fd);
+        return STATUS_BAD_VALUE;
+    }
+
+    EvsEnumerator::CameraRecord* pRecord = findCameraById(options[1]);
+    if (pRecord == nullptr) {
+        WriteStringToFd(StringPrintf("%s is not active\n", options[1].data()), fd);
+        return STATUS_BAD_VALUE;
+    }
+
+    auto device = pRecord->activeInstance.lock();
+    if (device == nullptr) {
+        WriteStringToFd(StringPrintf("%s seems dead\n", options[1].data()), fd);
+        return STATUS_DEAD_OBJECT;
+    }
+
+    const std::string command = options[2];
+    if (EqualsIgnoreCase(command, "start")) {
+        // --record [device id] start [file]
+        if (options.size() < 4) {
+            WriteStringToFd("Necessary argument is missing\n", fd);
+            cmdHelp(fd);
+            return STATUS_BAD_VALUE;
+        }
+
+        auto ret = device->startRecording(options[3]);
+        if (!ret.ok()) {
+            WriteStringToFd(StringPrintf("Failed to start recording: %s\n",
+                                         ret.error().message().data()),
+                            fd);
+            return STATUS_FAILED_TRANSACTION;
+        }
+    } else if (EqualsIgnoreCase(command, "stop")) {
+        // --record [device id] stop
+        device->stopRecording();
     } else {
         WriteStringToFd(StringPrintf("Unknown command: %s", command.data()), fd);
         cmdHelp(fd);
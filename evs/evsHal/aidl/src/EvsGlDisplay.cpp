@@ -38,6 +38,7 @@ using ::aidl::android::hardware::automotive::evs::DisplayDesc;
 using ::aidl::android::hardware::automotive::evs::DisplayState;
 using ::aidl::android::hardware::automotive::evs::EvsResult;
 using ::aidl::android::hardware::graphics::common::BufferUsage;
+using ::aidl::android::hardware::graphics::common::HardwareBufferDescription;
 using ::aidl::android::hardware::graphics::common::PixelFormat;
 using ::android::base::ScopedLockAssertion;
 using ::ndk::ScopedAStatus;
@@ -56,7 +57,9 @@ namespace aidl::android::hardware::automotive::evs::implementation {
 
 EvsGlDisplay::EvsGlDisplay(const std::shared_ptr<ICarDisplayProxy>& pDisplayProxy,
                            uint64_t displayId) :
-      mDisplayId(displayId), mDisplayProxy(pDisplayProxy) {
+      mDisplayId(displayId),
+      mDisplayProxy(pDisplayProxy),
+      mPacer(kNumTargetBuffers, std::make_unique<TimerVsyncSource>()) {
     LOG(DEBUG) << "EvsGlDisplay instantiated";
 
     // Set up our self description
@@ -72,6 +75,24 @@ EvsGlDisplay::EvsGlDisplay(const std::shared_ptr<ICarDisplayProxy>& pDisplayProx
     mRenderThread = std::thread([this]() { renderFrames(); });
 }
 
+EvsGlDisplay::EvsGlDisplay(unsigned width, unsigned height,
+                           std::unique_ptr<VsyncSource> vsyncSource) :
+      mDisplayId(0),
+      mHeadlessWidth(width),
+      mHeadlessHeight(height),
+      mPacer(kNumTargetBuffers, std::move(vsyncSource)) {
+    LOG(DEBUG) << "EvsGlDisplay instantiated off screen";
+
+    mInfo.id = "headless";
+    mInfo.vendorFlags = 3870;
+
+    {
+        std::lock_guard lock(mLock);
+        mState = RUN;
+    }
+    mRenderThread = std::thread([this]() { renderFrames(); });
+}
+
 EvsGlDisplay::~EvsGlDisplay() {
     LOG(DEBUG) << "EvsGlDisplay being destroyed";
     forceShutdown();
@@ -85,14 +106,9 @@ void EvsGlDisplay::forceShutdown() {
     {
         std::lock_guard lock(mLock);
 
-        // If the buffer isn't being held by a remote client, release it now as an
-        // optimization to release the resources more quickly than the destructor might
-        // get called.
-        if (mBuffer.handle != nullptr) {
-            // Report if we're going away while a buffer is outstanding
-            if (mBufferBusy || mState == RUN) {
-                LOG(ERROR) << "EvsGlDisplay going down while client is holding a buffer";
-            }
+        // Stop the rendering thread now as an optimization to release the buffers more
+        // quickly than the destructor might get called.
+        if (mState == RUN) {
             mState = STOPPING;
         }
 
@@ -100,7 +116,8 @@ void EvsGlDisplay::forceShutdown() {
         // is going to own the display now.
         mRequestedState = DisplayState::DEAD;
     }
-    mBufferReadyToRender.notify_all();
+    mPacer.stop();
+    mBuffersReadyToUse.notify_all();
 
     if (mRenderThread.joinable()) {
         mRenderThread.join();
@@ -116,17 +133,20 @@ bool EvsGlDisplay::initializeGlContextLocked() {
     // NOTE:  This will cause the display to become "VISIBLE" before a frame is actually
     // returned, which is contrary to the spec and will likely result in a black frame being
     // (briefly) shown.
-    if (!mGlWrapper.initialize(mDisplayProxy, mDisplayId)) {
+    const bool initialized = mDisplayProxy
+            ? mGlWrapper.initialize(mDisplayProxy, mDisplayId)
+            : mGlWrapper.initializeHeadless(mHeadlessWidth, mHeadlessHeight);
+    if (!initialized) {
         // Report the failure
         LOG(ERROR) << "Failed to initialize GL display";
         return false;
     }
 
-    // Assemble the buffer description we'll use for our render target
+    // Assemble the buffer description we'll use for our render targets
     static_assert(::aidl::android::hardware::graphics::common::PixelFormat::RGBA_8888 ==
                   static_cast<::aidl::android::hardware::graphics::common::PixelFormat>(
                           HAL_PIXEL_FORMAT_RGBA_8888));
-    mBuffer.description = {
+    const HardwareBufferDescription description = {
             .width = static_cast<int>(mGlWrapper.getWidth()),
             .height = static_cast<int>(mGlWrapper.getHeight()),
             .layers = 1,
@@ -140,37 +160,56 @@ bool EvsGlDisplay::initializeGlContextLocked() {
     };
 
     ::android::GraphicBufferAllocator& alloc(::android::GraphicBufferAllocator::get());
-    uint32_t stride = static_cast<uint32_t>(mBuffer.description.stride);
-    buffer_handle_t handle = nullptr;
-    const ::android::status_t result =
-            alloc.allocate(mBuffer.description.width, mBuffer.description.height,
-                           static_cast<::android::PixelFormat>(mBuffer.description.format),
-                           mBuffer.description.layers,
-                           static_cast<uint64_t>(mBuffer.description.usage), &handle, &stride,
-                           /* requestorName= */ "EvsGlDisplay");
-    mBuffer.description.stride = stride;
-    mBuffer.fingerprint = generateFingerPrint(mBuffer.handle);
-    if (result != ::android::NO_ERROR) {
-        LOG(ERROR) << "Error " << result << " allocating " << mBuffer.description.width << " x "
-                   << mBuffer.description.height << " graphics buffer.";
-        mGlWrapper.shutdown();
-        return false;
-    }
+    mBuffers.resize(kNumTargetBuffers);
+    for (auto& buffer : mBuffers) {
+        buffer.description = description;
+        uint32_t stride = static_cast<uint32_t>(buffer.description.stride);
+        buffer_handle_t handle = nullptr;
+        const ::android::status_t result =
+                alloc.allocate(buffer.description.width, buffer.description.height,
+                               static_cast<::android::PixelFormat>(buffer.description.format),
+                               buffer.description.layers,
+                               static_cast<uint64_t>(buffer.description.usage), &handle, &stride,
+                               /* requestorName= */ "EvsGlDisplay");
+        if (result != ::android::NO_ERROR) {
+            LOG(ERROR) << "Error " << result << " allocating " << buffer.description.width
+                       << " x " << buffer.description.height << " graphics buffer.";
+            releaseBuffers();
+            mGlWrapper.shutdown();
+            return false;
+        }
 
-    mBuffer.handle = handle;
-    if (mBuffer.handle == nullptr) {
-        LOG(ERROR) << "We didn't get a buffer handle back from the allocator";
-        mGlWrapper.shutdown();
-        return false;
+        if (handle == nullptr) {
+            LOG(ERROR) << "We didn't get a buffer handle back from the allocator";
+            releaseBuffers();
+            mGlWrapper.shutdown();
+            return false;
+        }
+
+        // The fingerprint identifies the buffer to the client and in the image cache of GlWrapper
+        buffer.description.stride = stride;
+        buffer.handle = handle;
+        buffer.fingerprint = generateFingerPrint(handle);
+        LOG(DEBUG) << "Allocated new buffer " << buffer.handle << " with stride "
+                   << buffer.description.stride;
     }
 
-    LOG(DEBUG) << "Allocated new buffer " << mBuffer.handle << " with stride "
-               << mBuffer.description.stride;
     return true;
 }
 
+void EvsGlDisplay::releaseBuffers() {
+    ::android::GraphicBufferAllocator& alloc(::android::GraphicBufferAllocator::get());
+    for (auto& buffer : mBuffers) {
+        if (buffer.handle != nullptr) {
+            alloc.free(buffer.handle);
+        }
+    }
+    mBuffers.clear();
+}
+
 /**
- * This method runs in a separate thread and renders the contents of the buffer.
+ * This method runs in a separate thread and presents the latest frame the client
+ * returned on every vsync.
  */
 void EvsGlDisplay::renderFrames() {
     {
@@ -178,57 +217,52 @@ void EvsGlDisplay::renderFrames() {
 
         if (!initializeGlContextLocked()) {
             LOG(ERROR) << "Failed to initialize GL context";
+            mPacer.stop();
             return;
         }
 
-        // Display buffer is ready.
-        mBufferBusy = false;
+        // Display buffers are ready.
+        mBuffersReady = true;
     }
-    mBufferReadyToUse.notify_all();
+    mBuffersReadyToUse.notify_all();
 
     while (true) {
-        {
-            std::unique_lock lock(mLock);
-            ScopedLockAssertion lock_assertion(mLock);
-            mBufferReadyToRender.wait(lock, [this]() REQUIRES(mLock) {
-                return mBufferReady || mState != RUN;
-            });
-            if (mState != RUN) {
-                LOG(DEBUG) << "A rendering thread is stopping";
-                break;
-            }
-            mBufferReady = false;
+        // Others only read the buffer records, and this thread releases them after the loop
+        int64_t vsyncNs = 0;
+        const int idx = mPacer.waitForPresent(&vsyncNs);
+        if (idx < 0) {
+            LOG(DEBUG) << "A rendering thread is stopping";
+            break;
         }
 
         // Update the texture contents with the provided data
-        if (!mGlWrapper.updateImageTexture(mBuffer.handle, mBuffer.description)) {
+        const BufferRecord& buffer = mBuffers[idx];
+        if (!mGlWrapper.updateImageTexture(buffer.fingerprint, buffer.handle,
+                                           buffer.description)) {
             LOG(WARNING) << "Failed to update the image texture";
+            mPacer.cancelPresent(idx);
             continue;
         }
 
         // Put the image on the screen
         mGlWrapper.renderImageToScreen();
+        mPacer.donePresenting(idx);
         if (!debugFirstFrameDisplayed) {
             LOG(DEBUG) << "EvsFirstFrameDisplayTiming start time: " << ::android::elapsedRealtime()
                        << " ms.";
             debugFirstFrameDisplayed = true;
         }
-
-        // Mark current frame is consumed.
-        {
-            std::lock_guard lock(mLock);
-            mBufferBusy = false;
-        }
-        mBufferReadyToUse.notify_all();
-        mBufferDone.notify_all();
     }
 
     LOG(DEBUG) << "A rendering thread is stopped.";
 
-    // Drop the graphics buffer we've been using
-    ::android::GraphicBufferAllocator& alloc(::android::GraphicBufferAllocator::get());
-    alloc.free(mBuffer.handle);
-    mBuffer.handle = nullptr;
+    // Drop the graphics buffers we've been using
+    mGlWrapper.releaseImageCache();
+    {
+        std::lock_guard lock(mLock);
+        mBuffersReady = false;
+        releaseBuffers();
+    }
 
     mGlWrapper.hideWindow(mDisplayProxy, mDisplayId);
     mGlWrapper.shutdown();
@@ -242,6 +276,15 @@ void EvsGlDisplay::renderFrames() {
  * See the description of the DisplayDesc structure for details.
  */
 ScopedAStatus EvsGlDisplay::getDisplayInfo(DisplayDesc* _aidl_return) {
+    if (mHeadlessWidth > 0) {
+        _aidl_return->width = mHeadlessWidth;
+        _aidl_return->height = mHeadlessHeight;
+        _aidl_return->orientation = Rotation::ROTATION_0;
+        _aidl_return->id = mInfo.id;
+        _aidl_return->vendorFlags = mInfo.vendorFlags;
+        return ::ndk::ScopedAStatus::ok();
+    }
+
     if (!mDisplayProxy) {
         return ::ndk::ScopedAStatus::fromServiceSpecificError(
                 static_cast<int>(EvsResult::UNDERLYING_SERVICE_ERROR));
@@ -326,45 +369,58 @@ ScopedAStatus EvsGlDisplay::getDisplayState(DisplayState* _aidl_return) {
  */
 ScopedAStatus EvsGlDisplay::getTargetBuffer(BufferDesc* _aidl_return) {
     LOG(DEBUG) << __FUNCTION__;
-    std::unique_lock lock(mLock);
-    ScopedLockAssertion lock_assertion(mLock);
-    if (mRequestedState == DisplayState::DEAD) {
-        LOG(ERROR) << "Rejecting buffer request from object that lost ownership of the display.";
-        return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::OWNERSHIP_LOST));
-    }
+    {
+        std::unique_lock lock(mLock);
+        ScopedLockAssertion lock_assertion(mLock);
+        if (mRequestedState == DisplayState::DEAD) {
+            LOG(ERROR) << "Rejecting buffer request from object that lost ownership of the "
+                          "display.";
+            return ScopedAStatus::fromServiceSpecificError(
+                    static_cast<int>(EvsResult::OWNERSHIP_LOST));
+        }
 
-    // If we don't already have a buffer, allocate one now
-    // mBuffer.memHandle is a type of buffer_handle_t, which is equal to
-    // native_handle_t*.
-    mBufferReadyToUse.wait(lock, [this]() REQUIRES(mLock) {
-        return !mBufferBusy;
-    });
+        // The rendering thread allocates the buffers when it starts
+        if (!mBuffersReadyToUse.wait_for(lock, kTimeout, [this]() REQUIRES(mLock) {
+                return mBuffersReady || mState != RUN;
+            }) ||
+            !mBuffersReady) {
+            LOG(ERROR) << "Display buffers are not allocated.";
+            return ScopedAStatus::fromServiceSpecificError(
+                    static_cast<int>(EvsResult::BUFFER_NOT_AVAILABLE));
+        }
+    }
 
-    // Do we have a frame available?
-    if (mBufferBusy) {
+    // A buffer becomes free at the latest when the frame on the screen is replaced
+    const int idx = mPacer.acquireBuffer(kTimeout);
+    if (idx < 0) {
         // This means either we have a 2nd client trying to compete for buffers
         // (an unsupported mode of operation) or else the client hasn't returned
-        // a previously issued buffer yet (they're behaving badly).
+        // previously issued buffers yet (they're behaving badly).
         // NOTE:  We have to make the callback even if we have nothing to provide
         LOG(ERROR) << "getTargetBuffer called while no buffers available.";
         return ScopedAStatus::fromServiceSpecificError(
                 static_cast<int>(EvsResult::BUFFER_NOT_AVAILABLE));
     }
 
-    // Mark our buffer as busy
-    mBufferBusy = true;
-
     // Send the buffer to the client
-    LOG(VERBOSE) << "Providing display buffer handle " << mBuffer.handle;
+    std::lock_guard lock(mLock);
+    if (!mBuffersReady) {
+        // The display is going down
+        return ScopedAStatus::fromServiceSpecificError(
+                static_cast<int>(EvsResult::BUFFER_NOT_AVAILABLE));
+    }
+
+    const BufferRecord& buffer = mBuffers[idx];
+    LOG(VERBOSE) << "Providing display buffer handle " << buffer.handle;
 
     BufferDesc bufferDescToSend = {
             .buffer =
                     {
-                            .handle = std::move(::android::dupToAidl(mBuffer.handle)),
-                            .description = mBuffer.description,
+                            .handle = std::move(::android::dupToAidl(buffer.handle)),
+                            .description = buffer.description,
                     },
             .pixelSizeBytes = 4,  // RGBA_8888 is 4-byte-per-pixel format
-            .bufferId = mBuffer.fingerprint,
+            .bufferId = buffer.fingerprint,
     };
     *_aidl_return = std::move(bufferDescToSend);
 
@@ -374,25 +430,26 @@ ScopedAStatus EvsGlDisplay::getTargetBuffer(BufferDesc* _aidl_return) {
 /**
  * This call tells the display that the buffer is ready for display.
  * The buffer is no longer valid for use by the client after this call.
+ * The frame is presented on the next vsync unless a newer one comes before it,
+ * so this does not wait for it to be rendered.
  */
 ScopedAStatus EvsGlDisplay::returnTargetBufferForDisplay(const BufferDesc& buffer) {
     LOG(VERBOSE) << __FUNCTION__;
-    std::unique_lock lock(mLock);
-    ScopedLockAssertion lock_assertion(mLock);
+    std::lock_guard lock(mLock);
 
     // Nobody should call us with a null handle
     if (buffer.buffer.handle.fds.size() < 1) {
         LOG(ERROR) << __FUNCTION__ << " called without a valid buffer handle.";
         return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::INVALID_ARG));
     }
-    if (buffer.bufferId != mBuffer.fingerprint) {
+    const auto it = std::find_if(mBuffers.begin(), mBuffers.end(), [&buffer](const auto& record) {
+        return record.fingerprint == buffer.bufferId;
+    });
+    if (!mBuffersReady || it == mBuffers.end()) {
         LOG(ERROR) << "Got an unrecognized frame returned.";
         return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::INVALID_ARG));
     }
-    if (!mBufferBusy) {
-        LOG(ERROR) << "A frame was returned with no outstanding frames.";
-        return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::INVALID_ARG));
-    }
+    const int idx = it - mBuffers.begin();
 
     // If we've been displaced by another owner of the display, then we can't do anything else
     if (mRequestedState == DisplayState::DEAD) {
@@ -409,16 +466,17 @@ ScopedAStatus EvsGlDisplay::returnTargetBufferForDisplay(const BufferDesc& buffe
     if (mRequestedState != DisplayState::VISIBLE) {
         // Not sure why a client would send frames back when we're not visible.
         LOG(WARNING) << "Got a frame returned while not visible - ignoring.";
+        if (!mPacer.cancelBuffer(idx)) {
+            LOG(ERROR) << "A frame was returned with no outstanding frames.";
+            return ScopedAStatus::fromServiceSpecificError(
+                    static_cast<int>(EvsResult::INVALID_ARG));
+        }
         return ScopedAStatus::ok();
     }
-    mBufferReady = true;
-    mBufferReadyToRender.notify_all();
 
-    if (!mBufferDone.wait_for(lock, kTimeout, [this]() REQUIRES(mLock) {
-            return !mBufferBusy;
-        })) {
-        return ScopedAStatus::fromServiceSpecificError(
-                static_cast<int>(EvsResult::UNDERLYING_SERVICE_ERROR));
+    if (!mPacer.queueBuffer(idx)) {
+        LOG(ERROR) << "A frame was returned with no outstanding frames.";
+        return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::INVALID_ARG));
     }
 
     return ScopedAStatus::ok();
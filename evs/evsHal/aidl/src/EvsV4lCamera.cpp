@@ -16,6 +16,7 @@
 
 #include "EvsV4lCamera.h"
 
+#include "GraphicBufferPool.h"
 #include "bufferCopy.h"
 
 #include <aidl/android/hardware/graphics/common/HardwareBufferDescription.h>
@@ -23,15 +24,22 @@
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 #include <android/hardware_buffer.h>
-#include <ui/GraphicBufferAllocator.h>
+#include <cutils/native_handle.h>
+#include <cutils/properties.h>
 #include <ui/GraphicBufferMapper.h>
 #include <utils/SystemClock.h>
+#include <utils/Timers.h>
 
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <chrono>
+#include <string_view>
+
 namespace {
 
+using ::aidl::android::hardware::automotive::evs::BufferDesc;
 using ::aidl::android::hardware::graphics::common::BufferUsage;
 using ::aidl::android::hardware::graphics::common::HardwareBufferDescription;
 using ::android::base::Error;
@@ -45,16 +53,52 @@ std::array<int32_t, 2> kDefaultResolution = {WIDTH, HEIGHT};
 // Safeguards against unreasonable resource consumption and provides a testable limit
 constexpr unsigned kMaxBuffersInFlight = 100;
 
+// Buffers the driver holds on to while frames are captured without copies
+constexpr unsigned kZeroCopyQueueDepth = 3;
+
+// How frames are shared with the driver: auto, dmabuf, expbuf or mmap (always copy)
+constexpr char kPropZeroCopyMode[] = "vendor.evs.v4l2.memory";
+
+// How a paused stream is held: discard (keep capturing and drop frames) or streamoff
+constexpr char kPropPauseMode[] = "vendor.evs.pause.mode";
+
+// How we expect to use the gralloc buffers we'll exchange with our client
+constexpr uint64_t kBufferUsage =
+        GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+// Microseconds passed since a CLOCK_MONOTONIC time
+int64_t getElapsedUs(int64_t sinceNs) {
+    return (systemTime(SYSTEM_TIME_MONOTONIC) - sinceNs) / 1000;
+}
+
+using FillFunction = std::function<void(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                                        unsigned imgStride, unsigned rowBegin, unsigned rowEnd)>;
+
+// Binds the size of the captured frames to one of the scaled fill functions of bufferCopy.h
+FillFunction bindSourceSize(void (*fill)(const BufferDesc&, uint8_t*, void*, unsigned, unsigned,
+                                         unsigned, unsigned, unsigned),
+                            unsigned srcWidth, unsigned srcHeight) {
+    return [fill, srcWidth, srcHeight](const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                                       unsigned imgStride, unsigned rowBegin, unsigned rowEnd) {
+        fill(tgtBuff, tgt, imgData, imgStride, rowBegin, rowEnd, srcWidth, srcHeight);
+    };
+}
+
 }  // namespace
 
 namespace aidl::android::hardware::automotive::evs::implementation {
 
 EvsV4lCamera::EvsV4lCamera(const char* deviceName,
                            std::unique_ptr<ConfigManager::CameraInfo>& camInfo) :
-      mFramesAllowed(0), mFramesInUse(0), mCameraInfo(camInfo) {
+      mBuffers(std::make_unique<BufferSlot[]>(kMaxBuffersInFlight)),
+      mFreeSlots(kMaxBuffersInFlight),
+      mFramesAllowed(0),
+      mFramesInUse(0),
+      mCameraInfo(camInfo) {
     LOG(DEBUG) << "EvsV4lCamera instantiated";
 
     mDescription.id = deviceName;
+    mConversionAffinity = ConversionAffinity::fromProperties(deviceName);
     if (camInfo) {
         uint8_t* ptr = reinterpret_cast<uint8_t*>(camInfo->characteristics);
         const size_t len = get_camera_metadata_size(camInfo->characteristics);
@@ -64,8 +108,7 @@ EvsV4lCamera::EvsV4lCamera(const char* deviceName,
     // Default output buffer format.
     mFormat = HAL_PIXEL_FORMAT_RGBA_8888;
 
-    // How we expect to use the gralloc buffers we'll exchange with our client
-    mUsage = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_OFTEN;
+    mUsage = kBufferUsage;
 }
 
 EvsV4lCamera::~EvsV4lCamera() {
@@ -87,17 +130,27 @@ void EvsV4lCamera::shutdown() {
     mVideo.close();
 
     // Drop all the graphics buffers we've been using
-    if (mBuffers.size() > 0) {
-        ::android::GraphicBufferAllocator& alloc(::android::GraphicBufferAllocator::get());
-        for (auto&& rec : mBuffers) {
-            if (rec.inUse) {
-                LOG(WARNING) << "Releasing buffer despite remote ownership";
-            }
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    uint32_t idx;
+    while (mFreeSlots.pop(&idx)) {
+    }
+
+    GraphicBufferPool& pool = GraphicBufferPool::getInstance();
+    for (unsigned i = 0; i < kMaxBuffersInFlight; ++i) {
+        BufferSlot& slot = mBuffers[i];
+        if (slot.handle == nullptr) {
+            continue;
         }
-        mBuffers.clear();
+        if (slot.inUse) {
+            LOG(WARNING) << "Releasing buffer despite remote ownership";
+            slot.inUse = false;
+        }
+        pool.release(slot.handle);
+        slot.handle = nullptr;
     }
+    mFramesAllowed = 0;
+    mFramesInUse = 0;
+    mSlotsToRelease = 0;
 }
 
 // Methods from ::aidl::android::hardware::automotive::evs::IEvsCamera follow.
@@ -136,7 +189,7 @@ ScopedAStatus EvsV4lCamera::setMaxFramesInFlight(int32_t bufferCount) {
 
 ScopedAStatus EvsV4lCamera::startVideoStream(const std::shared_ptr<IEvsCameraStream>& client) {
     LOG(DEBUG) << __FUNCTION__;
-    std::lock_guard<std::mutex> lock(mAccessLock);
+    std::unique_lock<std::mutex> lock(mAccessLock);
 
     // If we've been displaced by another owner of the camera, then we can't do anything else
     if (!mVideo.isOpen()) {
@@ -165,14 +218,30 @@ ScopedAStatus EvsV4lCamera::startVideoStream(const std::shared_ptr<IEvsCameraStr
     LOG(INFO) << "Configuring to accept " << std::string((char*)&videoSrcFormat)
               << " camera data and convert to " << std::hex << mFormat;
 
+    // MJPEG frames are decoded straight into any of the output formats.  Frames captured at
+    // another size than the output are scaled while they are converted.
+    mDecodeMjpeg = videoSrcFormat == V4L2_PIX_FMT_MJPEG;
+    const bool scaled = isScaled();
+    const unsigned srcWidth = mVideo.getWidth();
+    const unsigned srcHeight = mVideo.getHeight();
+    if (scaled) {
+        LOG(INFO) << "Scaling " << srcWidth << "x" << srcHeight << " frames to " << mOutputWidth
+                  << "x" << mOutputHeight;
+    }
     switch (mFormat) {
         case HAL_PIXEL_FORMAT_YCRCB_420_SP:
             switch (videoSrcFormat) {
                 case V4L2_PIX_FMT_NV21:
-                    mFillBufferFromVideo = fillNV21FromNV21;
+                    mFillBufferFromVideo =
+                            scaled ? bindSourceSize(fillNV21FromNV21Scaled, srcWidth, srcHeight)
+                                   : fillNV21FromNV21;
                     break;
                 case V4L2_PIX_FMT_YUYV:
-                    mFillBufferFromVideo = fillNV21FromYUYV;
+                    mFillBufferFromVideo =
+                            scaled ? bindSourceSize(fillNV21FromYUYVScaled, srcWidth, srcHeight)
+                                   : fillNV21FromYUYV;
+                    break;
+                case V4L2_PIX_FMT_MJPEG:
                     break;
                 default:
                     LOG(ERROR) << "Unhandled camera output format: " << ((char*)&videoSrcFormat)[0]
@@ -180,25 +249,62 @@ ScopedAStatus EvsV4lCamera::startVideoStream(const std::shared_ptr<IEvsCameraStr
                                << ((char*)&videoSrcFormat)[3] << std::hex << videoSrcFormat;
             }
             break;
-        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBA_8888: {
+            // The conversion follows the colorimetry the driver reports for the stream
+            const YuvColorSpace colorSpace =
+                    selectYuvColorSpace(mVideo.getColorspace(), mVideo.getYcbcrEncoding(),
+                                        mVideo.getQuantization());
+            LOG(INFO) << "Converting to RGBA with YCbCr color space "
+                      << static_cast<int>(colorSpace);
             switch (videoSrcFormat) {
                 case V4L2_PIX_FMT_YUYV:
-                    mFillBufferFromVideo = fillRGBAFromYUYV;
+                    mFillBufferFromVideo = [colorSpace, scaled, srcWidth, srcHeight](
+                                                   const BufferDesc& tgtBuff, uint8_t* tgt,
+                                                   void* imgData, unsigned imgStride,
+                                                   unsigned rowBegin, unsigned rowEnd) {
+                        if (scaled) {
+                            fillRGBAFromYUYVScaled(tgtBuff, tgt, imgData, imgStride, rowBegin,
+                                                   rowEnd, srcWidth, srcHeight, colorSpace);
+                        } else {
+                            fillRGBAFromYUYV(tgtBuff, tgt, imgData, imgStride, rowBegin, rowEnd,
+                                             colorSpace);
+                        }
+                    };
                     break;
                 case V4L2_PIX_FMT_UYVY:
-                    mFillBufferFromVideo = fillRGBAFromUYVY;
+                    mFillBufferFromVideo = [colorSpace, scaled, srcWidth, srcHeight](
+                                                   const BufferDesc& tgtBuff, uint8_t* tgt,
+                                                   void* imgData, unsigned imgStride,
+                                                   unsigned rowBegin, unsigned rowEnd) {
+                        if (scaled) {
+                            fillRGBAFromUYVYScaled(tgtBuff, tgt, imgData, imgStride, rowBegin,
+                                                   rowEnd, srcWidth, srcHeight, colorSpace);
+                        } else {
+                            fillRGBAFromUYVY(tgtBuff, tgt, imgData, imgStride, rowBegin, rowEnd,
+                                             colorSpace);
+                        }
+                    };
+                    break;
+                case V4L2_PIX_FMT_MJPEG:
                     break;
                 default:
                     LOG(ERROR) << "Unhandled camera source format " << (char*)&videoSrcFormat;
             }
             break;
+        }
         case HAL_PIXEL_FORMAT_YCBCR_422_I:
             switch (videoSrcFormat) {
                 case V4L2_PIX_FMT_YUYV:
-                    mFillBufferFromVideo = fillYUYVFromYUYV;
+                    mFillBufferFromVideo =
+                            scaled ? bindSourceSize(fillYUYVFromYUYVScaled, srcWidth, srcHeight)
+                                   : fillYUYVFromYUYV;
                     break;
                 case V4L2_PIX_FMT_UYVY:
-                    mFillBufferFromVideo = fillYUYVFromUYVY;
+                    mFillBufferFromVideo =
+                            scaled ? bindSourceSize(fillYUYVFromUYVYScaled, srcWidth, srcHeight)
+                                   : fillYUYVFromUYVY;
+                    break;
+                case V4L2_PIX_FMT_MJPEG:
                     break;
                 default:
                     LOG(ERROR) << "Unhandled camera source format " << (char*)&videoSrcFormat;
@@ -210,11 +316,20 @@ ScopedAStatus EvsV4lCamera::startVideoStream(const std::shared_ptr<IEvsCameraStr
 
     // Record the user's callback for use when we have a frame ready
     mStream = client;
+    mFrameRateLimiter.reset();
 
     // Set up the video stream with a callback to our member function forwardFrame()
-    if (!mVideo.startStream([this](VideoCapture*, imageBuffer* tgt, void* data) {
-            this->forwardFrame(tgt, data);
-        })) {
+    const auto callback = [this](VideoCapture*, imageBuffer* tgt, void* data) {
+        this->forwardFrame(tgt, data);
+    };
+    const bool sameFormat = !scaled &&
+            ((mFormat == HAL_PIXEL_FORMAT_YCRCB_420_SP && videoSrcFormat == V4L2_PIX_FMT_NV21) ||
+             (mFormat == HAL_PIXEL_FORMAT_YCBCR_422_I && videoSrcFormat == V4L2_PIX_FMT_YUYV));
+    if (sameFormat && startZeroCopyStream_Locked(callback, lock)) {
+        return ScopedAStatus::ok();
+    }
+
+    if (!mVideo.startStream(callback)) {
         // No need to hold onto this if we failed to start
         mStream = nullptr;
         LOG(ERROR) << "Underlying camera start stream failed";
@@ -228,8 +343,14 @@ ScopedAStatus EvsV4lCamera::startVideoStream(const std::shared_ptr<IEvsCameraStr
 ScopedAStatus EvsV4lCamera::stopVideoStream() {
     LOG(DEBUG) << __FUNCTION__;
 
-    // Tell the capture device to stop (and block until it does)
+    // Tell the capture device to stop (and block until it does), then wait for the frames
+    // still being decoded
     mVideo.stopStream();
+    MjpegDecoderPool::getInstance().drain(this);
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        releaseZeroCopyBuffers_Locked();
+    }
     if (mStream) {
         std::unique_lock<std::mutex> lock(mAccessLock);
 
@@ -267,11 +388,42 @@ ScopedAStatus EvsV4lCamera::doneWithFrame(const std::vector<BufferDesc>& buffers
 }
 
 ScopedAStatus EvsV4lCamera::pauseVideoStream() {
-    return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::NOT_SUPPORTED));
+    LOG(DEBUG) << __FUNCTION__;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (!mStream) {
+            LOG(WARNING) << "Ignoring pauseVideoStream call when no stream is running.";
+            return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::INVALID_ARG));
+        }
+    }
+
+    // Buffers stay allocated either way, so resuming does not wait for any allocation
+    char mode[PROPERTY_VALUE_MAX] = "\0";
+    property_get(kPropPauseMode, mode, "discard");
+    if (!mVideo.pauseStream(std::string_view(mode) == "streamoff")) {
+        return ScopedAStatus::fromServiceSpecificError(
+                static_cast<int>(EvsResult::UNDERLYING_SERVICE_ERROR));
+    }
+
+    return ScopedAStatus::ok();
 }
 
 ScopedAStatus EvsV4lCamera::resumeVideoStream() {
-    return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::NOT_SUPPORTED));
+    LOG(DEBUG) << __FUNCTION__;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (!mStream) {
+            LOG(WARNING) << "Ignoring resumeVideoStream call when no stream is running.";
+            return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::INVALID_ARG));
+        }
+    }
+
+    if (!mVideo.resumeStream()) {
+        return ScopedAStatus::fromServiceSpecificError(
+                static_cast<int>(EvsResult::UNDERLYING_SERVICE_ERROR));
+    }
+
+    return ScopedAStatus::ok();
 }
 
 ScopedAStatus EvsV4lCamera::setPrimaryClient() {
@@ -363,6 +515,19 @@ ScopedAStatus EvsV4lCamera::getIntParameter(CameraParam id, std::vector<int32_t>
 
 ScopedAStatus EvsV4lCamera::setExtendedInfo(int32_t opaqueIdentifier,
                                             const std::vector<uint8_t>& opaqueValue) {
+    if (opaqueIdentifier == kExtInfoTargetFrameRate) {
+        int32_t fps = -1;
+        if (opaqueValue.size() == sizeof(fps)) {
+            memcpy(&fps, opaqueValue.data(), sizeof(fps));
+        }
+        if (fps < 0) {
+            LOG(ERROR) << "Invalid target frame rate";
+            return ScopedAStatus::fromServiceSpecificError(
+                    static_cast<int>(EvsResult::INVALID_ARG));
+        }
+        setTargetFrameRate(fps);
+    }
+
     mExtInfo.insert_or_assign(opaqueIdentifier, opaqueValue);
     return ScopedAStatus::ok();
 }
@@ -401,7 +566,7 @@ ScopedAStatus EvsV4lCamera::importExternalBuffers(const std::vector<BufferDesc>&
     {
         std::lock_guard<std::mutex> lock(mAccessLock);
         if (numBuffersToAdd > (kMaxBuffersInFlight - mFramesAllowed)) {
-            numBuffersToAdd -= (kMaxBuffersInFlight - mFramesAllowed);
+            numBuffersToAdd = kMaxBuffersInFlight - mFramesAllowed;
             LOG(WARNING) << "Exceed the limit on number of buffers.  " << numBuffersToAdd
                          << " buffers will be added only.";
         }
@@ -426,24 +591,10 @@ ScopedAStatus EvsV4lCamera::importExternalBuffers(const std::vector<BufferDesc>&
                 continue;
             }
 
-            auto stored = false;
-            for (auto&& rec : mBuffers) {
-                if (rec.handle == nullptr) {
-                    // Use this existing entry
-                    rec.handle = memHandle;
-                    rec.inUse = false;
-
-                    stored = true;
-                    break;
-                }
-            }
-
-            if (!stored) {
-                // Add a BufferRecord wrapping this handle to our set of available buffers
-                mBuffers.push_back(std::move(BufferRecord(memHandle)));
+            if (!addBuffer_Locked(memHandle)) {
+                mapper.freeBuffer(memHandle);
+                break;
             }
-
-            ++mFramesAllowed;
         }
 
         *_aidl_return = mFramesAllowed - before;
@@ -457,44 +608,42 @@ EvsResult EvsV4lCamera::doneWithFrame_impl(const BufferDesc& bufferDesc) {
         return EvsResult::OK;
     }
 
-    if (static_cast<uint32_t>(bufferDesc.bufferId) >= mBuffers.size()) {
-        LOG(WARNING) << "Ignoring doneWithFrame called with invalid id " << bufferDesc.bufferId
-                     << " (max is " << mBuffers.size() - 1 << ")";
-        return EvsResult::OK;
-    }
-
-    // Mark this buffer as available
-    {
-        std::lock_guard<std::mutex> lock(mAccessLock);
-        mBuffers[bufferDesc.bufferId].inUse = false;
-        --mFramesInUse;
-
-        // If this frame's index is high in the array, try to move it down
-        // to improve locality after mFramesAllowed has been reduced.
-        if (static_cast<uint32_t>(bufferDesc.bufferId) >= mFramesAllowed) {
-            // Find an empty slot lower in the array (which should always exist in this case)
-            bool found = false;
-            for (auto&& rec : mBuffers) {
-                if (!rec.handle) {
-                    rec.handle = mBuffers[bufferDesc.bufferId].handle;
-                    mBuffers[bufferDesc.bufferId].handle = nullptr;
-                    found = true;
-                    break;
-                }
+    // Copied frames are returned without taking the lock
+    if (mZeroCopyMode != ZeroCopyMode::NONE) {
+        std::unique_lock<std::mutex> lock(mAccessLock);
+        if (mZeroCopyMode != ZeroCopyMode::NONE) {
+            // The buffer goes straight back to the driver
+            const uint32_t id = static_cast<uint32_t>(bufferDesc.bufferId);
+            if (id >= mZeroCopyBuffers.size() || !mZeroCopyBuffers[id].inUse) {
+                LOG(WARNING) << "Ignoring doneWithFrame called with invalid id " << id;
+                return EvsResult::OK;
             }
 
-            if (!found) {
-                LOG(WARNING) << "No empty slot!";
-            }
+            mZeroCopyBuffers[id].inUse = false;
+            --mFramesInUse;
+            mClientHoldLatency.record(getElapsedUs(mZeroCopyBuffers[id].deliveredNs));
+            lock.unlock();
+
+            mVideo.markFrameConsumed(id);
+            return EvsResult::OK;
         }
     }
 
+    const uint32_t id = static_cast<uint32_t>(bufferDesc.bufferId);
+    if (id >= kMaxBuffersInFlight || !mBuffers[id].inUse.exchange(false)) {
+        LOG(WARNING) << "Ignoring doneWithFrame called with invalid id " << bufferDesc.bufferId
+                     << " (max is " << kMaxBuffersInFlight - 1 << ")";
+        return EvsResult::OK;
+    }
+
+    // Mark this buffer as available
+    mClientHoldLatency.record(
+            getElapsedUs(mBuffers[id].deliveredNs.load(std::memory_order_relaxed)));
+    returnSlot(id);
     return EvsResult::OK;
 }
 
 EvsResult EvsV4lCamera::doneWithFrame_impl(uint32_t bufferId, buffer_handle_t handle) {
-    std::lock_guard<std::mutex> lock(mAccessLock);
-
     // If we've been displaced by another owner of the camera, then we can't do anything else
     if (!mVideo.isOpen()) {
         LOG(WARNING) << "Ignoring doneWithFrame call when camera has been lost.";
@@ -503,38 +652,41 @@ EvsResult EvsV4lCamera::doneWithFrame_impl(uint32_t bufferId, buffer_handle_t ha
 
     if (handle == nullptr) {
         LOG(ERROR) << "Ignoring doneWithFrame called with null handle";
-    } else if (bufferId >= mBuffers.size()) {
+    } else if (bufferId >= kMaxBuffersInFlight) {
         LOG(ERROR) << "Ignoring doneWithFrame called with invalid bufferId " << bufferId
-                   << " (max is " << mBuffers.size() - 1 << ")";
-    } else if (!mBuffers[bufferId].inUse) {
+                   << " (max is " << kMaxBuffersInFlight - 1 << ")";
+    } else if (!mBuffers[bufferId].inUse.exchange(false)) {
         LOG(ERROR) << "Ignoring doneWithFrame called on frame " << bufferId
                    << " which is already free";
     } else {
         // Mark the frame as available
-        mBuffers[bufferId].inUse = false;
-        --mFramesInUse;
-
-        // If this frame's index is high in the array, try to move it down
-        // to improve locality after mFramesAllowed has been reduced.
-        if (bufferId >= mFramesAllowed) {
-            // Find an empty slot lower in the array (which should always exist in this case)
-            bool found = false;
-            for (auto&& rec : mBuffers) {
-                if (!rec.handle) {
-                    rec.handle = mBuffers[bufferId].handle;
-                    mBuffers[bufferId].handle = nullptr;
-                    found = true;
-                    break;
-                }
-            }
+        mClientHoldLatency.record(
+                getElapsedUs(mBuffers[bufferId].deliveredNs.load(std::memory_order_relaxed)));
+        returnSlot(bufferId);
+    }
 
-            if (!found) {
-                LOG(WARNING) << "No empty slot!";
-            }
+    return EvsResult::OK;
+}
+
+void EvsV4lCamera::returnSlot(uint32_t id) {
+    --mFramesInUse;
+
+    // Retire the buffer if the client asked for fewer while it held this one
+    if (mSlotsToRelease > 0) {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (mSlotsToRelease > 0) {
+            --mSlotsToRelease;
+            GraphicBufferPool::getInstance().release(mBuffers[id].handle);
+            mBuffers[id].handle = nullptr;
+            --mFramesAllowed;
+            return;
         }
     }
 
-    return EvsResult::OK;
+    if (!mFreeSlots.push(id)) {
+        // Can't happen as the ring holds every slot
+        LOG(ERROR) << "Failed to return buffer slot " << id;
+    }
 }
 
 bool EvsV4lCamera::setAvailableFrames_Locked(unsigned bufferCount) {
@@ -547,10 +699,20 @@ bool EvsV4lCamera::setAvailableFrames_Locked(unsigned bufferCount) {
         return false;
     }
 
+    if (mCopyBuffersParked) {
+        // Frames are shared with the driver; the copy buffers follow when the stream stops
+        mFramesAllowed = bufferCount;
+        return true;
+    }
+
     // Is an increase required?
-    if (mFramesAllowed < bufferCount) {
-        // An increase is required
-        auto needed = bufferCount - mFramesAllowed;
+    const unsigned current = mFramesAllowed - mSlotsToRelease;
+    if (current < bufferCount) {
+        // An increase is required, which first keeps buffers that were waiting to be released
+        auto needed = bufferCount - current;
+        const unsigned kept = std::min<unsigned>(needed, mSlotsToRelease);
+        mSlotsToRelease -= kept;
+        needed -= kept;
         LOG(INFO) << "Allocating " << needed << " buffers for camera frames";
 
         auto added = increaseAvailableFrames_Locked(needed);
@@ -558,19 +720,20 @@ bool EvsV4lCamera::setAvailableFrames_Locked(unsigned bufferCount) {
             // If we didn't add all the frames we needed, then roll back to the previous state
             LOG(ERROR) << "Rolling back to previous frame queue size";
             decreaseAvailableFrames_Locked(added);
+            mSlotsToRelease += kept;
             return false;
         }
-    } else if (mFramesAllowed > bufferCount) {
+    } else if (current > bufferCount) {
         // A decrease is required
-        auto framesToRelease = mFramesAllowed - bufferCount;
+        auto framesToRelease = current - bufferCount;
         LOG(INFO) << "Returning " << framesToRelease << " camera frame buffers";
 
         auto released = decreaseAvailableFrames_Locked(framesToRelease);
         if (released != framesToRelease) {
-            // This shouldn't happen with a properly behaving client because the client
-            // should only make this call after returning sufficient outstanding buffers
-            // to allow a clean resize.
-            LOG(ERROR) << "Buffer queue shrink failed -- too many buffers currently in use?";
+            // The client still holds the others, or the capture thread is filling them, so they
+            // are released as soon as they come back.
+            LOG(INFO) << framesToRelease - released << " buffers will be released when returned";
+            mSlotsToRelease += framesToRelease - released;
         }
     }
 
@@ -578,20 +741,15 @@ bool EvsV4lCamera::setAvailableFrames_Locked(unsigned bufferCount) {
 }
 
 unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
-    // Acquire the graphics buffer allocator
-    ::android::GraphicBufferAllocator& alloc(::android::GraphicBufferAllocator::get());
+    // Buffers come from the pool shared with the other cameras
+    GraphicBufferPool& pool = GraphicBufferPool::getInstance();
+    const GraphicBufferPool::Key key = {mOutputWidth, mOutputHeight, static_cast<int32_t>(mFormat),
+                                        mUsage};
 
     unsigned added = 0;
     while (added < numToAdd) {
-        unsigned pixelsPerLine = 0;
-        buffer_handle_t memHandle = nullptr;
-        auto result = alloc.allocate(mVideo.getWidth(), mVideo.getHeight(), mFormat, 1, mUsage,
-                                     &memHandle, &pixelsPerLine, 0, "EvsV4lCamera");
-        if (result != ::android::NO_ERROR) {
-            LOG(ERROR) << "Error " << result << " allocating " << mVideo.getWidth() << " x "
-                       << mVideo.getHeight() << " graphics buffer";
-            break;
-        }
+        uint32_t pixelsPerLine = 0;
+        buffer_handle_t memHandle = pool.acquire(key, &pixelsPerLine);
         if (memHandle == nullptr) {
             LOG(ERROR) << "We didn't get a buffer handle back from the allocator";
             break;
@@ -605,23 +763,10 @@ unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
             mStride = pixelsPerLine;
         }
 
-        // Find a place to store the new buffer
-        auto stored = false;
-        for (auto&& rec : mBuffers) {
-            if (rec.handle == nullptr) {
-                // Use this existing entry
-                rec.handle = memHandle;
-                rec.inUse = false;
-                stored = true;
-                break;
-            }
-        }
-        if (!stored) {
-            // Add a BufferRecord wrapping this handle to our set of available buffers
-            mBuffers.push_back(std::move(BufferRecord(memHandle)));
+        if (!addBuffer_Locked(memHandle)) {
+            pool.release(memHandle);
+            break;
         }
-
-        ++mFramesAllowed;
         ++added;
     }
 
@@ -629,114 +774,459 @@ unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
 }
 
 unsigned EvsV4lCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
-    // Acquire the graphics buffer allocator
-    ::android::GraphicBufferAllocator& alloc(::android::GraphicBufferAllocator::get());
+    GraphicBufferPool& pool = GraphicBufferPool::getInstance();
 
+    // Only free slots can be released; the capture thread may take some of them meanwhile
     unsigned removed = 0;
-    for (auto&& rec : mBuffers) {
-        // Is this record not in use, but holding a buffer that we can free?
-        if ((rec.inUse == false) && (rec.handle != nullptr)) {
-            // Release buffer and update the record so we can recognize it as "empty"
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
+    uint32_t idx;
+    while (removed < numToRemove && mFreeSlots.pop(&idx)) {
+        // Release buffer and update the record so we can recognize it as "empty"
+        pool.release(mBuffers[idx].handle);
+        mBuffers[idx].handle = nullptr;
+
+        --mFramesAllowed;
+        ++removed;
+    }
 
-            --mFramesAllowed;
-            ++removed;
+    return removed;
+}
 
-            if (removed == numToRemove) {
-                break;
-            }
+bool EvsV4lCamera::addBuffer_Locked(buffer_handle_t handle) {
+    // Empty slots are neither queued nor in flight, so nobody else looks at them
+    for (unsigned idx = 0; idx < kMaxBuffersInFlight; ++idx) {
+        BufferSlot& slot = mBuffers[idx];
+        if (slot.handle == nullptr && !slot.inUse) {
+            slot.handle = handle;
+            ++mFramesAllowed;
+            mFreeSlots.push(idx);
+            return true;
         }
     }
 
-    return removed;
+    LOG(ERROR) << "No empty buffer slot left";
+    return false;
 }
 
-// This is the async callback from the video camera that tells us a frame is ready
-void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
-    LOG(DEBUG) << __FUNCTION__;
-    bool readyForFrame = false;
-    unsigned idx = 0;
+void EvsV4lCamera::dumpFrame(imageBuffer* pV4lBuff, void* pData) {
+    // Imported dmabufs which can't be mapped have no CPU view
+    if (!mDumpFrame || pData == nullptr) {
+        return;
+    }
 
-    // Lock scope for updating shared state
+    std::shared_ptr<FrameDumper> dumper;
     {
-        std::lock_guard<std::mutex> lock(mAccessLock);
+        std::lock_guard<std::mutex> lock(mDumpLock);
+        dumper = mFrameDumper;
+    }
+    if (dumper != nullptr) {
+        // The frame is copied here and written by the dump thread
+        const FrameDumper::Header header = {mVideo.getWidth(), mVideo.getHeight(), mStride,
+                                            mFormat};
+        // The image, without whatever the buffer holds after it
+        dumper->submit(mFrameCounter, header, pData,
+                       std::min<size_t>(pV4lBuff->length, mVideo.getImageSize()));
+    }
+}
 
-        // Are we allowed to issue another buffer?
-        if (mFramesInUse >= mFramesAllowed) {
+bool EvsV4lCamera::forwardZeroCopyFrame(imageBuffer* pV4lBuff) {
+    const unsigned idx = pV4lBuff->index;
+    bool readyForFrame = false;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (mZeroCopyMode == ZeroCopyMode::NONE) {
+            // Sharing the exported buffers failed after this frame was captured
+            return false;
+        } else if (mZeroCopyPending) {
+            // The exported buffers are still being imported; this frame goes back to the driver
+        } else if (mFramesInUse >= mFramesAllowed) {
             // Can't do anything right now -- skip this frame
             LOG(WARNING) << "Skipped a frame because too many are in flight";
+        } else if (idx >= mZeroCopyBuffers.size() || mZeroCopyBuffers[idx].inUse) {
+            LOG(ERROR) << "Driver returned unexpected buffer " << idx;
         } else {
-            // Identify an available buffer to fill
-            for (idx = 0; idx < mBuffers.size(); idx++) {
-                if (!mBuffers[idx].inUse) {
-                    if (mBuffers[idx].handle != nullptr) {
-                        // Found an available record, so stop looking
-                        break;
-                    }
-                }
+            mZeroCopyBuffers[idx].inUse = true;
+            mZeroCopyBuffers[idx].deliveredNs = systemTime(SYSTEM_TIME_MONOTONIC);
+            mFramesInUse++;
+            readyForFrame = true;
+        }
+    }
+
+    if (!readyForFrame) {
+        // We need to return the video buffer so it can capture a new frame
+        mVideo.markFrameConsumed(idx);
+        return true;
+    }
+
+    using AidlPixelFormat = ::aidl::android::hardware::graphics::common::PixelFormat;
+
+    // The driver has written the frame into the buffer already, so no CPU access is needed.  It
+    // is queued again only when the client returns it.
+    buffer_handle_t memHandle = mZeroCopyBuffers[idx].handle;
+    BufferDesc bufferDesc = {
+            .buffer =
+                    {
+                            .description =
+                                    {
+                                            .width = static_cast<int32_t>(mVideo.getWidth()),
+                                            .height = static_cast<int32_t>(mVideo.getHeight()),
+                                            .layers = 1,
+                                            .format = static_cast<AidlPixelFormat>(mFormat),
+                                            .usage = static_cast<BufferUsage>(mUsage),
+                                            .stride = static_cast<int32_t>(mZeroCopyStride),
+                                    },
+                            .handle = ::android::dupToAidl(memHandle),
+                    },
+            .bufferId = static_cast<int32_t>(idx),
+            .deviceId = mDescription.id,
+            .timestamp = static_cast<int64_t>(::android::elapsedRealtimeNano() * 1e+3),
+    };
+
+    // Without a conversion, the frame is ready as soon as it is dequeued
+    const int64_t readyNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    mConversionLatency.record((readyNs - mVideo.getDequeueTimeNs(idx)) / 1000);
+
+    auto flag = false;
+    if (mStream) {
+        std::vector<BufferDesc> frames;
+        frames.push_back(std::move(bufferDesc));
+        flag = mStream->deliverFrame(frames).isOk();
+        mDeliveryLatency.record(getElapsedUs(readyNs));
+    }
+
+    if (flag) {
+        LOG(DEBUG) << "Delivered " << memHandle << " as id " << idx << " without a copy";
+    } else {
+        LOG(ERROR) << "Frame delivery call failed in the transport layer.";
+
+        // Since we didn't actually deliver it, give the buffer back to the driver
+        {
+            std::lock_guard<std::mutex> lock(mAccessLock);
+            mZeroCopyBuffers[idx].inUse = false;
+            --mFramesInUse;
+        }
+        mVideo.markFrameConsumed(idx);
+    }
+
+    return true;
+}
+
+bool EvsV4lCamera::startZeroCopyStream_Locked(
+        const std::function<void(VideoCapture*, imageBuffer*, void*)>& callback,
+        std::unique_lock<std::mutex>& lock) {
+    // "mmap" always copies, "dmabuf" and "expbuf" allow only one way of sharing
+    char mode[PROPERTY_VALUE_MAX] = "\0";
+    property_get(kPropZeroCopyMode, mode, "auto");
+    const std::string_view modeName =
+            mMemoryMode.empty() ? std::string_view(mode) : std::string_view(mMemoryMode);
+    if (modeName == "mmap") {
+        return false;
+    }
+
+    if (modeName != "expbuf" && startDmabufImportStream_Locked(callback)) {
+        LOG(INFO) << mDescription.id << " streams into imported gralloc buffers";
+        return true;
+    }
+
+    if (modeName != "dmabuf") {
+        // Starts the stream in any case, copying frames if gralloc rejects the driver buffers
+        return startDmabufExportStream_Locked(callback, lock);
+    }
+
+    LOG(INFO) << mDescription.id << " falls back to copying frames";
+    return false;
+}
+
+bool EvsV4lCamera::startDmabufImportStream_Locked(
+        const std::function<void(VideoCapture*, imageBuffer*, void*)>& callback) {
+    // Buffers the client may hold, plus the ones the driver needs queued to keep capturing
+    const unsigned numBuffers = mFramesAllowed + kZeroCopyQueueDepth;
+
+    GraphicBufferPool& pool = GraphicBufferPool::getInstance();
+    const GraphicBufferPool::Key key = {mVideo.getWidth(), mVideo.getHeight(),
+                                        static_cast<int32_t>(mFormat), mUsage};
+    std::vector<ImportedBuffer> imported;
+    mZeroCopyMode = ZeroCopyMode::DMABUF_IMPORT;
+    for (unsigned i = 0; i < numBuffers; ++i) {
+        uint32_t pixelsPerLine = 0;
+        buffer_handle_t memHandle = pool.acquire(key, &pixelsPerLine);
+        if (memHandle == nullptr) {
+            LOG(WARNING) << "Failed to allocate a buffer to share with the driver";
+            break;
+        }
+        mZeroCopyBuffers.push_back(BufferRecord(memHandle));
+        if (!matchesCaptureLayout(memHandle, pixelsPerLine)) {
+            break;
+        }
+        mZeroCopyStride = pixelsPerLine;
+        imported.push_back({memHandle->data[0], mVideo.getImageSize()});
+    }
+
+    if (imported.size() != numBuffers || !mVideo.startStream(callback, imported)) {
+        releaseZeroCopyBuffers_Locked();
+        return false;
+    }
+
+    parkCopyBuffers_Locked();
+    return true;
+}
+
+bool EvsV4lCamera::matchesCaptureLayout(buffer_handle_t handle, uint32_t pixelsPerLine) {
+    // The driver writes rows with its own pitch, which gralloc must match
+    const unsigned bytesPerPixel = mFormat == HAL_PIXEL_FORMAT_YCBCR_422_I ? 2 : 1;
+    const uint32_t pitch = mVideo.getStride();
+    if (pixelsPerLine * bytesPerPixel != pitch || handle->numFds < 1) {
+        LOG(INFO) << "Gralloc pitch " << pixelsPerLine * bytesPerPixel
+                  << " does not match the capture pitch " << pitch;
+        return false;
+    }
+
+    // It writes a whole frame, which the dmabuf must hold
+    const int fd = handle->data[0];
+    const off_t size = lseek(fd, 0, SEEK_END);
+    lseek(fd, 0, SEEK_SET);
+    if (size < static_cast<off_t>(mVideo.getImageSize())) {
+        LOG(INFO) << "Gralloc buffer of " << size << " bytes can't hold a frame of "
+                  << mVideo.getImageSize() << " bytes";
+        return false;
+    }
+    if (mFormat != HAL_PIXEL_FORMAT_YCRCB_420_SP) {
+        return true;
+    }
+
+    // NV21 chroma follows the last row of luma, with the same pitch and V first, whereas
+    // gralloc may align the chroma plane further
+    ::android::GraphicBufferMapper& mapper = ::android::GraphicBufferMapper::get();
+    android_ycbcr ycbcr = {};
+    const auto result = mapper.lockYCbCr(handle, GRALLOC_USAGE_SW_READ_RARELY,
+                                         ::android::Rect(mVideo.getWidth(), mVideo.getHeight()),
+                                         &ycbcr);
+    if (result != ::android::NO_ERROR) {
+        LOG(INFO) << "Gralloc can't describe the planes of an NV21 buffer";
+        return false;
+    }
+    mapper.unlock(handle);
+
+    const uint8_t* luma = static_cast<const uint8_t*>(ycbcr.y);
+    const uint8_t* chroma = static_cast<const uint8_t*>(ycbcr.cr);
+    if (ycbcr.ystride != pitch || ycbcr.cstride != pitch || ycbcr.chroma_step != 2 ||
+        chroma - luma != static_cast<ptrdiff_t>(pitch * mVideo.getHeight()) ||
+        static_cast<const uint8_t*>(ycbcr.cb) != chroma + 1) {
+        LOG(INFO) << "Gralloc puts the NV21 chroma at offset " << chroma - luma
+                  << " with pitch " << ycbcr.cstride << " instead of "
+                  << pitch * mVideo.getHeight() << " with pitch " << pitch;
+        return false;
+    }
+    return true;
+}
+
+bool EvsV4lCamera::startDmabufExportStream_Locked(
+        const std::function<void(VideoCapture*, imageBuffer*, void*)>& callback,
+        std::unique_lock<std::mutex>& lock) {
+    // Until the buffer table is published, forwardZeroCopyFrame() hands the frames straight back
+    // to the driver
+    mZeroCopyMode = ZeroCopyMode::DMABUF_EXPORT;
+    mZeroCopyPending = true;
+    const uint64_t generation = ++mZeroCopyGeneration;
+
+    const unsigned bytesPerPixel = mFormat == HAL_PIXEL_FORMAT_YCBCR_422_I ? 2 : 1;
+    const uint32_t format = mFormat;
+    const uint32_t usage = mUsage;
+
+    // Starting the stream and importing every buffer take a while.  The capture engine thread
+    // delivers the frames of all cameras and takes our lock for each frame, so none of this
+    // may happen with the lock held.
+    lock.unlock();
+    std::vector<BufferRecord> buffers;
+    uint32_t stride = 0;
+    const bool started = mVideo.startStream(callback);
+    if (started) {
+        stride = mVideo.getStride() / bytesPerPixel;
+        ::android::GraphicBufferMapper& mapper = ::android::GraphicBufferMapper::get();
+        for (int i = 0; i < mVideo.getNumBuffers(); ++i) {
+            const int fd = mVideo.exportBuffer(i);
+            if (fd < 0) {
+                break;
             }
-            if (idx >= mBuffers.size()) {
-                // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
-                LOG(ERROR) << "Failed to find an available buffer slot";
-            } else {
-                // We're going to make the frame busy
-                mBuffers[idx].inUse = true;
-                mFramesInUse++;
-                readyForFrame = true;
+
+            // Gralloc implementations which only accept their own handles reject this
+            native_handle_t* rawHandle = native_handle_create(1, 0);
+            rawHandle->data[0] = fd;
+            buffer_handle_t memHandle = nullptr;
+            const auto result =
+                    mapper.importBuffer(rawHandle, mVideo.getWidth(), mVideo.getHeight(), 1,
+                                        format, usage, stride, &memHandle);
+            native_handle_close(rawHandle);
+            native_handle_delete(rawHandle);
+            if (result != ::android::NO_ERROR || memHandle == nullptr) {
+                LOG(INFO) << "Gralloc can't import the exported buffer " << i;
+                break;
             }
+            buffers.push_back(BufferRecord(memHandle));
         }
     }
+    const bool shared =
+            started && buffers.size() == static_cast<size_t>(mVideo.getNumBuffers());
+    lock.lock();
 
-    if (mDumpFrame) {
-        // Construct a target filename with the device identifier
-        std::string filename = std::string(mDescription.id);
-        std::replace(filename.begin(), filename.end(), '/', '_');
-        filename = mDumpPath + filename + "_" + std::to_string(mFrameCounter) + ".bin";
+    if (generation != mZeroCopyGeneration || !shared) {
+        for (auto&& rec : buffers) {
+            ::android::GraphicBufferMapper::get().freeBuffer(rec.handle);
+        }
+        if (generation != mZeroCopyGeneration) {
+            // stopVideoStream() ran meanwhile, there is nothing left to start
+            return true;
+        }
+
+        // A started stream keeps running and copies the frames
+        mZeroCopyMode = ZeroCopyMode::NONE;
+        mZeroCopyPending = false;
+        if (started) {
+            LOG(INFO) << mDescription.id << " falls back to copying frames";
+        }
+        return started;
+    }
 
-        ::android::base::unique_fd fd(
-                open(filename.data(), O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP));
-        LOG(ERROR) << filename << ", " << fd;
-        if (fd == -1) {
-            PLOG(ERROR) << "Failed to open a file, " << filename;
+    mZeroCopyBuffers = std::move(buffers);
+    mZeroCopyStride = stride;
+    mZeroCopyPending = false;
+    parkCopyBuffers_Locked();
+    LOG(INFO) << mDescription.id << " streams in exported driver buffers";
+    return true;
+}
+
+void EvsV4lCamera::releaseZeroCopyBuffers_Locked() {
+    GraphicBufferPool& pool = GraphicBufferPool::getInstance();
+    ::android::GraphicBufferMapper& mapper = ::android::GraphicBufferMapper::get();
+    for (auto&& rec : mZeroCopyBuffers) {
+        if (rec.inUse) {
+            LOG(WARNING) << "Releasing buffer despite remote ownership";
+            --mFramesInUse;
+        }
+        if (mZeroCopyMode == ZeroCopyMode::DMABUF_IMPORT) {
+            pool.release(rec.handle);
         } else {
-            auto width = mVideo.getWidth();
-            auto height = mVideo.getHeight();
-            auto len = write(fd.get(), &width, sizeof(width));
-            len += write(fd.get(), &height, sizeof(height));
-            len += write(fd.get(), &mStride, sizeof(mStride));
-            len += write(fd.get(), &mFormat, sizeof(mFormat));
-            len += write(fd.get(), pData, pV4lBuff->length);
-            LOG(INFO) << len << " bytes are written to " << filename;
+            mapper.freeBuffer(rec.handle);
+        }
+    }
+
+    mZeroCopyBuffers.clear();
+    unparkCopyBuffers_Locked();
+    mZeroCopyMode = ZeroCopyMode::NONE;
+    mZeroCopyPending = false;
+    mZeroCopyStride = 0;
+    ++mZeroCopyGeneration;
+}
+
+void EvsV4lCamera::parkCopyBuffers_Locked() {
+    // Frames shared with the driver are never copied, so the free copy buffers go back to the
+    // pool for the other cameras.  mFramesAllowed stays the number of frames the client may
+    // hold.  The capture thread takes no slots meanwhile, as every frame is shared.
+    GraphicBufferPool& pool = GraphicBufferPool::getInstance();
+    uint32_t idx;
+    while (mFreeSlots.pop(&idx)) {
+        pool.release(mBuffers[idx].handle);
+        mBuffers[idx].handle = nullptr;
+    }
+
+    // Slots still in flight keep their buffers until the copy buffers are acquired again
+    mFramesAllowed -= mSlotsToRelease;
+    mSlotsToRelease = 0;
+    mCopyBuffersParked = true;
+}
+
+void EvsV4lCamera::unparkCopyBuffers_Locked() {
+    if (!mCopyBuffersParked) {
+        return;
+    }
+    mCopyBuffersParked = false;
+
+    // Count the buffers which were in flight, or imported meanwhile, and acquire the others
+    const unsigned framesAllowed = mFramesAllowed;
+    mFramesAllowed = 0;
+    for (unsigned i = 0; i < kMaxBuffersInFlight; ++i) {
+        if (mBuffers[i].handle != nullptr) {
+            ++mFramesAllowed;
+        }
+    }
+    if (framesAllowed > 0 && !setAvailableFrames_Locked(framesAllowed)) {
+        LOG(WARNING) << "Only " << mFramesAllowed << " of " << framesAllowed
+                     << " buffers to copy frames into are available again";
+    }
+}
+
+// This is the async callback from the video camera that tells us a frame is ready
+void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
+    LOG(DEBUG) << __FUNCTION__;
+    dumpFrame(pV4lBuff, pData);
+
+    // Frames above the target rate go back to the driver before any buffer is touched.  The
+    // driver timestamps the frames when they are captured; the dequeue time stands in for
+    // drivers which don't.
+    int64_t captureNs = pV4lBuff->timestamp.tv_sec * 1000000000LL +
+            pV4lBuff->timestamp.tv_usec * 1000LL;
+    if (captureNs == 0) {
+        captureNs = mVideo.getDequeueTimeNs(pV4lBuff->index);
+    }
+    if (!mFrameRateLimiter.accept(captureNs)) {
+        mVideo.markFrameConsumed(pV4lBuff->index);
+        {
+            std::lock_guard<std::mutex> lock(mConversionStatsLock);
+            ++mConversionStats.skippedFrames;
         }
+        ++mFrameCounter;
+        return;
+    }
+
+    if (mZeroCopyMode != ZeroCopyMode::NONE && forwardZeroCopyFrame(pV4lBuff)) {
+        ++mFrameCounter;
+        return;
+    }
+
+    // Take a free buffer without the lock, so binder calls never stall the capture thread.  The
+    // ring only holds as many buffers as we are allowed to have in flight.
+    uint32_t idx = 0;
+    const bool readyForFrame = mFreeSlots.pop(&idx);
+    if (readyForFrame) {
+        // We're going to make the frame busy
+        mBuffers[idx].inUse = true;
+        mFramesInUse++;
+    } else {
+        // Can't do anything right now -- skip this frame
+        LOG(WARNING) << "Skipped a frame because too many are in flight";
     }
 
     if (!readyForFrame) {
         // We need to return the video buffer so it can capture a new frame
         mVideo.markFrameConsumed(pV4lBuff->index);
+    } else if (mDecodeMjpeg && !mVideo.getSyncGroup().empty()) {
+        // A logical camera forwards its set once the engine delivered the frames of all members
+        // on this thread, so a member of a set can't deliver its frame later from the decoders
+        if (!mSyncDecoder) {
+            mSyncDecoder = std::make_unique<MjpegDecoder>();
+        }
+        decodeFrame(idx, mVideo.getDequeueTimeNs(pV4lBuff->index), *mSyncDecoder,
+                    static_cast<const uint8_t*>(pData),
+                    pV4lBuff->bytesused > 0 ? pV4lBuff->bytesused : pV4lBuff->length);
+        mVideo.markFrameConsumed(pV4lBuff->index);
+    } else if (mDecodeMjpeg) {
+        // The decoder takes a copy of the frame, so the driver gets its buffer back right away
+        // and this thread is free to dispatch the frames of the other cameras
+        const int64_t dequeueNs = mVideo.getDequeueTimeNs(pV4lBuff->index);
+        const bool queued = MjpegDecoderPool::getInstance().submit(
+                this, pData, pV4lBuff->bytesused > 0 ? pV4lBuff->bytesused : pV4lBuff->length,
+                [this, idx, dequeueNs](MjpegDecoder& decoder, const std::vector<uint8_t>& frame) {
+                    decodeFrame(idx, dequeueNs, decoder, frame.data(), frame.size());
+                });
+        mVideo.markFrameConsumed(pV4lBuff->index);
+        if (!queued) {
+            LOG(WARNING) << "Skipped a frame because the MJPEG decoder falls behind";
+            mBuffers[idx].inUse = false;
+            returnSlot(idx);
+        }
     } else {
-        using AidlPixelFormat = ::aidl::android::hardware::graphics::common::PixelFormat;
-
         // Assemble the buffer description we'll transmit below
         buffer_handle_t memHandle = mBuffers[idx].handle;
-        BufferDesc bufferDesc = {
-                .buffer =
-                        {
-                                .description =
-                                        {
-                                                .width = static_cast<int32_t>(mVideo.getWidth()),
-                                                .height = static_cast<int32_t>(mVideo.getHeight()),
-                                                .layers = 1,
-                                                .format = static_cast<AidlPixelFormat>(mFormat),
-                                                .usage = static_cast<BufferUsage>(mUsage),
-                                                .stride = static_cast<int32_t>(mStride),
-                                        },
-                                .handle = ::android::dupToAidl(memHandle),
-                        },
-                .bufferId = static_cast<int32_t>(idx),
-                .deviceId = mDescription.id,
-                .timestamp = static_cast<int64_t>(::android::elapsedRealtimeNano() * 1e+3),
-        };
+        BufferDesc bufferDesc = makeBufferDesc(idx);
 
         // Lock our output buffer for writing
         // TODO(b/145459970): Sometimes, physical camera device maps a buffer
@@ -760,44 +1250,176 @@ void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
         }
 
         // Transfer the video image into the output buffer, making any needed
-        // format conversion along the way
-        mFillBufferFromVideo(bufferDesc, (uint8_t*)targetPixels, pData, mVideo.getStride());
+        // format conversion along the way.  Large frames are split into bands of rows
+        // which the shared helper threads convert concurrently.
+        const auto convertStart = std::chrono::steady_clock::now();
+        const unsigned rowAlignment = mFormat == HAL_PIXEL_FORMAT_YCRCB_420_SP ? 2 : 1;
+        const bool parallel = ConversionWorkerPool::getInstance().run(
+                mConversionAffinity, mOutputHeight, rowAlignment, pV4lBuff->length,
+                [&](unsigned rowBegin, unsigned rowEnd) {
+                    mFillBufferFromVideo(bufferDesc, (uint8_t*)targetPixels, pData,
+                                         mVideo.getStride(), rowBegin, rowEnd);
+                });
+        const int64_t convertUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                                          std::chrono::steady_clock::now() - convertStart)
+                                          .count();
+        {
+            std::lock_guard<std::mutex> lock(mConversionStatsLock);
+            ++mConversionStats.frames;
+            if (parallel) {
+                ++mConversionStats.parallelFrames;
+            }
+            mConversionStats.lastUs = convertUs;
+            mConversionStats.totalUs += convertUs;
+            mConversionStats.maxUs = std::max(mConversionStats.maxUs, convertUs);
+        }
 
         // Unlock the output buffer
         mapper.unlock(memHandle);
 
+        const int64_t readyNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        mConversionLatency.record((readyNs - mVideo.getDequeueTimeNs(pV4lBuff->index)) / 1000);
+
         // Give the video frame back to the underlying device for reuse
         // Note that we do this before making the client callback to give the
         // underlying camera more time to capture the next frame
         mVideo.markFrameConsumed(pV4lBuff->index);
 
-        // Issue the (asynchronous) callback to the client -- can't be holding
-        // the lock
-        auto flag = false;
-        if (mStream) {
-            std::vector<BufferDesc> frames;
-            frames.push_back(std::move(bufferDesc));
-            flag = mStream->deliverFrame(frames).isOk();
-        }
+        deliverFrame(std::move(bufferDesc), idx, readyNs);
+    }
 
-        if (flag) {
-            LOG(DEBUG) << "Delivered " << memHandle << " as id " << bufferDesc.bufferId;
-        } else {
-            // This can happen if the client dies and is likely unrecoverable.
-            // To avoid consuming resources generating failing calls, we stop sending
-            // frames.  Note, however, that the stream remains in the "STREAMING" state
-            // until cleaned up on the main thread.
-            LOG(ERROR) << "Frame delivery call failed in the transport layer.";
+    // Increse a frame counter
+    ++mFrameCounter;
+}
 
-            // Since we didn't actually deliver it, mark the frame as available
-            std::lock_guard<std::mutex> lock(mAccessLock);
-            mBuffers[idx].inUse = false;
-            --mFramesInUse;
+void EvsV4lCamera::decodeFrame(uint32_t idx, int64_t dequeueNs, MjpegDecoder& decoder,
+                               const uint8_t* data, size_t size) {
+    buffer_handle_t memHandle = mBuffers[idx].handle;
+    BufferDesc bufferDesc = makeBufferDesc(idx);
+    const uint32_t width = mOutputWidth;
+    const uint32_t height = mOutputHeight;
+
+    void* targetPixels = nullptr;
+    ::android::GraphicBufferMapper& mapper = ::android::GraphicBufferMapper::get();
+    auto result = mapper.lock(memHandle, GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                              ::android::Rect(width, height), &targetPixels);
+    if (!targetPixels) {
+        LOG(ERROR) << "Camera failed to gain access to image buffer for writing - "
+                   << " status: " << ::android::statusToString(result);
+    }
+
+    // NV21 rows are 16 byte aligned, as in the copy functions of bufferCopy.cpp
+    const auto decodeStart = std::chrono::steady_clock::now();
+    const MjpegDecoder::Target target = {
+            .pixels = static_cast<uint8_t*>(targetPixels),
+            .format = mFormat,
+            .width = width,
+            .height = height,
+            .stride = mFormat == HAL_PIXEL_FORMAT_YCRCB_420_SP ? (width + 15) & ~15u : mStride,
+    };
+    const bool decoded = targetPixels != nullptr && decoder.decode(data, size, target);
+    const int64_t decodeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now() - decodeStart)
+                                     .count();
+    mapper.unlock(memHandle);
+
+    {
+        std::lock_guard<std::mutex> lock(mConversionStatsLock);
+        if (!decoded) {
+            ++mConversionStats.failedFrames;
+        } else {
+            ++mConversionStats.frames;
+            if (decoder.getLastScale() > 1) {
+                ++mConversionStats.scaledFrames;
+            }
+            mConversionStats.lastUs = decodeUs;
+            mConversionStats.totalUs += decodeUs;
+            mConversionStats.maxUs = std::max(mConversionStats.maxUs, decodeUs);
         }
     }
 
-    // Increse a frame counter
-    ++mFrameCounter;
+    if (!decoded) {
+        // A corrupt frame is not worth showing
+        mBuffers[idx].inUse = false;
+        returnSlot(idx);
+        return;
+    }
+
+    const int64_t readyNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    mConversionLatency.record((readyNs - dequeueNs) / 1000);
+    deliverFrame(std::move(bufferDesc), idx, readyNs);
+}
+
+BufferDesc EvsV4lCamera::makeBufferDesc(uint32_t idx) {
+    using AidlPixelFormat = ::aidl::android::hardware::graphics::common::PixelFormat;
+
+    return {
+            .buffer =
+                    {
+                            .description =
+                                    {
+                                            .width = static_cast<int32_t>(mOutputWidth),
+                                            .height = static_cast<int32_t>(mOutputHeight),
+                                            .layers = 1,
+                                            .format = static_cast<AidlPixelFormat>(mFormat),
+                                            .usage = static_cast<BufferUsage>(mUsage),
+                                            .stride = static_cast<int32_t>(mStride),
+                                    },
+                            .handle = ::android::dupToAidl(mBuffers[idx].handle),
+                    },
+            .bufferId = static_cast<int32_t>(idx),
+            .deviceId = mDescription.id,
+            .timestamp = static_cast<int64_t>(::android::elapsedRealtimeNano() * 1e+3),
+    };
+}
+
+void EvsV4lCamera::deliverFrame(BufferDesc&& bufferDesc, uint32_t idx, int64_t readyNs) {
+    // Issue the (asynchronous) callback to the client -- can't be holding
+    // the lock
+    auto flag = false;
+    if (mStream) {
+        std::vector<BufferDesc> frames;
+        frames.push_back(std::move(bufferDesc));
+        mBuffers[idx].deliveredNs.store(systemTime(SYSTEM_TIME_MONOTONIC),
+                                        std::memory_order_relaxed);
+        flag = mStream->deliverFrame(frames).isOk();
+        mDeliveryLatency.record(getElapsedUs(readyNs));
+    }
+
+    if (flag) {
+        LOG(DEBUG) << "Delivered " << mBuffers[idx].handle << " as id " << idx;
+    } else {
+        // This can happen if the client dies and is likely unrecoverable.
+        // To avoid consuming resources generating failing calls, we stop sending
+        // frames.  Note, however, that the stream remains in the "STREAMING" state
+        // until cleaned up on the main thread.
+        LOG(ERROR) << "Frame delivery call failed in the transport layer.";
+
+        // Since we didn't actually deliver it, mark the frame as available
+        mBuffers[idx].inUse = false;
+        returnSlot(idx);
+    }
+}
+
+EvsV4lCamera::ConversionStats EvsV4lCamera::getConversionStats() {
+    std::lock_guard<std::mutex> lock(mConversionStatsLock);
+    return mConversionStats;
+}
+
+EvsV4lCamera::FrameLatency EvsV4lCamera::getFrameLatency() {
+    FrameLatency latency;
+    latency.capture = mVideo.getCaptureLatency().getSummary();
+    latency.conversion = mConversionLatency.getSummary();
+    latency.delivery = mDeliveryLatency.getSummary();
+    latency.clientHold = mClientHoldLatency.getSummary();
+    return latency;
+}
+
+void EvsV4lCamera::resetFrameLatency() {
+    mVideo.getCaptureLatency().reset();
+    mConversionLatency.reset();
+    mDeliveryLatency.reset();
+    mClientHoldLatency.reset();
 }
 
 bool EvsV4lCamera::convertToV4l2CID(CameraParam id, uint32_t& v4l2cid) {
@@ -865,15 +1487,26 @@ std::shared_ptr<EvsV4lCamera> EvsV4lCamera::Create(
         // Validate a given stream configuration.  If there is no exact match,
         // this will try to find the best match based on:
         // 1) same output format
-        // 2) the largest resolution that is smaller that a given configuration.
+        // 2) the smallest resolution that covers a given configuration, whose frames are
+        //    scaled down to the requested size; the scaling needs an even size.
+        // 3) the largest resolution that is smaller that a given configuration.
+        const bool canScale = requestedStreamCfg->width > 0 && requestedStreamCfg->height > 0 &&
+                requestedStreamCfg->width % 2 == 0 && requestedStreamCfg->height % 2 == 0;
         int32_t streamId = -1, area = INT_MIN;
+        int32_t coveringId = -1, coveringArea = INT_MAX;
         for (auto& [id, cfg] : camInfo->streamConfigurations) {
             if (cfg.format == requestedStreamCfg->format) {
                 if (cfg.width == requestedStreamCfg->width &&
                     cfg.height == requestedStreamCfg->height) {
                     // Find exact match.
                     streamId = id;
+                    coveringId = -1;
                     break;
+                } else if (cfg.width >= requestedStreamCfg->width &&
+                           cfg.height >= requestedStreamCfg->height &&
+                           cfg.width * cfg.height < coveringArea) {
+                    coveringId = id;
+                    coveringArea = cfg.width * cfg.height;
                 } else if (cfg.width < requestedStreamCfg->width &&
                            cfg.height < requestedStreamCfg->height &&
                            cfg.width * cfg.height > area) {
@@ -882,6 +1515,10 @@ std::shared_ptr<EvsV4lCamera> EvsV4lCamera::Create(
                 }
             }
         }
+        const bool scaleDown = canScale && coveringId >= 0;
+        if (scaleDown) {
+            streamId = coveringId;
+        }
 
         if (streamId >= 0) {
             LOG(INFO) << "Selected video stream configuration:";
@@ -892,6 +1529,10 @@ std::shared_ptr<EvsV4lCamera> EvsV4lCamera::Create(
             success = evsCamera->mVideo.open(deviceName,
                                              camInfo->streamConfigurations[streamId].width,
                                              camInfo->streamConfigurations[streamId].height);
+            if (success && scaleDown) {
+                evsCamera->mOutputWidth = requestedStreamCfg->width;
+                evsCamera->mOutputHeight = requestedStreamCfg->height;
+            }
             // Safe to statically cast
             // ::aidl::android::hardware::graphics::common::PixelFormat type to
             // android_pixel_format_t
@@ -910,26 +1551,66 @@ std::shared_ptr<EvsV4lCamera> EvsV4lCamera::Create(
         }
     }
 
+    // Without a size of their own, frames are delivered at the size they are captured
+    if (evsCamera->mOutputWidth == 0 || evsCamera->mOutputHeight == 0) {
+        evsCamera->mOutputWidth = evsCamera->mVideo.getWidth();
+        evsCamera->mOutputHeight = evsCamera->mVideo.getHeight();
+    }
+
     // List available camera parameters
     evsCamera->mCameraControls = evsCamera->mVideo.enumerateCameraControls();
 
     // Please note that the buffer usage flag does not come from a given stream
     // configuration.
-    evsCamera->mUsage =
-            GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_OFTEN;
+    evsCamera->mUsage = kBufferUsage;
 
     return evsCamera;
 }
 
-Result<void> EvsV4lCamera::startDumpFrames(const std::string& path) {
+void EvsV4lCamera::prewarmBuffers(const ConfigManager::CameraInfo& camInfo, unsigned count) {
+    GraphicBufferPool& pool = GraphicBufferPool::getInstance();
+    for (auto&& [id, cfg] : camInfo.streamConfigurations) {
+        if (cfg.type != ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT) {
+            continue;
+        }
+
+        // Cameras of the same configuration share the buffers the pool keeps
+        pool.prewarm({static_cast<uint32_t>(cfg.width), static_cast<uint32_t>(cfg.height),
+                      static_cast<int32_t>(cfg.format), kBufferUsage},
+                     count);
+    }
+}
+
+Result<void> EvsV4lCamera::startDumpFrames(const std::string& path, unsigned interval,
+                                           bool compress) {
     struct stat info;
     if (stat(path.data(), &info) != 0) {
         return Error(::android::BAD_VALUE) << "Cannot access " << path;
     } else if (!(info.st_mode & S_IFDIR)) {
         return Error(::android::BAD_VALUE) << path << " is not a directory";
+    } else if (interval < 1) {
+        return Error(::android::BAD_VALUE) << "Interval must be at least 1";
     }
 
-    mDumpPath = path;
+    // Construct the file names with the device identifier
+    std::string prefix = std::string(mDescription.id);
+    std::replace(prefix.begin(), prefix.end(), '/', '_');
+
+    std::shared_ptr<FrameDumper> previous;
+    {
+        std::lock_guard<std::mutex> lock(mDumpLock);
+        previous = std::move(mFrameDumper);
+        mFrameDumper = std::make_shared<FrameDumper>(FrameDumper::Options{
+                .directory = path,
+                .prefix = prefix,
+                .interval = interval,
+                .compress = compress,
+                .frameSize = mVideo.getImageSize(),
+        });
+    }
+    if (previous != nullptr) {
+        previous->stop();
+    }
     mDumpFrame = true;
 
     return {};
@@ -941,6 +1622,31 @@ Result<void> EvsV4lCamera::stopDumpFrames() {
     }
 
     mDumpFrame = false;
+
+    // Waits for the frames which were dumped to be written
+    std::shared_ptr<FrameDumper> dumper;
+    {
+        std::lock_guard<std::mutex> lock(mDumpLock);
+        dumper = mFrameDumper;
+    }
+    dumper->stop();
+    return {};
+}
+
+Result<FrameDumper::Stats> EvsV4lCamera::getDumpStats() {
+    std::lock_guard<std::mutex> lock(mDumpLock);
+    if (mFrameDumper == nullptr) {
+        return Error(::android::INVALID_OPERATION) << "Device has not dumped frames";
+    }
+
+    return mFrameDumper->getStats();
+}
+
+Result<void> EvsV4lCamera::startRecording(const std::string& path) {
+    if (!mVideo.startRecording(path)) {
+        return Error(::android::INVALID_OPERATION) << "Failed to record frames into " << path;
+    }
+
     return {};
 }
 
@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EvsV4lLogicalCamera.h"
+
+#include <aidl/android/hardware/automotive/evs/EvsEventType.h>
+#include <android-base/logging.h>
+
+namespace {
+
+using ::aidl::android::hardware::automotive::evs::BufferDesc;
+using ::aidl::android::hardware::common::NativeHandle;
+using ::ndk::ScopedAStatus;
+
+NativeHandle dupNativeHandle(const NativeHandle& handle) {
+    NativeHandle dup;
+
+    dup.fds = std::vector<::ndk::ScopedFileDescriptor>(handle.fds.size());
+    for (size_t i = 0; i < handle.fds.size(); ++i) {
+        dup.fds[i] = handle.fds[i].dup();
+    }
+    dup.ints = handle.ints;
+
+    return dup;
+}
+
+BufferDesc dupBufferDesc(const BufferDesc& src) {
+    BufferDesc dup = {
+            .buffer =
+                    {
+                            .description = src.buffer.description,
+                            .handle = dupNativeHandle(src.buffer.handle),
+                    },
+            .pixelSizeBytes = src.pixelSizeBytes,
+            .bufferId = src.bufferId,
+            .deviceId = src.deviceId,
+            .timestamp = src.timestamp,
+            .metadata = src.metadata,
+    };
+
+    return dup;
+}
+
+// Members only need to know which of their buffers comes back
+BufferDesc makeReturnedFrame(const BufferDesc& src) {
+    BufferDesc frame;
+    frame.bufferId = src.bufferId;
+    frame.deviceId = src.deviceId;
+    return frame;
+}
+
+}  // namespace
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+EvsV4lLogicalCamera::EvsV4lLogicalCamera(const char* groupId,
+                                         std::vector<std::shared_ptr<EvsV4lCamera>> members) :
+      mMembers(std::move(members)) {
+    LOG(DEBUG) << "EvsV4lLogicalCamera instantiated";
+
+    mDescription.id = groupId;
+}
+
+EvsV4lLogicalCamera::~EvsV4lLogicalCamera() {
+    LOG(DEBUG) << "EvsV4lLogicalCamera being destroyed";
+    shutdown();
+}
+
+std::shared_ptr<EvsV4lLogicalCamera> EvsV4lLogicalCamera::Create(
+        const char* groupId, std::unique_ptr<ConfigManager::CameraGroupInfo>& groupInfo,
+        std::vector<std::shared_ptr<EvsV4lCamera>> members) {
+    LOG(INFO) << "Create " << groupId << " with " << members.size() << " cameras";
+    if (members.empty()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<EvsV4lLogicalCamera> camera =
+            ndk::SharedRefBase::make<EvsV4lLogicalCamera>(groupId, std::move(members));
+    if (!camera) {
+        return nullptr;
+    }
+
+    if (groupInfo) {
+        uint8_t* ptr = reinterpret_cast<uint8_t*>(groupInfo->characteristics);
+        const size_t len = get_camera_metadata_size(groupInfo->characteristics);
+        camera->mDescription.metadata.insert(camera->mDescription.metadata.end(), ptr, ptr + len);
+    }
+    camera->mMemberStream = ndk::SharedRefBase::make<MemberStream>(camera.get());
+
+    return camera;
+}
+
+// This gets called if another caller "steals" ownership of the camera
+void EvsV4lLogicalCamera::shutdown() {
+    LOG(DEBUG) << "EvsV4lLogicalCamera shutdown";
+
+    stopVideoStream();
+    for (auto&& member : mMembers) {
+        member->shutdown();
+    }
+}
+
+ScopedAStatus EvsV4lLogicalCamera::getCameraInfo(CameraDesc* _aidl_return) {
+    LOG(DEBUG) << __FUNCTION__;
+
+    *_aidl_return = mDescription;
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::getPhysicalCameraInfo(const std::string& deviceId,
+                                                         CameraDesc* _aidl_return) {
+    LOG(DEBUG) << __FUNCTION__;
+
+    auto member = findMember(deviceId);
+    if (!member) {
+        return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::INVALID_ARG));
+    }
+
+    *_aidl_return = member->getDesc();
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::setMaxFramesInFlight(int32_t bufferCount) {
+    LOG(DEBUG) << __FUNCTION__;
+
+    // Every member may hold this many frames of the sets in flight
+    for (auto&& member : mMembers) {
+        auto status = member->setMaxFramesInFlight(bufferCount);
+        if (!status.isOk()) {
+            return status;
+        }
+    }
+
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::startVideoStream(
+        const std::shared_ptr<IEvsCameraStream>& client) {
+    LOG(DEBUG) << __FUNCTION__;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (mStream) {
+            LOG(ERROR) << "Ignoring startVideoStream call when a stream is already running.";
+            return ScopedAStatus::fromServiceSpecificError(
+                    static_cast<int>(EvsResult::STREAM_ALREADY_RUNNING));
+        }
+
+        mStream = client;
+        mPendingSet.clear();
+    }
+
+    // Frames of the members are grouped by the capture engine under the id of this camera
+    CaptureEngine::getInstance().configureSyncGroup(mDescription.id,
+                                                    CaptureEngine::getDefaultSkewNs(),
+                                                    [this] { forwardFrameSet(); });
+    for (auto&& member : mMembers) {
+        member->setSyncGroup(mDescription.id);
+        auto status = member->startVideoStream(mMemberStream);
+        if (!status.isOk()) {
+            LOG(ERROR) << "Failed to start " << member->getDesc().id;
+            stopVideoStream();
+            return status;
+        }
+    }
+
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::stopVideoStream() {
+    LOG(DEBUG) << __FUNCTION__;
+
+    // Blocks until no more frames are forwarded to us
+    for (auto&& member : mMembers) {
+        member->stopVideoStream();
+        member->setSyncGroup("");
+    }
+    CaptureEngine::getInstance().removeSyncGroup(mDescription.id);
+
+    std::shared_ptr<IEvsCameraStream> stream;
+    std::vector<BufferDesc> pending;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        stream = std::move(mStream);
+        pending = std::move(mPendingSet);
+        mPendingSet.clear();
+    }
+    returnFrames(pending);
+
+    if (stream) {
+        EvsEventDesc event;
+        event.aType = EvsEventType::STREAM_STOPPED;
+        event.deviceId = mDescription.id;
+        if (!stream->notify(event).isOk()) {
+            LOG(WARNING) << "Error delivering end of stream event";
+        }
+    }
+
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::doneWithFrame(const std::vector<BufferDesc>& buffers) {
+    LOG(DEBUG) << __FUNCTION__;
+
+    returnFrames(buffers);
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::pauseVideoStream() {
+    LOG(DEBUG) << __FUNCTION__;
+
+    for (auto&& member : mMembers) {
+        auto status = member->pauseVideoStream();
+        if (!status.isOk()) {
+            LOG(ERROR) << "Failed to pause " << member->getDesc().id;
+            resumeVideoStream();
+            return status;
+        }
+    }
+
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::resumeVideoStream() {
+    LOG(DEBUG) << __FUNCTION__;
+
+    // Resumes as many members as possible and reports the first failure
+    ScopedAStatus result = ScopedAStatus::ok();
+    for (auto&& member : mMembers) {
+        auto status = member->resumeVideoStream();
+        if (!status.isOk() && result.isOk()) {
+            LOG(ERROR) << "Failed to resume " << member->getDesc().id;
+            result = std::move(status);
+        }
+    }
+
+    return result;
+}
+
+ScopedAStatus EvsV4lLogicalCamera::setPrimaryClient() {
+    /* Because EVS HW module reference implementation expects a single client at
+     * a time, this returns a success code always.
+     */
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::forcePrimaryClient(const std::shared_ptr<IEvsDisplay>&) {
+    /* Because EVS HW module reference implementation expects a single client at
+     * a time, this returns a success code always.
+     */
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::unsetPrimaryClient() {
+    /* Because EVS HW module reference implementation expects a single client at
+     * a time, there is no chance that this is called by the secondary client and
+     * therefore returns a success code always.
+     */
+    return ScopedAStatus::ok();
+}
+
+// Parameters apply to the physical cameras, which the members expose through their own ids
+ScopedAStatus EvsV4lLogicalCamera::getParameterList(std::vector<CameraParam>* _aidl_return) {
+    _aidl_return->clear();
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::getIntParameterRange(CameraParam, ParameterRange*) {
+    return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::NOT_SUPPORTED));
+}
+
+ScopedAStatus EvsV4lLogicalCamera::setIntParameter(CameraParam, int32_t, std::vector<int32_t>*) {
+    return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::NOT_SUPPORTED));
+}
+
+ScopedAStatus EvsV4lLogicalCamera::getIntParameter(CameraParam, std::vector<int32_t>*) {
+    return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::NOT_SUPPORTED));
+}
+
+ScopedAStatus EvsV4lLogicalCamera::setExtendedInfo(int32_t, const std::vector<uint8_t>&) {
+    return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::NOT_SUPPORTED));
+}
+
+ScopedAStatus EvsV4lLogicalCamera::getExtendedInfo(int32_t, std::vector<uint8_t>*) {
+    return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::NOT_SUPPORTED));
+}
+
+ScopedAStatus EvsV4lLogicalCamera::importExternalBuffers(const std::vector<BufferDesc>&,
+                                                         int32_t* _aidl_return) {
+    LOG(DEBUG) << __FUNCTION__;
+
+    *_aidl_return = 0;
+    return ScopedAStatus::fromServiceSpecificError(static_cast<int>(EvsResult::NOT_SUPPORTED));
+}
+
+CaptureEngine::SyncGroupStats EvsV4lLogicalCamera::getSyncStats() {
+    return CaptureEngine::getInstance().getSyncGroupStats(mDescription.id);
+}
+
+ScopedAStatus EvsV4lLogicalCamera::MemberStream::deliverFrame(
+        const std::vector<BufferDesc>& buffers) {
+    mParent->collectFrames(buffers);
+    return ScopedAStatus::ok();
+}
+
+ScopedAStatus EvsV4lLogicalCamera::MemberStream::notify(const EvsEventDesc& event) {
+    mParent->forwardEvent(event);
+    return ScopedAStatus::ok();
+}
+
+// These run on the capture engine thread, which delivers the frames of a set one after another
+void EvsV4lLogicalCamera::collectFrames(const std::vector<BufferDesc>& buffers) {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    for (const auto& buffer : buffers) {
+        mPendingSet.push_back(dupBufferDesc(buffer));
+    }
+}
+
+void EvsV4lLogicalCamera::forwardFrameSet() {
+    std::shared_ptr<IEvsCameraStream> stream;
+    std::vector<BufferDesc> frames;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        stream = mStream;
+        frames = std::move(mPendingSet);
+        mPendingSet.clear();
+    }
+
+    if (frames.size() != mMembers.size() || !stream) {
+        // A member skipped its frame because the client holds too many, or failed to decode it
+        LOG(WARNING) << "Dropped an incomplete frame set of " << mDescription.id;
+        returnFrames(frames);
+        return;
+    }
+
+    std::vector<BufferDesc> returned;
+    returned.reserve(frames.size());
+    for (const auto& frame : frames) {
+        returned.push_back(makeReturnedFrame(frame));
+    }
+    if (!stream->deliverFrame(frames).isOk()) {
+        LOG(ERROR) << "Frame delivery call failed in the transport layer.";
+        returnFrames(returned);
+    }
+}
+
+void EvsV4lLogicalCamera::forwardEvent(const EvsEventDesc& event) {
+    if (event.aType == EvsEventType::STREAM_STOPPED) {
+        // Reported once for the whole group by stopVideoStream()
+        return;
+    }
+
+    std::shared_ptr<IEvsCameraStream> stream;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        stream = mStream;
+    }
+    if (stream && !stream->notify(event).isOk()) {
+        LOG(WARNING) << "Error delivering an event of " << event.deviceId;
+    }
+}
+
+void EvsV4lLogicalCamera::returnFrames(const std::vector<BufferDesc>& buffers) {
+    for (const auto& buffer : buffers) {
+        auto member = findMember(buffer.deviceId);
+        if (!member) {
+            LOG(WARNING) << "Ignoring a frame of unknown camera " << buffer.deviceId;
+            continue;
+        }
+
+        std::vector<BufferDesc> frame;
+        frame.push_back(makeReturnedFrame(buffer));
+        member->doneWithFrame(frame);
+    }
+}
+
+std::shared_ptr<EvsV4lCamera> EvsV4lLogicalCamera::findMember(const std::string& deviceId) {
+    for (auto&& member : mMembers) {
+        if (member->getDesc().id == deviceId) {
+            return member;
+        }
+    }
+    return nullptr;
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameDumper.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <cutils/properties.h>
+#include <system/thread_defs.h>
+
+#include <fcntl.h>
+#include <lz4frame.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+
+namespace {
+
+constexpr char kPropDumpSlots[] = "vendor.evs.dump.slots";
+constexpr int kDefaultDumpSlots = 4;
+
+// One slot is written while the others wait, so a new frame always finds one to take
+constexpr int kMinDumpSlots = 2;
+
+// A standard LZ4 frame, so the lz4 tool unpacks the files
+LZ4F_preferences_t getLz4Preferences(size_t contentSize) {
+    LZ4F_preferences_t preferences = {};
+    preferences.frameInfo.blockSizeID = LZ4F_max4MB;
+    preferences.frameInfo.contentSize = contentSize;
+    return preferences;
+}
+
+double nowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+}  // namespace
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+FrameDumper::FrameDumper(const Options& options) : mOptions(options) {
+    int numSlots = kDefaultDumpSlots;
+    char value[PROPERTY_VALUE_MAX] = "\0";
+    if (property_get(kPropDumpSlots, value, nullptr) > 0) {
+        numSlots = atoi(value);
+    }
+    mSlots.resize(std::max(numSlots, kMinDumpSlots));
+    mStats.slots = mSlots.size();
+
+    // Allocated before the first frame, so the capture thread only copies
+    const size_t slotSize = sizeof(Header) + options.frameSize;
+    for (auto& slot : mSlots) {
+        slot.buffer.resize(slotSize);
+    }
+    if (options.compress) {
+        const LZ4F_preferences_t preferences = getLz4Preferences(slotSize);
+        mCompressed.resize(LZ4F_compressFrameBound(slotSize, &preferences));
+    }
+
+    mWriter = std::thread([this] { writerLoop(); });
+}
+
+FrameDumper::~FrameDumper() {
+    stop();
+}
+
+void FrameDumper::submit(uint64_t frameNumber, const Header& header, const void* data,
+                         size_t length) {
+    size_t idx = 0;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mStopping || mStats.frames++ % mOptions.interval != 0) {
+            return;
+        }
+
+        const auto freeSlot = std::find_if(mSlots.begin(), mSlots.end(), [](const Slot& slot) {
+            return slot.state == SlotState::FREE;
+        });
+        if (freeSlot != mSlots.end()) {
+            idx = freeSlot - mSlots.begin();
+        } else if (!mQueue.empty()) {
+            // The disk can't keep up; the newest frames tell the most
+            idx = mQueue.front();
+            mQueue.pop_front();
+            ++mStats.dropped;
+        } else {
+            ++mStats.dropped;
+            return;
+        }
+
+        mSlots[idx].state = SlotState::FILLING;
+        ++mStats.sampled;
+    }
+
+    // Only the capture thread fills slots, and nobody else touches one while it is filled
+    Slot& slot = mSlots[idx];
+    slot.frameNumber = frameNumber;
+    slot.size = sizeof(header) + length;
+    if (slot.buffer.size() < slot.size) {
+        slot.buffer.resize(slot.size);
+    }
+    memcpy(slot.buffer.data(), &header, sizeof(header));
+    memcpy(slot.buffer.data() + sizeof(header), data, length);
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        slot.state = SlotState::QUEUED;
+        mQueue.push_back(idx);
+        mStats.maxQueued = std::max(mStats.maxQueued, mQueue.size());
+    }
+    mSignal.notify_one();
+}
+
+void FrameDumper::stop() {
+    std::lock_guard<std::mutex> stopLock(mStopLock);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mSignal.notify_all();
+
+    if (mWriter.joinable()) {
+        mWriter.join();
+    }
+}
+
+FrameDumper::Stats FrameDumper::getStats() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStats;
+}
+
+void FrameDumper::writerLoop() {
+    // Writing yields to capturing and converting frames
+    pthread_setname_np(pthread_self(), "EvsFrameDump");
+    if (setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND) != 0) {
+        PLOG(WARNING) << "Failed to lower the priority of the frame dump thread";
+    }
+
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mSignal.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+        if (mQueue.empty()) {
+            // Stopping, and every frame which was waiting is written
+            return;
+        }
+
+        Slot& slot = mSlots[mQueue.front()];
+        mQueue.pop_front();
+        slot.state = SlotState::WRITING;
+
+        lock.unlock();
+        const double startMs = nowMs();
+        const size_t fileBytes = writeSlot(slot);
+        const double elapsedMs = nowMs() - startMs;
+        lock.lock();
+
+        if (fileBytes > 0) {
+            ++mStats.written;
+            mStats.bytes += slot.size;
+            mStats.fileBytes += fileBytes;
+        } else {
+            ++mStats.failed;
+        }
+        mStats.writeMs += elapsedMs;
+        slot.state = SlotState::FREE;
+    }
+}
+
+size_t FrameDumper::writeSlot(const Slot& slot) {
+    std::string filename = mOptions.directory;
+    if (!filename.empty() && filename.back() != '/') {
+        filename += '/';
+    }
+    filename += mOptions.prefix + "_" + std::to_string(slot.frameNumber) + ".bin";
+
+    const uint8_t* contents = slot.buffer.data();
+    size_t size = slot.size;
+    if (mOptions.compress) {
+        const LZ4F_preferences_t preferences = getLz4Preferences(slot.size);
+        const size_t bound = LZ4F_compressFrameBound(slot.size, &preferences);
+        if (mCompressed.size() < bound) {
+            mCompressed.resize(bound);
+        }
+
+        size = LZ4F_compressFrame(mCompressed.data(), mCompressed.size(), slot.buffer.data(),
+                                  slot.size, &preferences);
+        if (LZ4F_isError(size)) {
+            LOG(WARNING) << "Failed to compress frame " << slot.frameNumber << ": "
+                         << LZ4F_getErrorName(size);
+            return 0;
+        }
+        contents = mCompressed.data();
+        filename += ".lz4";
+    }
+
+    ::android::base::unique_fd fd(open(filename.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                       S_IRUSR | S_IWUSR | S_IRGRP));
+    if (fd == -1) {
+        PLOG(WARNING) << "Failed to open a file, " << filename;
+        return 0;
+    }
+    if (!::android::base::WriteFully(fd, contents, size)) {
+        PLOG(WARNING) << "Failed to write " << filename;
+        return 0;
+    }
+
+    return size;
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameRateLimiter.h"
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+void FrameRateLimiter::reset() {
+    mAppliedFps = 0;
+    mNextDueNs = 0;
+}
+
+bool FrameRateLimiter::accept(int64_t timestampNs) {
+    const unsigned fps = mTargetFps;
+    if (fps == 0) {
+        mAppliedFps = 0;
+        return true;
+    }
+
+    const int64_t periodNs = 1000000000LL / fps;
+    if (fps != mAppliedFps) {
+        // A new rate starts with this frame
+        mAppliedFps = fps;
+        mNextDueNs = timestampNs;
+    }
+
+    // A quarter period of slack absorbs the jitter of the timestamps without letting two frames
+    // through for one period
+    if (timestampNs < mNextDueNs - periodNs / 4) {
+        return false;
+    }
+
+    if (timestampNs - mNextDueNs > periodNs) {
+        // Frames stopped for a while, or the clock jumped; no burst to catch up
+        mNextDueNs = timestampNs;
+    }
+    mNextDueNs += periodNs;
+    return true;
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
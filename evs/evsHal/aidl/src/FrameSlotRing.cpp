@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameSlotRing.h"
+
+#include <sys/types.h>
+
+namespace {
+
+size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 2;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}  // namespace
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Each cell carries a sequence number telling whether it is ready for the push or the pop of the
+// current lap around the ring, so producers and consumers only contend on their own position.
+FrameSlotRing::FrameSlotRing(size_t capacity) :
+      mMask(roundUpToPowerOfTwo(capacity) - 1),
+      mCells(std::make_unique<Cell[]>(mMask + 1)),
+      mEnqueuePos(0),
+      mDequeuePos(0) {
+    for (size_t i = 0; i <= mMask; ++i) {
+        mCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool FrameSlotRing::push(uint32_t slot) {
+    size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &mCells[pos & mMask];
+        const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const ssize_t diff = static_cast<ssize_t>(sequence) - static_cast<ssize_t>(pos);
+        if (diff == 0) {
+            if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The cell still holds the index of the previous lap
+            return false;
+        } else {
+            pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->slot = slot;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool FrameSlotRing::pop(uint32_t* slot) {
+    size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &mCells[pos & mMask];
+        const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const ssize_t diff = static_cast<ssize_t>(sequence) - static_cast<ssize_t>(pos + 1);
+        if (diff == 0) {
+            if (mDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Nothing has been pushed into this cell yet
+            return false;
+        } else {
+            pos = mDequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    *slot = cell->slot;
+    cell->sequence.store(pos + mMask + 1, std::memory_order_release);
+    return true;
+}
+
+size_t FrameSlotRing::size() const {
+    const size_t dequeued = mDequeuePos.load(std::memory_order_relaxed);
+    const size_t enqueued = mEnqueuePos.load(std::memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <sys/ioctl.h>
 
+#include <algorithm>
 #include <utility>
 
 namespace {
@@ -225,6 +226,22 @@ bool GlWrapper::initialize(const std::shared_ptr<ICarDisplayProxy>& pWindowProxy
     }
     ANativeWindow_acquire(mWindow);
 
+    return initializeContext();
+}
+
+bool GlWrapper::initializeHeadless(unsigned width, unsigned height) {
+    LOG(DEBUG) << __FUNCTION__;
+
+    mWidth = width;
+    mHeight = height;
+    mWindow = nullptr;
+    mHeadless = true;
+    LOG(INFO) << "Rendering off screen at " << mWidth << "x" << mHeight;
+
+    return initializeContext();
+}
+
+bool GlWrapper::initializeContext() {
     // Set up our OpenGL ES context associated with the default display
     mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
     if (mDisplay == EGL_NO_DISPLAY) {
@@ -246,6 +263,7 @@ bool GlWrapper::initialize(const std::shared_ptr<ICarDisplayProxy>& pWindowProxy
             EGL_GREEN_SIZE, 8,
             EGL_BLUE_SIZE,  8,
             EGL_DEPTH_SIZE, 0,
+            EGL_SURFACE_TYPE, mHeadless ? EGL_PBUFFER_BIT : EGL_WINDOW_BIT,
             EGL_NONE
             // clang-format on
     };
@@ -260,9 +278,20 @@ bool GlWrapper::initialize(const std::shared_ptr<ICarDisplayProxy>& pWindowProxy
     }
 
     // Create the EGL render target surface
-    mSurface = eglCreateWindowSurface(mDisplay, egl_config, mWindow, nullptr);
+    if (mHeadless) {
+        const EGLint pbuffer_attribs[] = {
+                // clang-format off
+                EGL_WIDTH,  static_cast<EGLint>(mWidth),
+                EGL_HEIGHT, static_cast<EGLint>(mHeight),
+                EGL_NONE
+                // clang-format on
+        };
+        mSurface = eglCreatePbufferSurface(mDisplay, egl_config, pbuffer_attribs);
+    } else {
+        mSurface = eglCreateWindowSurface(mDisplay, egl_config, mWindow, nullptr);
+    }
     if (mSurface == EGL_NO_SURFACE) {
-        LOG(ERROR) << "eglCreateWindowSurface failed, " << getEGLError();
+        LOG(ERROR) << "Failed to create a render target surface, " << getEGLError();
         return false;
     }
 
@@ -289,28 +318,12 @@ bool GlWrapper::initialize(const std::shared_ptr<ICarDisplayProxy>& pWindowProxy
         return false;
     }
 
-    // Create a GL texture that will eventually wrap our externally created texture surface(s)
-    glGenTextures(1, &mTextureMap);
-    if (mTextureMap <= 0) {
-        LOG(ERROR) << "Didn't get a texture handle allocated: " << getEGLError();
-        return false;
-    }
-
-    // Turn off mip-mapping for the created texture surface
-    // (the inbound camera imagery doesn't have MIPs)
-    glBindTexture(GL_TEXTURE_2D, mTextureMap);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     return true;
 }
 
 void GlWrapper::shutdown() {
     // Drop our device textures
-    if (mKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(mDisplay, mKHRimage);
-        mKHRimage = EGL_NO_IMAGE_KHR;
-    }
+    releaseImageCache();
 
     // Release all GL resources
     if (eglGetCurrentContext() == mContext) {
@@ -333,6 +346,11 @@ void GlWrapper::shutdown() {
 }
 
 void GlWrapper::showWindow(const std::shared_ptr<ICarDisplayProxy>& pWindowProxy, uint64_t id) {
+    if (mHeadless) {
+        // There is no window to show
+        return;
+    }
+
     if (pWindowProxy) {
         pWindowProxy->showWindow(id);
     } else {
@@ -341,6 +359,11 @@ void GlWrapper::showWindow(const std::shared_ptr<ICarDisplayProxy>& pWindowProxy
 }
 
 void GlWrapper::hideWindow(const std::shared_ptr<ICarDisplayProxy>& pWindowProxy, uint64_t id) {
+    if (mHeadless) {
+        // There is no window to hide
+        return;
+    }
+
     if (pWindowProxy) {
         pWindowProxy->hideWindow(id);
     } else {
@@ -348,9 +371,12 @@ void GlWrapper::hideWindow(const std::shared_ptr<ICarDisplayProxy>& pWindowProxy
     }
 }
 
-bool GlWrapper::updateImageTexture(buffer_handle_t handle,
+bool GlWrapper::updateImageTexture(uint64_t bufferId, buffer_handle_t handle,
                                    const HardwareBufferDescription& description) {
-    if (mKHRimage != EGL_NO_IMAGE_KHR) {
+    // Importing a buffer may take the driver a while, so it is done once per buffer
+    if (auto it = mImageCache.find(bufferId); it != mImageCache.end()) {
+        it->second.lastUsed = ++mImageCacheClock;
+        mTextureMap = it->second.texture;
         return true;
     }
 
@@ -369,21 +395,57 @@ bool GlWrapper::updateImageTexture(buffer_handle_t handle,
     // Get a GL compatible reference to the graphics buffer we've been given
     EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
     EGLClientBuffer cbuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
-    mKHRimage = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID, cbuf,
-                                  eglImageAttributes);
-    if (mKHRimage == EGL_NO_IMAGE_KHR) {
+    EGLImageKHR image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID,
+                                          cbuf, eglImageAttributes);
+    if (image == EGL_NO_IMAGE_KHR) {
         LOG(ERROR) << "Error creating EGLImage: " << getEGLError();
         return false;
     }
 
-    // Update the texture handle we already created to refer to this gralloc buffer
+    // Every buffer gets its own texture, so switching buffers does not respecify a texture
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    if (texture <= 0) {
+        LOG(ERROR) << "Didn't get a texture handle allocated: " << getEGLError();
+        eglDestroyImageKHR(mDisplay, image);
+        return false;
+    }
+
+    // Turn off mip-mapping for the created texture surface
+    // (the inbound camera imagery doesn't have MIPs)
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, mTextureMap);
-    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(mKHRimage));
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(image));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+    // Make room by dropping the buffer drawn the longest time ago
+    if (mImageCache.size() >= kMaxCachedImages) {
+        auto oldest = std::min_element(mImageCache.begin(), mImageCache.end(),
+                                       [](const auto& a, const auto& b) {
+                                           return a.second.lastUsed < b.second.lastUsed;
+                                       });
+        glDeleteTextures(1, &oldest->second.texture);
+        eglDestroyImageKHR(mDisplay, oldest->second.image);
+        mImageCache.erase(oldest);
+    }
+
+    mImageCache[bufferId] = {image, texture, ++mImageCacheClock};
+    mTextureMap = texture;
+    LOG(DEBUG) << "Buffer " << bufferId << " is imported; " << mImageCache.size()
+               << " buffers are cached";
 
     return true;
 }
 
+void GlWrapper::releaseImageCache() {
+    for (auto& [id, cached] : mImageCache) {
+        glDeleteTextures(1, &cached.texture);
+        eglDestroyImageKHR(mDisplay, cached.image);
+    }
+    mImageCache.clear();
+    mTextureMap = 0;
+}
+
 void GlWrapper::renderImageToScreen() {
     // Set the viewport
     glViewport(0, 0, mWidth, mHeight);
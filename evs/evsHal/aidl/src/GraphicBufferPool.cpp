@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GraphicBufferPool.h"
+
+#include <android-base/logging.h>
+#include <cutils/properties.h>
+#include <system/graphics-base.h>
+#include <ui/GraphicBufferAllocator.h>
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+namespace {
+
+constexpr char kPropWatermarkMb[] = "vendor.evs.pool.watermark_mb";
+constexpr size_t kDefaultWatermarkMb = 64;
+
+}  // namespace
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+GraphicBufferPool& GraphicBufferPool::getInstance() {
+    static GraphicBufferPool sInstance;
+    return sInstance;
+}
+
+GraphicBufferPool::GraphicBufferPool() {
+    char value[PROPERTY_VALUE_MAX] = "\0";
+    size_t watermarkMb = kDefaultWatermarkMb;
+    if (property_get(kPropWatermarkMb, value, nullptr) > 0) {
+        watermarkMb = strtoul(value, nullptr, 10);
+    }
+    mStats.highWatermarkBytes = watermarkMb * 1024 * 1024;
+}
+
+GraphicBufferPool::~GraphicBufferPool() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mPrewarmSignal.notify_all();
+    if (mPrewarmThread.joinable()) {
+        mPrewarmThread.join();
+    }
+
+    trim();
+}
+
+size_t GraphicBufferPool::getBufferSize(const Key& key, uint32_t stride) {
+    // An estimate; gralloc may add padding and metadata
+    const size_t pixels = static_cast<size_t>(stride) * key.height;
+    switch (key.format) {
+        case HAL_PIXEL_FORMAT_YCBCR_422_I:
+            return pixels * 2;
+        case HAL_PIXEL_FORMAT_YCRCB_420_SP:
+        case HAL_PIXEL_FORMAT_YV12:
+            return pixels * 3 / 2;
+        default:
+            return pixels * 4;
+    }
+}
+
+buffer_handle_t GraphicBufferPool::allocate(const Key& key, uint32_t* stride) {
+    ::android::GraphicBufferAllocator& alloc(::android::GraphicBufferAllocator::get());
+    buffer_handle_t handle = nullptr;
+    auto result = alloc.allocate(key.width, key.height, key.format, 1, key.usage, &handle, stride,
+                                 0, "EvsV4lCamera");
+    if (result != ::android::NO_ERROR || handle == nullptr) {
+        LOG(ERROR) << "Error " << result << " allocating " << key.width << " x " << key.height
+                   << " graphics buffer";
+        return nullptr;
+    }
+
+    return handle;
+}
+
+void GraphicBufferPool::free(buffer_handle_t handle) {
+    ::android::GraphicBufferAllocator::get().free(handle);
+}
+
+buffer_handle_t GraphicBufferPool::acquire(const Key& key, uint32_t* stride) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+
+        // The buffer given back last is the most likely to be still in the caches
+        auto it = std::find_if(mIdleBuffers.rbegin(), mIdleBuffers.rend(), [&key](const auto& b) {
+            return !(b.key < key) && !(key < b.key);
+        });
+        if (it != mIdleBuffers.rend()) {
+            const Buffer buffer = it->buffer;
+            const size_t bytes = it->bytes;
+            mIdleBuffers.erase(std::next(it).base());
+            mLiveBuffers[buffer.handle] = {key, buffer.stride, bytes};
+
+            ++mStats.reuses;
+            mStats.idleBytes -= bytes;
+            mStats.liveBytes += bytes;
+            *stride = buffer.stride;
+            return buffer.handle;
+        }
+    }
+
+    // Nothing to reuse, so allocate without holding the lock
+    buffer_handle_t handle = allocate(key, stride);
+    if (handle == nullptr) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    const size_t bytes = getBufferSize(key, *stride);
+    mLiveBuffers[handle] = {key, *stride, bytes};
+    ++mStats.allocations;
+    mStats.liveBytes += bytes;
+    mStats.peakBytes = std::max(mStats.peakBytes, mStats.liveBytes + mStats.idleBytes);
+    return handle;
+}
+
+void GraphicBufferPool::release(buffer_handle_t handle) {
+    if (handle == nullptr) {
+        return;
+    }
+
+    std::vector<buffer_handle_t> toFree;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mLiveBuffers.find(handle);
+        if (it == mLiveBuffers.end()) {
+            LOG(WARNING) << "Freeing a buffer which does not come from the pool";
+            toFree.push_back(handle);
+        } else {
+            const LiveBuffer live = it->second;
+            mLiveBuffers.erase(it);
+            mStats.liveBytes -= live.bytes;
+            mStats.idleBytes += live.bytes;
+            mIdleBuffers.push_back({live.key, {handle, live.stride}, live.bytes});
+            shrink_Locked(&toFree);
+        }
+    }
+
+    for (auto&& h : toFree) {
+        free(h);
+    }
+}
+
+void GraphicBufferPool::shrink_Locked(std::vector<buffer_handle_t>* toFree) {
+    while (!mIdleBuffers.empty() && mStats.idleBytes > mStats.highWatermarkBytes) {
+        toFree->push_back(mIdleBuffers.front().buffer.handle);
+        mStats.idleBytes -= mIdleBuffers.front().bytes;
+        ++mStats.frees;
+        mIdleBuffers.pop_front();
+    }
+}
+
+void GraphicBufferPool::prewarm(const Key& key, unsigned count) {
+    if (count == 0) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mPrewarmQueue.emplace_back(key, count);
+        if (!mPrewarmThread.joinable()) {
+            mPrewarmThread = std::thread([this]() { runPrewarm(); });
+        }
+    }
+    mPrewarmSignal.notify_all();
+}
+
+void GraphicBufferPool::runPrewarm() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mPrewarmSignal.wait(lock, [this]() { return mStopping || !mPrewarmQueue.empty(); });
+        if (mStopping) {
+            return;
+        }
+
+        const auto [key, count] = mPrewarmQueue.front();
+        mPrewarmQueue.pop_front();
+
+        // Buffers which are given back meanwhile count as well
+        const auto isKind = [&key = key](const IdleBuffer& b) {
+            return !(b.key < key) && !(key < b.key);
+        };
+        while (!mStopping && static_cast<unsigned>(std::count_if(mIdleBuffers.begin(),
+                                                                 mIdleBuffers.end(), isKind)) <
+                                     count) {
+            lock.unlock();
+            uint32_t stride = 0;
+            buffer_handle_t handle = allocate(key, &stride);
+            lock.lock();
+            if (handle == nullptr) {
+                break;
+            }
+
+            const size_t bytes = getBufferSize(key, stride);
+            if (mStats.idleBytes + bytes > mStats.highWatermarkBytes) {
+                LOG(INFO) << "Stop preallocating " << key.width << " x " << key.height
+                          << " buffers at the high watermark";
+                lock.unlock();
+                free(handle);
+                lock.lock();
+                break;
+            }
+
+            mIdleBuffers.push_back({key, {handle, stride}, bytes});
+            ++mStats.allocations;
+            ++mStats.prewarmed;
+            mStats.idleBytes += bytes;
+            mStats.peakBytes = std::max(mStats.peakBytes, mStats.liveBytes + mStats.idleBytes);
+        }
+
+        LOG(DEBUG) << "Preallocated " << key.width << " x " << key.height << " buffers; "
+                   << mIdleBuffers.size() << " buffers are kept";
+    }
+}
+
+void GraphicBufferPool::trim() {
+    std::deque<IdleBuffer> idle;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        idle.swap(mIdleBuffers);
+        mStats.frees += idle.size();
+        mStats.idleBytes = 0;
+    }
+
+    for (auto&& b : idle) {
+        free(b.buffer.handle);
+    }
+}
+
+GraphicBufferPool::Stats GraphicBufferPool::getStats() {
+    std::lock_guard<std::mutex> lock(mLock);
+    Stats stats = mStats;
+    stats.liveBuffers = mLiveBuffers.size();
+    stats.idleBuffers = mIdleBuffers.size();
+    return stats;
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Bucket index = (exponent group << kSubBucketBits) + the next kSubBucketBits bits below the
+// most significant one.  Groups 0 and 1 together hold the values below 2 * kSubBuckets exactly.
+unsigned LatencyHistogram::getBucketIndex(uint64_t valueUs) {
+    valueUs = std::min<uint64_t>(valueUs, (1ull << kMaxValueBits) - 1);
+    if (valueUs < kSubBuckets) {
+        return valueUs;
+    }
+
+    const unsigned exponent = 63 - __builtin_clzll(valueUs);
+    const unsigned shift = exponent - kSubBucketBits;
+    return ((exponent - kSubBucketBits + 1) << kSubBucketBits) +
+            ((valueUs >> shift) & (kSubBuckets - 1));
+}
+
+int64_t LatencyHistogram::getBucketHighestValue(unsigned index) {
+    const unsigned group = index >> kSubBucketBits;
+    if (group == 0) {
+        return index;
+    }
+
+    const unsigned shift = group - 1;
+    const int64_t lowest = (static_cast<int64_t>(kSubBuckets) << shift) +
+            (static_cast<int64_t>(index & (kSubBuckets - 1)) << shift);
+    return lowest + (1ll << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t valueUs) {
+    valueUs = std::max<int64_t>(valueUs, 0);
+    mBuckets[getBucketIndex(valueUs)].fetch_add(1, std::memory_order_relaxed);
+    mTotalUs.fetch_add(valueUs, std::memory_order_relaxed);
+
+    int64_t current = mMinUs.load(std::memory_order_relaxed);
+    while (valueUs < current &&
+           !mMinUs.compare_exchange_weak(current, valueUs, std::memory_order_relaxed)) {
+    }
+    current = mMaxUs.load(std::memory_order_relaxed);
+    while (valueUs > current &&
+           !mMaxUs.compare_exchange_weak(current, valueUs, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : mBuckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    mTotalUs.store(0, std::memory_order_relaxed);
+    mMinUs.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+    mMaxUs.store(0, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Summary LatencyHistogram::getSummary() const {
+    uint64_t counts[kNumBuckets];
+    Summary summary;
+    for (unsigned i = 0; i < kNumBuckets; ++i) {
+        counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+        summary.count += counts[i];
+    }
+    if (summary.count == 0) {
+        return summary;
+    }
+
+    summary.minUs = mMinUs.load(std::memory_order_relaxed);
+    summary.maxUs = mMaxUs.load(std::memory_order_relaxed);
+    summary.meanUs = mTotalUs.load(std::memory_order_relaxed) / summary.count;
+
+    // Each percentile is reported as the highest value its bucket may hold
+    const std::pair<double, int64_t*> percentiles[] = {
+            {0.5, &summary.p50Us},
+            {0.9, &summary.p90Us},
+            {0.99, &summary.p99Us},
+            {0.999, &summary.p999Us},
+    };
+    uint64_t seen = 0;
+    unsigned bucket = 0;
+    for (const auto& [fraction, value] : percentiles) {
+        const uint64_t rank = std::max<uint64_t>(1, std::ceil(fraction * summary.count));
+        while (bucket < kNumBuckets - 1 && seen + counts[bucket] < rank) {
+            seen += counts[bucket++];
+        }
+        *value = std::min(getBucketHighestValue(bucket), summary.maxUs);
+    }
+
+    return summary;
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -21,8 +21,10 @@
 #include <linux/v4l2-mediabus.h>
 #include <linux/videodev2.h>
 
+#include <algorithm>
 #include <stack>
 #include <string>
+#include <unordered_map>
 #include <dirent.h>
 #include <dlfcn.h>
 #include "SysCall.h"
@@ -208,19 +210,10 @@ int MediaControl::createLink() {
         }
     }
 
-    for (McLink& link : links) {
-        ALOGD("@%s, set link : %s --> %s", __func__, link.srcEntityName.c_str(),
-              link.sinkEntityName.c_str());
-        ret = -1;
-        int srcEntity = getEntityIdByName(link.srcEntityName.c_str());
-        int sinkEntity = getEntityIdByName(link.sinkEntityName.c_str());
-        if (srcEntity >= 0 && sinkEntity >= 0) {
-            ret = setupLink(srcEntity, link.srcPad, sinkEntity, link.sinkPad, true);
-        }
-        if (ret < 0) {
-            ALOGE("@%s, Fail set link : %s --> %s", __func__, link.srcEntityName.c_str(),
-                  link.sinkEntityName.c_str());
-        }
+    // Links which are already enabled, e.g. by an earlier start, are left alone
+    ret = setupRoute(vector<McLink>(links, links + ARRAY_SIZE(links)));
+    if (ret < 0) {
+        ALOGE("@%s, Fail set links", __func__);
     }
     return ret;
 }
@@ -233,6 +226,7 @@ void MediaControl::getDeviceName(const char* entityName, string& deviceNodeName,
     DIR* dp = opendir(dirPath);
     if (dp == nullptr) {
         ALOGE("@%s, Fail open : %s", __func__, dirPath);
+        return;
     }
 
     struct dirent* dirp = nullptr;
@@ -320,14 +314,35 @@ void MediaControl::releaseInstance() {
     }
 }
 
-MediaControl::MediaControl(const char* devName) : mDevName(devName) {}
+MediaControl::MediaControl(const char* devName)
+    : mDevName(devName),
+      mMediaVersion(0),
+      mHasTopology(false),
+      mTopologyVersion(0),
+      mTopologyPads(0),
+      mTopologyLinks(0) {}
 
-MediaControl::~MediaControl() {}
+MediaControl::~MediaControl() {
+    clearEntities();
+}
 
 int MediaControl::initEntities() {
+    int fd = openDevice();
+    if (fd < 0) {
+        return -1;
+    }
+    int ret = refreshTopology(fd);
+    closeDevice(fd);
+    if (ret == 0) {
+        ALOGD("@%s, topology %llu of %s is cached", __func__,
+              (unsigned long long)mTopologyVersion, mDevName.c_str());
+        return 0;
+    }
+
+    clearEntities();
     mEntities.reserve(100);
 
-    int ret = enumInfo();
+    ret = enumInfo();
     if (ret != 0) {
         ALOGE("Enum Info failed.\n");
         return -1;
@@ -345,6 +360,7 @@ void MediaControl::clearEntities() {
         entity->links = nullptr;
         entity = mEntities.erase(entity);
     }
+    mHasTopology = false;
 }
 
 MediaEntity* MediaControl::getEntityByName(const char* name) {
@@ -441,9 +457,15 @@ int MediaControl::resetAllRoutes() {
             continue;
         }
 
+        bool active = false;
         for (uint32_t j = 0; j < numRoutes; j++) {
+            active |= (routes[j].flags & V4L2_SUBDEV_ROUTE_FL_ACTIVE) != 0;
             routes[j].flags &= ~V4L2_SUBDEV_ROUTE_FL_ACTIVE;
         }
+        if (!active) {
+            close(fd);
+            continue;
+        }
 
         ret = SetRouting(fd, routes, numRoutes);
         if (ret < 0) {
@@ -456,60 +478,48 @@ int MediaControl::resetAllRoutes() {
 }
 
 int MediaControl::setupLink(MediaPad* source, MediaPad* sink, uint32_t flags) {
-    MediaLink* link = nullptr;
-    media_link_desc ulink;
-    uint32_t i;
-    int ret = 0;
-
-    SysCall* sc = SysCall::getInstance();
+    MediaLink* link = findLink(source->entity->info.id, source->index, sink->entity->info.id,
+                               sink->index);
+    if (!link) {
+        ALOGE("%s: Link not found", __func__);
+        return -ENOENT;
+    }
 
     int fd = openDevice();
-    if (fd < 0) goto done;
+    if (fd < 0) return -1;
 
-    for (i = 0; i < source->entity->numLinks; i++) {
-        link = &source->entity->links[i];
-
-        if (link->source->entity == source->entity && link->source->index == source->index &&
-            link->sink->entity == sink->entity && link->sink->index == sink->index)
-            break;
-    }
+    int ret = setupLink(fd, link, flags);
+    closeDevice(fd);
+    return ret;
+}
 
-    if (i == source->entity->numLinks) {
-        ALOGE("%s: Link not found", __func__);
-        ret = -ENOENT;
-        goto done;
-    }
+int MediaControl::setupLink(int fd, MediaLink* link, uint32_t flags) {
+    media_link_desc ulink;
+    SysCall* sc = SysCall::getInstance();
 
     /* source pad */
     memset(&ulink, 0, sizeof(media_link_desc));
-    ulink.source.entity = source->entity->info.id;
-    ulink.source.index = source->index;
+    ulink.source.entity = link->source->entity->info.id;
+    ulink.source.index = link->source->index;
     ulink.source.flags = MEDIA_PAD_FL_SOURCE;
 
     /* sink pad */
-    ulink.sink.entity = sink->entity->info.id;
-    ulink.sink.index = sink->index;
+    ulink.sink.entity = link->sink->entity->info.id;
+    ulink.sink.index = link->sink->index;
     ulink.sink.flags = MEDIA_PAD_FL_SINK;
 
-    if (link) ulink.flags = flags | (link->flags & MEDIA_LNK_FL_IMMUTABLE);
+    ulink.flags = flags | (link->flags & MEDIA_LNK_FL_IMMUTABLE);
 
-    ret = sc->ioctl(fd, MEDIA_IOC_SETUP_LINK, &ulink);
+    int ret = sc->ioctl(fd, MEDIA_IOC_SETUP_LINK, &ulink);
     if (ret == -1) {
         ret = -errno;
         ALOGE("Unable to setup link (%s)", strerror(errno));
-        goto done;
-    }
-
-    if (link) {
-        link->flags = ulink.flags;
-        link->twin->flags = ulink.flags;
+        return ret;
     }
 
-    ret = 0;
-
-done:
-    closeDevice(fd);
-    return ret;
+    link->flags = ulink.flags;
+    link->twin->flags = ulink.flags;
+    return 0;
 }
 
 int MediaControl::setupLink(uint32_t srcEntity, uint32_t srcPad, uint32_t sinkEntity,
@@ -517,23 +527,120 @@ int MediaControl::setupLink(uint32_t srcEntity, uint32_t srcPad, uint32_t sinkEn
     ALOGD("@%s srcEntity %d srcPad %d sinkEntity %d sinkPad %d enable %d", __func__, srcEntity,
           srcPad, sinkEntity, sinkPad, enable);
 
-    for (auto& entity : mEntities) {
-        for (uint32_t j = 0; j < entity.numLinks; j++) {
-            MediaLink* link = &entity.links[j];
+    MediaLink* link = findLink(srcEntity, srcPad, sinkEntity, sinkPad);
+    if (!link) {
+        return -1;
+    }
+
+    uint32_t flags = link->flags;
+    if (enable)
+        flags |= MEDIA_LNK_FL_ENABLED;
+    else
+        flags &= ~MEDIA_LNK_FL_ENABLED;
+
+    return setupLink(link->source, link->sink, flags);
+}
+
+MediaLink* MediaControl::findLink(uint32_t srcEntity, uint32_t srcPad, uint32_t sinkEntity,
+                                  uint32_t sinkPad) {
+    MediaEntity* source = getEntityById(srcEntity);
+    if (!source) {
+        return nullptr;
+    }
+
+    for (uint32_t i = 0; i < source->numLinks; i++) {
+        MediaLink* link = &source->links[i];
+        if (link->source->entity == source && link->source->index == srcPad &&
+            link->sink->entity->info.id == sinkEntity && link->sink->index == sinkPad) {
+            return link;
+        }
+    }
+
+    return nullptr;
+}
+
+int MediaControl::planRoute(const vector<McLink>& links, vector<LinkChange>* changes) {
+    vector<MediaLink*> wanted;
+    for (const McLink& l : links) {
+        int srcEntity = l.srcEntityName.empty() ? l.srcEntity
+                                                : getEntityIdByName(l.srcEntityName.c_str());
+        int sinkEntity = l.sinkEntityName.empty() ? l.sinkEntity
+                                                  : getEntityIdByName(l.sinkEntityName.c_str());
+        MediaLink* link = nullptr;
+        if (srcEntity >= 0 && sinkEntity >= 0) {
+            link = findLink(srcEntity, l.srcPad, sinkEntity, l.sinkPad);
+        }
+        if (!link) {
+            ALOGE("@%s, no link : %s --> %s", __func__, l.srcEntityName.c_str(),
+                  l.sinkEntityName.c_str());
+            return -ENOENT;
+        }
+        wanted.push_back(link);
+    }
 
-            if ((link->source->entity->info.id == srcEntity) && (link->source->index == srcPad) &&
-                (link->sink->entity->info.id == sinkEntity) && (link->sink->index == sinkPad)) {
-                if (enable)
-                    link->flags |= MEDIA_LNK_FL_ENABLED;
-                else
-                    link->flags &= ~MEDIA_LNK_FL_ENABLED;
+    auto isWanted = [&wanted](const MediaLink* link) {
+        return std::any_of(wanted.begin(), wanted.end(), [link](const MediaLink* w) {
+            return w->source == link->source && w->sink == link->sink;
+        });
+    };
 
-                return setupLink(link->source, link->sink, link->flags);
+    // A sink pad takes one enabled link, so the others feeding it are switched off first
+    for (MediaLink* link : wanted) {
+        MediaEntity* sink = link->sink->entity;
+        for (uint32_t i = 0; i < sink->numLinks; i++) {
+            MediaLink* other = sink->links[i].twin;
+            if (other->sink != link->sink || !(other->flags & MEDIA_LNK_FL_ENABLED) ||
+                (other->flags & MEDIA_LNK_FL_IMMUTABLE) || isWanted(other)) {
+                continue;
             }
+            bool planned = std::any_of(changes->begin(), changes->end(),
+                                       [other](const LinkChange& c) { return c.link == other; });
+            if (!planned) {
+                changes->push_back({other, false});
+            }
+        }
+    }
+
+    for (MediaLink* link : wanted) {
+        if (!(link->flags & MEDIA_LNK_FL_ENABLED)) {
+            changes->push_back({link, true});
         }
     }
 
-    return -1;
+    return 0;
+}
+
+int MediaControl::setupRoute(const vector<McLink>& links) {
+    int ret = initEntities();
+    if (ret < 0) {
+        return ret;
+    }
+
+    vector<LinkChange> changes;
+    ret = planRoute(links, &changes);
+    if (ret < 0 || changes.empty()) {
+        return ret;
+    }
+
+    int fd = openDevice();
+    if (fd < 0) return -1;
+
+    for (const LinkChange& change : changes) {
+        MediaLink* link = change.link;
+        ALOGD("@%s, %s link : %s:%u --> %s:%u", __func__, change.enable ? "enable" : "disable",
+              link->source->entity->info.name, link->source->index,
+              link->sink->entity->info.name, link->sink->index);
+        uint32_t flags = change.enable ? link->flags | MEDIA_LNK_FL_ENABLED
+                                       : link->flags & ~MEDIA_LNK_FL_ENABLED;
+        ret = setupLink(fd, link, flags);
+        if (ret < 0) {
+            break;
+        }
+    }
+    closeDevice(fd);
+
+    ALOGD("@%s, %zu links of %zu changed", __func__, changes.size(), links.size());
+    return ret;
 }
 
 int MediaControl::openDevice() {
@@ -578,6 +685,10 @@ int MediaControl::enumInfo() {
         goto done;
     }
 
+    // Taken first, so a topology changing meanwhile is enumerated again next time
+    mMediaVersion = info.media_version;
+    mHasTopology = queryTopologyVersion(fd) == 0;
+
     ret = enumEntities(fd);
     if (ret < 0) {
         ALOGE("Unable to enumerate entities for device %s", mDevName.c_str());
@@ -599,6 +710,73 @@ done:
     return ret;
 }
 
+int MediaControl::queryTopologyVersion(int fd) {
+    SysCall* sc = SysCall::getInstance();
+
+    // Without arrays, only the version and the number of objects are returned
+    media_v2_topology topology;
+    memset(&topology, 0, sizeof(topology));
+    if (sc->ioctl(fd, MEDIA_IOC_G_TOPOLOGY, &topology) < 0) {
+        ALOGW("Unable to get the topology of %s (%s)", mDevName.c_str(), strerror(errno));
+        return -errno;
+    }
+
+    mTopologyVersion = topology.topology_version;
+    mTopologyPads = topology.num_pads;
+    mTopologyLinks = topology.num_links;
+    return 0;
+}
+
+int MediaControl::refreshTopology(int fd) {
+    SysCall* sc = SysCall::getInstance();
+
+    // Pads are told apart by their index only since 4.19
+    if (mEntities.empty() || !mHasTopology || !MEDIA_V2_PAD_HAS_INDEX(mMediaVersion)) {
+        return 1;
+    }
+
+    vector<media_v2_pad> pads(mTopologyPads);
+    vector<media_v2_link> links(mTopologyLinks);
+    media_v2_topology topology;
+    memset(&topology, 0, sizeof(topology));
+    topology.num_pads = pads.size();
+    topology.ptr_pads = reinterpret_cast<uintptr_t>(pads.data());
+    topology.num_links = links.size();
+    topology.ptr_links = reinterpret_cast<uintptr_t>(links.data());
+    if (sc->ioctl(fd, MEDIA_IOC_G_TOPOLOGY, &topology) < 0 ||
+        topology.topology_version != mTopologyVersion) {
+        ALOGD("@%s, topology of %s changed", __func__, mDevName.c_str());
+        return 1;
+    }
+
+    std::unordered_map<uint32_t, const media_v2_pad*> padsById;
+    for (uint32_t i = 0; i < topology.num_pads; i++) {
+        padsById[pads[i].id] = &pads[i];
+    }
+
+    for (uint32_t i = 0; i < topology.num_links; i++) {
+        const media_v2_link& l = links[i];
+        if ((l.flags & MEDIA_LNK_FL_LINK_TYPE) != MEDIA_LNK_FL_DATA_LINK) {
+            continue;
+        }
+
+        auto source = padsById.find(l.source_id);
+        auto sink = padsById.find(l.sink_id);
+        if (source == padsById.end() || sink == padsById.end()) {
+            continue;
+        }
+
+        MediaLink* link = findLink(source->second->entity_id, source->second->index,
+                                   sink->second->entity_id, sink->second->index);
+        if (link) {
+            link->flags = l.flags;
+            link->twin->flags = l.flags;
+        }
+    }
+
+    return 0;
+}
+
 int MediaControl::enumEntities(int fd) {
     MediaEntity entity;
     uint32_t id;
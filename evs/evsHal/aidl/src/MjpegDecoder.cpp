@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MjpegDecoder.h"
+
+#include <android-base/logging.h>
+#include <cutils/properties.h>
+#include <system/graphics-base.h>
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// jpeglib.h needs the definitions of stdio.h
+#include <jpeglib.h>
+#include <jerror.h>
+
+#include <algorithm>
+
+namespace {
+
+using ::aidl::android::hardware::automotive::evs::implementation::MjpegDecoder;
+
+constexpr char kPropMjpegThreads[] = "vendor.evs.mjpeg.threads";
+constexpr int kDefaultMjpegThreads = 2;
+
+// Rows asked from libjpeg at once; it returns fewer when fewer are ready
+constexpr unsigned kRowBatch = 16;
+
+// Frame copies kept for reuse once their frames are decoded
+constexpr size_t kMaxSpareFrames = 4;
+
+struct ErrorManager {
+    jpeg_error_mgr base;
+    jmp_buf jump;
+    bool truncated;  // libjpeg fills the missing rows of a truncated image in gray
+};
+
+void onError(j_common_ptr info) {
+    char message[JMSG_LENGTH_MAX];
+    (*info->err->format_message)(info, message);
+    LOG(WARNING) << "Failed to decode an MJPEG frame: " << message;
+    longjmp(reinterpret_cast<ErrorManager*>(info->err)->jump, 1);
+}
+
+// UVC cameras commonly send frames libjpeg warns about, e.g. with bytes after the image
+void onMessage(j_common_ptr info, int level) {
+    if (level < 0 && info->err->msg_code == JWRN_JPEG_EOF) {
+        reinterpret_cast<ErrorManager*>(info->err)->truncated = true;
+    }
+    if (level <= 0) {
+        char message[JMSG_LENGTH_MAX];
+        (*info->err->format_message)(info, message);
+        LOG(DEBUG) << message;
+    }
+}
+
+// Stores a row of full resolution pixels, YCbCr or RGBA, into row y of a target of another
+// layout.  columns, if not null, holds the source pixel of each target pixel.
+void storeRow(const uint8_t* src, unsigned y, const unsigned* columns, unsigned width,
+              const MjpegDecoder::Target& target) {
+    const unsigned components = target.format == HAL_PIXEL_FORMAT_RGBA_8888 ? 4 : 3;
+    auto pixelAt = [src, columns, components](unsigned x) {
+        return src + (columns != nullptr ? columns[x] : x) * components;
+    };
+
+    switch (target.format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888: {
+            uint8_t* dst = target.pixels + y * target.stride * 4;
+            if (columns == nullptr) {
+                memcpy(dst, src, width * 4);
+                break;
+            }
+            for (unsigned x = 0; x < width; ++x) {
+                memcpy(dst + x * 4, pixelAt(x), 4);
+            }
+            break;
+        }
+        case HAL_PIXEL_FORMAT_YCBCR_422_I: {
+            // Y0 U0 Y1 V0, with the chroma of the even pixel
+            uint8_t* dst = target.pixels + y * target.stride * 2;
+            for (unsigned x = 0; x + 1 < width; x += 2) {
+                const uint8_t* pixel = pixelAt(x);
+                dst[x * 2] = pixel[0];
+                dst[x * 2 + 1] = pixel[1];
+                dst[x * 2 + 2] = pixelAt(x + 1)[0];
+                dst[x * 2 + 3] = pixel[2];
+            }
+            if (width % 2 != 0) {
+                // The last pixel of an odd width has no pair; its half of the pair ends the row
+                const uint8_t* pixel = pixelAt(width - 1);
+                dst[(width - 1) * 2] = pixel[0];
+                dst[(width - 1) * 2 + 1] = pixel[1];
+            }
+            break;
+        }
+        case HAL_PIXEL_FORMAT_YCRCB_420_SP: {
+            // A luma plane followed by interleaved V/U samples of every other row
+            uint8_t* luma = target.pixels + y * target.stride;
+            for (unsigned x = 0; x < width; ++x) {
+                luma[x] = pixelAt(x)[0];
+            }
+            if (y % 2 == 0) {
+                uint8_t* chroma = target.pixels + target.stride * target.height +
+                        y / 2 * target.stride;
+                for (unsigned x = 0; x + 1 < width; x += 2) {
+                    const uint8_t* pixel = pixelAt(x);
+                    chroma[x] = pixel[2];
+                    chroma[x + 1] = pixel[1];
+                }
+            }
+            break;
+        }
+    }
+}
+
+}  // namespace
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+struct MjpegDecoder::Context {
+    jpeg_decompress_struct info;
+    ErrorManager error;
+    std::vector<uint8_t> rows;  // Rows which are converted before they are stored in the target
+    std::vector<unsigned> columns;  // Source pixel of each target pixel, when resampling
+};
+
+MjpegDecoder::MjpegDecoder() : mContext(std::make_unique<Context>()) {
+    mContext->info.err = jpeg_std_error(&mContext->error.base);
+    mContext->error.base.error_exit = onError;
+    mContext->error.base.emit_message = onMessage;
+    jpeg_create_decompress(&mContext->info);
+}
+
+MjpegDecoder::~MjpegDecoder() {
+    jpeg_destroy_decompress(&mContext->info);
+}
+
+bool MjpegDecoder::decode(const uint8_t* data, size_t size, const Target& target) {
+    if (target.format != HAL_PIXEL_FORMAT_RGBA_8888 &&
+        target.format != HAL_PIXEL_FORMAT_YCBCR_422_I &&
+        target.format != HAL_PIXEL_FORMAT_YCRCB_420_SP) {
+        LOG(ERROR) << "Can't decode MJPEG frames into format 0x" << std::hex << target.format;
+        return false;
+    }
+
+    if (setjmp(mContext->error.jump) != 0) {
+        jpeg_abort_decompress(&mContext->info);
+        return false;
+    }
+
+    return decodeImage(data, size, target);
+}
+
+bool MjpegDecoder::decodeImage(const uint8_t* data, size_t size, const Target& target) {
+    jpeg_decompress_struct* info = &mContext->info;
+    mContext->error.truncated = false;
+    jpeg_mem_src(info, const_cast<uint8_t*>(data), size);
+    if (jpeg_read_header(info, TRUE) != JPEG_HEADER_OK) {
+        jpeg_abort_decompress(info);
+        return false;
+    }
+
+    // The largest reduction which still covers the target
+    unsigned scale = 8;
+    while (scale > 1 && ((info->image_width + scale - 1) / scale < target.width ||
+                         (info->image_height + scale - 1) / scale < target.height)) {
+        scale /= 2;
+    }
+    info->scale_num = 1;
+    info->scale_denom = scale;
+    mLastScale = scale;
+
+    // YCbCr targets keep the chroma subsampled, so smoothing it while upsampling is wasted
+    const bool rgba = target.format == HAL_PIXEL_FORMAT_RGBA_8888;
+    info->out_color_space = rgba ? JCS_EXT_RGBA : JCS_YCbCr;
+    info->do_fancy_upsampling = rgba ? TRUE : FALSE;
+    jpeg_start_decompress(info);
+
+    // The rows of the reduced image take the nearest pixels when its size still differs from
+    // the target; RGBA rows of the right size are decoded into the target directly
+    const bool resample =
+            info->output_width != target.width || info->output_height != target.height;
+    const unsigned rowBytes = info->output_width * info->output_components;
+    const bool direct = rgba && !resample;
+    mContext->rows.resize(static_cast<size_t>(rowBytes) * kRowBatch);
+
+    const unsigned* columns = nullptr;
+    if (resample) {
+        mContext->columns.resize(target.width);
+        for (unsigned x = 0; x < target.width; ++x) {
+            mContext->columns[x] = (2 * x + 1) * info->output_width / (2 * target.width);
+        }
+        columns = mContext->columns.data();
+    }
+
+    // The next target row to store, and the decoded row it samples
+    unsigned targetRow = 0;
+    auto sourceRow = [info, &target, resample](unsigned y) {
+        return resample ? (2 * y + 1) * info->output_height / (2 * target.height) : y;
+    };
+
+    JSAMPROW rows[kRowBatch];
+    while (info->output_scanline < info->output_height) {
+        const unsigned first = info->output_scanline;
+        const unsigned count = std::min(kRowBatch, info->output_height - first);
+        for (unsigned i = 0; i < count; ++i) {
+            rows[i] = direct && first + i < target.height
+                    ? target.pixels + (first + i) * target.stride * 4
+                    : mContext->rows.data() + i * rowBytes;
+        }
+
+        const unsigned read = jpeg_read_scanlines(info, rows, count);
+        if (direct) {
+            continue;
+        }
+        for (; targetRow < target.height && sourceRow(targetRow) < first + read; ++targetRow) {
+            const uint8_t* src = mContext->rows.data() + (sourceRow(targetRow) - first) * rowBytes;
+            storeRow(src, targetRow, columns, target.width, target);
+        }
+    }
+
+    jpeg_finish_decompress(info);
+    return !mContext->error.truncated;
+}
+
+MjpegDecoderPool& MjpegDecoderPool::getInstance() {
+    static MjpegDecoderPool sInstance;
+    return sInstance;
+}
+
+MjpegDecoderPool::MjpegDecoderPool() {
+    int numThreads = kDefaultMjpegThreads;
+    char value[PROPERTY_VALUE_MAX] = "\0";
+    if (property_get(kPropMjpegThreads, value, nullptr) > 0) {
+        numThreads = atoi(value);
+    }
+    mNumThreads = static_cast<unsigned>(std::max(numThreads, 1));
+}
+
+MjpegDecoderPool::~MjpegDecoderPool() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mSignal.notify_all();
+
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void MjpegDecoderPool::startThreads() {
+    // Threads are created with the first MJPEG frame
+    for (unsigned i = 0; i < mNumThreads; ++i) {
+        mThreads.emplace_back([this] { decoderLoop(); });
+    }
+    LOG(INFO) << "MJPEG frames are decoded on " << mNumThreads << " threads";
+}
+
+bool MjpegDecoderPool::submit(const void* stream, const void* data, size_t size, Job job) {
+    std::call_once(mStartOnce, [this] { startThreads(); });
+
+    std::vector<uint8_t> frame;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        StreamState& state = mStreams[stream];
+        if (state.waiting) {
+            return false;
+        }
+        state.waiting = true;
+
+        if (!mSpareFrames.empty()) {
+            frame = std::move(mSpareFrames.back());
+            mSpareFrames.pop_back();
+        }
+    }
+
+    // Only the capture thread of a stream submits its frames, so no other frame of the stream
+    // is queued while this one is copied
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    frame.assign(bytes, bytes + size);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mTasks.push_back({stream, std::move(frame), std::move(job)});
+    }
+    mSignal.notify_one();
+    return true;
+}
+
+void MjpegDecoderPool::drain(const void* stream) {
+    std::unique_lock<std::mutex> lock(mLock);
+    mIdle.wait(lock, [this, stream] {
+        const auto it = mStreams.find(stream);
+        return it == mStreams.end() || (!it->second.waiting && !it->second.decoding);
+    });
+    mStreams.erase(stream);
+}
+
+void MjpegDecoderPool::decoderLoop() {
+    MjpegDecoder decoder;
+
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        // The frames of a stream which is being decoded wait for it
+        auto runnable = mTasks.end();
+        mSignal.wait(lock, [this, &runnable] {
+            runnable = std::find_if(mTasks.begin(), mTasks.end(), [this](const Task& task) {
+                return !mStreams[task.stream].decoding;
+            });
+            return mStopping || runnable != mTasks.end();
+        });
+        if (mStopping) {
+            return;
+        }
+
+        Task task = std::move(*runnable);
+        mTasks.erase(runnable);
+        mStreams[task.stream] = {.waiting = false, .decoding = true};
+
+        lock.unlock();
+        task.job(decoder, task.frame);
+        lock.lock();
+
+        mStreams[task.stream].decoding = false;
+        if (mSpareFrames.size() < kMaxSpareFrames) {
+            mSpareFrames.push_back(std::move(task.frame));
+        }
+        mIdle.notify_all();
+
+        // A frame of the same stream may be waiting for this one
+        mSignal.notify_one();
+    }
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -85,6 +85,9 @@ int SysCall::ioctl(int fd, int request, struct media_links_desc* arg) {
 int SysCall::ioctl(int fd, int request, struct media_entity_desc* arg) {
     return ioctl(fd, request, reinterpret_cast<void*>(arg));
 }
+int SysCall::ioctl(int fd, int request, struct media_v2_topology* arg) {
+    return ioctl(fd, request, reinterpret_cast<void*>(arg));
+}
 int SysCall::ioctl(int fd, int request, struct v4l2_capability* arg) {
     return ioctl(fd, request, reinterpret_cast<void*>(arg));
 }
@@ -97,6 +100,12 @@ int SysCall::ioctl(int fd, int request, enum v4l2_buf_type* arg) {
 int SysCall::ioctl(int fd, int request, struct v4l2_format* arg) {
     return ioctl(fd, request, reinterpret_cast<void*>(arg));
 }
+int SysCall::ioctl(int fd, int request, struct v4l2_frmsizeenum* arg) {
+    return ioctl(fd, request, reinterpret_cast<void*>(arg));
+}
+int SysCall::ioctl(int fd, int request, struct v4l2_frmivalenum* arg) {
+    return ioctl(fd, request, reinterpret_cast<void*>(arg));
+}
 int SysCall::ioctl(int fd, int request, struct v4l2_requestbuffers* arg) {
     return ioctl(fd, request, reinterpret_cast<void*>(arg));
 }
@@ -0,0 +1,1134 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "V4l2Replay.h"
+
+#include <android-base/logging.h>
+#include <cutils/properties.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <system/thread_defs.h>
+#include <utils/Timers.h>
+
+#include <pthread.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+// Path of the file listing the replay devices
+constexpr char kPropReplayConfig[] = "vendor.evs.replay";
+
+constexpr uint32_t kReplayMagic = 0x52535645;  // "EVSR"
+constexpr uint32_t kReplayVersion = 1;
+constexpr char kDriverName[] = "evs-replay";
+constexpr uint32_t kMaxBuffers = 32;
+constexpr uint32_t kDefaultFps = 30;
+
+// Frames a recording holds while the disk is busy, a few hundred milliseconds at 30 fps
+constexpr size_t kRecorderSlots = 8;
+
+// 75% color bars: white, yellow, cyan, green, magenta, red, blue and black as Y, U and V
+constexpr uint8_t kColorBars[][3] = {
+        {180, 128, 128}, {162, 44, 142}, {131, 156, 44}, {112, 72, 58},
+        {84, 184, 198},  {65, 100, 212}, {35, 212, 114}, {16, 128, 128},
+};
+constexpr unsigned kNumColorBars = sizeof(kColorBars) / sizeof(kColorBars[0]);
+
+// How far the bars move between frames, in pixels
+constexpr unsigned kColorBarsStep = 4;
+
+uint32_t parsePixelFormat(const std::string& name) {
+    if (name == "YUYV") {
+        return V4L2_PIX_FMT_YUYV;
+    } else if (name == "UYVY") {
+        return V4L2_PIX_FMT_UYVY;
+    } else if (name == "NV21") {
+        return V4L2_PIX_FMT_NV21;
+    }
+    return 0;
+}
+
+// MJPEG is only played from recordings, as there are no synthetic compressed frames
+bool isSupportedPixelFormat(uint32_t format) {
+    return format == V4L2_PIX_FMT_YUYV || format == V4L2_PIX_FMT_UYVY ||
+            format == V4L2_PIX_FMT_NV21 || format == V4L2_PIX_FMT_MJPEG;
+}
+
+// Rows of uncompressed frames may be padded, as drivers do to align them
+uint32_t getBytesPerLine(uint32_t format, uint32_t width, uint32_t padding = 0) {
+    switch (format) {
+        case V4L2_PIX_FMT_NV21:
+            return width + padding;
+        case V4L2_PIX_FMT_MJPEG:
+            return 0;  // As uvcvideo reports for compressed formats
+        default:
+            return width * 2 + padding;
+    }
+}
+
+// Compressed frames vary in size; they are assumed to be no larger than YUYV ones
+uint32_t getImageSize(uint32_t format, uint32_t width, uint32_t height, uint32_t padding = 0) {
+    const uint32_t bytesPerLine = getBytesPerLine(format, width, padding);
+    switch (format) {
+        case V4L2_PIX_FMT_NV21:
+            return bytesPerLine * height * 3 / 2;
+        case V4L2_PIX_FMT_MJPEG:
+            return width * height * 2;
+        default:
+            return bytesPerLine * height;
+    }
+}
+
+// Color bars scrolled to the left by kColorBarsStep pixels every frame
+void fillColorBars(uint32_t format, uint32_t width, uint32_t height, uint32_t bytesPerLine,
+                   uint64_t frame, uint8_t* dst) {
+    const uint32_t barWidth = std::max(width / kNumColorBars, 1u);
+    const uint64_t shift = frame * kColorBarsStep;
+    const auto getBar = [&](uint32_t x) {
+        return kColorBars[((x + shift) / barWidth) % kNumColorBars];
+    };
+
+    // Every row is the same, so build one and copy it
+    if (format == V4L2_PIX_FMT_NV21) {
+        for (uint32_t x = 0; x < width; ++x) {
+            dst[x] = getBar(x)[0];
+        }
+        uint8_t* chroma = dst + bytesPerLine * height;
+        for (uint32_t x = 0; x + 1 < width; x += 2) {
+            chroma[x] = getBar(x)[2];
+            chroma[x + 1] = getBar(x)[1];
+        }
+        for (uint32_t y = 1; y < height; ++y) {
+            memcpy(dst + y * bytesPerLine, dst, bytesPerLine);
+        }
+        for (uint32_t y = 1; y < height / 2; ++y) {
+            memcpy(chroma + y * bytesPerLine, chroma, bytesPerLine);
+        }
+        return;
+    }
+
+    const bool yuyv = format == V4L2_PIX_FMT_YUYV;
+    for (uint32_t x = 0; x + 1 < width; x += 2) {
+        const uint8_t* bar = getBar(x);
+        uint8_t* pixels = dst + x * 2;
+        pixels[0] = yuyv ? bar[0] : bar[1];
+        pixels[1] = yuyv ? bar[1] : bar[0];
+        pixels[2] = yuyv ? bar[0] : bar[2];
+        pixels[3] = yuyv ? bar[2] : bar[0];
+    }
+    for (uint32_t y = 1; y < height; ++y) {
+        memcpy(dst + y * bytesPerLine, dst, bytesPerLine);
+    }
+}
+
+size_t alignTo8(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+// A recording mapped into memory with the location of every frame
+class Recording {
+public:
+    struct Frame {
+        const uint8_t* data;
+        uint32_t size;
+        int64_t timestampNs;
+    };
+
+    static std::shared_ptr<Recording> Load(const std::string& path) {
+        const int fd = ::open(path.data(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            PLOG(ERROR) << "Failed to open " << path;
+            return nullptr;
+        }
+
+        struct stat info;
+        void* mapped = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(ReplayFileHeader)) {
+            mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            LOG(ERROR) << "Failed to map " << path;
+            return nullptr;
+        }
+
+        std::shared_ptr<Recording> recording(new Recording(mapped, info.st_size));
+        const auto* header = static_cast<const ReplayFileHeader*>(mapped);
+        if (header->magic != kReplayMagic || header->version != kReplayVersion ||
+            !isSupportedPixelFormat(header->pixelFormat) || header->width == 0 ||
+            header->height == 0 ||
+            header->bytesPerLine != getBytesPerLine(header->pixelFormat, header->width)) {
+            LOG(ERROR) << path << " is not a recording this version can play";
+            return nullptr;
+        }
+        recording->mHeader = *header;
+
+        // A recording which was cut short ends at the last complete frame
+        const auto* bytes = static_cast<const uint8_t*>(mapped);
+        size_t offset = sizeof(ReplayFileHeader);
+        while (offset + sizeof(ReplayFrameHeader) <= recording->mSize) {
+            ReplayFrameHeader frame;
+            memcpy(&frame, bytes + offset, sizeof(frame));
+            offset += sizeof(frame);
+            if (frame.size > recording->mSize - offset) {
+                break;
+            }
+            recording->mFrames.push_back({bytes + offset, frame.size, frame.timestampNs});
+            offset += alignTo8(frame.size);
+        }
+        if (recording->mFrames.empty()) {
+            LOG(ERROR) << path << " holds no frame";
+            return nullptr;
+        }
+
+        return recording;
+    }
+
+    ~Recording() { ::munmap(mMapped, mSize); }
+
+    const ReplayFileHeader& getHeader() const { return mHeader; }
+    const Frame& getFrame(uint64_t index) const { return mFrames[index % mFrames.size()]; }
+
+    // Time between a frame and the next one; the last frame is followed by the first one again
+    // after an average interval
+    int64_t getIntervalNs(uint64_t index) const {
+        const size_t count = mFrames.size();
+        const int64_t averageNs = count > 1
+                ? (mFrames.back().timestampNs - mFrames.front().timestampNs) / (count - 1)
+                : 1000000000LL / kDefaultFps;
+        const size_t current = index % count;
+        if (current + 1 == count) {
+            return averageNs;
+        }
+        return mFrames[current + 1].timestampNs - mFrames[current].timestampNs;
+    }
+
+    uint32_t getAverageFps() const {
+        const int64_t averageNs = getIntervalNs(mFrames.size() - 1);
+        return averageNs > 0 ? std::max<int64_t>(1, (1000000000LL + averageNs / 2) / averageNs)
+                             : kDefaultFps;
+    }
+
+private:
+    Recording(void* mapped, size_t size) : mMapped(mapped), mSize(size) {}
+
+    void* mMapped;
+    size_t mSize;
+    ReplayFileHeader mHeader = {};
+    std::vector<Frame> mFrames;
+};
+
+}  // namespace
+
+struct ReplaySysCall::Device {
+    std::string name;
+
+    // What to play and how
+    uint32_t pixelFormat = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> sizes;
+    std::shared_ptr<Recording> recording;
+    uint32_t fps = 0;  // Zero follows the timestamps of the recording
+    int64_t jitterNs = 0;
+    uint32_t dropPercent = 0;
+    uint32_t dropEvery = 0;
+    uint32_t seed = 0;
+
+    std::mutex lock;
+    std::condition_variable signal;
+
+    // Current format
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    // A buffer allocated here lives in a memfd of its own, so it can be mapped through the file
+    // descriptor of the device and exported as a stand-in for a dmabuf.  An imported buffer is
+    // a duplicate of the dmabuf the client queued, mapped while the device holds it.
+    struct Buffer {
+        int fd = -1;
+        int clientFd = -1;  // The descriptor of an imported buffer as the client knows it
+        uint8_t* data = nullptr;
+        size_t length = 0;
+        bool queued = false;  // Held by the device, from VIDIOC_QBUF until VIDIOC_DQBUF
+
+        void release() {
+            if (data != nullptr) {
+                ::munmap(data, length);
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            *this = {};
+        }
+    };
+
+    int owner = -1;  // The file descriptor which requested the buffers, signaled for new frames
+    uint32_t memory = V4L2_MEMORY_MMAP;
+    uint32_t maxBuffers = kMaxBuffers;  // As many as the driver accepts in VIDIOC_REQBUFS
+    uint32_t bytesPerLinePadding = 0;
+    size_t bufferSize = 0;  // Of the buffers allocated here
+    std::vector<Buffer> buffers;
+    std::deque<uint32_t> queued;
+    std::deque<v4l2_buffer> done;
+
+    bool streaming = false;
+    std::thread producer;
+    uint64_t frameIndex = 0;
+    uint32_t sequence = 0;
+
+    uint32_t getBytesPerLine() const {
+        return ::getBytesPerLine(pixelFormat, width, bytesPerLinePadding);
+    }
+    uint32_t getImageSize() const {
+        return ::getImageSize(pixelFormat, width, height, bytesPerLinePadding);
+    }
+};
+
+const std::vector<std::string>& ReplaySysCall::install() {
+    char path[PROPERTY_VALUE_MAX] = "\0";
+    property_get(kPropReplayConfig, path, "");
+    return install(path);
+}
+
+const std::vector<std::string>& ReplaySysCall::install(const std::string& configPath) {
+    static std::once_flag once;
+    static std::vector<std::string> deviceNames;
+    std::call_once(once, [&configPath] {
+        if (configPath.empty()) {
+            return;
+        }
+
+        // Stays installed for the lifetime of the process, as the default instance does
+        ReplaySysCall* replay = new ReplaySysCall();
+        if (!replay->loadDevices(configPath)) {
+            delete replay;
+            return;
+        }
+
+        for (const auto& [name, device] : replay->mDevices) {
+            deviceNames.emplace_back(name);
+        }
+        SysCall::updateInstance(replay);
+        sInstalled = replay;
+        LOG(INFO) << deviceNames.size() << " replay devices are installed from " << configPath;
+    });
+
+    return deviceNames;
+}
+
+bool ReplaySysCall::addDevices(const std::string& configPath) {
+    return sInstalled != nullptr && sInstalled->loadDevices(configPath);
+}
+
+bool ReplaySysCall::isReplayDevice(const v4l2_capability& caps) {
+    return strncmp(reinterpret_cast<const char*>(caps.driver), kDriverName,
+                   sizeof(caps.driver)) == 0;
+}
+
+bool ReplaySysCall::loadDevices(const std::string& configPath) {
+    std::ifstream config(configPath);
+    if (!config) {
+        LOG(ERROR) << "Failed to open " << configPath;
+        return false;
+    }
+
+    std::map<std::string, std::shared_ptr<Device>> devices;
+    std::string line;
+    while (std::getline(config, line)) {
+        std::istringstream tokens(line.substr(0, line.find('#')));
+        std::string name, source;
+        if (!(tokens >> name >> source)) {
+            continue;
+        }
+
+        auto device = std::make_shared<Device>();
+        device->name = name;
+        if (source.rfind("synthetic:", 0) == 0) {
+            std::istringstream fields(source.substr(strlen("synthetic:")));
+            std::string field;
+            std::getline(fields, field, ':');
+            device->pixelFormat = parsePixelFormat(field);
+            while (std::getline(fields, field, ':')) {
+                uint32_t width = 0, height = 0;
+                if (sscanf(field.data(), "%ux%u", &width, &height) == 2 && width > 1 &&
+                    height > 1) {
+                    device->sizes.emplace_back(width & ~1u, height & ~1u);
+                }
+            }
+            device->fps = kDefaultFps;
+        } else {
+            device->recording = Recording::Load(source);
+            if (device->recording) {
+                const auto& header = device->recording->getHeader();
+                device->pixelFormat = header.pixelFormat;
+                device->sizes.emplace_back(header.width, header.height);
+            }
+        }
+        if (!isSupportedPixelFormat(device->pixelFormat) || device->sizes.empty()) {
+            LOG(ERROR) << "Ignoring replay device " << name << " with an invalid source "
+                       << source;
+            continue;
+        }
+
+        std::string option;
+        while (tokens >> option) {
+            const auto separator = option.find('=');
+            const std::string key = option.substr(0, separator);
+            const long value = separator != std::string::npos
+                    ? strtol(option.data() + separator + 1, nullptr, 10)
+                    : 0;
+            if (key == "fps" && value > 0) {
+                device->fps = value;
+            } else if (key == "jitter_us" && value >= 0) {
+                device->jitterNs = value * 1000;
+            } else if (key == "drop_percent" && value >= 0 && value <= 100) {
+                device->dropPercent = value;
+            } else if (key == "drop_every" && value >= 0) {
+                device->dropEvery = value;
+            } else if (key == "seed" && value >= 0) {
+                device->seed = value;
+            } else if (key == "max_buffers" && value > 0) {
+                device->maxBuffers = std::min<uint32_t>(value, kMaxBuffers);
+            } else if (key == "padding" && value >= 0 && !device->recording) {
+                // Recorded frames keep the rows they were recorded with
+                device->bytesPerLinePadding = value;
+            } else {
+                LOG(WARNING) << "Ignoring an invalid option of " << name << ": " << option;
+            }
+        }
+
+        device->width = device->sizes[0].first;
+        device->height = device->sizes[0].second;
+        LOG(INFO) << "Replay device " << name << " plays " << source;
+        devices.insert_or_assign(name, std::move(device));
+    }
+    if (devices.empty()) {
+        return false;
+    }
+
+    // Devices already open keep playing what they were opened with
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto& [name, device] : devices) {
+        mDevices.insert_or_assign(name, std::move(device));
+    }
+    return true;
+}
+
+std::shared_ptr<ReplaySysCall::Device> ReplaySysCall::getDevice(int fd) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mHandles.find(fd);
+    return it != mHandles.end() ? it->second : nullptr;
+}
+
+int ReplaySysCall::open(const char* pathname, int flags) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mDevices.find(pathname);
+    if (it == mDevices.end()) {
+        return SysCall::open(pathname, flags);
+    }
+
+    // An eventfd stands in for the device; it is readable while frames are ready, which is
+    // what the capture engine waits for
+    const int fd = eventfd(0, EFD_CLOEXEC | EFD_SEMAPHORE |
+                                      ((flags & O_NONBLOCK) ? EFD_NONBLOCK : 0));
+    if (fd >= 0) {
+        mHandles.emplace(fd, it->second);
+    }
+    return fd;
+}
+
+int ReplaySysCall::close(int fd) {
+    std::shared_ptr<Device> device;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mHandles.find(fd);
+        if (it == mHandles.end()) {
+            return SysCall::close(fd);
+        }
+        device = std::move(it->second);
+        mHandles.erase(it);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(device->lock);
+        if (device->owner == fd) {
+            stopStream_Locked(*device, lock);
+            releaseBuffers_Locked(*device);
+        }
+    }
+    return ::close(fd);
+}
+
+void* ReplaySysCall::mmap(void* addr, size_t len, int prot, int flag, int filedes, off_t off) {
+    auto device = getDevice(filedes);
+    if (!device) {
+        return SysCall::mmap(addr, len, prot, flag, filedes, off);
+    }
+
+    // The offset picks the buffer, as VIDIOC_QUERYBUF reports it
+    std::lock_guard<std::mutex> lock(device->lock);
+    if (device->memory != V4L2_MEMORY_MMAP || device->bufferSize == 0 ||
+        off % device->bufferSize != 0 || off / device->bufferSize >= device->buffers.size()) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    return ::mmap(addr, len, prot, flag, device->buffers[off / device->bufferSize].fd, 0);
+}
+
+int ReplaySysCall::ioctl(int fd, int request, struct v4l2_capability* arg) {
+    auto device = getDevice(fd);
+    if (!device) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+    if (request != (int)VIDIOC_QUERYCAP) {
+        errno = ENOTTY;
+        return -1;
+    }
+
+    memset(arg, 0, sizeof(*arg));
+    snprintf(reinterpret_cast<char*>(arg->driver), sizeof(arg->driver), "%s", kDriverName);
+    snprintf(reinterpret_cast<char*>(arg->card), sizeof(arg->card), "%s", device->name.data());
+    snprintf(reinterpret_cast<char*>(arg->bus_info), sizeof(arg->bus_info), "platform:%s",
+             kDriverName);
+    arg->version = 0x00010000;
+    arg->device_caps = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+    arg->capabilities = arg->device_caps | V4L2_CAP_DEVICE_CAPS;
+    return 0;
+}
+
+int ReplaySysCall::ioctl(int fd, int request, v4l2_fmtdesc* arg) {
+    auto device = getDevice(fd);
+    if (!device) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+    if (request != (int)VIDIOC_ENUM_FMT || arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+        arg->index != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    arg->flags = device->pixelFormat == V4L2_PIX_FMT_MJPEG ? V4L2_FMT_FLAG_COMPRESSED : 0;
+    arg->pixelformat = device->pixelFormat;
+    snprintf(reinterpret_cast<char*>(arg->description), sizeof(arg->description), "%.4s",
+             reinterpret_cast<const char*>(&device->pixelFormat));
+    return 0;
+}
+
+int ReplaySysCall::ioctl(int fd, int request, struct v4l2_frmsizeenum* arg) {
+    auto device = getDevice(fd);
+    if (!device) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+    if (request != (int)VIDIOC_ENUM_FRAMESIZES || arg->pixel_format != device->pixelFormat ||
+        arg->index >= device->sizes.size()) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    arg->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+    arg->discrete.width = device->sizes[arg->index].first;
+    arg->discrete.height = device->sizes[arg->index].second;
+    return 0;
+}
+
+int ReplaySysCall::ioctl(int fd, int request, struct v4l2_frmivalenum* arg) {
+    auto device = getDevice(fd);
+    if (!device) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+    const auto size = std::make_pair(arg->width, arg->height);
+    if (request != (int)VIDIOC_ENUM_FRAMEINTERVALS || arg->pixel_format != device->pixelFormat ||
+        arg->index != 0 ||
+        std::find(device->sizes.begin(), device->sizes.end(), size) == device->sizes.end()) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    arg->type = V4L2_FRMIVAL_TYPE_DISCRETE;
+    arg->discrete.numerator = 1;
+    arg->discrete.denominator =
+            device->fps > 0 ? device->fps : device->recording->getAverageFps();
+    return 0;
+}
+
+int ReplaySysCall::ioctl(int fd, int request, struct v4l2_format* arg) {
+    auto device = getDevice(fd);
+    if (!device) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+    if (arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(device->lock);
+    uint32_t width = device->width;
+    uint32_t height = device->height;
+    if (request == (int)VIDIOC_S_FMT || request == (int)VIDIOC_TRY_FMT) {
+        // The closest match is the requested size if there is one, as the pixel format is fixed
+        const auto size = std::make_pair(arg->fmt.pix.width, arg->fmt.pix.height);
+        const bool found =
+                std::find(device->sizes.begin(), device->sizes.end(), size) != device->sizes.end();
+        width = found ? size.first : device->sizes[0].first;
+        height = found ? size.second : device->sizes[0].second;
+        if (request == (int)VIDIOC_S_FMT) {
+            if (!device->buffers.empty() &&
+                (width != device->width || height != device->height)) {
+                errno = EBUSY;
+                return -1;
+            }
+            device->width = width;
+            device->height = height;
+        }
+    } else if (request != (int)VIDIOC_G_FMT) {
+        errno = ENOTTY;
+        return -1;
+    }
+
+    memset(&arg->fmt.pix, 0, sizeof(arg->fmt.pix));
+    arg->fmt.pix.width = width;
+    arg->fmt.pix.height = height;
+    arg->fmt.pix.pixelformat = device->pixelFormat;
+    arg->fmt.pix.field = V4L2_FIELD_NONE;
+    arg->fmt.pix.bytesperline = getBytesPerLine(device->pixelFormat, width,
+                                                device->bytesPerLinePadding);
+    arg->fmt.pix.sizeimage = getImageSize(device->pixelFormat, width, height,
+                                          device->bytesPerLinePadding);
+    arg->fmt.pix.colorspace = V4L2_COLORSPACE_SMPTE170M;
+    return 0;
+}
+
+int ReplaySysCall::ioctl(int fd, int request, struct v4l2_requestbuffers* arg) {
+    auto device = getDevice(fd);
+    if (!device) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+    if (request != (int)VIDIOC_REQBUFS || arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+        (arg->memory != V4L2_MEMORY_MMAP && arg->memory != V4L2_MEMORY_DMABUF)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(device->lock);
+    if (device->streaming || (device->owner >= 0 && device->owner != fd)) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    releaseBuffers_Locked(*device);
+    if (arg->count == 0) {
+        return 0;
+    }
+
+    // Like a driver, grant fewer buffers than requested if it can't take that many
+    const uint32_t count = std::min(arg->count, device->maxBuffers);
+    device->memory = arg->memory;
+    device->buffers.resize(count);
+    if (arg->memory == V4L2_MEMORY_MMAP) {
+        const size_t pageSize = sysconf(_SC_PAGESIZE);
+        const size_t bufferSize = (device->getImageSize() + pageSize - 1) / pageSize * pageSize;
+        for (auto& buffer : device->buffers) {
+            buffer.fd = memfd_create(device->name.data(), MFD_CLOEXEC);
+            void* data = MAP_FAILED;
+            if (buffer.fd >= 0 && ftruncate(buffer.fd, bufferSize) == 0) {
+                data = ::mmap(nullptr, bufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, buffer.fd,
+                              0);
+            }
+            if (data == MAP_FAILED) {
+                PLOG(ERROR) << "Failed to allocate buffers for " << device->name;
+                releaseBuffers_Locked(*device);
+                errno = ENOMEM;
+                return -1;
+            }
+            buffer.data = static_cast<uint8_t*>(data);
+            buffer.length = bufferSize;
+        }
+        device->bufferSize = bufferSize;
+    }
+
+    device->owner = fd;
+    arg->count = count;
+    return 0;
+}
+
+int ReplaySysCall::ioctl(int fd, int request, struct v4l2_buffer* arg) {
+    auto device = getDevice(fd);
+    if (!device) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+
+    if (request == (int)VIDIOC_DQBUF) {
+        // One count of the eventfd per completed frame
+        uint64_t count;
+        if (::read(fd, &count, sizeof(count)) != sizeof(count)) {
+            return -1;
+        }
+
+        std::lock_guard<std::mutex> lock(device->lock);
+        if (device->done.empty()) {
+            errno = EAGAIN;
+            return -1;
+        }
+        *arg = device->done.front();
+        device->done.pop_front();
+        device->buffers[arg->index].queued = false;
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(device->lock);
+    if (arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE || arg->memory != device->memory ||
+        arg->index >= device->buffers.size()) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    Device::Buffer& buffer = device->buffers[arg->index];
+    if (request == (int)VIDIOC_QUERYBUF) {
+        arg->length = buffer.length;
+        if (device->memory == V4L2_MEMORY_MMAP) {
+            arg->m.offset = arg->index * device->bufferSize;
+        } else {
+            arg->m.fd = buffer.clientFd;
+        }
+        arg->flags = (device->memory == V4L2_MEMORY_MMAP ? V4L2_BUF_FLAG_MAPPED : 0) |
+                (buffer.queued ? V4L2_BUF_FLAG_QUEUED : 0) | V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+        return 0;
+    } else if (request == (int)VIDIOC_QBUF) {
+        if (buffer.queued ||
+            (device->memory == V4L2_MEMORY_DMABUF && !importBuffer_Locked(*device, *arg))) {
+            errno = EINVAL;
+            return -1;
+        }
+        buffer.queued = true;
+        device->queued.push_back(arg->index);
+        return 0;
+    }
+
+    errno = ENOTTY;
+    return -1;
+}
+
+int ReplaySysCall::ioctl(int fd, int request, enum v4l2_buf_type* arg) {
+    auto device = getDevice(fd);
+    if (!device) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+    if (*arg != V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    std::unique_lock<std::mutex> lock(device->lock);
+    if (request == (int)VIDIOC_STREAMON) {
+        if (device->owner != fd) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (!device->streaming) {
+            // Every session starts from the first frame with the same random choices
+            device->streaming = true;
+            device->frameIndex = 0;
+            device->sequence = 0;
+            device->producer = std::thread(runProducer, device.get());
+        }
+        return 0;
+    } else if (request == (int)VIDIOC_STREAMOFF) {
+        if (device->owner == fd) {
+            stopStream_Locked(*device, lock);
+        }
+        return 0;
+    }
+
+    errno = ENOTTY;
+    return -1;
+}
+
+int ReplaySysCall::ioctl(int fd, int request, struct v4l2_control* arg) {
+    if (!getDevice(fd)) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+
+    // Replay devices have no controls
+    errno = EINVAL;
+    return -1;
+}
+
+int ReplaySysCall::ioctl(int fd, int request, struct v4l2_queryctrl* arg) {
+    if (!getDevice(fd)) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+int ReplaySysCall::ioctl(int fd, int request, struct v4l2_exportbuffer* arg) {
+    auto device = getDevice(fd);
+    if (!device) {
+        return SysCall::ioctl(fd, request, arg);
+    }
+    if (request != (int)VIDIOC_EXPBUF || arg->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+        arg->plane != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(device->lock);
+    if (device->memory != V4L2_MEMORY_MMAP || arg->index >= device->buffers.size()) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // The memfd of the buffer stands in for a dmabuf; its mappings see the frames as they are
+    // written
+    const int exported = fcntl(device->buffers[arg->index].fd,
+                               (arg->flags & O_CLOEXEC) ? F_DUPFD_CLOEXEC : F_DUPFD, 0);
+    if (exported < 0) {
+        return -1;
+    }
+    arg->fd = exported;
+    return 0;
+}
+
+bool ReplaySysCall::importBuffer_Locked(Device& device, const v4l2_buffer& arg) {
+    // A dmabuf queued again is still mapped from the last time
+    Device::Buffer& buffer = device.buffers[arg.index];
+    struct stat queuedStat, mappedStat;
+    if (fstat(arg.m.fd, &queuedStat) != 0) {
+        return false;
+    }
+    if (buffer.data != nullptr && buffer.clientFd == arg.m.fd &&
+        fstat(buffer.fd, &mappedStat) == 0 && mappedStat.st_dev == queuedStat.st_dev &&
+        mappedStat.st_ino == queuedStat.st_ino) {
+        return true;
+    }
+
+    // Like videobuf2, reject a dmabuf which can't hold a whole frame
+    const off_t size = lseek(arg.m.fd, 0, SEEK_END);
+    lseek(arg.m.fd, 0, SEEK_SET);
+    const size_t length = arg.length > 0 ? arg.length : size;
+    if (size < 0 || length < device.getImageSize() || length > static_cast<size_t>(size)) {
+        LOG(ERROR) << "Dmabuf " << arg.m.fd << " of " << size << " bytes can't hold a frame of "
+                   << device.getImageSize() << " bytes";
+        return false;
+    }
+
+    const int fd = fcntl(arg.m.fd, F_DUPFD_CLOEXEC, 0);
+    void* data = fd >= 0
+            ? ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+            : MAP_FAILED;
+    if (data == MAP_FAILED) {
+        PLOG(ERROR) << "Failed to map dmabuf " << arg.m.fd;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+
+    buffer.release();
+    buffer.fd = fd;
+    buffer.clientFd = arg.m.fd;
+    buffer.data = static_cast<uint8_t*>(data);
+    buffer.length = length;
+    return true;
+}
+
+void ReplaySysCall::stopStream_Locked(Device& device, std::unique_lock<std::mutex>& lock) {
+    if (device.streaming) {
+        device.streaming = false;
+        device.signal.notify_all();
+        lock.unlock();
+        device.producer.join();
+        lock.lock();
+    }
+
+    // Like a driver, give every buffer back to the client
+    device.queued.clear();
+    device.done.clear();
+    for (auto& buffer : device.buffers) {
+        buffer.queued = false;
+    }
+    if (device.owner >= 0) {
+        uint64_t count;
+        while (::read(device.owner, &count, sizeof(count)) == sizeof(count) && count > 0) {
+            // Drains the frames which are no longer available
+        }
+    }
+}
+
+void ReplaySysCall::releaseBuffers_Locked(Device& device) {
+    // Mappings of the client keep the memory alive until it unmaps them
+    for (auto& buffer : device.buffers) {
+        buffer.release();
+    }
+
+    device.owner = -1;
+    device.memory = V4L2_MEMORY_MMAP;
+    device.bufferSize = 0;
+    device.buffers.clear();
+    device.queued.clear();
+    device.done.clear();
+}
+
+void ReplaySysCall::runProducer(Device* device) {
+    std::minstd_rand random(device->seed + 1);
+    std::unique_lock<std::mutex> lock(device->lock);
+    auto nextFrameTime = std::chrono::steady_clock::now();
+    while (device->streaming) {
+        const uint64_t frame = device->frameIndex;
+        const int64_t intervalNs = device->fps > 0 ? 1000000000LL / device->fps
+                                                   : device->recording->getIntervalNs(frame);
+        const int64_t jitterNs = device->jitterNs > 0
+                ? static_cast<int64_t>(random() % (2 * device->jitterNs + 1)) - device->jitterNs
+                : 0;
+        const bool drop = (device->dropEvery > 0 && (frame + 1) % device->dropEvery == 0) ||
+                (device->dropPercent > 0 && random() % 100 < device->dropPercent);
+
+        // Jitter moves single frames, not the whole timeline
+        device->signal.wait_until(lock, nextFrameTime + std::chrono::nanoseconds(jitterNs),
+                                  [device] { return !device->streaming; });
+        if (!device->streaming) {
+            break;
+        }
+        nextFrameTime += std::chrono::nanoseconds(intervalNs);
+        ++device->frameIndex;
+        const uint32_t sequence = device->sequence++;
+
+        // A dropped frame, or one without a free buffer, leaves a gap in the sequence numbers
+        if (drop || device->queued.empty()) {
+            continue;
+        }
+        const uint32_t index = device->queued.front();
+        device->queued.pop_front();
+
+        // The buffer belongs to us until it is done, so it is filled without holding the lock
+        uint8_t* dst = device->buffers[index].data;
+        uint32_t bytesUsed = device->getImageSize();
+        lock.unlock();
+        if (device->recording) {
+            const auto& recorded = device->recording->getFrame(frame);
+            bytesUsed = std::min<uint32_t>(recorded.size, bytesUsed);
+            memcpy(dst, recorded.data, bytesUsed);
+        } else {
+            fillColorBars(device->pixelFormat, device->width, device->height,
+                          device->getBytesPerLine(), frame, dst);
+        }
+        lock.lock();
+        if (!device->streaming) {
+            break;
+        }
+
+        v4l2_buffer buffer = {};
+        buffer.index = index;
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = device->memory;
+        buffer.bytesused = bytesUsed;
+        buffer.length = device->buffers[index].length;
+        if (device->memory == V4L2_MEMORY_MMAP) {
+            buffer.m.offset = index * device->bufferSize;
+        } else {
+            buffer.m.fd = device->buffers[index].clientFd;
+        }
+        buffer.field = V4L2_FIELD_NONE;
+        buffer.sequence = sequence;
+        buffer.flags = (device->memory == V4L2_MEMORY_MMAP ? V4L2_BUF_FLAG_MAPPED : 0) |
+                V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC |
+                V4L2_BUF_FLAG_TSTAMP_SRC_EOF;
+        const int64_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        buffer.timestamp.tv_sec = now / 1000000000LL;
+        buffer.timestamp.tv_usec = (now % 1000000000LL) / 1000;
+        device->done.push_back(buffer);
+
+        const uint64_t one = 1;
+        if (::write(device->owner, &one, sizeof(one)) != sizeof(one)) {
+            PLOG(WARNING) << "Failed to signal a frame of " << device->name;
+        }
+    }
+}
+
+std::unique_ptr<ReplayRecorder> ReplayRecorder::Create(const std::string& path,
+                                                       uint32_t pixelFormat, uint32_t width,
+                                                       uint32_t height, uint32_t bytesPerLine) {
+    if (!isSupportedPixelFormat(pixelFormat) ||
+        bytesPerLine != getBytesPerLine(pixelFormat, width)) {
+        LOG(ERROR) << "Recordings of format 0x" << std::hex << pixelFormat << " with "
+                   << std::dec << bytesPerLine << " bytes per line are not supported";
+        return nullptr;
+    }
+
+    const int fd = ::open(path.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                          S_IRUSR | S_IWUSR | S_IRGRP);
+    if (fd < 0) {
+        PLOG(ERROR) << "Failed to create " << path;
+        return nullptr;
+    }
+
+    std::unique_ptr<ReplayRecorder> recorder(new ReplayRecorder(fd));
+    const ReplayFileHeader header = {
+            .magic = kReplayMagic,
+            .version = kReplayVersion,
+            .pixelFormat = pixelFormat,
+            .width = width,
+            .height = height,
+            .bytesPerLine = bytesPerLine,
+            .reserved = {},
+    };
+    if (::write(fd, &header, sizeof(header)) != sizeof(header)) {
+        PLOG(ERROR) << "Failed to write " << path;
+        return nullptr;
+    }
+
+    return recorder;
+}
+
+ReplayRecorder::ReplayRecorder(int fd) : mFd(fd), mSlots(kRecorderSlots) {
+    mWriter = std::thread([this] { writerLoop(); });
+}
+
+ReplayRecorder::~ReplayRecorder() {
+    finish();
+    ::close(mFd);
+}
+
+bool ReplayRecorder::record(int64_t timestampNs, const void* data, uint32_t size) {
+    size_t idx = 0;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mFailed) {
+            return false;
+        }
+
+        const auto freeSlot = std::find_if(mSlots.begin(), mSlots.end(), [](const Slot& slot) {
+            return slot.state == SlotState::FREE;
+        });
+        if (mStopping || freeSlot == mSlots.end()) {
+            ++mNumDropped;
+            return true;
+        }
+
+        idx = freeSlot - mSlots.begin();
+        mSlots[idx].state = SlotState::FILLING;
+    }
+
+    if (!mHasFirstFrame) {
+        mHasFirstFrame = true;
+        mFirstTimestampNs = timestampNs;
+    }
+
+    // Only the capture thread fills slots, and nobody else touches one while it is filled
+    Slot& slot = mSlots[idx];
+    slot.timestampNs = timestampNs - mFirstTimestampNs;
+    slot.size = size;
+    if (slot.buffer.size() < size) {
+        slot.buffer.resize(size);
+    }
+    memcpy(slot.buffer.data(), data, size);
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        slot.state = SlotState::QUEUED;
+        mQueue.push_back(idx);
+    }
+    mSignal.notify_one();
+    return true;
+}
+
+void ReplayRecorder::finish() {
+    std::lock_guard<std::mutex> finishLock(mFinishLock);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mSignal.notify_all();
+
+    if (mWriter.joinable()) {
+        mWriter.join();
+    }
+}
+
+uint64_t ReplayRecorder::getNumFrames() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mNumFrames;
+}
+
+uint64_t ReplayRecorder::getNumDropped() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mNumDropped;
+}
+
+void ReplayRecorder::writerLoop() {
+    // Writing yields to capturing and converting frames
+    pthread_setname_np(pthread_self(), "EvsReplayRecord");
+    if (setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND) != 0) {
+        PLOG(WARNING) << "Failed to lower the priority of the replay recorder thread";
+    }
+
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mSignal.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+        if (mQueue.empty() || mFailed) {
+            // Stopping, and every frame which was waiting is written
+            return;
+        }
+
+        Slot& slot = mSlots[mQueue.front()];
+        mQueue.pop_front();
+        slot.state = SlotState::WRITING;
+
+        lock.unlock();
+        const bool written = writeSlot(slot);
+        lock.lock();
+
+        if (written) {
+            ++mNumFrames;
+        } else {
+            // A frame missing in the middle would shift the timing of the rest; the recording
+            // ends here
+            mFailed = true;
+            mQueue.clear();
+        }
+        slot.state = SlotState::FREE;
+    }
+}
+
+bool ReplayRecorder::writeSlot(const Slot& slot) {
+    const ReplayFrameHeader header = {
+            .timestampNs = slot.timestampNs,
+            .size = slot.size,
+            .reserved = 0,
+    };
+    static const uint8_t padding[8] = {};
+    const iovec parts[] = {
+            {const_cast<ReplayFrameHeader*>(&header), sizeof(header)},
+            {const_cast<uint8_t*>(slot.buffer.data()), slot.size},
+            {const_cast<uint8_t*>(padding), alignTo8(slot.size) - slot.size},
+    };
+    const ssize_t length = sizeof(header) + alignTo8(slot.size);
+    if (::writev(mFd, parts, 3) != length) {
+        PLOG(ERROR) << "Failed to record a frame";
+        return false;
+    }
+    return true;
+}
@@ -15,6 +15,8 @@
  */
 
 #include "VideoCapture.h"
+#include "CaptureEngine.h"
+#include "SysCall.h"
 #include <vector>
 #include <string.h>
 
@@ -30,17 +32,54 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <cutils/properties.h>
+#include <utils/Timers.h>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <iomanip>
+#include <map>
 
 // NOTE:  This developmental code does not properly clean up resources in case of failure
 //        during the resource setup phase.  Of particular note is the potential to leak
 //        the file descriptor.  This must be fixed before using this code for anything but
 //        experimentation.
 
+using ::aidl::android::hardware::automotive::evs::implementation::CapabilityCache;
+using ::aidl::android::hardware::automotive::evs::implementation::CaptureEngine;
+
 const std::string kPropEvsDQBufFPS = "vendor.camera.fps.evs.dqbuf";
 
+// Whether MJPEG is captured when YUYV can't deliver the requested size at full rate: auto or off
+constexpr char kPropMjpegMode[] = "vendor.evs.v4l2.mjpeg";
+
+// Sizes each pixel format is captured in at 30 frames per second or more
+using FastSizes = std::map<uint32_t, std::set<std::pair<uint32_t, uint32_t>>>;
+
+// Chooses MJPEG when YUYV can't deliver width x height at full rate but MJPEG can, either at that
+// size or at twice, four or eight times the size, which the decoder scales down cheaply.  Returns
+// the scale, or 0 to capture YUYV.
+uint32_t selectMjpegScale(const FastSizes& fastSizes, uint32_t width, uint32_t height) {
+    char mode[PROPERTY_VALUE_MAX] = "\0";
+    property_get(kPropMjpegMode, mode, "auto");
+    const auto mjpeg = fastSizes.find(V4L2_PIX_FMT_MJPEG);
+    if (strcmp(mode, "off") == 0 || mjpeg == fastSizes.end() || width == 0 || height == 0) {
+        return 0;
+    }
+
+    const auto yuyv = fastSizes.find(V4L2_PIX_FMT_YUYV);
+    if (yuyv != fastSizes.end() && yuyv->second.count({width, height}) > 0) {
+        return 0;
+    }
+
+    for (uint32_t scale = 1; scale <= 8; scale *= 2) {
+        if (mjpeg->second.count({width * scale, height * scale}) > 0) {
+            return scale;
+        }
+    }
+    return 0;
+}
+
 int getPropValue(const std::string& prop)
 {
     int value = 0;
@@ -60,7 +99,8 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
     LOG(INFO) <<"App requested resolution "<<width <<" "<<height;
 
     // If we want a polling interface for getting frames, we would use O_NONBLOCK
-    mDeviceFd = ::open(deviceName, O_RDWR| O_NONBLOCK, 0);
+    SysCall* sysCall = SysCall::getInstance();
+    mDeviceFd = sysCall->open(deviceName, O_RDWR | O_NONBLOCK);
     if (mDeviceFd < 0) {
         PLOG(ERROR) << "failed to open device " << deviceName;
         return false;
@@ -68,7 +108,7 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
 
     v4l2_capability caps;
     {
-        int result = ioctl(mDeviceFd, VIDIOC_QUERYCAP, &caps);
+        int result = sysCall->ioctl(mDeviceFd, VIDIOC_QUERYCAP, &caps);
         if (result < 0) {
             PLOG(ERROR) << "failed to get device caps for " << deviceName;
             return false;
@@ -97,59 +137,55 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
     LOG(DEBUG) << "  All Caps: " << std::hex << std::setw(8) << caps.capabilities;
     LOG(DEBUG) << "  Dev Caps: " << std::hex << caps.device_caps;
 
-    // Enumerate the available capture formats (if any)
+    // Enumerate the available capture formats (if any), which is answered from the cache of
+    // device capabilities unless this kind of device has not been seen yet
+    mCapabilities = CapabilityCache::getInstance().get(deviceName, mDeviceFd, caps);
     LOG(DEBUG) << "Supported capture formats:";
-    v4l2_fmtdesc formatDescriptions;
-    formatDescriptions.type = mBufferType;
-    for (int i = 0; true; i++) {
-        formatDescriptions.index = i;
-        if (ioctl(mDeviceFd, VIDIOC_ENUM_FMT, &formatDescriptions) == 0) {
-            LOG(DEBUG) << "  icotl formats..." << std::setw(2) << i << ": " << formatDescriptions.description << " "
-                       << std::hex << std::setw(8) << formatDescriptions.pixelformat << " "
-                       << std::hex << formatDescriptions.flags;
-            // auto detect USB camera resolution
-            struct v4l2_frmsizeenum frmsize;
-            frmsize.pixel_format = formatDescriptions.pixelformat;
-            frmsize.index = 0;
-            while (ioctl(mDeviceFd, VIDIOC_ENUM_FRAMESIZES, &frmsize) >= 0) {
-                struct v4l2_frmivalenum frmival;
-                memset(&frmival, 0, sizeof(frmival));
-                frmival.pixel_format = formatDescriptions.pixelformat;
-                if (frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
-                    frmival.width = frmsize.discrete.width;
-                    frmival.height = frmsize.discrete.height;
-                    while (ioctl(mDeviceFd, VIDIOC_ENUM_FRAMEINTERVALS, &frmival) == 0) {
-                        if ((frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE) &&
-                            (1.0 * frmival.discrete.denominator / frmival.discrete.numerator >
-                             29.0) &&
-                            (requestWidth * requestHeight) <
-                                frmsize.discrete.width * frmsize.discrete.height) {
-                            if(frmsize.discrete.width == (uint32_t)width && frmsize.discrete.height == (uint32_t)height) {
-                                requestWidth = frmsize.discrete.width;
-                                requestHeight = frmsize.discrete.height;
-                                LOG(INFO) <<"Driver support this resolution "<<requestWidth<<" "<<requestHeight;
-                                break;
-                            }
+    std::set<uint32_t> pixelFormats;
+    FastSizes fastSizes;
+    for (auto&& format : mCapabilities->formats) {
+        const v4l2_fmtdesc& formatDescriptions = format.desc;
+        LOG(DEBUG) << "  icotl formats..." << std::setw(2) << formatDescriptions.index << ": "
+                   << formatDescriptions.description << " " << std::hex << std::setw(8)
+                   << formatDescriptions.pixelformat << " " << std::hex
+                   << formatDescriptions.flags;
+        pixelFormats.insert(formatDescriptions.pixelformat);
+
+        // auto detect USB camera resolution
+        for (auto&& size : format.sizes) {
+            const v4l2_frmsizeenum& frmsize = size.size;
+            if (frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+                for (auto&& frmival : size.intervals) {
+                    if (frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE &&
+                        frmival.discrete.denominator > 29 * frmival.discrete.numerator) {
+                        fastSizes[frmival.pixel_format].emplace(frmival.width, frmival.height);
+                    }
+                    if ((frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE) &&
+                        (1.0 * frmival.discrete.denominator / frmival.discrete.numerator >
+                         29.0) &&
+                        (requestWidth * requestHeight) <
+                            frmsize.discrete.width * frmsize.discrete.height) {
+                        if(frmsize.discrete.width == (uint32_t)width && frmsize.discrete.height == (uint32_t)height) {
+                            requestWidth = frmsize.discrete.width;
+                            requestHeight = frmsize.discrete.height;
+                            LOG(INFO) <<"Driver support this resolution "<<requestWidth<<" "<<requestHeight;
+                            break;
                         }
-                        frmival.index++;
                     }
-               } else {
-                   LOG(INFO) << "Stepwise: step_width=" << frmsize.stepwise.step_width<< " step_height=" << frmsize.stepwise.step_height;
-                   LOG(INFO) << "min_width = " << frmsize.stepwise.min_width << " min_height=" << frmsize.stepwise.min_height;
-                   LOG(INFO) << "max_width = " << frmsize.stepwise.max_width << " max_height=" << frmsize.stepwise.max_height;
-                   requestWidth = frmsize.stepwise.min_width;
-                   requestHeight = frmsize.stepwise.min_height;
-
                 }
-                frmsize.index++;
+           } else {
+               LOG(INFO) << "Stepwise: step_width=" << frmsize.stepwise.step_width<< " step_height=" << frmsize.stepwise.step_height;
+               LOG(INFO) << "min_width = " << frmsize.stepwise.min_width << " min_height=" << frmsize.stepwise.min_height;
+               LOG(INFO) << "max_width = " << frmsize.stepwise.max_width << " max_height=" << frmsize.stepwise.max_height;
+               requestWidth = frmsize.stepwise.min_width;
+               requestHeight = frmsize.stepwise.min_height;
+
             }
-        } else {
-            // No more formats available
-            break;
         }
     }
 
     // Set our desired output format
+    uint32_t mjpegScale = 0;
     v4l2_format format;
     format.type = mBufferType;
     if (format.type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
@@ -172,34 +208,65 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
         format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
         format.fmt.pix.width = requestWidth > 0 ? requestWidth : width;
         format.fmt.pix.height = requestHeight > 0 ? requestHeight : height;
+
+        // USB cameras often deliver large sizes at full rate only compressed
+        mjpegScale = selectMjpegScale(fastSizes, width, height);
+        if (mjpegScale > 0) {
+            format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+            format.fmt.pix.width = width * mjpegScale;
+            format.fmt.pix.height = height * mjpegScale;
+        } else if (pixelFormats.count(V4L2_PIX_FMT_YUYV) == 0 &&
+                   pixelFormats.count(V4L2_PIX_FMT_MJPEG) > 0) {
+            format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+            mjpegScale = 1;
+        }
     }
 
-    if (ioctl(mDeviceFd, VIDIOC_S_FMT, &format) < 0) {
+    if (sysCall->ioctl(mDeviceFd, VIDIOC_S_FMT, &format) < 0) {
         PLOG(ERROR) << "VIDIOC_S_FMT failed";
     }
 
     // Report the current output format
-    if (ioctl(mDeviceFd, VIDIOC_G_FMT, &format) == 0) {
+    if (sysCall->ioctl(mDeviceFd, VIDIOC_G_FMT, &format) == 0) {
         if (format.type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
             mFormat = format.fmt.pix_mp.pixelformat;
             mWidth = format.fmt.pix_mp.width;
             mHeight = format.fmt.pix_mp.height;
             mStride = format.fmt.pix_mp.plane_fmt[0].bytesperline;
+            mColorspace = format.fmt.pix_mp.colorspace;
+            mYcbcrEncoding = format.fmt.pix_mp.ycbcr_enc;
+            mQuantization = format.fmt.pix_mp.quantization;
+            mImageSize = format.fmt.pix_mp.plane_fmt[0].sizeimage;
         } else {
             mFormat = format.fmt.pix.pixelformat;
             mWidth = format.fmt.pix.width;
             mHeight = format.fmt.pix.height;
             mStride = format.fmt.pix.bytesperline;
+            mColorspace = format.fmt.pix.colorspace;
+            mYcbcrEncoding = format.fmt.pix.ycbcr_enc;
+            mQuantization = format.fmt.pix.quantization;
+            mImageSize = format.fmt.pix.sizeimage;
         }
 
         LOG(INFO) << "Current output format:  "
                   << "fmt=0x" << std::hex << mFormat << ", " << std::dec << mWidth << " x "
-                  << mHeight << ", pitch=" << mStride;
+                  << mHeight << ", pitch=" << mStride << ", colorspace=" << mColorspace
+                  << ", ycbcr_enc=" << mYcbcrEncoding << ", quantization=" << mQuantization;
     } else {
         PLOG(ERROR) << "VIDIOC_G_FMT failed";
         return false;
     }
 
+    // Compressed frames are delivered at the size they are decoded to
+    mCaptureWidth = mWidth;
+    mCaptureHeight = mHeight;
+    if (mFormat == V4L2_PIX_FMT_MJPEG && mjpegScale > 1 &&
+        mWidth == (uint32_t)width * mjpegScale && mHeight == (uint32_t)height * mjpegScale) {
+        mWidth = width;
+        mHeight = height;
+        LOG(INFO) << "MJPEG frames are decoded at 1/" << mjpegScale << " scale";
+    }
+
     // Make sure we're initialized to the STOPPED state
     mRunMode = STOPPED;
     mFrames.clear();
@@ -215,12 +282,14 @@ void VideoCapture::close() {
 
     if (isOpen()) {
         LOG(DEBUG) << "closing video device file handle " << mDeviceFd;
-        ::close(mDeviceFd);
+        SysCall::getInstance()->close(mDeviceFd);
         mDeviceFd = -1;
     }
+    mCapabilities.reset();
 }
 
-bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback) {
+bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback,
+                               const std::vector<ImportedBuffer>& importedBuffers) {
     // Set the state of our background thread
     int prevRunMode = mRunMode.fetch_or(RUN);
     if (prevRunMode & RUN) {
@@ -229,92 +298,173 @@ bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, v
         return false;
     }
 
+    if (!setUpBuffers(importedBuffers)) {
+        releaseBuffers();
+        mRunMode = STOPPED;
+        return false;
+    }
+
+    // Start the video stream
+    v4l2_buf_type type = static_cast<v4l2_buf_type>(mBufferType);
+    if (SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_STREAMON, &type) < 0) {
+        PLOG(ERROR) << "VIDIOC_STREAMON failed";
+       // return false;
+    }
+
+    // Remember who to tell about new frames as they arrive
+    mCallback = callback;
+    mPauseMode = PauseMode::NONE;
+    mFPSDebugEnabled = getPropValue(kPropEvsDQBufFPS) > 0;
+
+    // The capture engine receives and dispatches the video frames of all streams
+    if (!CaptureEngine::getInstance().addDevice(this)) {
+        SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_STREAMOFF, &type);
+        mCallback = nullptr;
+        releaseBuffers();
+        mRunMode = STOPPED;
+        return false;
+    }
+
+    mNumCamerasStreaming++;
+
+    LOG(DEBUG) << "Stream started.";
+    return true;
+}
+
+bool VideoCapture::setUpBuffers(const std::vector<ImportedBuffer>& importedBuffers) {
+    // The buffer queue goes through SysCall so that it can be replaced by a mock
+    SysCall* sysCall = SysCall::getInstance();
+    mMemoryType = importedBuffers.empty() ? V4L2_MEMORY_MMAP : V4L2_MEMORY_DMABUF;
+    const int requested = importedBuffers.empty() ? BUFFER_COUNT : importedBuffers.size();
+
     // Tell the L4V2 driver to prepare our streaming buffers
     v4l2_requestbuffers bufrequest;
+    memset(&bufrequest, 0, sizeof(bufrequest));
     bufrequest.type = mBufferType;
-    bufrequest.memory = V4L2_MEMORY_MMAP;
-    bufrequest.count = BUFFER_COUNT;
-    if (ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest) < 0) {
+    bufrequest.memory = mMemoryType;
+    bufrequest.count = requested;
+    if (sysCall->ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest) < 0) {
         PLOG(ERROR) << "VIDIOC_REQBUFS failed";
         return false;
     }
+    if (mMemoryType == V4L2_MEMORY_DMABUF && bufrequest.count != (__u32)requested) {
+        // Every imported buffer must have a slot, its index identifies it to the caller
+        LOG(ERROR) << "Driver accepts " << bufrequest.count << " of " << requested
+                   << " dmabufs";
+        return false;
+    }
+    if (bufrequest.count < 1) {
+        LOG(ERROR) << "Driver grants no buffers";
+        return false;
+    }
 
-    mNumBuffers = BUFFER_COUNT;
+    // A driver may grant fewer buffers of its own than requested
+    const int numBuffers = bufrequest.count;
+    mNumBuffers = numBuffers;
     mBufferInfos = std::make_unique<v4l2_buffer[]>(mNumBuffers);
+    mPlanes = std::make_unique<v4l2_plane[]>(mNumBuffers * VIDEO_PLANES);
     mPixelBuffers = std::make_unique<void*[]>(mNumBuffers);
+    mMappedSizes = std::make_unique<size_t[]>(mNumBuffers);
+    mDequeueTimesNs = std::make_unique<int64_t[]>(mNumBuffers);
 
     for (int i = 0; i < mNumBuffers; ++i) {
         // Get the information on the buffer that was created for us
         memset(&mBufferInfos[i], 0, sizeof(v4l2_buffer));
         mBufferInfos[i].type = mBufferType;
-        mBufferInfos[i].memory = V4L2_MEMORY_MMAP;
+        mBufferInfos[i].memory = mMemoryType;
         mBufferInfos[i].index = i;
 
-        if (mBufferInfos[i].type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
-            std::vector<struct v4l2_plane> planes;
-            planes.resize(VIDEO_PLANES);
-            mBufferInfos[i].m.planes = planes.data();
-            mBufferInfos[i].length = planes.size();
+        const bool multiPlanar = mBufferInfos[i].type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        if (multiPlanar) {
+            memset(&mPlanes[i * VIDEO_PLANES], 0, sizeof(v4l2_plane) * VIDEO_PLANES);
+            mBufferInfos[i].m.planes = &mPlanes[i * VIDEO_PLANES];
+            mBufferInfos[i].length = VIDEO_PLANES;
         }
 
-        if (ioctl(mDeviceFd, VIDIOC_QUERYBUF, &mBufferInfos[i]) < 0) {
-            PLOG(ERROR) << "VIDIOC_QUERYBUF failed";
-            return false;
-        }
+        if (mMemoryType == V4L2_MEMORY_DMABUF) {
+            const ImportedBuffer& imported = importedBuffers[i];
+            if (multiPlanar) {
+                mBufferInfos[i].m.planes[0].m.fd = imported.fd;
+                mBufferInfos[i].m.planes[0].length = imported.length;
+            } else {
+                mBufferInfos[i].m.fd = imported.fd;
+                mBufferInfos[i].length = imported.length;
+            }
 
-        uint32_t memOffset = mBufferInfos[i].type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ?
-                                 mBufferInfos[i].m.planes[0].m.mem_offset :
-                                 mBufferInfos[i].m.offset;
-        LOG(DEBUG) << "Buffer description:";
-        LOG(INFO) << "  offset: " << memOffset;
-        LOG(DEBUG) << "  length: " << mBufferInfos[i].length;
-        LOG(DEBUG) << "  flags : " << std::hex << mBufferInfos[i].flags;
-        if (mBufferInfos[i].type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
-            LOG(INFO) << "  size : " << std::hex << mBufferInfos[i].m.planes[0].length;
-
-        mBufferSize = (mBufferInfos[i].type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) ?
-                          mBufferInfos[i].m.planes[0].length :
-                          mBufferInfos[i].length;
-        std::vector<void*> mappedBuffer;
-        mappedBuffer.resize(VIDEO_PLANES);
-        for (uint32_t plane = 0; plane < VIDEO_PLANES; plane++) {
-            mappedBuffer[plane] =
-                mmap(NULL, mBufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, mDeviceFd, memOffset);
-
-            if (mappedBuffer[plane] == MAP_FAILED) {
+            // A read only view, so frames can still be dumped; streaming works without it
+            void* mapped = sysCall->mmap(NULL, imported.length, PROT_READ, MAP_SHARED,
+                                         imported.fd, 0);
+            if (mapped == MAP_FAILED) {
+                PLOG(WARNING) << "Failed to map dmabuf " << imported.fd;
+                mapped = nullptr;
+            }
+            mPixelBuffers[i] = mapped;
+            mMappedSizes[i] = mapped != nullptr ? imported.length : 0;
+            LOG(INFO) << "Buffer " << i << " imported from dmabuf " << imported.fd;
+        } else {
+            if (sysCall->ioctl(mDeviceFd, VIDIOC_QUERYBUF, &mBufferInfos[i]) < 0) {
+                PLOG(ERROR) << "VIDIOC_QUERYBUF failed";
+                return false;
+            }
+
+            uint32_t memOffset = multiPlanar ? mBufferInfos[i].m.planes[0].m.mem_offset
+                                             : mBufferInfos[i].m.offset;
+            LOG(DEBUG) << "Buffer description:";
+            LOG(INFO) << "  offset: " << memOffset;
+            LOG(DEBUG) << "  length: " << mBufferInfos[i].length;
+            LOG(DEBUG) << "  flags : " << std::hex << mBufferInfos[i].flags;
+            if (multiPlanar)
+                LOG(INFO) << "  size : " << std::hex << mBufferInfos[i].m.planes[0].length;
+
+            const uint32_t bufferSize =
+                    multiPlanar ? mBufferInfos[i].m.planes[0].length : mBufferInfos[i].length;
+            void* mapped = sysCall->mmap(NULL, bufferSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                         mDeviceFd, memOffset);
+            if (mapped == MAP_FAILED) {
                 PLOG(ERROR) << "mmap() failed";
                 return false;
             }
 
-            memset(mappedBuffer[plane], 0, mBufferSize);
+            memset(mapped, 0, bufferSize);
+            mPixelBuffers[i] = mapped;
+            mMappedSizes[i] = bufferSize;
+            LOG(INFO) << "Buffer mapped at " << mPixelBuffers[i];
         }
-        mPixelBuffers[i] = mappedBuffer[0];
-        LOG(INFO) << "Buffer mapped at " << mPixelBuffers[i];
 
         // Queue the first capture buffer
-        if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[i]) < 0) {
+        if (sysCall->ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[i]) < 0) {
             PLOG(ERROR) << "VIDIOC_QBUF failed";
             return false;
         }
     }
 
-    // Start the video stream
-    const int type = mBufferType;
-    if (ioctl(mDeviceFd, VIDIOC_STREAMON, &type) < 0) {
-        PLOG(ERROR) << "VIDIOC_STREAMON failed";
-       // return false;
-    }
-
-    // Remember who to tell about new frames as they arrive
-    mCallback = callback;
+    return true;
+}
 
-    // Fire up a thread to receive and dispatch the video frames
-    mCaptureThread = std::thread([this]() { collectFrames(); });
+void VideoCapture::releaseBuffers() {
+    SysCall* sysCall = SysCall::getInstance();
+    for (int i = 0; i < mNumBuffers; ++i) {
+        // Unmap the buffers we allocated, or the views of the imported ones
+        if (mPixelBuffers[i] != nullptr) {
+            sysCall->munmap(mPixelBuffers[i], mMappedSizes[i]);
+        }
+    }
 
-    mNumCamerasStreaming++;
+    // Tell the L4V2 driver to release our streaming buffers
+    v4l2_requestbuffers bufrequest;
+    memset(&bufrequest, 0, sizeof(bufrequest));
+    bufrequest.type = mBufferType;
+    bufrequest.memory = mMemoryType;
+    bufrequest.count = 0;
+    sysCall->ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest);
 
-    LOG(DEBUG) << "Stream started.";
-    return true;
+    // Release capture buffers
+    mNumBuffers = 0;
+    mBufferInfos = nullptr;
+    mPlanes = nullptr;
+    mPixelBuffers = nullptr;
+    mMappedSizes = nullptr;
+    mDequeueTimesNs = nullptr;
 }
 
 void VideoCapture::stopStream() {
@@ -323,56 +473,173 @@ void VideoCapture::stopStream() {
     if (prevRunMode == STOPPED) {
         // The background thread wasn't running, so set the flag back to STOPPED
         mRunMode = STOPPED;
+
+        // It may have ended on its own after an error
+        CaptureEngine::getInstance().removeDevice(this);
     } else if (prevRunMode & STOPPING) {
         LOG(ERROR) << "stopStream called while stream is already stopping.  "
                    << "Reentrancy is not supported!";
         return;
     } else {
-        // Block until the background thread is stopped
-        if (mCaptureThread.joinable()) {
-            mCaptureThread.join();
-        }
+        // Block until no callback of ours runs anymore; frames of other streams keep flowing
+        CaptureEngine::getInstance().removeDevice(this);
+        mRunMode = STOPPED;
 
         // Stop the underlying video stream (automatically empties the buffer queue)
-        const int type = mBufferType;
-        if (ioctl(mDeviceFd, VIDIOC_STREAMOFF, &type) < 0) {
+        v4l2_buf_type type = static_cast<v4l2_buf_type>(mBufferType);
+        if (SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_STREAMOFF, &type) < 0) {
             PLOG(ERROR) << "VIDIOC_STREAMOFF failed";
         }
 
         mNumCamerasStreaming--;
 
-        LOG(DEBUG) << "Capture thread stopped.";
+        LOG(DEBUG) << "Stream stopped.";
     }
 
-    for (int i = 0; i < mNumBuffers; ++i) {
-        // Unmap the buffers we allocated
-        munmap(mPixelBuffers[i], mBufferSize);
-    }
+    stopRecording();
 
-    // Tell the L4V2 driver to release our streaming buffers
-    v4l2_requestbuffers bufrequest;
-    bufrequest.type = mBufferType;
-    bufrequest.memory = V4L2_MEMORY_MMAP;
-    bufrequest.count = 0;
-    ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest);
+    {
+        // Frames still held by the client can't be queued anymore
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        mFrames.clear();
+        releaseBuffers();
+    }
 
     // Drop our reference to the frame delivery callback interface
     mCallback = nullptr;
+    mPauseMode = PauseMode::NONE;
+}
 
-    // Release capture buffers
-    mNumBuffers = 0;
-    mBufferInfos = nullptr;
-    mPixelBuffers = nullptr;
+bool VideoCapture::pauseStream(bool streamOff) {
+    if (mRunMode != RUN) {
+        LOG(ERROR) << "Can't pause a stream which is not running";
+        return false;
+    }
+
+    PauseMode expected = PauseMode::NONE;
+    if (!mPauseMode.compare_exchange_strong(expected, streamOff ? PauseMode::STREAM_OFF
+                                                                : PauseMode::DISCARD)) {
+        LOG(WARNING) << "Stream is paused already";
+        return true;
+    }
+
+    if (!streamOff) {
+        LOG(DEBUG) << "Stream paused; frames are dropped.";
+        return true;
+    }
+
+    // Block until no callback of ours runs anymore, then stop the device without releasing
+    // the buffers
+    CaptureEngine::getInstance().removeDevice(this);
+    v4l2_buf_type type = static_cast<v4l2_buf_type>(mBufferType);
+    if (SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_STREAMOFF, &type) < 0) {
+        PLOG(ERROR) << "VIDIOC_STREAMOFF failed";
+        mPauseMode = PauseMode::NONE;
+        if (!CaptureEngine::getInstance().addDevice(this)) {
+            mRunMode = STOPPED;
+        }
+        return false;
+    }
+
+    {
+        // VIDIOC_STREAMOFF takes back every buffer the driver held; queue them again for the
+        // next VIDIOC_STREAMON.  Buffers held by the client are queued when they come back.
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        SysCall* sysCall = SysCall::getInstance();
+        for (int i = 0; i < mNumBuffers; ++i) {
+            if (mFrames.find(i) == mFrames.end() &&
+                sysCall->ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[i]) < 0) {
+                PLOG(ERROR) << "VIDIOC_QBUF failed for buffer " << i;
+            }
+        }
+    }
+
+    LOG(DEBUG) << "Stream paused; the device is stopped.";
+    return true;
+}
+
+bool VideoCapture::resumeStream() {
+    const PauseMode mode = mPauseMode.exchange(PauseMode::NONE);
+    if (mode != PauseMode::STREAM_OFF) {
+        LOG(DEBUG) << "Stream resumed.";
+        return true;
+    }
+
+    v4l2_buf_type type = static_cast<v4l2_buf_type>(mBufferType);
+    if (SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_STREAMON, &type) < 0) {
+        PLOG(ERROR) << "VIDIOC_STREAMON failed";
+    }
+
+    if (!CaptureEngine::getInstance().addDevice(this)) {
+        SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_STREAMOFF, &type);
+        mPauseMode = PauseMode::STREAM_OFF;
+        return false;
+    }
+
+    LOG(DEBUG) << "Stream resumed; the device is restarted.";
+    return true;
+}
+
+bool VideoCapture::startRecording(const std::string& path) {
+    if (mRunMode != RUN) {
+        LOG(ERROR) << "Can't record a stream which is not running";
+        return false;
+    }
+
+    auto recorder = ReplayRecorder::Create(path, mFormat, mCaptureWidth, mCaptureHeight, mStride);
+    if (!recorder) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mRecorderLock);
+    mRecorder = std::move(recorder);
+    LOG(INFO) << "Recording frames into " << path;
+    return true;
+}
+
+void VideoCapture::stopRecording() {
+    std::unique_ptr<ReplayRecorder> recorder;
+    {
+        std::lock_guard<std::mutex> lock(mRecorderLock);
+        recorder = std::move(mRecorder);
+    }
+
+    if (recorder) {
+        recorder->finish();
+        LOG(INFO) << recorder->getNumFrames() << " frames are recorded, "
+                  << recorder->getNumDropped() << " dropped while the disk was busy";
+    }
+}
+
+int VideoCapture::exportBuffer(int index) {
+    if (index < 0 || index >= mNumBuffers || mMemoryType != V4L2_MEMORY_MMAP) {
+        LOG(ERROR) << "Buffer " << index << " can't be exported";
+        return -1;
+    }
+
+    v4l2_exportbuffer expbuf;
+    memset(&expbuf, 0, sizeof(expbuf));
+    expbuf.type = mBufferType;
+    expbuf.index = index;
+    expbuf.plane = 0;
+    expbuf.flags = O_RDWR | O_CLOEXEC;
+    if (SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_EXPBUF, &expbuf) < 0) {
+        PLOG(ERROR) << "VIDIOC_EXPBUF failed";
+        return -1;
+    }
+
+    return expbuf.fd;
 }
 
 bool VideoCapture::returnFrame(int id) {
+    std::lock_guard<std::mutex> lock(mFramesLock);
     if (mFrames.find(id) == mFrames.end()) {
         LOG(WARNING) << "Invalid request to return a buffer " << id << " is ignored.";
         return false;
     }
 
     // Requeue the buffer to capture the next available frame
-    if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[id]) < 0) {
+    if (SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[id]) < 0) {
         PLOG(ERROR) << "VIDIOC_QBUF failed";
         return false;
     }
@@ -383,87 +650,108 @@ bool VideoCapture::returnFrame(int id) {
     return true;
 }
 
-// This runs on a background thread to receive and dispatch video frames
-void VideoCapture::collectFrames() {
-    // Run until our atomic signal is cleared
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(mDeviceFd, &fds);
-
+// This runs on the thread of the capture engine whenever the device has a frame for us
+bool VideoCapture::dequeueFrame(int* index, int64_t* timestampNs) {
     static int frameCount = 0;
     static auto startTime = std::chrono::high_resolution_clock::now();
 
-    static bool FPSDebugEnabled = false;
-
-    if(getPropValue(kPropEvsDQBufFPS) > 0)
-    {
-        FPSDebugEnabled = true;
+    *index = -1;
+    if (mRunMode != RUN) {
+        return true;
     }
 
-    while (mRunMode == RUN) {
-        struct v4l2_plane mplanes[VIDEO_PLANES];
-         struct v4l2_buffer buf = {
-                        .type = mBufferType, .memory = V4L2_MEMORY_MMAP};
+    struct v4l2_plane mplanes[VIDEO_PLANES];
+    struct v4l2_buffer buf = {.type = mBufferType, .memory = mMemoryType};
 
-        if (mBufferType == V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
-            LOG(INFO) << "MPLANE setting to dqbuf";
-            buf.length = VIDEO_PLANES;
-            buf.m.planes = mplanes;
-        }
+    if (mBufferType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+        LOG(DEBUG) << "MPLANE setting to dqbuf";
+        buf.length = VIDEO_PLANES;
+        buf.m.planes = mplanes;
+    }
 
-        timeval tv;
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;  // 10ms
-        int ret = select(mDeviceFd + 1, &fds, nullptr, nullptr, &tv);
-        if (ret == -1) {
-            LOG(INFO) << "Fatal error: selection failure ";
-            break;
-        } else if (ret == 0) {
-            LOG(INFO) << "Warning: timeout of device ";
-            continue;
+    // The device is non-blocking, so this fails with EAGAIN if the frame is not ready after all
+    if (SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_DQBUF, &buf) < 0) {
+        if (errno == EAGAIN) {
+            return true;
         }
+        PLOG(ERROR) << "VIDIOC_DQBUF failed";
+        return false;
+    }
 
-        // Wait for a buffer to be ready
-        if (ioctl(mDeviceFd, VIDIOC_DQBUF, &buf) < 0) {
-            PLOG(ERROR) << "VIDIOC_DQBUF failed";
-            break;
+    if (mPauseMode != PauseMode::NONE) {
+        // Hand the buffer straight back to the driver while the stream is paused
+        std::lock_guard<std::mutex> lock(mFramesLock);
+        if (SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[buf.index]) < 0) {
+            PLOG(ERROR) << "VIDIOC_QBUF failed";
         }
+        return true;
+    }
 
-        if(FPSDebugEnabled)
+    if(mFPSDebugEnabled)
+    {
+        frameCount++;
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime-startTime).count();
+        if(duration >= 1000)
         {
-            frameCount++;
-            auto currentTime = std::chrono::high_resolution_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime-startTime).count();
-            if(duration >= 1000)
-            {
-                double FPS = static_cast<double>(frameCount * 1000) / duration;
-                FPS = FPS / mNumCamerasStreaming;
-
-                LOG(INFO) << "EVS_HAL Frame Collection FPS: "<<FPS << "For " << mNumCamerasStreaming << "Cameras Streaming";
-
-                frameCount = 0;
-                startTime = currentTime;
-            }
+            double FPS = static_cast<double>(frameCount * 1000) / duration;
+            FPS = FPS / mNumCamerasStreaming;
+
+            LOG(INFO) << "EVS_HAL Frame Collection FPS: "<<FPS << "For " << mNumCamerasStreaming << "Cameras Streaming";
+
+            frameCount = 0;
+            startTime = currentTime;
         }
+    }
 
+    {
+        std::lock_guard<std::mutex> lock(mFramesLock);
         mFrames.insert(buf.index);
 
-        // Update a frame metadata
+        // Update a frame metadata; the planes stay in our own storage for the next QBUF
+        if (mBufferType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
+            memcpy(&mPlanes[buf.index * VIDEO_PLANES], mplanes, sizeof(mplanes));
+            buf.m.planes = &mPlanes[buf.index * VIDEO_PLANES];
+        }
         mBufferInfos[buf.index] = buf;
+    }
 
-        // If a callback was requested per frame, do that now
-        if (mCallback) {
-            mCallback(this, &mBufferInfos[buf.index], mPixelBuffers[buf.index]);
+    *index = buf.index;
+    *timestampNs = static_cast<int64_t>(buf.timestamp.tv_sec) * 1000000000LL +
+            static_cast<int64_t>(buf.timestamp.tv_usec) * 1000LL;
+
+    // Only monotonic timestamps can be compared with our clock
+    const int64_t dequeueTimeNs = systemTime(SYSTEM_TIME_MONOTONIC);
+    mDequeueTimesNs[buf.index] = dequeueTimeNs;
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        mCaptureLatency.record((dequeueTimeNs - *timestampNs) / 1000);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mRecorderLock);
+        if (mRecorder) {
+            const size_t bytesUsed = mBufferType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
+                    ? buf.m.planes[0].bytesused
+                    : buf.bytesused;
+            const size_t size =
+                    std::min(bytesUsed > 0 ? bytesUsed : mImageSize, mMappedSizes[buf.index]);
+            if (!mRecorder->record(*timestampNs, mPixelBuffers[buf.index], size)) {
+                mRecorder.reset();
+            }
         }
     }
+    return true;
+}
 
-    // Mark ourselves stopped
-    LOG(DEBUG) << "VideoCapture thread ending";
-    mRunMode = STOPPED;
+void VideoCapture::dispatchFrame(int index) {
+    // If a callback was requested per frame, do that now
+    if (mCallback) {
+        mCallback(this, &mBufferInfos[index], mPixelBuffers[index]);
+    }
 }
 
 int VideoCapture::setParameter(v4l2_control& control) {
-    int status = ioctl(mDeviceFd, VIDIOC_S_CTRL, &control);
+    int status = SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_S_CTRL, &control);
     if (status < 0) {
         PLOG(ERROR) << "Failed to program a parameter value "
                     << "id = " << std::hex << control.id;
@@ -473,7 +761,7 @@ int VideoCapture::setParameter(v4l2_control& control) {
 }
 
 int VideoCapture::getParameter(v4l2_control& control) {
-    int status = ioctl(mDeviceFd, VIDIOC_G_CTRL, &control);
+    int status = SysCall::getInstance()->ioctl(mDeviceFd, VIDIOC_G_CTRL, &control);
     if (status < 0) {
         PLOG(ERROR) << "Failed to read a parameter value"
                     << " fd = " << std::hex << mDeviceFd << " id = " << control.id;
@@ -483,21 +771,15 @@ int VideoCapture::getParameter(v4l2_control& control) {
 }
 
 std::set<uint32_t> VideoCapture::enumerateCameraControls() {
-    // Retrieve available camera controls
-    struct v4l2_queryctrl ctrl = {.id = V4L2_CTRL_FLAG_NEXT_CTRL};
-
+    // Available camera controls were retrieved with the other capabilities of the device
     std::set<uint32_t> ctrlIDs;
-    while (0 == ioctl(mDeviceFd, VIDIOC_QUERYCTRL, &ctrl)) {
-        if (!(ctrl.flags & V4L2_CTRL_FLAG_DISABLED)) {
-            ctrlIDs.insert(ctrl.id);
-        }
-
-        ctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+    if (mCapabilities == nullptr) {
+        return ctrlIDs;
     }
 
-    if (errno != EINVAL) {
-        PLOG(WARNING) << "Failed to run VIDIOC_QUERYCTRL";
+    for (auto&& ctrl : mCapabilities->controls) {
+        ctrlIDs.insert(ctrl.id);
     }
 
-    return std::move(ctrlIDs);
+    return ctrlIDs;
 }
@@ -15,10 +15,14 @@
  */
 
 #include "bufferCopy.h"
+#include "bufferCopyKernels.h"
 
 #include <android-base/logging.h>
+#include <linux/videodev2.h>
+#include <string.h>
 
-#include <libyuv.h>
+#include <algorithm>
+#include <vector>
 
 namespace aidl::android::hardware::automotive::evs::implementation {
 
@@ -31,7 +35,8 @@ int align(int value) {
     return (value + mask) & ~mask;
 }
 
-void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned) {
+void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned,
+                      unsigned rowBegin, unsigned rowEnd) {
     // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleave U/V
     // array. It assumes an even width and height for the overall image, and a horizontal stride
     // that is an even multiple of 16 bytes for both the Y and UV arrays.
@@ -42,14 +47,143 @@ void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     const unsigned strideLum = align<16>(pDesc->width);
     const unsigned sizeY = strideLum * pDesc->height;
     const unsigned strideColor = strideLum;  // 1/2 the samples, but two interleaved channels
-    const unsigned sizeColor = strideColor * pDesc->height / 2;
-    const unsigned totalBytes = sizeY + sizeColor;
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(imgData);
 
-    // Simply copy the data byte for byte
-    memcpy(tgt, imgData, totalBytes);
+    // Simply copy the data byte for byte, the luma rows of the band and then their chroma rows
+    memcpy(tgt + rowBegin * strideLum, src + rowBegin * strideLum,
+           (rowEnd - rowBegin) * strideLum);
+    memcpy(tgt + sizeY + (rowBegin / 2) * strideColor, src + sizeY + (rowBegin / 2) * strideColor,
+           (rowEnd - rowBegin) / 2 * strideColor);
 }
 
-void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+namespace {
+
+struct YUYVpixel {
+    uint8_t Y1;
+    uint8_t U;
+    uint8_t Y2;
+    uint8_t V;
+};
+
+// Scalar reference of ConversionKernels::yuyvToNV21Rows
+void yuyvToNV21RowsScalar(const uint8_t* srcTop, const uint8_t* srcBot, uint8_t* yTopRow,
+                          uint8_t* yBotRow, uint8_t* uvRow, unsigned width) {
+    const YUYVpixel* topSrcRow = reinterpret_cast<const YUYVpixel*>(srcTop);
+    const YUYVpixel* botSrcRow = reinterpret_cast<const YUYVpixel*>(srcBot);
+
+    for (unsigned cellCol = 0; cellCol < width / 2; cellCol++) {
+        // Collect the values from the YUYV interleaved data
+        const YUYVpixel* pTopMacroPixel = &topSrcRow[cellCol];
+        const YUYVpixel* pBotMacroPixel = &botSrcRow[cellCol];
+
+        // Down sample the U/V values by linear average between rows
+        const uint8_t uValue = (pTopMacroPixel->U + pBotMacroPixel->U) >> 1;
+        const uint8_t vValue = (pTopMacroPixel->V + pBotMacroPixel->V) >> 1;
+
+        // Store the values into the NV21 layout
+        yTopRow[cellCol * 2] = pTopMacroPixel->Y1;
+        yTopRow[cellCol * 2 + 1] = pTopMacroPixel->Y2;
+        yBotRow[cellCol * 2] = pBotMacroPixel->Y1;
+        yBotRow[cellCol * 2 + 1] = pBotMacroPixel->Y2;
+        uvRow[cellCol * 2] = uValue;
+        uvRow[cellCol * 2 + 1] = vValue;
+    }
+}
+
+// Scalar reference of ConversionKernels::swapYUYVRow
+void swapYUYVRowScalar(const uint8_t* srcRow, uint8_t* dstRow, unsigned width) {
+    const uint32_t* src = reinterpret_cast<const uint32_t*>(srcRow);
+    uint32_t* dst = reinterpret_cast<uint32_t*>(dstRow);
+
+    for (unsigned c = 0; c < width / 2; c++) {
+        // Note:  we're walking two pixels at a time here (even/odd)
+        uint32_t srcPixel = *src++;
+
+        uint8_t Y1 = (srcPixel)&0xFF;
+        uint8_t U = (srcPixel >> 8) & 0xFF;
+        uint8_t Y2 = (srcPixel >> 16) & 0xFF;
+        uint8_t V = (srcPixel >> 24) & 0xFF;
+
+        // Now we write back the pair of pixels with the components swizzled
+        *dst++ = (U) | (Y1 << 8) | (V << 16) | (Y2 << 24);
+    }
+}
+
+inline uint8_t clampToByte(int value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// Scalar reference of ConversionKernels::yuyvToRGBARow
+void yuyvToRGBARowScalar(const uint8_t* src, uint8_t* dst, unsigned width,
+                         const YuvToRgbCoefficients& coef, bool uyvy) {
+    const unsigned yIndex = uyvy ? 1 : 0;
+    const unsigned uIndex = uyvy ? 0 : 1;
+    const unsigned vIndex = uyvy ? 2 : 3;
+
+    for (unsigned x = 0; x < width; x++) {
+        const uint8_t* macroPixel = src + (x / 2) * 4;
+        const int y = (macroPixel[yIndex + (x & 1) * 2] - coef.yOffset) * coef.yScale;
+        const int u = macroPixel[uIndex] - 128;
+        const int v = macroPixel[vIndex] - 128;
+
+        dst[x * 4] = clampToByte((y + coef.crR * v + 32) >> 6);
+        dst[x * 4 + 1] = clampToByte((y - coef.cbG * u - coef.crG * v + 32) >> 6);
+        dst[x * 4 + 2] = clampToByte((y + coef.cbB * u + 32) >> 6);
+        dst[x * 4 + 3] = 0xFF;
+    }
+}
+
+}  // namespace
+
+const YuvToRgbCoefficients& getYuvToRgbCoefficients(YuvColorSpace colorSpace) {
+    // Kr/Kb of BT.601 are 0.299/0.114 and of BT.709 0.2126/0.0722.  The limited range scales
+    // luma by 255 / 219 and chroma by 255 / 224.
+    static const YuvToRgbCoefficients kBt601Limited = {16, 75, 102, 25, 52, 129};
+    static const YuvToRgbCoefficients kBt601Full = {0, 64, 90, 22, 46, 113};
+    static const YuvToRgbCoefficients kBt709Limited = {16, 75, 115, 14, 34, 135};
+    static const YuvToRgbCoefficients kBt709Full = {0, 64, 101, 12, 30, 119};
+
+    switch (colorSpace) {
+        case YuvColorSpace::BT601_FULL:
+            return kBt601Full;
+        case YuvColorSpace::BT709_LIMITED:
+            return kBt709Limited;
+        case YuvColorSpace::BT709_FULL:
+            return kBt709Full;
+        case YuvColorSpace::BT601_LIMITED:
+        default:
+            return kBt601Limited;
+    }
+}
+
+YuvColorSpace selectYuvColorSpace(uint32_t colorspace, uint32_t ycbcrEnc, uint32_t quantization) {
+    // Resolve the defaults the same way the V4L2 drivers do
+    if (ycbcrEnc == V4L2_YCBCR_ENC_DEFAULT) {
+        ycbcrEnc = V4L2_MAP_YCBCR_ENC_DEFAULT(colorspace);
+    }
+    if (quantization == V4L2_QUANTIZATION_DEFAULT) {
+        quantization = V4L2_MAP_QUANTIZATION_DEFAULT(false, colorspace, ycbcrEnc);
+    }
+
+    const bool fullRange = quantization == V4L2_QUANTIZATION_FULL_RANGE;
+    if (ycbcrEnc == V4L2_YCBCR_ENC_709 || ycbcrEnc == V4L2_YCBCR_ENC_XV709) {
+        return fullRange ? YuvColorSpace::BT709_FULL : YuvColorSpace::BT709_LIMITED;
+    }
+    return fullRange ? YuvColorSpace::BT601_FULL : YuvColorSpace::BT601_LIMITED;
+}
+
+const ConversionKernels& getScalarConversionKernels() {
+    static const ConversionKernels kScalarKernels = {
+            .name = "scalar",
+            .yuyvToNV21Rows = yuyvToNV21RowsScalar,
+            .swapYUYVRow = swapYUYVRowScalar,
+            .yuyvToRGBARow = yuyvToRGBARowScalar,
+    };
+    return kScalarKernels;
+}
+
+void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd) {
     // The YUYV format provides an interleaved array of pixel values with U and V subsampled in
     // the horizontal direction only.  Also known as interleaved 422 format.  A 4 byte
     // "macro pixel" provides the Y value for two adjacent pixels and the U and V values shared
@@ -58,13 +192,7 @@ void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     // to construct the NV21 format.
     // NV21 requires even width and height, so we assume that is the case for the incomming image
     // as well.
-    uint32_t* srcDataYUYV = (uint32_t*)imgData;
-    struct YUYVpixel {
-        uint8_t Y1;
-        uint8_t U;
-        uint8_t Y2;
-        uint8_t V;
-    };
+    const ConversionKernels& kernels = getConversionKernels();
 
     // Target image layout properties
     const AHardwareBuffer_Desc* pDesc =
@@ -73,144 +201,277 @@ void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     const unsigned sizeY = strideLum * pDesc->height;
     const unsigned strideColor = strideLum;  // 1/2 the samples, but two interleaved channels
 
-    // Source image layout properties
-    const unsigned srcRowPixels = imgStride / 4;  // imgStride is in units of bytes
-    const unsigned srcRowDoubleStep = srcRowPixels * 2;
-    uint32_t* topSrcRow = srcDataYUYV;
-    uint32_t* botSrcRow = srcDataYUYV + srcRowPixels;
-
-    // We're going to work on one 2x2 cell in the output image at at time
-    for (unsigned cellRow = 0; cellRow < pDesc->height / 2; cellRow++) {
-        // Set up the output pointers
+    // We're going to work on one row of 2x2 cells in the output image at at time
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(imgData);
+    for (unsigned cellRow = rowBegin / 2; cellRow < rowEnd / 2; cellRow++) {
+        // Set up the input and output pointers
+        const uint8_t* topSrcRow = src + (cellRow * 2) * imgStride;
         uint8_t* yTopRow = tgt + (cellRow * 2) * strideLum;
-        uint8_t* yBotRow = yTopRow + strideLum;
         uint8_t* uvRow = (tgt + sizeY) + cellRow * strideColor;
 
-        for (unsigned cellCol = 0; cellCol < pDesc->width / 2; cellCol++) {
-            // Collect the values from the YUYV interleaved data
-            const YUYVpixel* pTopMacroPixel = (YUYVpixel*)&topSrcRow[cellCol];
-            const YUYVpixel* pBotMacroPixel = (YUYVpixel*)&botSrcRow[cellCol];
-
-            // Down sample the U/V values by linear average between rows
-            const uint8_t uValue = (pTopMacroPixel->U + pBotMacroPixel->U) >> 1;
-            const uint8_t vValue = (pTopMacroPixel->V + pBotMacroPixel->V) >> 1;
-
-            // Store the values into the NV21 layout
-            yTopRow[cellCol * 2] = pTopMacroPixel->Y1;
-            yTopRow[cellCol * 2 + 1] = pTopMacroPixel->Y2;
-            yBotRow[cellCol * 2] = pBotMacroPixel->Y1;
-            yBotRow[cellCol * 2 + 1] = pBotMacroPixel->Y2;
-            uvRow[cellCol * 2] = uValue;
-            uvRow[cellCol * 2 + 1] = vValue;
-        }
-
-        // Skipping two rows to get to the next set of two source rows
-        topSrcRow += srcRowDoubleStep;
-        botSrcRow += srcRowDoubleStep;
+        kernels.yuyvToNV21Rows(topSrcRow, topSrcRow + imgStride, yTopRow, yTopRow + strideLum,
+                               uvRow, pDesc->width);
     }
 }
 
-void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+static void fillRGBAFromPackedYUV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                                  unsigned imgStride, unsigned rowBegin, unsigned rowEnd,
+                                  YuvColorSpace colorSpace, bool uyvy) {
+    // Converts straight into RGBA byte order, so no second pass to swap R and B is needed.
+    const ConversionKernels& kernels = getConversionKernels();
+    const YuvToRgbCoefficients& coefficients = getYuvToRgbCoefficients(colorSpace);
     const AHardwareBuffer_Desc* pDesc =
             reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
-    // Converts YUY2ToARGB (little endian).  Please note that libyuv uses the
-    // little endian while we're using the big endian in RGB format names.
-    const auto dstStrideInBytes = pDesc->stride * 4;  // 4-byte per pixel
-    auto result = libyuv::YUY2ToARGB((const uint8_t*)imgData,
-                                     imgStride,  // input stride in bytes
-                                     tgt,
-                                     dstStrideInBytes,  // output stride in bytes
-                                     pDesc->width, pDesc->height);
-    if (result) {
-        LOG(ERROR) << "Failed to convert YUYV to BGRA.";
-        return;
-    }
-
-    // Swaps R and B pixels to convert BGRA to RGBA in place.
-    // TODO(b/190783702): Consider allocating an extra space to store ARGB data
-    //                    temporarily if below operation is too slow.
-    result = libyuv::ABGRToARGB(tgt, dstStrideInBytes, tgt, dstStrideInBytes, pDesc->width,
-                                pDesc->height);
-    if (result) {
-        LOG(ERROR) << "Failed to convert BGRA to RGBA.";
-    }
-}
-
-void fillRGBAFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
-    const AHardwareBuffer_Desc* pDesc =
-        reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
-    // Converts YUY2ToARGB (little endian).  Please note that libyuv uses the
-    // little endian while we're using the big endian in RGB format names.
-    const auto dstStrideInBytes = pDesc->stride * 4;  // 4-byte per pixel
-    auto result = libyuv::UYVYToARGB((const uint8_t*)imgData,
-                                     imgStride,             // input stride in bytes
-                                     tgt,
-                                     dstStrideInBytes,      // output stride in bytes
-                                     pDesc->width,
-                                     pDesc->height);
-    if (result) {
-        LOG(ERROR) << "Failed to convert YUYV to BGRA.";
-        return;
-    }
-
-    // Swaps R and B pixels to convert BGRA to RGBA in place.
-    // TODO(b/190783702): Consider allocating an extra space to store ARGB data
-    //                    temporarily if below operation is too slow.
-    result = libyuv::ABGRToARGB(tgt, dstStrideInBytes, tgt, dstStrideInBytes,
-                                pDesc->width, pDesc->height);
-    if (result) {
-        LOG(ERROR) << "Failed to convert BGRA to RGBA.";
-    }
-}
-
-void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+    const unsigned dstStrideInBytes = pDesc->stride * 4;  // 4-byte per pixel
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(imgData);
+
+    for (unsigned r = rowBegin; r < rowEnd; r++) {
+        kernels.yuyvToRGBARow(src + r * imgStride, tgt + r * dstStrideInBytes, pDesc->width,
+                              coefficients, uyvy);
+    }
+}
+
+void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd, YuvColorSpace colorSpace) {
+    fillRGBAFromPackedYUV(tgtBuff, tgt, imgData, imgStride, rowBegin, rowEnd, colorSpace,
+                          /* uyvy= */ false);
+}
+
+void fillRGBAFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd, YuvColorSpace colorSpace) {
+    fillRGBAFromPackedYUV(tgtBuff, tgt, imgData, imgStride, rowBegin, rowEnd, colorSpace,
+                          /* uyvy= */ true);
+}
+
+void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd) {
     const AHardwareBuffer_Desc* pDesc =
             reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
     unsigned width = pDesc->width;
-    unsigned height = pDesc->height;
     uint8_t* src = (uint8_t*)imgData;
     uint8_t* dst = (uint8_t*)tgt;
     unsigned srcStrideBytes = imgStride;
     unsigned dstStrideBytes = pDesc->stride * 2;
 
-    for (unsigned r = 0; r < height; r++) {
+    for (unsigned r = rowBegin; r < rowEnd; r++) {
         // Copy a pixel row at a time (2 bytes per pixel, averaged over a YUYV macro pixel)
         memcpy(dst + r * dstStrideBytes, src + r * srcStrideBytes, width * 2);
     }
 }
 
-void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned rowBegin, unsigned rowEnd) {
+    const ConversionKernels& kernels = getConversionKernels();
     const AHardwareBuffer_Desc* pDesc =
             reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
     unsigned width = pDesc->width;
-    unsigned height = pDesc->height;
-    uint32_t* src = (uint32_t*)imgData;
-    uint32_t* dst = (uint32_t*)tgt;
-    unsigned srcStridePixels = imgStride / 2;
-    unsigned dstStridePixels = pDesc->stride;
-
-    const int srcRowPadding32 =
-            srcStridePixels / 2 - width / 2;  // 2 bytes per pixel, 4 bytes per word
-    const int dstRowPadding32 =
-            dstStridePixels / 2 - width / 2;  // 2 bytes per pixel, 4 bytes per word
-
-    for (unsigned r = 0; r < height; r++) {
-        for (unsigned c = 0; c < width / 2; c++) {
-            // Note:  we're walking two pixels at a time here (even/odd)
-            uint32_t srcPixel = *src++;
-
-            uint8_t Y1 = (srcPixel)&0xFF;
-            uint8_t U = (srcPixel >> 8) & 0xFF;
-            uint8_t Y2 = (srcPixel >> 16) & 0xFF;
-            uint8_t V = (srcPixel >> 24) & 0xFF;
-
-            // Now we write back the pair of pixels with the components swizzled
-            *dst++ = (U) | (Y1 << 8) | (V << 16) | (Y2 << 24);
+    const uint8_t* src = (const uint8_t*)imgData;
+    unsigned srcStrideBytes = imgStride;
+    unsigned dstStrideBytes = pDesc->stride * 2;  // 2 bytes per pixel
+
+    for (unsigned r = rowBegin; r < rowEnd; r++) {
+        // Extra data or end of row alignment padding is skipped by the strides
+        kernels.swapYUYVRow(src + r * srcStrideBytes, tgt + r * dstStrideBytes, width);
+    }
+}
+
+namespace {
+
+// Source row or column of the nearest sample for a target row or column, from their centers
+inline unsigned nearestSample(unsigned target, unsigned srcSize, unsigned tgtSize) {
+    return static_cast<unsigned>((2 * static_cast<uint64_t>(target) + 1) * srcSize /
+                                 (2 * static_cast<uint64_t>(tgtSize)));
+}
+
+// Where the target macro pixels of a packed 4:2:2 row, YUYV or UYVY, take their samples from a
+// row of another width.  A target macro pixel takes the luma of the nearest source pixels and
+// the chroma of the source macro pixel of its first one.
+struct PackedColumns {
+    std::vector<uint32_t> chroma;  // Source macro pixel of each target macro pixel
+    std::vector<uint32_t> luma;    // Byte offset of the luma sample of each target pixel
+};
+
+PackedColumns mapPackedColumns(unsigned srcWidth, unsigned dstWidth, bool uyvy) {
+    const unsigned yIndex = uyvy ? 1 : 0;
+
+    // An odd target width repeats the last luma sample, as the row kernels read whole macro
+    // pixels
+    const unsigned macroPixels = (dstWidth + 1) / 2;
+    PackedColumns columns;
+    columns.chroma.resize(macroPixels);
+    columns.luma.resize(macroPixels * 2);
+    for (unsigned x = 0; x < macroPixels * 2; x++) {
+        const unsigned sx = nearestSample(std::min(x, dstWidth - 1), srcWidth, dstWidth);
+        columns.luma[x] = (sx / 2) * 4 + yIndex + (sx & 1) * 2;
+        if (x % 2 == 0) {
+            columns.chroma[x / 2] = sx / 2;
+        }
+    }
+    return columns;
+}
+
+// Resamples a packed 4:2:2 row keeping its byte order
+void resamplePackedRow(const uint8_t* srcRow, const PackedColumns& columns, uint8_t* dstRow,
+                       unsigned dstWidth, bool uyvy) {
+    // Note:  like swapYUYVRowScalar, this handles macro pixels as little endian words
+    const uint32_t* src = reinterpret_cast<const uint32_t*>(srcRow);
+    uint32_t* dst = reinterpret_cast<uint32_t*>(dstRow);
+    const uint32_t* chroma = columns.chroma.data();
+    const uint32_t* luma = columns.luma.data();
+    const uint32_t chromaMask = uyvy ? 0x00FF00FF : 0xFF00FF00;
+
+    if (uyvy) {
+        for (unsigned c = 0; c < (dstWidth + 1) / 2; c++) {
+            dst[c] = (src[chroma[c]] & chromaMask) | srcRow[luma[c * 2]] << 8 |
+                    srcRow[luma[c * 2 + 1]] << 24;
+        }
+    } else {
+        for (unsigned c = 0; c < (dstWidth + 1) / 2; c++) {
+            dst[c] = (src[chroma[c]] & chromaMask) | srcRow[luma[c * 2]] |
+                    srcRow[luma[c * 2 + 1]] << 16;
+        }
+    }
+}
+
+void fillRGBAFromPackedYUVScaled(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                                 unsigned imgStride, unsigned rowBegin, unsigned rowEnd,
+                                 unsigned srcWidth, unsigned srcHeight, YuvColorSpace colorSpace,
+                                 bool uyvy) {
+    const ConversionKernels& kernels = getConversionKernels();
+    const YuvToRgbCoefficients& coefficients = getYuvToRgbCoefficients(colorSpace);
+    const AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+    const unsigned dstStrideInBytes = pDesc->stride * 4;  // 4-byte per pixel
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(imgData);
+
+    const PackedColumns columns = mapPackedColumns(srcWidth, pDesc->width, uyvy);
+    std::vector<uint8_t> scratch((pDesc->width + 1) / 2 * 4);
+    for (unsigned r = rowBegin; r < rowEnd; r++) {
+        const unsigned srcRow = nearestSample(r, srcHeight, pDesc->height);
+        resamplePackedRow(src + srcRow * imgStride, columns, scratch.data(), pDesc->width, uyvy);
+        kernels.yuyvToRGBARow(scratch.data(), tgt + r * dstStrideInBytes, pDesc->width,
+                              coefficients, uyvy);
+    }
+}
+
+}  // namespace
+
+void fillNV21FromNV21Scaled(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                            unsigned imgStride, unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight) {
+    // The chroma plane of the source follows its luma rows of imgStride bytes
+    const AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+    const unsigned strideLum = align<16>(pDesc->width);
+    const unsigned sizeY = strideLum * pDesc->height;
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(imgData);
+    const uint8_t* srcColor = src + imgStride * srcHeight;
+
+    // A chroma sample covers 2x2 pixels, so its samples are picked on the half size grid
+    std::vector<uint32_t> lumaColumns(pDesc->width);
+    std::vector<uint32_t> chromaColumns(pDesc->width / 2);
+    for (unsigned x = 0; x < pDesc->width; x++) {
+        lumaColumns[x] = nearestSample(x, srcWidth, pDesc->width);
+    }
+    for (unsigned cellCol = 0; cellCol < pDesc->width / 2; cellCol++) {
+        chromaColumns[cellCol] = nearestSample(cellCol, srcWidth / 2, pDesc->width / 2) * 2;
+    }
+
+    for (unsigned r = rowBegin; r < rowEnd; r++) {
+        const uint8_t* srcRow = src + nearestSample(r, srcHeight, pDesc->height) * imgStride;
+        uint8_t* yRow = tgt + r * strideLum;
+        for (unsigned x = 0; x < pDesc->width; x++) {
+            yRow[x] = srcRow[lumaColumns[x]];
+        }
+    }
+
+    for (unsigned cellRow = rowBegin / 2; cellRow < rowEnd / 2; cellRow++) {
+        const uint8_t* srcRow =
+                srcColor + nearestSample(cellRow, srcHeight / 2, pDesc->height / 2) * imgStride;
+        uint8_t* uvRow = tgt + sizeY + cellRow * strideLum;
+        for (unsigned cellCol = 0; cellCol < pDesc->width / 2; cellCol++) {
+            uvRow[cellCol * 2] = srcRow[chromaColumns[cellCol]];
+            uvRow[cellCol * 2 + 1] = srcRow[chromaColumns[cellCol] + 1];
         }
+    }
+}
+
+void fillNV21FromYUYVScaled(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                            unsigned imgStride, unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight) {
+    const ConversionKernels& kernels = getConversionKernels();
+    const AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+    const unsigned strideLum = align<16>(pDesc->width);
+    const unsigned sizeY = strideLum * pDesc->height;
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(imgData);
+
+    // Both rows of a 2x2 cell are resampled, and their chroma averaged as without scaling
+    const unsigned rowBytes = pDesc->width * 2;
+    const PackedColumns columns = mapPackedColumns(srcWidth, pDesc->width, /* uyvy= */ false);
+    std::vector<uint8_t> scratch(rowBytes * 2);
+    for (unsigned cellRow = rowBegin / 2; cellRow < rowEnd / 2; cellRow++) {
+        const unsigned topRow = nearestSample(cellRow * 2, srcHeight, pDesc->height);
+        const unsigned botRow = nearestSample(cellRow * 2 + 1, srcHeight, pDesc->height);
+        resamplePackedRow(src + topRow * imgStride, columns, scratch.data(), pDesc->width,
+                          /* uyvy= */ false);
+        resamplePackedRow(src + botRow * imgStride, columns, scratch.data() + rowBytes,
+                          pDesc->width, /* uyvy= */ false);
+
+        uint8_t* yTopRow = tgt + (cellRow * 2) * strideLum;
+        kernels.yuyvToNV21Rows(scratch.data(), scratch.data() + rowBytes, yTopRow,
+                               yTopRow + strideLum, tgt + sizeY + cellRow * strideLum,
+                               pDesc->width);
+    }
+}
+
+void fillRGBAFromYUYVScaled(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                            unsigned imgStride, unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight, YuvColorSpace colorSpace) {
+    fillRGBAFromPackedYUVScaled(tgtBuff, tgt, imgData, imgStride, rowBegin, rowEnd, srcWidth,
+                                srcHeight, colorSpace, /* uyvy= */ false);
+}
+
+void fillRGBAFromUYVYScaled(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                            unsigned imgStride, unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight, YuvColorSpace colorSpace) {
+    fillRGBAFromPackedYUVScaled(tgtBuff, tgt, imgData, imgStride, rowBegin, rowEnd, srcWidth,
+                                srcHeight, colorSpace, /* uyvy= */ true);
+}
+
+void fillYUYVFromYUYVScaled(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                            unsigned imgStride, unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight) {
+    // Same byte order, so the rows are resampled straight into the target
+    const AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+    const unsigned dstStrideBytes = pDesc->stride * 2;  // 2 bytes per pixel
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(imgData);
+
+    const PackedColumns columns = mapPackedColumns(srcWidth, pDesc->width, /* uyvy= */ false);
+    for (unsigned r = rowBegin; r < rowEnd; r++) {
+        const unsigned srcRow = nearestSample(r, srcHeight, pDesc->height);
+        resamplePackedRow(src + srcRow * imgStride, columns, tgt + r * dstStrideBytes,
+                          pDesc->width, /* uyvy= */ false);
+    }
+}
+
+void fillYUYVFromUYVYScaled(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                            unsigned imgStride, unsigned rowBegin, unsigned rowEnd,
+                            unsigned srcWidth, unsigned srcHeight) {
+    const ConversionKernels& kernels = getConversionKernels();
+    const AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+    const unsigned dstStrideBytes = pDesc->stride * 2;  // 2 bytes per pixel
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(imgData);
 
-        // Skip over any extra data or end of row alignment padding
-        src += srcRowPadding32;
-        dst += dstRowPadding32;
+    const PackedColumns columns = mapPackedColumns(srcWidth, pDesc->width, /* uyvy= */ true);
+    std::vector<uint8_t> scratch(pDesc->width * 2);
+    for (unsigned r = rowBegin; r < rowEnd; r++) {
+        const unsigned srcRow = nearestSample(r, srcHeight, pDesc->height);
+        resamplePackedRow(src + srcRow * imgStride, columns, scratch.data(), pDesc->width,
+                          /* uyvy= */ true);
+        kernels.swapYUYVRow(scratch.data(), tgt + r * dstStrideBytes, pDesc->width);
     }
 }
 
@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bufferCopyKernels.h"
+
+#include <android-base/logging.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EVS_KERNELS_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define EVS_KERNELS_NEON 1
+#endif
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+#if defined(EVS_KERNELS_X86)
+
+// (a + b) >> 1 per byte; _mm_avg_epu8() rounds up, so the carried low bit is subtracted to stay
+// bit exact with the scalar reference.
+__attribute__((target("sse4.1"))) inline __m128i averageFloor(__m128i a, __m128i b) {
+    const __m128i one = _mm_set1_epi8(1);
+    return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+}
+
+__attribute__((target("avx2"))) inline __m256i averageFloor256(__m256i a, __m256i b) {
+    const __m256i one = _mm256_set1_epi8(1);
+    return _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), one));
+}
+
+__attribute__((target("sse4.1"))) void yuyvToNV21RowsSse41(const uint8_t* srcTop,
+                                                           const uint8_t* srcBot, uint8_t* yTop,
+                                                           uint8_t* yBot, uint8_t* uv,
+                                                           unsigned width) {
+    const __m128i lumaMask = _mm_set1_epi16(0x00FF);
+    const unsigned cells = width / 2;
+    unsigned c = 0;
+
+    // 8 macro pixels (32 source bytes) per row and iteration
+    for (; c + 8 <= cells; c += 8) {
+        const __m128i t0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcTop + c * 4));
+        const __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcTop + c * 4 + 16));
+        const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcBot + c * 4));
+        const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcBot + c * 4 + 16));
+
+        const __m128i yt = _mm_packus_epi16(_mm_and_si128(t0, lumaMask),
+                                            _mm_and_si128(t1, lumaMask));
+        const __m128i yb = _mm_packus_epi16(_mm_and_si128(b0, lumaMask),
+                                            _mm_and_si128(b1, lumaMask));
+        const __m128i ct = _mm_packus_epi16(_mm_srli_epi16(t0, 8), _mm_srli_epi16(t1, 8));
+        const __m128i cb = _mm_packus_epi16(_mm_srli_epi16(b0, 8), _mm_srli_epi16(b1, 8));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(yTop + c * 2), yt);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(yBot + c * 2), yb);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + c * 2), averageFloor(ct, cb));
+    }
+
+    if (c < cells) {
+        getScalarConversionKernels().yuyvToNV21Rows(srcTop + c * 4, srcBot + c * 4, yTop + c * 2,
+                                                    yBot + c * 2, uv + c * 2, (cells - c) * 2);
+    }
+}
+
+__attribute__((target("avx2"))) void yuyvToNV21RowsAvx2(const uint8_t* srcTop,
+                                                        const uint8_t* srcBot, uint8_t* yTop,
+                                                        uint8_t* yBot, uint8_t* uv,
+                                                        unsigned width) {
+    const __m256i lumaMask = _mm256_set1_epi16(0x00FF);
+    const unsigned cells = width / 2;
+    unsigned c = 0;
+
+    // 16 macro pixels (64 source bytes) per row and iteration.  The packs work within 128 bit
+    // lanes, so the 64 bit quarters are reordered afterwards.
+    for (; c + 16 <= cells; c += 16) {
+        const __m256i t0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcTop + c * 4));
+        const __m256i t1 =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcTop + c * 4 + 32));
+        const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBot + c * 4));
+        const __m256i b1 =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcBot + c * 4 + 32));
+
+        __m256i yt = _mm256_packus_epi16(_mm256_and_si256(t0, lumaMask),
+                                         _mm256_and_si256(t1, lumaMask));
+        __m256i yb = _mm256_packus_epi16(_mm256_and_si256(b0, lumaMask),
+                                         _mm256_and_si256(b1, lumaMask));
+        __m256i ct = _mm256_packus_epi16(_mm256_srli_epi16(t0, 8), _mm256_srli_epi16(t1, 8));
+        __m256i cb = _mm256_packus_epi16(_mm256_srli_epi16(b0, 8), _mm256_srli_epi16(b1, 8));
+
+        yt = _mm256_permute4x64_epi64(yt, 0xD8);
+        yb = _mm256_permute4x64_epi64(yb, 0xD8);
+        const __m256i c2 = _mm256_permute4x64_epi64(averageFloor256(ct, cb), 0xD8);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(yTop + c * 2), yt);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(yBot + c * 2), yb);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + c * 2), c2);
+    }
+
+    if (c < cells) {
+        yuyvToNV21RowsSse41(srcTop + c * 4, srcBot + c * 4, yTop + c * 2, yBot + c * 2,
+                            uv + c * 2, (cells - c) * 2);
+    }
+}
+
+__attribute__((target("sse4.1"))) void swapYUYVRowSse41(const uint8_t* src, uint8_t* dst,
+                                                        unsigned width) {
+    const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    const unsigned bytes = (width / 2) * 4;
+    unsigned i = 0;
+
+    for (; i + 16 <= bytes; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(v, swap));
+    }
+
+    if (i < bytes) {
+        getScalarConversionKernels().swapYUYVRow(src + i, dst + i, (bytes - i) / 2);
+    }
+}
+
+__attribute__((target("avx2"))) void swapYUYVRowAvx2(const uint8_t* src, uint8_t* dst,
+                                                     unsigned width) {
+    const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    const unsigned bytes = (width / 2) * 4;
+    unsigned i = 0;
+
+    for (; i + 32 <= bytes; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(v, swap));
+    }
+
+    if (i < bytes) {
+        swapYUYVRowSse41(src + i, dst + i, (bytes - i) / 2);
+    }
+}
+
+// Shuffles which widen the luma and the chroma of 8 packed pixels into 16 bit lanes; -1 clears
+// the high bytes.
+__attribute__((target("sse4.1"))) inline void getRGBAShuffles(bool uyvy, __m128i* yShuffle,
+                                                              __m128i* uShuffle,
+                                                              __m128i* vShuffle) {
+    if (uyvy) {
+        *yShuffle = _mm_setr_epi8(1, -1, 3, -1, 5, -1, 7, -1, 9, -1, 11, -1, 13, -1, 15, -1);
+        *uShuffle = _mm_setr_epi8(0, -1, 0, -1, 4, -1, 4, -1, 8, -1, 8, -1, 12, -1, 12, -1);
+        *vShuffle = _mm_setr_epi8(2, -1, 2, -1, 6, -1, 6, -1, 10, -1, 10, -1, 14, -1, 14, -1);
+    } else {
+        *yShuffle = _mm_setr_epi8(0, -1, 2, -1, 4, -1, 6, -1, 8, -1, 10, -1, 12, -1, 14, -1);
+        *uShuffle = _mm_setr_epi8(1, -1, 1, -1, 5, -1, 5, -1, 9, -1, 9, -1, 13, -1, 13, -1);
+        *vShuffle = _mm_setr_epi8(3, -1, 3, -1, 7, -1, 7, -1, 11, -1, 11, -1, 15, -1, 15, -1);
+    }
+}
+
+__attribute__((target("sse4.1"))) void yuyvToRGBARowSse41(const uint8_t* src, uint8_t* dst,
+                                                          unsigned width,
+                                                          const YuvToRgbCoefficients& coef,
+                                                          bool uyvy) {
+    __m128i yShuffle, uShuffle, vShuffle;
+    getRGBAShuffles(uyvy, &yShuffle, &uShuffle, &vShuffle);
+
+    const __m128i yOffset = _mm_set1_epi16(coef.yOffset);
+    const __m128i yScale = _mm_set1_epi16(coef.yScale);
+    const __m128i crR = _mm_set1_epi16(coef.crR);
+    const __m128i cbG = _mm_set1_epi16(coef.cbG);
+    const __m128i crG = _mm_set1_epi16(coef.crG);
+    const __m128i cbB = _mm_set1_epi16(coef.cbB);
+    const __m128i chromaBias = _mm_set1_epi16(128);
+    const __m128i rounding = _mm_set1_epi16(32);
+    const __m128i alpha = _mm_set1_epi8(-1);
+    unsigned x = 0;
+
+    // 8 pixels (16 source bytes) per iteration.  The sums saturate only where the clamped
+    // result is 255 anyway, so the output matches the scalar reference.
+    for (; x + 8 <= width; x += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 2));
+        const __m128i y = _mm_mullo_epi16(_mm_sub_epi16(_mm_shuffle_epi8(v, yShuffle), yOffset),
+                                          yScale);
+        const __m128i cb = _mm_sub_epi16(_mm_shuffle_epi8(v, uShuffle), chromaBias);
+        const __m128i cr = _mm_sub_epi16(_mm_shuffle_epi8(v, vShuffle), chromaBias);
+
+        __m128i r = _mm_adds_epi16(_mm_adds_epi16(y, _mm_mullo_epi16(cr, crR)), rounding);
+        __m128i g = _mm_subs_epi16(y, _mm_mullo_epi16(cb, cbG));
+        g = _mm_adds_epi16(_mm_subs_epi16(g, _mm_mullo_epi16(cr, crG)), rounding);
+        __m128i b = _mm_adds_epi16(_mm_adds_epi16(y, _mm_mullo_epi16(cb, cbB)), rounding);
+
+        r = _mm_packus_epi16(_mm_srai_epi16(r, 6), _mm_setzero_si128());
+        g = _mm_packus_epi16(_mm_srai_epi16(g, 6), _mm_setzero_si128());
+        b = _mm_packus_epi16(_mm_srai_epi16(b, 6), _mm_setzero_si128());
+
+        const __m128i rg = _mm_unpacklo_epi8(r, g);
+        const __m128i ba = _mm_unpacklo_epi8(b, alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4 + 16),
+                         _mm_unpackhi_epi16(rg, ba));
+    }
+
+    if (x < width) {
+        getScalarConversionKernels().yuyvToRGBARow(src + x * 2, dst + x * 4, width - x, coef,
+                                                   uyvy);
+    }
+}
+
+__attribute__((target("avx2"))) void yuyvToRGBARowAvx2(const uint8_t* src, uint8_t* dst,
+                                                       unsigned width,
+                                                       const YuvToRgbCoefficients& coef,
+                                                       bool uyvy) {
+    __m128i yShuffle, uShuffle, vShuffle;
+    getRGBAShuffles(uyvy, &yShuffle, &uShuffle, &vShuffle);
+
+    const __m256i yShuffle256 = _mm256_broadcastsi128_si256(yShuffle);
+    const __m256i uShuffle256 = _mm256_broadcastsi128_si256(uShuffle);
+    const __m256i vShuffle256 = _mm256_broadcastsi128_si256(vShuffle);
+    const __m256i yOffset = _mm256_set1_epi16(coef.yOffset);
+    const __m256i yScale = _mm256_set1_epi16(coef.yScale);
+    const __m256i crR = _mm256_set1_epi16(coef.crR);
+    const __m256i cbG = _mm256_set1_epi16(coef.cbG);
+    const __m256i crG = _mm256_set1_epi16(coef.crG);
+    const __m256i cbB = _mm256_set1_epi16(coef.cbB);
+    const __m256i chromaBias = _mm256_set1_epi16(128);
+    const __m256i rounding = _mm256_set1_epi16(32);
+    const __m256i alpha = _mm256_set1_epi8(-1);
+    unsigned x = 0;
+
+    // 16 pixels (32 source bytes) per iteration.  Everything works within 128 bit lanes, so
+    // the halves of both results are reordered at the end.
+    for (; x + 16 <= width; x += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 2));
+        const __m256i y = _mm256_mullo_epi16(
+                _mm256_sub_epi16(_mm256_shuffle_epi8(v, yShuffle256), yOffset), yScale);
+        const __m256i cb = _mm256_sub_epi16(_mm256_shuffle_epi8(v, uShuffle256), chromaBias);
+        const __m256i cr = _mm256_sub_epi16(_mm256_shuffle_epi8(v, vShuffle256), chromaBias);
+
+        __m256i r = _mm256_adds_epi16(_mm256_adds_epi16(y, _mm256_mullo_epi16(cr, crR)),
+                                      rounding);
+        __m256i g = _mm256_subs_epi16(y, _mm256_mullo_epi16(cb, cbG));
+        g = _mm256_adds_epi16(_mm256_subs_epi16(g, _mm256_mullo_epi16(cr, crG)), rounding);
+        __m256i b = _mm256_adds_epi16(_mm256_adds_epi16(y, _mm256_mullo_epi16(cb, cbB)),
+                                      rounding);
+
+        r = _mm256_packus_epi16(_mm256_srai_epi16(r, 6), _mm256_setzero_si256());
+        g = _mm256_packus_epi16(_mm256_srai_epi16(g, 6), _mm256_setzero_si256());
+        b = _mm256_packus_epi16(_mm256_srai_epi16(b, 6), _mm256_setzero_si256());
+
+        const __m256i rg = _mm256_unpacklo_epi8(r, g);
+        const __m256i ba = _mm256_unpacklo_epi8(b, alpha);
+        const __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+        const __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4 + 32),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    if (x < width) {
+        yuyvToRGBARowSse41(src + x * 2, dst + x * 4, width - x, coef, uyvy);
+    }
+}
+
+const ConversionKernels kSse41Kernels = {
+        .name = "sse4.1",
+        .yuyvToNV21Rows = yuyvToNV21RowsSse41,
+        .swapYUYVRow = swapYUYVRowSse41,
+        .yuyvToRGBARow = yuyvToRGBARowSse41,
+};
+
+const ConversionKernels kAvx2Kernels = {
+        .name = "avx2",
+        .yuyvToNV21Rows = yuyvToNV21RowsAvx2,
+        .swapYUYVRow = swapYUYVRowAvx2,
+        .yuyvToRGBARow = yuyvToRGBARowAvx2,
+};
+
+#elif defined(EVS_KERNELS_NEON)
+
+void yuyvToNV21RowsNeon(const uint8_t* srcTop, const uint8_t* srcBot, uint8_t* yTop,
+                        uint8_t* yBot, uint8_t* uv, unsigned width) {
+    const unsigned cells = width / 2;
+    unsigned c = 0;
+
+    // 8 macro pixels per row and iteration; vld2q splits the luma from the interleaved chroma
+    for (; c + 8 <= cells; c += 8) {
+        const uint8x16x2_t t = vld2q_u8(srcTop + c * 4);
+        const uint8x16x2_t b = vld2q_u8(srcBot + c * 4);
+
+        vst1q_u8(yTop + c * 2, t.val[0]);
+        vst1q_u8(yBot + c * 2, b.val[0]);
+        vst1q_u8(uv + c * 2, vhaddq_u8(t.val[1], b.val[1]));
+    }
+
+    if (c < cells) {
+        getScalarConversionKernels().yuyvToNV21Rows(srcTop + c * 4, srcBot + c * 4, yTop + c * 2,
+                                                    yBot + c * 2, uv + c * 2, (cells - c) * 2);
+    }
+}
+
+void swapYUYVRowNeon(const uint8_t* src, uint8_t* dst, unsigned width) {
+    const unsigned bytes = (width / 2) * 4;
+    unsigned i = 0;
+
+    for (; i + 16 <= bytes; i += 16) {
+        vst1q_u8(dst + i, vrev16q_u8(vld1q_u8(src + i)));
+    }
+
+    if (i < bytes) {
+        getScalarConversionKernels().swapYUYVRow(src + i, dst + i, (bytes - i) / 2);
+    }
+}
+
+struct RGBAPixelsNeon {
+    uint8x8_t r;
+    uint8x8_t g;
+    uint8x8_t b;
+};
+
+inline RGBAPixelsNeon convertLumaNeon(uint8x8_t luma, int16x8_t crR, int16x8_t cbG,
+                                      int16x8_t cbB, const YuvToRgbCoefficients& coef) {
+    const int16x8_t rounding = vdupq_n_s16(32);
+    const int16x8_t y = vmulq_n_s16(
+            vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(luma)), vdupq_n_s16(coef.yOffset)),
+            coef.yScale);
+
+    // vqshrun clamps to [0, 255] while narrowing
+    RGBAPixelsNeon out;
+    out.r = vqshrun_n_s16(vqaddq_s16(vqaddq_s16(y, crR), rounding), 6);
+    out.g = vqshrun_n_s16(vqaddq_s16(vqsubq_s16(y, cbG), rounding), 6);
+    out.b = vqshrun_n_s16(vqaddq_s16(vqaddq_s16(y, cbB), rounding), 6);
+    return out;
+}
+
+void yuyvToRGBARowNeon(const uint8_t* src, uint8_t* dst, unsigned width,
+                       const YuvToRgbCoefficients& coef, bool uyvy) {
+    const int16x8_t chromaBias = vdupq_n_s16(128);
+    unsigned x = 0;
+
+    // 16 pixels (8 macro pixels) per iteration; vld4 splits the even and odd luma and both
+    // chroma planes, which then apply to both luma vectors.
+    for (; x + 16 <= width; x += 16) {
+        const uint8x8x4_t v = vld4_u8(src + x * 2);
+        const uint8x8_t even = uyvy ? v.val[1] : v.val[0];
+        const uint8x8_t odd = uyvy ? v.val[3] : v.val[2];
+        const int16x8_t cb =
+                vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(uyvy ? v.val[0] : v.val[1])), chromaBias);
+        const int16x8_t cr =
+                vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(uyvy ? v.val[2] : v.val[3])), chromaBias);
+
+        const int16x8_t crR = vmulq_n_s16(cr, coef.crR);
+        const int16x8_t cbG = vaddq_s16(vmulq_n_s16(cb, coef.cbG), vmulq_n_s16(cr, coef.crG));
+        const int16x8_t cbB = vmulq_n_s16(cb, coef.cbB);
+
+        const RGBAPixelsNeon e = convertLumaNeon(even, crR, cbG, cbB, coef);
+        const RGBAPixelsNeon o = convertLumaNeon(odd, crR, cbG, cbB, coef);
+        const uint8x8x2_t r = vzip_u8(e.r, o.r);
+        const uint8x8x2_t g = vzip_u8(e.g, o.g);
+        const uint8x8x2_t b = vzip_u8(e.b, o.b);
+
+        uint8x16x4_t out;
+        out.val[0] = vcombine_u8(r.val[0], r.val[1]);
+        out.val[1] = vcombine_u8(g.val[0], g.val[1]);
+        out.val[2] = vcombine_u8(b.val[0], b.val[1]);
+        out.val[3] = vdupq_n_u8(0xFF);
+        vst4q_u8(dst + x * 4, out);
+    }
+
+    if (x < width) {
+        getScalarConversionKernels().yuyvToRGBARow(src + x * 2, dst + x * 4, width - x, coef,
+                                                   uyvy);
+    }
+}
+
+const ConversionKernels kNeonKernels = {
+        .name = "neon",
+        .yuyvToNV21Rows = yuyvToNV21RowsNeon,
+        .swapYUYVRow = swapYUYVRowNeon,
+        .yuyvToRGBARow = yuyvToRGBARowNeon,
+};
+
+#endif
+
+const ConversionKernels& selectConversionKernels() {
+#if defined(EVS_KERNELS_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return kAvx2Kernels;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return kSse41Kernels;
+    }
+#elif defined(EVS_KERNELS_NEON)
+    return kNeonKernels;
+#endif
+    return getScalarConversionKernels();
+}
+
+}  // namespace
+
+std::vector<const ConversionKernels*> getSupportedConversionKernels() {
+    std::vector<const ConversionKernels*> kernels = {&getScalarConversionKernels()};
+#if defined(EVS_KERNELS_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) {
+        kernels.push_back(&kSse41Kernels);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back(&kAvx2Kernels);
+    }
+#elif defined(EVS_KERNELS_NEON)
+    kernels.push_back(&kNeonKernels);
+#endif
+    return kernels;
+}
+
+const ConversionKernels& getConversionKernels() {
+    static const ConversionKernels& kernels = []() -> const ConversionKernels& {
+        const ConversionKernels& selected = selectConversionKernels();
+        LOG(INFO) << "Using " << selected.name << " pixel conversion kernels";
+        return selected;
+    }();
+    return kernels;
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
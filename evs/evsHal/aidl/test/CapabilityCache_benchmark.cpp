@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Getting the capabilities of a camera as a camera is opened: enumerated by the V4L2 ioctls, as
+// on the first open after a start without a stored cache or after a hotplug, against taken from
+// CapabilityCache.  The camera is a model of a UVC webcam with two formats of eight frame sizes,
+// three frame rates each, and twelve controls.  It answers from memory, without the round trips
+// to the camera a real one makes, so its times hold only the work of the HAL; the ioctls counter
+// tells how many questions a real camera is asked.  Set vendor.evs.benchmark.camera to a real
+// device, e.g. /dev/video0, to time that camera instead.
+
+#include "CapabilityCache.h"
+#include "ReplayDevices.h"
+#include "SysCall.h"
+
+#include <benchmark/benchmark.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+constexpr char kModelName[] = "/dev/video-uvc-model";
+
+// Answers the enumeration ioctls of one file descriptor; others go to the system
+class UvcCameraModel : public SysCall {
+public:
+    static constexpr int kFd = 0x7fff0000;
+
+    using SysCall::ioctl;
+
+    int ioctl(int fd, int request, v4l2_fmtdesc* arg) override {
+        if (fd != kFd) {
+            return SysCall::ioctl(fd, request, arg);
+        }
+        ++mNumIoctls;
+        if (arg->index >= 2) {
+            return fail();
+        }
+        arg->pixelformat = arg->index == 0 ? V4L2_PIX_FMT_YUYV : V4L2_PIX_FMT_MJPEG;
+        return 0;
+    }
+
+    int ioctl(int fd, int request, v4l2_frmsizeenum* arg) override {
+        if (fd != kFd) {
+            return SysCall::ioctl(fd, request, arg);
+        }
+        ++mNumIoctls;
+        if (arg->index >= 8) {
+            return fail();
+        }
+        arg->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+        arg->discrete.width = 320 * (arg->index + 1);
+        arg->discrete.height = 180 * (arg->index + 1);
+        return 0;
+    }
+
+    int ioctl(int fd, int request, v4l2_frmivalenum* arg) override {
+        if (fd != kFd) {
+            return SysCall::ioctl(fd, request, arg);
+        }
+        ++mNumIoctls;
+        if (arg->index >= 3) {
+            return fail();
+        }
+        arg->type = V4L2_FRMIVAL_TYPE_DISCRETE;
+        arg->discrete.numerator = 1;
+        arg->discrete.denominator = 30 / (arg->index + 1);
+        return 0;
+    }
+
+    int ioctl(int fd, int request, v4l2_queryctrl* arg) override {
+        if (fd != kFd) {
+            return SysCall::ioctl(fd, request, arg);
+        }
+        ++mNumIoctls;
+        static constexpr uint32_t kControls[] = {
+                V4L2_CID_BRIGHTNESS,
+                V4L2_CID_CONTRAST,
+                V4L2_CID_SATURATION,
+                V4L2_CID_HUE,
+                V4L2_CID_AUTO_WHITE_BALANCE,
+                V4L2_CID_GAIN,
+                V4L2_CID_POWER_LINE_FREQUENCY,
+                V4L2_CID_WHITE_BALANCE_TEMPERATURE,
+                V4L2_CID_SHARPNESS,
+                V4L2_CID_BACKLIGHT_COMPENSATION,
+                V4L2_CID_EXPOSURE_AUTO,
+                V4L2_CID_EXPOSURE_ABSOLUTE,
+        };
+        const uint32_t after = arg->id & ~V4L2_CTRL_FLAG_NEXT_CTRL;
+        for (uint32_t id : kControls) {
+            if (id > after) {
+                memset(arg, 0, sizeof(*arg));
+                arg->id = id;
+                arg->maximum = 255;
+                arg->step = 1;
+                return 0;
+            }
+        }
+        return fail();
+    }
+
+    static v4l2_capability getCapability() {
+        v4l2_capability caps = {};
+        strncpy(reinterpret_cast<char*>(caps.driver), "uvcvideo", sizeof(caps.driver));
+        strncpy(reinterpret_cast<char*>(caps.card), "UVC Camera Model", sizeof(caps.card));
+        strncpy(reinterpret_cast<char*>(caps.bus_info), "usb-model-1", sizeof(caps.bus_info));
+        caps.version = 0x60100;
+        caps.capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+        return caps;
+    }
+
+    uint64_t getNumIoctls() const { return mNumIoctls; }
+
+private:
+    static int fail() {
+        errno = EINVAL;
+        return -1;
+    }
+
+    std::atomic<uint64_t> mNumIoctls = 0;
+};
+
+// range(0): whether the capabilities are taken from the cache
+void BM_GetCapabilities(benchmark::State& state) {
+    const bool warm = state.range(0) != 0;
+    CapabilityCache& cache = CapabilityCache::getInstance();
+
+    // The model stands in for the system calls while this runs
+    SysCall* const system = SysCall::getInstance();
+    UvcCameraModel model;
+    std::string name = getBenchmarkCamera();
+    int fd = -1;
+    v4l2_capability caps = {};
+    if (name.empty()) {
+        SysCall::updateInstance(&model);
+        name = kModelName;
+        fd = UvcCameraModel::kFd;
+        caps = UvcCameraModel::getCapability();
+    } else {
+        fd = system->open(name.data(), O_RDWR);
+        if (fd < 0 || system->ioctl(fd, VIDIOC_QUERYCAP, &caps) != 0) {
+            state.SkipWithError("failed to open the camera");
+            if (fd >= 0) {
+                system->close(fd);
+            }
+            return;
+        }
+    }
+
+    // Fills the cache for the warm case
+    cache.get(name, fd, caps);
+
+    const uint64_t firstIoctl = model.getNumIoctls();
+    for (auto _ : state) {
+        if (!warm) {
+            state.PauseTiming();
+            cache.invalidate(name);
+            state.ResumeTiming();
+        }
+        auto capabilities = cache.get(name, fd, caps);
+        benchmark::DoNotOptimize(capabilities);
+    }
+
+    if (fd == UvcCameraModel::kFd) {
+        // Keeps the model out of the stored cache
+        cache.invalidate(name);
+        SysCall::updateInstance(system);
+        state.counters["ioctls"] = benchmark::Counter(model.getNumIoctls() - firstIoctl,
+                                                      benchmark::Counter::kAvgIterations);
+    } else {
+        system->close(fd);
+    }
+}
+
+BENCHMARK(BM_GetCapabilities)->ArgName("warm")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
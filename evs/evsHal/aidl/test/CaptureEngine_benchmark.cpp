@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Throughput and latency of the capture path with one to eight cameras on the shared capture
+// thread of CaptureEngine.  Every camera is a 1280x720 YUYV replay device at 30 fps, and the
+// latency of a frame runs from its driver timestamp to its callback, so it holds waking up,
+// dequeuing and dispatching behind the frames of the other cameras.  The recording variant
+// records the first camera into a file meanwhile, which must not slow down the others.
+// BM_ReplayEvsCameras measures the same cameras through EvsV4lCamera, with the conversions.
+
+#include "ReplayDevices.h"
+#include "VideoCapture.h"
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+// Length of one iteration
+constexpr int kMeasuredSeconds = 2;
+
+// Counts the frames of all cameras and how late their callbacks came
+class Delivery {
+public:
+    void onFrame(VideoCapture* video, imageBuffer* buffer) {
+        const int64_t timestampNs = buffer->timestamp.tv_sec * 1000000000LL +
+                buffer->timestamp.tv_usec * 1000LL;
+        mLatency.record((systemTime(SYSTEM_TIME_MONOTONIC) - timestampNs) / 1000);
+        ++mFrames;
+        video->markFrameConsumed(buffer->index);
+    }
+
+    void reset() {
+        mLatency.reset();
+        mFrames = 0;
+    }
+
+    uint64_t getFrames() const { return mFrames; }
+    LatencyHistogram::Summary getLatency() const { return mLatency.getSummary(); }
+
+private:
+    LatencyHistogram mLatency;
+    std::atomic<uint64_t> mFrames = 0;
+};
+
+// range(0): the number of cameras, range(1): whether the first camera is recorded
+void BM_ReplayCameras(benchmark::State& state) {
+    const int numCameras = state.range(0);
+    const bool recording = state.range(1) != 0;
+    if (!installReplayDevices()) {
+        state.SkipWithError("no replay devices");
+        return;
+    }
+
+    Delivery delivery;
+    auto callback = [&delivery](VideoCapture* video, imageBuffer* buffer, void*) {
+        delivery.onFrame(video, buffer);
+    };
+
+    std::vector<std::unique_ptr<VideoCapture>> cameras;
+    const auto stopCameras = [&cameras] {
+        for (auto& camera : cameras) {
+            camera->stopRecording();
+            camera->stopStream();
+            camera->close();
+        }
+    };
+    for (int i = 0; i < numCameras; ++i) {
+        auto camera = std::make_unique<VideoCapture>();
+        if (!camera->open(getCameraReplayDevice(i).data(), 1280, 720) ||
+            !camera->startStream(callback)) {
+            state.SkipWithError("failed to start a camera");
+            stopCameras();
+            return;
+        }
+        cameras.push_back(std::move(camera));
+    }
+
+    TemporaryDir dir;
+    if (recording && !cameras[0]->startRecording(std::string(dir.path) + "/camera0.rec")) {
+        state.SkipWithError("failed to record");
+        stopCameras();
+        return;
+    }
+
+    // Frames queued while the streams started would count as late
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    uint64_t frames = 0;
+    double seconds = 0;
+    delivery.reset();
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t first = delivery.getFrames();
+        std::this_thread::sleep_for(std::chrono::seconds(kMeasuredSeconds));
+        frames += delivery.getFrames() - first;
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    const LatencyHistogram::Summary latency = delivery.getLatency();
+    stopCameras();
+
+    state.SetItemsProcessed(frames);
+    if (seconds > 0) {
+        state.counters["fps_per_camera"] = frames / seconds / numCameras;
+    }
+    state.counters["p50_ms"] = latency.p50Us / 1000.;
+    state.counters["p99_ms"] = latency.p99Us / 1000.;
+    state.counters["max_ms"] = latency.maxUs / 1000.;
+}
+
+BENCHMARK(BM_ReplayCameras)
+        ->ArgNames({"cameras", "recording"})
+        ->ArgsProduct({{1, 2, 4, 8}, {0, 1}})
+        ->Iterations(1)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
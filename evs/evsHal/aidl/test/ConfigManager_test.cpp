@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConfigManager.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// A camera group, two cameras with controls, streams and metadata, and a display
+constexpr char kConfiguration[] = R"(<?xml version='1.0' encoding='utf-8'?>
+<configuration>
+    <system>
+        <num_cameras value='2'/>
+    </system>
+    <camera>
+        <group id='group0' synchronized='CALIBRATED'>
+            <caps>
+                <stream id='0' width='640' height='360' format='RGBA_8888' framerate='30'/>
+            </caps>
+            <characteristics>
+                <parameter name='REQUEST_AVAILABLE_CAPABILITIES' type='enum' size='1'
+                           value='LOGICAL_MULTI_CAMERA'/>
+                <parameter name='LOGICAL_MULTI_CAMERA_PHYSICAL_IDS' type='byte[]' size='2'
+                           value='/dev/video10,/dev/video11'/>
+            </characteristics>
+        </group>
+        <device id='/dev/video10' position='rear'>
+            <caps>
+                <supported_controls>
+                    <control name='BRIGHTNESS' min='0' max='255'/>
+                    <control name='CONTRAST' min='0' max='255' step='5'/>
+                </supported_controls>
+                <stream id='0' width='1280' height='720' format='RGBA_8888' framerate='30'/>
+                <stream id='1' width='1920' height='1080' format='YUYV' framerate='60'/>
+            </caps>
+            <characteristics>
+                <parameter name='LENS_DISTORTION' type='float' size='5'
+                           value='0.1,0.2,0.3,0.4,0.5'/>
+                <parameter name='LENS_POSE_ROTATION' type='float' size='4'
+                           value='0.0,0.0,1.0,0.0'/>
+            </characteristics>
+        </device>
+        <device id='/dev/video11' position='front'>
+            <caps>
+                <stream id='0' width='1280' height='720' format='NV21' framerate='30'/>
+            </caps>
+        </device>
+    </camera>
+    <display>
+        <device id='display0' position='driver'>
+            <caps>
+                <stream id='0' width='1920' height='1080' format='RGBA_8888'/>
+            </caps>
+        </device>
+    </display>
+</configuration>
+)";
+
+size_t metadataDataSize(camera_metadata_tag_t tag, size_t count) {
+    return tag == ANDROID_LOGICAL_MULTI_CAMERA_PHYSICAL_IDS ? count : count * sizeof(int32_t);
+}
+
+}  // namespace
+
+class ConfigManagerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mConfigPath = std::string(mDir.path) + "/evs_configuration.xml";
+        mOverrideConfigPath = std::string(mDir.path) + "/evs_configuration_override.xml";
+        mCachePath = std::string(mDir.path) + "/evs_configuration.bin";
+        ASSERT_TRUE(android::base::WriteStringToFile(kConfiguration, mConfigPath));
+
+        mDefaultPath = ConfigManager::sConfigDefaultPath;
+        mOverridePath = ConfigManager::sConfigOverridePath;
+        ConfigManager::sConfigDefaultPath = mConfigPath;
+        ConfigManager::sConfigOverridePath = mOverrideConfigPath;  // Missing, so skipped
+    }
+
+    void TearDown() override {
+        ConfigManager::sConfigDefaultPath = mDefaultPath;
+        ConfigManager::sConfigOverridePath = mOverridePath;
+    }
+
+    std::unique_ptr<ConfigManager> newConfigManager() {
+        std::unique_ptr<ConfigManager> config(new ConfigManager());
+        config->mBinaryFilePath = mCachePath;
+        config->mSourceHash = ConfigManager::hashConfigSources();
+        return config;
+    }
+
+    std::unique_ptr<ConfigManager> loadXml() {
+        auto config = newConfigManager();
+        return config->readConfigDataFromXML() ? std::move(config) : nullptr;
+    }
+
+    std::unique_ptr<ConfigManager> loadCache() {
+        auto config = newConfigManager();
+        return config->readConfigDataFromBinary() ? std::move(config) : nullptr;
+    }
+
+    static bool storeCache(ConfigManager* config) { return config->writeConfigDataToBinary(); }
+
+    static void expectSameStreams(const std::unordered_map<int32_t, StreamConfiguration>& a,
+                                  const std::unordered_map<int32_t, StreamConfiguration>& b) {
+        ASSERT_EQ(a.size(), b.size());
+        for (auto&& [id, cfg] : a) {
+            auto it = b.find(id);
+            ASSERT_NE(it, b.end()) << "stream " << id;
+            EXPECT_EQ(cfg.width, it->second.width);
+            EXPECT_EQ(cfg.height, it->second.height);
+            EXPECT_EQ(cfg.format, it->second.format);
+            EXPECT_EQ(cfg.type, it->second.type);
+            EXPECT_EQ(cfg.framerate, it->second.framerate);
+        }
+    }
+
+    static void expectSameCamera(const ConfigManager::CameraInfo& a,
+                                 const ConfigManager::CameraInfo& b) {
+        EXPECT_EQ(a.controls, b.controls);
+        expectSameStreams(a.streamConfigurations, b.streamConfigurations);
+
+        ASSERT_EQ(a.cameraMetadata.size(), b.cameraMetadata.size());
+        for (auto&& [tag, entry] : a.cameraMetadata) {
+            auto it = b.cameraMetadata.find(tag);
+            ASSERT_NE(it, b.cameraMetadata.end()) << "tag " << tag;
+            ASSERT_EQ(entry.second, it->second.second);
+            EXPECT_EQ(memcmp(entry.first, it->second.first, metadataDataSize(tag, entry.second)),
+                      0);
+        }
+
+        ASSERT_EQ(a.characteristics == nullptr, b.characteristics == nullptr);
+        if (a.characteristics != nullptr) {
+            const size_t size = get_camera_metadata_size(a.characteristics);
+            ASSERT_EQ(size, get_camera_metadata_size(b.characteristics));
+            EXPECT_EQ(memcmp(a.characteristics, b.characteristics, size), 0);
+        }
+    }
+
+    static void expectSameState(const ConfigManager& a, const ConfigManager& b) {
+        EXPECT_TRUE(b.mIsReady);
+        EXPECT_EQ(a.mSystemInfo.numCameras, b.mSystemInfo.numCameras);
+        EXPECT_EQ(a.mCameraPosition, b.mCameraPosition);
+
+        ASSERT_EQ(a.mCameraInfo.size(), b.mCameraInfo.size());
+        for (auto&& [id, info] : a.mCameraInfo) {
+            auto it = b.mCameraInfo.find(id);
+            ASSERT_NE(it, b.mCameraInfo.end()) << "camera " << id;
+            expectSameCamera(*info, *it->second);
+        }
+
+        ASSERT_EQ(a.mCameraGroups.size(), b.mCameraGroups.size());
+        for (auto&& [id, info] : a.mCameraGroups) {
+            auto it = b.mCameraGroups.find(id);
+            ASSERT_NE(it, b.mCameraGroups.end()) << "group " << id;
+            expectSameCamera(*info, *it->second);
+            EXPECT_EQ(info->devices, it->second->devices);
+            EXPECT_EQ(info->synchronized, it->second->synchronized);
+        }
+
+        ASSERT_EQ(a.mDisplayInfo.size(), b.mDisplayInfo.size());
+        for (auto&& [id, info] : a.mDisplayInfo) {
+            auto it = b.mDisplayInfo.find(id);
+            ASSERT_NE(it, b.mDisplayInfo.end()) << "display " << id;
+            expectSameStreams(info->streamConfigurations, it->second->streamConfigurations);
+        }
+    }
+
+    static void setGroupMembers(ConfigManager* config, const std::string& group,
+                                std::unordered_set<std::string> members) {
+        config->mCameraGroups[group]->devices = std::move(members);
+    }
+
+    TemporaryDir mDir;
+    std::string mConfigPath;
+    std::string mOverrideConfigPath;
+    std::string mCachePath;
+    std::string_view mDefaultPath;
+    std::string_view mOverridePath;
+};
+
+namespace {
+
+TEST_F(ConfigManagerTest, CacheLoadsTheStateParsedFromXml) {
+    auto fromXml = loadXml();
+    ASSERT_NE(fromXml, nullptr);
+    // The XML reader does not fill the member list; set one so that it is stored too
+    setGroupMembers(fromXml.get(), "group0", {"/dev/video10", "/dev/video11"});
+    ASSERT_TRUE(storeCache(fromXml.get()));
+
+    auto fromCache = loadCache();
+    ASSERT_NE(fromCache, nullptr);
+    expectSameState(*fromXml, *fromCache);
+}
+
+TEST_F(ConfigManagerTest, MissingCacheIsRejected) {
+    EXPECT_EQ(loadCache(), nullptr);
+}
+
+TEST_F(ConfigManagerTest, CorruptedCacheIsRejected) {
+    auto fromXml = loadXml();
+    ASSERT_NE(fromXml, nullptr);
+    ASSERT_TRUE(storeCache(fromXml.get()));
+
+    std::string cache;
+    ASSERT_TRUE(android::base::ReadFileToString(mCachePath, &cache));
+    for (size_t offset = 0; offset < cache.size(); ++offset) {
+        std::string corrupted = cache;
+        corrupted[offset] ^= 0x5a;
+        ASSERT_TRUE(android::base::WriteStringToFile(corrupted, mCachePath));
+        EXPECT_EQ(loadCache(), nullptr) << "byte " << offset;
+    }
+}
+
+TEST_F(ConfigManagerTest, TruncatedCacheIsRejected) {
+    auto fromXml = loadXml();
+    ASSERT_NE(fromXml, nullptr);
+    ASSERT_TRUE(storeCache(fromXml.get()));
+
+    std::string cache;
+    ASSERT_TRUE(android::base::ReadFileToString(mCachePath, &cache));
+    for (size_t size = 0; size < cache.size(); ++size) {
+        ASSERT_TRUE(android::base::WriteStringToFile(cache.substr(0, size), mCachePath));
+        EXPECT_EQ(loadCache(), nullptr) << "size " << size;
+    }
+}
+
+TEST_F(ConfigManagerTest, CacheOfChangedConfigurationIsStale) {
+    auto fromXml = loadXml();
+    ASSERT_NE(fromXml, nullptr);
+    ASSERT_TRUE(storeCache(fromXml.get()));
+
+    std::string configuration(kConfiguration);
+    configuration.replace(configuration.find("framerate='60'"), 14, "framerate='30'");
+    ASSERT_TRUE(android::base::WriteStringToFile(configuration, mConfigPath));
+    EXPECT_EQ(loadCache(), nullptr);
+
+    // The refreshed cache matches the changed file
+    auto changed = loadXml();
+    ASSERT_NE(changed, nullptr);
+    ASSERT_TRUE(storeCache(changed.get()));
+    auto fromCache = loadCache();
+    ASSERT_NE(fromCache, nullptr);
+    expectSameState(*changed, *fromCache);
+}
+
+}  // namespace
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DisplayPacer.h"
+
+#include <gtest/gtest.h>
+#include <utils/Timers.h>
+
+#include <chrono>
+#include <future>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+using std::chrono_literals::operator""ms;
+
+constexpr size_t kNumBuffers = 3;
+constexpr int64_t kVsyncPeriodNs = 16666667;
+
+int64_t now() {
+    return systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+class DisplayPacerTest : public ::testing::Test {
+protected:
+    DisplayPacerTest() :
+          mVsync(new SimulatedVsyncSource(kVsyncPeriodNs)),
+          mPacer(kNumBuffers, std::unique_ptr<VsyncSource>(mVsync)) {}
+
+    ~DisplayPacerTest() override { mPacer.stop(); }
+
+    // Runs the presenter until it takes a frame on a vsync at vsyncNs, and returns that frame
+    int waitForPresent(int64_t vsyncNs) {
+        int64_t presentedVsyncNs = -1;
+        auto presenting = std::async(std::launch::async, [this, &presentedVsyncNs] {
+            return mPacer.waitForPresent(&presentedVsyncNs);
+        });
+
+        // A tick before the presenter waits for the vsync is lost, so keep ticking
+        while (presenting.wait_for(1ms) != std::future_status::ready) {
+            mVsync->tick(vsyncNs);
+        }
+        const int idx = presenting.get();
+        if (idx >= 0) {
+            EXPECT_EQ(presentedVsyncNs, vsyncNs);
+        }
+        return idx;
+    }
+
+    int queueFrame() {
+        const int idx = mPacer.acquireBuffer(10ms);
+        EXPECT_GE(idx, 0);
+        EXPECT_TRUE(mPacer.queueBuffer(idx));
+        return idx;
+    }
+
+    SimulatedVsyncSource* mVsync;  // Owned by mPacer
+    DisplayPacer mPacer;
+};
+
+TEST_F(DisplayPacerTest, LatestQueuedFrameIsPresented) {
+    // Three frames before one vsync: only the last one is shown
+    const int first = queueFrame();
+    const int second = queueFrame();
+    const int third = queueFrame();
+    EXPECT_NE(first, second);
+    EXPECT_FALSE(mPacer.queueBuffer(third));
+
+    EXPECT_EQ(waitForPresent(now()), third);
+    mPacer.donePresenting(third);
+
+    const DisplayPacer::Stats stats = mPacer.getStats();
+    EXPECT_EQ(stats.queued, 3u);
+    EXPECT_EQ(stats.presented, 1u);
+    EXPECT_EQ(stats.dropped, 2u);
+    EXPECT_EQ(stats.vsyncPeriodNs, kVsyncPeriodNs);
+}
+
+TEST_F(DisplayPacerTest, PresentedBufferStaysOnScreenUntilReplaced) {
+    const int shown = queueFrame();
+    ASSERT_EQ(waitForPresent(now()), shown);
+    mPacer.donePresenting(shown);
+
+    // The display may still scan out the buffer on the screen, so the client gets the others only
+    const int first = mPacer.acquireBuffer(10ms);
+    const int second = mPacer.acquireBuffer(10ms);
+    ASSERT_GE(first, 0);
+    ASSERT_GE(second, 0);
+    EXPECT_NE(first, shown);
+    EXPECT_NE(second, shown);
+    EXPECT_EQ(mPacer.acquireBuffer(10ms), -1);
+
+    // Presenting the next frame frees the one it replaces
+    ASSERT_TRUE(mPacer.queueBuffer(first));
+    ASSERT_EQ(waitForPresent(now()), first);
+    EXPECT_EQ(mPacer.acquireBuffer(10ms), -1);
+    mPacer.donePresenting(first);
+    EXPECT_EQ(mPacer.acquireBuffer(10ms), shown);
+
+    EXPECT_TRUE(mPacer.cancelBuffer(second));
+    EXPECT_EQ(mPacer.getStats().presented, 2u);
+}
+
+TEST_F(DisplayPacerTest, CancelledPresentKeepsTheScreen) {
+    const int shown = queueFrame();
+    ASSERT_EQ(waitForPresent(now()), shown);
+    mPacer.donePresenting(shown);
+
+    const int failed = queueFrame();
+    ASSERT_EQ(waitForPresent(now()), failed);
+    mPacer.cancelPresent(failed);
+
+    // The failed frame is free again while the shown one is still held
+    EXPECT_GE(mPacer.acquireBuffer(10ms), 0);
+    EXPECT_GE(mPacer.acquireBuffer(10ms), 0);
+    EXPECT_EQ(mPacer.acquireBuffer(10ms), -1);
+
+    const DisplayPacer::Stats stats = mPacer.getStats();
+    EXPECT_EQ(stats.queued, 2u);
+    EXPECT_EQ(stats.presented, 1u);
+    EXPECT_EQ(stats.dropped, 0u);
+}
+
+TEST_F(DisplayPacerTest, LatePresentCountsMissedVsyncs) {
+    // Presented three and a half periods after its vsync
+    const int late = queueFrame();
+    ASSERT_EQ(waitForPresent(now() - kVsyncPeriodNs * 7 / 2), late);
+    mPacer.donePresenting(late);
+
+    // Presented right on its vsync
+    const int onTime = queueFrame();
+    ASSERT_EQ(waitForPresent(now()), onTime);
+    mPacer.donePresenting(onTime);
+
+    const DisplayPacer::Stats stats = mPacer.getStats();
+    EXPECT_EQ(stats.presented, 2u);
+    EXPECT_EQ(stats.missedVsyncs, 3u);
+    EXPECT_EQ(stats.presentLatency.count, 2u);
+}
+
+TEST_F(DisplayPacerTest, BuffersNotHeldAreRejected) {
+    EXPECT_FALSE(mPacer.queueBuffer(-1));
+    EXPECT_FALSE(mPacer.queueBuffer(kNumBuffers));
+    EXPECT_FALSE(mPacer.cancelBuffer(0));
+
+    const int idx = mPacer.acquireBuffer(10ms);
+    ASSERT_GE(idx, 0);
+    EXPECT_TRUE(mPacer.cancelBuffer(idx));
+    EXPECT_FALSE(mPacer.cancelBuffer(idx));
+    EXPECT_FALSE(mPacer.queueBuffer(idx));
+
+    // Only the frame being presented can be done or cancelled
+    mPacer.donePresenting(idx);
+    mPacer.cancelPresent(idx);
+    mPacer.donePresenting(kNumBuffers);
+    EXPECT_EQ(mPacer.getStats().presented, 0u);
+    EXPECT_EQ(mPacer.getStats().queued, 0u);
+}
+
+TEST_F(DisplayPacerTest, StopReleasesWaiters) {
+    // The presenter waits for a frame, then for a vsync that never comes
+    int64_t vsyncNs = 0;
+    auto noFrame = std::async(std::launch::async,
+                              [this, &vsyncNs] { return mPacer.waitForPresent(&vsyncNs); });
+    EXPECT_EQ(noFrame.wait_for(20ms), std::future_status::timeout);
+
+    queueFrame();
+    ASSERT_GE(mPacer.acquireBuffer(10ms), 0);
+    ASSERT_GE(mPacer.acquireBuffer(10ms), 0);
+
+    // The client waits for a buffer while every buffer is taken
+    auto noBuffer = std::async(std::launch::async, [this] { return mPacer.acquireBuffer(5000ms); });
+    EXPECT_EQ(noBuffer.wait_for(20ms), std::future_status::timeout);
+
+    mPacer.stop();
+    ASSERT_EQ(noFrame.wait_for(1000ms), std::future_status::ready);
+    ASSERT_EQ(noBuffer.wait_for(1000ms), std::future_status::ready);
+    EXPECT_EQ(noFrame.get(), -1);
+    EXPECT_EQ(noBuffer.get(), -1);
+
+    EXPECT_EQ(mPacer.waitForPresent(&vsyncNs), -1);
+    EXPECT_EQ(mPacer.acquireBuffer(10ms), -1);
+}
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Drives an off screen EvsGlDisplay as a client does, with the vsyncs ticked by the test, so the
+// pacing of the returned frames can be checked without a display.
+
+#include "EvsGlDisplay.h"
+
+#include <aidl/android/hardware/automotive/evs/EvsResult.h>
+#include <gtest/gtest.h>
+#include <utils/Timers.h>
+
+#include <chrono>
+#include <thread>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::evs::BufferDesc;
+using ::aidl::android::hardware::automotive::evs::DisplayDesc;
+using ::aidl::android::hardware::automotive::evs::DisplayState;
+using ::aidl::android::hardware::automotive::evs::EvsResult;
+
+constexpr int kWidth = 640;
+constexpr int kHeight = 480;
+constexpr int64_t kVsyncPeriodNs = 16666667;
+
+class EvsGlDisplayTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        auto vsync = std::make_unique<SimulatedVsyncSource>(kVsyncPeriodNs);
+        mVsync = vsync.get();
+        mDisplay = ::ndk::SharedRefBase::make<EvsGlDisplay>(kWidth, kHeight, std::move(vsync));
+    }
+
+    // Ticks the vsync until the display has presented that many frames, for a second at most
+    bool tickUntilPresented(uint64_t presented) {
+        for (int i = 0; i < 1000; ++i) {
+            if (mDisplay->getPresentStats().presented >= presented) {
+                return true;
+            }
+            mVsync->tick(systemTime(SYSTEM_TIME_MONOTONIC));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    }
+
+    SimulatedVsyncSource* mVsync = nullptr;  // Owned by mDisplay
+    std::shared_ptr<EvsGlDisplay> mDisplay;
+};
+
+TEST_F(EvsGlDisplayTest, ReportsTheOffScreenSize) {
+    DisplayDesc info;
+    ASSERT_TRUE(mDisplay->getDisplayInfo(&info).isOk());
+    EXPECT_EQ(info.width, kWidth);
+    EXPECT_EQ(info.height, kHeight);
+
+    BufferDesc buffer;
+    ASSERT_TRUE(mDisplay->getTargetBuffer(&buffer).isOk());
+    EXPECT_EQ(buffer.buffer.description.width, kWidth);
+    EXPECT_EQ(buffer.buffer.description.height, kHeight);
+    EXPECT_TRUE(mDisplay->returnTargetBufferForDisplay(buffer).isOk());
+}
+
+TEST_F(EvsGlDisplayTest, ReturnedFrameIsPresentedOnTheNextVsync) {
+    ASSERT_TRUE(mDisplay->setDisplayState(DisplayState::VISIBLE_ON_NEXT_FRAME).isOk());
+
+    BufferDesc buffer;
+    ASSERT_TRUE(mDisplay->getTargetBuffer(&buffer).isOk());
+    ASSERT_TRUE(mDisplay->returnTargetBufferForDisplay(buffer).isOk());
+
+    DisplayState state;
+    ASSERT_TRUE(mDisplay->getDisplayState(&state).isOk());
+    EXPECT_EQ(state, DisplayState::VISIBLE);
+
+    ASSERT_TRUE(tickUntilPresented(1));
+    const DisplayPacer::Stats stats = mDisplay->getPresentStats();
+    EXPECT_EQ(stats.queued, 1u);
+    EXPECT_EQ(stats.dropped, 0u);
+}
+
+TEST_F(EvsGlDisplayTest, FramesReturnedBetweenVsyncsAreDropped) {
+    ASSERT_TRUE(mDisplay->setDisplayState(DisplayState::VISIBLE_ON_NEXT_FRAME).isOk());
+
+    // Nothing ticks, so the second frame replaces the first one waiting for the vsync
+    for (int i = 0; i < 2; ++i) {
+        BufferDesc buffer;
+        ASSERT_TRUE(mDisplay->getTargetBuffer(&buffer).isOk());
+        ASSERT_TRUE(mDisplay->returnTargetBufferForDisplay(buffer).isOk());
+    }
+
+    ASSERT_TRUE(tickUntilPresented(1));
+    const DisplayPacer::Stats stats = mDisplay->getPresentStats();
+    EXPECT_EQ(stats.queued, 2u);
+    EXPECT_EQ(stats.presented, 1u);
+    EXPECT_EQ(stats.dropped, 1u);
+
+    // One buffer is on the screen and the two others are free again
+    BufferDesc first;
+    BufferDesc second;
+    ASSERT_TRUE(mDisplay->getTargetBuffer(&first).isOk());
+    ASSERT_TRUE(mDisplay->getTargetBuffer(&second).isOk());
+    EXPECT_NE(first.bufferId, second.bufferId);
+    EXPECT_TRUE(mDisplay->returnTargetBufferForDisplay(first).isOk());
+    EXPECT_TRUE(mDisplay->returnTargetBufferForDisplay(second).isOk());
+}
+
+TEST_F(EvsGlDisplayTest, FramesAreNotPresentedWhileNotVisible) {
+    BufferDesc buffer;
+    ASSERT_TRUE(mDisplay->getTargetBuffer(&buffer).isOk());
+    ASSERT_TRUE(mDisplay->returnTargetBufferForDisplay(buffer).isOk());
+
+    // The frame is freed without being queued, so it cannot be returned a second time
+    EXPECT_EQ(mDisplay->getPresentStats().queued, 0u);
+    EXPECT_FALSE(mDisplay->returnTargetBufferForDisplay(buffer).isOk());
+}
+
+TEST_F(EvsGlDisplayTest, ShutdownLosesOwnership) {
+    BufferDesc buffer;
+    ASSERT_TRUE(mDisplay->getTargetBuffer(&buffer).isOk());
+
+    mDisplay->forceShutdown();
+
+    DisplayState state;
+    ASSERT_TRUE(mDisplay->getDisplayState(&state).isOk());
+    EXPECT_EQ(state, DisplayState::DEAD);
+
+    auto status = mDisplay->getTargetBuffer(&buffer);
+    ASSERT_FALSE(status.isOk());
+    EXPECT_EQ(status.getServiceSpecificError(), static_cast<int>(EvsResult::OWNERSHIP_LOST));
+
+    status = mDisplay->setDisplayState(DisplayState::VISIBLE);
+    ASSERT_FALSE(status.isOk());
+    EXPECT_EQ(status.getServiceSpecificError(), static_cast<int>(EvsResult::OWNERSHIP_LOST));
+}
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
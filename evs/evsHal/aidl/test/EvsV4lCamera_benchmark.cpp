@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The whole HAL path of one to eight cameras, from the replay devices through EvsV4lCamera to a
+// client: every camera is a 1280x720 YUYV replay device at 30 fps whose frames are converted into
+// RGBA gralloc buffers and delivered to a stream which returns each one right away.  Unlike
+// BM_ReplayCameras, this holds the conversions and the deliveries of every camera.  The
+// recording variant records the first camera into a file meanwhile.  Buffers come from gralloc,
+// so this runs on a device.
+
+#include "EvsV4lCamera.h"
+#include "ReplayDevices.h"
+
+#include <aidl/android/hardware/automotive/evs/BnEvsCameraStream.h>
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::evs::BnEvsCameraStream;
+using ::aidl::android::hardware::automotive::evs::BufferDesc;
+using ::aidl::android::hardware::automotive::evs::EvsEventDesc;
+using ::aidl::android::hardware::automotive::evs::Stream;
+using ::aidl::android::hardware::graphics::common::PixelFormat;
+using ::ndk::ScopedAStatus;
+
+constexpr int kWidth = 1280;
+constexpr int kHeight = 720;
+
+// Length of one iteration
+constexpr int kMeasuredSeconds = 2;
+
+// Hands every frame straight back to its camera, as a client which only looks at them would
+class ReturningStream : public BnEvsCameraStream {
+public:
+    void setCamera(const std::shared_ptr<EvsV4lCamera>& camera) { mCamera = camera; }
+
+    ScopedAStatus deliverFrame(const std::vector<BufferDesc>& buffers) override {
+        std::vector<BufferDesc> returned(buffers.size());
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            returned[i].bufferId = buffers[i].bufferId;
+        }
+        if (auto camera = mCamera.lock()) {
+            camera->doneWithFrame(returned);
+        }
+        mFrames += buffers.size();
+        return ScopedAStatus::ok();
+    }
+
+    ScopedAStatus notify(const EvsEventDesc&) override { return ScopedAStatus::ok(); }
+
+    uint64_t getFrames() const { return mFrames; }
+
+private:
+    std::weak_ptr<EvsV4lCamera> mCamera;
+    std::atomic<uint64_t> mFrames = 0;
+};
+
+struct Camera {
+    std::unique_ptr<ConfigManager::CameraInfo> info;  // Referenced by camera
+    std::shared_ptr<EvsV4lCamera> camera;
+    std::shared_ptr<ReturningStream> stream;
+};
+
+void stopCameras(std::vector<Camera>* cameras) {
+    for (auto& camera : *cameras) {
+        camera.camera->stopRecording();
+        camera.camera->stopVideoStream();
+        camera.camera->shutdown();
+    }
+    cameras->clear();
+}
+
+// range(0): the number of cameras, range(1): whether the first camera is recorded
+void BM_ReplayEvsCameras(benchmark::State& state) {
+    const int numCameras = state.range(0);
+    const bool recording = state.range(1) != 0;
+    if (!installReplayDevices()) {
+        state.SkipWithError("no replay devices");
+        return;
+    }
+
+    std::vector<Camera> cameras;
+    for (int i = 0; i < numCameras; ++i) {
+        Camera camera;
+        camera.info = std::make_unique<ConfigManager::CameraInfo>();
+        camera.info->streamConfigurations[0] = {
+                .id = 0,
+                .width = kWidth,
+                .height = kHeight,
+                .format = PixelFormat::RGBA_8888,
+                .type = ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT,
+                .framerate = 30,
+        };
+        const Stream config = {.width = kWidth, .height = kHeight,
+                               .format = PixelFormat::RGBA_8888};
+        camera.camera =
+                EvsV4lCamera::Create(getCameraReplayDevice(i).data(), camera.info, &config);
+        if (!camera.camera) {
+            state.SkipWithError("failed to open a camera");
+            stopCameras(&cameras);
+            return;
+        }
+        camera.stream = ::ndk::SharedRefBase::make<ReturningStream>();
+        camera.stream->setCamera(camera.camera);
+        if (!camera.camera->startVideoStream(camera.stream).isOk()) {
+            state.SkipWithError("failed to start a camera");
+            camera.camera->shutdown();
+            stopCameras(&cameras);
+            return;
+        }
+        cameras.push_back(std::move(camera));
+    }
+
+    TemporaryDir dir;
+    const std::string recordingPath = std::string(dir.path) + "/camera0.rec";
+    if (recording && !cameras[0].camera->startRecording(recordingPath).ok()) {
+        state.SkipWithError("failed to record");
+        stopCameras(&cameras);
+        return;
+    }
+
+    // Frames queued while the streams started would count as late
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    for (auto& camera : cameras) {
+        camera.camera->resetFrameLatency();
+    }
+
+    const auto countFrames = [&cameras] {
+        uint64_t frames = 0;
+        for (const auto& camera : cameras) {
+            frames += camera.stream->getFrames();
+        }
+        return frames;
+    };
+    uint64_t frames = 0;
+    double seconds = 0;
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t first = countFrames();
+        std::this_thread::sleep_for(std::chrono::seconds(kMeasuredSeconds));
+        frames += countFrames() - first;
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // The slowest camera of each stage
+    EvsV4lCamera::FrameLatency worst = {};
+    for (auto& camera : cameras) {
+        const EvsV4lCamera::FrameLatency latency = camera.camera->getFrameLatency();
+        worst.capture.p99Us = std::max(worst.capture.p99Us, latency.capture.p99Us);
+        worst.conversion.p99Us = std::max(worst.conversion.p99Us, latency.conversion.p99Us);
+        worst.delivery.p99Us = std::max(worst.delivery.p99Us, latency.delivery.p99Us);
+    }
+    stopCameras(&cameras);
+
+    state.SetItemsProcessed(frames);
+    if (seconds > 0) {
+        state.counters["fps_per_camera"] = frames / seconds / numCameras;
+    }
+    state.counters["capture_p99_ms"] = worst.capture.p99Us / 1000.;
+    state.counters["conversion_p99_ms"] = worst.conversion.p99Us / 1000.;
+    state.counters["delivery_p99_ms"] = worst.delivery.p99Us / 1000.;
+}
+
+BENCHMARK(BM_ReplayEvsCameras)
+        ->ArgNames({"cameras", "recording"})
+        ->ArgsProduct({{1, 2, 4, 8}, {0, 1}})
+        ->Iterations(1)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
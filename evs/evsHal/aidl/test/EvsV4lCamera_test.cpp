@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Streams from the replay devices through EvsV4lCamera in the output format of the capture, so
+// frames can be shared with the device instead of copied.  Buffers come from gralloc, so this
+// runs on a device.
+
+#include "EvsV4lCamera.h"
+#include "GraphicBufferPool.h"
+#include "ReplayDevices.h"
+
+#include <aidl/android/hardware/automotive/evs/BnEvsCameraStream.h>
+#include <aidlcommonsupport/NativeHandle.h>
+#include <gtest/gtest.h>
+#include <hardware/gralloc.h>
+#include <ui/GraphicBufferMapper.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::evs::BnEvsCameraStream;
+using ::aidl::android::hardware::automotive::evs::BufferDesc;
+using ::aidl::android::hardware::automotive::evs::EvsEventDesc;
+using ::aidl::android::hardware::automotive::evs::Stream;
+using ::aidl::android::hardware::graphics::common::PixelFormat;
+using ::ndk::ScopedAStatus;
+
+using ZeroCopyMode = EvsV4lCamera::ZeroCopyMode;
+
+constexpr int kWidth = 640;
+constexpr int kHeight = 480;
+
+// Y, U and V of the color bars the synthetic devices draw
+const std::set<std::tuple<uint8_t, uint8_t, uint8_t>> kColorBars = {
+        {180, 128, 128}, {162, 44, 142}, {131, 156, 44}, {112, 72, 58},
+        {84, 184, 198},  {65, 100, 212}, {35, 212, 114}, {16, 128, 128},
+};
+
+// A delivered buffer mapped for reading, with the first pixel of its frame
+class MappedFrame {
+public:
+    explicit MappedFrame(const BufferDesc& buffer) {
+        const auto& description = buffer.buffer.description;
+        ::android::GraphicBufferMapper& mapper = ::android::GraphicBufferMapper::get();
+        native_handle_t* rawHandle = ::android::dupFromAidl(buffer.buffer.handle);
+        if (mapper.importBuffer(rawHandle, description.width, description.height, 1,
+                                static_cast<::android::PixelFormat>(description.format),
+                                static_cast<uint64_t>(description.usage), description.stride,
+                                &mHandle) != ::android::NO_ERROR) {
+            mHandle = nullptr;
+        }
+        native_handle_close(rawHandle);
+        native_handle_delete(rawHandle);
+        if (mHandle == nullptr) {
+            return;
+        }
+
+        const ::android::Rect bounds(description.width, description.height);
+        if (description.format == PixelFormat::YCRCB_420_SP) {
+            android_ycbcr ycbcr = {};
+            mLocked = mapper.lockYCbCr(mHandle, GRALLOC_USAGE_SW_READ_OFTEN, bounds, &ycbcr) ==
+                    ::android::NO_ERROR;
+            if (mLocked) {
+                mPixel = {*static_cast<const uint8_t*>(ycbcr.y),
+                          *static_cast<const uint8_t*>(ycbcr.cb),
+                          *static_cast<const uint8_t*>(ycbcr.cr)};
+            }
+        } else {
+            void* pixels = nullptr;
+            mLocked = mapper.lock(mHandle, GRALLOC_USAGE_SW_READ_OFTEN, bounds, &pixels) ==
+                    ::android::NO_ERROR;
+            if (mLocked) {
+                const uint8_t* yuyv = static_cast<const uint8_t*>(pixels);
+                mPixel = {yuyv[0], yuyv[1], yuyv[3]};
+            }
+        }
+    }
+
+    ~MappedFrame() {
+        ::android::GraphicBufferMapper& mapper = ::android::GraphicBufferMapper::get();
+        if (mLocked) {
+            mapper.unlock(mHandle);
+        }
+        if (mHandle != nullptr) {
+            mapper.freeBuffer(mHandle);
+        }
+    }
+
+    bool isLocked() const { return mLocked; }
+    const std::tuple<uint8_t, uint8_t, uint8_t>& getFirstPixel() const { return mPixel; }
+
+private:
+    buffer_handle_t mHandle = nullptr;
+    bool mLocked = false;
+    std::tuple<uint8_t, uint8_t, uint8_t> mPixel;
+};
+
+// Holds the frames it receives until the test returns them, and checks the pixels of each
+class FrameReceiver : public BnEvsCameraStream {
+public:
+    ScopedAStatus deliverFrame(const std::vector<BufferDesc>& buffers) override {
+        for (const auto& buffer : buffers) {
+            const MappedFrame frame(buffer);
+            std::lock_guard<std::mutex> lock(mLock);
+            mPixelsMatch = mPixelsMatch && frame.isLocked() &&
+                    kColorBars.count(frame.getFirstPixel()) > 0;
+            mHeld.push_back(buffer.bufferId);
+            mIds.insert(buffer.bufferId);
+            ++mReceived;
+        }
+        mSignal.notify_all();
+        return ScopedAStatus::ok();
+    }
+
+    ScopedAStatus notify(const EvsEventDesc&) override { return ScopedAStatus::ok(); }
+
+    // Whether that many frames arrive within a few seconds
+    bool waitForFrames(unsigned frames) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mSignal.wait_for(lock, std::chrono::seconds(5),
+                                [this, frames] { return mReceived >= frames; });
+    }
+
+    // Ids of the frames held, which the caller returns
+    std::vector<int32_t> takeHeld() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return std::move(mHeld);
+    }
+
+    unsigned getReceived() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mReceived;
+    }
+
+    std::set<int32_t> getIds() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mIds;
+    }
+
+    bool pixelsMatch() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mPixelsMatch;
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mSignal;
+    std::vector<int32_t> mHeld;
+    std::set<int32_t> mIds;
+    unsigned mReceived = 0;
+    bool mPixelsMatch = true;
+};
+
+class EvsV4lCameraTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(installReplayDevices());
+        mReceiver = ::ndk::SharedRefBase::make<FrameReceiver>();
+    }
+
+    void TearDown() override {
+        if (mCamera) {
+            mCamera->stopVideoStream();
+            mCamera->shutdown();
+        }
+    }
+
+    // Opens a device with frames delivered at the capture size in the capture format
+    void open(const char* deviceName, PixelFormat format) {
+        mCameraInfo = std::make_unique<ConfigManager::CameraInfo>();
+        mCameraInfo->streamConfigurations[0] = {
+                .id = 0,
+                .width = kWidth,
+                .height = kHeight,
+                .format = format,
+                .type = ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT,
+                .framerate = 30,
+        };
+        const Stream stream = {.width = kWidth, .height = kHeight, .format = format};
+        mCamera = EvsV4lCamera::Create(deviceName, mCameraInfo, &stream);
+        ASSERT_NE(mCamera, nullptr);
+    }
+
+    void start(const std::string& memoryMode, int32_t framesInFlight) {
+        mCamera->setMemoryMode(memoryMode);
+        ASSERT_TRUE(mCamera->setMaxFramesInFlight(framesInFlight).isOk());
+        ASSERT_TRUE(mCamera->startVideoStream(mReceiver).isOk());
+    }
+
+    void returnHeldFrames() {
+        std::vector<BufferDesc> buffers;
+        for (int32_t id : mReceiver->takeHeld()) {
+            BufferDesc buffer;
+            buffer.bufferId = id;
+            buffers.push_back(std::move(buffer));
+        }
+        ASSERT_TRUE(mCamera->doneWithFrame(buffers).isOk());
+    }
+
+    // Receives that many frames, returning each one as it comes
+    void receiveAndReturn(unsigned frames) {
+        const unsigned target = mReceiver->getReceived() + frames;
+        while (mReceiver->getReceived() < target) {
+            ASSERT_TRUE(mReceiver->waitForFrames(mReceiver->getReceived() + 1));
+            returnHeldFrames();
+        }
+    }
+
+    static size_t getLiveBuffers() {
+        return GraphicBufferPool::getInstance().getStats().liveBuffers;
+    }
+
+    std::unique_ptr<ConfigManager::CameraInfo> mCameraInfo;  // Referenced by mCamera
+    std::shared_ptr<EvsV4lCamera> mCamera;
+    std::shared_ptr<FrameReceiver> mReceiver;
+};
+
+TEST_F(EvsV4lCameraTest, ImportedGrallocBuffersAreDeliveredWithoutACopy) {
+    open(kFastReplayDevice, PixelFormat::YCBCR_422_I);
+    ASSERT_TRUE(mCamera->setMaxFramesInFlight(2).isOk());
+    const size_t copyBuffers = getLiveBuffers();
+
+    start("dmabuf", 2);
+    ASSERT_EQ(mCamera->getZeroCopyMode(), ZeroCopyMode::DMABUF_IMPORT);
+
+    // The two copy buffers are back in the pool, and the device captures into five others
+    EXPECT_EQ(getLiveBuffers(), copyBuffers - 2 + 5);
+
+    receiveAndReturn(30);
+    EXPECT_TRUE(mReceiver->pixelsMatch());
+
+    // Every returned buffer is queued to the device again
+    const std::set<int32_t> ids = mReceiver->getIds();
+    EXPECT_GT(ids.size(), 2u);
+    EXPECT_LT(*ids.rbegin(), 5);
+
+    // Stopping gives back the shared buffers and takes the copy buffers again
+    ASSERT_TRUE(mCamera->stopVideoStream().isOk());
+    EXPECT_EQ(mCamera->getZeroCopyMode(), ZeroCopyMode::NONE);
+    EXPECT_EQ(getLiveBuffers(), copyBuffers);
+}
+
+TEST_F(EvsV4lCameraTest, HeldFramesLimitTheDeliveryUntilReturned) {
+    open(kFastReplayDevice, PixelFormat::YCBCR_422_I);
+    start("dmabuf", 2);
+    ASSERT_EQ(mCamera->getZeroCopyMode(), ZeroCopyMode::DMABUF_IMPORT);
+
+    // The device keeps capturing into the three other buffers, which are handed back to it
+    ASSERT_TRUE(mReceiver->waitForFrames(2));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(mReceiver->getReceived(), 2u);
+
+    returnHeldFrames();
+    EXPECT_TRUE(mReceiver->waitForFrames(4));
+}
+
+TEST_F(EvsV4lCameraTest, PitchMismatchFallsBackToCopying) {
+    // Rows of the device are 64 bytes longer than those of the gralloc buffers
+    open(kPaddedReplayDevice, PixelFormat::YCBCR_422_I);
+    start("dmabuf", 2);
+    EXPECT_EQ(mCamera->getZeroCopyMode(), ZeroCopyMode::NONE);
+
+    receiveAndReturn(10);
+    EXPECT_TRUE(mReceiver->pixelsMatch());
+}
+
+TEST_F(EvsV4lCameraTest, DriverGrantingFewerBuffersFallsBackToCopying) {
+    // One frame in flight needs four buffers shared with the device, which grants two
+    open(kTwoBuffersReplayDevice, PixelFormat::YCBCR_422_I);
+    const size_t liveBuffers = getLiveBuffers();
+    start("dmabuf", 1);
+    EXPECT_EQ(mCamera->getZeroCopyMode(), ZeroCopyMode::NONE);
+
+    // The buffers acquired for the import went back to the pool
+    EXPECT_EQ(getLiveBuffers(), liveBuffers + 1);
+
+    receiveAndReturn(10);
+    EXPECT_TRUE(mReceiver->pixelsMatch());
+}
+
+TEST_F(EvsV4lCameraTest, ExportedBuffersAreDeliveredOrCopied) {
+    open(kFastReplayDevice, PixelFormat::YCBCR_422_I);
+    start("expbuf", 2);
+
+    // Gralloc implementations which only accept their own handles reject the exported memory,
+    // and frames are copied instead
+    const ZeroCopyMode mode = mCamera->getZeroCopyMode();
+    EXPECT_TRUE(mode == ZeroCopyMode::DMABUF_EXPORT || mode == ZeroCopyMode::NONE);
+
+    receiveAndReturn(20);
+    EXPECT_TRUE(mReceiver->pixelsMatch());
+    if (mode == ZeroCopyMode::DMABUF_EXPORT) {
+        EXPECT_LT(*mReceiver->getIds().rbegin(), BUFFER_COUNT);
+    }
+}
+
+TEST_F(EvsV4lCameraTest, Nv21ChromaIsWhereGrallocExpectsIt) {
+    // Whether or not gralloc lays out NV21 as the device writes it, the chroma of the delivered
+    // frames is where gralloc describes it
+    open(kNv21ReplayDevice, PixelFormat::YCRCB_420_SP);
+    start("dmabuf", 2);
+
+    receiveAndReturn(10);
+    EXPECT_TRUE(mReceiver->pixelsMatch());
+}
+
+TEST_F(EvsV4lCameraTest, MmapModeAlwaysCopies) {
+    open(kFastReplayDevice, PixelFormat::YCBCR_422_I);
+    start("mmap", 2);
+    EXPECT_EQ(mCamera->getZeroCopyMode(), ZeroCopyMode::NONE);
+
+    receiveAndReturn(10);
+    EXPECT_TRUE(mReceiver->pixelsMatch());
+}
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameRateLimiter.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+constexpr int64_t kSecondNs = 1000000000LL;
+constexpr int64_t kSensorPeriodNs = kSecondNs / 30;
+
+// Timestamps of ten seconds of a 30 fps sensor, each up to 3 ms early or late
+std::vector<int64_t> jitteredTimestamps() {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int64_t> jitter(-3000000, 3000000);
+    std::vector<int64_t> timestamps;
+    for (int i = 0; i < 300; ++i) {
+        timestamps.push_back(kSecondNs + i * kSensorPeriodNs + jitter(rng));
+    }
+    return timestamps;
+}
+
+std::vector<int64_t> keptTimestamps(FrameRateLimiter& limiter,
+                                    const std::vector<int64_t>& timestamps) {
+    std::vector<int64_t> kept;
+    std::copy_if(timestamps.begin(), timestamps.end(), std::back_inserter(kept),
+                 [&limiter](int64_t timestampNs) { return limiter.accept(timestampNs); });
+    return kept;
+}
+
+// Most frames kept within any one second
+int maxFramesPerSecond(const std::vector<int64_t>& kept) {
+    int most = 0;
+    for (size_t first = 0, last = 0; last < kept.size(); ++last) {
+        while (kept[last] - kept[first] >= kSecondNs) {
+            ++first;
+        }
+        most = std::max<int>(most, last - first + 1);
+    }
+    return most;
+}
+
+TEST(FrameRateLimiterTest, NoTargetKeepsEveryFrame) {
+    FrameRateLimiter limiter;
+    const auto timestamps = jitteredTimestamps();
+    EXPECT_EQ(keptTimestamps(limiter, timestamps).size(), timestamps.size());
+}
+
+TEST(FrameRateLimiterTest, DecimatesAJitteredSensor) {
+    const auto timestamps = jitteredTimestamps();
+    for (unsigned fps : {30u, 20u, 15u, 10u, 5u, 1u}) {
+        FrameRateLimiter limiter;
+        limiter.setTargetRate(fps);
+        const auto kept = keptTimestamps(limiter, timestamps);
+
+        // The ten seconds keep the target rate on average and never exceed it in any second
+        EXPECT_GE(kept.size(), fps * 10 - 1) << fps << " fps";
+        EXPECT_LE(kept.size(), fps * 10 + 1) << fps << " fps";
+        EXPECT_LE(maxFramesPerSecond(kept), static_cast<int>(fps) + 1) << fps << " fps";
+    }
+}
+
+TEST(FrameRateLimiterTest, HalfTheSensorRateKeepsEveryOtherFrame) {
+    const auto timestamps = jitteredTimestamps();
+    FrameRateLimiter limiter;
+    limiter.setTargetRate(15);
+    for (size_t i = 0; i < timestamps.size(); ++i) {
+        EXPECT_EQ(limiter.accept(timestamps[i]), i % 2 == 0) << "frame " << i;
+    }
+}
+
+TEST(FrameRateLimiterTest, StallDoesNotReleaseABurst) {
+    FrameRateLimiter limiter;
+    limiter.setTargetRate(10);
+    EXPECT_TRUE(limiter.accept(0));
+
+    // After five seconds without frames, the next one is due a period later again
+    EXPECT_TRUE(limiter.accept(5 * kSecondNs));
+    EXPECT_FALSE(limiter.accept(5 * kSecondNs + kSensorPeriodNs));
+    EXPECT_FALSE(limiter.accept(5 * kSecondNs + 2 * kSensorPeriodNs));
+    EXPECT_TRUE(limiter.accept(5 * kSecondNs + 3 * kSensorPeriodNs));
+}
+
+TEST(FrameRateLimiterTest, RateChangeAppliesToTheNextFrame) {
+    FrameRateLimiter limiter;
+    limiter.setTargetRate(1);
+    EXPECT_TRUE(limiter.accept(0));
+    EXPECT_FALSE(limiter.accept(kSensorPeriodNs));
+
+    limiter.setTargetRate(0);
+    EXPECT_TRUE(limiter.accept(2 * kSensorPeriodNs));
+    EXPECT_TRUE(limiter.accept(3 * kSensorPeriodNs));
+
+    limiter.setTargetRate(15);
+    EXPECT_TRUE(limiter.accept(4 * kSensorPeriodNs));
+    EXPECT_FALSE(limiter.accept(5 * kSensorPeriodNs));
+    EXPECT_TRUE(limiter.accept(6 * kSensorPeriodNs));
+}
+
+TEST(FrameRateLimiterTest, ResetStartsOver) {
+    FrameRateLimiter limiter;
+    limiter.setTargetRate(1);
+    EXPECT_TRUE(limiter.accept(0));
+    EXPECT_FALSE(limiter.accept(kSensorPeriodNs));
+
+    // A restarted stream keeps its first frame, whatever the old timestamps were
+    limiter.reset();
+    EXPECT_EQ(limiter.getTargetRate(), 1u);
+    EXPECT_TRUE(limiter.accept(2 * kSensorPeriodNs));
+    EXPECT_FALSE(limiter.accept(3 * kSensorPeriodNs));
+}
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
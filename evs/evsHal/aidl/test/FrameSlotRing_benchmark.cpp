@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameSlotRing.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+// The free slots of EvsV4lCamera before the ring: a linear scan for a slot which is not in use,
+// under the lock the binder threads take to return their slots
+class LockedSlots {
+public:
+    explicit LockedSlots(uint32_t slots) : mInUse(slots, false) {}
+
+    bool acquire(uint32_t* slot) {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (uint32_t i = 0; i < mInUse.size(); ++i) {
+            if (!mInUse[i]) {
+                mInUse[i] = true;
+                *slot = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void release(uint32_t slot) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mInUse[slot] = false;
+    }
+
+private:
+    std::mutex mLock;
+    std::vector<bool> mInUse;
+};
+
+class RingSlots {
+public:
+    explicit RingSlots(uint32_t slots) : mRing(slots) {
+        for (uint32_t i = 0; i < slots; ++i) {
+            mRing.push(i);
+        }
+    }
+
+    bool acquire(uint32_t* slot) { return mRing.pop(slot); }
+
+    void release(uint32_t slot) {
+        while (!mRing.push(slot)) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    FrameSlotRing mRing;
+};
+
+// range(0): frames in flight, range(1): client threads returning them.  Each iteration is one
+// frame of the capture thread: take a free slot, or skip the frame if there is none, and hand
+// the slot to the clients, which return it from their own threads as binder threads calling
+// doneWithFrame() would.  The capture thread never waits for the clients.
+template <class Slots>
+void captureFrames(benchmark::State& state) {
+    const uint32_t slots = state.range(0);
+    const unsigned numClients = state.range(1);
+
+    Slots freeSlots(slots);
+    FrameSlotRing delivered(slots);
+    std::atomic<bool> done = false;
+    std::vector<std::thread> clients;
+    for (unsigned c = 0; c < numClients; ++c) {
+        clients.emplace_back([&] {
+            while (!done) {
+                uint32_t slot = 0;
+                if (delivered.pop(&slot)) {
+                    freeSlots.release(slot);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    int64_t skipped = 0;
+    int64_t worstNs = 0;
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        uint32_t slot = 0;
+        const bool acquired = freeSlots.acquire(&slot);
+        worstNs = std::max<int64_t>(worstNs, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                     std::chrono::steady_clock::now() - start)
+                                                     .count());
+        if (!acquired) {
+            ++skipped;
+            continue;
+        }
+
+        // Holds every slot, so this only fails while a client is half way through a pop
+        while (!delivered.push(slot)) {
+        }
+    }
+
+    done = true;
+    for (auto& t : clients) {
+        t.join();
+    }
+
+    state.counters["skipped"] = benchmark::Counter(skipped, benchmark::Counter::kAvgIterations);
+    state.counters["worst_acquire_us"] = worstNs / 1000.0;
+}
+
+void contentionArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"in_flight", "clients"});
+    for (int inFlight : {2, 4, 8, 16}) {
+        for (int clients : {1, 2, 4}) {
+            b->Args({inFlight, clients});
+        }
+    }
+    b->UseRealTime();
+}
+
+BENCHMARK_TEMPLATE(captureFrames, RingSlots)->Apply(contentionArgs);
+BENCHMARK_TEMPLATE(captureFrames, LockedSlots)->Apply(contentionArgs);
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
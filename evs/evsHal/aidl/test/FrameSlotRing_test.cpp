@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameSlotRing.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+TEST(FrameSlotRingTest, FirstInFirstOut) {
+    FrameSlotRing ring(4);
+    uint32_t slot = 0;
+    EXPECT_FALSE(ring.pop(&slot));
+
+    for (uint32_t i = 0; i < 4; ++i) {
+        EXPECT_TRUE(ring.push(i * 10));
+    }
+    EXPECT_FALSE(ring.push(99));
+    EXPECT_EQ(ring.size(), 4u);
+
+    // Several laps around the ring
+    for (uint32_t lap = 0; lap < 3; ++lap) {
+        for (uint32_t i = 0; i < 4; ++i) {
+            ASSERT_TRUE(ring.pop(&slot));
+            EXPECT_EQ(slot, i * 10);
+            EXPECT_TRUE(ring.push(slot));
+        }
+    }
+    EXPECT_EQ(ring.size(), 4u);
+}
+
+TEST(FrameSlotRingTest, CapacityIsRoundedUpToAPowerOfTwo) {
+    FrameSlotRing ring(5);
+    for (uint32_t i = 0; i < 8; ++i) {
+        EXPECT_TRUE(ring.push(i));
+    }
+    EXPECT_FALSE(ring.push(8));
+
+    uint32_t slot = 0;
+    for (uint32_t i = 0; i < 8; ++i) {
+        ASSERT_TRUE(ring.pop(&slot));
+        EXPECT_EQ(slot, i);
+    }
+    EXPECT_FALSE(ring.pop(&slot));
+    EXPECT_EQ(ring.size(), 0u);
+}
+
+// One capture thread takes the free slots while client threads return them, as in
+// EvsV4lCamera.  Every slot must be held by one thread at a time and none may get lost.
+TEST(FrameSlotRingTest, SlotsSurviveConcurrentReturns) {
+    constexpr uint32_t kSlots = 8;
+    constexpr unsigned kClients = 4;
+    constexpr int kFrames = 100000;
+
+    FrameSlotRing ring(kSlots);
+    std::vector<std::atomic<bool>> inUse(kSlots);
+    for (uint32_t i = 0; i < kSlots; ++i) {
+        ASSERT_TRUE(ring.push(i));
+    }
+
+    // Each client returns the slots it is handed through its own single slot mailbox
+    std::vector<std::atomic<int64_t>> mailbox(kClients);
+    for (auto& m : mailbox) {
+        m = -1;
+    }
+    std::atomic<bool> done = false;
+    std::atomic<int> errors = 0;
+    std::vector<std::thread> clients;
+    for (unsigned c = 0; c < kClients; ++c) {
+        clients.emplace_back([&, c] {
+            for (;;) {
+                const int64_t slot = mailbox[c].exchange(-1);
+                if (slot < 0) {
+                    if (done) {
+                        return;
+                    }
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (!inUse[slot].exchange(false)) {
+                    ++errors;
+                }
+                // A push only fails while the capture thread is half way through a pop
+                while (!ring.push(static_cast<uint32_t>(slot))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    int delivered = 0;
+    for (int frame = 0; frame < kFrames; ++frame) {
+        uint32_t slot = 0;
+        if (!ring.pop(&slot)) {
+            continue;
+        }
+        if (slot >= kSlots || inUse[slot].exchange(true)) {
+            ++errors;
+            continue;
+        }
+        ++delivered;
+
+        // Wait for the client to take its previous frame
+        int64_t expected = -1;
+        while (!mailbox[frame % kClients].compare_exchange_weak(expected, slot)) {
+            expected = -1;
+            std::this_thread::yield();
+        }
+    }
+
+    // Let the clients drain their mailboxes
+    for (auto& m : mailbox) {
+        while (m != -1) {
+            std::this_thread::yield();
+        }
+    }
+    done = true;
+    for (auto& t : clients) {
+        t.join();
+    }
+
+    EXPECT_EQ(errors, 0);
+    EXPECT_GT(delivered, 0);
+    EXPECT_EQ(ring.size(), kSlots);
+
+    std::vector<bool> seen(kSlots);
+    uint32_t slot = 0;
+    while (ring.pop(&slot)) {
+        ASSERT_LT(slot, kSlots);
+        EXPECT_FALSE(seen[slot]) << "slot " << slot << " was queued twice";
+        seen[slot] = true;
+    }
+}
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// CPU time per displayed frame of GlWrapper with the camera buffers imported into EGL once and
+// cached, against importing every frame as before the cache, which releaseImageCache() ahead of
+// each frame brings back.  Four 1280x720 RGBA buffers take turns as the buffers of a camera do,
+// and the frames are drawn into a pbuffer, so no display is needed.
+
+#include "GlWrapper.h"
+
+#include <aidl/android/hardware/graphics/common/BufferUsage.h>
+#include <aidl/android/hardware/graphics/common/HardwareBufferDescription.h>
+#include <aidl/android/hardware/graphics/common/PixelFormat.h>
+#include <benchmark/benchmark.h>
+#include <ui/GraphicBufferAllocator.h>
+
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+using ::aidl::android::hardware::graphics::common::BufferUsage;
+using ::aidl::android::hardware::graphics::common::HardwareBufferDescription;
+using ::aidl::android::hardware::graphics::common::PixelFormat;
+
+constexpr int kWidth = 1280;
+constexpr int kHeight = 720;
+constexpr int kNumCameraBuffers = 4;
+
+struct CameraBuffer {
+    HardwareBufferDescription description;
+    buffer_handle_t handle = nullptr;
+};
+
+// Buffers as a camera allocates them, sampled by the GPU and written by the CPU
+class CameraBuffers {
+public:
+    CameraBuffers() {
+        ::android::GraphicBufferAllocator& alloc(::android::GraphicBufferAllocator::get());
+        for (int i = 0; i < kNumCameraBuffers; ++i) {
+            CameraBuffer buffer;
+            buffer.description = {
+                    .width = kWidth,
+                    .height = kHeight,
+                    .layers = 1,
+                    .format = PixelFormat::RGBA_8888,
+                    .usage = static_cast<BufferUsage>(GRALLOC_USAGE_HW_TEXTURE |
+                                                      GRALLOC_USAGE_SW_WRITE_OFTEN),
+            };
+            uint32_t stride = 0;
+            if (alloc.allocate(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888, 1,
+                               static_cast<uint64_t>(buffer.description.usage), &buffer.handle,
+                               &stride, "EvsGlBenchmark") != ::android::NO_ERROR) {
+                return;
+            }
+            buffer.description.stride = stride;
+            mBuffers.push_back(buffer);
+        }
+    }
+
+    ~CameraBuffers() {
+        for (const auto& buffer : mBuffers) {
+            ::android::GraphicBufferAllocator::get().free(buffer.handle);
+        }
+    }
+
+    bool isValid() const { return mBuffers.size() == kNumCameraBuffers; }
+    const CameraBuffer& operator[](size_t index) const { return mBuffers[index]; }
+
+private:
+    std::vector<CameraBuffer> mBuffers;
+};
+
+// range(0): whether the imported buffers are kept from one frame to the next
+void BM_DrawCameraFrame(benchmark::State& state) {
+    const bool cached = state.range(0) != 0;
+    GlWrapper glWrapper;
+    if (!glWrapper.initializeHeadless(kWidth, kHeight)) {
+        state.SkipWithError("failed to initialize EGL");
+        return;
+    }
+
+    {
+        CameraBuffers buffers;
+        if (!buffers.isValid()) {
+            state.SkipWithError("failed to allocate the camera buffers");
+        }
+
+        uint64_t frame = 0;
+        for (auto _ : state) {
+            if (!cached) {
+                glWrapper.releaseImageCache();
+            }
+
+            const int index = frame++ % kNumCameraBuffers;
+            if (!glWrapper.updateImageTexture(index, buffers[index].handle,
+                                              buffers[index].description)) {
+                state.SkipWithError("failed to import a camera buffer");
+                break;
+            }
+            glWrapper.renderImageToScreen();
+        }
+
+        // The buffers may not be freed while they are imported
+        glWrapper.releaseImageCache();
+    }
+    glWrapper.shutdown();
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_DrawCameraFrame)->ArgName("cached")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
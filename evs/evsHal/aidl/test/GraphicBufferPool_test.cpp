@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GraphicBufferPool.h"
+
+#include <gtest/gtest.h>
+#include <hardware/gralloc.h>
+#include <system/graphics-base.h>
+#include <ui/GraphicBufferAllocator.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+// As the cameras allocate them
+constexpr uint64_t kCameraUsage =
+        GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_OFTEN;
+const GraphicBufferPool::Key kRgbaKey = {1280, 720, HAL_PIXEL_FORMAT_RGBA_8888, kCameraUsage};
+const GraphicBufferPool::Key kYuyvKey = {640, 480, HAL_PIXEL_FORMAT_YCBCR_422_I, kCameraUsage};
+
+// The pool is shared by the process, so every test starts without kept buffers and compares
+// the statistics with those at its start
+class GraphicBufferPoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mPool.trim();
+        mStart = mPool.getStats();
+        ASSERT_EQ(mStart.liveBuffers, 0u);
+    }
+
+    void TearDown() override { mPool.trim(); }
+
+    std::vector<buffer_handle_t> acquire(const GraphicBufferPool::Key& key, unsigned count) {
+        std::vector<buffer_handle_t> handles;
+        for (unsigned i = 0; i < count; ++i) {
+            uint32_t stride = 0;
+            buffer_handle_t handle = mPool.acquire(key, &stride);
+            EXPECT_NE(handle, nullptr);
+            EXPECT_GE(stride, key.width);
+            handles.push_back(handle);
+        }
+        return handles;
+    }
+
+    void release(const std::vector<buffer_handle_t>& handles) {
+        for (auto handle : handles) {
+            mPool.release(handle);
+        }
+    }
+
+    GraphicBufferPool& mPool = GraphicBufferPool::getInstance();
+    GraphicBufferPool::Stats mStart;
+};
+
+TEST_F(GraphicBufferPoolTest, NextSessionReusesTheBuffers) {
+    auto first = acquire(kRgbaKey, 6);
+    release(first);
+    auto stats = mPool.getStats();
+    EXPECT_EQ(stats.allocations - mStart.allocations, 6u);
+    EXPECT_EQ(stats.liveBuffers, 0u);
+    EXPECT_EQ(stats.idleBuffers, 6u);
+
+    // Another camera of the same configuration allocates nothing
+    auto second = acquire(kRgbaKey, 6);
+    stats = mPool.getStats();
+    EXPECT_EQ(stats.allocations - mStart.allocations, 6u);
+    EXPECT_EQ(stats.reuses - mStart.reuses, 6u);
+    EXPECT_EQ(stats.liveBuffers, 6u);
+    EXPECT_EQ(stats.idleBuffers, 0u);
+
+    std::sort(first.begin(), first.end());
+    std::sort(second.begin(), second.end());
+    EXPECT_EQ(first, second);
+    release(second);
+}
+
+TEST_F(GraphicBufferPoolTest, BuffersAreReusedOnlyForTheirKind) {
+    release(acquire(kRgbaKey, 2));
+
+    auto yuyv = acquire(kYuyvKey, 2);
+    auto stats = mPool.getStats();
+    EXPECT_EQ(stats.allocations - mStart.allocations, 4u);
+    EXPECT_EQ(stats.reuses - mStart.reuses, 0u);
+    EXPECT_EQ(stats.idleBuffers, 2u);
+
+    // Other usage is another kind as well
+    GraphicBufferPool::Key renderKey = kRgbaKey;
+    renderKey.usage |= GRALLOC_USAGE_HW_RENDER;
+    auto render = acquire(renderKey, 1);
+    EXPECT_EQ(mPool.getStats().reuses - mStart.reuses, 0u);
+
+    release(yuyv);
+    release(render);
+}
+
+TEST_F(GraphicBufferPoolTest, KeptBuffersStayBelowTheHighWatermark) {
+    const GraphicBufferPool::Key largeKey = {1920, 1080, HAL_PIXEL_FORMAT_RGBA_8888,
+                                             kCameraUsage};
+    const size_t largeBytes = 1920 * 1080 * 4;
+    const unsigned count = mStart.highWatermarkBytes / largeBytes + 3;
+
+    auto handles = acquire(largeKey, count);
+    EXPECT_GE(mPool.getStats().peakBytes, count * largeBytes);
+    release(handles);
+
+    const auto stats = mPool.getStats();
+    EXPECT_LE(stats.idleBytes, stats.highWatermarkBytes);
+    EXPECT_LT(stats.idleBuffers, count);
+    EXPECT_EQ(stats.frees - mStart.frees, count - stats.idleBuffers);
+}
+
+TEST_F(GraphicBufferPoolTest, PrewarmedBuffersServeTheFirstSession) {
+    mPool.prewarm(kYuyvKey, 4);
+
+    // Preallocation runs in the background
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (mPool.getStats().idleBuffers < 4 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    auto stats = mPool.getStats();
+    ASSERT_EQ(stats.idleBuffers, 4u);
+    EXPECT_EQ(stats.prewarmed - mStart.prewarmed, 4u);
+
+    auto handles = acquire(kYuyvKey, 4);
+    stats = mPool.getStats();
+    EXPECT_EQ(stats.reuses - mStart.reuses, 4u);
+    EXPECT_EQ(stats.allocations - mStart.allocations, 4u);
+    release(handles);
+}
+
+TEST_F(GraphicBufferPoolTest, TrimFreesTheKeptBuffers) {
+    auto kept = acquire(kRgbaKey, 3);
+    auto live = acquire(kYuyvKey, 1);
+    release(kept);
+
+    mPool.trim();
+    const auto stats = mPool.getStats();
+    EXPECT_EQ(stats.idleBuffers, 0u);
+    EXPECT_EQ(stats.idleBytes, 0u);
+    EXPECT_EQ(stats.liveBuffers, 1u);
+    EXPECT_EQ(stats.frees - mStart.frees, 3u);
+    release(live);
+}
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MediaControl.h"
+#include "SysCall.h"
+
+#include <gtest/gtest.h>
+#include <linux/version.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kMediaFd = 0x7ffe0000;
+
+// A deserializer with two sensors which may feed its first sink pad, and a CSI-2 receiver
+// carrying a stream of another camera.  The graph answers the media controller ioctls the way
+// the kernel does; enabling a link into a sink pad fed by another enabled link fails with EBUSY.
+class FakeMediaDevice : public SysCall {
+public:
+    struct Entity {
+        uint32_t id;
+        std::string name;
+        uint32_t pads;
+    };
+
+    struct Link {
+        uint32_t source;
+        uint32_t sourcePad;
+        uint32_t sink;
+        uint32_t sinkPad;
+        uint32_t flags;
+    };
+
+    FakeMediaDevice() {
+        addEntity("isx031 a", 1);
+        addEntity("isx031 b", 1);
+        addEntity("isx031 e", 1);
+        addEntity("TI960 a", 5);
+        addEntity("Intel IPU6 CSI-2 1", 2);
+        addEntity("Intel IPU6 CSI-2 3", 2);
+        addEntity("Intel IPU6 ISYS Capture 2", 1);
+        addEntity("Intel IPU6 ISYS Capture 6", 1);
+
+        addLink("isx031 a", 0, "TI960 a", 0, MEDIA_LNK_FL_ENABLED);
+        addLink("isx031 b", 0, "TI960 a", 1, MEDIA_LNK_FL_ENABLED);
+        addLink("isx031 e", 0, "TI960 a", 0, 0);
+        addLink("TI960 a", 4, "Intel IPU6 CSI-2 1", 0, MEDIA_LNK_FL_ENABLED);
+        addLink("Intel IPU6 CSI-2 1", 1, "Intel IPU6 ISYS Capture 2", 0, 0);
+        addLink("Intel IPU6 CSI-2 3", 1, "Intel IPU6 ISYS Capture 6", 0, MEDIA_LNK_FL_ENABLED);
+    }
+
+    void addEntity(const std::string& name, uint32_t pads) {
+        mEntities.push_back({static_cast<uint32_t>(mEntities.size() + 1), name, pads});
+    }
+
+    void addLink(const std::string& source, uint32_t sourcePad, const std::string& sink,
+                 uint32_t sinkPad, uint32_t flags) {
+        mLinks.push_back({entityId(source), sourcePad, entityId(sink), sinkPad, flags});
+    }
+
+    Link* findLink(const std::string& source, uint32_t sourcePad, const std::string& sink,
+                   uint32_t sinkPad) {
+        for (Link& link : mLinks) {
+            if (link.source == entityId(source) && link.sourcePad == sourcePad &&
+                link.sink == entityId(sink) && link.sinkPad == sinkPad) {
+                return &link;
+            }
+        }
+        return nullptr;
+    }
+
+    bool isEnabled(const std::string& source, uint32_t sourcePad, const std::string& sink,
+                   uint32_t sinkPad) {
+        Link* link = findLink(source, sourcePad, sink, sinkPad);
+        return link && (link->flags & MEDIA_LNK_FL_ENABLED);
+    }
+
+    // Another client changing the graph
+    void bumpTopologyVersion() { ++mTopologyVersion; }
+    void setHasTopology(bool hasTopology) { mHasTopology = hasTopology; }
+
+    // The links set up, in order, as "enable <source>:<pad> -> <sink>:<pad>"
+    std::vector<std::string> mSetupLinks;
+    int mNumEnumEntities = 0;
+
+    using SysCall::ioctl;
+
+    int open(const char*, int) override { return kMediaFd; }
+    int close(int) override { return 0; }
+
+    int ioctl(int fd, int, media_device_info* info) override {
+        if (fd != kMediaFd) return fail(EBADF);
+        memset(info, 0, sizeof(*info));
+        snprintf(info->driver, sizeof(info->driver), "intel-ipu6");
+        info->media_version = KERNEL_VERSION(5, 15, 0);
+        return 0;
+    }
+
+    int ioctl(int fd, int, media_entity_desc* desc) override {
+        if (fd != kMediaFd) return fail(EBADF);
+        ++mNumEnumEntities;
+        uint32_t id = desc->id & ~MEDIA_ENT_ID_FLAG_NEXT;
+        bool next = desc->id & MEDIA_ENT_ID_FLAG_NEXT;
+        for (const Entity& entity : mEntities) {
+            if (next ? entity.id <= id : entity.id != id) {
+                continue;
+            }
+            memset(desc, 0, sizeof(*desc));
+            desc->id = entity.id;
+            snprintf(desc->name, sizeof(desc->name), "%s", entity.name.c_str());
+            desc->pads = entity.pads;
+            for (const Link& link : mLinks) {
+                desc->links += link.source == entity.id;
+            }
+            return 0;
+        }
+        return fail(EINVAL);
+    }
+
+    int ioctl(int fd, int, media_links_enum* links) override {
+        if (fd != kMediaFd) return fail(EBADF);
+        const Entity* entity = findEntity(links->entity);
+        if (!entity) return fail(EINVAL);
+        for (uint32_t i = 0; i < entity->pads; i++) {
+            memset(&links->pads[i], 0, sizeof(links->pads[i]));
+            links->pads[i].entity = entity->id;
+            links->pads[i].index = i;
+        }
+        uint32_t n = 0;
+        for (const Link& link : mLinks) {
+            if (link.source != entity->id) continue;
+            media_link_desc& desc = links->links[n++];
+            memset(&desc, 0, sizeof(desc));
+            desc.source.entity = link.source;
+            desc.source.index = link.sourcePad;
+            desc.sink.entity = link.sink;
+            desc.sink.index = link.sinkPad;
+            desc.flags = link.flags;
+        }
+        return 0;
+    }
+
+    int ioctl(int fd, int, media_link_desc* desc) override {
+        if (fd != kMediaFd) return fail(EBADF);
+        Link* link = nullptr;
+        for (Link& l : mLinks) {
+            if (l.source == desc->source.entity && l.sourcePad == desc->source.index &&
+                l.sink == desc->sink.entity && l.sinkPad == desc->sink.index) {
+                link = &l;
+            }
+        }
+        if (!link) return fail(EINVAL);
+
+        bool enable = desc->flags & MEDIA_LNK_FL_ENABLED;
+        mSetupLinks.push_back(std::string(enable ? "enable " : "disable ") +
+                              findEntity(link->source)->name + ":" +
+                              std::to_string(link->sourcePad) + " -> " +
+                              findEntity(link->sink)->name + ":" + std::to_string(link->sinkPad));
+        if (enable) {
+            for (const Link& other : mLinks) {
+                if (&other != link && other.sink == link->sink &&
+                    other.sinkPad == link->sinkPad && (other.flags & MEDIA_LNK_FL_ENABLED)) {
+                    return fail(EBUSY);
+                }
+            }
+        }
+        link->flags = desc->flags;
+        return 0;
+    }
+
+    // Pads have ids of 100 times their entity plus their index, and an interface link leads
+    // to each entity, as with the device nodes of the subdevices
+    int ioctl(int fd, int, media_v2_topology* topology) override {
+        if (fd != kMediaFd) return fail(EBADF);
+        if (!mHasTopology) return fail(ENOTTY);
+
+        uint32_t numPads = 0;
+        for (const Entity& entity : mEntities) {
+            numPads += entity.pads;
+        }
+        uint32_t numLinks = mEntities.size() + mLinks.size();
+        if ((topology->ptr_pads && topology->num_pads < numPads) ||
+            (topology->ptr_links && topology->num_links < numLinks)) {
+            return fail(ENOSPC);
+        }
+
+        if (topology->ptr_pads) {
+            auto* pads = reinterpret_cast<media_v2_pad*>(topology->ptr_pads);
+            for (const Entity& entity : mEntities) {
+                for (uint32_t i = 0; i < entity.pads; i++) {
+                    *pads = {};
+                    pads->id = entity.id * 100 + i;
+                    pads->entity_id = entity.id;
+                    pads->index = i;
+                    pads++;
+                }
+            }
+        }
+        if (topology->ptr_links) {
+            auto* links = reinterpret_cast<media_v2_link*>(topology->ptr_links);
+            for (const Entity& entity : mEntities) {
+                *links = {};
+                links->source_id = 10000 + entity.id;
+                links->sink_id = entity.id;
+                links->flags = MEDIA_LNK_FL_INTERFACE_LINK | MEDIA_LNK_FL_ENABLED;
+                links++;
+            }
+            for (const Link& link : mLinks) {
+                *links = {};
+                links->source_id = link.source * 100 + link.sourcePad;
+                links->sink_id = link.sink * 100 + link.sinkPad;
+                links->flags = link.flags;
+                links++;
+            }
+        }
+        topology->topology_version = mTopologyVersion;
+        topology->num_entities = mEntities.size();
+        topology->num_pads = numPads;
+        topology->num_links = numLinks;
+        return 0;
+    }
+
+private:
+    static int fail(int error) {
+        errno = error;
+        return -1;
+    }
+
+    uint32_t entityId(const std::string& name) const {
+        for (const Entity& entity : mEntities) {
+            if (entity.name == name) return entity.id;
+        }
+        return 0;
+    }
+
+    const Entity* findEntity(uint32_t id) const {
+        for (const Entity& entity : mEntities) {
+            if (entity.id == id) return &entity;
+        }
+        return nullptr;
+    }
+
+    std::vector<Entity> mEntities;
+    std::vector<Link> mLinks;
+    uint64_t mTopologyVersion = 7;
+    bool mHasTopology = true;
+};
+
+McLink makeLink(const char* source, uint32_t sourcePad, const char* sink, uint32_t sinkPad) {
+    McLink link = {};
+    link.srcEntityName = source;
+    link.srcPad = sourcePad;
+    link.sinkEntityName = sink;
+    link.sinkPad = sinkPad;
+    link.enable = true;
+    return link;
+}
+
+// The route of the camera behind the first sink pad of the deserializer
+std::vector<McLink> makeRoute(const char* sensor) {
+    return {makeLink(sensor, 0, "TI960 a", 0), makeLink("TI960 a", 4, "Intel IPU6 CSI-2 1", 0),
+            makeLink("Intel IPU6 CSI-2 1", 1, "Intel IPU6 ISYS Capture 2", 0)};
+}
+
+}  // namespace
+
+class MediaControlTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mPreviousSysCall = SysCall::getInstance();
+        SysCall::updateInstance(&mDevice);
+        mMediaControl = new MediaControl("/dev/media0");
+    }
+
+    void TearDown() override {
+        delete mMediaControl;
+        SysCall::updateInstance(mPreviousSysCall);
+    }
+
+    FakeMediaDevice mDevice;
+    MediaControl* mMediaControl = nullptr;
+
+private:
+    SysCall* mPreviousSysCall = nullptr;
+};
+
+namespace {
+
+TEST_F(MediaControlTest, ConflictingLinkIsDisabledBeforeTheRouteIsEnabled) {
+    ASSERT_EQ(mMediaControl->setupRoute(makeRoute("isx031 e")), 0);
+
+    std::vector<std::string> expected = {
+            "disable isx031 a:0 -> TI960 a:0",
+            "enable isx031 e:0 -> TI960 a:0",
+            "enable Intel IPU6 CSI-2 1:1 -> Intel IPU6 ISYS Capture 2:0",
+    };
+    EXPECT_EQ(mDevice.mSetupLinks, expected);
+
+    // The stream of the other sensor into the deserializer and the other CSI-2 port stay up
+    EXPECT_TRUE(mDevice.isEnabled("isx031 b", 0, "TI960 a", 1));
+    EXPECT_TRUE(mDevice.isEnabled("Intel IPU6 CSI-2 3", 1, "Intel IPU6 ISYS Capture 6", 0));
+}
+
+TEST_F(MediaControlTest, EnabledRouteIsNotSetAgain) {
+    ASSERT_EQ(mMediaControl->setupRoute(makeRoute("isx031 a")), 0);
+    mDevice.mSetupLinks.clear();
+
+    ASSERT_EQ(mMediaControl->setupRoute(makeRoute("isx031 a")), 0);
+    EXPECT_TRUE(mDevice.mSetupLinks.empty());
+}
+
+TEST_F(MediaControlTest, UnknownLinkIsRejectedWithoutChanges) {
+    std::vector<McLink> route = makeRoute("isx031 e");
+    route.push_back(makeLink("isx031 z", 0, "TI960 a", 2));
+
+    EXPECT_EQ(mMediaControl->setupRoute(route), -ENOENT);
+    EXPECT_TRUE(mDevice.mSetupLinks.empty());
+    EXPECT_TRUE(mDevice.isEnabled("isx031 a", 0, "TI960 a", 0));
+}
+
+TEST_F(MediaControlTest, TopologyIsEnumeratedOnceWhileTheVersionHolds) {
+    ASSERT_EQ(mMediaControl->initEntities(), 0);
+    int numEnumEntities = mDevice.mNumEnumEntities;
+    ASSERT_GT(numEnumEntities, 0);
+
+    ASSERT_EQ(mMediaControl->setupRoute(makeRoute("isx031 e")), 0);
+    ASSERT_EQ(mMediaControl->setupRoute(makeRoute("isx031 a")), 0);
+    EXPECT_EQ(mDevice.mNumEnumEntities, numEnumEntities);
+}
+
+TEST_F(MediaControlTest, LinksSwitchedByOthersAreRefreshed) {
+    ASSERT_EQ(mMediaControl->initEntities(), 0);
+
+    // Someone else moves the first sink pad to the other sensor behind our back
+    mDevice.findLink("isx031 a", 0, "TI960 a", 0)->flags = 0;
+    mDevice.findLink("isx031 e", 0, "TI960 a", 0)->flags = MEDIA_LNK_FL_ENABLED;
+
+    ASSERT_EQ(mMediaControl->setupRoute(makeRoute("isx031 a")), 0);
+    std::vector<std::string> expected = {
+            "disable isx031 e:0 -> TI960 a:0",
+            "enable isx031 a:0 -> TI960 a:0",
+            "enable Intel IPU6 CSI-2 1:1 -> Intel IPU6 ISYS Capture 2:0",
+    };
+    EXPECT_EQ(mDevice.mSetupLinks, expected);
+}
+
+TEST_F(MediaControlTest, ChangedTopologyIsEnumeratedAgain) {
+    ASSERT_EQ(mMediaControl->initEntities(), 0);
+    ASSERT_EQ(mMediaControl->getEntityIdByName("Intel IPU6 ISYS Capture 3"), -1);
+    int numEnumEntities = mDevice.mNumEnumEntities;
+
+    mDevice.addEntity("Intel IPU6 ISYS Capture 3", 1);
+    mDevice.addLink("Intel IPU6 CSI-2 1", 1, "Intel IPU6 ISYS Capture 3", 0, 0);
+    mDevice.bumpTopologyVersion();
+
+    ASSERT_EQ(mMediaControl->initEntities(), 0);
+    EXPECT_GT(mDevice.mNumEnumEntities, numEnumEntities);
+    EXPECT_GT(mMediaControl->getEntityIdByName("Intel IPU6 ISYS Capture 3"), 0);
+
+    std::vector<McLink> route = {
+            makeLink("Intel IPU6 CSI-2 1", 1, "Intel IPU6 ISYS Capture 3", 0)};
+    ASSERT_EQ(mMediaControl->setupRoute(route), 0);
+    EXPECT_TRUE(mDevice.isEnabled("Intel IPU6 CSI-2 1", 1, "Intel IPU6 ISYS Capture 3", 0));
+}
+
+TEST_F(MediaControlTest, DeviceWithoutTopologyIsEnumeratedEveryTime) {
+    mDevice.setHasTopology(false);
+
+    ASSERT_EQ(mMediaControl->initEntities(), 0);
+    int numEnumEntities = mDevice.mNumEnumEntities;
+
+    ASSERT_EQ(mMediaControl->setupRoute(makeRoute("isx031 e")), 0);
+    EXPECT_GT(mDevice.mNumEnumEntities, numEnumEntities);
+    EXPECT_EQ(mDevice.mSetupLinks.front(), "disable isx031 a:0 -> TI960 a:0");
+    EXPECT_TRUE(mDevice.isEnabled("isx031 e", 0, "TI960 a", 0));
+}
+
+}  // namespace
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// CPU time of the conversions for the streams of a 30 fps 1280x720 YUYV camera, per second of
+// video: a main view, two thumbnails and an NV21 stream for a model, all full size at the sensor
+// rate against each one at its own size and rate.  Each stream runs its FrameRateLimiter first
+// and converts only the frames it keeps, as forwardFrame() does.
+
+#include "FrameRateLimiter.h"
+#include "bufferCopy.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+constexpr unsigned kSensorWidth = 1280;
+constexpr unsigned kSensorHeight = 720;
+constexpr unsigned kSensorFps = 30;
+constexpr int64_t kSensorPeriodNs = 1000000000LL / kSensorFps;
+
+struct Consumer {
+    const char* name;
+    unsigned width;
+    unsigned height;
+    bool nv21;     // RGBA otherwise
+    unsigned fps;  // 0 for the sensor rate
+};
+
+const std::vector<Consumer> kAllFullSize = {
+        {"main", 1280, 720, false, 0},
+        {"thumbnail", 1280, 720, false, 0},
+        {"thumbnail", 1280, 720, false, 0},
+        {"model", 1280, 720, true, 0},
+};
+
+const std::vector<Consumer> kPerStreamSizeAndRate = {
+        {"main", 1280, 720, false, 0},
+        {"thumbnail", 320, 180, false, 15},
+        {"thumbnail", 320, 180, false, 15},
+        {"model", 640, 360, true, 5},
+};
+
+class Stream {
+public:
+    explicit Stream(const Consumer& consumer) :
+          mConsumer(consumer), mTarget(consumer.width * consumer.height * 4) {
+        mLimiter.setTargetRate(consumer.fps);
+        AHardwareBuffer_Desc* pDesc =
+                reinterpret_cast<AHardwareBuffer_Desc*>(&mDesc.buffer.description);
+        pDesc->width = consumer.width;
+        pDesc->height = consumer.height;
+        pDesc->stride = consumer.width;
+        pDesc->layers = 1;
+    }
+
+    // Returns the pixels converted for the frame
+    uint64_t forwardFrame(int64_t timestampNs, uint8_t* frame) {
+        if (!mLimiter.accept(timestampNs)) {
+            return 0;
+        }
+
+        const unsigned stride = kSensorWidth * 2;
+        const unsigned height = mConsumer.height;
+        const bool scaled = mConsumer.width != kSensorWidth || height != kSensorHeight;
+        if (mConsumer.nv21 && scaled) {
+            fillNV21FromYUYVScaled(mDesc, mTarget.data(), frame, stride, 0, height, kSensorWidth,
+                                   kSensorHeight);
+        } else if (mConsumer.nv21) {
+            fillNV21FromYUYV(mDesc, mTarget.data(), frame, stride, 0, height);
+        } else if (scaled) {
+            fillRGBAFromYUYVScaled(mDesc, mTarget.data(), frame, stride, 0, height, kSensorWidth,
+                                   kSensorHeight, YuvColorSpace::BT601_LIMITED);
+        } else {
+            fillRGBAFromYUYV(mDesc, mTarget.data(), frame, stride, 0, height,
+                             YuvColorSpace::BT601_LIMITED);
+        }
+        return static_cast<uint64_t>(mConsumer.width) * height;
+    }
+
+private:
+    const Consumer& mConsumer;
+    FrameRateLimiter mLimiter;
+    BufferDesc mDesc;
+    std::vector<uint8_t> mTarget;
+};
+
+// One iteration is one second of video
+void BM_ConvertStreams(benchmark::State& state, const std::vector<Consumer>* consumers) {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> frame(kSensorWidth * kSensorHeight * 2);
+    for (auto& b : frame) {
+        b = byte(rng);
+    }
+
+    std::vector<Stream> streams(consumers->begin(), consumers->end());
+
+    // The timestamps of the sensor come up to a millisecond early or late
+    std::uniform_int_distribution<int64_t> jitter(-1000000, 1000000);
+    int64_t frameCount = 0;
+    uint64_t converted = 0;
+    uint64_t pixels = 0;
+    for (auto _ : state) {
+        for (unsigned f = 0; f < kSensorFps; ++f) {
+            const int64_t timestampNs = frameCount++ * kSensorPeriodNs + jitter(rng);
+            for (auto& stream : streams) {
+                const uint64_t streamPixels = stream.forwardFrame(timestampNs, frame.data());
+                converted += streamPixels > 0;
+                pixels += streamPixels;
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+
+    state.counters["frames_converted"] =
+            benchmark::Counter(converted, benchmark::Counter::kAvgIterations);
+    state.counters["Mpixels"] = benchmark::Counter(pixels / 1e6, benchmark::Counter::kAvgIterations);
+}
+
+}  // namespace
+
+BENCHMARK_CAPTURE(BM_ConvertStreams, all_full_size, &kAllFullSize)
+        ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ConvertStreams, per_stream_size_and_rate, &kPerStreamSizeAndRate)
+        ->Unit(benchmark::kMillisecond);
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
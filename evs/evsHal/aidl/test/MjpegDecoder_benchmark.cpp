@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Decoding MJPEG frames of 1920x1080 UVC cameras.  A recording of a moving 4:2:2 scene is
+// generated once per process and played by replay devices, so the frames come through
+// ReplaySysCall and VideoCapture as they would from a camera.  BM_MjpegDecode decodes a captured
+// frame at full size and at 1/2 and 1/4 scale in the IDCT into each target format, and
+// BM_MjpegCameras streams one to four cameras and decodes either on the capture thread or on
+// MjpegDecoderPool.
+
+#include "LatencyHistogram.h"
+#include "MjpegDecoder.h"
+#include "ReplayDevices.h"
+#include "VideoCapture.h"
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <system/graphics-base.h>
+#include <utils/Timers.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <jpeglib.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+constexpr uint32_t kWidth = 1920;
+constexpr uint32_t kHeight = 1080;
+constexpr int kRecordedFrames = 30;
+constexpr int kNumMjpegDevices = 4;
+
+// Length of one iteration of BM_MjpegCameras
+constexpr int kMeasuredSeconds = 2;
+
+std::string getMjpegReplayDevice(int index) {
+    return "/dev/video-replay-mjpeg" + std::to_string(index);
+}
+
+// A 4:2:2 JPEG like UVC cameras send, of gradients which move with the frame
+std::vector<uint8_t> encodeFrame(int frame) {
+    jpeg_compress_struct info;
+    jpeg_error_mgr error;
+    info.err = jpeg_std_error(&error);
+    jpeg_create_compress(&info);
+
+    unsigned char* out = nullptr;
+    unsigned long size = 0;
+    jpeg_mem_dest(&info, &out, &size);
+    info.image_width = kWidth;
+    info.image_height = kHeight;
+    info.input_components = 3;
+    info.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, 85, TRUE);
+    info.comp_info[0].h_samp_factor = 2;
+    info.comp_info[0].v_samp_factor = 1;
+    jpeg_start_compress(&info, TRUE);
+
+    std::vector<uint8_t> row(kWidth * 3);
+    while (info.next_scanline < kHeight) {
+        const unsigned y = info.next_scanline;
+        for (unsigned x = 0; x < kWidth; ++x) {
+            row[x * 3] = x + frame * 8;
+            row[x * 3 + 1] = y * 255 / kHeight;
+            row[x * 3 + 2] = (x ^ y) + frame;
+        }
+        JSAMPROW rows[] = {row.data()};
+        jpeg_write_scanlines(&info, rows, 1);
+    }
+    jpeg_finish_compress(&info);
+    jpeg_destroy_compress(&info);
+
+    std::vector<uint8_t> jpeg(out, out + size);
+    free(out);
+    return jpeg;
+}
+
+// Records the generated frames and adds the devices which play them, once per process
+bool installMjpegReplayDevices() {
+    static const bool installed = [] {
+        if (!installReplayDevices()) {
+            return false;
+        }
+
+        // The devices map the recording, so it may go with the directory
+        TemporaryDir dir;
+        const std::string recordingPath = std::string(dir.path) + "/mjpeg.rec";
+        {
+            auto recorder = ReplayRecorder::Create(recordingPath, V4L2_PIX_FMT_MJPEG, kWidth,
+                                                   kHeight, 0);
+            if (!recorder) {
+                return false;
+            }
+            for (int i = 0; i < kRecordedFrames; ++i) {
+                const auto jpeg = encodeFrame(i);
+                if (!recorder->record(i * 1000000000LL / 30, jpeg.data(), jpeg.size())) {
+                    return false;
+                }
+            }
+            recorder->finish();
+            if (recorder->getNumFrames() != kRecordedFrames) {
+                return false;
+            }
+        }
+
+        std::string config;
+        for (int i = 0; i < kNumMjpegDevices; ++i) {
+            config += getMjpegReplayDevice(i) + " " + recordingPath + " fps=30\n";
+        }
+        const std::string configPath = std::string(dir.path) + "/replay.conf";
+        return ::android::base::WriteStringToFile(config, configPath) &&
+                ReplaySysCall::addDevices(configPath);
+    }();
+    return installed;
+}
+
+// Copies the first frame a device delivers
+std::vector<uint8_t> captureFrame(const std::string& device) {
+    VideoCapture video;
+    if (!video.open(device.data(), kWidth, kHeight)) {
+        return {};
+    }
+
+    std::mutex lock;
+    std::condition_variable signal;
+    std::vector<uint8_t> frame;
+    video.startStream([&](VideoCapture* capture, imageBuffer* buffer, void* data) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (frame.empty()) {
+                const auto* bytes = static_cast<const uint8_t*>(data);
+                frame.assign(bytes, bytes + buffer->bytesused);
+            }
+        }
+        signal.notify_all();
+        capture->markFrameConsumed(buffer->index);
+    });
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        signal.wait_for(guard, std::chrono::seconds(5), [&frame] { return !frame.empty(); });
+    }
+    video.stopStream();
+    video.close();
+    return frame;
+}
+
+// Rows of gralloc buffers are aligned, so the targets are too
+uint32_t getStride(uint32_t width) {
+    return (width + 63) & ~63u;
+}
+
+// range(0): the HAL pixel format of the target, range(1): the divisor of its size
+void BM_MjpegDecode(benchmark::State& state) {
+    const uint32_t format = state.range(0);
+    const uint32_t scale = state.range(1);
+    if (!installMjpegReplayDevices()) {
+        state.SkipWithError("no MJPEG replay devices");
+        return;
+    }
+    const std::vector<uint8_t> jpeg = captureFrame(getMjpegReplayDevice(0));
+    if (jpeg.empty()) {
+        state.SkipWithError("no frame captured");
+        return;
+    }
+
+    const uint32_t width = kWidth / scale;
+    const uint32_t height = kHeight / scale;
+    std::vector<uint8_t> pixels(getStride(width) * height * 4);
+    const MjpegDecoder::Target target = {
+            .pixels = pixels.data(),
+            .format = format,
+            .width = width,
+            .height = height,
+            .stride = getStride(width),
+    };
+    MjpegDecoder decoder;
+    for (auto _ : state) {
+        if (!decoder.decode(jpeg.data(), jpeg.size(), target)) {
+            state.SkipWithError("failed to decode");
+            return;
+        }
+        benchmark::DoNotOptimize(pixels.data());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * jpeg.size());
+    state.counters["idct_scale"] = decoder.getLastScale();
+}
+
+BENCHMARK(BM_MjpegDecode)
+        ->ArgNames({"format", "scale"})
+        ->ArgsProduct({{HAL_PIXEL_FORMAT_RGBA_8888, HAL_PIXEL_FORMAT_YCBCR_422_I,
+                        HAL_PIXEL_FORMAT_YCRCB_420_SP},
+                       {1, 2, 4}})
+        ->Unit(benchmark::kMillisecond);
+
+// Decodes the frames of one camera into its own RGBA target at half size, as EvsV4lCamera does
+// on a decoder thread or, without MjpegDecoderPool, on the capture thread
+class MjpegCamera {
+public:
+    MjpegCamera(bool usePool, LatencyHistogram* callbackLatency,
+                LatencyHistogram* frameLatency)
+          : mUsePool(usePool),
+            mCallbackLatency(callbackLatency),
+            mFrameLatency(frameLatency),
+            mPixels(getStride(kWidth / 2) * (kHeight / 2) * 4) {}
+
+    bool start(const std::string& device) {
+        return mVideo.open(device.data(), kWidth, kHeight) &&
+                mVideo.startStream([this](VideoCapture* video, imageBuffer* buffer, void* data) {
+                    onFrame(video, buffer, data);
+                });
+    }
+
+    void stop() {
+        mVideo.stopStream();
+        if (mUsePool) {
+            MjpegDecoderPool::getInstance().drain(this);
+        }
+        mVideo.close();
+    }
+
+    void reset() {
+        mDecoded = 0;
+        mDropped = 0;
+    }
+
+    uint64_t getDecoded() const { return mDecoded; }
+    uint64_t getDropped() const { return mDropped; }
+
+private:
+    void onFrame(VideoCapture* video, imageBuffer* buffer, void* data) {
+        const int64_t startNs = systemTime(SYSTEM_TIME_MONOTONIC);
+        const int64_t timestampNs = buffer->timestamp.tv_sec * 1000000000LL +
+                buffer->timestamp.tv_usec * 1000LL;
+        if (mUsePool) {
+            const bool queued = MjpegDecoderPool::getInstance().submit(
+                    this, data, buffer->bytesused,
+                    [this, timestampNs](MjpegDecoder& decoder, const std::vector<uint8_t>& frame) {
+                        decode(decoder, frame.data(), frame.size(), timestampNs);
+                    });
+            if (!queued) {
+                ++mDropped;
+            }
+        } else {
+            decode(mDecoder, static_cast<const uint8_t*>(data), buffer->bytesused, timestampNs);
+        }
+        video->markFrameConsumed(buffer->index);
+        mCallbackLatency->record((systemTime(SYSTEM_TIME_MONOTONIC) - startNs) / 1000);
+    }
+
+    void decode(MjpegDecoder& decoder, const uint8_t* data, size_t size, int64_t timestampNs) {
+        const MjpegDecoder::Target target = {
+                .pixels = mPixels.data(),
+                .format = HAL_PIXEL_FORMAT_RGBA_8888,
+                .width = kWidth / 2,
+                .height = kHeight / 2,
+                .stride = getStride(kWidth / 2),
+        };
+        if (decoder.decode(data, size, target)) {
+            mFrameLatency->record((systemTime(SYSTEM_TIME_MONOTONIC) - timestampNs) / 1000);
+            ++mDecoded;
+        }
+    }
+
+    const bool mUsePool;
+    LatencyHistogram* const mCallbackLatency;
+    LatencyHistogram* const mFrameLatency;
+    VideoCapture mVideo;
+    MjpegDecoder mDecoder;  // Used by the capture thread when not pooled
+    std::vector<uint8_t> mPixels;
+    std::atomic<uint64_t> mDecoded = 0;
+    std::atomic<uint64_t> mDropped = 0;
+};
+
+// range(0): the number of cameras, range(1): whether MjpegDecoderPool decodes the frames
+void BM_MjpegCameras(benchmark::State& state) {
+    const int numCameras = state.range(0);
+    const bool usePool = state.range(1) != 0;
+    if (!installMjpegReplayDevices()) {
+        state.SkipWithError("no MJPEG replay devices");
+        return;
+    }
+
+    LatencyHistogram callbackLatency;
+    LatencyHistogram frameLatency;
+    std::vector<std::unique_ptr<MjpegCamera>> cameras;
+    const auto stopCameras = [&cameras] {
+        for (auto& camera : cameras) {
+            camera->stop();
+        }
+    };
+    for (int i = 0; i < numCameras; ++i) {
+        auto camera = std::make_unique<MjpegCamera>(usePool, &callbackLatency, &frameLatency);
+        if (!camera->start(getMjpegReplayDevice(i))) {
+            state.SkipWithError("failed to start a camera");
+            stopCameras();
+            return;
+        }
+        cameras.push_back(std::move(camera));
+    }
+
+    // Frames queued while the streams started would count as late
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    for (auto& camera : cameras) {
+        camera->reset();
+    }
+    callbackLatency.reset();
+    frameLatency.reset();
+
+    double seconds = 0;
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::seconds(kMeasuredSeconds));
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    uint64_t decoded = 0;
+    uint64_t dropped = 0;
+    for (const auto& camera : cameras) {
+        decoded += camera->getDecoded();
+        dropped += camera->getDropped();
+    }
+    stopCameras();
+
+    state.SetItemsProcessed(decoded);
+    if (seconds > 0) {
+        state.counters["fps_per_camera"] = decoded / seconds / numCameras;
+    }
+    state.counters["dropped"] = dropped;
+    state.counters["callback_p99_ms"] = callbackLatency.getSummary().p99Us / 1000.;
+    state.counters["frame_p99_ms"] = frameLatency.getSummary().p99Us / 1000.;
+}
+
+BENCHMARK(BM_MjpegCameras)
+        ->ArgNames({"cameras", "pool"})
+        ->ArgsProduct({{1, 2, 4}, {0, 1}})
+        ->Iterations(1)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MjpegDecoder.h"
+
+#include <gtest/gtest.h>
+#include <system/graphics-base.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jpeglib.h>
+
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+constexpr uint8_t kGuard = 0xA5;
+
+// A 4:2:2 JPEG like UVC cameras send, of a single color
+std::vector<uint8_t> encodeJpeg(unsigned width, unsigned height, const uint8_t rgb[3]) {
+    jpeg_compress_struct info;
+    jpeg_error_mgr error;
+    info.err = jpeg_std_error(&error);
+    jpeg_create_compress(&info);
+
+    unsigned char* out = nullptr;
+    unsigned long size = 0;
+    jpeg_mem_dest(&info, &out, &size);
+    info.image_width = width;
+    info.image_height = height;
+    info.input_components = 3;
+    info.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, 95, TRUE);
+    info.comp_info[0].h_samp_factor = 2;
+    info.comp_info[0].v_samp_factor = 1;
+    jpeg_start_compress(&info, TRUE);
+
+    std::vector<uint8_t> row(width * 3);
+    for (unsigned x = 0; x < width; ++x) {
+        memcpy(&row[x * 3], rgb, 3);
+    }
+    while (info.next_scanline < height) {
+        JSAMPROW rows[] = {row.data()};
+        jpeg_write_scanlines(&info, rows, 1);
+    }
+    jpeg_finish_compress(&info);
+    jpeg_destroy_compress(&info);
+
+    std::vector<uint8_t> jpeg(out, out + size);
+    free(out);
+    return jpeg;
+}
+
+// Decodes into a buffer which ends right after the last row, followed by guard bytes
+bool decodeWithGuard(const std::vector<uint8_t>& jpeg, uint32_t format, uint32_t width,
+                     uint32_t height, std::vector<uint8_t>* pixels, size_t* imageSize) {
+    const unsigned bytesPerPixel = format == HAL_PIXEL_FORMAT_RGBA_8888 ? 4 : 2;
+    *imageSize = width * height * bytesPerPixel;
+    pixels->assign(*imageSize + 64, kGuard);
+
+    MjpegDecoder decoder;
+    const MjpegDecoder::Target target = {
+            .pixels = pixels->data(),
+            .format = format,
+            .width = width,
+            .height = height,
+            .stride = width,
+    };
+    return decoder.decode(jpeg.data(), jpeg.size(), target);
+}
+
+bool guardIsIntact(const std::vector<uint8_t>& pixels, size_t imageSize) {
+    for (size_t i = imageSize; i < pixels.size(); ++i) {
+        if (pixels[i] != kGuard) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(MjpegDecoderTest, DecodesIntoRgba) {
+    const uint8_t orange[] = {240, 128, 16};
+    const auto jpeg = encodeJpeg(64, 48, orange);
+
+    std::vector<uint8_t> pixels;
+    size_t imageSize = 0;
+    ASSERT_TRUE(decodeWithGuard(jpeg, HAL_PIXEL_FORMAT_RGBA_8888, 64, 48, &pixels, &imageSize));
+    EXPECT_TRUE(guardIsIntact(pixels, imageSize));
+    for (size_t i = 0; i < imageSize; i += 4) {
+        EXPECT_NEAR(pixels[i], orange[0], 4);
+        EXPECT_NEAR(pixels[i + 1], orange[1], 4);
+        EXPECT_NEAR(pixels[i + 2], orange[2], 4);
+        EXPECT_EQ(pixels[i + 3], 0xFF);
+    }
+}
+
+// The last pixel of an odd width has no partner in a Y0 U Y1 V pair and must not write one
+TEST(MjpegDecoderTest, OddWidthYuyvEndsWithTheRow) {
+    const uint8_t gray[] = {128, 128, 128};
+    const uint32_t widths[] = {33, 63};  // Decoded at full size, and resampled from 64
+    for (uint32_t width : widths) {
+        SCOPED_TRACE(width);
+        const auto jpeg = encodeJpeg(width == 33 ? 33 : 64, 16, gray);
+
+        std::vector<uint8_t> pixels;
+        size_t imageSize = 0;
+        ASSERT_TRUE(decodeWithGuard(jpeg, HAL_PIXEL_FORMAT_YCBCR_422_I, width, 16, &pixels,
+                                    &imageSize));
+        EXPECT_TRUE(guardIsIntact(pixels, imageSize));
+
+        // Luma and the chroma of the even pixels, so the last pixel of every row is stored
+        for (size_t i = 0; i < imageSize; ++i) {
+            EXPECT_NEAR(pixels[i], 128, 4) << "at byte " << i;
+        }
+    }
+}
+
+TEST(MjpegDecoderTest, CorruptImageIsRejected) {
+    const uint8_t gray[] = {128, 128, 128};
+    auto jpeg = encodeJpeg(64, 48, gray);
+    jpeg.resize(8);
+
+    std::vector<uint8_t> pixels;
+    size_t imageSize = 0;
+    EXPECT_FALSE(decodeWithGuard(jpeg, HAL_PIXEL_FORMAT_RGBA_8888, 64, 48, &pixels, &imageSize));
+    EXPECT_TRUE(guardIsIntact(pixels, imageSize));
+}
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Time from restarting a stream to its first frame: stopStream() and startStream(), which
+// release and allocate the V4L2 buffers again, against resumeStream() after a pause in either
+// mode.  The replay device has no sensor to restart and produces a frame as soon as it streams,
+// so the stop/start time measured with it holds only the buffer setup of the HAL and driver
+// calls; set vendor.evs.benchmark.camera to a real device, e.g. /dev/video0, to measure that
+// camera instead.
+
+#include "ReplayDevices.h"
+#include "VideoCapture.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+enum Restart {
+    STOP_START,
+    RESUME_DISCARD,
+    RESUME_STREAMOFF,
+};
+
+std::string getCameraName() {
+    const std::string name = getBenchmarkCamera();
+    if (!name.empty()) {
+        return name;
+    }
+    return installReplayDevices() ? kFastReplayDevice : "";
+}
+
+// Signals the first frame captured after it is armed
+class FirstFrame {
+public:
+    void arm() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mArmedAt = std::chrono::steady_clock::now();
+        mArmed = true;
+    }
+
+    void onFrame(VideoCapture* video, imageBuffer* buffer) {
+        const auto now = std::chrono::steady_clock::now();
+        video->markFrameConsumed(buffer->index);
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mArmed) {
+            mArmed = false;
+            mLatency = now - mArmedAt;
+            mCond.notify_one();
+        }
+    }
+
+    // Returns the time from arm() to the frame, or a negative one on a timeout
+    double wait() {
+        std::unique_lock<std::mutex> lock(mLock);
+        if (!mCond.wait_for(lock, std::chrono::seconds(2), [this] { return !mArmed; })) {
+            mArmed = false;
+            return -1;
+        }
+        return std::chrono::duration<double>(mLatency).count();
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    bool mArmed = false;
+    std::chrono::steady_clock::time_point mArmedAt;
+    std::chrono::steady_clock::duration mLatency{};
+};
+
+// range(0): how the stream is restarted, see Restart
+void BM_FirstFrameAfterRestart(benchmark::State& state) {
+    const auto restart = static_cast<Restart>(state.range(0));
+    const std::string name = getCameraName();
+    VideoCapture video;
+    if (name.empty() || !video.open(name.data())) {
+        state.SkipWithError("no camera to capture from");
+        return;
+    }
+
+    FirstFrame firstFrame;
+    auto callback = [&firstFrame](VideoCapture* video, imageBuffer* buffer, void*) {
+        firstFrame.onFrame(video, buffer);
+    };
+    firstFrame.arm();
+    if (!video.startStream(callback) || firstFrame.wait() < 0) {
+        state.SkipWithError("failed to start the stream");
+        video.close();
+        return;
+    }
+
+    for (auto _ : state) {
+        // Pausing is not measured, only getting the frames back
+        if (restart == STOP_START) {
+            video.stopStream();
+        } else {
+            video.pauseStream(restart == RESUME_STREAMOFF);
+        }
+
+        firstFrame.arm();
+        const bool restarted = restart == STOP_START ? video.startStream(callback)
+                                                     : video.resumeStream();
+        const double seconds = restarted ? firstFrame.wait() : -1;
+        if (seconds < 0) {
+            state.SkipWithError("no frame after the restart");
+            break;
+        }
+        state.SetIterationTime(seconds);
+    }
+
+    video.stopStream();
+    video.close();
+}
+
+BENCHMARK(BM_FirstFrameAfterRestart)
+        ->ArgName("restart")
+        ->DenseRange(STOP_START, RESUME_STREAMOFF)
+        ->UseManualTime()
+        ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPP_EVS_SAMPLEDRIVER_AIDL_TEST_REPLAYDEVICES_H
+#define CPP_EVS_SAMPLEDRIVER_AIDL_TEST_REPLAYDEVICES_H
+
+#include "V4l2Replay.h"
+
+#include <android-base/file.h>
+#include <cutils/properties.h>
+
+#include <string>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+// Names a real camera, e.g. /dev/video0, for the benchmarks to measure instead of a virtual one
+constexpr char kPropBenchmarkCamera[] = "vendor.evs.benchmark.camera";
+
+inline std::string getBenchmarkCamera() {
+    char name[PROPERTY_VALUE_MAX] = "\0";
+    property_get(kPropBenchmarkCamera, name, "");
+    return name;
+}
+
+// Virtual cameras the tests and benchmarks capture from.  ReplaySysCall installs one set per
+// process, so every test or benchmark of a binary finds its devices in this list.
+constexpr char kFastReplayDevice[] = "/dev/video-replay-fast";  // 640x480 YUYV at 250 fps
+
+// 640x480 virtual cameras at 250 fps for the tests of sharing buffers with the driver
+constexpr char kNv21ReplayDevice[] = "/dev/video-replay-nv21";
+constexpr char kPaddedReplayDevice[] = "/dev/video-replay-padded";  // 64 bytes after every row
+constexpr char kTwoBuffersReplayDevice[] = "/dev/video-replay-two-buffers";  // Grants only two
+
+// 640x480 YUYV at 100 fps which drops a fifth of its frames, for the tests of replaying them
+constexpr char kDroppingReplayDevice[] = "/dev/video-replay-dropping";
+
+// 1280x720 YUYV at 30 fps with 0.5 ms of jitter, as the cameras of a surround view
+constexpr int kNumCameraReplayDevices = 8;
+inline std::string getCameraReplayDevice(int index) {
+    return "/dev/video-replay-camera" + std::to_string(index);
+}
+
+inline bool installReplayDevices() {
+    static const bool installed = [] {
+        TemporaryDir dir;
+        const std::string path = std::string(dir.path) + "/replay.conf";
+        std::string config = std::string(kFastReplayDevice) + " synthetic:YUYV:640x480 fps=250\n";
+        config += std::string(kNv21ReplayDevice) + " synthetic:NV21:640x480 fps=250\n";
+        config += std::string(kPaddedReplayDevice) +
+                " synthetic:YUYV:640x480 fps=250 padding=64\n";
+        config += std::string(kTwoBuffersReplayDevice) +
+                " synthetic:YUYV:640x480 fps=250 max_buffers=2\n";
+        config += std::string(kDroppingReplayDevice) +
+                " synthetic:YUYV:640x480 fps=100 jitter_us=2000 drop_percent=20 seed=7\n";
+        for (int i = 0; i < kNumCameraReplayDevices; ++i) {
+            config += getCameraReplayDevice(i) + " synthetic:YUYV:1280x720 fps=30 jitter_us=500" +
+                    " seed=" + std::to_string(i + 1) + "\n";
+        }
+        return ::android::base::WriteStringToFile(config, path) &&
+                !ReplaySysCall::install(path).empty();
+    }();
+    return installed;
+}
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
+
+#endif  // CPP_EVS_SAMPLEDRIVER_AIDL_TEST_REPLAYDEVICES_H
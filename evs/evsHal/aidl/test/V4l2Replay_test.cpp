@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Streams from the replay devices through VideoCapture, with the buffers allocated by the device,
+// imported from dmabufs of the client or exported to it.  Memfds stand in for the dmabufs.
+
+#include "ReplayDevices.h"
+#include "VideoCapture.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+constexpr unsigned kWidth = 640;
+constexpr unsigned kHeight = 480;
+constexpr unsigned kYuyvFrameSize = kWidth * kHeight * 2;
+
+// Luma of the color bars the synthetic devices draw
+const std::set<uint8_t> kColorBarLuma = {180, 162, 131, 112, 84, 65, 35, 16};
+
+// A memfd as large as a dmabuf of the given size, mapped for the test to look at
+class FakeDmabuf {
+public:
+    explicit FakeDmabuf(size_t size) : mSize(size) {
+        mFd = memfd_create("FakeDmabuf", MFD_CLOEXEC);
+        if (mFd >= 0 && ftruncate(mFd, size) == 0) {
+            void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, mFd, 0);
+            mData = data != MAP_FAILED ? static_cast<const uint8_t*>(data) : nullptr;
+        }
+    }
+    ~FakeDmabuf() {
+        if (mData != nullptr) {
+            munmap(const_cast<uint8_t*>(mData), mSize);
+        }
+        if (mFd >= 0) {
+            ::close(mFd);
+        }
+    }
+    FakeDmabuf(const FakeDmabuf&) = delete;
+    FakeDmabuf& operator=(const FakeDmabuf&) = delete;
+
+    int fd() const { return mFd; }
+    const uint8_t* data() const { return mData; }
+
+private:
+    const size_t mSize;
+    int mFd = -1;
+    const uint8_t* mData = nullptr;
+};
+
+// Hands each frame to a check on the capture thread and gives it back to the device
+class FrameCounter {
+public:
+    using Check = std::function<void(imageBuffer* buffer, const uint8_t* data)>;
+
+    explicit FrameCounter(Check check = nullptr) : mCheck(std::move(check)) {}
+
+    std::function<void(VideoCapture*, imageBuffer*, void*)> callback() {
+        return [this](VideoCapture* video, imageBuffer* buffer, void* data) {
+            if (mCheck) {
+                mCheck(buffer, static_cast<const uint8_t*>(data));
+            }
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                mIndices.insert(buffer->index);
+                ++mFrames;
+            }
+            mSignal.notify_all();
+            video->markFrameConsumed(buffer->index);
+        };
+    }
+
+    // Whether that many frames arrive within a few seconds
+    bool waitForFrames(unsigned frames) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mSignal.wait_for(lock, std::chrono::seconds(5),
+                                [this, frames] { return mFrames >= frames; });
+    }
+
+    std::set<uint32_t> getIndices() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mIndices;
+    }
+
+private:
+    const Check mCheck;
+    std::mutex mLock;
+    std::condition_variable mSignal;
+    unsigned mFrames = 0;
+    std::set<uint32_t> mIndices;
+};
+
+class V4l2ReplayTest : public ::testing::Test {
+protected:
+    void SetUp() override { ASSERT_TRUE(installReplayDevices()); }
+
+    void TearDown() override {
+        mVideo.stopStream();
+        mVideo.close();
+    }
+
+    VideoCapture mVideo;
+};
+
+TEST_F(V4l2ReplayTest, ImportedDmabufsReceiveTheFrames) {
+    ASSERT_TRUE(mVideo.open(kFastReplayDevice, kWidth, kHeight));
+    ASSERT_EQ(mVideo.getImageSize(), kYuyvFrameSize);
+
+    std::vector<std::unique_ptr<FakeDmabuf>> dmabufs;
+    std::vector<ImportedBuffer> imported;
+    for (int i = 0; i < 4; ++i) {
+        dmabufs.push_back(std::make_unique<FakeDmabuf>(kYuyvFrameSize));
+        ASSERT_NE(dmabufs.back()->data(), nullptr);
+        imported.push_back({dmabufs.back()->fd(), kYuyvFrameSize});
+    }
+
+    // The device writes into the dmabuf of the index it reports, which the view shows
+    bool framesMatch = true;
+    FrameCounter counter([&](imageBuffer* buffer, const uint8_t* data) {
+        const uint8_t* written = dmabufs[buffer->index]->data();
+        framesMatch = framesMatch && buffer->memory == V4L2_MEMORY_DMABUF &&
+                buffer->m.fd == imported[buffer->index].fd && data != nullptr &&
+                kColorBarLuma.count(written[0]) > 0 &&
+                memcmp(data, written, kYuyvFrameSize) == 0;
+    });
+    ASSERT_TRUE(mVideo.startStream(counter.callback(), imported));
+    EXPECT_EQ(mVideo.getNumBuffers(), 4);
+
+    // Each buffer comes back and is queued again
+    ASSERT_TRUE(counter.waitForFrames(20));
+    mVideo.stopStream();
+    EXPECT_TRUE(framesMatch);
+    EXPECT_EQ(counter.getIndices(), std::set<uint32_t>({0, 1, 2, 3}));
+}
+
+TEST_F(V4l2ReplayTest, DmabufTooSmallForAFrameIsRejected) {
+    ASSERT_TRUE(mVideo.open(kFastReplayDevice, kWidth, kHeight));
+
+    FakeDmabuf dmabuf(kYuyvFrameSize / 2);
+    FrameCounter counter;
+    EXPECT_FALSE(mVideo.startStream(counter.callback(), {{dmabuf.fd(), kYuyvFrameSize}}));
+
+    // The device is left without buffers, so it streams as usual afterwards
+    ASSERT_TRUE(mVideo.startStream(counter.callback()));
+    EXPECT_TRUE(counter.waitForFrames(5));
+}
+
+TEST_F(V4l2ReplayTest, DriverGrantingFewerBuffersRejectsTheImport) {
+    ASSERT_TRUE(mVideo.open(kTwoBuffersReplayDevice, kWidth, kHeight));
+
+    // Every dmabuf needs a buffer of the device, or frames would be missing from some
+    std::vector<std::unique_ptr<FakeDmabuf>> dmabufs;
+    std::vector<ImportedBuffer> imported;
+    for (int i = 0; i < 4; ++i) {
+        dmabufs.push_back(std::make_unique<FakeDmabuf>(kYuyvFrameSize));
+        imported.push_back({dmabufs.back()->fd(), kYuyvFrameSize});
+    }
+    FrameCounter counter;
+    EXPECT_FALSE(mVideo.startStream(counter.callback(), imported));
+
+    // Buffers of the device are fine with fewer than requested
+    ASSERT_TRUE(mVideo.startStream(counter.callback()));
+    EXPECT_EQ(mVideo.getNumBuffers(), 2);
+    EXPECT_TRUE(counter.waitForFrames(5));
+}
+
+TEST_F(V4l2ReplayTest, ExportedBuffersShowTheCapturedFrames) {
+    ASSERT_TRUE(mVideo.open(kFastReplayDevice, kWidth, kHeight));
+
+    std::vector<const uint8_t*> exported(BUFFER_COUNT, nullptr);
+    std::mutex exportedLock;
+    bool framesMatch = true;
+    FrameCounter counter([&](imageBuffer* buffer, const uint8_t* data) {
+        std::lock_guard<std::mutex> lock(exportedLock);
+        const uint8_t* view = exported[buffer->index];
+        framesMatch = framesMatch &&
+                (view == nullptr || memcmp(data, view, kYuyvFrameSize) == 0);
+    });
+    ASSERT_TRUE(mVideo.startStream(counter.callback()));
+    ASSERT_EQ(mVideo.getNumBuffers(), BUFFER_COUNT);
+
+    {
+        std::lock_guard<std::mutex> lock(exportedLock);
+        for (int i = 0; i < BUFFER_COUNT; ++i) {
+            const int fd = mVideo.exportBuffer(i);
+            ASSERT_GE(fd, 0);
+            void* view = mmap(nullptr, kYuyvFrameSize, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            ASSERT_NE(view, MAP_FAILED);
+            exported[i] = static_cast<const uint8_t*>(view);
+        }
+    }
+
+    ASSERT_TRUE(counter.waitForFrames(20));
+    mVideo.stopStream();
+    EXPECT_TRUE(framesMatch);
+    for (const uint8_t* view : exported) {
+        munmap(const_cast<uint8_t*>(view), kYuyvFrameSize);
+    }
+}
+
+TEST_F(V4l2ReplayTest, PaddedRowsAreReportedAndWritten) {
+    ASSERT_TRUE(mVideo.open(kPaddedReplayDevice, kWidth, kHeight));
+    constexpr unsigned kStride = kWidth * 2 + 64;
+    EXPECT_EQ(mVideo.getStride(), kStride);
+    EXPECT_EQ(mVideo.getImageSize(), kStride * kHeight);
+
+    // Every row starts with a pixel of the color bars, one stride after the last
+    bool rowsMatch = true;
+    FrameCounter counter([&](imageBuffer*, const uint8_t* data) {
+        for (unsigned y = 1; y < kHeight; ++y) {
+            rowsMatch = rowsMatch && memcmp(data, data + y * kStride, kWidth * 2) == 0;
+        }
+        rowsMatch = rowsMatch && kColorBarLuma.count(data[0]) > 0;
+    });
+    ASSERT_TRUE(mVideo.startStream(counter.callback()));
+    ASSERT_TRUE(counter.waitForFrames(5));
+    mVideo.stopStream();
+    EXPECT_TRUE(rowsMatch);
+}
+
+TEST_F(V4l2ReplayTest, DropsRepeatAcrossSessions) {
+    ASSERT_TRUE(mVideo.open(kDroppingReplayDevice, kWidth, kHeight));
+
+    // Each session starts the generator over, so the same frames go missing
+    constexpr uint32_t kSequences = 60;
+    std::vector<uint32_t> sessions[2];
+    for (auto& sequences : sessions) {
+        std::mutex sequencesLock;
+        FrameCounter counter([&](imageBuffer* buffer, const uint8_t*) {
+            std::lock_guard<std::mutex> lock(sequencesLock);
+            if (buffer->sequence < kSequences) {
+                sequences.push_back(buffer->sequence);
+            }
+        });
+        ASSERT_TRUE(mVideo.startStream(counter.callback()));
+        // Every sequence number below kSequences is decided once that many frames arrived
+        ASSERT_TRUE(counter.waitForFrames(kSequences));
+        mVideo.stopStream();
+    }
+
+    EXPECT_EQ(sessions[0], sessions[1]);
+    EXPECT_LT(sessions[0].size(), kSequences);
+    EXPECT_GT(sessions[0].size(), kSequences / 2);
+}
+
+TEST_F(V4l2ReplayTest, RecordingPlaysBackByteExact) {
+    ASSERT_TRUE(mVideo.open(kFastReplayDevice, kWidth, kHeight));
+
+    // Every frame delivered while recording, which the recording holds a part of
+    std::vector<std::vector<uint8_t>> captured;
+    std::mutex capturedLock;
+    FrameCounter counter([&](imageBuffer*, const uint8_t* data) {
+        std::lock_guard<std::mutex> lock(capturedLock);
+        captured.emplace_back(data, data + kYuyvFrameSize);
+    });
+    TemporaryDir dir;
+    const std::string recordingPath = std::string(dir.path) + "/fast.rec";
+    ASSERT_TRUE(mVideo.startStream(counter.callback()));
+    ASSERT_TRUE(mVideo.startRecording(recordingPath));
+    ASSERT_TRUE(counter.waitForFrames(40));
+    mVideo.stopRecording();
+    mVideo.stopStream();
+    mVideo.close();
+
+    const std::string configPath = std::string(dir.path) + "/replay.conf";
+    const std::string device = "/dev/video-replay-recorded";
+    ASSERT_TRUE(::android::base::WriteStringToFile(device + " " + recordingPath + "\n",
+                                                   configPath));
+    ASSERT_TRUE(ReplaySysCall::addDevices(configPath));
+
+    std::vector<std::vector<uint8_t>> replayed;
+    std::mutex replayedLock;
+    bool sizesMatch = true;
+    FrameCounter replayCounter([&](imageBuffer* buffer, const uint8_t* data) {
+        std::lock_guard<std::mutex> lock(replayedLock);
+        sizesMatch = sizesMatch && buffer->bytesused == kYuyvFrameSize;
+        replayed.emplace_back(data, data + kYuyvFrameSize);
+    });
+    ASSERT_TRUE(mVideo.open(device.data(), kWidth, kHeight));
+    ASSERT_TRUE(mVideo.startStream(replayCounter.callback()));
+    ASSERT_TRUE(replayCounter.waitForFrames(10));
+    mVideo.stopStream();
+    EXPECT_TRUE(sizesMatch);
+
+    // The replayed frames come in the order they were captured, missing at most the dropped ones
+    ASSERT_GE(replayed.size(), 10u);
+    auto next = captured.begin();
+    for (const auto& frame : replayed) {
+        next = std::find(next, captured.end(), frame);
+        ASSERT_NE(next, captured.end());
+        ++next;
+    }
+}
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
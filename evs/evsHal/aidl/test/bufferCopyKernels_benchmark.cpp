@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bufferCopyKernels.h"
+
+#include <benchmark/benchmark.h>
+#include <libyuv.h>
+
+#include <string>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+// A 1080p frame per iteration, converted row by row like the fill functions do
+constexpr unsigned kWidth = 1920;
+constexpr unsigned kHeight = 1080;
+
+// Reported as items_per_second, in pixels
+void setPixelRate(benchmark::State& state) {
+    state.SetItemsProcessed(state.iterations() * kWidth * kHeight);
+}
+
+void yuyvToNV21(benchmark::State& state, const ConversionKernels* kernels) {
+    std::vector<uint8_t> src(kWidth * kHeight * 2, 0x80);
+    std::vector<uint8_t> dst(kWidth * kHeight * 3 / 2);
+    for (auto _ : state) {
+        for (unsigned r = 0; r < kHeight; r += 2) {
+            kernels->yuyvToNV21Rows(&src[r * kWidth * 2], &src[(r + 1) * kWidth * 2],
+                                    &dst[r * kWidth], &dst[(r + 1) * kWidth],
+                                    &dst[kWidth * kHeight + r / 2 * kWidth], kWidth);
+        }
+        benchmark::ClobberMemory();
+    }
+    setPixelRate(state);
+}
+
+void uyvyToYUYV(benchmark::State& state, const ConversionKernels* kernels) {
+    std::vector<uint8_t> src(kWidth * kHeight * 2, 0x80);
+    std::vector<uint8_t> dst(src.size());
+    for (auto _ : state) {
+        for (unsigned r = 0; r < kHeight; ++r) {
+            kernels->swapYUYVRow(&src[r * kWidth * 2], &dst[r * kWidth * 2], kWidth);
+        }
+        benchmark::ClobberMemory();
+    }
+    setPixelRate(state);
+}
+
+void packedToRGBA(benchmark::State& state, const ConversionKernels* kernels, bool uyvy) {
+    const YuvToRgbCoefficients& coefficients =
+            getYuvToRgbCoefficients(YuvColorSpace::BT601_LIMITED);
+    std::vector<uint8_t> src(kWidth * kHeight * 2, 0x80);
+    std::vector<uint8_t> dst(kWidth * kHeight * 4);
+    for (auto _ : state) {
+        for (unsigned r = 0; r < kHeight; ++r) {
+            kernels->yuyvToRGBARow(&src[r * kWidth * 2], &dst[r * kWidth * 4], kWidth,
+                                   coefficients, uyvy);
+        }
+        benchmark::ClobberMemory();
+    }
+    setPixelRate(state);
+}
+
+void yuyvToRGBA(benchmark::State& state, const ConversionKernels* kernels) {
+    packedToRGBA(state, kernels, /* uyvy= */ false);
+}
+
+void uyvyToRGBA(benchmark::State& state, const ConversionKernels* kernels) {
+    packedToRGBA(state, kernels, /* uyvy= */ true);
+}
+
+// The conversion before the fused kernels: libyuv into ARGB (BGRA in memory), then a second pass
+// over the frame to swap R and B in place
+void packedToRGBATwoPass(benchmark::State& state, bool uyvy) {
+    std::vector<uint8_t> src(kWidth * kHeight * 2, 0x80);
+    std::vector<uint8_t> dst(kWidth * kHeight * 4);
+    const int srcStride = kWidth * 2;
+    const int dstStride = kWidth * 4;
+    for (auto _ : state) {
+        if (uyvy) {
+            libyuv::UYVYToARGB(src.data(), srcStride, dst.data(), dstStride, kWidth, kHeight);
+        } else {
+            libyuv::YUY2ToARGB(src.data(), srcStride, dst.data(), dstStride, kWidth, kHeight);
+        }
+        libyuv::ABGRToARGB(dst.data(), dstStride, dst.data(), dstStride, kWidth, kHeight);
+        benchmark::ClobberMemory();
+    }
+    setPixelRate(state);
+}
+
+// One benchmark per format and implementation the running CPU supports
+const bool kRegistered = [] {
+    for (const ConversionKernels* kernels : getSupportedConversionKernels()) {
+        const std::string suffix = std::string("/") + kernels->name;
+        benchmark::RegisterBenchmark(("YUYVToNV21" + suffix).c_str(), yuyvToNV21, kernels);
+        benchmark::RegisterBenchmark(("UYVYToYUYV" + suffix).c_str(), uyvyToYUYV, kernels);
+        benchmark::RegisterBenchmark(("YUYVToRGBA" + suffix).c_str(), yuyvToRGBA, kernels);
+        benchmark::RegisterBenchmark(("UYVYToRGBA" + suffix).c_str(), uyvyToRGBA, kernels);
+    }
+    benchmark::RegisterBenchmark("YUYVToRGBA/libyuv_two_pass", packedToRGBATwoPass, false);
+    benchmark::RegisterBenchmark("UYVYToRGBA/libyuv_two_pass", packedToRGBATwoPass, true);
+    return true;
+}();
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
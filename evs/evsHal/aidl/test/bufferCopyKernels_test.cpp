@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bufferCopy.h"
+#include "bufferCopyKernels.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace aidl::android::hardware::automotive::evs::implementation {
+
+namespace {
+
+// Fill byte of the target buffers, which every byte a conversion does not own has to keep
+constexpr uint8_t kGuard = 0xCD;
+
+// Widths of the row tests: odd, around every vector width and a few full rows
+const std::vector<unsigned> kWidths = [] {
+    std::vector<unsigned> widths;
+    for (unsigned w = 1; w <= 130; ++w) {
+        widths.push_back(w);
+    }
+    widths.insert(widths.end(), {255, 256, 257, 639, 640, 1279, 1280, 1920});
+    return widths;
+}();
+
+const YuvColorSpace kColorSpaces[] = {
+        YuvColorSpace::BT601_LIMITED,
+        YuvColorSpace::BT601_FULL,
+        YuvColorSpace::BT709_LIMITED,
+        YuvColorSpace::BT709_FULL,
+};
+
+std::vector<uint8_t> randomBytes(size_t size, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> bytes(size);
+    for (auto& b : bytes) {
+        b = byte(rng);
+    }
+    return bytes;
+}
+
+uint8_t clampToByte(int value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// Per pixel golden conversions, written from the format definitions rather than from the
+// kernels
+
+void goldenYUYVToNV21Rows(const uint8_t* top, const uint8_t* bot, uint8_t* yTop, uint8_t* yBot,
+                          uint8_t* uv, unsigned width) {
+    for (unsigned x = 0; x < width / 2 * 2; ++x) {
+        yTop[x] = top[x * 2];
+        yBot[x] = bot[x * 2];
+    }
+    for (unsigned c = 0; c < width / 2; ++c) {
+        uv[c * 2] = (top[c * 4 + 1] + bot[c * 4 + 1]) / 2;
+        uv[c * 2 + 1] = (top[c * 4 + 3] + bot[c * 4 + 3]) / 2;
+    }
+}
+
+void goldenSwapRow(const uint8_t* src, uint8_t* dst, unsigned width) {
+    for (unsigned i = 0; i < width / 2 * 4; i += 2) {
+        dst[i] = src[i + 1];
+        dst[i + 1] = src[i];
+    }
+}
+
+void goldenYUYVToRGBARow(const uint8_t* src, uint8_t* dst, unsigned width,
+                         YuvColorSpace colorSpace, bool uyvy) {
+    const YuvToRgbCoefficients& c = getYuvToRgbCoefficients(colorSpace);
+    for (unsigned x = 0; x < width; ++x) {
+        const uint8_t* macroPixel = src + x / 2 * 4;
+        const int y = macroPixel[(uyvy ? 1 : 0) + (x % 2) * 2];
+        const int u = macroPixel[uyvy ? 0 : 1] - 128;
+        const int v = macroPixel[uyvy ? 2 : 3] - 128;
+        const int luma = (y - c.yOffset) * c.yScale;
+        dst[x * 4] = clampToByte((luma + c.crR * v + 32) >> 6);
+        dst[x * 4 + 1] = clampToByte((luma - c.cbG * u - c.crG * v + 32) >> 6);
+        dst[x * 4 + 2] = clampToByte((luma + c.cbB * u + 32) >> 6);
+        dst[x * 4 + 3] = 0xFF;
+    }
+}
+
+// Source rows of a packed 4:2:2 image; an odd width still reads its last whole macro pixel
+size_t packedRowBytes(unsigned width) {
+    return (width + 1) / 2 * 4;
+}
+
+BufferDesc makeTarget(unsigned width, unsigned height, unsigned stride) {
+    BufferDesc desc;
+    AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<AHardwareBuffer_Desc*>(&desc.buffer.description);
+    pDesc->width = width;
+    pDesc->height = height;
+    pDesc->stride = stride;
+    pDesc->layers = 1;
+    return desc;
+}
+
+class ConversionKernelsTest : public ::testing::TestWithParam<const ConversionKernels*> {
+protected:
+    const ConversionKernels& kernels() const { return *GetParam(); }
+};
+
+TEST_P(ConversionKernelsTest, YUYVToNV21Rows) {
+    for (unsigned width : kWidths) {
+        // Misaligned by one byte, so no implementation can rely on aligned loads
+        const auto src = randomBytes(packedRowBytes(width) * 2 + 1, width);
+        const uint8_t* top = src.data() + 1;
+        const uint8_t* bot = top + packedRowBytes(width);
+
+        std::vector<uint8_t> golden(width * 3 + 3, kGuard);
+        std::vector<uint8_t> out(golden.size(), kGuard);
+        goldenYUYVToNV21Rows(top, bot, golden.data(), golden.data() + width + 1,
+                             golden.data() + width * 2 + 2, width);
+        kernels().yuyvToNV21Rows(top, bot, out.data(), out.data() + width + 1,
+                                 out.data() + width * 2 + 2, width);
+        ASSERT_EQ(golden, out) << kernels().name << " width " << width;
+    }
+}
+
+TEST_P(ConversionKernelsTest, SwapYUYVRow) {
+    for (unsigned width : kWidths) {
+        const auto src = randomBytes(packedRowBytes(width) + 1, width);
+
+        std::vector<uint8_t> golden(packedRowBytes(width) + 4, kGuard);
+        std::vector<uint8_t> out(golden.size(), kGuard);
+        goldenSwapRow(src.data() + 1, golden.data() + 1, width);
+        kernels().swapYUYVRow(src.data() + 1, out.data() + 1, width);
+        ASSERT_EQ(golden, out) << kernels().name << " width " << width;
+    }
+}
+
+TEST_P(ConversionKernelsTest, YUYVToRGBARow) {
+    for (bool uyvy : {false, true}) {
+        for (YuvColorSpace colorSpace : kColorSpaces) {
+            const YuvToRgbCoefficients& coefficients = getYuvToRgbCoefficients(colorSpace);
+            for (unsigned width : kWidths) {
+                const auto src = randomBytes(packedRowBytes(width) + 1, width);
+
+                std::vector<uint8_t> golden(width * 4 + 5, kGuard);
+                std::vector<uint8_t> out(golden.size(), kGuard);
+                goldenYUYVToRGBARow(src.data() + 1, golden.data() + 1, width, colorSpace, uyvy);
+                kernels().yuyvToRGBARow(src.data() + 1, out.data() + 1, width, coefficients,
+                                        uyvy);
+                ASSERT_EQ(golden, out) << kernels().name << (uyvy ? " uyvy" : " yuyv")
+                                       << " color space " << static_cast<int>(colorSpace)
+                                       << " width " << width;
+            }
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(SupportedKernels, ConversionKernelsTest,
+                         ::testing::ValuesIn(getSupportedConversionKernels()),
+                         [](const ::testing::TestParamInfo<const ConversionKernels*>& info) {
+                             std::string name = info.param->name;
+                             std::replace(name.begin(), name.end(), '.', '_');
+                             return name;
+                         });
+
+// Whole frames through the fill functions and the kernels the running CPU selects: padded
+// source and target strides, odd widths where the format allows them and frames converted in
+// bands
+struct FrameSize {
+    unsigned width;
+    unsigned height;
+    unsigned srcPadding;  // Bytes after each source row
+    unsigned dstPadding;  // Pixels after each target row
+};
+
+const FrameSize kFrameSizes[] = {
+        {2, 2, 0, 0},    {6, 4, 0, 14},     {34, 10, 8, 30},     {127, 6, 3, 1},
+        {320, 8, 0, 0},  {333, 12, 60, 3},  {1280, 4, 128, 64},  {1922, 2, 4, 62},
+};
+
+std::vector<unsigned> bandEdges(unsigned height) {
+    // Bands of NV21 targets must start at even rows
+    std::vector<unsigned> edges = {0};
+    for (unsigned r = 2; r < height; r += 4) {
+        edges.push_back(r);
+    }
+    edges.push_back(height);
+    return edges;
+}
+
+TEST(BufferFillTest, NV21FromYUYV) {
+    for (const FrameSize& size : kFrameSizes) {
+        if (size.width % 2 || size.height % 2) {
+            continue;
+        }
+        const unsigned srcStride = size.width * 2 + size.srcPadding;
+        const auto src = randomBytes(srcStride * size.height, size.width);
+
+        // The fill function aligns the luma and chroma strides to 16 pixels
+        const unsigned strideLum = (size.width + 15) & ~15u;
+        std::vector<uint8_t> golden(strideLum * size.height * 3 / 2, kGuard);
+        for (unsigned r = 0; r < size.height; r += 2) {
+            goldenYUYVToNV21Rows(&src[r * srcStride], &src[(r + 1) * srcStride],
+                                 &golden[r * strideLum], &golden[(r + 1) * strideLum],
+                                 &golden[strideLum * size.height + r / 2 * strideLum],
+                                 size.width);
+        }
+
+        const BufferDesc desc = makeTarget(size.width, size.height, strideLum);
+        std::vector<uint8_t> out(golden.size(), kGuard);
+        const auto edges = bandEdges(size.height);
+        for (size_t b = 0; b + 1 < edges.size(); ++b) {
+            fillNV21FromYUYV(desc, out.data(), const_cast<uint8_t*>(src.data()), srcStride,
+                             edges[b], edges[b + 1]);
+        }
+        ASSERT_EQ(golden, out) << size.width << "x" << size.height;
+    }
+}
+
+TEST(BufferFillTest, RGBAFromPackedYUV) {
+    for (bool uyvy : {false, true}) {
+        for (YuvColorSpace colorSpace : kColorSpaces) {
+            for (const FrameSize& size : kFrameSizes) {
+                const unsigned srcStride = packedRowBytes(size.width) + size.srcPadding;
+                const unsigned dstStride = size.width + size.dstPadding;
+                const auto src = randomBytes(srcStride * size.height, size.width);
+
+                std::vector<uint8_t> golden(dstStride * size.height * 4, kGuard);
+                for (unsigned r = 0; r < size.height; ++r) {
+                    goldenYUYVToRGBARow(&src[r * srcStride], &golden[r * dstStride * 4],
+                                        size.width, colorSpace, uyvy);
+                }
+
+                const BufferDesc desc = makeTarget(size.width, size.height, dstStride);
+                std::vector<uint8_t> out(golden.size(), kGuard);
+                void* data = const_cast<uint8_t*>(src.data());
+                for (unsigned r = 0; r < size.height; r += 3) {
+                    const unsigned end = std::min(size.height, r + 3);
+                    if (uyvy) {
+                        fillRGBAFromUYVY(desc, out.data(), data, srcStride, r, end, colorSpace);
+                    } else {
+                        fillRGBAFromYUYV(desc, out.data(), data, srcStride, r, end, colorSpace);
+                    }
+                }
+                ASSERT_EQ(golden, out) << (uyvy ? "uyvy " : "yuyv ") << size.width << "x"
+                                       << size.height << " color space "
+                                       << static_cast<int>(colorSpace);
+            }
+        }
+    }
+}
+
+TEST(BufferFillTest, YUYVFromPackedYUV) {
+    for (bool uyvy : {false, true}) {
+        for (const FrameSize& size : kFrameSizes) {
+            if (size.width % 2) {
+                continue;
+            }
+            const unsigned srcStride = size.width * 2 + size.srcPadding;
+            const unsigned dstStride = size.width + size.dstPadding;
+            const auto src = randomBytes(srcStride * size.height, size.width);
+
+            std::vector<uint8_t> golden(dstStride * size.height * 2, kGuard);
+            for (unsigned r = 0; r < size.height; ++r) {
+                if (uyvy) {
+                    goldenSwapRow(&src[r * srcStride], &golden[r * dstStride * 2], size.width);
+                } else {
+                    std::copy_n(&src[r * srcStride], size.width * 2, &golden[r * dstStride * 2]);
+                }
+            }
+
+            const BufferDesc desc = makeTarget(size.width, size.height, dstStride);
+            std::vector<uint8_t> out(golden.size(), kGuard);
+            void* data = const_cast<uint8_t*>(src.data());
+            if (uyvy) {
+                fillYUYVFromUYVY(desc, out.data(), data, srcStride, 0, size.height);
+            } else {
+                fillYUYVFromYUYV(desc, out.data(), data, srcStride, 0, size.height);
+            }
+            ASSERT_EQ(golden, out) << (uyvy ? "uyvy " : "yuyv ") << size.width << "x"
+                                   << size.height;
+        }
+    }
+}
+
+// Scaled fills of a padded 1280x720 source against converting a golden nearest sample resample
+// of it at the target size
+constexpr unsigned kScaledSrcWidth = 1280;
+constexpr unsigned kScaledSrcHeight = 720;
+constexpr unsigned kScaledSrcStride = kScaledSrcWidth * 2 + 64;
+
+const FrameSize kScaledSizes[] = {
+        {2, 2, 0, 0},  {320, 180, 0, 0}, {640, 360, 0, 16}, {962, 542, 0, 30}, {1920, 1080, 0, 0},
+};
+
+// Each target pixel takes the luma of the source pixel nearest its center, and a pair of target
+// pixels the chroma of the macro pixel holding the source pixel of its first one
+std::vector<uint8_t> goldenResampleYUYV(const std::vector<uint8_t>& src, unsigned srcStride,
+                                        unsigned srcWidth, unsigned srcHeight, unsigned width,
+                                        unsigned height) {
+    std::vector<uint8_t> dst(width * height * 2);
+    for (unsigned y = 0; y < height; ++y) {
+        const uint8_t* srcRow = &src[(2 * y + 1) * srcHeight / (2 * height) * srcStride];
+        uint8_t* dstRow = &dst[y * width * 2];
+        for (unsigned x = 0; x < width; ++x) {
+            const unsigned sx = (2 * x + 1) * srcWidth / (2 * width);
+            const unsigned pairX = (2 * (x & ~1u) + 1) * srcWidth / (2 * width);
+            dstRow[x * 2] = srcRow[sx * 2];
+            dstRow[x * 2 + 1] = srcRow[(pairX & ~1u) * 2 + 1 + (x % 2) * 2];
+        }
+    }
+    return dst;
+}
+
+std::vector<uint8_t> swapPackedImage(const std::vector<uint8_t>& src, unsigned stride,
+                                     unsigned width, unsigned height) {
+    std::vector<uint8_t> dst(src.size());
+    for (unsigned r = 0; r < height; ++r) {
+        goldenSwapRow(&src[r * stride], &dst[r * stride], width);
+    }
+    return dst;
+}
+
+TEST(BufferScaledFillTest, SourceSizeMatchesThePlainFills) {
+    const unsigned width = kScaledSrcWidth;
+    const unsigned height = kScaledSrcHeight;
+    const unsigned stride = kScaledSrcStride;
+    auto src = randomBytes(stride * height, width);
+    auto uyvy = swapPackedImage(src, stride, width, height);
+    const BufferDesc desc = makeTarget(width, height, width);
+
+    std::vector<uint8_t> plain(width * height * 4, kGuard);
+    std::vector<uint8_t> scaled(plain.size(), kGuard);
+    fillRGBAFromYUYV(desc, plain.data(), src.data(), stride, 0, height,
+                     YuvColorSpace::BT601_LIMITED);
+    fillRGBAFromYUYVScaled(desc, scaled.data(), src.data(), stride, 0, height, width, height,
+                           YuvColorSpace::BT601_LIMITED);
+    EXPECT_EQ(plain, scaled);
+    fillRGBAFromUYVYScaled(desc, scaled.data(), uyvy.data(), stride, 0, height, width, height,
+                           YuvColorSpace::BT601_LIMITED);
+    EXPECT_EQ(plain, scaled);
+
+    plain.assign(width * height * 2, kGuard);
+    scaled.assign(plain.size(), kGuard);
+    fillYUYVFromUYVY(desc, plain.data(), uyvy.data(), stride, 0, height);
+    fillYUYVFromUYVYScaled(desc, scaled.data(), uyvy.data(), stride, 0, height, width, height);
+    EXPECT_EQ(plain, scaled);
+    fillYUYVFromYUYVScaled(desc, scaled.data(), src.data(), stride, 0, height, width, height);
+    EXPECT_EQ(plain, scaled);
+
+    // The NV21 source has no row padding, as the NV21 fills write it
+    plain.assign(width * height * 3 / 2, kGuard);
+    scaled.assign(plain.size(), kGuard);
+    fillNV21FromYUYV(desc, plain.data(), src.data(), stride, 0, height);
+    fillNV21FromYUYVScaled(desc, scaled.data(), src.data(), stride, 0, height, width, height);
+    EXPECT_EQ(plain, scaled);
+    fillNV21FromNV21Scaled(desc, scaled.data(), plain.data(), width, 0, height, width, height);
+    EXPECT_EQ(plain, scaled);
+}
+
+TEST(BufferScaledFillTest, OtherSizesMatchAGoldenResample) {
+    auto src = randomBytes(kScaledSrcStride * kScaledSrcHeight, kScaledSrcWidth);
+    auto uyvy = swapPackedImage(src, kScaledSrcStride, kScaledSrcWidth, kScaledSrcHeight);
+
+    for (const FrameSize& size : kScaledSizes) {
+        auto resampled = goldenResampleYUYV(src, kScaledSrcStride, kScaledSrcWidth,
+                                            kScaledSrcHeight, size.width, size.height);
+        const unsigned dstStride = size.width + size.dstPadding;
+        const BufferDesc desc = makeTarget(size.width, size.height, dstStride);
+        const auto edges = bandEdges(size.height);
+
+        for (bool fromUyvy : {false, true}) {
+            std::vector<uint8_t> golden(dstStride * size.height * 4, kGuard);
+            std::vector<uint8_t> out(golden.size(), kGuard);
+            fillRGBAFromYUYV(desc, golden.data(), resampled.data(), size.width * 2, 0,
+                             size.height, YuvColorSpace::BT709_FULL);
+            for (size_t b = 0; b + 1 < edges.size(); ++b) {
+                if (fromUyvy) {
+                    fillRGBAFromUYVYScaled(desc, out.data(), uyvy.data(), kScaledSrcStride,
+                                           edges[b], edges[b + 1], kScaledSrcWidth,
+                                           kScaledSrcHeight, YuvColorSpace::BT709_FULL);
+                } else {
+                    fillRGBAFromYUYVScaled(desc, out.data(), src.data(), kScaledSrcStride,
+                                           edges[b], edges[b + 1], kScaledSrcWidth,
+                                           kScaledSrcHeight, YuvColorSpace::BT709_FULL);
+                }
+            }
+            ASSERT_EQ(golden, out) << (fromUyvy ? "uyvy " : "yuyv ") << "to RGBA " << size.width
+                                   << "x" << size.height;
+
+            golden.assign(dstStride * size.height * 2, kGuard);
+            out.assign(golden.size(), kGuard);
+            fillYUYVFromYUYV(desc, golden.data(), resampled.data(), size.width * 2, 0,
+                             size.height);
+            if (fromUyvy) {
+                fillYUYVFromUYVYScaled(desc, out.data(), uyvy.data(), kScaledSrcStride, 0,
+                                       size.height, kScaledSrcWidth, kScaledSrcHeight);
+            } else {
+                fillYUYVFromYUYVScaled(desc, out.data(), src.data(), kScaledSrcStride, 0,
+                                       size.height, kScaledSrcWidth, kScaledSrcHeight);
+            }
+            ASSERT_EQ(golden, out) << (fromUyvy ? "uyvy " : "yuyv ") << "to YUYV " << size.width
+                                   << "x" << size.height;
+        }
+
+        // The NV21 fills align the strides themselves
+        const unsigned strideLum = (size.width + 15) & ~15u;
+        std::vector<uint8_t> golden(strideLum * size.height * 3 / 2, kGuard);
+        std::vector<uint8_t> out(golden.size(), kGuard);
+        fillNV21FromYUYV(desc, golden.data(), resampled.data(), size.width * 2, 0, size.height);
+        for (size_t b = 0; b + 1 < edges.size(); ++b) {
+            fillNV21FromYUYVScaled(desc, out.data(), src.data(), kScaledSrcStride, edges[b],
+                                   edges[b + 1], kScaledSrcWidth, kScaledSrcHeight);
+        }
+        ASSERT_EQ(golden, out) << "yuyv to NV21 " << size.width << "x" << size.height;
+    }
+}
+
+}  // namespace
+
+}  // namespace aidl::android::hardware::automotive::evs::implementation
@@ -13,20 +13,34 @@
 # limitations under the License.
 LOCAL_PATH := $(call my-dir)
 
-include $(CLEAR_VARS)
-LOCAL_MODULE := android.hardware.neuralnetworks@1.2-service-gpgpu
-LOCAL_MODULE_RELATIVE_PATH := hw
-LOCAL_PROPRIETARY_MODULE := true
-LOCAL_INIT_RC := android.hardware.neuralnetworks@1.2-service-gpgpu.rc
-LOCAL_SRC_FILES := \
-service.cpp \
+# glslc of the NDK shader tools, compiles the shaders which are not checked in
+# as SPIR-V, see vulkan/shader/gen_spv.sh. spirv-opt and spirv-val check the
+# registered shader variants, see vulkan/shader/validate_variants.py.
+NN_GPU_SHADER_TOOLS ?= prebuilts/ndk/current/shader-tools/$(HOST_PREBUILT_TAG)
+NN_GPU_GLSLC ?= $(NN_GPU_SHADER_TOOLS)/glslc
+NN_GPU_SPIRV_OPT ?= $(NN_GPU_SHADER_TOOLS)/spirv-opt
+NN_GPU_SPIRV_VAL ?= $(NN_GPU_SHADER_TOOLS)/spirv-val
+NN_GPU_GENERATED_SHADERS := \
+activation \
+fully_connected \
+resize_bilinear \
+l2_normalization \
+mean \
+pool
+
+# everything of the service but its main, shared with the benchmark and the shadow validator test
+NN_GPU_HAL_SRC_FILES := \
 device.cpp \
 prepare_model.cpp \
 executor_manager.cpp \
 base_executor.cpp \
 gpu_executor.cpp \
+batch_scheduler.cpp \
+cpu_reference.cpp \
+shadow_validator.cpp \
 vulkan/vk_cs_executor.cpp \
 vulkan/vk_memory_manager.cpp \
+vulkan/vk_memory_budget.cpp \
 vulkan/vk_pool_info.cpp \
 vulkan/vk_memory_info.cpp \
 vulkan/vk_operand.cpp \
@@ -40,7 +54,13 @@ vulkan/vk_cs_executor_softmax.cpp \
 vulkan/vk_cs_executor_pool.cpp \
 vulkan/vk_cs_executor_lrn.cpp \
 vulkan/vk_cs_executor_reshape.cpp \
+vulkan/vk_cs_executor_fully_connected.cpp \
+vulkan/vk_cs_executor_activation.cpp \
+vulkan/vk_cs_executor_resize_bilinear.cpp \
+vulkan/vk_cs_executor_l2_norm.cpp \
+vulkan/vk_cs_executor_mean.cpp \
 vulkan/vk_op_base.cpp \
+vulkan/vk_shader_variant.cpp \
 vulkan/vk_wrapper.cpp \
 vulkan/shader/elewise_spv.cpp \
 vulkan/shader/conv_spv.cpp \
@@ -48,11 +68,9 @@ vulkan/shader/dw_conv_spv.cpp \
 vulkan/shader/concat_spv.cpp \
 vulkan/shader/logistic_spv.cpp \
 vulkan/shader/softmax_spv.cpp \
-vulkan/shader/avg_pool_spv.cpp \
 vulkan/shader/conv_chn3to4_spv.cpp \
 vulkan/shader/conv_gemmShader4_8_spv.cpp \
 vulkan/shader/conv_gemm1_spv.cpp \
-vulkan/shader/max_pool_spv.cpp \
 vulkan/shader/lrn_spv.cpp \
 gles/gles_cs_executor.cpp \
 gles/gles_cs_executor_add.cpp \
@@ -83,33 +101,14 @@ gles/gles_memory_manager.cpp \
 gles/gles_operand.cpp \
 gles/gles_pool_info.cpp
 
-LOCAL_CFLAGS += \
--DLOG_TAG=\"NN_GPU_HAL\" \
--DLOG_NDEBUG=0
-
-ifeq ($(TARGET_PRODUCT), gordon_peak)
-LOCAL_CFLAGS += -DTARGET_GORDON_PEAK
-endif
-
-ifeq ($(TARGET_PRODUCT), icl_presi_kbl)
-LOCAL_CFLAGS += -DTARGET_KBL
-endif
-
-ifeq ($(TARGET_PRODUCT), celadon_tablet)
-LOCAL_CFLAGS += -DTARGET_KBL
-endif
-
-LOCAL_C_INCLUDES := \
+NN_GPU_HAL_C_INCLUDES := \
 frameworks/ml/nn/common/include \
 frameworks/ml/nn/runtime/include \
 frameworks/native/libs/nativewindow/include \
 frameworks/native/libs/ui/include \
 frameworks/native/libs/nativebase/include
 
-
-LOCAL_STATIC_LIBRARIES := libneuralnetworks_common
-
-LOCAL_SHARED_LIBRARIES := \
+NN_GPU_HAL_SHARED_LIBRARIES := \
 libbase \
 libdl \
 libcutils \
@@ -128,5 +127,141 @@ android.hardware.neuralnetworks@1.0 \
 android.hidl.allocator@1.0 \
 android.hidl.memory@1.0
 
+include $(CLEAR_VARS)
+LOCAL_MODULE := android.hardware.neuralnetworks@1.2-service-gpgpu
+LOCAL_MODULE_CLASS := EXECUTABLES
+LOCAL_MODULE_RELATIVE_PATH := hw
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_INIT_RC := android.hardware.neuralnetworks@1.2-service-gpgpu.rc
+LOCAL_SRC_FILES := \
+service.cpp \
+$(NN_GPU_HAL_SRC_FILES)
+
+include $(LOCAL_PATH)/vulkan/shader/gen_spv.mk
+
+# specializes every registered shader variant at its bounds and validates it
+nn_gpu_variants_stamp := $(nn_gpu_spv_dir)/validate_variants.stamp
+$(nn_gpu_variants_stamp): PRIVATE_SCRIPT := $(LOCAL_PATH)/vulkan/shader/validate_variants.py
+$(nn_gpu_variants_stamp): PRIVATE_SPV_DIR := $(nn_gpu_spv_dir)
+$(nn_gpu_variants_stamp): $(LOCAL_PATH)/vulkan/shader/validate_variants.py \
+        $(LOCAL_PATH)/vulkan/vk_shader_variants.hxx \
+        $(wildcard $(LOCAL_PATH)/vulkan/shader/*_spv.cpp) $(nn_gpu_spv_srcs) \
+        $(NN_GPU_SPIRV_OPT) $(NN_GPU_SPIRV_VAL)
+	@echo "Validate shader variants: $@"
+	$(hide) $(PRIVATE_SCRIPT) --spirv-opt $(NN_GPU_SPIRV_OPT) --spirv-val $(NN_GPU_SPIRV_VAL) \
+	    --spv-dir $(PRIVATE_SPV_DIR)
+	$(hide) touch $@
+LOCAL_ADDITIONAL_DEPENDENCIES += $(nn_gpu_variants_stamp)
+
+LOCAL_CFLAGS += \
+-DLOG_TAG=\"NN_GPU_HAL\" \
+-DLOG_NDEBUG=0
+
+ifeq ($(TARGET_PRODUCT), gordon_peak)
+LOCAL_CFLAGS += -DTARGET_GORDON_PEAK
+endif
+
+ifeq ($(TARGET_PRODUCT), icl_presi_kbl)
+LOCAL_CFLAGS += -DTARGET_KBL
+endif
+
+ifeq ($(TARGET_PRODUCT), celadon_tablet)
+LOCAL_CFLAGS += -DTARGET_KBL
+endif
+
+LOCAL_C_INCLUDES := $(NN_GPU_HAL_C_INCLUDES)
+
+LOCAL_STATIC_LIBRARIES := libneuralnetworks_common
+
+LOCAL_SHARED_LIBRARIES := $(NN_GPU_HAL_SHARED_LIBRARIES)
+
 LOCAL_MULTILIB := 64
 include $(BUILD_EXECUTABLE)
+
+# throughput and latency of the BatchScheduler against one by one executions,
+# run with adb shell setprop nn.gpgpu.vulkan 1 for the vulkan backend
+include $(CLEAR_VARS)
+LOCAL_MODULE := nn_gpu_batch_benchmark
+LOCAL_MODULE_CLASS := NATIVE_TESTS
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_SRC_FILES := \
+test/batch_scheduler_benchmark.cpp \
+$(NN_GPU_HAL_SRC_FILES)
+
+include $(LOCAL_PATH)/vulkan/shader/gen_spv.mk
+
+LOCAL_CFLAGS += \
+-DLOG_TAG=\"NN_GPU_HAL\"
+
+LOCAL_C_INCLUDES := $(NN_GPU_HAL_C_INCLUDES)
+
+LOCAL_STATIC_LIBRARIES := libneuralnetworks_common
+
+LOCAL_SHARED_LIBRARIES := $(NN_GPU_HAL_SHARED_LIBRARIES)
+
+LOCAL_MULTILIB := 64
+include $(BUILD_NATIVE_BENCHMARK)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := nn_gpu_vk_shader_test
+LOCAL_MODULE_CLASS := NATIVE_TESTS
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_SRC_FILES := \
+test/vk_shader_test.cpp \
+cpu_reference.cpp \
+vulkan/vk_wrapper.cpp
+
+include $(LOCAL_PATH)/vulkan/shader/gen_spv.mk
+
+LOCAL_CFLAGS += \
+-DLOG_TAG=\"NN_GPU_HAL\"
+
+LOCAL_SHARED_LIBRARIES := \
+libbase \
+libdl \
+liblog \
+libvulkan
+
+LOCAL_MULTILIB := 64
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := nn_gpu_shadow_validator_test
+LOCAL_MODULE_CLASS := NATIVE_TESTS
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_SRC_FILES := \
+test/shadow_validator_test.cpp \
+$(NN_GPU_HAL_SRC_FILES)
+
+include $(LOCAL_PATH)/vulkan/shader/gen_spv.mk
+
+LOCAL_CFLAGS += \
+-DLOG_TAG=\"NN_GPU_HAL\"
+
+LOCAL_C_INCLUDES := $(NN_GPU_HAL_C_INCLUDES)
+
+LOCAL_STATIC_LIBRARIES := libneuralnetworks_common
+
+LOCAL_SHARED_LIBRARIES := $(NN_GPU_HAL_SHARED_LIBRARIES)
+
+LOCAL_MULTILIB := 64
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := nn_gpu_memory_budget_test
+LOCAL_MODULE_CLASS := NATIVE_TESTS
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_SRC_FILES := \
+test/vk_memory_budget_test.cpp \
+vulkan/vk_memory_budget.cpp
+
+LOCAL_CFLAGS += \
+-DLOG_TAG=\"NN_GPU_HAL\"
+
+LOCAL_SHARED_LIBRARIES := \
+libbase \
+libcutils \
+liblog
+
+LOCAL_MULTILIB := 64
+include $(BUILD_NATIVE_TEST)
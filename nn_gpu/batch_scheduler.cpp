@@ -0,0 +1,648 @@
+#include <sys/mman.h>
+#include <cutils/properties.h>
+
+#include "batch_scheduler.h"
+#include "executor_manager.h"
+
+NAME_SPACE_BEGIN
+
+// weight of the last execution in the moving average of the execution time
+#define EXEC_TIME_SMOOTHING 0.2f
+
+struct MappedPool
+{
+    MappedPool() : userptr(nullptr), size(0), prot(0) {}
+
+    std::string name;
+    sp<IMemory> memory;
+    uint8_t* userptr;
+    size_t size;
+    int prot;
+};
+
+static bool mapPool(const hidl_memory& hidlMemory, MappedPool& pool)
+{
+    pool.name = hidlMemory.name();
+    pool.size = hidlMemory.size();
+    if (pool.name == "mmap_fd")
+    {
+        int fd = hidlMemory.handle()->data[0];
+        pool.prot = hidlMemory.handle()->data[1];
+        size_t offset = getSizeFromInts(hidlMemory.handle()->data[2],
+                                        hidlMemory.handle()->data[3]);
+        void* p = mmap(nullptr, pool.size, pool.prot, MAP_SHARED, fd, offset);
+        if (p == MAP_FAILED)
+        {
+            LOGE("BatchScheduler: can't mmap the file descriptor.");
+            return false;
+        }
+        pool.userptr = static_cast<uint8_t*>(p);
+        return true;
+    }
+    else if (pool.name == "ashmem")
+    {
+        pool.memory = mapMemory(hidlMemory);
+        if (pool.memory == nullptr)
+        {
+            LOGE("BatchScheduler: can't map shared memory.");
+            return false;
+        }
+        pool.memory->update();
+        pool.userptr = reinterpret_cast<uint8_t*>(static_cast<void*>(pool.memory->getPointer()));
+        return pool.userptr != nullptr;
+    }
+
+    LOGE("BatchScheduler: unsupported memory %s", pool.name.c_str());
+    return false;
+}
+
+static void unmapPool(MappedPool& pool)
+{
+    if (pool.userptr == nullptr)
+    {
+        return;
+    }
+
+    if (pool.name == "mmap_fd")
+    {
+        if (pool.prot & PROT_WRITE)
+        {
+            msync(pool.userptr, pool.size, MS_SYNC);
+        }
+        munmap(pool.userptr, pool.size);
+    }
+    else if (pool.name == "ashmem")
+    {
+        pool.memory->commit();
+    }
+    pool.userptr = nullptr;
+}
+
+static hidl_memory allocateSharedMemory(size_t size)
+{
+    hidl_memory memory;
+
+    sp<IAllocator> allocator = IAllocator::getService("ashmem");
+    if (allocator == nullptr)
+    {
+        LOGE("BatchScheduler: ashmem allocator is not available");
+        return memory;
+    }
+
+    allocator->allocate(size, [&](bool success, const hidl_memory& mem) {
+        if (success)
+        {
+            memory = mem;
+        }
+    });
+
+    return memory;
+}
+
+static bool isTemporaryTensor(const Operand& operand)
+{
+    return operand.lifetime == OperandLifeTime::TEMPORARY_VARIABLE ||
+           operand.lifetime == OperandLifeTime::MODEL_INPUT ||
+           operand.lifetime == OperandLifeTime::MODEL_OUTPUT;
+}
+
+static size_t sampleSize(const Operand& operand)
+{
+    size_t count = 1;
+    for (size_t i = 1; i < operand.dimensions.size(); ++i)
+    {
+        count *= operand.dimensions[i];
+    }
+    return count * sizeof(float);
+}
+
+static bool getConstInt32(const Model& model, uint32_t index, uint32_t idx, int32_t& value)
+{
+    const Operand& operand = model.operands[index];
+    if (operand.lifetime != OperandLifeTime::CONSTANT_COPY)
+    {
+        return false;
+    }
+    memcpy(&value, &model.operandValues[operand.location.offset + idx * sizeof(int32_t)], sizeof(int32_t));
+    return true;
+}
+
+// false if the optional axis input of operation resolves to the batch dimension
+static bool checkAxis(const Model& model, const Operation& operation, uint32_t axisInput)
+{
+    if (operation.inputs.size() <= axisInput)
+    {
+        return true;
+    }
+
+    int32_t axis;
+    if (!getConstInt32(model, operation.inputs[axisInput], 0, axis))
+    {
+        return false;
+    }
+
+    int32_t rank = model.operands[operation.inputs[0]].dimensions.size();
+    return axis != 0 && axis != -rank;
+}
+
+BatchConfig BatchConfig::fromProperties()
+{
+    BatchConfig config;
+    char prop[PROPERTY_VALUE_MAX] = "\0";
+
+    if (property_get("nn.gpgpu.batch.max", prop, nullptr) > 0)
+    {
+        sscanf(prop, "%d", &config.maxBatch);
+    }
+    if (property_get("nn.gpgpu.batch.window_us", prop, nullptr) > 0)
+    {
+        sscanf(prop, "%ld", &config.windowUs);
+    }
+    if (property_get("nn.gpgpu.batch.slo_us", prop, nullptr) > 0)
+    {
+        sscanf(prop, "%ld", &config.sloUs);
+    }
+
+    return config;
+}
+
+bool BatchScheduler::isBatchable(const Model& model)
+{
+    for (const auto& operand : model.operands)
+    {
+        if (!isTemporaryTensor(operand))
+        {
+            continue;
+        }
+        if (operand.type != OperandType::TENSOR_FLOAT32 ||
+            operand.dimensions.size() == 0 || operand.dimensions[0] != 1)
+        {
+            return false;
+        }
+    }
+
+    for (const auto& operation : model.operations)
+    {
+        switch (operation.type)
+        {
+        case OperationType::ADD:
+        case OperationType::MUL:
+        case OperationType::CONV_2D:
+        case OperationType::DEPTHWISE_CONV_2D:
+        case OperationType::AVERAGE_POOL_2D:
+        case OperationType::MAX_POOL_2D:
+        case OperationType::LOGISTIC:
+        case OperationType::RELU:
+        case OperationType::RELU1:
+        case OperationType::RELU6:
+        case OperationType::TANH:
+        case OperationType::RESIZE_BILINEAR:
+        case OperationType::FULLY_CONNECTED:
+            break;
+        case OperationType::SOFTMAX:
+            if (!checkAxis(model, operation, 2)) return false;
+            break;
+        case OperationType::L2_NORMALIZATION:
+            if (!checkAxis(model, operation, 1)) return false;
+            break;
+        case OperationType::LOCAL_RESPONSE_NORMALIZATION:
+            if (!checkAxis(model, operation, 5)) return false;
+            break;
+        case OperationType::CONCATENATION:
+            if (!checkAxis(model, operation, operation.inputs.size() - 1)) return false;
+            break;
+        case OperationType::RESHAPE:
+        {
+            // the leading 1 of the new shape is scaled with the batch
+            int32_t first;
+            if (!getConstInt32(model, operation.inputs[1], 0, first) || (first != 1 && first != -1))
+            {
+                return false;
+            }
+            break;
+        }
+        case OperationType::MEAN:
+        {
+            const Operand& axes = model.operands[operation.inputs[1]];
+            int32_t rank = model.operands[operation.inputs[0]].dimensions.size();
+            for (uint32_t i = 0; i < axes.dimensions[0]; ++i)
+            {
+                int32_t axis;
+                if (!getConstInt32(model, operation.inputs[1], i, axis) || axis == 0 || axis == -rank)
+                {
+                    return false;
+                }
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+BatchScheduler::BatchScheduler(const Model& m, BaseExecutor* e, const BatchConfig& c) :
+    model(m), exec(e), config(c), stopping(false)
+{
+    modelBatchable = isBatchable(model);
+    if (!modelBatchable)
+    {
+        LOGW("BatchScheduler: the model is not batchable, requests run one by one");
+    }
+
+    for (uint32_t index : model.inputIndexes)
+    {
+        inputSizes.push_back(sampleSize(model.operands[index]));
+    }
+    for (uint32_t index : model.outputIndexes)
+    {
+        outputSizes.push_back(sampleSize(model.operands[index]));
+    }
+
+    LOGD("BatchScheduler: max batch %d, window %ld us, slo %ld us",
+         config.maxBatch, config.windowUs, config.sloUs);
+    worker = std::thread([this]{ loop(); });
+}
+
+BatchScheduler::~BatchScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_one();
+    worker.join();
+
+    for (auto& it : batchedModels)
+    {
+        it.second->exec->deinitPerModel();
+    }
+
+    showStats();
+}
+
+void BatchScheduler::submit(const Request& request, const Completion& done)
+{
+    Pending pending = { request, done, std::chrono::steady_clock::now() };
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (stats.requests == 0)
+        {
+            firstArrival = pending.arrival;
+        }
+        stats.requests++;
+        queue.push_back(pending);
+    }
+    cv.notify_one();
+}
+
+long BatchScheduler::estimateUs(int size) const
+{
+    // assume linear scaling from the closest measured batch size below
+    auto it = execUs.upper_bound(size);
+    if (it == execUs.begin())
+    {
+        return 0;
+    }
+    --it;
+    return (long)(it->second * size / it->first);
+}
+
+void BatchScheduler::recordExecution(int size, long elapsedUs)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = execUs.find(size);
+    if (it == execUs.end())
+    {
+        execUs[size] = elapsedUs;
+    }
+    else
+    {
+        it->second += (elapsedUs - it->second) * EXEC_TIME_SMOOTHING;
+    }
+}
+
+BatchScheduler::time_point BatchScheduler::flushDeadline()
+{
+    const time_point arrival = queue.front().arrival;
+    time_point deadline = arrival + std::chrono::microseconds(config.windowUs);
+
+    // leave enough time to run a batch with one more request within the slo
+    if (config.sloUs > 0)
+    {
+        long budgetUs = config.sloUs - estimateUs(queue.size() + 1);
+        deadline = std::min(deadline, arrival + std::chrono::microseconds(std::max(budgetUs, 0L)));
+    }
+
+    return deadline;
+}
+
+void BatchScheduler::loop()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+
+    while (true)
+    {
+        cv.wait(lock, [this]{ return stopping || !queue.empty(); });
+        if (queue.empty())
+        {
+            break;
+        }
+
+        while (!stopping && modelBatchable && (int)queue.size() < config.maxBatch)
+        {
+            time_point deadline = flushDeadline();
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                break;
+            }
+            cv.wait_until(lock, deadline);
+        }
+
+        std::vector<Pending> batch;
+        while (!queue.empty() && (int)batch.size() < config.maxBatch)
+        {
+            batch.push_back(queue.front());
+            queue.pop_front();
+        }
+
+        lock.unlock();
+        runBatch(batch);
+        lock.lock();
+    }
+}
+
+bool BatchScheduler::isBatchable(const Request& request) const
+{
+    auto check = [this, &request](const hidl_vec<RequestArgument>& args,
+                                  const hidl_vec<uint32_t>& indexes,
+                                  const std::vector<size_t>& sizes) {
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            const RequestArgument& arg = args[i];
+            if (arg.hasNoValue || arg.location.length != sizes[i] ||
+                arg.location.poolIndex >= request.pools.size())
+            {
+                return false;
+            }
+            if (arg.dimensions.size() > 0 && arg.dimensions != model.operands[indexes[i]].dimensions)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    return check(request.inputs, model.inputIndexes, inputSizes) &&
+           check(request.outputs, model.outputIndexes, outputSizes);
+}
+
+BatchScheduler::BatchedModel* BatchScheduler::getBatchedModel(int size)
+{
+    auto it = batchedModels.find(size);
+    if (it != batchedModels.end())
+    {
+        return it->second.get();
+    }
+
+    std::unique_ptr<BatchedModel> bm(new BatchedModel());
+    bm->model = model;
+    for (auto& operand : bm->model.operands)
+    {
+        if (isTemporaryTensor(operand))
+        {
+            operand.dimensions[0] = size;
+        }
+    }
+    for (const auto& operation : bm->model.operations)
+    {
+        if (operation.type == OperationType::RESHAPE)
+        {
+            const Operand& shape = bm->model.operands[operation.inputs[1]];
+            int32_t* first = reinterpret_cast<int32_t*>(&bm->model.operandValues[shape.location.offset]);
+            if (*first == 1)
+            {
+                *first = size;
+            }
+        }
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < inputSizes.size(); ++i)
+    {
+        bm->inputOffsets.push_back(total);
+        total += inputSizes[i] * size;
+    }
+    for (size_t i = 0; i < outputSizes.size(); ++i)
+    {
+        bm->outputOffsets.push_back(total);
+        total += outputSizes[i] * size;
+    }
+
+    bm->memory = allocateSharedMemory(total);
+    if (bm->memory.size() == 0 || (bm->mapped = mapMemory(bm->memory)) == nullptr)
+    {
+        LOGE("BatchScheduler: failed to allocate %zu bytes for batch %d", total, size);
+        return nullptr;
+    }
+
+    bm->exec = ExecutorManager::createExecutor(bm->model);
+    if (bm->exec == nullptr || !bm->exec->initPerModel())
+    {
+        LOGE("BatchScheduler: failed to prepare the model with batch %d", size);
+        return nullptr;
+    }
+
+    bm->request.pools = { bm->memory };
+    bm->request.inputs.resize(inputSizes.size());
+    for (size_t i = 0; i < inputSizes.size(); ++i)
+    {
+        bm->request.inputs[i] = { .hasNoValue = false,
+                                  .location = { .poolIndex = 0,
+                                                .offset = (uint32_t)bm->inputOffsets[i],
+                                                .length = (uint32_t)(inputSizes[i] * size) },
+                                  .dimensions = {} };
+    }
+    bm->request.outputs.resize(outputSizes.size());
+    for (size_t i = 0; i < outputSizes.size(); ++i)
+    {
+        bm->request.outputs[i] = { .hasNoValue = false,
+                                   .location = { .poolIndex = 0,
+                                                 .offset = (uint32_t)bm->outputOffsets[i],
+                                                 .length = (uint32_t)(outputSizes[i] * size) },
+                                   .dimensions = {} };
+    }
+
+    NN_GPU_DEBUG("BatchScheduler: prepared the model with batch %d", size);
+    BatchedModel* ret = bm.get();
+    batchedModels[size] = std::move(bm);
+    return ret;
+}
+
+void BatchScheduler::complete(Pending& pending, bool succ)
+{
+    time_point now = std::chrono::steady_clock::now();
+    long latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(now - pending.arrival).count();
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stats.latencyUs += latencyUs;
+        stats.maxLatencyUs = std::max(stats.maxLatencyUs, latencyUs);
+        lastCompletion = now;
+    }
+
+    pending.done(succ);
+}
+
+void BatchScheduler::runSingle(Pending& pending)
+{
+    time_point start = std::chrono::steady_clock::now();
+
+    exec->initPerExecThread();
+    bool succ = exec->run(pending.request);
+    exec->deinitPerExecThread();
+
+    recordExecution(1, std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - start).count());
+    complete(pending, succ);
+}
+
+void BatchScheduler::runBatch(std::vector<Pending>& batch)
+{
+    std::vector<Pending> singles;
+    std::vector<Pending> batched;
+    for (auto& pending : batch)
+    {
+        if (modelBatchable && isBatchable(pending.request))
+        {
+            batched.push_back(pending);
+        }
+        else
+        {
+            singles.push_back(pending);
+        }
+    }
+
+    BatchedModel* bm = nullptr;
+    int size = 1;
+    if (batched.size() > 1)
+    {
+        // pad to a power of two, so that few batched models are prepared
+        while (size < (int)batched.size())
+        {
+            size <<= 1;
+        }
+        size = std::min(size, config.maxBatch);
+        bm = getBatchedModel(size);
+        if (bm == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            modelBatchable = false;
+        }
+    }
+
+    if (bm == nullptr)
+    {
+        singles.insert(singles.end(), batched.begin(), batched.end());
+        batched.clear();
+    }
+
+    for (auto& pending : singles)
+    {
+        runSingle(pending);
+    }
+
+    if (batched.empty())
+    {
+        return;
+    }
+
+    std::vector<std::vector<MappedPool>> pools(batched.size());
+    std::vector<bool> mapped(batched.size(), true);
+    uint8_t* base = reinterpret_cast<uint8_t*>(static_cast<void*>(bm->mapped->getPointer()));
+
+    // gather the inputs, the padded samples keep stale data which is never read back
+    bm->mapped->update();
+    for (size_t k = 0; k < batched.size(); ++k)
+    {
+        const Request& request = batched[k].request;
+        pools[k].resize(request.pools.size());
+        for (size_t p = 0; p < request.pools.size() && mapped[k]; ++p)
+        {
+            mapped[k] = mapPool(request.pools[p], pools[k][p]);
+        }
+        if (!mapped[k])
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < request.inputs.size(); ++i)
+        {
+            const DataLocation& loc = request.inputs[i].location;
+            memcpy(base + bm->inputOffsets[i] + k * inputSizes[i],
+                   pools[k][loc.poolIndex].userptr + loc.offset, inputSizes[i]);
+        }
+    }
+    bm->mapped->commit();
+
+    time_point start = std::chrono::steady_clock::now();
+    bm->exec->initPerExecThread();
+    bool succ = bm->exec->run(bm->request);
+    bm->exec->deinitPerExecThread();
+    recordExecution(size, std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - start).count());
+
+    // scatter the outputs
+    bm->mapped->update();
+    for (size_t k = 0; k < batched.size(); ++k)
+    {
+        if (succ && mapped[k])
+        {
+            const Request& request = batched[k].request;
+            for (size_t i = 0; i < request.outputs.size(); ++i)
+            {
+                const DataLocation& loc = request.outputs[i].location;
+                memcpy(pools[k][loc.poolIndex].userptr + loc.offset,
+                       base + bm->outputOffsets[i] + k * outputSizes[i], outputSizes[i]);
+            }
+        }
+        for (auto& pool : pools[k])
+        {
+            unmapPool(pool);
+        }
+        complete(batched[k], succ && mapped[k]);
+    }
+    bm->mapped->commit();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    stats.batches++;
+    stats.batchedRequests += batched.size();
+}
+
+void BatchScheduler::showStats()
+{
+    if (stats.requests == 0)
+    {
+        return;
+    }
+
+    float seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+                        lastCompletion - firstArrival).count() / 1000000.f;
+    NN_GPU_PERF("BatchScheduler: %llu requests, %llu of them in %llu batched executions (average batch %f)",
+                (unsigned long long)stats.requests, (unsigned long long)stats.batchedRequests,
+                (unsigned long long)stats.batches,
+                stats.batches > 0 ? (float)stats.batchedRequests / stats.batches : 0.f);
+    NN_GPU_PERF("BatchScheduler: latency average %f ms, max %f ms, throughput %f requests/s",
+                stats.latencyUs / 1000.f / stats.requests, stats.maxLatencyUs / 1000.f,
+                seconds > 0.f ? stats.requests / seconds : 0.f);
+    for (const auto& it : execUs)
+    {
+        NN_GPU_PERF("BatchScheduler: batch %d executes in %f ms", it.first, it.second / 1000.f);
+    }
+}
+
+NAME_SPACE_STOP
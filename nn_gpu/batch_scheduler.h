@@ -0,0 +1,117 @@
+#ifndef ANDROID_HARDWARE_NEURALNETWORKS_V1_2_BATCH_SCHEDULER_H
+#define ANDROID_HARDWARE_NEURALNETWORKS_V1_2_BATCH_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "base_executor.h"
+
+NAME_SPACE_BEGIN
+
+struct BatchConfig
+{
+    BatchConfig() : maxBatch(0), windowUs(2000), sloUs(0) {}
+
+    // read from nn.gpgpu.batch.max, nn.gpgpu.batch.window_us and nn.gpgpu.batch.slo_us
+    static BatchConfig fromProperties();
+    bool enabled() const { return maxBatch > 1; }
+
+    int maxBatch;       // batching is disabled when it is not greater than 1
+    long windowUs;      // how long the oldest request waits for others at most
+    long sloUs;         // latency objective of one request, 0 means none
+};
+
+struct BatchStats
+{
+    BatchStats() : requests(0), batches(0), batchedRequests(0), latencyUs(0), maxLatencyUs(0) {}
+
+    uint64_t requests;
+    uint64_t batches;           // executions with more than one request
+    uint64_t batchedRequests;   // requests which ran in these executions
+    long latencyUs;             // sum of the time from arrival to completion
+    long maxLatencyUs;
+};
+
+// Coalesces the concurrent executions of one prepared model into batched
+// executions. A copy of the model with the batch dimension of every
+// non-constant tensor scaled is prepared for each batch size (powers of two
+// up to maxBatch). The inputs are gathered into one shared memory, the batched
+// executor runs once and the outputs are scattered back to the requests.
+// Models or requests which are not batchable run one by one on the executor
+// of the original model, still on the scheduler thread.
+class BatchScheduler
+{
+public:
+    typedef std::function<void(bool)> Completion;
+
+    BatchScheduler(const Model& model, BaseExecutor* exec, const BatchConfig& config);
+    ~BatchScheduler();
+
+    void submit(const Request& request, const Completion& done);
+
+    // true if every operation of model keeps the samples of a batch independent
+    static bool isBatchable(const Model& model);
+
+private:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    struct Pending
+    {
+        Request request;
+        Completion done;
+        time_point arrival;
+    };
+
+    struct BatchedModel
+    {
+        Model model;
+        sp<BaseExecutor> exec;
+        hidl_memory memory;                 // inputs then outputs, sample-major
+        sp<IMemory> mapped;
+        std::vector<size_t> inputOffsets;
+        std::vector<size_t> outputOffsets;
+        Request request;                    // refers to memory only
+    };
+
+    void loop();
+    time_point flushDeadline();
+    void runBatch(std::vector<Pending>& batch);
+    void runSingle(Pending& pending);
+    bool isBatchable(const Request& request) const;
+    BatchedModel* getBatchedModel(int size);
+    void complete(Pending& pending, bool succ);
+    long estimateUs(int size) const;
+    void recordExecution(int size, long elapsedUs);
+    void showStats();
+
+    const Model& model;
+    BaseExecutor* exec;
+    BatchConfig config;
+    bool modelBatchable;
+
+    std::vector<size_t> inputSizes;     // bytes of one sample
+    std::vector<size_t> outputSizes;
+
+    std::map<int, std::unique_ptr<BatchedModel>> batchedModels;
+    std::map<int, float> execUs;        // moving average of the execution time per batch size
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<Pending> queue;
+    bool stopping;
+    std::thread worker;
+
+    BatchStats stats;
+    time_point firstArrival;
+    time_point lastCompletion;
+};
+
+NAME_SPACE_STOP
+
+#endif
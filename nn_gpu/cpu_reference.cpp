@@ -0,0 +1,531 @@
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "cpu_reference.h"
+
+NAME_SPACE_BEGIN
+
+#define MAX_BROADCAST_DIMS 4
+
+void parallelFor(int count, const std::function<void(int, int)>& func)
+{
+    static const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    const int chunks = std::min(cores, count);
+    if (chunks <= 1)
+    {
+        func(0, count);
+        return;
+    }
+
+    const int chunk_size = (count + chunks - 1) / chunks;
+    std::vector<std::thread> workers;
+    for (int begin = chunk_size; begin < count; begin += chunk_size)
+    {
+        workers.emplace_back(func, begin, std::min(begin + chunk_size, count));
+    }
+    func(0, chunk_size);
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+float dotProduct(const float* a, const float* b, int len)
+{
+    int i = 0;
+    float sum = 0.f;
+
+#if defined(__SSE__)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= len; i += 4)
+    {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__ARM_NEON)
+    float32x4_t acc = vdupq_n_f32(0.f);
+    for (; i + 4 <= len; i += 4)
+    {
+        acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    sum = vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1) + vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3);
+#endif
+
+    for (; i < len; ++i)
+    {
+        sum += a[i] * b[i];
+    }
+
+    return sum;
+}
+
+float applyActivation(float value, int activation)
+{
+    switch (activation)
+    {
+    case kActivationRelu:
+        return std::max(value, 0.f);
+    case kActivationRelu1:
+        return std::min(std::max(value, -1.f), 1.f);
+    case kActivationRelu6:
+        return std::min(std::max(value, 0.f), 6.f);
+    default:
+        return value;
+    }
+}
+
+static void convOneBhwc(float* in_data, int in_offset, float* filter_data, int filter_offset,
+                        float* bias, int bias_offset, float* convolved_data, int out_offset,
+                        int in_w, int in_h, int out_w, int out_h,
+                        int pad_left, int pad_top, int has_bias, int stride_w, int stride_h,
+                        int filter_w, int filter_h, int dilation_x, int dilation_y,
+                        int in_c, int out_c, int out_z, int out_x, int out_y, int depth, int activation)
+{
+    const int ZPAR = 1;
+
+    if (out_x < out_w && out_y < out_h)
+    {
+        float sum[ZPAR];
+
+        for(int kern = 0; kern < ZPAR; kern++)
+        {
+            sum[kern] = 0.0f;
+        }
+
+        const int org_y                 = out_y * stride_h - pad_top;
+        const int org_x                 = out_x * stride_w - pad_left;
+        const int current_filter_offset = filter_offset + depth * filter_h * filter_w * in_c;
+        const int bias_index            = bias_offset + (depth % out_c);
+        const int local_in_offset       = (org_y * in_w + org_x) * in_c;
+
+        float* in_ptr     = in_data + (in_offset + local_in_offset);
+        float* filter_ptr = filter_data + (current_filter_offset);
+
+        for(int y = 0; y < filter_h; y++)
+        {
+            for(int x = 0; x < filter_w; x++)
+            {
+                if(org_y + int(y * dilation_y) >= 0 && org_y + int(y * dilation_y) < int(in_h) &&
+                   org_x + int(x * dilation_x) >= 0 && org_x + int(x * dilation_x) < int(in_w))
+                {
+                    for(int outz = 0; outz < ZPAR; outz++)
+                    {
+                        sum[outz] += dotProduct(in_ptr, filter_ptr + outz * filter_h * filter_w * in_c, in_c);
+                    }
+                }
+
+                in_ptr += dilation_x * in_c;
+                filter_ptr += in_c;
+            }
+
+            in_ptr += in_w * dilation_y * in_c - dilation_x * in_c * filter_w;
+        }
+
+        for (int kern = 0; kern < ZPAR; kern++)
+        {
+            if (depth + kern < out_z)
+            {
+                int offset = out_offset + (out_y * out_w  + out_x) * out_c + depth + kern;
+                float out  = has_bias ? sum[kern] + bias[bias_index + kern] : sum[kern];
+                convolved_data[offset] = applyActivation(out, activation);
+            }
+        }
+    }
+}
+
+void convCpuBhwc(float* in_buffer, float* bias_buffer, float* filter_buffer, float* benchmark,
+                 int batch, int group, int has_bias, int in_c, int in_w, int in_h,
+                 int out_c, int out_w, int out_h, int filter_w, int filter_h,
+                 int padding_left, int padding_top, int stride_w, int stride_h,
+                 int dilation_x, int dilation_y, int activation)
+{
+    const int m          = out_c / group;
+    const int bottom_dim = in_c * in_w * in_h;
+    const int top_dim    = out_c * out_w * out_h;
+
+    // every (batch, row) pair writes its own output row
+    parallelFor(batch * out_h, [&](int begin, int end) {
+        for (int row = begin; row < end; ++row)
+        {
+            const int n     = row / out_h;
+            const int out_y = row % out_h;
+
+            for (int g = 0; g < group; ++g)
+            {
+                const int in_offset     = n * bottom_dim + in_w * in_h * (in_c / group) * g;
+                const int filter_offset = filter_h * filter_w * (in_c / group) * m * g;
+                const int bias_offset   = m * g;
+                const int out_offset    = n * top_dim + out_w * out_h * m * g;
+
+                for (int out_x = 0; out_x < out_w; ++out_x)
+                {
+                    for (int depth = 0; depth < m; ++depth)
+                    {
+                        convOneBhwc(in_buffer, in_offset, filter_buffer, filter_offset, bias_buffer, bias_offset,
+                                    benchmark, out_offset, in_w, in_h, out_w, out_h, padding_left, padding_top,
+                                    has_bias, stride_w, stride_h, filter_w, filter_h, dilation_x, dilation_y,
+                                    in_c, out_c, m, out_x, out_y, depth, activation);
+                    }
+                }
+            }
+        }
+    });
+}
+
+void depthConvCpu(const float* in, const float* filter, const float* bias, float* out,
+                  int batch, int in_h, int in_w, int in_c, int out_h, int out_w, int out_c,
+                  int filter_h, int filter_w, int pad_top, int pad_left,
+                  int stride_h, int stride_w, int multiplier, int activation)
+{
+    parallelFor(batch * out_h, [&](int begin, int end) {
+        for (int row = begin; row < end; ++row)
+        {
+            const int b  = row / out_h;
+            const int oy = row % out_h;
+
+            for (int ox = 0; ox < out_w; ++ox)
+            {
+                for (int oc = 0; oc < out_c; ++oc)
+                {
+                    const int ic = oc / multiplier;
+                    float sum = bias[oc];
+
+                    for (int fy = 0; fy < filter_h; ++fy)
+                    {
+                        const int iy = oy * stride_h - pad_top + fy;
+                        if (iy < 0 || iy >= in_h)
+                        {
+                            continue;
+                        }
+
+                        for (int fx = 0; fx < filter_w; ++fx)
+                        {
+                            const int ix = ox * stride_w - pad_left + fx;
+                            if (ix < 0 || ix >= in_w)
+                            {
+                                continue;
+                            }
+
+                            sum += in[((b * in_h + iy) * in_w + ix) * in_c + ic] *
+                                   filter[(fy * filter_w + fx) * out_c + oc];
+                        }
+                    }
+
+                    out[((b * out_h + oy) * out_w + ox) * out_c + oc] = applyActivation(sum, activation);
+                }
+            }
+        }
+    });
+}
+
+void poolCpu(const float* in, float* out, int batch, int in_h, int in_w, int channels,
+             int out_h, int out_w, int filter_h, int filter_w, int pad_top, int pad_left,
+             int stride_h, int stride_w, bool is_max, int activation)
+{
+    parallelFor(batch * out_h, [&](int begin, int end) {
+        for (int row = begin; row < end; ++row)
+        {
+            const int b  = row / out_h;
+            const int oy = row % out_h;
+
+            const int y_start = std::max(oy * stride_h - pad_top, 0);
+            const int y_end   = std::min(oy * stride_h - pad_top + filter_h, in_h);
+
+            for (int ox = 0; ox < out_w; ++ox)
+            {
+                const int x_start = std::max(ox * stride_w - pad_left, 0);
+                const int x_end   = std::min(ox * stride_w - pad_left + filter_w, in_w);
+                const int count   = std::max((y_end - y_start) * (x_end - x_start), 1);
+
+                for (int c = 0; c < channels; ++c)
+                {
+                    float value = is_max ? -FLT_MAX : 0.f;
+                    for (int iy = y_start; iy < y_end; ++iy)
+                    {
+                        for (int ix = x_start; ix < x_end; ++ix)
+                        {
+                            const float v = in[((b * in_h + iy) * in_w + ix) * channels + c];
+                            value = is_max ? std::max(value, v) : value + v;
+                        }
+                    }
+
+                    if (!is_max)
+                    {
+                        value /= count;
+                    }
+                    out[((b * out_h + oy) * out_w + ox) * channels + c] = applyActivation(value, activation);
+                }
+            }
+        }
+    });
+}
+
+// right align shape to MAX_BROADCAST_DIMS dims, broadcast dims get a zero stride
+static void broadcastStrides(const std::vector<uint32_t>& shape, int* strides)
+{
+    const int pad = MAX_BROADCAST_DIMS - shape.size();
+    int stride = 1;
+    for (int d = MAX_BROADCAST_DIMS - 1; d >= 0; --d)
+    {
+        const int dim = d < pad ? 1 : shape[d - pad];
+        strides[d] = dim == 1 ? 0 : stride;
+        stride *= dim;
+    }
+}
+
+void eleWiseCpu(const float* in0, const std::vector<uint32_t>& shape0,
+                const float* in1, const std::vector<uint32_t>& shape1,
+                float* out, const std::vector<uint32_t>& out_shape, bool is_mul, int activation)
+{
+    ASSERT(shape0.size() <= MAX_BROADCAST_DIMS && shape1.size() <= MAX_BROADCAST_DIMS);
+    ASSERT(out_shape.size() <= MAX_BROADCAST_DIMS);
+
+    int stride0[MAX_BROADCAST_DIMS];
+    int stride1[MAX_BROADCAST_DIMS];
+    int out_ext[MAX_BROADCAST_DIMS];
+    broadcastStrides(shape0, stride0);
+    broadcastStrides(shape1, stride1);
+
+    const int pad = MAX_BROADCAST_DIMS - out_shape.size();
+    int total = 1;
+    for (int d = 0; d < MAX_BROADCAST_DIMS; ++d)
+    {
+        out_ext[d] = d < pad ? 1 : out_shape[d - pad];
+        total *= out_ext[d];
+    }
+
+    parallelFor(total, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            int off0 = 0;
+            int off1 = 0;
+            int rem = i;
+            for (int d = MAX_BROADCAST_DIMS - 1; d >= 0; --d)
+            {
+                const int coord = rem % out_ext[d];
+                rem /= out_ext[d];
+                off0 += coord * stride0[d];
+                off1 += coord * stride1[d];
+            }
+
+            const float value = is_mul ? in0[off0] * in1[off1] : in0[off0] + in1[off1];
+            out[i] = applyActivation(value, activation);
+        }
+    });
+}
+
+void concatCpu(const std::vector<const float*>& ins, const std::vector<int>& axis_sizes,
+               float* out, int outer, int inner)
+{
+    int out_axis = 0;
+    for (int size : axis_sizes)
+    {
+        out_axis += size;
+    }
+
+    int axis_offset = 0;
+    for (size_t i = 0; i < ins.size(); ++i)
+    {
+        const int copy_size = axis_sizes[i] * inner;
+        for (int o = 0; o < outer; ++o)
+        {
+            memcpy(out + (o * out_axis + axis_offset) * inner, ins[i] + o * copy_size, copy_size * sizeof(float));
+        }
+        axis_offset += axis_sizes[i];
+    }
+}
+
+void softmaxCpu(const float* in, float* out, int outer, int depth, float beta)
+{
+    parallelFor(outer, [&](int begin, int end) {
+        for (int o = begin; o < end; ++o)
+        {
+            const float* src = in + o * depth;
+            float* dst = out + o * depth;
+
+            float max_value = -FLT_MAX;
+            for (int i = 0; i < depth; ++i)
+            {
+                max_value = std::max(max_value, src[i]);
+            }
+
+            float sum = 0.f;
+            for (int i = 0; i < depth; ++i)
+            {
+                dst[i] = expf((src[i] - max_value) * beta);
+                sum += dst[i];
+            }
+
+            for (int i = 0; i < depth; ++i)
+            {
+                dst[i] /= sum;
+            }
+        }
+    });
+}
+
+void logisticCpu(const float* in, float* out, int total)
+{
+    parallelFor(total, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            out[i] = 1.f / (1.f + expf(-in[i]));
+        }
+    });
+}
+
+void lrnCpu(const float* in, float* out, int outer, int depth,
+            int radius, float bias, float alpha, float beta)
+{
+    parallelFor(outer, [&](int begin, int end) {
+        for (int o = begin; o < end; ++o)
+        {
+            const float* src = in + o * depth;
+            for (int c = 0; c < depth; ++c)
+            {
+                const int c_start = std::max(c - radius, 0);
+                const int c_end   = std::min(c + radius + 1, depth);
+
+                float sqr_sum = 0.f;
+                for (int i = c_start; i < c_end; ++i)
+                {
+                    sqr_sum += src[i] * src[i];
+                }
+                out[o * depth + c] = src[c] / powf(bias + alpha * sqr_sum, beta);
+            }
+        }
+    });
+}
+
+void activationCpu(const float* in, float* out, int total, int type)
+{
+    parallelFor(total, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            out[i] = type == kActivationTanh ? tanhf(in[i]) : applyActivation(in[i], type);
+        }
+    });
+}
+
+void fullyConnectedCpu(const float* in, const float* weights, const float* bias, float* out,
+                       int batch, int k, int n, int activation)
+{
+    parallelFor(batch * n, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            const int b = i / n;
+            const int u = i % n;
+            out[i] = applyActivation(bias[u] + dotProduct(in + b * k, weights + u * k, k), activation);
+        }
+    });
+}
+
+void resizeBilinearCpu(const float* in, float* out, int batch, int in_h, int in_w,
+                       int out_h, int out_w, int channels)
+{
+    const float scale_h = static_cast<float>(in_h) / out_h;
+    const float scale_w = static_cast<float>(in_w) / out_w;
+
+    parallelFor(batch * out_h, [&](int begin, int end) {
+        for (int row = begin; row < end; ++row)
+        {
+            const int b = row / out_h;
+            const int y = row % out_h;
+
+            const float in_y = y * scale_h;
+            const int y0 = std::min(static_cast<int>(floorf(in_y)), in_h - 1);
+            const int y1 = std::min(y0 + 1, in_h - 1);
+            const float dy = in_y - y0;
+
+            for (int x = 0; x < out_w; ++x)
+            {
+                const float in_x = x * scale_w;
+                const int x0 = std::min(static_cast<int>(floorf(in_x)), in_w - 1);
+                const int x1 = std::min(x0 + 1, in_w - 1);
+                const float dx = in_x - x0;
+
+                const float* row0 = in + (b * in_h + y0) * in_w * channels;
+                const float* row1 = in + (b * in_h + y1) * in_w * channels;
+                float* dst = out + ((b * out_h + y) * out_w + x) * channels;
+
+                for (int c = 0; c < channels; ++c)
+                {
+                    const float top = row0[x0 * channels + c] +
+                                      (row0[x1 * channels + c] - row0[x0 * channels + c]) * dx;
+                    const float bottom = row1[x0 * channels + c] +
+                                         (row1[x1 * channels + c] - row1[x0 * channels + c]) * dx;
+                    dst[c] = top + (bottom - top) * dy;
+                }
+            }
+        }
+    });
+}
+
+void l2NormCpu(const float* in, float* out, int depth, int outer)
+{
+    parallelFor(outer, [&](int begin, int end) {
+        for (int o = begin; o < end; ++o)
+        {
+            const float* src = in + o * depth;
+            const float inv = 1.f / std::max(sqrtf(dotProduct(src, src, depth)), 1.e-6f);
+            for (int i = 0; i < depth; ++i)
+            {
+                out[o * depth + i] = src[i] * inv;
+            }
+        }
+    });
+}
+
+void meanCpu(const float* in, float* out, const std::vector<uint32_t>& dims,
+             const std::vector<bool>& reduced)
+{
+    const int rank = dims.size();
+    std::vector<int> out_strides(rank, 0);
+
+    int out_total = 1;
+    int reduce_count = 1;
+    for (int d = rank - 1; d >= 0; --d)
+    {
+        if (reduced[d])
+        {
+            reduce_count *= dims[d];
+        }
+        else
+        {
+            out_strides[d] = out_total;
+            out_total *= dims[d];
+        }
+    }
+
+    std::vector<double> sums(out_total, 0.0);
+    int in_total = out_total * reduce_count;
+    for (int i = 0; i < in_total; ++i)
+    {
+        int rem = i;
+        int out_idx = 0;
+        for (int d = rank - 1; d >= 0; --d)
+        {
+            out_idx += (rem % dims[d]) * out_strides[d];
+            rem /= dims[d];
+        }
+        sums[out_idx] += in[i];
+    }
+
+    for (int o = 0; o < out_total; ++o)
+    {
+        out[o] = static_cast<float>(sums[o] / reduce_count);
+    }
+}
+
+NAME_SPACE_STOP
@@ -0,0 +1,69 @@
+#ifndef ANDROID_HARDWARE_NEURALNETWORKS_V1_2_CPU_REFERENCE_H
+#define ANDROID_HARDWARE_NEURALNETWORKS_V1_2_CPU_REFERENCE_H
+
+#include <functional>
+#include <vector>
+
+#include "base.h"
+
+NAME_SPACE_BEGIN
+
+// plain float32 NHWC kernels used as the golden output of the gpu shaders,
+// by the convolution tuning and by the shadow validation mode
+
+// keep in sync with TYPE in vulkan/shader/activation.comp
+enum ActivationType { kActivationRelu = 1, kActivationRelu1, kActivationRelu6, kActivationTanh };
+
+// split [0, count) into one chunk per cpu core and run func(begin, end) on each of them
+void parallelFor(int count, const std::function<void(int, int)>& func);
+
+float dotProduct(const float* a, const float* b, int len);
+
+// fused activation as defined by FusedActivationFunc
+float applyActivation(float value, int activation);
+
+void convCpuBhwc(float* in_buffer, float* bias_buffer, float* filter_buffer, float* benchmark,
+                 int batch, int group, int has_bias, int in_c, int in_w, int in_h,
+                 int out_c, int out_w, int out_h, int filter_w, int filter_h,
+                 int padding_left, int padding_top, int stride_w, int stride_h,
+                 int dilation_x, int dilation_y, int activation);
+
+void depthConvCpu(const float* in, const float* filter, const float* bias, float* out,
+                  int batch, int in_h, int in_w, int in_c, int out_h, int out_w, int out_c,
+                  int filter_h, int filter_w, int pad_top, int pad_left,
+                  int stride_h, int stride_w, int multiplier, int activation);
+
+void poolCpu(const float* in, float* out, int batch, int in_h, int in_w, int channels,
+             int out_h, int out_w, int filter_h, int filter_w, int pad_top, int pad_left,
+             int stride_h, int stride_w, bool is_max, int activation);
+
+// ADD and MUL with the numpy style broadcast of the nn api
+void eleWiseCpu(const float* in0, const std::vector<uint32_t>& shape0,
+                const float* in1, const std::vector<uint32_t>& shape1,
+                float* out, const std::vector<uint32_t>& out_shape, bool is_mul, int activation);
+
+void concatCpu(const std::vector<const float*>& ins, const std::vector<int>& axis_sizes,
+               float* out, int outer, int inner);
+
+void softmaxCpu(const float* in, float* out, int outer, int depth, float beta);
+void logisticCpu(const float* in, float* out, int total);
+void lrnCpu(const float* in, float* out, int outer, int depth,
+            int radius, float bias, float alpha, float beta);
+void activationCpu(const float* in, float* out, int total, int type);
+
+void fullyConnectedCpu(const float* in, const float* weights, const float* bias, float* out,
+                       int batch, int k, int n, int activation);
+
+// half pixel offsets are not used, i.e. align_corners = false of tensorflow
+void resizeBilinearCpu(const float* in, float* out, int batch, int in_h, int in_w,
+                       int out_h, int out_w, int channels);
+
+void l2NormCpu(const float* in, float* out, int depth, int outer);
+
+// reduced[i] tells whether dims[i] is averaged
+void meanCpu(const float* in, float* out, const std::vector<uint32_t>& dims,
+             const std::vector<bool>& reduced);
+
+NAME_SPACE_STOP
+
+#endif
@@ -300,33 +300,47 @@ void GlesCsExecutor::setArgOperands(const Request& request)
     updateForArguments(model.outputIndexes, request.outputs);
 }
 
-bool GlesCsExecutor::run(const Operation& operation, OperationCpuTimer* timer, GlesOperationResource& resource)
+bool GlesCsExecutor::run(const Operation& operation, uint32_t index, OperationCpuTimer* timer,
+                         GlesOperationResource& resource)
 {
-    GlesCpuTimer t(timer);
-
     //maybe some checking here
     const hidl_vec<uint32_t>& inputs = operation.inputs;
     const hidl_vec<uint32_t>& outputs = operation.outputs;
 
     bool ret = true;
 
-    switch (operation.type)
     {
+        GlesCpuTimer t(timer);
+
+        switch (operation.type)
+        {
 
 #define SETUP_OP(op)                \
-    case OperationType::op:         \
-        NN_GPU_DEBUG("run operation type with %d", OperationType::op); \
-        ret = do##op(operation, resource);    \
-        break;
+        case OperationType::op:         \
+            NN_GPU_DEBUG("run operation type with %d", OperationType::op); \
+            ret = do##op(operation, resource);    \
+            break;
 #include "gles_setup_op.hxx"
 #undef SETUP_OP
 
-    default:
-        NOT_IMPLEMENTED;
-        break;
+        default:
+            NOT_IMPLEMENTED;
+            break;
+        }
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
     }
 
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    // the inputs must be validated before their storage is released by markOpFinished
+    if (ret && shadow != nullptr)
+    {
+        ShadowOperandAdapter<GlesOperand> reader(model, operands);
+        if (!shadow->validate(index, getOpName(operation), operation, reader) &&
+            operation.type == OperationType::CONV_2D && !resource.convSignature.empty())
+        {
+            blacklistConvConfig(resource.convSignature, resource.convConfig);
+        }
+    }
 
     for (uint32_t i : inputs)
     {
@@ -347,15 +361,23 @@ bool GlesCsExecutor::run(const Request& request)
     restoreOperands();
     memMgr.resetFromRequest(request);
     setArgOperands(request);
+    if (shadow != nullptr)
+    {
+        shadow->beginRun();
+    }
     for (size_t i = 0; i < model.operations.size(); ++i)
     {
         const Operation& operation = model.operations[i];
         OperationCpuTimer* timer = &operationTimers[i];
-        if (!run(operation, timer, operationResources[i]))
+        if (!run(operation, i, timer, operationResources[i]))
         {
             return false;
         }
     }
+    if (shadow != nullptr)
+    {
+        shadow->endRun();
+    }
     memMgr.sync();
     CHECKGLERROR();
     return true;
@@ -30,6 +30,7 @@
 #include "gles_memory_manager.h"
 #include "gles_cs_program_manager.h"
 #include "gles_cpu_timer.h"
+#include "shadow_validator.h"
 
 NAME_SPACE_BEGIN
 
@@ -37,6 +38,9 @@ struct GlesOperationResource
 {
     GlesOperationResource(){}
     std::vector<GLuint> tmpBo;
+    // tuning cache entry used by CONV_2D, blacklisted when the shadow validation fails
+    std::string convSignature;
+    std::string convConfig;
 };
 
 class GlesCsExecutor : public GpuExecutor
@@ -75,6 +79,7 @@ private:
     std::vector<GlesOperand> operands;
     std::vector<OperationCpuTimer> operationTimers;
     std::vector<GlesOperationResource> operationResources;
+    std::shared_ptr<ShadowValidator> shadow;
 
     void showEglError()
     {
@@ -98,7 +103,10 @@ private:
     void setUniform1ui(GLuint prog, const char* name, GLuint v);
     void setUniform1f(GLuint prog, const char* name, GLfloat f);
 
-    bool run(const Operation& operation, OperationCpuTimer* timer, GlesOperationResource& resource);
+    bool run(const Operation& operation, uint32_t index, OperationCpuTimer* timer, GlesOperationResource& resource);
+
+    // drop a conv shader config from the tuning cache and never tune to it again
+    static void blacklistConvConfig(const std::string& signature, const std::string& config);
 
 #define SETUP_OP(op) bool do##op(const Operation& operation, GlesOperationResource& resource);
 #include "gles_setup_op.hxx"
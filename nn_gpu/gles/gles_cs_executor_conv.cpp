@@ -1,4 +1,5 @@
 #include <math.h>
+#include <set>
 #include <cutils/properties.h>
 #include "gles_cs_executor.h"
 
@@ -28,6 +29,8 @@ NAME_SPACE_BEGIN
 typedef std::map<std::string, std::string> ShaderConfigMap;
 typedef std::map<long, int> TimedConfig;
 static ShaderConfigMap shaderConfigMap;
+// "signature:config" pairs which failed the shadow validation
+static std::set<std::string> blacklistedConfigs;
 static bool inited = false;
 static std::mutex mtx;
 const char *prop_prefix = "persist.nn.gpgpu.shader.config.";
@@ -1005,8 +1008,15 @@ bool tryShaderConfig(ConvParam& convParam,
     
     key.activation  = convParam.activation;
     key.convParam   = convParam;
+    const std::string sig = genConvSignature(convParam);
     for (size_t i = 0; i < configs.size(); i ++)
     {
+        if (blacklistedConfigs.count(sig + ":" + genShaderConfigString(configs[i])) > 0)
+        {
+            NN_GPU_PERF("CONV_2D: %s: skip blacklisted config %s\n", __func__, genShaderConfigString(configs[i]).c_str());
+            continue;
+        }
+
         long elapsedUS;
         bool ret = convolveTimed(convParam, configs[i], progMgr, 1, elapsedUS, true);
         // delete temporary program in time to save run time memory.
@@ -1179,6 +1189,10 @@ void prepareShaderConfig(ConvParam& convParam,
 
     // load from persistent storage
     found = loadConfig(sig, conf);
+    if (found && blacklistedConfigs.count(sig + ":" + genShaderConfigString(conf)) > 0)
+    {
+        found = false;
+    }
     if (!found)
     {
         tune(convParam, conf, progMgr, input, filter, bias, output);
@@ -1198,6 +1212,21 @@ void prepareShaderConfig(ConvParam& convParam,
     return;
 }
 
+void GlesCsExecutor::blacklistConvConfig(const std::string& signature, const std::string& config)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    LOGW("CONV_2D: blacklist shader config %s for %s", config.c_str(), signature.c_str());
+    blacklistedConfigs.insert(signature + ":" + config);
+
+    // the next execution re-tunes among the remaining candidates
+    ShaderConfigMap::iterator it = shaderConfigMap.find(signature);
+    if (it != shaderConfigMap.end() && it->second == config)
+    {
+        shaderConfigMap.erase(it);
+    }
+}
+
 // FIXME:
 // Android NN don't set group, dilation, has_bias,
 // so make these assumptions: group = 1, dilation = 1, has_bias = 1
@@ -1375,6 +1404,8 @@ bool GlesCsExecutor::doCONV_2D(const Operation& operation, GlesOperationResource
         outSSbo = output.getSSbo();
 
         prepareShaderConfig(convParam, shaderConf, progMgr, inSSbo, filterSSbo, biasSSbo, outSSbo);
+        resource.convSignature = genConvSignature(convParam);
+        resource.convConfig = genShaderConfigString(shaderConf);
 
         NN_GPU_DEBUG("convParam batch %d, input_height %d, input_width %d, input_chn %d, output_height %d, output_width %d, "
                 "output_chn %d, filter_height %d, filter_width %d, stride_height %d, stride_width %d, padding_height %d, "
@@ -203,6 +203,22 @@ void GlesOperand::retrieveData()
     }
 }
 
+void GlesOperand::copyToBuffer(float* to_buf, const size_t buf_size)
+{
+    const size_t size = std::min(length, buf_size * sizeof(float));
+    GLuint ssbo = getSSbo();
+
+    // make the shader writes visible to the mapping
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+    uint8_t* p = (uint8_t*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (p != nullptr)
+    {
+        memcpy(to_buf, p, size);
+    }
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+}
+
 void GlesOperand::markOpFinished()
 {
     if (lifetime == OperandLifeTime::TEMPORARY_VARIABLE)
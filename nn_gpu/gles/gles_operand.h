@@ -32,6 +32,7 @@ public:
 
     void markOpFinished();
     void retrieveData();
+    void copyToBuffer(float* to_buf, const size_t buf_size);
     uint32_t getElementCount();
     uint32_t getElementCount(int32_t axis);
 
@@ -42,6 +43,14 @@ public:
         return data[0];
     }
 
+    // for small constant tensors such as axes, only valid with CONSTANT_COPY lifetime
+    template <typename T>
+    T getScalarData(uint32_t idx) const
+    {
+        const T* data = reinterpret_cast<const T*>(valPtr);
+        return data[idx];
+    }
+
     uint32_t getDimensionSize(uint32_t idx)
     {
         if (idx >= dimensions.size())
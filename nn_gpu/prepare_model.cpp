@@ -3,10 +3,12 @@
 #include <string.h>
 
 #include <hidl/LegacySupport.h>
+#include <future>
 #include <thread>
 
 #include "prepare_model.h"
 #include "executor_manager.h"
+#include "batch_scheduler.h"
 #include "ValidateHal.h"
 
 NAME_SPACE_BEGIN
@@ -31,7 +33,17 @@ PreparedModel::PreparedModel(const Model& model)
 bool PreparedModel::initialize()
 {
     NN_GPU_CALL();
-    return exec->initPerModel();
+    if (!exec->initPerModel())
+    {
+        return false;
+    }
+
+    BatchConfig config = BatchConfig::fromProperties();
+    if (config.enabled())
+    {
+        scheduler.reset(new BatchScheduler(mModel, exec.get(), config));
+    }
+    return true;
 }
 
 void PreparedModel::asyncExecute_1_2(const Request& request,
@@ -87,6 +99,14 @@ Return<ErrorStatus> PreparedModel::execute(const Request& request,
         return ErrorStatus::INVALID_ARGUMENT;
     }
 
+    if (scheduler != nullptr)
+    {
+        scheduler->submit(request, [callback](bool succ) {
+            callback->notify(succ ? ErrorStatus::NONE : ErrorStatus::GENERAL_FAILURE);
+        });
+        return ErrorStatus::NONE;
+    }
+
     execThreads.push_back(std::thread([this, request, callback]{ asyncExecute(request, callback); }));
 
     return ErrorStatus::NONE;
@@ -116,6 +136,14 @@ Return<ErrorStatus> PreparedModel::execute_1_2(const Request& request,
         return ErrorStatus::INVALID_ARGUMENT;
     }
 
+    if (scheduler != nullptr)
+    {
+        scheduler->submit(request, [callback](bool succ) {
+            callback->notify_1_2(succ ? ErrorStatus::NONE : ErrorStatus::GENERAL_FAILURE, {}, kNoTiming);
+        });
+        return ErrorStatus::NONE;
+    }
+
     execThreads.push_back(std::thread([this, request, callback]{ asyncExecute(request, callback); }));
 
     return ErrorStatus::NONE;
@@ -139,6 +167,15 @@ Return<void> PreparedModel::executeSynchronously(const Request& request,
         return Void();
     }
 
+    if (scheduler != nullptr)
+    {
+        std::promise<bool> done;
+        scheduler->submit(request, [&done](bool succ) { done.set_value(succ); });
+        bool succ = done.get_future().get();
+        cb(succ ? ErrorStatus::NONE : ErrorStatus::GENERAL_FAILURE, {}, kNoTiming);
+        return Void();
+    }
+
     exec->initPerExecThread();
     bool succ = exec->run(request);
     exec->deinitPerExecThread();
@@ -174,6 +211,7 @@ PreparedModel::~PreparedModel()
 {
     NN_GPU_CALL();
     for (auto& th : execThreads) th.join();
+    scheduler.reset();
     exec->deinitPerModel();
 }
 
@@ -1,6 +1,8 @@
 #ifndef ANDROID_HARDWARE_NEURALNETWORKS_V1_2_PREPARE_MODEL_H
 #define ANDROID_HARDWARE_NEURALNETWORKS_V1_2_PREPARE_MODEL_H
 
+#include <memory>
+
 #include "hal_types.h"
 
 NAME_SPACE_BEGIN
@@ -8,6 +10,7 @@ NAME_SPACE_BEGIN
 using time_point = std::chrono::steady_clock::time_point;
 
 class BaseExecutor;
+class BatchScheduler;
 
 class PreparedModel : public IPreparedModel
 {
@@ -35,6 +38,8 @@ private:
     Model mModel;
     sp<BaseExecutor> exec;
     std::vector<std::thread> execThreads;
+    // coalesces concurrent executions when nn.gpgpu.batch.max is greater than 1
+    std::unique_ptr<BatchScheduler> scheduler;
 };
 
 NAME_SPACE_STOP
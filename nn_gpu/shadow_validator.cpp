@@ -0,0 +1,539 @@
+#include <math.h>
+#include <cmath>
+#include <cutils/properties.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include "shadow_validator.h"
+#include "gpu_executor.h"
+#include "cpu_reference.h"
+
+NAME_SPACE_BEGIN
+
+// gpu results are accumulated in another order than the cpu reference
+static const float kAbsTolerance = 1.e-3f;
+static const float kRelTolerance = 1.e-3f;
+static const float kRelEpsilon   = 1.e-6f;
+
+static size_t getElementCount(const std::vector<uint32_t>& dims)
+{
+    size_t count = 1;
+    for (auto d : dims)
+    {
+        count *= d;
+    }
+    return count;
+}
+
+static std::vector<float> readTensor(ShadowOperandReader& reader, uint32_t index)
+{
+    std::vector<float> buf(getElementCount(reader.getDimensions(index)));
+    reader.readTensor(index, buf.data(), buf.size());
+    return buf;
+}
+
+void ShadowStats::merge(const ShadowStats& other)
+{
+    count          += other.count;
+    mismatch_count += other.mismatch_count;
+    nan_count      += other.nan_count;
+    inf_count      += other.inf_count;
+    first_mismatch  = std::min(first_mismatch, other.first_mismatch);
+    max_abs_error   = std::max(max_abs_error, other.max_abs_error);
+    max_rel_error   = std::max(max_rel_error, other.max_rel_error);
+}
+
+void ShadowValidator::compareRange(const float* actual, const float* expected, size_t begin, size_t end,
+                                   ShadowStats& stats, bool use_simd)
+{
+    size_t i = begin;
+
+#if defined(__SSE__)
+    const size_t simd_end = use_simd ? end : begin;
+    const __m128 sign    = _mm_set1_ps(-0.f);
+    const __m128 inf     = _mm_set1_ps(INFINITY);
+    const __m128 abs_tol = _mm_set1_ps(kAbsTolerance);
+    const __m128 rel_tol = _mm_set1_ps(kRelTolerance);
+    const __m128 rel_eps = _mm_set1_ps(kRelEpsilon);
+    __m128 max_abs = _mm_setzero_ps();
+    __m128 max_rel = _mm_setzero_ps();
+
+    for (; i + 4 <= simd_end; i += 4)
+    {
+        const __m128 a     = _mm_loadu_ps(actual + i);
+        const __m128 e     = _mm_loadu_ps(expected + i);
+        const __m128 abs_e = _mm_andnot_ps(sign, e);
+        const __m128 diff  = _mm_andnot_ps(sign, _mm_sub_ps(a, e));
+        const __m128 rel   = _mm_div_ps(diff, _mm_max_ps(abs_e, rel_eps));
+
+        // nan lanes keep the previous maximum since the second operand is returned for them
+        max_abs = _mm_max_ps(diff, max_abs);
+        max_rel = _mm_max_ps(rel, max_rel);
+
+        const int nan_bits = _mm_movemask_ps(_mm_cmpunord_ps(a, a));
+        const int inf_bits = _mm_movemask_ps(_mm_cmpeq_ps(_mm_andnot_ps(sign, a), inf));
+        const int bad_bits = _mm_movemask_ps(_mm_cmpgt_ps(diff, _mm_add_ps(abs_tol, _mm_mul_ps(rel_tol, abs_e)))) |
+                             nan_bits;
+        if (bad_bits | inf_bits)
+        {
+            stats.nan_count      += __builtin_popcount(nan_bits);
+            stats.inf_count      += __builtin_popcount(inf_bits);
+            stats.mismatch_count += __builtin_popcount(bad_bits);
+            if (bad_bits && stats.first_mismatch == SIZE_MAX)
+            {
+                stats.first_mismatch = i + __builtin_ctz(bad_bits);
+            }
+        }
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, max_abs);
+    stats.max_abs_error = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    _mm_storeu_ps(lanes, max_rel);
+    stats.max_rel_error = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#else
+    UNUSED(use_simd);
+#endif
+
+    for (; i < end; ++i)
+    {
+        const float a    = actual[i];
+        const float e    = expected[i];
+        const float diff = fabsf(a - e);
+
+        if (std::isnan(a))
+        {
+            stats.nan_count++;
+        }
+        else if (std::isinf(a))
+        {
+            stats.inf_count++;
+        }
+
+        if (std::isnan(a) || diff > kAbsTolerance + kRelTolerance * fabsf(e))
+        {
+            stats.mismatch_count++;
+            stats.first_mismatch = std::min(stats.first_mismatch, i);
+        }
+
+        if (!std::isnan(diff))
+        {
+            stats.max_abs_error = std::max(stats.max_abs_error, diff);
+            stats.max_rel_error = std::max(stats.max_rel_error, diff / std::max(fabsf(e), kRelEpsilon));
+        }
+    }
+
+    stats.count = end - begin;
+}
+
+void ShadowValidator::compare(const float* actual, const float* expected, size_t count, ShadowStats& stats)
+{
+    const int chunks = (count + SHADOW_COMPARE_CHUNK - 1) / SHADOW_COMPARE_CHUNK;
+    std::vector<ShadowStats> partial(chunks);
+
+    parallelFor(chunks, [&](int begin, int end) {
+        for (int c = begin; c < end; ++c)
+        {
+            const size_t first = static_cast<size_t>(c) * SHADOW_COMPARE_CHUNK;
+            compareRange(actual, expected, first, std::min(first + SHADOW_COMPARE_CHUNK, count), partial[c]);
+        }
+    });
+
+    stats = ShadowStats();
+    for (const auto& p : partial)
+    {
+        stats.merge(p);
+    }
+}
+
+int ShadowValidator::getLevel()
+{
+    static int level = -1;
+
+    if (level < 0)
+    {
+        char prop[PROPERTY_VALUE_MAX] = "\0";
+        level = 0;
+        if (property_get("nn.gpgpu.shadow", prop, nullptr) > 0)
+        {
+            sscanf(prop, "%d", &level);
+        }
+    }
+
+    return level;
+}
+
+void ShadowValidator::beginRun()
+{
+    firstDiverged = -1;
+    firstDivergedName.clear();
+    divergedCount = 0;
+}
+
+void ShadowValidator::endRun()
+{
+    if (firstDiverged < 0)
+    {
+        LOGD("shadow validation: all %zu operations passed", model.operations.size());
+        return;
+    }
+
+    LOGE("shadow validation: %u of %zu operations diverged, the first diverging layer is operation %d %s",
+         divergedCount, model.operations.size(), firstDiverged, firstDivergedName.c_str());
+}
+
+bool ShadowValidator::validate(uint32_t opIndex, const std::string& opName,
+                               const Operation& operation, ShadowOperandReader& reader)
+{
+    std::vector<float> expected;
+    if (!computeReference(operation, reader, expected))
+    {
+        NN_GPU_DEBUG("shadow validation: no cpu reference for operation %u %s", opIndex, opName.c_str());
+        return true;
+    }
+
+    const uint32_t out = operation.outputs[0];
+    std::vector<float> actual(expected.size());
+    reader.readTensor(out, actual.data(), actual.size());
+
+    ShadowStats stats;
+    compare(actual.data(), expected.data(), actual.size(), stats);
+
+    if (stats.passed())
+    {
+        if (getLevel() > 1)
+        {
+            LOGD("shadow validation: operation %u %s passed, %zu elements, max abs error %g, max rel error %g",
+                 opIndex, opName.c_str(), stats.count, stats.max_abs_error, stats.max_rel_error);
+        }
+        return true;
+    }
+
+    const size_t first = stats.first_mismatch;
+    LOGE("shadow validation: operation %u %s diverged, %zu of %zu elements mismatch, "
+         "max abs error %g, max rel error %g, nan %zu, inf %zu",
+         opIndex, opName.c_str(), stats.mismatch_count, stats.count,
+         stats.max_abs_error, stats.max_rel_error, stats.nan_count, stats.inf_count);
+    if (first < actual.size())
+    {
+        LOGE("shadow validation: first mismatch at %zu, gpu: %f, cpu: %f", first, actual[first], expected[first]);
+    }
+
+    if (firstDiverged < 0)
+    {
+        firstDiverged = opIndex;
+        firstDivergedName = opName;
+    }
+    divergedCount++;
+
+    return false;
+}
+
+static bool isExplicitPadding(const Model& model, const hidl_vec<uint32_t>& ins,
+                              const size_t explicitCount, const uint32_t typeIndex)
+{
+    // explicit and implicit padding with the optional inputs of v1.2 may have the same
+    // input count, the implicit one has the BOOL layout flag at typeIndex
+    return ins.size() >= explicitCount && model.operands[ins[typeIndex]].type != OperandType::BOOL;
+}
+
+struct WindowParam
+{
+    int pad_top;
+    int pad_left;
+    int stride_h;
+    int stride_w;
+    int activation;
+};
+
+static void implicitWindowParam(ShadowOperandReader& reader, uint32_t scheme_index,
+                                uint32_t stride_w_index, uint32_t stride_h_index,
+                                const std::vector<uint32_t>& in_dims, int filter_h, int filter_w,
+                                WindowParam& p)
+{
+    int32_t tail;
+    const int32_t scheme = reader.getInt32(scheme_index);
+    p.stride_w = reader.getInt32(stride_w_index);
+    p.stride_h = reader.getInt32(stride_h_index);
+    calculateExplicitPadding(in_dims[2], p.stride_w, filter_w, scheme, &p.pad_left, &tail);
+    calculateExplicitPadding(in_dims[1], p.stride_h, filter_h, scheme, &p.pad_top, &tail);
+}
+
+bool ShadowValidator::computeReference(const Operation& operation, ShadowOperandReader& reader,
+                                       std::vector<float>& expected)
+{
+    const hidl_vec<uint32_t>& ins = operation.inputs;
+    const std::vector<uint32_t> out_dims = reader.getDimensions(operation.outputs[0]);
+    expected.resize(getElementCount(out_dims));
+
+    switch (operation.type)
+    {
+    case OperationType::ADD:
+    case OperationType::MUL:
+    {
+        std::vector<float> in0 = readTensor(reader, ins[0]);
+        std::vector<float> in1 = readTensor(reader, ins[1]);
+        eleWiseCpu(in0.data(), reader.getDimensions(ins[0]), in1.data(), reader.getDimensions(ins[1]),
+                   expected.data(), out_dims, operation.type == OperationType::MUL, reader.getInt32(ins[2]));
+        return true;
+    }
+    case OperationType::CONV_2D:
+    {
+        const std::vector<uint32_t> in_dims = reader.getDimensions(ins[0]);
+        const std::vector<uint32_t> filter_dims = reader.getDimensions(ins[1]);
+        const bool is_explicit = isExplicitPadding(model, ins, 10, 7);
+        const size_t layout_index = is_explicit ? 10 : 7;
+        if (ins.size() > layout_index && reader.getBool(ins[layout_index]))
+        {
+            return false;   // NCHW
+        }
+
+        const size_t dilation_index = layout_index + 1;
+        const int dilation_x = ins.size() > dilation_index + 1 ? reader.getInt32(ins[dilation_index]) : 1;
+        const int dilation_y = ins.size() > dilation_index + 1 ? reader.getInt32(ins[dilation_index + 1]) : 1;
+
+        WindowParam p;
+        if (is_explicit)
+        {
+            p.pad_left   = reader.getInt32(ins[3]);
+            p.pad_top    = reader.getInt32(ins[5]);
+            p.stride_w   = reader.getInt32(ins[7]);
+            p.stride_h   = reader.getInt32(ins[8]);
+            p.activation = reader.getInt32(ins[9]);
+        }
+        else
+        {
+            implicitWindowParam(reader, ins[3], ins[4], ins[5], in_dims,
+                                (filter_dims[1] - 1) * dilation_y + 1, (filter_dims[2] - 1) * dilation_x + 1, p);
+            p.activation = reader.getInt32(ins[6]);
+        }
+
+        std::vector<float> in = readTensor(reader, ins[0]);
+        std::vector<float> filter = readTensor(reader, ins[1]);
+        std::vector<float> bias = readTensor(reader, ins[2]);
+        convCpuBhwc(in.data(), bias.data(), filter.data(), expected.data(),
+                    in_dims[0], 1, 1, in_dims[3], in_dims[2], in_dims[1],
+                    out_dims[3], out_dims[2], out_dims[1], filter_dims[2], filter_dims[1],
+                    p.pad_left, p.pad_top, p.stride_w, p.stride_h, dilation_x, dilation_y, p.activation);
+        return true;
+    }
+    case OperationType::DEPTHWISE_CONV_2D:
+    {
+        const std::vector<uint32_t> in_dims = reader.getDimensions(ins[0]);
+        const std::vector<uint32_t> filter_dims = reader.getDimensions(ins[1]);
+        const bool is_explicit = isExplicitPadding(model, ins, 11, 8);
+        const size_t layout_index = is_explicit ? 11 : 8;
+        if (ins.size() > layout_index && reader.getBool(ins[layout_index]))
+        {
+            return false;   // NCHW
+        }
+        if (ins.size() > layout_index + 1)
+        {
+            return false;   // dilation is not handled by the reference
+        }
+
+        WindowParam p;
+        int multiplier;
+        if (is_explicit)
+        {
+            p.pad_left   = reader.getInt32(ins[3]);
+            p.pad_top    = reader.getInt32(ins[5]);
+            p.stride_w   = reader.getInt32(ins[7]);
+            p.stride_h   = reader.getInt32(ins[8]);
+            multiplier   = reader.getInt32(ins[9]);
+            p.activation = reader.getInt32(ins[10]);
+        }
+        else
+        {
+            implicitWindowParam(reader, ins[3], ins[4], ins[5], in_dims, filter_dims[1], filter_dims[2], p);
+            multiplier   = reader.getInt32(ins[6]);
+            p.activation = reader.getInt32(ins[7]);
+        }
+
+        std::vector<float> in = readTensor(reader, ins[0]);
+        std::vector<float> filter = readTensor(reader, ins[1]);
+        std::vector<float> bias = readTensor(reader, ins[2]);
+        depthConvCpu(in.data(), filter.data(), bias.data(), expected.data(),
+                     in_dims[0], in_dims[1], in_dims[2], in_dims[3], out_dims[1], out_dims[2], out_dims[3],
+                     filter_dims[1], filter_dims[2], p.pad_top, p.pad_left, p.stride_h, p.stride_w,
+                     multiplier, p.activation);
+        return true;
+    }
+    case OperationType::AVERAGE_POOL_2D:
+    case OperationType::MAX_POOL_2D:
+    {
+        const std::vector<uint32_t> in_dims = reader.getDimensions(ins[0]);
+        const bool is_explicit = ins.size() >= 10;
+        const size_t layout_index = is_explicit ? 10 : 7;
+        if (ins.size() > layout_index && reader.getBool(ins[layout_index]))
+        {
+            return false;   // NCHW
+        }
+
+        WindowParam p;
+        int filter_w, filter_h;
+        if (is_explicit)
+        {
+            p.pad_left   = reader.getInt32(ins[1]);
+            p.pad_top    = reader.getInt32(ins[3]);
+            p.stride_w   = reader.getInt32(ins[5]);
+            p.stride_h   = reader.getInt32(ins[6]);
+            filter_w     = reader.getInt32(ins[7]);
+            filter_h     = reader.getInt32(ins[8]);
+            p.activation = reader.getInt32(ins[9]);
+        }
+        else
+        {
+            filter_w     = reader.getInt32(ins[4]);
+            filter_h     = reader.getInt32(ins[5]);
+            implicitWindowParam(reader, ins[1], ins[2], ins[3], in_dims, filter_h, filter_w, p);
+            p.activation = reader.getInt32(ins[6]);
+        }
+
+        std::vector<float> in = readTensor(reader, ins[0]);
+        poolCpu(in.data(), expected.data(), in_dims[0], in_dims[1], in_dims[2], in_dims[3],
+                out_dims[1], out_dims[2], filter_h, filter_w, p.pad_top, p.pad_left, p.stride_h, p.stride_w,
+                operation.type == OperationType::MAX_POOL_2D, p.activation);
+        return true;
+    }
+    case OperationType::CONCATENATION:
+    {
+        const size_t num = ins.size() - 1;
+        const int rank = out_dims.size();
+        int axis = reader.getInt32(ins[num]);
+        if (axis < 0)
+        {
+            axis += rank;
+        }
+
+        int outer = 1;
+        int inner = 1;
+        for (int d = 0; d < rank; ++d)
+        {
+            if (d < axis)
+                outer *= out_dims[d];
+            else if (d > axis)
+                inner *= out_dims[d];
+        }
+
+        std::vector<std::vector<float>> buffers(num);
+        std::vector<const float*> in_ptrs(num);
+        std::vector<int> axis_sizes(num);
+        for (size_t i = 0; i < num; ++i)
+        {
+            buffers[i] = readTensor(reader, ins[i]);
+            in_ptrs[i] = buffers[i].data();
+            axis_sizes[i] = reader.getDimensions(ins[i])[axis];
+        }
+        concatCpu(in_ptrs, axis_sizes, expected.data(), outer, inner);
+        return true;
+    }
+    case OperationType::SOFTMAX:
+    {
+        const int depth = out_dims.back();
+        if (ins.size() > 2)
+        {
+            const int axis = reader.getInt32(ins[2]);
+            if (axis != -1 && axis != static_cast<int>(out_dims.size()) - 1)
+            {
+                return false;
+            }
+        }
+
+        std::vector<float> in = readTensor(reader, ins[0]);
+        softmaxCpu(in.data(), expected.data(), expected.size() / depth, depth, reader.getFloat32(ins[1]));
+        return true;
+    }
+    case OperationType::LOCAL_RESPONSE_NORMALIZATION:
+    {
+        const int depth = out_dims.back();
+        if (ins.size() > 5)
+        {
+            const int axis = reader.getInt32(ins[5]);
+            if (axis != -1 && axis != static_cast<int>(out_dims.size()) - 1)
+            {
+                return false;
+            }
+        }
+
+        std::vector<float> in = readTensor(reader, ins[0]);
+        lrnCpu(in.data(), expected.data(), expected.size() / depth, depth, reader.getInt32(ins[1]),
+               reader.getFloat32(ins[2]), reader.getFloat32(ins[3]), reader.getFloat32(ins[4]));
+        return true;
+    }
+    case OperationType::LOGISTIC:
+    {
+        std::vector<float> in = readTensor(reader, ins[0]);
+        logisticCpu(in.data(), expected.data(), expected.size());
+        return true;
+    }
+    case OperationType::RELU:
+    case OperationType::RELU1:
+    case OperationType::RELU6:
+    case OperationType::TANH:
+    {
+        const int type = operation.type == OperationType::RELU  ? kActivationRelu  :
+                         operation.type == OperationType::RELU1 ? kActivationRelu1 :
+                         operation.type == OperationType::RELU6 ? kActivationRelu6 : kActivationTanh;
+        std::vector<float> in = readTensor(reader, ins[0]);
+        activationCpu(in.data(), expected.data(), expected.size(), type);
+        return true;
+    }
+    case OperationType::RESHAPE:
+    {
+        reader.readTensor(ins[0], expected.data(), expected.size());
+        return true;
+    }
+    case OperationType::FULLY_CONNECTED:
+    {
+        const std::vector<uint32_t> weights_dims = reader.getDimensions(ins[1]);
+        const int num_units  = weights_dims[0];
+        const int input_size = weights_dims[1];
+
+        std::vector<float> in = readTensor(reader, ins[0]);
+        std::vector<float> weights = readTensor(reader, ins[1]);
+        std::vector<float> bias = readTensor(reader, ins[2]);
+        fullyConnectedCpu(in.data(), weights.data(), bias.data(), expected.data(),
+                          in.size() / input_size, input_size, num_units, reader.getInt32(ins[3]));
+        return true;
+    }
+    case OperationType::RESIZE_BILINEAR:
+    {
+        const std::vector<uint32_t> in_dims = reader.getDimensions(ins[0]);
+        std::vector<float> in = readTensor(reader, ins[0]);
+        resizeBilinearCpu(in.data(), expected.data(), in_dims[0], in_dims[1], in_dims[2],
+                          out_dims[1], out_dims[2], in_dims[3]);
+        return true;
+    }
+    case OperationType::L2_NORMALIZATION:
+    {
+        const int depth = out_dims.back();
+        std::vector<float> in = readTensor(reader, ins[0]);
+        l2NormCpu(in.data(), expected.data(), depth, expected.size() / depth);
+        return true;
+    }
+    case OperationType::MEAN:
+    {
+        const std::vector<uint32_t> in_dims = reader.getDimensions(ins[0]);
+        const int rank = in_dims.size();
+        const size_t axes_count = getElementCount(reader.getDimensions(ins[1]));
+
+        std::vector<bool> reduced(rank, false);
+        for (size_t i = 0; i < axes_count; ++i)
+        {
+            int axis = reader.getInt32(ins[1], i);
+            reduced[axis < 0 ? axis + rank : axis] = true;
+        }
+
+        std::vector<float> in = readTensor(reader, ins[0]);
+        meanCpu(in.data(), expected.data(), in_dims, reduced);
+        return true;
+    }
+    default:
+        break;
+    }
+
+    return false;
+}
+
+NAME_SPACE_STOP
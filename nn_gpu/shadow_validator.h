@@ -0,0 +1,134 @@
+#ifndef ANDROID_HARDWARE_NEURALNETWORKS_V1_2_SHADOW_VALIDATOR_H
+#define ANDROID_HARDWARE_NEURALNETWORKS_V1_2_SHADOW_VALIDATOR_H
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+#include "base_executor.h"
+
+NAME_SPACE_BEGIN
+
+// elements compared by one task of parallelFor
+#define SHADOW_COMPARE_CHUNK 65536
+
+struct ShadowStats
+{
+    ShadowStats() :
+        count(0), mismatch_count(0), first_mismatch(SIZE_MAX),
+        nan_count(0), inf_count(0), max_abs_error(0.f), max_rel_error(0.f)
+    {};
+
+    bool passed() const { return mismatch_count == 0 && nan_count == 0 && inf_count == 0; }
+    void merge(const ShadowStats& other);
+
+    size_t count;
+    size_t mismatch_count;
+    size_t first_mismatch;
+    size_t nan_count;         // of the gpu output
+    size_t inf_count;         // of the gpu output
+    float max_abs_error;
+    float max_rel_error;
+};
+
+// backend independent access to the operands of an executor
+class ShadowOperandReader
+{
+public:
+    virtual ~ShadowOperandReader() {}
+    virtual std::vector<uint32_t> getDimensions(uint32_t index) = 0;
+    virtual void readTensor(uint32_t index, float* buf, size_t count) = 0;
+    virtual int32_t getInt32(uint32_t index, uint32_t idx = 0) = 0;
+    virtual float getFloat32(uint32_t index) = 0;
+    virtual bool getBool(uint32_t index) = 0;
+};
+
+template <typename OperandType_>
+class ShadowOperandAdapter : public ShadowOperandReader
+{
+public:
+    ShadowOperandAdapter(const Model& m, std::vector<OperandType_>& ops) : model(m), operands(ops) {}
+
+    std::vector<uint32_t> getDimensions(uint32_t index) override
+    {
+        std::vector<uint32_t> dims(operands[index].getNumberOfDimensions());
+        for (size_t i = 0; i < dims.size(); ++i)
+        {
+            dims[i] = operands[index].getDimensionSize(i);
+        }
+        return dims;
+    }
+
+    void readTensor(uint32_t index, float* buf, size_t count) override
+    {
+        const Operand& from = model.operands[index];
+        if (from.lifetime == OperandLifeTime::CONSTANT_COPY)
+        {
+            memcpy(buf, &model.operandValues[from.location.offset], count * sizeof(float));
+        }
+        else
+        {
+            operands[index].copyToBuffer(buf, count);
+        }
+    }
+
+    int32_t getInt32(uint32_t index, uint32_t idx) override
+    {
+        return operands[index].template getScalarData<int32_t>(idx);
+    }
+
+    float getFloat32(uint32_t index) override
+    {
+        return operands[index].template getScalarData<float>();
+    }
+
+    bool getBool(uint32_t index) override
+    {
+        return operands[index].template getScalarData<uint8_t>() != 0;
+    }
+
+private:
+    const Model& model;
+    std::vector<OperandType_>& operands;
+};
+
+// Shadow validation mode, enabled by nn.gpgpu.shadow:
+//   1: every operation output is read back and compared against the cpu reference
+//      computed from the gpu inputs of the same operation, divergences are logged
+//   2: additionally log the statistics of the operations which passed
+class ShadowValidator
+{
+public:
+    ShadowValidator(const Model& m) : model(m), firstDiverged(-1), divergedCount(0) {}
+
+    static int getLevel();
+    static bool enabled() { return getLevel() > 0; }
+
+    void beginRun();
+    void endRun();
+
+    // returns false when the gpu output diverges from the cpu reference,
+    // operations without cpu reference are treated as passed
+    bool validate(uint32_t opIndex, const std::string& opName,
+                  const Operation& operation, ShadowOperandReader& reader);
+
+    static void compare(const float* actual, const float* expected, size_t count, ShadowStats& stats);
+
+    // compares the elements [begin, end) on the calling thread, the whole groups of 4 take
+    // the SSE path when use_simd is set and the build has it
+    static void compareRange(const float* actual, const float* expected, size_t begin, size_t end,
+                             ShadowStats& stats, bool use_simd = true);
+
+private:
+    bool computeReference(const Operation& operation, ShadowOperandReader& reader,
+                          std::vector<float>& expected);
+
+    const Model& model;
+    int firstDiverged;
+    std::string firstDivergedName;
+    uint32_t divergedCount;
+};
+
+NAME_SPACE_STOP
+
+#endif
@@ -0,0 +1,327 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Throughput and latency of the BatchScheduler against executing the requests one by one.
+// Requests for a fully connected model arrive at a fixed rate (open loop) and the latency is
+// taken from the arrival of each request to its completion, so the cost of waiting for the
+// batch window is part of it. A maximum batch of 1 runs every request alone on the scheduler
+// thread, which is the baseline.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "../batch_scheduler.h"
+#include "../executor_manager.h"
+
+NAME_SPACE_BEGIN
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+// requests of one measurement, at every arrival rate
+const int kRequests = 512;
+
+void appendValue(Model& model, const void* data, size_t size, Operand& operand)
+{
+    operand.lifetime = OperandLifeTime::CONSTANT_COPY;
+    operand.location = { .poolIndex = 0,
+                         .offset = (uint32_t)model.operandValues.size(),
+                         .length = (uint32_t)size };
+
+    std::vector<uint8_t> values(model.operandValues.begin(), model.operandValues.end());
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    values.insert(values.end(), bytes, bytes + size);
+    model.operandValues = values;
+}
+
+Operand makeOperand(OperandType type, const std::vector<uint32_t>& dims, OperandLifeTime lifetime)
+{
+    Operand operand = {};
+    operand.type = type;
+    operand.dimensions = dims;
+    operand.numberOfConsumers = 0;
+    operand.lifetime = lifetime;
+    return operand;
+}
+
+// output[1, units] = relu(input[1, depth] * weights[units, depth]' + bias[units])
+Model makeFullyConnectedModel(uint32_t depth, uint32_t units)
+{
+    Model model = {};
+    std::vector<Operand> operands;
+
+    operands.push_back(makeOperand(OperandType::TENSOR_FLOAT32, {1, depth}, OperandLifeTime::MODEL_INPUT));
+    operands.push_back(makeOperand(OperandType::TENSOR_FLOAT32, {units, depth}, OperandLifeTime::CONSTANT_COPY));
+    operands.push_back(makeOperand(OperandType::TENSOR_FLOAT32, {units}, OperandLifeTime::CONSTANT_COPY));
+    operands.push_back(makeOperand(OperandType::INT32, {}, OperandLifeTime::CONSTANT_COPY));
+    operands.push_back(makeOperand(OperandType::TENSOR_FLOAT32, {1, units}, OperandLifeTime::MODEL_OUTPUT));
+    operands[0].numberOfConsumers = 1;
+    operands[1].numberOfConsumers = 1;
+    operands[2].numberOfConsumers = 1;
+    operands[3].numberOfConsumers = 1;
+
+    std::vector<float> weights(units * depth);
+    for (size_t i = 0; i < weights.size(); ++i)
+    {
+        weights[i] = (float)((i * 7919) % 255) / 255.f - 0.5f;
+    }
+    std::vector<float> bias(units, 0.25f);
+    int32_t activation = static_cast<int32_t>(FusedActivationFunc::RELU);
+
+    appendValue(model, weights.data(), weights.size() * sizeof(float), operands[1]);
+    appendValue(model, bias.data(), bias.size() * sizeof(float), operands[2]);
+    appendValue(model, &activation, sizeof(activation), operands[3]);
+
+    Operation operation = {};
+    operation.type = OperationType::FULLY_CONNECTED;
+    operation.inputs = {0, 1, 2, 3};
+    operation.outputs = {4};
+
+    model.operands = operands;
+    model.operations = {operation};
+    model.inputIndexes = {0};
+    model.outputIndexes = {4};
+    return model;
+}
+
+// one shared memory per request, the input then the output
+bool makeRequests(uint32_t depth, uint32_t units, std::vector<Request>& requests)
+{
+    sp<IAllocator> allocator = IAllocator::getService("ashmem");
+    if (allocator == nullptr)
+    {
+        LOGE("batch benchmark: ashmem allocator is not available");
+        return false;
+    }
+
+    const uint32_t inputSize = depth * sizeof(float);
+    const uint32_t outputSize = units * sizeof(float);
+    for (auto& request : requests)
+    {
+        hidl_memory memory;
+        allocator->allocate(inputSize + outputSize, [&](bool success, const hidl_memory& mem) {
+            if (success)
+            {
+                memory = mem;
+            }
+        });
+        sp<IMemory> mapped = mapMemory(memory);
+        if (mapped == nullptr)
+        {
+            LOGE("batch benchmark: failed to allocate the request memory");
+            return false;
+        }
+
+        mapped->update();
+        float* input = reinterpret_cast<float*>(static_cast<void*>(mapped->getPointer()));
+        for (uint32_t i = 0; i < depth; ++i)
+        {
+            input[i] = (float)(i % 17) / 17.f;
+        }
+        mapped->commit();
+
+        request.pools = {memory};
+        request.inputs = {{ .hasNoValue = false,
+                            .location = { .poolIndex = 0, .offset = 0, .length = inputSize },
+                            .dimensions = {} }};
+        request.outputs = {{ .hasNoValue = false,
+                             .location = { .poolIndex = 0, .offset = inputSize, .length = outputSize },
+                             .dimensions = {} }};
+    }
+    return true;
+}
+
+class Completions
+{
+public:
+    explicit Completions(size_t count) : latencyUs(count), remaining(0), failures(0) {}
+
+    void start(int count)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        remaining = count;
+    }
+
+    BatchScheduler::Completion callback(int index, clock_type::time_point arrival)
+    {
+        return [this, index, arrival](bool succ) {
+            latencyUs[index] = std::chrono::duration_cast<std::chrono::microseconds>(
+                                   clock_type::now() - arrival).count();
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!succ)
+            {
+                failures++;
+            }
+            if (--remaining == 0)
+            {
+                cv.notify_one();
+            }
+        };
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this]{ return remaining == 0; });
+    }
+
+    std::vector<long> latencyUs;
+    int remaining;
+    int failures;
+
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+// the model is prepared once, the batched models once per benchmark
+struct FullyConnected
+{
+    static const uint32_t kDepth = 1024;
+    static const uint32_t kUnits = 1024;
+
+    FullyConnected() : model(makeFullyConnectedModel(kDepth, kUnits)), requests(kRequests), ready(false)
+    {
+        exec = ExecutorManager::createExecutor(model);
+        ready = exec != nullptr && exec->initPerModel() && makeRequests(kDepth, kUnits, requests);
+    }
+
+    ~FullyConnected()
+    {
+        if (exec != nullptr)
+        {
+            exec->deinitPerModel();
+        }
+    }
+
+    Model model;
+    sp<BaseExecutor> exec;
+    std::vector<Request> requests;
+    bool ready;
+};
+
+// created by main() between the per process init and deinit of the executors
+FullyConnected* fullyConnected = nullptr;
+
+long percentile(std::vector<long> values, float p)
+{
+    size_t index = std::min(values.size() - 1, (size_t)(values.size() * p));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// range(0): the maximum batch, range(1): the arrival rate in requests per second
+void BM_FullyConnected(benchmark::State& state)
+{
+    FullyConnected& fc = *fullyConnected;
+    if (!fc.ready)
+    {
+        state.SkipWithError("failed to prepare the model");
+        return;
+    }
+
+    BatchConfig config;
+    config.maxBatch = state.range(0);
+    config.windowUs = 2000;
+    config.sloUs = 0;
+    const auto interval = std::chrono::microseconds(1000000 / state.range(1));
+
+    BatchScheduler scheduler(fc.model, fc.exec.get(), config);
+    Completions completions(kRequests);
+
+    // prepare the batched models before measuring, one burst per padded batch size
+    for (int size = 2; size <= config.maxBatch; size <<= 1)
+    {
+        completions.start(size);
+        for (int i = 0; i < size; ++i)
+        {
+            scheduler.submit(fc.requests[i], completions.callback(i, clock_type::now()));
+        }
+        completions.wait();
+    }
+
+    std::vector<long> latencyUs;
+    double seconds = 0;
+    int failures = 0;
+    for (auto _ : state)
+    {
+        completions.start(kRequests);
+        clock_type::time_point start = clock_type::now();
+        for (int i = 0; i < kRequests; ++i)
+        {
+            clock_type::time_point arrival = start + interval * i;
+            std::this_thread::sleep_until(arrival);
+            scheduler.submit(fc.requests[i], completions.callback(i, arrival));
+        }
+        completions.wait();
+
+        seconds += std::chrono::duration<double>(clock_type::now() - start).count();
+        latencyUs.insert(latencyUs.end(), completions.latencyUs.begin(), completions.latencyUs.end());
+        failures += completions.failures;
+        completions.failures = 0;
+    }
+
+    if (failures > 0)
+    {
+        state.SkipWithError("executions failed");
+        return;
+    }
+
+    state.SetItemsProcessed(latencyUs.size());
+    state.counters["requests/s"] = latencyUs.size() / seconds;
+    state.counters["p50_ms"] = percentile(latencyUs, 0.5f) / 1000.;
+    state.counters["p99_ms"] = percentile(latencyUs, 0.99f) / 1000.;
+    state.counters["max_ms"] = *std::max_element(latencyUs.begin(), latencyUs.end()) / 1000.;
+}
+
+}  // namespace
+
+BENCHMARK(BM_FullyConnected)
+    ->ArgNames({"max_batch", "rate"})
+    ->ArgsProduct({{1, 2, 4, 8}, {100, 400, 1600, 6400}})
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+NAME_SPACE_STOP
+
+int main(int argc, char** argv)
+{
+    using namespace android::hardware::neuralnetworks::V1_2::implementation;
+
+    if (!ExecutorManager::initPerProcess())
+    {
+        LOGE("batch benchmark: no executor is available");
+        return 1;
+    }
+
+    benchmark::Initialize(&argc, argv);
+    fullyConnected = new FullyConnected();
+    benchmark::RunSpecifiedBenchmarks();
+    delete fullyConnected;
+
+    ExecutorManager::deinitPerProcess();
+    return 0;
+}
@@ -0,0 +1,589 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Comparison statistics of the shadow validation mode, the CPU reference kernels it checks the
+// operations against, and the blacklisting of the CONV_2D tuning configs which diverge. The
+// operands are fakes holding float data, so no vulkan device is needed.
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../cpu_reference.h"
+#include "../shadow_validator.h"
+#include "../vulkan/vk_cs_executor.h"
+
+NAME_SPACE_BEGIN
+
+namespace {
+
+// kAbsTolerance and kRelTolerance of the validator, an element mismatches when
+// |actual - expected| > kAbsTolerance + kRelTolerance * |expected|
+const float kAbsTolerance = 1.e-3f;
+const float kRelTolerance = 1.e-3f;
+
+std::vector<float> randomData(size_t count, float min, float max, uint32_t seed = 1)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(min, max);
+    std::vector<float> data(count);
+    for (auto& v : data)
+    {
+        v = dist(rng);
+    }
+    return data;
+}
+
+void expectSameStats(const ShadowStats& a, const ShadowStats& b)
+{
+    EXPECT_EQ(a.count, b.count);
+    EXPECT_EQ(a.mismatch_count, b.mismatch_count);
+    EXPECT_EQ(a.first_mismatch, b.first_mismatch);
+    EXPECT_EQ(a.nan_count, b.nan_count);
+    EXPECT_EQ(a.inf_count, b.inf_count);
+    EXPECT_EQ(a.max_abs_error, b.max_abs_error);
+    EXPECT_EQ(a.max_rel_error, b.max_rel_error);
+}
+
+void expectNear(const std::vector<float>& actual, const std::vector<float>& expected)
+{
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); ++i)
+    {
+        ASSERT_NEAR(actual[i], expected[i], 1.e-5f + 1.e-5f * fabsf(expected[i])) << "at index " << i;
+    }
+}
+
+// every pair of elements below is exactly at or just past the tolerance, so both the SSE groups
+// and the scalar tail see each case
+TEST(ShadowCompareTest, ToleranceBoundaries)
+{
+    std::vector<float> expected;
+    std::vector<float> at_bound;
+    std::vector<float> past_bound;
+    for (float e : {0.f, 1000.f, -1000.f, 0.f, 1000.f, -1000.f, 0.f, 1000.f, -1000.f})
+    {
+        const float bound = kAbsTolerance + kRelTolerance * fabsf(e);
+        const float sign = e < 0.f ? -1.f : 1.f;
+        expected.push_back(e);
+        at_bound.push_back(e == 0.f ? bound : e + sign * 1.f);
+        past_bound.push_back(e == 0.f ? nextafterf(bound, 1.f) : e + sign * 1.5f);
+    }
+
+    for (bool use_simd : {true, false})
+    {
+        ShadowStats stats;
+        ShadowValidator::compareRange(at_bound.data(), expected.data(), 0, expected.size(), stats, use_simd);
+        EXPECT_TRUE(stats.passed()) << "simd " << use_simd;
+        EXPECT_EQ(stats.count, expected.size());
+        EXPECT_EQ(stats.first_mismatch, SIZE_MAX);
+        EXPECT_FLOAT_EQ(stats.max_abs_error, 1.f);
+
+        stats = ShadowStats();
+        ShadowValidator::compareRange(past_bound.data(), expected.data(), 0, expected.size(), stats, use_simd);
+        EXPECT_FALSE(stats.passed()) << "simd " << use_simd;
+        EXPECT_EQ(stats.mismatch_count, expected.size());
+        EXPECT_EQ(stats.first_mismatch, 0u);
+        EXPECT_EQ(stats.nan_count, 0u);
+        EXPECT_EQ(stats.inf_count, 0u);
+    }
+}
+
+TEST(ShadowCompareTest, CountsNanAndInf)
+{
+    std::vector<float> expected = randomData(11, -1.f, 1.f);
+    std::vector<float> actual = expected;
+    actual[1]  = NAN;
+    actual[4]  = INFINITY;
+    actual[6]  = -INFINITY;
+    actual[9]  = NAN;
+    actual[10] = INFINITY;
+
+    for (bool use_simd : {true, false})
+    {
+        ShadowStats stats;
+        ShadowValidator::compareRange(actual.data(), expected.data(), 0, actual.size(), stats, use_simd);
+        EXPECT_EQ(stats.nan_count, 2u) << "simd " << use_simd;
+        EXPECT_EQ(stats.inf_count, 3u) << "simd " << use_simd;
+        EXPECT_EQ(stats.mismatch_count, 5u) << "simd " << use_simd;
+        EXPECT_EQ(stats.first_mismatch, 1u) << "simd " << use_simd;
+        EXPECT_EQ(stats.max_abs_error, INFINITY) << "simd " << use_simd;
+        EXPECT_FALSE(stats.passed());
+    }
+
+    // inf alone fails the validation, even against an inf reference
+    std::vector<float> inf(4, INFINITY);
+    ShadowStats stats;
+    ShadowValidator::compare(inf.data(), inf.data(), inf.size(), stats);
+    EXPECT_EQ(stats.mismatch_count, 0u);
+    EXPECT_EQ(stats.inf_count, 4u);
+    EXPECT_FALSE(stats.passed());
+}
+
+TEST(ShadowCompareTest, FirstMismatchAcrossGroupAndChunkBoundaries)
+{
+    const size_t count = 2 * SHADOW_COMPARE_CHUNK + 7;
+    const std::vector<float> expected = randomData(count, -4.f, 4.f);
+
+    for (size_t first : {size_t(0), size_t(3), size_t(4), size_t(5),
+                         size_t(SHADOW_COMPARE_CHUNK - 1), size_t(SHADOW_COMPARE_CHUNK),
+                         size_t(SHADOW_COMPARE_CHUNK + 1), size_t(2 * SHADOW_COMPARE_CHUNK + 3),
+                         count - 1})
+    {
+        // a nan right after it, in the same group of 4 or the next one, and a mismatch at the end
+        std::vector<float> actual = expected;
+        std::set<size_t> mismatches = {first, count - 1};
+        actual[first] += 1.f;
+        if (first + 1 < count - 1)
+        {
+            actual[first + 1] = NAN;
+            mismatches.insert(first + 1);
+        }
+        actual[count - 1] = expected[count - 1] - 1.f;
+
+        ShadowStats stats;
+        ShadowValidator::compare(actual.data(), expected.data(), count, stats);
+        EXPECT_EQ(stats.count, count);
+        EXPECT_EQ(stats.first_mismatch, first);
+        EXPECT_EQ(stats.mismatch_count, mismatches.size()) << "first " << first;
+        EXPECT_FLOAT_EQ(stats.max_abs_error, 1.f);
+    }
+
+    std::vector<float> same = expected;
+    ShadowStats stats;
+    ShadowValidator::compare(same.data(), expected.data(), count, stats);
+    EXPECT_TRUE(stats.passed());
+    EXPECT_EQ(stats.first_mismatch, SIZE_MAX);
+    EXPECT_EQ(stats.max_abs_error, 0.f);
+}
+
+TEST(ShadowCompareTest, SimdAndScalarPathsAgree)
+{
+    const size_t count = 1003;
+    const std::vector<float> expected = randomData(count, -100.f, 100.f, 2);
+    std::vector<float> actual = expected;
+
+    // small errors within the tolerance everywhere, some mismatches, nan and inf
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> noise(-5.e-4f, 5.e-4f);
+    std::uniform_int_distribution<size_t> pick(0, count - 1);
+    for (auto& v : actual)
+    {
+        v += noise(rng);
+    }
+    for (int i = 0; i < 20; ++i)
+    {
+        actual[pick(rng)] += 0.5f;
+    }
+    actual[pick(rng)] = NAN;
+    actual[pick(rng)] = -INFINITY;
+
+    // ranges starting and ending inside a group of 4 too
+    for (size_t begin : {size_t(0), size_t(1), size_t(6)})
+    {
+        for (size_t end : {count, count - 2, size_t(501)})
+        {
+            ShadowStats simd;
+            ShadowStats scalar;
+            ShadowValidator::compareRange(actual.data(), expected.data(), begin, end, simd, true);
+            ShadowValidator::compareRange(actual.data(), expected.data(), begin, end, scalar, false);
+            SCOPED_TRACE(testing::Message() << "range " << begin << " " << end);
+            expectSameStats(simd, scalar);
+        }
+    }
+
+    ShadowStats whole;
+    ShadowStats range;
+    ShadowValidator::compare(actual.data(), expected.data(), count, whole);
+    ShadowValidator::compareRange(actual.data(), expected.data(), 0, count, range, false);
+    expectSameStats(whole, range);
+}
+
+// operands of an operation held in memory, with the interface of VkOperand the adapter needs
+struct FakeOperand
+{
+    std::vector<uint32_t> dims;
+    std::vector<float> data;
+    std::vector<int32_t> ints;
+    float scalar = 0.f;
+
+    uint32_t getNumberOfDimensions() const { return dims.size(); }
+    uint32_t getDimensionSize(uint32_t i) const { return dims[i]; }
+    void copyToBuffer(float* buf, size_t count) const { memcpy(buf, data.data(), count * sizeof(float)); }
+
+    template <typename T>
+    T getScalarData(uint32_t idx = 0) const
+    {
+        return std::is_same<T, float>::value ? static_cast<T>(scalar) : static_cast<T>(ints[idx]);
+    }
+};
+
+// CONV_2D with explicit padding, 2x9x11x5 input, 7 filters of 3x3, stride 2x1 and relu
+class ShadowConvTest : public ::testing::Test
+{
+protected:
+    enum { B = 2, H = 9, W = 11, C = 5, OC = 7, FH = 3, FW = 3, SH = 2, SW = 1, PT = 1, PL = 2 };
+    enum { OH = (H + 2 * PT - FH) / SH + 1, OW = (W + 2 * PL - FW) / SW + 1 };
+    enum { kOutput = 10, kOperandCount = 11 };
+
+    ShadowConvTest() : operands(kOperandCount), reader(model, operands), validator(model)
+    {
+        model.operands.resize(kOperandCount);
+        for (size_t i = 0; i < kOperandCount; ++i)
+        {
+            model.operands[i].type = i < 3 || i == kOutput ? OperandType::TENSOR_FLOAT32 : OperandType::INT32;
+            model.operands[i].lifetime = OperandLifeTime::TEMPORARY_VARIABLE;
+        }
+
+        operands[0].dims = {B, H, W, C};
+        operands[0].data = randomData(B * H * W * C, -1.f, 1.f, 4);
+        operands[1].dims = {OC, FH, FW, C};
+        operands[1].data = randomData(OC * FH * FW * C, -1.f, 1.f, 5);
+        operands[2].dims = {OC};
+        operands[2].data = randomData(OC, -1.f, 1.f, 6);
+
+        const int32_t scalars[] = {PL, PL, PT, PT, SW, SH, kActivationRelu};
+        for (int i = 0; i < 7; ++i)
+        {
+            operands[3 + i].ints = {scalars[i]};
+        }
+
+        operands[kOutput].dims = {B, OH, OW, OC};
+        operands[kOutput].data = naiveConv();
+
+        conv.type = OperationType::CONV_2D;
+        conv.inputs = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+        conv.outputs = {kOutput};
+    }
+
+    std::vector<float> naiveConv() const
+    {
+        std::vector<float> out(B * OH * OW * OC);
+        for (int b = 0; b < B; ++b)
+            for (int y = 0; y < OH; ++y)
+                for (int x = 0; x < OW; ++x)
+                    for (int o = 0; o < OC; ++o)
+                    {
+                        float sum = operands[2].data[o];
+                        for (int fy = 0; fy < FH; ++fy)
+                            for (int fx = 0; fx < FW; ++fx)
+                            {
+                                const int iy = y * SH - PT + fy;
+                                const int ix = x * SW - PL + fx;
+                                if (iy < 0 || iy >= H || ix < 0 || ix >= W)
+                                    continue;
+                                for (int c = 0; c < C; ++c)
+                                    sum += operands[0].data[((b * H + iy) * W + ix) * C + c] *
+                                           operands[1].data[((o * FH + fy) * FW + fx) * C + c];
+                            }
+                        out[((b * OH + y) * OW + x) * OC + o] = std::max(sum, 0.f);
+                    }
+        return out;
+    }
+
+    Model model;
+    std::vector<FakeOperand> operands;
+    ShadowOperandAdapter<FakeOperand> reader;
+    ShadowValidator validator;
+    Operation conv;
+};
+
+TEST_F(ShadowConvTest, ValidatesAgainstTheReference)
+{
+    validator.beginRun();
+    EXPECT_TRUE(validator.validate(0, "CONV_2D", conv, reader));
+
+    operands[kOutput].data[17] += 0.1f;
+    EXPECT_FALSE(validator.validate(1, "CONV_2D", conv, reader));
+
+    operands[kOutput].data[17] = NAN;
+    EXPECT_FALSE(validator.validate(2, "CONV_2D", conv, reader));
+    validator.endRun();
+}
+
+TEST_F(ShadowConvTest, DivergingConvBlacklistsItsConfig)
+{
+    const std::string sig = "shadow_test_diverging_conv";
+    const std::string config = "type5_lsz1_64_1_block8_4_1";
+    const std::string retuned = "type1_lsz4_64_1_block1_1_1";
+    VkCsExecutor::storeConvConfig(sig, config);
+
+    operands[kOutput].data[3] -= 1.f;
+    EXPECT_FALSE(VkCsExecutor::shadowValidate(validator, 0, "CONV_2D", conv, reader, sig, config));
+
+    // the cached config is gone and the tuning skips it from now on, but not the other candidates
+    std::string found;
+    EXPECT_FALSE(VkCsExecutor::findConvConfig(sig, found));
+    EXPECT_TRUE(VkCsExecutor::isConvConfigBlacklisted(sig, config));
+    EXPECT_FALSE(VkCsExecutor::isConvConfigBlacklisted(sig, retuned));
+    EXPECT_FALSE(VkCsExecutor::isConvConfigBlacklisted("shadow_test_other_conv", config));
+
+    // a config tuned since then is not dropped by a late blacklisting of the old one
+    VkCsExecutor::storeConvConfig(sig, retuned);
+    VkCsExecutor::blacklistConvConfig(sig, config);
+    ASSERT_TRUE(VkCsExecutor::findConvConfig(sig, found));
+    EXPECT_EQ(found, retuned);
+}
+
+TEST_F(ShadowConvTest, PassingConvKeepsItsConfig)
+{
+    const std::string sig = "shadow_test_passing_conv";
+    const std::string config = "type5_lsz1_24_1_block8_4_1";
+    VkCsExecutor::storeConvConfig(sig, config);
+
+    EXPECT_TRUE(VkCsExecutor::shadowValidate(validator, 0, "CONV_2D", conv, reader, sig, config));
+
+    std::string found;
+    ASSERT_TRUE(VkCsExecutor::findConvConfig(sig, found));
+    EXPECT_EQ(found, config);
+    EXPECT_FALSE(VkCsExecutor::isConvConfigBlacklisted(sig, config));
+}
+
+TEST_F(ShadowConvTest, OnlyConvBlacklists)
+{
+    const std::string sig = "shadow_test_relu";
+    const std::string config = "type5_lsz1_16_1_block8_4_1";
+    VkCsExecutor::storeConvConfig(sig, config);
+
+    // a diverging RELU after a convolution leaves the config of the convolution alone
+    operands[kOutput].dims = operands[0].dims;
+    operands[kOutput].data.resize(operands[0].data.size());
+    for (size_t i = 0; i < operands[0].data.size(); ++i)
+    {
+        operands[kOutput].data[i] = std::max(operands[0].data[i], 0.f) + (i == 7 ? 1.f : 0.f);
+    }
+
+    Operation relu;
+    relu.type = OperationType::RELU;
+    relu.inputs = {0};
+    relu.outputs = {kOutput};
+    EXPECT_FALSE(VkCsExecutor::shadowValidate(validator, 1, "RELU", relu, reader, sig, config));
+
+    std::string found;
+    EXPECT_TRUE(VkCsExecutor::findConvConfig(sig, found));
+    EXPECT_FALSE(VkCsExecutor::isConvConfigBlacklisted(sig, config));
+
+    // nor does a convolution which did not come from the tuning cache
+    operands[kOutput].dims = {B, OH, OW, OC};
+    operands[kOutput].data = naiveConv();
+    operands[kOutput].data[0] += 1.f;
+    EXPECT_FALSE(VkCsExecutor::shadowValidate(validator, 2, "CONV_2D", conv, reader, "", ""));
+    EXPECT_TRUE(VkCsExecutor::findConvConfig(sig, found));
+}
+
+// pool, concat, softmax, lrn and depthwise references against the plain loops of their definition
+
+TEST(CpuReferenceTest, Pool)
+{
+    const int batch = 2, in_h = 9, in_w = 11, channels = 5, filter_h = 3, filter_w = 4;
+    const int pad_top = 1, pad_left = 2, stride_h = 2, stride_w = 3;
+    const int out_h = (in_h + 2 * pad_top - filter_h) / stride_h + 1;
+    const int out_w = (in_w + 2 * pad_left - filter_w) / stride_w + 1;
+    const std::vector<float> in = randomData(batch * in_h * in_w * channels, -8.f, 8.f);
+
+    for (bool is_max : {false, true})
+    {
+        for (int activation = 0; activation <= kActivationRelu6; ++activation)
+        {
+            std::vector<float> expected(batch * out_h * out_w * channels);
+            for (int b = 0; b < batch; ++b)
+                for (int y = 0; y < out_h; ++y)
+                    for (int x = 0; x < out_w; ++x)
+                        for (int c = 0; c < channels; ++c)
+                        {
+                            // the padding is not part of the average
+                            float sum = 0.f, max = -FLT_MAX;
+                            int count = 0;
+                            for (int fy = 0; fy < filter_h; ++fy)
+                                for (int fx = 0; fx < filter_w; ++fx)
+                                {
+                                    const int iy = y * stride_h - pad_top + fy;
+                                    const int ix = x * stride_w - pad_left + fx;
+                                    if (iy < 0 || iy >= in_h || ix < 0 || ix >= in_w)
+                                        continue;
+                                    const float v = in[((b * in_h + iy) * in_w + ix) * channels + c];
+                                    sum += v;
+                                    max = std::max(max, v);
+                                    count++;
+                                }
+                            const float v = is_max ? max : sum / count;
+                            expected[((b * out_h + y) * out_w + x) * channels + c] = applyActivation(v, activation);
+                        }
+
+            std::vector<float> out(expected.size());
+            poolCpu(in.data(), out.data(), batch, in_h, in_w, channels, out_h, out_w, filter_h, filter_w,
+                    pad_top, pad_left, stride_h, stride_w, is_max, activation);
+            SCOPED_TRACE(testing::Message() << "max " << is_max << " activation " << activation);
+            expectNear(out, expected);
+        }
+    }
+}
+
+TEST(CpuReferenceTest, Concat)
+{
+    // [2, 3, a, 4] along the axis 2 for a of 1, 5 and 2
+    const int outer = 2 * 3, inner = 4;
+    const std::vector<int> axis_sizes = {1, 5, 2};
+    const int out_axis = 8;
+
+    std::vector<std::vector<float>> ins;
+    std::vector<const float*> in_ptrs;
+    for (size_t i = 0; i < axis_sizes.size(); ++i)
+    {
+        ins.push_back(randomData(outer * axis_sizes[i] * inner, -1.f, 1.f, 10 + i));
+    }
+    for (const auto& in : ins)
+    {
+        in_ptrs.push_back(in.data());
+    }
+
+    std::vector<float> expected(outer * out_axis * inner);
+    for (int o = 0; o < outer; ++o)
+    {
+        int a_out = 0;
+        for (size_t i = 0; i < ins.size(); ++i)
+        {
+            for (int a = 0; a < axis_sizes[i]; ++a, ++a_out)
+            {
+                for (int n = 0; n < inner; ++n)
+                {
+                    expected[(o * out_axis + a_out) * inner + n] = ins[i][(o * axis_sizes[i] + a) * inner + n];
+                }
+            }
+        }
+    }
+
+    std::vector<float> out(expected.size());
+    concatCpu(in_ptrs, axis_sizes, out.data(), outer, inner);
+    EXPECT_EQ(out, expected);
+}
+
+TEST(CpuReferenceTest, Softmax)
+{
+    const int outer = 7, depth = 13;
+    const std::vector<float> in = randomData(outer * depth, -20.f, 20.f);
+
+    for (float beta : {1.f, 0.5f, 2.f})
+    {
+        std::vector<float> expected(in.size());
+        for (int o = 0; o < outer; ++o)
+        {
+            double sum = 0.0;
+            for (int i = 0; i < depth; ++i)
+            {
+                sum += exp(static_cast<double>(in[o * depth + i]) * beta);
+            }
+            for (int i = 0; i < depth; ++i)
+            {
+                expected[o * depth + i] = exp(static_cast<double>(in[o * depth + i]) * beta) / sum;
+            }
+        }
+
+        std::vector<float> out(in.size());
+        softmaxCpu(in.data(), out.data(), outer, depth, beta);
+        SCOPED_TRACE(testing::Message() << "beta " << beta);
+        expectNear(out, expected);
+    }
+}
+
+TEST(CpuReferenceTest, Lrn)
+{
+    const int outer = 6, depth = 11;
+    const std::vector<float> in = randomData(outer * depth, -3.f, 3.f);
+
+    for (int radius : {0, 2, 20})
+    {
+        const float bias = 1.f, alpha = 0.1f, beta = 0.75f;
+        std::vector<float> expected(in.size());
+        for (int o = 0; o < outer; ++o)
+        {
+            for (int c = 0; c < depth; ++c)
+            {
+                double sqr_sum = 0.0;
+                for (int i = c - radius; i <= c + radius; ++i)
+                {
+                    if (i >= 0 && i < depth)
+                    {
+                        sqr_sum += in[o * depth + i] * in[o * depth + i];
+                    }
+                }
+                expected[o * depth + c] = in[o * depth + c] / pow(bias + alpha * sqr_sum, beta);
+            }
+        }
+
+        std::vector<float> out(in.size());
+        lrnCpu(in.data(), out.data(), outer, depth, radius, bias, alpha, beta);
+        SCOPED_TRACE(testing::Message() << "radius " << radius);
+        expectNear(out, expected);
+    }
+}
+
+TEST(CpuReferenceTest, DepthwiseConv)
+{
+    const int batch = 2, in_h = 8, in_w = 7, in_c = 3, multiplier = 2, out_c = in_c * multiplier;
+    const int filter_h = 3, filter_w = 2, pad_top = 1, pad_left = 1, stride_h = 2, stride_w = 1;
+    const int out_h = (in_h + 2 * pad_top - filter_h) / stride_h + 1;
+    const int out_w = (in_w + 2 * pad_left - filter_w) / stride_w + 1;
+    const std::vector<float> in = randomData(batch * in_h * in_w * in_c, -1.f, 1.f, 20);
+    const std::vector<float> filter = randomData(filter_h * filter_w * out_c, -1.f, 1.f, 21);
+    const std::vector<float> bias = randomData(out_c, -1.f, 1.f, 22);
+
+    for (int activation = 0; activation <= kActivationRelu6; ++activation)
+    {
+        // output channel ic * multiplier + m filters input channel ic
+        std::vector<float> expected(batch * out_h * out_w * out_c);
+        for (int b = 0; b < batch; ++b)
+            for (int y = 0; y < out_h; ++y)
+                for (int x = 0; x < out_w; ++x)
+                    for (int ic = 0; ic < in_c; ++ic)
+                        for (int m = 0; m < multiplier; ++m)
+                        {
+                            const int oc = ic * multiplier + m;
+                            float sum = bias[oc];
+                            for (int fy = 0; fy < filter_h; ++fy)
+                                for (int fx = 0; fx < filter_w; ++fx)
+                                {
+                                    const int iy = y * stride_h - pad_top + fy;
+                                    const int ix = x * stride_w - pad_left + fx;
+                                    if (iy < 0 || iy >= in_h || ix < 0 || ix >= in_w)
+                                        continue;
+                                    sum += in[((b * in_h + iy) * in_w + ix) * in_c + ic] *
+                                           filter[(fy * filter_w + fx) * out_c + oc];
+                                }
+                            expected[((b * out_h + y) * out_w + x) * out_c + oc] = applyActivation(sum, activation);
+                        }
+
+        std::vector<float> out(expected.size());
+        depthConvCpu(in.data(), filter.data(), bias.data(), out.data(), batch, in_h, in_w, in_c,
+                     out_h, out_w, out_c, filter_h, filter_w, pad_top, pad_left, stride_h, stride_w,
+                     multiplier, activation);
+        SCOPED_TRACE(testing::Message() << "activation " << activation);
+        expectNear(out, expected);
+    }
+}
+
+}  // namespace
+
+NAME_SPACE_STOP
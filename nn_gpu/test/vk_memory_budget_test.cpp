@@ -0,0 +1,240 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Budget accounting, LRU eviction and the allocation failure path of VkMemoryBudget,
+// with fake models in place of the memory managers of the prepared models.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../vulkan/vk_memory_budget.h"
+
+NAME_SPACE_BEGIN
+
+namespace {
+
+const size_t kMB = 1024 * 1024;
+
+class FakeModel : public VkMemoryBudgetClient
+{
+public:
+    FakeModel(const std::string& name, size_t weights, size_t footprint,
+              std::vector<std::string>* evicted)
+        : name(name), weights(weights), footprint(footprint), resident(0), evicted(evicted) {}
+
+    size_t getResidentSize() const override { return resident; }
+    size_t getWeightSize() const override { return weights; }
+
+    size_t evict() override
+    {
+        evicted->push_back(name);
+        size_t bytes = resident;
+        resident = 0;
+        return bytes;
+    }
+
+    // what VkCsExecutor::run() does around an execution
+    void start(VkMemoryBudget& budget)
+    {
+        budget.acquire(this);
+        resident = footprint;
+    }
+
+    void finish(VkMemoryBudget& budget)
+    {
+        budget.release(this);
+    }
+
+    void run(VkMemoryBudget& budget)
+    {
+        start(budget);
+        finish(budget);
+    }
+
+private:
+    std::string name;
+    size_t weights;
+    size_t footprint;
+    size_t resident;
+    std::vector<std::string>* evicted;
+};
+
+class VkMemoryBudgetTest : public ::testing::Test
+{
+protected:
+    FakeModel* addModel(VkMemoryBudget& budget, const std::string& name, size_t footprint)
+    {
+        models.emplace_back(new FakeModel(name, footprint / 2, footprint, &evicted));
+        budget.registerClient(models.back().get());
+        return models.back().get();
+    }
+
+    void TearDown() override
+    {
+        models.clear();
+    }
+
+    std::vector<std::unique_ptr<FakeModel>> models;
+    std::vector<std::string> evicted;
+};
+
+}  // namespace
+
+TEST_F(VkMemoryBudgetTest, UnlimitedBudgetNeverEvicts)
+{
+    VkMemoryBudget budget(0);
+    for (int i = 0; i < 8; i++)
+    {
+        addModel(budget, std::to_string(i), 512 * kMB)->run(budget);
+    }
+
+    EXPECT_TRUE(evicted.empty());
+    EXPECT_EQ(budget.getStats().evictionCount, 0u);
+}
+
+TEST_F(VkMemoryBudgetTest, ModelsWithinBudgetStayResident)
+{
+    VkMemoryBudget budget(300 * kMB);
+    FakeModel* a = addModel(budget, "a", 100 * kMB);
+    FakeModel* b = addModel(budget, "b", 100 * kMB);
+    FakeModel* c = addModel(budget, "c", 100 * kMB);
+    for (int i = 0; i < 3; i++)
+    {
+        a->run(budget);
+        b->run(budget);
+        c->run(budget);
+    }
+
+    EXPECT_TRUE(evicted.empty());
+}
+
+TEST_F(VkMemoryBudgetTest, OverBudgetEvictsLeastRecentlyUsed)
+{
+    VkMemoryBudget budget(250 * kMB);
+    FakeModel* a = addModel(budget, "a", 100 * kMB);
+    FakeModel* b = addModel(budget, "b", 100 * kMB);
+    FakeModel* c = addModel(budget, "c", 100 * kMB);
+    a->run(budget);
+    b->run(budget);
+    a->run(budget);
+
+    // c's weights (50 MB) still fit, its measured footprint does not
+    c->run(budget);
+    EXPECT_TRUE(evicted.empty());
+    b->run(budget);
+    EXPECT_EQ(evicted, std::vector<std::string>({"a"}));
+
+    VkMemoryBudgetStats stats = budget.getStats();
+    EXPECT_EQ(stats.evictionCount, 1u);
+    EXPECT_EQ(stats.evictedBytes, 100 * kMB);
+    EXPECT_EQ(stats.allocFailures, 0u);
+}
+
+TEST_F(VkMemoryBudgetTest, EvictsUntilTheModelFits)
+{
+    VkMemoryBudget budget(300 * kMB);
+    FakeModel* a = addModel(budget, "a", 100 * kMB);
+    FakeModel* b = addModel(budget, "b", 100 * kMB);
+    FakeModel* c = addModel(budget, "c", 100 * kMB);
+    FakeModel* big = addModel(budget, "big", 500 * kMB);
+    a->run(budget);
+    b->run(budget);
+    c->run(budget);
+
+    // the 250 MB of weights of big need the whole budget
+    big->run(budget);
+    EXPECT_EQ(evicted, std::vector<std::string>({"a", "b", "c"}));
+    EXPECT_EQ(budget.getStats().evictedBytes, 300 * kMB);
+
+    // an evicted model comes back at the expense of the least recently used one
+    evicted.clear();
+    a->run(budget);
+    EXPECT_EQ(evicted, std::vector<std::string>({"big"}));
+}
+
+TEST_F(VkMemoryBudgetTest, RunningModelIsNotEvicted)
+{
+    VkMemoryBudget budget(150 * kMB);
+    FakeModel* a = addModel(budget, "a", 100 * kMB);
+    FakeModel* b = addModel(budget, "b", 100 * kMB);
+    a->run(budget);
+
+    // a is busy, b runs over budget rather than evicting it
+    a->start(budget);
+    b->run(budget);
+    EXPECT_TRUE(evicted.empty());
+    a->finish(budget);
+
+    // once a is idle again it is the one to go
+    b->run(budget);
+    EXPECT_EQ(evicted, std::vector<std::string>({"a"}));
+}
+
+TEST_F(VkMemoryBudgetTest, UnregisteredModelIsNotEvicted)
+{
+    VkMemoryBudget budget(150 * kMB);
+    FakeModel* a = addModel(budget, "a", 100 * kMB);
+    FakeModel* b = addModel(budget, "b", 100 * kMB);
+    a->run(budget);
+    budget.unregisterClient(a);
+
+    b->run(budget);
+    EXPECT_TRUE(evicted.empty());
+}
+
+TEST_F(VkMemoryBudgetTest, AllocationFailureEvictsIdleModels)
+{
+    VkMemoryBudget budget(0);
+    FakeModel* a = addModel(budget, "a", 100 * kMB);
+    FakeModel* b = addModel(budget, "b", 100 * kMB);
+    FakeModel* c = addModel(budget, "c", 100 * kMB);
+    a->run(budget);
+    b->run(budget);
+
+    // c fails to allocate while running: the idle models are released for the retry
+    c->start(budget);
+    EXPECT_TRUE(budget.evictIdle());
+    EXPECT_EQ(evicted, std::vector<std::string>({"a", "b"}));
+
+    // nothing left to release, Buffer::init() fails without a retry
+    EXPECT_FALSE(budget.evictIdle());
+    c->finish(budget);
+
+    VkMemoryBudgetStats stats = budget.getStats();
+    EXPECT_EQ(stats.allocFailures, 2u);
+    EXPECT_EQ(stats.evictionCount, 2u);
+    EXPECT_EQ(stats.evictedBytes, 200 * kMB);
+}
+
+TEST_F(VkMemoryBudgetTest, RestoreStatistics)
+{
+    VkMemoryBudget budget(0);
+    budget.recordRestore(4 * kMB, 1000);
+    budget.recordRestore(2 * kMB, 3000);
+
+    VkMemoryBudgetStats stats = budget.getStats();
+    EXPECT_EQ(stats.restoreCount, 2u);
+    EXPECT_EQ(stats.restoredBytes, 6 * kMB);
+    EXPECT_EQ(stats.restoreTimeUs, 4000);
+    EXPECT_EQ(stats.maxRestoreTimeUs, 3000);
+}
+
+NAME_SPACE_STOP
@@ -0,0 +1,575 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Runs the compute shaders of the vulkan executors on whatever vulkan device the loader
+// offers first (e.g. lavapipe with VK_ICD_FILENAMES pointing at lvp_icd) and compares their
+// output with the CPU reference kernels. Specialization and push constants are laid out the
+// way the executor of each operation does it.
+
+#include <math.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../cpu_reference.h"
+#include "../vulkan/vk_wrapper.h"
+#include "../vulkan/shader/spv_shader.h"
+
+NAME_SPACE_BEGIN
+
+namespace {
+
+class ShaderRunner
+{
+public:
+    bool init();
+    void release();
+
+    // buffers are bound in order, all of them are read back after the dispatch
+    void run(const uint32_t* spv, size_t spv_size, const std::vector<int>& spec_consts,
+             const void* push_consts, size_t push_size, std::vector<std::vector<float>>& buffers,
+             uint32_t group_x, uint32_t group_y = 1, uint32_t group_z = 1);
+
+private:
+    struct Buffer
+    {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+    };
+
+    Buffer createBuffer(const std::vector<float>& data);
+    void destroyBuffer(const Buffer& buffer);
+
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
+    VkCommandPool cmd_pool = VK_NULL_HANDLE;
+    uint32_t host_memory_type = 0;
+};
+
+bool ShaderRunner::init()
+{
+    if (!InitVulkan())
+    {
+        return false;
+    }
+
+    VkApplicationInfo app_info = {};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pApplicationName = "nn_gpu_vk_shader_test";
+    app_info.apiVersion = VK_MAKE_VERSION(1, 0, 0);
+
+    VkInstanceCreateInfo instance_info = {};
+    instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instance_info.pApplicationInfo = &app_info;
+    if (vkCreateInstance(&instance_info, NULL, &instance) != VK_SUCCESS)
+    {
+        return false;
+    }
+
+    uint32_t count = 1;
+    if (vkEnumeratePhysicalDevices(instance, &count, &physical_device) < 0 || count == 0)
+    {
+        return false;
+    }
+
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, NULL);
+    std::vector<VkQueueFamilyProperties> families(count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, families.data());
+    uint32_t family = 0;
+    while (family < count && !(families[family].queueFlags & VK_QUEUE_COMPUTE_BIT))
+    {
+        family++;
+    }
+    if (family == count)
+    {
+        return false;
+    }
+
+    VkPhysicalDeviceMemoryProperties memory_props;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_props);
+    const VkMemoryPropertyFlags host_flags =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (host_memory_type = 0; host_memory_type < memory_props.memoryTypeCount; host_memory_type++)
+    {
+        if ((memory_props.memoryTypes[host_memory_type].propertyFlags & host_flags) == host_flags)
+        {
+            break;
+        }
+    }
+    if (host_memory_type == memory_props.memoryTypeCount)
+    {
+        return false;
+    }
+
+    const float priority = 1.0f;
+    VkDeviceQueueCreateInfo queue_info = {};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+
+    VkDeviceCreateInfo device_info = {};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    if (vkCreateDevice(physical_device, &device_info, NULL, &device) != VK_SUCCESS)
+    {
+        return false;
+    }
+    vkGetDeviceQueue(device, family, 0, &queue);
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.queueFamilyIndex = family;
+    return vkCreateCommandPool(device, &pool_info, NULL, &cmd_pool) == VK_SUCCESS;
+}
+
+void ShaderRunner::release()
+{
+    if (device != VK_NULL_HANDLE)
+    {
+        vkDestroyCommandPool(device, cmd_pool, NULL);
+        vkDestroyDevice(device, NULL);
+    }
+    if (instance != VK_NULL_HANDLE)
+    {
+        vkDestroyInstance(instance, NULL);
+    }
+}
+
+ShaderRunner::Buffer ShaderRunner::createBuffer(const std::vector<float>& data)
+{
+    Buffer b;
+    b.size = data.size() * sizeof(float);
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = b.size;
+    buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    EXPECT_EQ(vkCreateBuffer(device, &buffer_info, NULL, &b.buffer), VK_SUCCESS);
+
+    VkMemoryRequirements req;
+    vkGetBufferMemoryRequirements(device, b.buffer, &req);
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = req.size;
+    alloc_info.memoryTypeIndex = host_memory_type;
+    EXPECT_EQ(vkAllocateMemory(device, &alloc_info, NULL, &b.memory), VK_SUCCESS);
+    EXPECT_EQ(vkBindBufferMemory(device, b.buffer, b.memory, 0), VK_SUCCESS);
+
+    void* p;
+    EXPECT_EQ(vkMapMemory(device, b.memory, 0, b.size, 0, &p), VK_SUCCESS);
+    memcpy(p, data.data(), b.size);
+    vkUnmapMemory(device, b.memory);
+    return b;
+}
+
+void ShaderRunner::destroyBuffer(const Buffer& b)
+{
+    vkDestroyBuffer(device, b.buffer, NULL);
+    vkFreeMemory(device, b.memory, NULL);
+}
+
+void ShaderRunner::run(const uint32_t* spv, size_t spv_size, const std::vector<int>& spec_consts,
+                       const void* push_consts, size_t push_size,
+                       std::vector<std::vector<float>>& buffers, uint32_t group_x, uint32_t group_y,
+                       uint32_t group_z)
+{
+    const uint32_t buffer_num = buffers.size();
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings(buffer_num);
+    for (uint32_t i = 0; i < buffer_num; i++)
+    {
+        bindings[i] = {};
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = buffer_num;
+    layout_info.pBindings = bindings.data();
+    VkDescriptorSetLayout set_layout;
+    ASSERT_EQ(vkCreateDescriptorSetLayout(device, &layout_info, NULL, &set_layout), VK_SUCCESS);
+
+    VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer_num};
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    VkDescriptorPool descriptor_pool;
+    ASSERT_EQ(vkCreateDescriptorPool(device, &pool_info, NULL, &descriptor_pool), VK_SUCCESS);
+
+    VkDescriptorSetAllocateInfo set_info = {};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.descriptorPool = descriptor_pool;
+    set_info.descriptorSetCount = 1;
+    set_info.pSetLayouts = &set_layout;
+    VkDescriptorSet descriptor_set;
+    ASSERT_EQ(vkAllocateDescriptorSets(device, &set_info, &descriptor_set), VK_SUCCESS);
+
+    std::vector<Buffer> gpu_buffers;
+    std::vector<VkDescriptorBufferInfo> buffer_infos(buffer_num);
+    std::vector<VkWriteDescriptorSet> writes(buffer_num);
+    for (uint32_t i = 0; i < buffer_num; i++)
+    {
+        gpu_buffers.push_back(createBuffer(buffers[i]));
+        buffer_infos[i] = {gpu_buffers[i].buffer, 0, gpu_buffers[i].size};
+        writes[i] = {};
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = descriptor_set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &buffer_infos[i];
+    }
+    vkUpdateDescriptorSets(device, buffer_num, writes.data(), 0, NULL);
+
+    VkShaderModuleCreateInfo module_info = {};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = spv_size;
+    module_info.pCode = spv;
+    VkShaderModule module;
+    ASSERT_EQ(vkCreateShaderModule(device, &module_info, NULL, &module), VK_SUCCESS);
+
+    // constant ids are the positions in spec_consts, as in the executors
+    std::vector<VkSpecializationMapEntry> entries(spec_consts.size());
+    for (size_t i = 0; i < spec_consts.size(); i++)
+    {
+        entries[i] = {static_cast<uint32_t>(i), static_cast<uint32_t>(i * sizeof(int)), sizeof(int)};
+    }
+    VkSpecializationInfo spec_info;
+    spec_info.mapEntryCount = entries.size();
+    spec_info.pMapEntries = entries.data();
+    spec_info.dataSize = spec_consts.size() * sizeof(int);
+    spec_info.pData = spec_consts.data();
+
+    VkPushConstantRange push_range = {VK_SHADER_STAGE_COMPUTE_BIT, 0, (uint32_t)push_size};
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &set_layout;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_range;
+    VkPipelineLayout pipeline_layout;
+    ASSERT_EQ(vkCreatePipelineLayout(device, &pipeline_layout_info, NULL, &pipeline_layout),
+              VK_SUCCESS);
+
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.stage.pSpecializationInfo = &spec_info;
+    pipeline_info.layout = pipeline_layout;
+    VkPipeline pipeline;
+    ASSERT_EQ(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline),
+              VK_SUCCESS);
+
+    VkCommandBufferAllocateInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool = cmd_pool;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
+    VkCommandBuffer cmd;
+    ASSERT_EQ(vkAllocateCommandBuffers(device, &cmd_info, &cmd), VK_SUCCESS);
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    ASSERT_EQ(vkBeginCommandBuffer(cmd, &begin_info), VK_SUCCESS);
+    vkCmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, push_size, push_consts);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1,
+                            &descriptor_set, 0, NULL);
+    vkCmdDispatch(cmd, group_x, group_y, group_z);
+    ASSERT_EQ(vkEndCommandBuffer(cmd), VK_SUCCESS);
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd;
+    ASSERT_EQ(vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE), VK_SUCCESS);
+    ASSERT_EQ(vkQueueWaitIdle(queue), VK_SUCCESS);
+
+    for (uint32_t i = 0; i < buffer_num; i++)
+    {
+        void* p;
+        ASSERT_EQ(vkMapMemory(device, gpu_buffers[i].memory, 0, gpu_buffers[i].size, 0, &p),
+                  VK_SUCCESS);
+        memcpy(buffers[i].data(), p, gpu_buffers[i].size);
+        vkUnmapMemory(device, gpu_buffers[i].memory);
+        destroyBuffer(gpu_buffers[i]);
+    }
+
+    vkFreeCommandBuffers(device, cmd_pool, 1, &cmd);
+    vkDestroyPipeline(device, pipeline, NULL);
+    vkDestroyPipelineLayout(device, pipeline_layout, NULL);
+    vkDestroyShaderModule(device, module, NULL);
+    vkDestroyDescriptorPool(device, descriptor_pool, NULL);
+    vkDestroyDescriptorSetLayout(device, set_layout, NULL);
+}
+
+std::vector<float> randomData(size_t count, float lo, float hi)
+{
+    static std::mt19937 rng(20190411);
+    std::uniform_real_distribution<float> dist(lo, hi);
+    std::vector<float> data(count);
+    for (auto& v : data)
+    {
+        v = dist(rng);
+    }
+    return data;
+}
+
+void expectNear(const std::vector<float>& gpu, const std::vector<float>& cpu)
+{
+    ASSERT_EQ(gpu.size(), cpu.size());
+    for (size_t i = 0; i < gpu.size(); i++)
+    {
+        ASSERT_NEAR(gpu[i], cpu[i], 1e-4f + 1e-4f * fabsf(cpu[i])) << "at index " << i;
+    }
+}
+
+uint32_t groupCount(int total, int local_size)
+{
+    return (total + local_size - 1) / local_size;
+}
+
+}  // namespace
+
+class VkShaderTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestCase()
+    {
+        available = runner.init();
+    }
+
+    static void TearDownTestCase()
+    {
+        runner.release();
+    }
+
+    void SetUp() override
+    {
+        ASSERT_TRUE(available) << "no vulkan device with a compute queue";
+    }
+
+    static ShaderRunner runner;
+    static bool available;
+};
+
+ShaderRunner VkShaderTest::runner;
+bool VkShaderTest::available = false;
+
+TEST_F(VkShaderTest, Activation)
+{
+    // see doActivation()
+    const int local_size = 64;
+    const int total = 1000;
+    const std::vector<float> input = randomData(total, -8.f, 8.f);
+
+    for (int type : {kActivationRelu, kActivationRelu1, kActivationRelu6, kActivationTanh})
+    {
+        SCOPED_TRACE(type);
+        std::vector<std::vector<float>> buffers = {input, std::vector<float>(total)};
+        runner.run(activation_spv, activation_spv_size, {local_size, type}, &total, sizeof(total),
+                   buffers, groupCount(total, local_size));
+
+        std::vector<float> expected(total);
+        activationCpu(input.data(), expected.data(), total, type);
+        expectNear(buffers[1], expected);
+    }
+}
+
+TEST_F(VkShaderTest, FullyConnected)
+{
+    // see doFULLY_CONNECTED(), units not a multiple of the tile of 4
+    const int local_size = 16;
+    const int tile_n = 4;
+    struct { int batch; int k; int n; } param = {3, 37, 19};
+
+    const std::vector<float> input = randomData(param.batch * param.k, -1.f, 1.f);
+    const std::vector<float> weights = randomData(param.n * param.k, -1.f, 1.f);
+    const std::vector<float> bias = randomData(param.n, -1.f, 1.f);
+
+    for (int activation = 0; activation <= kActivationRelu6; activation++)
+    {
+        SCOPED_TRACE(activation);
+        std::vector<std::vector<float>> buffers = {input, weights, bias,
+                                                   std::vector<float>(param.batch * param.n)};
+        runner.run(fully_connected_spv, fully_connected_spv_size, {local_size, activation},
+                   &param, sizeof(param), buffers,
+                   groupCount(groupCount(param.n, tile_n), local_size), param.batch);
+
+        std::vector<float> expected(param.batch * param.n);
+        fullyConnectedCpu(input.data(), weights.data(), bias.data(), expected.data(),
+                          param.batch, param.k, param.n, activation);
+        expectNear(buffers[3], expected);
+    }
+}
+
+TEST_F(VkShaderTest, ResizeBilinear)
+{
+    // see doRESIZE_BILINEAR(), both up and down scaling
+    const int local_size = 64;
+    const int batch = 2;
+    struct
+    {
+        int in_h, in_w, out_h, out_w, channels, total;
+        float scale_h, scale_w;
+    } param = {5, 7, 9, 4, 3, 0, 0.f, 0.f};
+    param.total = batch * param.out_h * param.out_w * param.channels;
+    param.scale_h = static_cast<float>(param.in_h) / param.out_h;
+    param.scale_w = static_cast<float>(param.in_w) / param.out_w;
+
+    const std::vector<float> input =
+        randomData(batch * param.in_h * param.in_w * param.channels, -4.f, 4.f);
+    std::vector<std::vector<float>> buffers = {input, std::vector<float>(param.total)};
+    runner.run(resize_bilinear_spv, resize_bilinear_spv_size, {local_size}, &param, sizeof(param),
+               buffers, groupCount(param.total, local_size));
+
+    std::vector<float> expected(param.total);
+    resizeBilinearCpu(input.data(), expected.data(), batch, param.in_h, param.in_w,
+                      param.out_h, param.out_w, param.channels);
+    expectNear(buffers[1], expected);
+}
+
+TEST_F(VkShaderTest, L2Normalization)
+{
+    // see doL2_NORMALIZATION(), the last row is all zeros
+    const int local_size = 32;
+    struct { int depth; int outer; } param = {33, 10};
+
+    std::vector<float> input = randomData(param.depth * param.outer, -3.f, 3.f);
+    std::fill(input.end() - param.depth, input.end(), 0.f);
+    std::vector<std::vector<float>> buffers = {input,
+                                               std::vector<float>(param.depth * param.outer)};
+    runner.run(l2_normalization_spv, l2_normalization_spv_size, {local_size}, &param,
+               sizeof(param), buffers, groupCount(param.outer, local_size));
+
+    std::vector<float> expected(param.depth * param.outer);
+    l2NormCpu(input.data(), expected.data(), param.depth, param.outer);
+    expectNear(buffers[1], expected);
+}
+
+TEST_F(VkShaderTest, Mean)
+{
+    // see doMEAN(), inputs of lower rank are padded to 4D with leading 1s
+    const int local_size = 32;
+    struct Case
+    {
+        std::vector<uint32_t> dims;
+        std::vector<bool> reduced;
+    };
+    const Case cases[] = {
+        {{2, 5, 6, 3}, {false, true, true, false}},
+        {{2, 5, 6, 3}, {true, false, false, true}},
+        {{4, 6, 7}, {false, true, false}},
+        {{9, 11}, {true, true}},
+    };
+
+    for (const Case& c : cases)
+    {
+        struct
+        {
+            int out_ext[4];
+            int red_ext[4];
+            int stride[4];
+            int total;
+            int reduce_count;
+        } param;
+        param.total = 1;
+        param.reduce_count = 1;
+
+        const int pad = 4 - c.dims.size();
+        int in_total = 1;
+        for (int d = 3; d >= 0; d--)
+        {
+            const int dim = d < pad ? 1 : c.dims[d - pad];
+            const bool reduced = d >= pad && c.reduced[d - pad];
+            param.out_ext[d] = reduced ? 1 : dim;
+            param.red_ext[d] = reduced ? dim : 1;
+            param.stride[d] = in_total;
+            param.total *= param.out_ext[d];
+            param.reduce_count *= param.red_ext[d];
+            in_total *= dim;
+        }
+
+        const std::vector<float> input = randomData(in_total, -2.f, 2.f);
+        std::vector<std::vector<float>> buffers = {input, std::vector<float>(param.total)};
+        runner.run(mean_spv, mean_spv_size, {local_size}, &param, sizeof(param), buffers,
+                   groupCount(param.total, local_size));
+
+        std::vector<float> expected(param.total);
+        meanCpu(input.data(), expected.data(), c.dims, c.reduced);
+        expectNear(buffers[1], expected);
+    }
+}
+
+TEST_F(VkShaderTest, Pool)
+{
+    // see doPool(), channels on x, output columns on y and batch * output rows on z. The
+    // windows of the first row and column reach into the padding, those of the last ones
+    // end at the padding of the other side.
+    const int local_size[3] = {8, 8, 1};
+    struct
+    {
+        int channels, in_h, in_w, out_h, out_w, padding_h, padding_w;
+        int filter_h, filter_w, stride_h, stride_w, batch;
+    } param = {5, 9, 11, 5, 6, 1, 1, 3, 3, 2, 2, 2};
+
+    const std::vector<float> input =
+        randomData(param.batch * param.in_h * param.in_w * param.channels, -8.f, 8.f);
+    const int total = param.batch * param.out_h * param.out_w * param.channels;
+
+    for (int type : {0, 1})
+    {
+        for (int activation = 0; activation <= kActivationRelu6; activation++)
+        {
+            SCOPED_TRACE(::testing::Message() << (type ? "max" : "average") << " pool, activation "
+                                              << activation);
+            std::vector<std::vector<float>> buffers = {input, std::vector<float>(total)};
+            runner.run(pool_spv, pool_spv_size,
+                       {local_size[0], local_size[1], local_size[2], type, activation},
+                       &param, sizeof(param), buffers,
+                       groupCount(param.channels, local_size[0]),
+                       groupCount(param.out_w, local_size[1]),
+                       groupCount(param.batch * param.out_h, local_size[2]));
+
+            std::vector<float> expected(total);
+            poolCpu(input.data(), expected.data(), param.batch, param.in_h, param.in_w,
+                    param.channels, param.out_h, param.out_w, param.filter_h, param.filter_w,
+                    param.padding_h, param.padding_w, param.stride_h, param.stride_w,
+                    type == 1, activation);
+            expectNear(buffers[1], expected);
+        }
+    }
+}
+
+NAME_SPACE_STOP
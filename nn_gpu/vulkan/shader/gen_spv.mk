@@ -0,0 +1,16 @@
+# Compiles the shaders of NN_GPU_GENERATED_SHADERS from their .comp sources with
+# gen_spv.sh and adds the results to the sources of the current module.
+# Include after LOCAL_MODULE and LOCAL_MODULE_CLASS are set.
+
+nn_gpu_spv_dir := $(call local-generated-sources-dir)/shader
+nn_gpu_spv_srcs := $(foreach s,$(NN_GPU_GENERATED_SHADERS),$(nn_gpu_spv_dir)/$(s)_spv.cpp)
+
+$(nn_gpu_spv_srcs): PRIVATE_GLSLC := $(NN_GPU_GLSLC)
+$(nn_gpu_spv_srcs): PRIVATE_SCRIPT := $(LOCAL_PATH)/vulkan/shader/gen_spv.sh
+$(nn_gpu_spv_srcs): $(nn_gpu_spv_dir)/%_spv.cpp: $(LOCAL_PATH)/vulkan/shader/%.comp \
+        $(LOCAL_PATH)/vulkan/shader/gen_spv.sh $(NN_GPU_GLSLC)
+	@echo "Compile shader: $@"
+	@mkdir -p $(dir $@)
+	$(hide) $(PRIVATE_SCRIPT) $(PRIVATE_GLSLC) $< $@
+
+LOCAL_GENERATED_SOURCES += $(nn_gpu_spv_srcs)
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# Copyright @2019 Intel Corporation
+#
+# Compiles a compute shader with glslc and wraps the SPIR-V words into a C++
+# source defining <name>_spv[] and <name>_spv_size, see spv_shader.h.
+#
+# usage: gen_spv.sh path/to/glslc name.comp name_spv.cpp
+
+if [ $# -ne 3 ]
+then
+echo usage: $0 glslc shader.comp output.cpp
+exit 1
+fi
+
+name=`basename $2 .comp`_spv
+
+$1 -fshader-stage=compute --target-env=vulkan1.0 -mfmt=num -o $3.num $2 || exit 1
+
+{
+echo '#include <stddef.h>'
+echo '#include "base.h"'
+echo
+echo 'NAME_SPACE_BEGIN'
+echo
+echo "extern const unsigned int $name[] = {"
+cat $3.num
+echo '};'
+echo "extern const size_t ${name}_size = sizeof($name);"
+echo
+echo 'NAME_SPACE_STOP'
+} > $3
+
+rm -f $3.num
@@ -19,14 +19,14 @@
 #ifndef ANDROID_HARDWARE_NEURALNETWORKS_V1_2_VK_SPV_SHADER_H
 #define ANDROID_HARDWARE_NEURALNETWORKS_V1_2_VK_SPV_SHADER_H
 
+#include <stddef.h>
+
 NAME_SPACE_BEGIN
 
 extern const unsigned int elewise_spv[890];
 extern const unsigned int conv_spv[1700];
 extern const unsigned int concat_spv[626];
 extern const unsigned int softmax_spv[900];
-extern const unsigned int avg_pool_spv[2057];
-extern const unsigned int max_pool_spv[1894];
 extern const unsigned int lrn_spv[1730];
 extern const unsigned int dw_conv_spv[2231];
 extern const unsigned int logistic_spv[368];
@@ -34,6 +34,32 @@ extern const unsigned int conv_chn3to4_spv[729];
 extern const unsigned int conv_gemmShader4_8_spv[7691];
 extern const unsigned int conv_gemm1_spv[1320];
 
+// named like the sizes of the generated shaders below
+const size_t elewise_spv_size = sizeof(elewise_spv);
+const size_t conv_spv_size = sizeof(conv_spv);
+const size_t concat_spv_size = sizeof(concat_spv);
+const size_t softmax_spv_size = sizeof(softmax_spv);
+const size_t lrn_spv_size = sizeof(lrn_spv);
+const size_t dw_conv_spv_size = sizeof(dw_conv_spv);
+const size_t logistic_spv_size = sizeof(logistic_spv);
+const size_t conv_chn3to4_spv_size = sizeof(conv_chn3to4_spv);
+const size_t conv_gemmShader4_8_spv_size = sizeof(conv_gemmShader4_8_spv);
+const size_t conv_gemm1_spv_size = sizeof(conv_gemm1_spv);
+
+// compiled from their .comp sources at build time, see gen_spv.sh
+extern const unsigned int activation_spv[];
+extern const size_t activation_spv_size;
+extern const unsigned int fully_connected_spv[];
+extern const size_t fully_connected_spv_size;
+extern const unsigned int resize_bilinear_spv[];
+extern const size_t resize_bilinear_spv_size;
+extern const unsigned int l2_normalization_spv[];
+extern const size_t l2_normalization_spv_size;
+extern const unsigned int mean_spv[];
+extern const size_t mean_spv_size;
+extern const unsigned int pool_spv[];
+extern const size_t pool_spv_size;
+
 NAME_SPACE_STOP
 
 #endif
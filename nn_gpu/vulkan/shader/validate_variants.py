@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+#
+# Copyright @2019 Intel Corporation
+#
+# Validates every shader variant registered in ../vk_shader_variants.hxx:
+# the embedded SPIR-V of each shader is specialized with the default value of
+# all registered constants, then with every constant at its minimum and at its
+# maximum, and each result is frozen with spirv-opt and checked by spirv-val.
+# The shaders compiled at build time are looked up in the --spv-dir directories
+# first, see gen_spv.mk. Run as part of the Android.mk build.
+#
+# usage: validate_variants.py [--spirv-opt PATH] [--spirv-val PATH] [--spv-dir DIR]...
+
+import argparse
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+REGISTRY = os.path.join(HERE, '..', 'vk_shader_variants.hxx')
+
+def parse_registry(path):
+    variants = {}
+    order = []
+    for line in open(path):
+        m = re.match(r'\s*SHADER_VARIANT\((\w+),\s*(\w+),\s*(\d+)\)', line)
+        if m:
+            variants[m.group(1)] = {'spv': m.group(2), 'consts': []}
+            order.append(m.group(1))
+            continue
+        m = re.match(r'\s*SPEC_CONST_RANGE\((\w+),\s*(\d+),\s*(\w+),\s*(-?\d+),\s*(-?\d+),\s*(-?\d+)\)', line)
+        if m:
+            shader, cid, name, lo, hi, default = m.groups()
+            variants[shader]['consts'].append((int(cid), name, int(lo), int(hi), int(default)))
+    return [(name, variants[name]) for name in order]
+
+def load_spv(spv_name, spv_dirs):
+    for d in spv_dirs + [HERE]:
+        path = os.path.join(d, spv_name + '.cpp')
+        if os.path.exists(path):
+            break
+    text = open(path).read()
+    body = text[text.index('{') + 1:text.rindex('}')]
+    words = [int(w, 16) for w in re.findall(r'0x[0-9a-fA-F]+', body)]
+    return struct.pack('<%dI' % len(words), *words)
+
+def variant_values(consts):
+    defaults = dict((c[0], c[4]) for c in consts)
+    yield 'default', defaults
+    for cid, name, lo, hi, _ in consts:
+        for tag, value in (('min', lo), ('max', hi)):
+            values = dict(defaults)
+            values[cid] = value
+            yield '%s=%d(%s)' % (name, value, tag), values
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--spirv-opt', default='spirv-opt')
+    parser.add_argument('--spirv-val', default='spirv-val')
+    parser.add_argument('--spv-dir', action='append', default=[])
+    args = parser.parse_args()
+
+    failures = 0
+    total = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        for shader, desc in parse_registry(REGISTRY):
+            src = os.path.join(tmp, shader + '.spv')
+            with open(src, 'wb') as f:
+                f.write(load_spv(desc['spv'], args.spv_dir))
+
+            for tag, values in variant_values(desc['consts']):
+                total += 1
+                dst = os.path.join(tmp, shader + '_variant.spv')
+                spec = ' '.join('%d:%d' % (cid, v) for cid, v in sorted(values.items()))
+                steps = [
+                    [args.spirv_opt, '--set-spec-const-default-value', spec,
+                     '--freeze-spec-const', '--fold-spec-const-op-composite', src, '-o', dst],
+                    [args.spirv_val, '--target-env', 'vulkan1.0', dst],
+                ]
+                for cmd in steps:
+                    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+                    if result.returncode != 0:
+                        failures += 1
+                        print('FAIL %s %s\n%s' % (shader, tag, result.stdout.decode().rstrip()))
+                        break
+
+    print('%d of %d shader variants passed' % (total - failures, total))
+    return 1 if failures else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -18,6 +18,7 @@
 #include "vk_common.h"
 #include "vk_buffer.h"
 #include "vk_wrapper.h"
+#include "vk_memory_budget.h"
 
 NAME_SPACE_BEGIN
 
@@ -59,7 +60,17 @@ bool Buffer::init(const uint8_t* data)
     allocateInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits,
                                                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
                                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-    VK_CHECK_RESULT(vkAllocateMemory(device, &allocateInfo, NULL, &memory));
+    VkResult result = vkAllocateMemory(device, &allocateInfo, NULL, &memory);
+    if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY)
+    {
+        // degrade by releasing the memory of the idle models instead of failing the execution
+        LOGW("Buffer: allocating %zu bytes failed, evict idle models and retry", length);
+        if (VkMemoryBudget::get().evictIdle())
+        {
+            result = vkAllocateMemory(device, &allocateInfo, NULL, &memory);
+        }
+    }
+    VK_CHECK_RESULT(result);
 
     if (data)
     {
@@ -25,6 +25,7 @@
 
 NAME_SPACE_BEGIN
 
+extern VkInstance kInstance;
 extern VkPhysicalDevice kPhysicalDevice;
 extern VkPhysicalDeviceProperties kDeviceProps;
 extern VkDevice kDevice;
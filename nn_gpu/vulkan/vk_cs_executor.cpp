@@ -16,10 +16,12 @@
  *
  */
 
+#include <string.h>
 #include "vk_cs_executor.h"
 #include "vk_wrapper.h"
 #include "vk_op_base.h"
 #include "vk_cpu_timer.h"
+#include "vk_memory_budget.h"
 
 NAME_SPACE_BEGIN
 
@@ -68,6 +70,69 @@ static uint32_t getComputeQueueFamilyIndex()
     return i;
 }
 
+// budget of the heaps used by Buffer::init, 0 without VK_EXT_memory_budget
+static size_t queryDeviceMemoryBudget()
+{
+#ifdef VK_EXT_MEMORY_BUDGET_EXTENSION_NAME
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(kPhysicalDevice, nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> exts(count);
+    vkEnumerateDeviceExtensionProperties(kPhysicalDevice, nullptr, &count, exts.data());
+
+    bool supported = false;
+    for (const auto& ext : exts)
+    {
+        if (strcmp(ext.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+        {
+            supported = true;
+            break;
+        }
+    }
+
+    PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2 =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+            vkGetInstanceProcAddr(kInstance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+    if (!supported || getMemoryProperties2 == nullptr)
+    {
+        NN_GPU_DEBUG("VK_EXT_memory_budget is not supported");
+        return 0;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProps = {};
+    budgetProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2KHR props = {};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+    props.pNext = &budgetProps;
+    getMemoryProperties2(kPhysicalDevice, &props);
+
+    // only the heaps which back host visible and coherent memory are used, see Buffer::init
+    const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    const VkPhysicalDeviceMemoryProperties& memProps = props.memoryProperties;
+    std::vector<bool> usedHeaps(memProps.memoryHeapCount, false);
+    for (uint32_t i = 0; i < memProps.memoryTypeCount; ++i)
+    {
+        if ((memProps.memoryTypes[i].propertyFlags & flags) == flags)
+        {
+            usedHeaps[memProps.memoryTypes[i].heapIndex] = true;
+        }
+    }
+
+    size_t total = 0;
+    for (uint32_t i = 0; i < memProps.memoryHeapCount; ++i)
+    {
+        if (usedHeaps[i])
+        {
+            total += budgetProps.heapBudget[i];
+        }
+    }
+    return total;
+#else
+    return 0;
+#endif
+}
+
 bool VkCsExecutor::initPerProcess()
 {
     NN_GPU_CALL();
@@ -100,6 +165,19 @@ bool VkCsExecutor::initPerProcess()
     deviceExt.push_back("VK_KHR_swapchain");
 #endif
 
+    // needed to query VK_EXT_memory_budget with a vulkan 1.0 instance
+    uint32_t instanceExtCount = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &instanceExtCount, nullptr);
+    std::vector<VkExtensionProperties> instanceExtProps(instanceExtCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &instanceExtCount, instanceExtProps.data());
+    for (const auto& ext : instanceExtProps)
+    {
+        if (strcmp(ext.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0)
+        {
+            instanceExt.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+        }
+    }
+
     // Create the Vulkan instance
     VkInstanceCreateInfo instanceCreateInfo{
         .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
@@ -191,6 +269,8 @@ bool VkCsExecutor::initPerProcess()
     commandPoolCreateInfo.queueFamilyIndex = kQueueFamilyIndex;
     VK_CHECK_RESULT(vkCreateCommandPool(kDevice, &commandPoolCreateInfo, NULL, &kCmdPool));
 
+    VkMemoryBudget::get().init(queryDeviceMemoryBudget());
+
     initialized = true;
 
     NN_GPU_EXIT();
@@ -224,9 +304,16 @@ bool VkCsExecutor::initPerModel()
     NN_GPU_CALL();
 
     memMgr.initFromModel(model);
+    VkMemoryBudget::get().registerClient(&memMgr);
     initOperands();
     initOperationTimers();
 
+    if (ShadowValidator::enabled())
+    {
+        LOGD("VkCsExecutor: shadow validation enabled by nn.gpgpu.shadow");
+        shadow.reset(new ShadowValidator(model));
+    }
+
     return true;
 }
 
@@ -272,6 +359,8 @@ void VkCsExecutor::deinitPerModel()
 
     showOperationTimers();
 
+    VkMemoryBudget::get().unregisterClient(&memMgr);
+    VkMemoryBudget::get().showStats();
     memMgr.clean();
 }
 
@@ -334,11 +423,25 @@ void VkCsExecutor::setArgOperands(const Request& request)
     updateForArguments(model.outputIndexes, request.outputs);
 }
 
-bool VkCsExecutor::run(const Operation& operation, OperationCpuTimer* timer)
+bool VkCsExecutor::shadowValidate(ShadowValidator& shadow, uint32_t index, const std::string& opName,
+                                  const Operation& operation, ShadowOperandReader& reader,
+                                  const std::string& convSignature, const std::string& convConfig)
 {
-    NN_GPU_CALL();
+    if (shadow.validate(index, opName, operation, reader))
+    {
+        return true;
+    }
 
-    VkCpuTimer t(timer);
+    if (operation.type == OperationType::CONV_2D && !convSignature.empty())
+    {
+        blacklistConvConfig(convSignature, convConfig);
+    }
+    return false;
+}
+
+bool VkCsExecutor::run(const Operation& operation, uint32_t index, OperationCpuTimer* timer)
+{
+    NN_GPU_CALL();
 
     //maybe some checking here
     const hidl_vec<uint32_t>& inputs = operation.inputs;
@@ -346,22 +449,34 @@ bool VkCsExecutor::run(const Operation& operation, OperationCpuTimer* timer)
 
     bool ret = true;
 
-	opBase.reset(new VkOpBase());
-
-    switch (operation.type)
     {
+        VkCpuTimer t(timer);
+
+        opBase.reset(new VkOpBase());
+        convSignature.clear();
+
+        switch (operation.type)
+        {
 
 #define SETUP_OP(op)                \
-    case OperationType::op:         \
-        NN_GPU_DEBUG("run operation type with %d", OperationType::op); \
-        ret = do##op(operation);    \
-        break;
+        case OperationType::op:         \
+            NN_GPU_DEBUG("run operation type with %d", OperationType::op); \
+            ret = do##op(operation);    \
+            break;
 #include "vk_setup_op.hxx"
 #undef SETUP_OP
 
-    default:
-        NOT_IMPLEMENTED;
-        break;
+        default:
+            NOT_IMPLEMENTED;
+            break;
+        }
+    }
+
+    // the inputs must be validated before their storage is released by markOpFinished
+    if (ret && shadow != nullptr)
+    {
+        ShadowOperandAdapter<VkOperand> reader(model, operands);
+        shadowValidate(*shadow, index, getOpName(operation), operation, reader, convSignature, convConfig);
     }
 
     for (uint32_t i : inputs)
@@ -380,21 +495,39 @@ bool VkCsExecutor::run(const Operation& operation, OperationCpuTimer* timer)
 
 bool VkCsExecutor::run(const Request& request)
 {
+    // evicted buffers of this model are restored lazily when they are bound
+    VkMemoryBudget::get().acquire(&memMgr);
+
+    bool ret = true;
     restoreOperands();
     memMgr.resetFromRequest(request);
     setArgOperands(request);
+    if (shadow != nullptr)
+    {
+        shadow->beginRun();
+    }
     for (size_t i = 0; i < model.operations.size(); ++i)
     {
         const Operation& operation = model.operations[i];
         NN_GPU_DEBUG("run loop on Operation %d", operation.type);
         OperationCpuTimer* timer = &operationTimers[i];
-        if (!run(operation, timer))
+        if (!run(operation, i, timer))
         {
-            return false;
+            ret = false;
+            break;
         }
     }
-    memMgr.sync();
-    return true;
+    if (ret)
+    {
+        if (shadow != nullptr)
+        {
+            shadow->endRun();
+        }
+        memMgr.sync();
+    }
+
+    VkMemoryBudget::get().release(&memMgr);
+    return ret;
 }
 
 void VkCsExecutor::getCapabilities(V1_0::Capabilities &cap)
@@ -405,6 +538,66 @@ void VkCsExecutor::getCapabilities(V1_0::Capabilities &cap)
            .quantized8Performance = {.execTime = 0.91f, .powerUsage = 0.91f}};
 }
 
+template <typename T>
+static T getModelScalar(const Model& model, const Operand& operand, uint32_t idx = 0)
+{
+    return reinterpret_cast<const T*>(&model.operandValues[operand.location.offset])[idx];
+}
+
+// reject the variants of the registered operations which the shaders do not handle
+static bool checkOperationVariant(const Model& model, const Operation& operation)
+{
+    const hidl_vec<uint32_t>& ins = operation.inputs;
+
+    switch (operation.type)
+    {
+    case OperationType::RESIZE_BILINEAR:
+    {
+        const Operand& width = model.operands[ins[1]];
+        if (width.type != OperandType::INT32 || width.lifetime != OperandLifeTime::CONSTANT_COPY)
+        {
+            LOGW("RESIZE_BILINEAR: only constant INT32 output size is supported.");
+            return false;
+        }
+        if (ins.size() > 3 && getModelScalar<uint8_t>(model, model.operands[ins[3]]))
+        {
+            LOGW("RESIZE_BILINEAR: NCHW layout not supported.");
+            return false;
+        }
+        break;
+    }
+    case OperationType::L2_NORMALIZATION:
+    {
+        if (ins.size() > 1)
+        {
+            const int rank = model.operands[ins[0]].dimensions.size();
+            const int axis = getModelScalar<int32_t>(model, model.operands[ins[1]]);
+            if (axis != -1 && axis != rank - 1)
+            {
+                LOGW("L2_NORMALIZATION: only the innermost axis is supported.");
+                return false;
+            }
+        }
+        break;
+    }
+    case OperationType::MEAN:
+    {
+        const Operand& axes = model.operands[ins[1]];
+        if (axes.lifetime != OperandLifeTime::CONSTANT_COPY ||
+            model.operands[ins[0]].dimensions.size() > 4)
+        {
+            LOGW("MEAN: only constant axes on tensors up to 4D are supported.");
+            return false;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    return true;
+}
+
 std::vector<bool> VkCsExecutor::getSupportedOperations(const Model& model)
 {
     NN_GPU_CALL();
@@ -440,6 +633,11 @@ std::vector<bool> VkCsExecutor::getSupportedOperations(const Model& model)
             supported[i] = false;
             break;
         }
+
+        if (supported[i] && !checkOperationVariant(model, operation))
+        {
+            supported[i] = false;
+        }
     }
 
     return supported;
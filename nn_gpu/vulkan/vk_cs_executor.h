@@ -24,6 +24,7 @@
 #include "vk_memory_manager.h"
 #include "vk_op_base.h"
 #include "operation_cpu_timer.h"
+#include "shadow_validator.h"
 
 NAME_SPACE_BEGIN
 
@@ -111,12 +112,29 @@ public:
     void deinitPerModel() override;
     std::string getOpName(const Operation& operation);
 
+    // in-memory tuning cache of the CONV_2D shader configs, keyed by the signature of the convolution
+    static bool findConvConfig(const std::string& signature, std::string& config);
+    static void storeConvConfig(const std::string& signature, const std::string& config);
+    static void blacklistConvConfig(const std::string& signature, const std::string& config);
+    static bool isConvConfigBlacklisted(const std::string& signature, const std::string& config);
+
+    // shadow validates an operation, a diverging CONV_2D blacklists the config which computed it
+    // (convSignature and convConfig, empty when it did not come from the tuning cache)
+    static bool shadowValidate(ShadowValidator& shadow, uint32_t index, const std::string& opName,
+                               const Operation& operation, ShadowOperandReader& reader,
+                               const std::string& convSignature, const std::string& convConfig);
+
 private:
     //cannot be a global memMgr per process since the gl objects belong to one context (_ctx)
     VkMemoryManager memMgr;
     std::vector<VkOperand> operands;
     std::vector<OperationCpuTimer> operationTimers;
     std::shared_ptr<VkOpBase> opBase;
+    std::shared_ptr<ShadowValidator> shadow;
+
+    // tuning cache entry used by the last CONV_2D, blacklisted when the shadow validation fails
+    std::string convSignature;
+    std::string convConfig;
 
     void initOperands();
     void restoreOperands();
@@ -126,12 +144,13 @@ private:
     void showOperationTimers();
     void deinitOperationResources();
 
-    bool run(const Operation& operation, OperationCpuTimer* timer);
+    bool run(const Operation& operation, uint32_t index, OperationCpuTimer* timer);
 
     bool doEleWise(const Operation& operation, const int type);
     bool convolve(const Operation& operation, ShaderConfig& config);
     bool depthConvolve(const Operation& operation, ShaderConfig& config);
     bool doPool(const Operation& operation, ShaderConfig& config, const int type);
+    bool doActivation(const Operation& operation, const int type);
 
     // for convolve tuning
     void tune(VkConvSpecializedConst& param, ShaderConfig& conf,
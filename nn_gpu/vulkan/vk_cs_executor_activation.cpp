@@ -0,0 +1,129 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <cutils/properties.h>
+#include "gpu_executor.h"
+#include "vk_common.h"
+#include "vk_cs_executor.h"
+#include "cpu_reference.h"
+#include "shader/spv_shader.h"
+
+NAME_SPACE_BEGIN
+
+#define LOCAL_SZ_X 64
+
+struct ActivationSpecConst
+{
+    int lsz_x;
+    int type;
+};
+
+struct ActivationParam
+{
+public:
+    ActivationParam(int t) : total(t) {};
+public:
+    int total;
+};
+
+bool VkCsExecutor::doRELU(const Operation& operation)
+{
+    NN_GPU_CALL();
+    return doActivation(operation, kActivationRelu);
+}
+
+bool VkCsExecutor::doRELU1(const Operation& operation)
+{
+    NN_GPU_CALL();
+    return doActivation(operation, kActivationRelu1);
+}
+
+bool VkCsExecutor::doRELU6(const Operation& operation)
+{
+    NN_GPU_CALL();
+    return doActivation(operation, kActivationRelu6);
+}
+
+bool VkCsExecutor::doTANH(const Operation& operation)
+{
+    NN_GPU_CALL();
+    return doActivation(operation, kActivationTanh);
+}
+
+bool VkCsExecutor::doActivation(const Operation& operation, const int type)
+{
+    NN_GPU_ENTRY();
+
+#define BUFFER_NUM 2
+    opBase->initVulkanThing(BUFFER_NUM);
+
+    const hidl_vec<uint32_t>& ins = operation.inputs;
+    const hidl_vec<uint32_t>& outs = operation.outputs;
+
+    VkOperand& input  = operands[ins[0]];
+    VkOperand& output = operands[outs[0]];
+
+    int total = input.getElementCount();
+    int local_size_x = LOCAL_SZ_X;
+    opBase->computeGroupCountX(total, local_size_x, local_size_x);
+    opBase->group_y = 1;
+    opBase->group_z = 1;
+
+    ActivationParam param(total);
+
+    if (opBase->pipeline == VK_NULL_HANDLE)
+    {
+        NN_GPU_DEBUG("VkCsExecutor::doActivation: run createShaderModule");
+        opBase->createShaderModule(activation_spv, activation_spv_size);
+
+        ActivationSpecConst spec_const = {local_size_x, type};
+#define SPECIALIZATION_CONST_NUM 2
+        VkSpecializationMapEntry entry[SPECIALIZATION_CONST_NUM];
+        SET_SPEC_CONST_ENTRY(entry[0], 0, offsetof(ActivationSpecConst, lsz_x), sizeof(int));
+        SET_SPEC_CONST_ENTRY(entry[1], 1, offsetof(ActivationSpecConst, type), sizeof(int));
+
+        VkSpecializationInfo spec_info;
+        spec_info.mapEntryCount = SPECIALIZATION_CONST_NUM;
+        spec_info.pMapEntries = entry;
+        spec_info.dataSize = sizeof(spec_const);
+        spec_info.pData = &spec_const;
+
+        NN_GPU_DEBUG("VkCsExecutor::doActivation: run createPipeline");
+        opBase->createPipeline(sizeof(ActivationParam), &spec_info);
+    }
+
+    NN_GPU_DEBUG("VkCsExecutor::doActivation: bind operands");
+    opBase->bindOperand(input, 0, opBase->descriptor_set);
+    opBase->bindOperand(output, 1, opBase->descriptor_set);
+
+    NN_GPU_DEBUG("VkCsExecutor::doActivation: type is %d, group_x is %d, group_y is %d, group_z is %d",
+        type, opBase->group_x, opBase->group_y, opBase->group_z);
+
+    NN_GPU_DEBUG("VkCsExecutor::doActivation: do recordCommandBuffer");
+    opBase->recordCommandBuffer((void *)&param, sizeof(ActivationParam));
+
+    NN_GPU_DEBUG("VkCsExecutor::doActivation: do runCommandBuffer");
+    opBase->runCommandBuffer();
+
+    NN_GPU_EXIT();
+
+    return true;
+}
+
+NAME_SPACE_STOP
@@ -17,10 +17,13 @@
  */
 
 #include <math.h>
+#include <set>
 #include <cutils/properties.h>
 #include "gpu_executor.h"
 #include "vk_common.h"
 #include "vk_cs_executor.h"
+#include "vk_shader_variant.h"
+#include "cpu_reference.h"
 #include "shader/spv_shader.h"
 
 NAME_SPACE_BEGIN
@@ -64,8 +67,6 @@ enum ConvShaderType
     CONV_SHADER_TYPE_NUM                 = 7
 };
 
-enum FusedActivationFunctionType { kNone, kRelu, kRelu1, kRelu6 };
-
 struct PushConst {
 public:
     PushConst() {};
@@ -78,6 +79,8 @@ using TuningTimeMap    = std::map<long, int>;
 
 static std::mutex mtx;
 static ShaderConfigMap shaderConfigMap;
+// "signature:config" pairs which failed the shadow validation
+static std::set<std::string> blacklistedConfigs;
 static bool is_initialized = false;
 static int tmpBoSize = 0;
 static int shader_type = CONV_SHADER_TYPE_BASIC;
@@ -315,6 +318,20 @@ static inline bool needImg2Col(const VkConvSpecializedConst& param)
              param.filter_h == 1 && param.filter_w == 1);
 }
 
+// name of the shader variant registered in vk_shader_variants.hxx
+static const char* convShaderName(const int type)
+{
+    switch (type)
+    {
+    case CONV_SHADER_TYPE_GEMM_4_8_GENERIC:
+        return "conv_gemmShader4_8";
+    case CONV_SHADER_TYPE_GEMM1:
+        return "conv_gemm1";
+    default:
+        return "conv";
+    }
+}
+
 static std::string genConvSignature(const VkConvSpecializedConst& param)
 {
     std::stringstream sig;
@@ -344,6 +361,18 @@ static void configToString(const ShaderConfig& conf, std::string& str)
     str = ss.str();
 }
 
+// same format as defaultConfig, parsed by string2Config
+static std::string genShaderConfigString(const ShaderConfig& conf)
+{
+    std::stringstream ss;
+
+    ss << "type"  << shader_type       << "_"
+       << "lsz"   << conf.local_size_x << "_" << conf.local_size_y  << "_" << conf.local_size_z << "_"
+       << "block" << conf.block_width  << "_" << conf.block_height << "_" << conf.block_depth;
+
+    return ss.str();
+}
+
 static bool computeGroupCount(int& gx, int& gy, int& gz, const int type,
                               const VkConvSpecializedConst& param, const ShaderConfig& conf)
 {
@@ -453,7 +482,8 @@ static std::vector<ShaderConfig> genShaderConfigCandidates(VkConvSpecializedCons
             }
         }
 
-        for (int ly = 8; ly <= 256; ly += 8)
+        const int max_ly = getSpecConstMax("conv_gemmShader4_8", 1, 256);
+        for (int ly = 8; ly <= max_ly; ly += 8)
         {
             conf.local_size_y = ly;
             param.local_sz_y  = ly;
@@ -477,9 +507,11 @@ static std::vector<ShaderConfig> genShaderConfigCandidates(VkConvSpecializedCons
         conf.block_depth  = 1;
         shader_type       = CONV_SHADER_TYPE_GEMM1;
 
-        for (int lx = 1; lx <= 256; lx *= 4)
+        const int max_lx = getSpecConstMax("conv_gemm1", 0, 256);
+        const int max_ly = getSpecConstMax("conv_gemm1", 1, 256);
+        for (int lx = 1; lx <= max_lx; lx *= 4)
         {
-            for (int ly = 1; ly <= 256; ly *= 4)
+            for (int ly = 1; ly <= max_ly; ly *= 4)
             {
                 conf.local_size_x = lx;
                 conf.local_size_y = ly;
@@ -502,11 +534,14 @@ static std::vector<ShaderConfig> genShaderConfigCandidates(VkConvSpecializedCons
         conf.block_height = 1;
         conf.block_depth  = 1;
 
-        for (int lx = 1; lx <= 256; lx *= 4)
+        const int max_lx = getSpecConstMax("conv", 0, 256);
+        const int max_ly = getSpecConstMax("conv", 1, 256);
+        const int max_lz = getSpecConstMax("conv", 2, 32);
+        for (int lx = 1; lx <= max_lx; lx *= 4)
         {
-            for (int ly = 1; ly <= 256; ly *= 4)
+            for (int ly = 1; ly <= max_ly; ly *= 4)
             {
-                for (int lz = 1; lz <= 32; lz *= 4)
+                for (int lz = 1; lz <= max_lz; lz *= 4)
                 {
                     conf.local_size_x = lx;
                     conf.local_size_y = ly;
@@ -567,149 +602,35 @@ static void setSpecInfo(VkSpecializationMapEntry* entry,
     return;
 }
 
-static void convOneBhwc(float* in_data, int in_offset, float* filter_data, int filter_offset,
-                        float* bias, int bias_offset, float* convolved_data, int out_offset,
-                        int in_w, int in_h, int out_w, int out_h,
-                        int pad_left, int pad_top, int has_bias, int stride_w, int stride_h,
-                        int filter_w, int filter_h, int dilation_x, int dilation_y,
-                        int in_c, int out_c, int out_z, int out_x, int out_y, int depth, int activation)
+// loads the default configs, mtx must be held
+static void initShaderConfigMap()
 {
-    const int ZPAR = 1;
-
-    if (out_x < out_w && out_y < out_h)
+    if (is_initialized)
     {
-        float sum[ZPAR];
-
-        for(int kern = 0; kern < ZPAR; kern++)
-        {
-            sum[kern] = 0.0f;
-        }
-
-        const int org_y                 = out_y * stride_h - pad_top;
-        const int org_x                 = out_x * stride_w - pad_left;
-        const int current_filter_offset = filter_offset + depth * filter_h * filter_w * in_c;
-        const int bias_index            = bias_offset + (depth % out_c);
-        const int local_in_offset       = (org_y * in_w + org_x) * in_c;
-
-        float* in_ptr     = in_data + (in_offset + local_in_offset);
-        float* filter_ptr = filter_data + (current_filter_offset);
-
-        for(int y = 0; y < filter_h; y++)
-        {
-            for(int x = 0; x < filter_w; x++)
-            {
-                if(org_y + int(y * dilation_y) >= 0 && org_y + int(y * dilation_y) < int(in_h) &&
-                   org_x + int(x * dilation_x) >= 0 && org_x + int(x * dilation_x) < int(in_w))
-                {
-                    for(int c = 0; c < in_c; c++)
-                    {
-                        for(int outz = 0; outz < ZPAR; outz++)
-                        {
-                            sum[outz] += in_ptr[c] * filter_ptr[outz * filter_h * filter_w * in_c + c];
-                        }
-                    }
-                }
-
-                in_ptr += dilation_x * in_c;
-                filter_ptr += in_c;
-            }
-
-            in_ptr += in_w * dilation_y * in_c - dilation_x * in_c * filter_w;
-        }
-
-        if (has_bias)
-        {
-            for (int kern = 0; kern < ZPAR; kern++)
-            {
-                if (depth + kern < out_z)
-                {
-                    int offset = out_offset + (out_y * out_w  + out_x) * out_c + depth + kern;
-                    float out = sum[kern] + bias[bias_index +kern];
-                    if (activation == kRelu)
-                    {
-                        out = out > 0.f ? out : 0.f;
-                    }
-                    else if (activation == kRelu1)
-                    {
-                        out = out > 1.f ? 1.f : out < -1.f ? -1.f : out;
-                    }
-                    else if (activation == kRelu6)
-                    {
-                        out = out > 6.f ? 6.f : out < 0.f ? 0.f : out;
-                    }
-                    convolved_data[offset] = out;
-                }
-            }
-        }
-        else
-        {
-            for (int kern = 0; kern < ZPAR; kern++)
-            {
-                if (depth + kern < out_z)
-                {
-                    int offset = out_offset + (out_y * out_w  + out_x) * out_c + depth + kern;
-                    float out  = sum[kern];
+        return;
+    }
 
-                    if (activation == kRelu)
-                    {
-                        out = out > 0.f ? out : 0.f;
-                    }
-                    else if (activation == kRelu1)
-                    {
-                        out = out > 1.f ? 1.f : out < -1.f ? -1.f : out;
-                    }
-                    else if (activation == kRelu6)
-                    {
-                        out = out > 6.f ? 6.f : out < 0.f ? 0.f : out;
-                    }
+    NN_GPU_DEBUG("prepareShaderConfig: init shaderConfigMap for vulkan backend shader");
 
-                    convolved_data[offset] = out;
-                }
-            }
-        }
+    int configNum = 0;
+    if (sizeof(defaultConfig) > 0)
+    {
+        configNum = sizeof(defaultConfig) / sizeof(defaultConfig[0]) / 2;
     }
-}
-
-static void convCpuBhwc(float* in_buffer, float* bias_buffer, float* filter_buffer, float* benchmark,
-                        int batch, int group, int has_bias, int in_c, int in_w, int in_h,
-                        int out_c, int out_w, int out_h, int filter_w, int filter_h,
-                        int padding_left, int padding_top, int stride_w, int stride_h,
-                        int dilation_x, int dilation_y, int activation)
-{
-    int in_offset     = 0;
-    int bias_offset   = 0;
-    int filter_offset = 0;
-    int out_offset    = 0;
-    int m             = out_c / group;
-    int bottom_dim    = in_c * in_w * in_h;
-    int top_dim       = out_c * out_w * out_h;
-
-    for (int n = 0; n < batch; ++n)
+    for (int i = 0; i < configNum; i++)
     {
-        for (int g = 0; g < group; ++g)
-        {
-            in_offset     = n * bottom_dim + in_w * in_h * (in_c / group) * g;
-            filter_offset = filter_h * filter_w * (in_c / group) * m * g;
-            bias_offset   = m * g;
-            out_offset    = n * top_dim + out_w * out_h * m * g;
-
-            for (int depth = 0; depth < m; ++depth)
-            {
-                for (int out_y = 0; out_y < out_h; ++out_y)
-                {
-                    for (int out_x = 0; out_x < out_w; ++out_x)
-                    {
-                        convOneBhwc(in_buffer, in_offset, filter_buffer, filter_offset, bias_buffer, bias_offset,
-                                    benchmark, out_offset, in_w, in_h, out_w, out_h, padding_left, padding_top,
-                                    has_bias, stride_w, stride_h, filter_w, filter_h, dilation_x, dilation_y,
-                                    in_c, out_c, m, out_x, out_y, depth, activation);
-                    }
-                }
-            }
-        }
+        ShaderConfigPair entry(defaultConfig[2 * i], defaultConfig[2 * i + 1]);
+        shaderConfigMap.insert(entry);
+        NN_GPU_PERF("CONV_2D: %s: load pre-tuned config: %s, %s\n", __func__, defaultConfig[2 * i], defaultConfig[2 * i + 1]);
     }
+    NN_GPU_DEBUG("prepareShaderConfig: shaderConfigMap is initialized");
+    is_initialized = true;
+}
 
-    return;
+// mtx must be held
+static bool isBlacklisted(const std::string& signature, const std::string& config)
+{
+    return blacklistedConfigs.count(signature + ":" + config) > 0;
 }
 
 static bool fake_loadConfig()
@@ -828,6 +749,12 @@ bool VkCsExecutor::tuning_convolve(VkConvSpecializedConst& param, const ShaderCo
     VkSpecializationMapEntry entry[SPEC_CONST_NUM];
     setSpecInfo(entry, spec_info, param, SPEC_CONST_NUM);
 
+    // skip the candidates outside of the registered ranges
+    if (!checkSpecializationInfo(convShaderName(shader_type), spec_info))
+    {
+        return false;
+    }
+
     switch (shader_type)
     {
     case CONV_SHADER_TYPE_GEMM_4_8_GENERIC: {
@@ -897,11 +824,18 @@ bool VkCsExecutor::tryShaderConfig(VkConvSpecializedConst& param,
     ShaderConfig conf;
     std::string conf_str;
     TuningTimeMap time_map;
+    const std::string sig = genConvSignature(param);
 
     for (size_t i = 0; i < configs.size(); i ++)
     {
         long elapsed_us, t;
 
+        if (isBlacklisted(sig, genShaderConfigString(configs[i])))
+        {
+            NN_GPU_PERF("CONV_2D: %s: skip blacklisted config %s\n", __func__, genShaderConfigString(configs[i]).c_str());
+            continue;
+        }
+
         param.local_sz_x   = configs[i].local_size_x;
         param.local_sz_y   = configs[i].local_size_y;
         param.local_sz_z   = configs[i].local_size_z;
@@ -1062,24 +996,7 @@ void VkCsExecutor::prepareShaderConfig(VkConvSpecializedConst& param, ShaderConf
     mtx.lock();
 
     // load default configs and get vulkan info
-    if (!is_initialized)
-    {
-        NN_GPU_DEBUG("prepareShaderConfig: init shaderConfigMap for vulkan backend shader");
-
-        int configNum = 0;
-        if (sizeof(defaultConfig) > 0)
-        {
-            configNum = sizeof(defaultConfig) / sizeof(defaultConfig[0]) / 2;
-        }
-        for (int i = 0; i < configNum; i++)
-        {
-            ShaderConfigPair entry(defaultConfig[2 * i], defaultConfig[2 * i + 1]);
-            shaderConfigMap.insert(entry);
-            NN_GPU_PERF("CONV_2D: %s: load pre-tuned config: %s, %s\n", __func__, defaultConfig[2 * i], defaultConfig[2 * i + 1]);
-        }
-        NN_GPU_DEBUG("prepareShaderConfig: shaderConfigMap is initialized");
-        is_initialized = true;
-    }
+    initShaderConfigMap();
 
     // search in-memory cache
     ShaderConfigMap::iterator it = shaderConfigMap.find(sig);
@@ -1087,6 +1004,8 @@ void VkCsExecutor::prepareShaderConfig(VkConvSpecializedConst& param, ShaderConf
     {
         NN_GPU_PERF("CONV_2D: %s: found config %s, %s\n", __func__, sig.c_str(), it->second.c_str());
         string2Config(it->second.c_str(), conf);
+        convSignature = sig;
+        convConfig = it->second;
         mtx.unlock();
         return;
     }
@@ -1101,6 +1020,11 @@ void VkCsExecutor::prepareShaderConfig(VkConvSpecializedConst& param, ShaderConf
         tuned = true;
     }
 
+    // cache the tuned config in memory
+    convSignature = sig;
+    convConfig = genShaderConfigString(conf);
+    shaderConfigMap[sig] = convConfig;
+
     // todo: store persistent config
     if (tuned)
     {
@@ -1297,6 +1221,12 @@ bool VkCsExecutor::convolve(const Operation& operation, ShaderConfig& config)
         VkSpecializationMapEntry entry[SPEC_CONST_NUM];
         setSpecInfo(entry, spec_info, spec_const, SPEC_CONST_NUM);
 
+        if (!checkSpecializationInfo(convShaderName(shader_type), spec_info))
+        {
+            LOGE("VkCsExecutor::doCONV_2D: invalid shader config");
+            return false;
+        }
+
         switch (shader_type)
         {
         case CONV_SHADER_TYPE_GEMM_4_8_GENERIC: {
@@ -1389,6 +1319,50 @@ bool VkCsExecutor::convolve(const Operation& operation, ShaderConfig& config)
     return true;
 }
 
+bool VkCsExecutor::findConvConfig(const std::string& signature, std::string& config)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    initShaderConfigMap();
+    ShaderConfigMap::iterator it = shaderConfigMap.find(signature);
+    if (it == shaderConfigMap.end())
+    {
+        return false;
+    }
+
+    config = it->second;
+    return true;
+}
+
+void VkCsExecutor::storeConvConfig(const std::string& signature, const std::string& config)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    initShaderConfigMap();
+    shaderConfigMap[signature] = config;
+}
+
+bool VkCsExecutor::isConvConfigBlacklisted(const std::string& signature, const std::string& config)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return isBlacklisted(signature, config);
+}
+
+void VkCsExecutor::blacklistConvConfig(const std::string& signature, const std::string& config)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    LOGW("CONV_2D: blacklist shader config %s for %s", config.c_str(), signature.c_str());
+    blacklistedConfigs.insert(signature + ":" + config);
+
+    // the next execution re-tunes among the remaining candidates
+    ShaderConfigMap::iterator it = shaderConfigMap.find(signature);
+    if (it != shaderConfigMap.end() && it->second == config)
+    {
+        shaderConfigMap.erase(it);
+    }
+}
+
 // FIXME:
 // Android NN don't set group, dilation, has_bias,
 // so make these assumptions: group = 1, dilation = 1, has_bias = 1
@@ -21,6 +21,7 @@
 #include "gpu_executor.h"
 #include "vk_common.h"
 #include "vk_cs_executor.h"
+#include "vk_shader_variant.h"
 #include "shader/spv_shader.h"
 
 NAME_SPACE_BEGIN
@@ -126,6 +127,12 @@ bool VkCsExecutor::doEleWise(const Operation& operation, const int type)
 		spec_info.dataSize = sizeof(spec_const);
 		spec_info.pData = &spec_const;
 
+		if (!checkSpecializationInfo("elewise", spec_info))
+		{
+			LOGE("VkCsExecutor::doEleWise: invalid shader config");
+			return false;
+		}
+
 		opBase->createPipeline(sizeof(PushConst), &spec_info);
 	}
 
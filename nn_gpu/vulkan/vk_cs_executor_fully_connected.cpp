@@ -0,0 +1,120 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <cutils/properties.h>
+#include "gpu_executor.h"
+#include "vk_common.h"
+#include "vk_cs_executor.h"
+#include "shader/spv_shader.h"
+
+NAME_SPACE_BEGIN
+
+#define LOCAL_SZ_X 16
+// number of output units computed by one invocation, keep in sync with fully_connected.comp
+#define TILE_N 4
+
+struct FullyConnectedSpecConst
+{
+    int lsz_x;
+    int activation;
+};
+
+struct FullyConnectedParam
+{
+public:
+    FullyConnectedParam(int b, int in_size, int units) : batch(b), k(in_size), n(units) {};
+public:
+    int batch;
+    int k;
+    int n;
+};
+
+bool VkCsExecutor::doFULLY_CONNECTED(const Operation& operation)
+{
+    NN_GPU_ENTRY();
+
+    ASSERT(operation.type == OperationType::FULLY_CONNECTED);
+
+#define BUFFER_NUM 4
+    opBase->initVulkanThing(BUFFER_NUM);
+
+    const hidl_vec<uint32_t>& ins = operation.inputs;
+    const hidl_vec<uint32_t>& outs = operation.outputs;
+    ASSERT(ins.size() == 4);
+
+    VkOperand& input   = operands[ins[0]];
+    VkOperand& weights = operands[ins[1]];
+    VkOperand& bias    = operands[ins[2]];
+    VkOperand& output  = operands[outs[0]];
+
+    const int activation = operands[ins[3]].getScalarData<int>();
+    const int num_units  = weights.getDimensionSize(0);
+    const int input_size = weights.getDimensionSize(1);
+    const int batch      = input.getElementCount() / input_size;
+
+    FullyConnectedParam param(batch, input_size, num_units);
+
+    int local_size_x = LOCAL_SZ_X;
+    opBase->computeGroupCountX((num_units + TILE_N - 1) / TILE_N, local_size_x, local_size_x);
+    opBase->group_y = batch;
+    opBase->group_z = 1;
+
+    NN_GPU_DEBUG("VkCsExecutor::doFULLY_CONNECTED: batch is %d, input size is %d, units is %d, activation is %d, "
+        "group_x is %d, group_y is %d, group_z is %d", batch, input_size, num_units, activation,
+        opBase->group_x, opBase->group_y, opBase->group_z);
+
+    if (opBase->pipeline == VK_NULL_HANDLE)
+    {
+        NN_GPU_DEBUG("VkCsExecutor::doFULLY_CONNECTED: run createShaderModule");
+        opBase->createShaderModule(fully_connected_spv, fully_connected_spv_size);
+
+        FullyConnectedSpecConst spec_const = {local_size_x, activation};
+#define SPECIALIZATION_CONST_NUM 2
+        VkSpecializationMapEntry entry[SPECIALIZATION_CONST_NUM];
+        SET_SPEC_CONST_ENTRY(entry[0], 0, offsetof(FullyConnectedSpecConst, lsz_x), sizeof(int));
+        SET_SPEC_CONST_ENTRY(entry[1], 1, offsetof(FullyConnectedSpecConst, activation), sizeof(int));
+
+        VkSpecializationInfo spec_info;
+        spec_info.mapEntryCount = SPECIALIZATION_CONST_NUM;
+        spec_info.pMapEntries = entry;
+        spec_info.dataSize = sizeof(spec_const);
+        spec_info.pData = &spec_const;
+
+        NN_GPU_DEBUG("VkCsExecutor::doFULLY_CONNECTED: run createPipeline");
+        opBase->createPipeline(sizeof(FullyConnectedParam), &spec_info);
+    }
+
+    NN_GPU_DEBUG("VkCsExecutor::doFULLY_CONNECTED: bind operands");
+    opBase->bindOperand(input, 0, opBase->descriptor_set);
+    opBase->bindOperand(weights, 1, opBase->descriptor_set);
+    opBase->bindOperand(bias, 2, opBase->descriptor_set);
+    opBase->bindOperand(output, 3, opBase->descriptor_set);
+
+    NN_GPU_DEBUG("VkCsExecutor::doFULLY_CONNECTED: do recordCommandBuffer");
+    opBase->recordCommandBuffer((void *)&param, sizeof(FullyConnectedParam));
+
+    NN_GPU_DEBUG("VkCsExecutor::doFULLY_CONNECTED: do runCommandBuffer");
+    opBase->runCommandBuffer();
+
+    NN_GPU_EXIT();
+
+    return true;
+}
+
+NAME_SPACE_STOP
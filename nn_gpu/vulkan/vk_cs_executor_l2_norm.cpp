@@ -0,0 +1,107 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <cutils/properties.h>
+#include "gpu_executor.h"
+#include "vk_common.h"
+#include "vk_cs_executor.h"
+#include "shader/spv_shader.h"
+
+NAME_SPACE_BEGIN
+
+#define LOCAL_SZ_X 32
+
+struct L2NormSpecConst
+{
+    int lsz_x;
+};
+
+struct L2NormParam
+{
+public:
+    L2NormParam(int d, int o) : depth(d), outer(o) {};
+public:
+    int depth;
+    int outer;
+};
+
+bool VkCsExecutor::doL2_NORMALIZATION(const Operation& operation)
+{
+    NN_GPU_ENTRY();
+
+    ASSERT(operation.type == OperationType::L2_NORMALIZATION);
+
+#define BUFFER_NUM 2
+    opBase->initVulkanThing(BUFFER_NUM);
+
+    const hidl_vec<uint32_t>& ins = operation.inputs;
+    const hidl_vec<uint32_t>& outs = operation.outputs;
+
+    VkOperand& input  = operands[ins[0]];
+    VkOperand& output = operands[outs[0]];
+
+    // only the innermost axis is accepted by getSupportedOperations
+    const int depth = input.getDimensionSize(input.getNumberOfDimensions() - 1);
+    const int outer = input.getElementCount() / depth;
+
+    L2NormParam param(depth, outer);
+
+    int local_size_x = LOCAL_SZ_X;
+    opBase->computeGroupCountX(outer, local_size_x, local_size_x);
+    opBase->group_y = 1;
+    opBase->group_z = 1;
+
+    NN_GPU_DEBUG("VkCsExecutor::doL2_NORMALIZATION: depth is %d, outer is %d, group_x is %d",
+        depth, outer, opBase->group_x);
+
+    if (opBase->pipeline == VK_NULL_HANDLE)
+    {
+        NN_GPU_DEBUG("VkCsExecutor::doL2_NORMALIZATION: run createShaderModule");
+        opBase->createShaderModule(l2_normalization_spv, l2_normalization_spv_size);
+
+        L2NormSpecConst spec_const = {local_size_x};
+        VkSpecializationMapEntry entry[1];
+        SET_SPEC_CONST_ENTRY(entry[0], 0, offsetof(L2NormSpecConst, lsz_x), sizeof(int));
+
+        VkSpecializationInfo spec_info;
+        spec_info.mapEntryCount = 1;
+        spec_info.pMapEntries = entry;
+        spec_info.dataSize = sizeof(spec_const);
+        spec_info.pData = &spec_const;
+
+        NN_GPU_DEBUG("VkCsExecutor::doL2_NORMALIZATION: run createPipeline");
+        opBase->createPipeline(sizeof(L2NormParam), &spec_info);
+    }
+
+    NN_GPU_DEBUG("VkCsExecutor::doL2_NORMALIZATION: bind operands");
+    opBase->bindOperand(input, 0, opBase->descriptor_set);
+    opBase->bindOperand(output, 1, opBase->descriptor_set);
+
+    NN_GPU_DEBUG("VkCsExecutor::doL2_NORMALIZATION: do recordCommandBuffer");
+    opBase->recordCommandBuffer((void *)&param, sizeof(L2NormParam));
+
+    NN_GPU_DEBUG("VkCsExecutor::doL2_NORMALIZATION: do runCommandBuffer");
+    opBase->runCommandBuffer();
+
+    NN_GPU_EXIT();
+
+    return true;
+}
+
+NAME_SPACE_STOP
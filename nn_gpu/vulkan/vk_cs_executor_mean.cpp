@@ -0,0 +1,137 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <cutils/properties.h>
+#include "gpu_executor.h"
+#include "vk_common.h"
+#include "vk_cs_executor.h"
+#include "shader/spv_shader.h"
+
+NAME_SPACE_BEGIN
+
+#define LOCAL_SZ_X 32
+#define MEAN_MAX_DIMS 4
+
+struct MeanSpecConst
+{
+    int lsz_x;
+};
+
+// the input is padded to 4D with leading 1s, see mean.comp
+struct MeanParam
+{
+    int out_ext[MEAN_MAX_DIMS];
+    int red_ext[MEAN_MAX_DIMS];
+    int stride[MEAN_MAX_DIMS];
+    int total;
+    int reduce_count;
+};
+
+bool VkCsExecutor::doMEAN(const Operation& operation)
+{
+    NN_GPU_ENTRY();
+
+    ASSERT(operation.type == OperationType::MEAN);
+
+#define BUFFER_NUM 2
+    opBase->initVulkanThing(BUFFER_NUM);
+
+    const hidl_vec<uint32_t>& ins = operation.inputs;
+    const hidl_vec<uint32_t>& outs = operation.outputs;
+
+    VkOperand& input  = operands[ins[0]];
+    VkOperand& axes   = operands[ins[1]];
+    VkOperand& output = operands[outs[0]];
+
+    const int rank = input.getNumberOfDimensions();
+    const int pad = MEAN_MAX_DIMS - rank;
+    ASSERT(rank <= MEAN_MAX_DIMS);
+
+    bool reduced[MEAN_MAX_DIMS] = {false, false, false, false};
+    for (int i = 0; i < axes.getElementCount(); ++i)
+    {
+        int axis = axes.getScalarData<int32_t>(i);
+        if (axis < 0)
+        {
+            axis += rank;
+        }
+        ASSERT(axis >= 0 && axis < rank);
+        reduced[axis + pad] = true;
+    }
+
+    MeanParam param;
+    param.total = 1;
+    param.reduce_count = 1;
+    int stride = 1;
+    for (int d = MEAN_MAX_DIMS - 1; d >= 0; --d)
+    {
+        const int dim = d < pad ? 1 : input.getDimensionSize(d - pad);
+        param.out_ext[d] = reduced[d] ? 1 : dim;
+        param.red_ext[d] = reduced[d] ? dim : 1;
+        param.stride[d] = stride;
+        param.total *= param.out_ext[d];
+        param.reduce_count *= param.red_ext[d];
+        stride *= dim;
+    }
+
+    ASSERT(param.total == output.getElementCount());
+
+    int local_size_x = LOCAL_SZ_X;
+    opBase->computeGroupCountX(param.total, local_size_x, local_size_x);
+    opBase->group_y = 1;
+    opBase->group_z = 1;
+
+    NN_GPU_DEBUG("VkCsExecutor::doMEAN: output count is %d, reduce count is %d, group_x is %d",
+        param.total, param.reduce_count, opBase->group_x);
+
+    if (opBase->pipeline == VK_NULL_HANDLE)
+    {
+        NN_GPU_DEBUG("VkCsExecutor::doMEAN: run createShaderModule");
+        opBase->createShaderModule(mean_spv, mean_spv_size);
+
+        MeanSpecConst spec_const = {local_size_x};
+        VkSpecializationMapEntry entry[1];
+        SET_SPEC_CONST_ENTRY(entry[0], 0, offsetof(MeanSpecConst, lsz_x), sizeof(int));
+
+        VkSpecializationInfo spec_info;
+        spec_info.mapEntryCount = 1;
+        spec_info.pMapEntries = entry;
+        spec_info.dataSize = sizeof(spec_const);
+        spec_info.pData = &spec_const;
+
+        NN_GPU_DEBUG("VkCsExecutor::doMEAN: run createPipeline");
+        opBase->createPipeline(sizeof(MeanParam), &spec_info);
+    }
+
+    NN_GPU_DEBUG("VkCsExecutor::doMEAN: bind operands");
+    opBase->bindOperand(input, 0, opBase->descriptor_set);
+    opBase->bindOperand(output, 1, opBase->descriptor_set);
+
+    NN_GPU_DEBUG("VkCsExecutor::doMEAN: do recordCommandBuffer");
+    opBase->recordCommandBuffer((void *)&param, sizeof(MeanParam));
+
+    NN_GPU_DEBUG("VkCsExecutor::doMEAN: do runCommandBuffer");
+    opBase->runCommandBuffer();
+
+    NN_GPU_EXIT();
+
+    return true;
+}
+
+NAME_SPACE_STOP
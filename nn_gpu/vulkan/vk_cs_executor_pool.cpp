@@ -21,15 +21,18 @@
 #include "gpu_executor.h"
 #include "vk_common.h"
 #include "vk_cs_executor.h"
+#include "vk_shader_variant.h"
 #include "shader/spv_shader.h"
 
 NAME_SPACE_BEGIN
 
-#define DEFAULT_LOCAL_SZ 256
-// TODO: query group count from vulkan device
-#define MAX_GROUP_COUNT_X 65535
-#define MAX_GROUP_COUNT_Y 65535
-#define MAX_GROUP_COUNT_Z 65535
+struct PoolSpecConst {
+      int local_sz_x;
+      int local_sz_y;
+      int local_sz_z;
+      int type;
+      int activation;
+};
 
 struct PoolParam {
       int channels;
@@ -43,8 +46,7 @@ struct PoolParam {
       int filter_w;
       int stride_h;
       int stride_w;
-      int total;
-      int mask_or_padded_area;
+      int batch;
 };
 
 enum OpPoolType { kPoolTypeAvg, kPoolTypeMax, kPoolTypeNum };
@@ -75,30 +77,13 @@ bool VkCsExecutor::doPool(const Operation& operation, ShaderConfig& config, cons
 
 	PaddingScheme padding_mode;
 
-	if (opBase->pipeline == VK_NULL_HANDLE)
-	{
-        if (type == kPoolTypeAvg)
-        {
-		    opBase->createShaderModule(avg_pool_spv, sizeof(avg_pool_spv));
-        }
-        else if (type == kPoolTypeMax)
-        {
-            opBase->createShaderModule(max_pool_spv, sizeof(max_pool_spv));
-        }
-
-		opBase->createPipeline(sizeof(PoolParam));
-	}
-
-	opBase->bindOperand(in, 0, opBase->descriptor_set);
-	opBase->bindOperand(out, 1, opBase->descriptor_set);
-
     PoolParam param;
     param.channels   = in_shape[kShapeIdxChannel];
     param.in_height  = in_shape[kShapeIdxHeight];
     param.in_width   = in_shape[kShapeIdxWidth];
     param.out_height = out_shape[kShapeIdxHeight];
     param.out_width  = out_shape[kShapeIdxWidth];
-    param.total      = out.getElementCount();
+    param.batch      = in_shape[kShapeIdxBatch];
 
     if (inCount == 10) {
         param.padding_left   = operands[ins[1]].getScalarData<uint32_t>();
@@ -107,9 +92,7 @@ bool VkCsExecutor::doPool(const Operation& operation, ShaderConfig& config, cons
         param.stride_h     = operands[ins[6]].getScalarData<uint32_t>();
         param.filter_w = operands[ins[7]].getScalarData<uint32_t>();
         param.filter_h = operands[ins[8]].getScalarData<uint32_t>();
-        //it is not used in compute shader, only support case of activtion as 0
         activation   = operands[ins[9]].getScalarData<uint32_t>();
-        assert(activation == 0);
     } else {
         padding_mode = static_cast<PaddingScheme>(operands[ins[1]].getScalarData<uint32_t>());
         param.stride_w     = operands[ins[2]].getScalarData<uint32_t>();
@@ -117,7 +100,6 @@ bool VkCsExecutor::doPool(const Operation& operation, ShaderConfig& config, cons
         param.filter_w = operands[ins[4]].getScalarData<uint32_t>();
         param.filter_h = operands[ins[5]].getScalarData<uint32_t>();
         activation   = operands[ins[6]].getScalarData<uint32_t>();
-        assert(activation == 0);
         calculateExplicitPadding(param.in_width, param.stride_w,
                                  param.filter_w, padding_mode,
                                  &param.padding_left);
@@ -126,31 +108,47 @@ bool VkCsExecutor::doPool(const Operation& operation, ShaderConfig& config, cons
                                  &param.padding_top);
     }
 
-    int32_t lsz_x  = config.local_size_x;
-    int32_t lsz_y  = config.local_size_y;
-    int32_t lsz_z  = config.local_size_z;
-    int32_t item_z = 1;
-
-    opBase->group_x = ceil(static_cast<float>(param.out_width) / lsz_x);
-    opBase->group_y = ceil(static_cast<float>(param.out_height) / lsz_y);
-    opBase->group_z = ceil(static_cast<float>((ceil(static_cast<float>(param.channels) / item_z))) / lsz_z);
-
-    /* for average pool, following member is used for padded_area, hard coded as true in vkcom,
-     * for max pool, it is used to indicate if mask tensor exist, we didn't support currently
-     */
-    if (type == kPoolTypeAvg)
-    {
-        param.mask_or_padded_area = 1;
-    }
-    else
-    {
-        param.mask_or_padded_area = 0;
-    }
+	if (opBase->pipeline == VK_NULL_HANDLE)
+	{
+        // the pooling type and the fused activation are folded into the pipeline
+        PoolSpecConst spec_const = {config.local_size_x, config.local_size_y, config.local_size_z,
+                                    type, activation};
+#define SPECIALIZATION_CONST_NUM 5
+        VkSpecializationMapEntry entry[SPECIALIZATION_CONST_NUM];
+        SET_SPEC_CONST_ENTRY(entry[0], 0, offsetof(PoolSpecConst, local_sz_x), sizeof(int));
+        SET_SPEC_CONST_ENTRY(entry[1], 1, offsetof(PoolSpecConst, local_sz_y), sizeof(int));
+        SET_SPEC_CONST_ENTRY(entry[2], 2, offsetof(PoolSpecConst, local_sz_z), sizeof(int));
+        SET_SPEC_CONST_ENTRY(entry[3], 3, offsetof(PoolSpecConst, type), sizeof(int));
+        SET_SPEC_CONST_ENTRY(entry[4], 4, offsetof(PoolSpecConst, activation), sizeof(int));
+
+        VkSpecializationInfo spec_info;
+        spec_info.mapEntryCount = SPECIALIZATION_CONST_NUM;
+        spec_info.pMapEntries = entry;
+        spec_info.dataSize = sizeof(spec_const);
+        spec_info.pData = &spec_const;
+
+        if (!checkSpecializationInfo("pool", spec_info))
+        {
+            LOGE("VkCsExecutor::doPool: invalid shader config");
+            return false;
+        }
+
+        opBase->createShaderModule(pool_spv, pool_spv_size);
+		opBase->createPipeline(sizeof(PoolParam), &spec_info);
+	}
+
+	opBase->bindOperand(in, 0, opBase->descriptor_set);
+	opBase->bindOperand(out, 1, opBase->descriptor_set);
+
+    // x: channel, y: output column, z: batch * output row, see pool.comp
+    opBase->group_x = alignSize(param.channels, config.local_size_x) / config.local_size_x;
+    opBase->group_y = alignSize(param.out_width, config.local_size_y) / config.local_size_y;
+    opBase->group_z = alignSize(param.batch * param.out_height, config.local_size_z) / config.local_size_z;
 
     NN_GPU_DEBUG("VkCsExecutor::doPool: param channels is %d, in height is %d, in width is %d, out height is %d, "
-        "out width is %d, total is %d, stride w is %d, stride h is %d, filter w is %d, filter h is %d, padded area is %d",
-        param.channels, param.in_height, param.in_width, param.out_height, param.out_width, param.total, param.stride_w,
-        param.stride_h, param.filter_w, param.filter_h, param.mask_or_padded_area);
+        "out width is %d, batch is %d, stride w is %d, stride h is %d, filter w is %d, filter h is %d, activation is %d",
+        param.channels, param.in_height, param.in_width, param.out_height, param.out_width, param.batch, param.stride_w,
+        param.stride_h, param.filter_w, param.filter_h, activation);
 
     opBase->recordCommandBuffer((void *)&param, sizeof(PoolParam));
     opBase->runCommandBuffer();
@@ -158,7 +156,6 @@ bool VkCsExecutor::doPool(const Operation& operation, ShaderConfig& config, cons
 	return true;
 }
 
-
 bool VkCsExecutor::doAVERAGE_POOL_2D(const Operation& operation)
 {
     NN_GPU_ENTRY();
@@ -0,0 +1,119 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <cutils/properties.h>
+#include "gpu_executor.h"
+#include "vk_common.h"
+#include "vk_cs_executor.h"
+#include "shader/spv_shader.h"
+
+NAME_SPACE_BEGIN
+
+#define LOCAL_SZ_X 64
+
+struct ResizeBilinearSpecConst
+{
+    int lsz_x;
+};
+
+struct ResizeBilinearParam
+{
+    int in_h;
+    int in_w;
+    int out_h;
+    int out_w;
+    int channels;
+    int total;
+    float scale_h;
+    float scale_w;
+};
+
+bool VkCsExecutor::doRESIZE_BILINEAR(const Operation& operation)
+{
+    NN_GPU_ENTRY();
+
+    ASSERT(operation.type == OperationType::RESIZE_BILINEAR);
+
+#define BUFFER_NUM 2
+    opBase->initVulkanThing(BUFFER_NUM);
+
+    const hidl_vec<uint32_t>& ins = operation.inputs;
+    const hidl_vec<uint32_t>& outs = operation.outputs;
+
+    VkOperand& input  = operands[ins[0]];
+    VkOperand& output = operands[outs[0]];
+
+    Shape in_shape  = input.getShape();
+    Shape out_shape = output.getShape();
+
+    ResizeBilinearParam param;
+    param.in_h     = in_shape[kShapeIdxHeight];
+    param.in_w     = in_shape[kShapeIdxWidth];
+    param.out_h    = operands[ins[2]].getScalarData<int>();
+    param.out_w    = operands[ins[1]].getScalarData<int>();
+    param.channels = in_shape[kShapeIdxChannel];
+    param.total    = output.getElementCount();
+    param.scale_h  = static_cast<float>(param.in_h) / param.out_h;
+    param.scale_w  = static_cast<float>(param.in_w) / param.out_w;
+
+    ASSERT(out_shape[kShapeIdxHeight] == (uint32_t)param.out_h && out_shape[kShapeIdxWidth] == (uint32_t)param.out_w);
+
+    int local_size_x = LOCAL_SZ_X;
+    opBase->computeGroupCountX(param.total, local_size_x, local_size_x);
+    opBase->group_y = 1;
+    opBase->group_z = 1;
+
+    NN_GPU_DEBUG("VkCsExecutor::doRESIZE_BILINEAR: in %dx%d, out %dx%d, channels %d, group_x is %d",
+        param.in_w, param.in_h, param.out_w, param.out_h, param.channels, opBase->group_x);
+
+    if (opBase->pipeline == VK_NULL_HANDLE)
+    {
+        NN_GPU_DEBUG("VkCsExecutor::doRESIZE_BILINEAR: run createShaderModule");
+        opBase->createShaderModule(resize_bilinear_spv, resize_bilinear_spv_size);
+
+        ResizeBilinearSpecConst spec_const = {local_size_x};
+        VkSpecializationMapEntry entry[1];
+        SET_SPEC_CONST_ENTRY(entry[0], 0, offsetof(ResizeBilinearSpecConst, lsz_x), sizeof(int));
+
+        VkSpecializationInfo spec_info;
+        spec_info.mapEntryCount = 1;
+        spec_info.pMapEntries = entry;
+        spec_info.dataSize = sizeof(spec_const);
+        spec_info.pData = &spec_const;
+
+        NN_GPU_DEBUG("VkCsExecutor::doRESIZE_BILINEAR: run createPipeline");
+        opBase->createPipeline(sizeof(ResizeBilinearParam), &spec_info);
+    }
+
+    NN_GPU_DEBUG("VkCsExecutor::doRESIZE_BILINEAR: bind operands");
+    opBase->bindOperand(input, 0, opBase->descriptor_set);
+    opBase->bindOperand(output, 1, opBase->descriptor_set);
+
+    NN_GPU_DEBUG("VkCsExecutor::doRESIZE_BILINEAR: do recordCommandBuffer");
+    opBase->recordCommandBuffer((void *)&param, sizeof(ResizeBilinearParam));
+
+    NN_GPU_DEBUG("VkCsExecutor::doRESIZE_BILINEAR: do runCommandBuffer");
+    opBase->runCommandBuffer();
+
+    NN_GPU_EXIT();
+
+    return true;
+}
+
+NAME_SPACE_STOP
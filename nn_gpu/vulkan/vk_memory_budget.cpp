@@ -0,0 +1,217 @@
+/*
+ * Copyright @2017 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cutils/properties.h>
+#include "vk_memory_budget.h"
+
+NAME_SPACE_BEGIN
+
+static const size_t kMegaByte = 1024 * 1024;
+
+VkMemoryBudget& VkMemoryBudget::get()
+{
+    static VkMemoryBudget instance;
+    return instance;
+}
+
+void VkMemoryBudget::init(size_t deviceBudget)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    int budgetMB = -1;
+    char prop[PROPERTY_VALUE_MAX] = "\0";
+    if (property_get("nn.gpgpu.memory.budget", prop, nullptr) > 0)
+    {
+        sscanf(prop, "%d", &budgetMB);
+    }
+
+    if (budgetMB >= 0)
+    {
+        budget = (size_t)budgetMB * kMegaByte;
+    }
+    else
+    {
+        budget = deviceBudget;
+    }
+
+    LOGD("VkMemoryBudget: budget is %zu MB%s", budget / kMegaByte, budget == 0 ? " (unlimited)" : "");
+}
+
+VkMemoryBudget::Client* VkMemoryBudget::findClient(VkMemoryBudgetClient* mgr)
+{
+    for (auto& client : clients)
+    {
+        if (client.mgr == mgr)
+        {
+            return &client;
+        }
+    }
+    return nullptr;
+}
+
+void VkMemoryBudget::registerClient(VkMemoryBudgetClient* mgr)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    ASSERT(findClient(mgr) == nullptr);
+    Client client = { mgr, false, ++clock, 0, 0 };
+    clients.push_back(client);
+}
+
+void VkMemoryBudget::unregisterClient(VkMemoryBudgetClient* mgr)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+        if (clients[i].mgr == mgr)
+        {
+            NN_GPU_PERF("VkMemoryBudget: model %p evicted %u times", mgr, clients[i].evictionCount);
+            clients.erase(clients.begin() + i);
+            return;
+        }
+    }
+}
+
+size_t VkMemoryBudget::evictClient(Client& client)
+{
+    ASSERT(!client.busy);
+
+    size_t bytes = client.mgr->evict();
+    client.resident = 0;
+    client.evictionCount++;
+
+    stats.evictionCount++;
+    stats.evictedBytes += bytes;
+
+    LOGD("VkMemoryBudget: evicted model %p, released %zu KB", client.mgr, bytes / 1024);
+    return bytes;
+}
+
+void VkMemoryBudget::acquire(VkMemoryBudgetClient* mgr)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    Client* self = findClient(mgr);
+    ASSERT(self != nullptr);
+    self->busy = true;
+    self->lastUsed = ++clock;
+
+    if (budget == 0)
+    {
+        return;
+    }
+
+    // the weights are the lower bound of the footprint before the first run
+    size_t used = self->resident > 0 ? self->resident : mgr->getWeightSize();
+    for (const auto& client : clients)
+    {
+        if (client.mgr != mgr)
+        {
+            used += client.resident;
+        }
+    }
+
+    while (used > budget)
+    {
+        Client* lru = nullptr;
+        for (auto& client : clients)
+        {
+            if (!client.busy && client.resident > 0 &&
+                (lru == nullptr || client.lastUsed < lru->lastUsed))
+            {
+                lru = &client;
+            }
+        }
+
+        if (lru == nullptr)
+        {
+            LOGW("VkMemoryBudget: %zu MB in use exceeds the budget of %zu MB, no idle model to evict",
+                 used / kMegaByte, budget / kMegaByte);
+            break;
+        }
+
+        size_t resident = lru->resident;
+        evictClient(*lru);
+        used -= resident;
+    }
+}
+
+void VkMemoryBudget::release(VkMemoryBudgetClient* mgr)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    Client* self = findClient(mgr);
+    ASSERT(self != nullptr);
+    self->busy = false;
+    self->lastUsed = ++clock;
+    self->resident = mgr->getResidentSize();
+}
+
+bool VkMemoryBudget::evictIdle()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    stats.allocFailures++;
+
+    size_t bytes = 0;
+    for (auto& client : clients)
+    {
+        if (!client.busy && client.resident > 0)
+        {
+            bytes += evictClient(client);
+        }
+    }
+
+    return bytes > 0;
+}
+
+void VkMemoryBudget::recordRestore(size_t bytes, long elapsedUs)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    stats.restoreCount++;
+    stats.restoredBytes += bytes;
+    stats.restoreTimeUs += elapsedUs;
+    stats.maxRestoreTimeUs = std::max(stats.maxRestoreTimeUs, elapsedUs);
+}
+
+VkMemoryBudgetStats VkMemoryBudget::getStats()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return stats;
+}
+
+void VkMemoryBudget::showStats()
+{
+    VkMemoryBudgetStats s = getStats();
+
+    NN_GPU_PERF("VkMemoryBudget: %u evictions released %zu KB, %u allocation failures",
+                s.evictionCount, s.evictedBytes / 1024, s.allocFailures);
+    if (s.restoreCount > 0)
+    {
+        NN_GPU_PERF("VkMemoryBudget: %u buffers (%zu KB) restored, average %f ms, max %f ms",
+                    s.restoreCount, s.restoredBytes / 1024,
+                    s.restoreTimeUs / 1000.f / s.restoreCount, s.maxRestoreTimeUs / 1000.f);
+    }
+}
+
+NAME_SPACE_STOP
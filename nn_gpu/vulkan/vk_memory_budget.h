@@ -0,0 +1,116 @@
+/*
+ * Copyright @2017 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ANDROID_HARDWARE_NEURALNETWORKS_V1_2_VK_MEMORY_BUDGET_H
+#define ANDROID_HARDWARE_NEURALNETWORKS_V1_2_VK_MEMORY_BUDGET_H
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include "../base.h"
+
+NAME_SPACE_BEGIN
+
+// The gpu memory of one prepared model as seen by VkMemoryBudget, implemented by
+// VkMemoryManager. Only called when the model is not running.
+class VkMemoryBudgetClient
+{
+public:
+    virtual ~VkMemoryBudgetClient() {}
+
+    virtual size_t getResidentSize() const = 0;
+    virtual size_t getWeightSize() const = 0;
+    // release the gpu buffers, returns the number of bytes released
+    virtual size_t evict() = 0;
+};
+
+struct VkMemoryBudgetStats
+{
+    VkMemoryBudgetStats() :
+        evictionCount(0), evictedBytes(0), restoreCount(0), restoredBytes(0),
+        restoreTimeUs(0), maxRestoreTimeUs(0), allocFailures(0)
+    {};
+
+    uint32_t evictionCount;     // number of model evictions
+    size_t evictedBytes;
+    uint32_t restoreCount;      // number of buffers uploaded again after an eviction
+    size_t restoredBytes;
+    long restoreTimeUs;
+    long maxRestoreTimeUs;
+    uint32_t allocFailures;     // allocations which failed before evicting idle models
+};
+
+// Process wide budget of the gpu memory used by the prepared models.
+// The budget is set by nn.gpgpu.memory.budget (in MB), or queried from
+// VK_EXT_memory_budget when the property is not set, 0 means unlimited.
+// A model registers its memory manager, which is busy between acquire()
+// and release(). Before a model runs, the least recently used idle models
+// are evicted until the last known footprint of the model fits into the
+// budget. The evicted buffers are re-created from their host copies the
+// next time they are bound.
+class VkMemoryBudget
+{
+public:
+    static VkMemoryBudget& get();
+
+    // a budget of its own, used by the tests
+    explicit VkMemoryBudget(size_t budgetBytes) : budget(budgetBytes), clock(0) {}
+
+    // deviceBudget is the VK_EXT_memory_budget size in bytes, 0 if unknown
+    void init(size_t deviceBudget);
+
+    void registerClient(VkMemoryBudgetClient* mgr);
+    void unregisterClient(VkMemoryBudgetClient* mgr);
+
+    void acquire(VkMemoryBudgetClient* mgr);
+    void release(VkMemoryBudgetClient* mgr);
+
+    // evict all idle models after an allocation failure, returns false if nothing is freed
+    bool evictIdle();
+
+    void recordRestore(size_t bytes, long elapsedUs);
+
+    VkMemoryBudgetStats getStats();
+    void showStats();
+
+private:
+    VkMemoryBudget() : budget(0), clock(0) {}
+
+    struct Client
+    {
+        VkMemoryBudgetClient* mgr;
+        bool busy;
+        uint64_t lastUsed;
+        size_t resident;        // footprint measured after the last run
+        uint32_t evictionCount;
+    };
+
+    size_t evictClient(Client& client);
+    Client* findClient(VkMemoryBudgetClient* mgr);
+
+    std::mutex mtx;
+    std::vector<Client> clients;
+    size_t budget;              // in bytes
+    uint64_t clock;
+    VkMemoryBudgetStats stats;
+};
+
+NAME_SPACE_STOP
+
+#endif
@@ -17,10 +17,12 @@
  */
 
 #include <sys/mman.h>
+#include <sys/time.h>
 #include "vk_common.h"
 #include "vk_memory_info.h"
 #include "vk_buffer.h"
 #include "vk_wrapper.h"
+#include "vk_memory_budget.h"
 
 NAME_SPACE_BEGIN
 
@@ -66,9 +68,40 @@ bool VkMemoryInfo::sync(std::string name)
 
 VkBuffer VkMemoryInfo::getVkBuffer()
 {
-	if (!buffer)
-		buffer.reset(new Buffer(length, userptr)); 
-	return buffer->getVkBuffer();
+    if (!buffer)
+    {
+        if (evicted)
+        {
+            struct timeval val;
+            gettimeofday(&val, NULL);
+            long start = val.tv_sec*1000000 + val.tv_usec;
+
+            buffer.reset(new Buffer(length, userptr));
+
+            gettimeofday(&val, NULL);
+            long end = val.tv_sec*1000000 + val.tv_usec;
+            VkMemoryBudget::get().recordRestore(length, end - start);
+            evicted = false;
+        }
+        else
+        {
+            buffer.reset(new Buffer(length, userptr));
+        }
+    }
+    return buffer->getVkBuffer();
+}
+
+size_t VkMemoryInfo::evict()
+{
+    if (!buffer)
+    {
+        return 0;
+    }
+
+    // the content of buffers without userptr is dead once the model is idle
+    buffer.reset();
+    evicted = (userptr != nullptr);
+    return length;
 }
 
 void VkMemoryInfo::dump()
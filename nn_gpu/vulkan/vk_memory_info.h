@@ -30,7 +30,7 @@ class VkMemoryInfo
 public:
     //todo, device is not set
     VkMemoryInfo(uint8_t* us, size_t le) :
-                userptr(us), length(le), inUsing(true), refCount(1), needSync(false)
+                userptr(us), length(le), inUsing(true), refCount(1), needSync(false), evicted(false)
                 {}
     ~VkMemoryInfo() {}
     bool sync(std::string name);
@@ -45,12 +45,15 @@ public:
     void dumpToFile(const char* file_name, const int channels = 0);
     void resetForTune();
     void copyToBuffer(float* to_buf, const size_t buf_size);
+    // release the gpu buffer, returns the released size in bytes
+    size_t evict();
 private:
     uint8_t* userptr;
     size_t length;
     bool inUsing;
     uint32_t refCount;
     bool needSync;
+    bool evicted;               // the buffer is re-created from userptr when it is bound again
     friend class VkMemoryManager;
     std::shared_ptr<Buffer> buffer;
 };
@@ -17,6 +17,7 @@
  */
 
 #include <sys/mman.h>
+#include <set>
 #include "vk_memory_manager.h"
 #include "vk_common.h"
 
@@ -121,6 +122,56 @@ bool VkMemoryManager::sync()
     return true;
 }
 
+size_t VkMemoryManager::getResidentSize() const
+{
+    // buffers might be shared between memory infos, count each of them once
+    std::set<const Buffer*> buffers;
+    size_t size = 0;
+
+    for (const std::vector<VkMemoryInfo>* memInfos : { &modelMemInfos, &intermediumMemInfos, &requestMemInfos })
+    {
+        for (const auto& mem : *memInfos)
+        {
+            if (mem.buffer && buffers.insert(mem.buffer.get()).second)
+            {
+                size += mem.length;
+            }
+        }
+    }
+
+    return size;
+}
+
+size_t VkMemoryManager::getWeightSize() const
+{
+    size_t size = 0;
+    for (const auto& mem : modelMemInfos)
+    {
+        size += mem.length;
+    }
+    return size;
+}
+
+size_t VkMemoryManager::evict()
+{
+    size_t size = 0;
+
+    for (auto& mem : modelMemInfos)
+    {
+        size += mem.evict();
+    }
+    for (auto& mem : intermediumMemInfos)
+    {
+        size += mem.evict();
+    }
+    for (auto& mem : requestMemInfos)
+    {
+        size += mem.evict();
+    }
+
+    return size;
+}
+
 void VkMemoryManager::cleanPoolInfos(std::vector<VkPoolInfo>& poolInfos) const
 {
     for (size_t i = 0; i < poolInfos.size(); i++)
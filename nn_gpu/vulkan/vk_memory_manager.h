@@ -22,10 +22,11 @@
 #include "base_executor.h"
 #include "vk_pool_info.h"
 #include "vk_memory_info.h"
+#include "vk_memory_budget.h"
 
 NAME_SPACE_BEGIN
 
-class VkMemoryManager
+class VkMemoryManager : public VkMemoryBudgetClient
 {
 public:
     VkMemoryManager() {}
@@ -53,6 +54,11 @@ public:
     VkMemoryInfo* createIntermediumMemoryInfo(size_t length);
     VkMemoryInfo* createIntermediumMemoryInfo(uint8_t* userptr, size_t length);
 
+    // for VkMemoryBudget, only called when the model is not running
+    size_t getResidentSize() const override;
+    size_t getWeightSize() const override;
+    size_t evict() override;
+
 private:
     std::vector<VkPoolInfo> modelPoolInfos;
     std::vector<VkMemoryInfo> modelMemInfos;
@@ -58,6 +58,14 @@ public:
         return data[0];
     }
 
+    // for small constant tensors such as axes, only valid with CONSTANT_COPY lifetime
+    template <typename T>
+    T getScalarData(uint32_t idx) const
+    {
+        const T* data = reinterpret_cast<const T*>(valPtr);
+        return data[idx];
+    }
+
     uint32_t getDimensionSize(uint32_t idx)
     {
         if (idx >= dimensions.size())
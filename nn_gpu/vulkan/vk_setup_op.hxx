@@ -9,3 +9,11 @@ SETUP_OP(LOCAL_RESPONSE_NORMALIZATION)
 SETUP_OP(DEPTHWISE_CONV_2D)
 SETUP_OP(LOGISTIC)
 SETUP_OP(RESHAPE)
+SETUP_OP(FULLY_CONNECTED)
+SETUP_OP(RELU)
+SETUP_OP(RELU1)
+SETUP_OP(RELU6)
+SETUP_OP(TANH)
+SETUP_OP(RESIZE_BILINEAR)
+SETUP_OP(L2_NORMALIZATION)
+SETUP_OP(MEAN)
@@ -0,0 +1,149 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include "vk_shader_variant.h"
+#include "shader/spv_shader.h"
+
+NAME_SPACE_BEGIN
+
+static const ShaderVariant shaderVariants[] =
+{
+#define SHADER_VARIANT(shader, spv, buffer_num) { #shader, spv, spv##_size, buffer_num },
+#define SPEC_CONST_RANGE(shader, id, name, min, max, def)
+#include "vk_shader_variants.hxx"
+#undef SPEC_CONST_RANGE
+#undef SHADER_VARIANT
+};
+
+static const SpecConstRange specConstRanges[] =
+{
+#define SHADER_VARIANT(shader, spv, buffer_num)
+#define SPEC_CONST_RANGE(shader, id, name, min, max, def) { #shader, id, #name, min, max, def },
+#include "vk_shader_variants.hxx"
+#undef SPEC_CONST_RANGE
+#undef SHADER_VARIANT
+};
+
+#define LOCAL_SZ_ID_NUM 3
+
+static const char* localSizeNames[LOCAL_SZ_ID_NUM] = { "LOCAL_SZ_X", "LOCAL_SZ_Y", "LOCAL_SZ_Z" };
+
+const ShaderVariant* findShaderVariant(const char* shader)
+{
+    for (const ShaderVariant& variant : shaderVariants)
+    {
+        if (strcmp(variant.name, shader) == 0)
+        {
+            return &variant;
+        }
+    }
+    return nullptr;
+}
+
+const SpecConstRange* findSpecConstRange(const char* shader, uint32_t id)
+{
+    for (const SpecConstRange& range : specConstRanges)
+    {
+        if (range.id == id && strcmp(range.shader, shader) == 0)
+        {
+            return &range;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<const SpecConstRange*> getSpecConstRanges(const char* shader)
+{
+    std::vector<const SpecConstRange*> ranges;
+    for (const SpecConstRange& range : specConstRanges)
+    {
+        if (strcmp(range.shader, shader) == 0)
+        {
+            ranges.push_back(&range);
+        }
+    }
+    return ranges;
+}
+
+int getSpecConstMax(const char* shader, uint32_t id, int default_max)
+{
+    const SpecConstRange* range = findSpecConstRange(shader, id);
+    return range ? range->max_value : default_max;
+}
+
+bool checkSpecializationInfo(const char* shader, const VkSpecializationInfo& spec_info)
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(spec_info.pData);
+    uint32_t local_size[LOCAL_SZ_ID_NUM] = {1, 1, 1};
+
+    for (uint32_t i = 0; i < spec_info.mapEntryCount; ++i)
+    {
+        const VkSpecializationMapEntry& entry = spec_info.pMapEntries[i];
+        if (entry.size != sizeof(int) || entry.offset + entry.size > spec_info.dataSize)
+        {
+            continue;
+        }
+
+        int value;
+        memcpy(&value, data + entry.offset, sizeof(int));
+
+        const SpecConstRange* range = findSpecConstRange(shader, entry.constantID);
+        if (range == nullptr)
+        {
+            continue;
+        }
+
+        if (value < range->min_value || value > range->max_value)
+        {
+            LOGE("%s: specialization constant %s = %d is out of range [%d, %d]",
+                 shader, range->name, value, range->min_value, range->max_value);
+            return false;
+        }
+
+        for (int d = 0; d < LOCAL_SZ_ID_NUM; ++d)
+        {
+            if (strcmp(range->name, localSizeNames[d]) == 0)
+            {
+                local_size[d] = value;
+            }
+        }
+    }
+
+    const VkPhysicalDeviceLimits& limits = kDeviceProps.limits;
+    for (int i = 0; i < LOCAL_SZ_ID_NUM; ++i)
+    {
+        if (local_size[i] > limits.maxComputeWorkGroupSize[i])
+        {
+            LOGE("%s: local size %u exceeds the device limit %u on dimension %d",
+                 shader, local_size[i], limits.maxComputeWorkGroupSize[i], i);
+            return false;
+        }
+    }
+
+    if (local_size[0] * local_size[1] * local_size[2] > limits.maxComputeWorkGroupInvocations)
+    {
+        LOGE("%s: workgroup of %u invocations exceeds the device limit %u", shader,
+             local_size[0] * local_size[1] * local_size[2], limits.maxComputeWorkGroupInvocations);
+        return false;
+    }
+
+    return true;
+}
+
+NAME_SPACE_STOP
@@ -0,0 +1,59 @@
+/*
+ * Copyright @2019 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ANDROID_HARDWARE_NEURALNETWORKS_V1_2_VK_SHADER_VARIANT_H
+#define ANDROID_HARDWARE_NEURALNETWORKS_V1_2_VK_SHADER_VARIANT_H
+
+#include "vk_common.h"
+
+NAME_SPACE_BEGIN
+
+// A shader variant is one embedded SPIR-V blob specialized at pipeline creation
+// through VkSpecializationInfo. The tunable constants and their legal ranges are
+// registered in vk_shader_variants.hxx.
+struct ShaderVariant
+{
+    const char* name;
+    const uint32_t* spv;
+    size_t spv_size;
+    int buffer_num;
+};
+
+struct SpecConstRange
+{
+    const char* shader;
+    uint32_t id;
+    const char* name;
+    int min_value;
+    int max_value;
+    int default_value;
+};
+
+const ShaderVariant* findShaderVariant(const char* shader);
+const SpecConstRange* findSpecConstRange(const char* shader, uint32_t id);
+std::vector<const SpecConstRange*> getSpecConstRanges(const char* shader);
+
+// upper bound the tuner may use for a constant, default_max if it is not registered
+int getSpecConstMax(const char* shader, uint32_t id, int default_max);
+
+// check every registered constant in spec_info, and the workgroup size against the device limit
+bool checkSpecializationInfo(const char* shader, const VkSpecializationInfo& spec_info);
+
+NAME_SPACE_STOP
+
+#endif
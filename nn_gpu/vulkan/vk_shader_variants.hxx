@@ -0,0 +1,36 @@
+// Tunable specialization constants of the compute shaders, see vk_shader_variant.h.
+// Also parsed by shader/validate_variants.py, keep one entry per line.
+//
+// SHADER_VARIANT(shader, spv, buffer_num)
+// SPEC_CONST_RANGE(shader, constant_id, name, min, max, default)
+
+SHADER_VARIANT(conv, conv_spv, 4)
+SPEC_CONST_RANGE(conv, 0, LOCAL_SZ_X, 1, 256, 1)
+SPEC_CONST_RANGE(conv, 1, LOCAL_SZ_Y, 1, 256, 16)
+SPEC_CONST_RANGE(conv, 2, LOCAL_SZ_Z, 1, 32, 1)
+SPEC_CONST_RANGE(conv, 18, ACTIVATION, 0, 3, 0)
+
+SHADER_VARIANT(conv_gemm1, conv_gemm1_spv, 4)
+SPEC_CONST_RANGE(conv_gemm1, 0, LOCAL_SZ_X, 1, 256, 1)
+SPEC_CONST_RANGE(conv_gemm1, 1, LOCAL_SZ_Y, 1, 256, 16)
+SPEC_CONST_RANGE(conv_gemm1, 2, LOCAL_SZ_Z, 1, 1, 1)
+SPEC_CONST_RANGE(conv_gemm1, 18, ACTIVATION, 0, 3, 0)
+
+SHADER_VARIANT(conv_gemmShader4_8, conv_gemmShader4_8_spv, 4)
+SPEC_CONST_RANGE(conv_gemmShader4_8, 0, LOCAL_SZ_X, 1, 1, 1)
+SPEC_CONST_RANGE(conv_gemmShader4_8, 1, LOCAL_SZ_Y, 1, 256, 16)
+SPEC_CONST_RANGE(conv_gemmShader4_8, 2, LOCAL_SZ_Z, 1, 1, 1)
+SPEC_CONST_RANGE(conv_gemmShader4_8, 18, ACTIVATION, 0, 3, 0)
+
+SHADER_VARIANT(elewise, elewise_spv, 3)
+SPEC_CONST_RANGE(elewise, 0, LOCAL_SZ_X, 1, 1024, 8)
+SPEC_CONST_RANGE(elewise, 1, ACTIVATION, 0, 3, 0)
+SPEC_CONST_RANGE(elewise, 2, BROADCAST, 0, 1, 0)
+SPEC_CONST_RANGE(elewise, 3, TYPE, 0, 1, 0)
+
+SHADER_VARIANT(pool, pool_spv, 2)
+SPEC_CONST_RANGE(pool, 0, LOCAL_SZ_X, 1, 256, 8)
+SPEC_CONST_RANGE(pool, 1, LOCAL_SZ_Y, 1, 256, 8)
+SPEC_CONST_RANGE(pool, 2, LOCAL_SZ_Z, 1, 64, 1)
+SPEC_CONST_RANGE(pool, 3, TYPE, 0, 1, 0)
+SPEC_CONST_RANGE(pool, 4, ACTIVATION, 0, 3, 0)